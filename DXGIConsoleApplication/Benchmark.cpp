@@ -0,0 +1,1288 @@
+// Benchmark.cpp : Microbenchmarks of the CPU side frame paths over synthetic frames.
+//
+
+#include "Benchmark.h"
+#include "RegionCopy.h"
+#include "ImageView.h"
+#include "FrameHash.h"
+#include "ColorConvert.h"
+#include "FrameWriter.h"
+#include "RectCoalesce.h"
+#include "RecordingFile.h"
+#include "PointerComposite.h"
+#include "ScreenCodec.h"
+#include "Downscale.h"
+#include "CaptureRegion.h"
+#include "FrameRing.h"
+#include "FrameShare.h"
+#include "EventLog.h"
+#include "DuplicationManager.h"
+#include <malloc.h>
+#include <math.h>
+#include <stdlib.h>
+
+// Small rects scattered over the screen, like a caret and text being typed
+#define BENCH_TYPING_RECTS  24
+
+// Glyph cells of a few lines of text redrawn one by one, then a spinner redrawn in overlapping steps
+#define BENCH_SLIVER_LINES      3
+#define BENCH_SLIVER_GLYPHS     16
+#define BENCH_SPINNER_STEPS     16
+#define BENCH_SLIVER_RECTS      (BENCH_SLIVER_LINES * BENCH_SLIVER_GLYPHS + BENCH_SPINNER_STEPS)
+
+// Move rects the rotation math is run over per operation
+#define BENCH_MOVE_RECTS    64
+
+// Rows a scroll moves the content by
+#define BENCH_SCROLL_ROWS   48
+
+// Color pointer shape with soft edges, as large as the default pointer at 150% scaling
+#define BENCH_POINTER_SIZE  48
+
+// Writing bitmaps goes to disk, a few repetitions are enough to see a trend
+#define BENCH_DISK_REPETITIONS  3
+
+// Frames handed from the producer to a consumer per ring handoff measurement, and their size
+#define BENCH_RING_FRAMES   2000
+#define BENCH_RING_WIDTH    64
+#define BENCH_RING_HEIGHT   64
+#define BENCH_RING_SIZE     4
+
+// Frames of the ring handoff size published to a reader process per shared frame measurement
+#define BENCH_SHARE_FRAMES      2000
+
+// Time a reader process gets to attach, and the longest it waits for the next frame
+#define BENCH_SHARE_TIMEOUT_MS  5000
+
+// Log calls timed together, the ring takes a batch without dropping, and batches per measurement
+#define BENCH_LOG_BATCH     128
+#define BENCH_LOG_BATCHES   400
+
+typedef struct _BENCH_RESOLUTION
+{
+	const char* Name;
+	UINT Width;
+	UINT Height;
+} BENCH_RESOLUTION;
+
+static const BENCH_RESOLUTION Resolutions[] =
+{
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4K", 3840, 2160 },
+	{ "8K", 7680, 4320 }
+};
+
+//
+// Synthetic frame and rect distributions one resolution is benchmarked with
+//
+typedef struct _BENCH_FRAME
+{
+	UINT Width;
+	UINT Height;
+	UINT Pitch;                 // Padded like a staging texture row
+	BYTE* Src;
+	BYTE* Dst;
+	BYTE* Packed;
+	BYTE* Yuv;
+	BYTE* Screen;               // Desktop like content the codec is measured on, Src is noise
+	BYTE* Encoded;
+	UINT EncodedCapacity;
+	UINT EncodedSize;
+	RECT Typing[BENCH_TYPING_RECTS];
+	RECT Slivers[BENCH_SLIVER_RECTS];
+	RECT Merged[BENCH_SLIVER_RECTS];     // Scratch the rects are merged in, merging works in place
+	RECT* Recorded;             // Dirty rects of every frame of a recording, one after the other
+	UINT* RecordedCounts;       // Dirty rects per frame
+	UINT RecordedFrames;
+	UINT RecordedRects;
+	RECT* RecordedScratch;
+	RECT Window;                // One window redrawing, about 40% of the screen
+	REGION_LAYOUT Panel;        // Capture region of a panel, a ninth of the screen overlapping the window
+	RECT PanelRects[BENCH_TYPING_RECTS];
+	DXGI_OUTDUPL_MOVE_RECT Scroll;
+	RECT ScrollDirty;           // Rows uncovered by the scroll
+	DXGI_OUTDUPL_MOVE_RECT Moves[BENCH_MOVE_RECTS];
+	FRAMEHASH* Hash;
+	POINTER_STATE Pointer;
+	POINTERCOMPOSITOR* Compositor;
+	FRAMEPYRAMID* BoxPyramid;
+	UINT Counter;
+} BENCH_FRAME;
+
+// Returns the pixel bytes the operation touched
+typedef UINT64 (*BENCH_OP)(_Inout_ BENCH_FRAME* Frame);
+
+// Keeps the compiler from discarding results nobody reads
+static volatile UINT64 Sink;
+
+static UINT Random(_Inout_ UINT* State)
+{
+	*State = *State * 1664525 + 1013904223;
+	return *State >> 8;
+}
+
+static UINT64 GetTicks()
+{
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+	return Now.QuadPart;
+}
+
+static UINT64 BenchTyping(_Inout_ BENCH_FRAME* Frame)
+{
+	return CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Frame->Typing, BENCH_TYPING_RECTS);
+}
+
+static UINT64 BenchWindow(_Inout_ BENCH_FRAME* Frame)
+{
+	return CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, &Frame->Window, 1);
+}
+
+static UINT64 BenchRegionWindow(_Inout_ BENCH_FRAME* Frame)
+{
+	// Window redraw as a capture of the panel sees it, read back from a staging texture of the panel's size
+	UINT Count = ClipRectsToRegions(Frame->PanelRects, &Frame->Panel, nullptr, 0, &Frame->Window, 1);
+	return CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Panel.Width, Frame->Panel.Height, Frame->PanelRects, Count);
+}
+
+static UINT64 BenchRegionTyping(_Inout_ BENCH_FRAME* Frame)
+{
+	UINT Count = ClipRectsToRegions(Frame->PanelRects, &Frame->Panel, nullptr, 0, Frame->Typing, BENCH_TYPING_RECTS);
+	return CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Panel.Width, Frame->Panel.Height, Frame->PanelRects, Count);
+}
+
+static UINT64 BenchScroll(_Inout_ BENCH_FRAME* Frame)
+{
+	UINT64 Bytes = ApplyMoveRects(Frame->Dst, Frame->Pitch, Frame->Width, Frame->Height, &Frame->Scroll, 1,
+		DXGI_MODE_ROTATION_IDENTITY, Frame->Width, Frame->Height);
+	return Bytes + CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, &Frame->ScrollDirty, 1);
+}
+
+static UINT64 BenchCoalesceTyping(_Inout_ BENCH_FRAME* Frame)
+{
+	memcpy(Frame->Merged, Frame->Typing, sizeof(Frame->Typing));
+	Sink += CoalesceRects(Frame->Merged, BENCH_TYPING_RECTS, nullptr);
+	return 0;
+}
+
+static UINT64 BenchCoalesceSlivers(_Inout_ BENCH_FRAME* Frame)
+{
+	memcpy(Frame->Merged, Frame->Slivers, sizeof(Frame->Slivers));
+	Sink += CoalesceRects(Frame->Merged, BENCH_SLIVER_RECTS, nullptr);
+	return 0;
+}
+
+static UINT64 BenchSlivers(_Inout_ BENCH_FRAME* Frame)
+{
+	return CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Frame->Slivers, BENCH_SLIVER_RECTS);
+}
+
+static UINT64 BenchSliversMerged(_Inout_ BENCH_FRAME* Frame)
+{
+	memcpy(Frame->Merged, Frame->Slivers, sizeof(Frame->Slivers));
+	UINT Count = CoalesceRects(Frame->Merged, BENCH_SLIVER_RECTS, nullptr);
+	return CopyRegions(Frame->Dst, Frame->Pitch, Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Frame->Merged, Count);
+}
+
+//
+// Slivers of a rotated output mapped upright, the acquired image is in portrait
+//
+static UINT64 BenchRotateRects(_Inout_ BENCH_FRAME* Frame)
+{
+	RotateRects(Frame->Merged, Frame->Slivers, BENCH_SLIVER_RECTS, DXGI_MODE_ROTATION_ROTATE90, Frame->Height, Frame->Width);
+	Sink += Frame->Merged[Frame->Counter++ % BENCH_SLIVER_RECTS].left;
+	return 0;
+}
+
+//
+// The same as CAPTUREMANAGER mapped them before RotateRects: a SetMoveRectForRotation per rect
+//
+static UINT64 BenchRotateRectsPerRect(_Inout_ BENCH_FRAME* Frame)
+{
+	for (UINT i = 0; i < BENCH_SLIVER_RECTS; ++i)
+	{
+		DXGI_OUTDUPL_MOVE_RECT Move;
+		RtlZeroMemory(&Move, sizeof(Move));
+		Move.DestinationRect = Frame->Slivers[i];
+		RECT Unused;
+		SetMoveRectForRotation(&Unused, &Frame->Merged[i], DXGI_MODE_ROTATION_ROTATE90, &Move, Frame->Height, Frame->Width);
+	}
+	Sink += Frame->Merged[Frame->Counter++ % BENCH_SLIVER_RECTS].left;
+	return 0;
+}
+
+static UINT64 BenchPointerMove(_Inout_ BENCH_FRAME* Frame)
+{
+	// Take the pointer out where it was and draw it a few pixels further, like a pointer only update
+	RECT Rects[2];
+	Frame->Compositor->Erase(Frame->Dst, Frame->Pitch, &Rects[0]);
+	UINT Step = Frame->Counter++ % 64;
+	Frame->Pointer.Position.x = (Frame->Width / 3) + Step * 5;
+	Frame->Pointer.Position.y = (Frame->Height / 3) + Step * 3;
+	Frame->Compositor->Draw(Frame->Dst, Frame->Pitch, Frame->Width, Frame->Height, &Frame->Pointer, &Rects[1]);
+	return 2 * BENCH_POINTER_SIZE * BENCH_POINTER_SIZE * BPP;
+}
+
+static UINT64 BenchCoalesceRecorded(_Inout_ BENCH_FRAME* Frame)
+{
+	memcpy(Frame->RecordedScratch, Frame->Recorded, Frame->RecordedRects * sizeof(RECT));
+	RECT* Rects = Frame->RecordedScratch;
+	for (UINT f = 0; f < Frame->RecordedFrames; ++f)
+	{
+		Sink += CoalesceRects(Rects, Frame->RecordedCounts[f], nullptr);
+		Rects += Frame->RecordedCounts[f];
+	}
+	return 0;
+}
+
+static UINT64 MoveRectMath(_Inout_ BENCH_FRAME* Frame, DXGI_MODE_ROTATION Rotation)
+{
+	RECT SrcRect, DestRect;
+	UINT64 Sum = 0;
+	for (UINT i = 0; i < BENCH_MOVE_RECTS; ++i)
+	{
+		SetMoveRectForRotation(&SrcRect, &DestRect, Rotation, &Frame->Moves[i], Frame->Width, Frame->Height);
+		Sum += SrcRect.left + DestRect.bottom;
+	}
+	Sink += Sum;
+	return 0;
+}
+
+static UINT64 BenchMoveRectIdentity(_Inout_ BENCH_FRAME* Frame)
+{
+	return MoveRectMath(Frame, DXGI_MODE_ROTATION_IDENTITY);
+}
+
+static UINT64 BenchMoveRectRotate90(_Inout_ BENCH_FRAME* Frame)
+{
+	return MoveRectMath(Frame, DXGI_MODE_ROTATION_ROTATE90);
+}
+
+static UINT64 BenchMoveRectRotate180(_Inout_ BENCH_FRAME* Frame)
+{
+	return MoveRectMath(Frame, DXGI_MODE_ROTATION_ROTATE180);
+}
+
+static UINT64 BenchMoveRectRotate270(_Inout_ BENCH_FRAME* Frame)
+{
+	return MoveRectMath(Frame, DXGI_MODE_ROTATION_ROTATE270);
+}
+
+static UINT64 BenchPack(_Inout_ BENCH_FRAME* Frame)
+{
+	IMAGE_VIEW View = { Frame->Src, Frame->Width, Frame->Height, Frame->Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+	return CopyImagePacked(Frame->Packed, Frame->Width * BPP, &View, nullptr);
+}
+
+static UINT64 BenchHash(_Inout_ BENCH_FRAME* Frame)
+{
+	// Touch one row so every call sees a changed frame
+	Frame->Src[(Frame->Counter++ % Frame->Height) * Frame->Pitch] ^= 1;
+	Sink += Frame->Hash->Update(Frame->Src, Frame->Pitch, Frame->Width, Frame->Height);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchEncodeScreen(_Inout_ BENCH_FRAME* Frame)
+{
+	Frame->EncodedSize = EncodeScreenFrame(Frame->Encoded, Frame->EncodedCapacity, Frame->Screen, Frame->Pitch, Frame->Width, Frame->Height, SCREENCODEC_STRIP_ROWS);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchDecodeScreen(_Inout_ BENCH_FRAME* Frame)
+{
+	Sink += DecodeScreenFrame(Frame->Dst, Frame->Pitch, Frame->Width, Frame->Height, Frame->Encoded, Frame->EncodedSize);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchEncodeNoise(_Inout_ BENCH_FRAME* Frame)
+{
+	Frame->EncodedSize = EncodeScreenFrame(Frame->Encoded, Frame->EncodedCapacity, Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, SCREENCODEC_STRIP_ROWS);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchPyramidBox(_Inout_ BENCH_FRAME* Frame)
+{
+	IMAGE_VIEW View = { Frame->Src, Frame->Width, Frame->Height, Frame->Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+	Frame->BoxPyramid->Update(&View, nullptr, nullptr);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchBilinear8x(_Inout_ BENCH_FRAME* Frame)
+{
+	// Reads two rows of every eight
+	DownscaleBGRABilinear(Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Frame->Packed, GetDownscaledSize(Frame->Width, 3) * BPP, 8);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchPyramidTyping(_Inout_ BENCH_FRAME* Frame)
+{
+	IMAGE_VIEW View = { Frame->Src, Frame->Width, Frame->Height, Frame->Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+	FRAME_METADATA Meta;
+	RtlZeroMemory(&Meta, sizeof(Meta));
+	Meta.MetaData = reinterpret_cast<BYTE*>(Frame->Typing);
+	Meta.MetaDataSize = sizeof(Frame->Typing);
+	Meta.DirtyCount = BENCH_TYPING_RECTS;
+	Frame->BoxPyramid->Update(&View, &Meta, nullptr);
+
+	UINT64 Bytes = 0;
+	for (UINT i = 0; i < BENCH_TYPING_RECTS; ++i)
+	{
+		Bytes += static_cast<UINT64>(Frame->Typing[i].right - Frame->Typing[i].left) * BPP * (Frame->Typing[i].bottom - Frame->Typing[i].top);
+	}
+	return Bytes;
+}
+
+static UINT64 BenchI420(_Inout_ BENCH_FRAME* Frame)
+{
+	UINT ChromaWidth = (Frame->Width + 1) / 2;
+	UINT ChromaHeight = (Frame->Height + 1) / 2;
+	BYTE* Y = Frame->Yuv;
+	BYTE* U = Y + Frame->Width * Frame->Height;
+	BYTE* V = U + ChromaWidth * ChromaHeight;
+	ConvertBGRAToI420(Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Y, Frame->Width, U, ChromaWidth, V, ChromaWidth, COLOR_MATRIX_BT709);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchNV12(_Inout_ BENCH_FRAME* Frame)
+{
+	BYTE* Y = Frame->Yuv;
+	BYTE* UV = Y + Frame->Width * Frame->Height;
+	ConvertBGRAToNV12(Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Y, Frame->Width, UV, ((Frame->Width + 1) / 2) * 2, COLOR_MATRIX_BT709);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchYUY2(_Inout_ BENCH_FRAME* Frame)
+{
+	ConvertBGRAToYUY2(Frame->Src, Frame->Pitch, Frame->Width, Frame->Height, Frame->Yuv, ((Frame->Width + 1) / 2) * 4, COLOR_MATRIX_BT709);
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static UINT64 BenchBitmap(_Inout_ BENCH_FRAME* Frame)
+{
+	IMAGE_VIEW View = { Frame->Src, Frame->Width, Frame->Height, Frame->Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+	Sink += save_as_bitmap(&View, "bench.bmp");
+	return static_cast<UINT64>(Frame->Width) * BPP * Frame->Height;
+}
+
+static int CompareDouble(const void* a, const void* b)
+{
+	double x = *reinterpret_cast<const double*>(a);
+	double y = *reinterpret_cast<const double*>(b);
+	return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+//
+// Time Op over Repetitions repetitions. The iteration count is calibrated once so a
+// repetition lasts at least BENCH_MIN_REPETITION_MS, which keeps timer resolution out of the numbers.
+//
+static bool Measure(BENCH_OP Op, _Inout_ BENCH_FRAME* Frame, UINT Repetitions, _Out_ BENCH_RESULT* Result)
+{
+	RtlZeroMemory(Result, sizeof(BENCH_RESULT));
+
+	double* Samples = new (std::nothrow) double[Repetitions];
+	if (!Samples)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+
+	// Warm up caches and the page tables, then calibrate on a second run
+	Result->BytesPerOp = Op(Frame);
+	UINT64 Start = GetTicks();
+	Sink += Op(Frame);
+	UINT64 Once = GetTicks() - Start;
+	UINT64 Target = Frequency.QuadPart * BENCH_MIN_REPETITION_MS / 1000;
+	Result->Iterations = Once ? (Target + Once - 1) / Once : Target;
+	if (!Result->Iterations)
+	{
+		Result->Iterations = 1;
+	}
+
+	double Sum = 0;
+	for (UINT r = 0; r < Repetitions; ++r)
+	{
+		Start = GetTicks();
+		for (UINT64 i = 0; i < Result->Iterations; ++i)
+		{
+			Sink += Op(Frame);
+		}
+		UINT64 Elapsed = GetTicks() - Start;
+
+		Samples[r] = Elapsed * 1e9 / Frequency.QuadPart / Result->Iterations;
+		Sum += Samples[r];
+	}
+
+	qsort(Samples, Repetitions, sizeof(double), CompareDouble);
+	Result->MinNs = Samples[0];
+	Result->MedianNs = (Repetitions % 2) ? Samples[Repetitions / 2] : (Samples[Repetitions / 2 - 1] + Samples[Repetitions / 2]) / 2;
+	Result->MeanNs = Sum / Repetitions;
+
+	double Variance = 0;
+	for (UINT r = 0; r < Repetitions; ++r)
+	{
+		Variance += (Samples[r] - Result->MeanNs) * (Samples[r] - Result->MeanNs);
+	}
+	Result->StdDevNs = (Repetitions > 1) ? sqrt(Variance / (Repetitions - 1)) : 0;
+
+	delete [] Samples;
+	return true;
+}
+
+static void Report(_In_ FILE* Out, _In_z_ const char* Name, _In_z_ const char* Resolution, _In_ const BENCH_RESULT* Result)
+{
+	double MBPerSecond = Result->MedianNs ? Result->BytesPerOp * 1e3 / Result->MedianNs : 0;
+	fprintf_s(Out, "%-22s %-6s %14.1f ns/op  min %14.1f  stddev %5.1f%%  %10.1f MB/s  (%llu x %llu bytes)\n",
+		Name, Resolution, Result->MedianNs, Result->MinNs,
+		Result->MeanNs ? Result->StdDevNs * 100.0 / Result->MeanNs : 0.0, MBPerSecond,
+		Result->Iterations, Result->BytesPerOp);
+}
+
+//
+// Fill the frame with noise and lay out the rect distributions
+//
+static bool CreateFrame(_Out_ BENCH_FRAME* Frame, UINT Width, UINT Height)
+{
+	RtlZeroMemory(Frame, sizeof(BENCH_FRAME));
+	Frame->Width = Width;
+	Frame->Height = Height;
+	Frame->Pitch = Width * BPP + 64;
+
+	SIZE_T FrameBytes = static_cast<SIZE_T>(Frame->Pitch) * Height;
+	Frame->Src = reinterpret_cast<BYTE*>(_aligned_malloc(FrameBytes, 64));
+	Frame->Dst = reinterpret_cast<BYTE*>(_aligned_malloc(FrameBytes, 64));
+	Frame->Packed = reinterpret_cast<BYTE*>(_aligned_malloc(static_cast<SIZE_T>(Width) * BPP * Height, 64));
+	Frame->Yuv = reinterpret_cast<BYTE*>(_aligned_malloc(static_cast<SIZE_T>((Width + 1) / 2) * 4 * Height, 64));
+	Frame->Screen = reinterpret_cast<BYTE*>(_aligned_malloc(FrameBytes, 64));
+	Frame->EncodedCapacity = GetMaxEncodedSize(Width, Height, SCREENCODEC_STRIP_ROWS);
+	Frame->Encoded = reinterpret_cast<BYTE*>(_aligned_malloc(Frame->EncodedCapacity, 64));
+	Frame->Hash = new (std::nothrow) FRAMEHASH;
+	Frame->Compositor = new (std::nothrow) POINTERCOMPOSITOR;
+	Frame->BoxPyramid = new (std::nothrow) FRAMEPYRAMID;
+	Frame->Pointer.BufferSize = BENCH_POINTER_SIZE * BENCH_POINTER_SIZE * BPP;
+	Frame->Pointer.ShapeBuffer = new (std::nothrow) BYTE[Frame->Pointer.BufferSize];
+	if (!Frame->Src || !Frame->Dst || !Frame->Packed || !Frame->Yuv || !Frame->Screen || !Frame->Encoded ||
+		!Frame->Hash || !Frame->Compositor || !Frame->BoxPyramid || !Frame->Pointer.ShapeBuffer)
+	{
+		return false;
+	}
+
+	UINT Seed = Width * 31 + Height;
+	UINT* Pixels = reinterpret_cast<UINT*>(Frame->Src);
+	for (SIZE_T i = 0; i < FrameBytes / sizeof(UINT); ++i)
+	{
+		Pixels[i] = Random(&Seed) | 0xFF000000;
+	}
+	memcpy(Frame->Dst, Frame->Src, FrameBytes);
+
+	// Flat background, a taskbar and a few windows with title bars and lines of text
+	for (UINT y = 0; y < Height; ++y)
+	{
+		UINT* Row = reinterpret_cast<UINT*>(Frame->Screen + static_cast<SIZE_T>(y) * Frame->Pitch);
+		for (UINT x = 0; x < Width; ++x)
+		{
+			Row[x] = (y >= Height - 40) ? 0xFF202830 : 0xFF3A6EA5;
+		}
+	}
+	for (UINT w = 0; w < 4; ++w)
+	{
+		UINT Left = Random(&Seed) % (Width / 2);
+		UINT Top = Random(&Seed) % (Height / 2);
+		UINT Right = Left + Width / 3 + Random(&Seed) % (Width / 6);
+		UINT Bottom = Top + Height / 3 + Random(&Seed) % (Height / 6);
+		for (UINT y = Top; y < Bottom; ++y)
+		{
+			UINT* Row = reinterpret_cast<UINT*>(Frame->Screen + static_cast<SIZE_T>(y) * Frame->Pitch);
+			bool TextLine = (y > Top + 40) && ((y - Top) % 20 < 12);
+			for (UINT x = Left; x < Right; ++x)
+			{
+				UINT Pixel = (y < Top + 30) ? 0xFFF0F0F0 : 0xFFFFFFFF;
+				if (TextLine && x > Left + 8 && (x - Left) % 9 < 7 && Random(&Seed) % 3 == 0)
+				{
+					Pixel = 0xFF000000 | (Random(&Seed) % 96) * 0x010101;
+				}
+				Row[x] = Pixel;
+			}
+		}
+	}
+	Frame->EncodedSize = EncodeScreenFrame(Frame->Encoded, Frame->EncodedCapacity, Frame->Screen, Frame->Pitch, Width, Height, SCREENCODEC_STRIP_ROWS);
+
+	// Opaque in the middle, alpha falling off towards the edges
+	Frame->Pointer.ShapeInfo.Type = DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR;
+	Frame->Pointer.ShapeInfo.Width = BENCH_POINTER_SIZE;
+	Frame->Pointer.ShapeInfo.Height = BENCH_POINTER_SIZE;
+	Frame->Pointer.ShapeInfo.Pitch = BENCH_POINTER_SIZE * BPP;
+	Frame->Pointer.Visible = true;
+	Frame->Pointer.HasShape = true;
+	UINT* Shape = reinterpret_cast<UINT*>(Frame->Pointer.ShapeBuffer);
+	for (UINT y = 0; y < BENCH_POINTER_SIZE; ++y)
+	{
+		for (UINT x = 0; x < BENCH_POINTER_SIZE; ++x)
+		{
+			UINT Edge = min(min(x, y), min(BENCH_POINTER_SIZE - 1 - x, BENCH_POINTER_SIZE - 1 - y));
+			UINT Alpha = min(Edge * 32, 255u);
+			Shape[y * BENCH_POINTER_SIZE + x] = (Alpha << 24) | (Random(&Seed) & 0x00FFFFFF);
+		}
+	}
+
+	for (UINT i = 0; i < BENCH_TYPING_RECTS; ++i)
+	{
+		LONG x = Random(&Seed) % (Width - 200);
+		LONG y = Random(&Seed) % (Height - 40);
+		SetRect(&Frame->Typing[i], x, y, x + 16 + Random(&Seed) % 184, y + 8 + Random(&Seed) % 32);
+	}
+
+	// Glyph cells touch each other and the lines touch too, the spinner steps overlap
+	UINT Sliver = 0;
+	LONG TextX = Random(&Seed) % (Width / 2);
+	LONG TextY = Random(&Seed) % (Height / 2);
+	for (UINT l = 0; l < BENCH_SLIVER_LINES; ++l)
+	{
+		for (UINT g = 0; g < BENCH_SLIVER_GLYPHS; ++g, ++Sliver)
+		{
+			SetRect(&Frame->Slivers[Sliver], TextX + g * 9, TextY + l * 18, TextX + g * 9 + 9, TextY + l * 18 + 18);
+		}
+	}
+	LONG SpinnerX = Width / 2 + Random(&Seed) % (Width / 4);
+	LONG SpinnerY = Height / 2 + Random(&Seed) % (Height / 4);
+	for (UINT s = 0; s < BENCH_SPINNER_STEPS; ++s, ++Sliver)
+	{
+		LONG x = SpinnerX + (s % 4);
+		LONG y = SpinnerY + (s / 4);
+		SetRect(&Frame->Slivers[Sliver], x, y, x + 24, y + 24);
+	}
+
+	SetRect(&Frame->Window, Width / 5, Height / 5, Width / 5 + Width * 2 / 3, Height / 5 + Height * 3 / 5);
+
+	DXGI_OUTPUT_DESC Desc;
+	RtlZeroMemory(&Desc, sizeof(Desc));
+	SetRect(&Desc.DesktopCoordinates, 0, 0, Width, Height);
+	Desc.Rotation = DXGI_MODE_ROTATION_IDENTITY;
+	RECT Panel;
+	SetRect(&Panel, Width / 2, Height / 8, Width / 2 + Width / 3, Height / 8 + Height / 3);
+	BuildRegionLayout(&Frame->Panel, &Panel, 1, &Desc, Width, Height);
+
+	// Whole screen scrolls up, a strip at the bottom is redrawn
+	Frame->Scroll.SourcePoint.x = 0;
+	Frame->Scroll.SourcePoint.y = BENCH_SCROLL_ROWS;
+	SetRect(&Frame->Scroll.DestinationRect, 0, 0, Width, Height - BENCH_SCROLL_ROWS);
+	SetRect(&Frame->ScrollDirty, 0, Height - BENCH_SCROLL_ROWS, Width, Height);
+
+	for (UINT i = 0; i < BENCH_MOVE_RECTS; ++i)
+	{
+		LONG x = Random(&Seed) % (Width / 2);
+		LONG y = Random(&Seed) % (Height / 2);
+		Frame->Moves[i].SourcePoint.x = Random(&Seed) % (Width / 2);
+		Frame->Moves[i].SourcePoint.y = Random(&Seed) % (Height / 2);
+		SetRect(&Frame->Moves[i].DestinationRect, x, y, x + 1 + Random(&Seed) % (Width / 2), y + 1 + Random(&Seed) % (Height / 2));
+	}
+
+	return true;
+}
+
+static void DestroyFrame(_Inout_ BENCH_FRAME* Frame)
+{
+	_aligned_free(Frame->Src);
+	_aligned_free(Frame->Dst);
+	_aligned_free(Frame->Packed);
+	_aligned_free(Frame->Yuv);
+	_aligned_free(Frame->Screen);
+	_aligned_free(Frame->Encoded);
+	delete Frame->Hash;
+	delete Frame->Compositor;
+	delete Frame->BoxPyramid;
+	delete [] Frame->Pointer.ShapeBuffer;
+	RtlZeroMemory(Frame, sizeof(BENCH_FRAME));
+}
+
+//
+// Consumer side of a ring handoff measurement
+//
+typedef struct _BENCH_RING
+{
+	FRAMERING* Ring;
+	UINT Consumer;
+	bool Poll;                  // Spin on Read instead of sleeping in it
+	UINT64* Latency;            // Ticks from Publish until the consumer had the frame
+	volatile LONG Count;
+} BENCH_RING;
+
+static DWORD WINAPI BenchRingConsumer(_In_ void* Param)
+{
+	BENCH_RING* Bench = reinterpret_cast<BENCH_RING*>(Param);
+	RING_FRAME* Frame;
+	bool Timeout;
+
+	while (Bench->Count < BENCH_RING_FRAMES &&
+		Bench->Ring->Read(Bench->Consumer, &Frame, &Timeout, Bench->Poll ? 0 : INFINITE) == DUPL_RETURN_SUCCESS)
+	{
+		if (Timeout)
+		{
+			// The producer may share the core, spinning on it would keep the frame from being published
+			SwitchToThread();
+			continue;
+		}
+
+		Bench->Latency[Bench->Count] = GetTicks() - Frame->PublishTime.QuadPart;
+		Bench->Ring->Release(Frame);
+		InterlockedIncrement(&Bench->Count);
+	}
+
+	return 0;
+}
+
+//
+// Time from Publish until a waiting consumer holds the frame, with a consumer sleeping in Read
+// and one spinning on it. Frames are small so the copy into the ring doesn't dominate, and each
+// is only published once the consumer has the one before.
+//
+static int BenchRingHandoff(_In_ FILE* Out)
+{
+	static const UINT Pitch = BENCH_RING_WIDTH * BPP;
+	FRAMEPOOL Pool;
+	BYTE* Pixels = new (std::nothrow) BYTE[Pitch * BENCH_RING_HEIGHT];
+	UINT64* Latency = new (std::nothrow) UINT64[BENCH_RING_FRAMES];
+	if (!Pixels || !Latency || Pool.Init(Out, Pitch * BENCH_RING_HEIGHT, 0, BENCH_RING_SIZE + 2, 0) != DUPL_RETURN_SUCCESS)
+	{
+		fprintf_s(Out, "Skipping ring handoff, buffers could not be allocated.\n");
+		delete [] Pixels;
+		delete [] Latency;
+		return 1;
+	}
+	RtlZeroMemory(Pixels, Pitch * BENCH_RING_HEIGHT);
+	IMAGE_VIEW View = { Pixels, BENCH_RING_WIDTH, BENCH_RING_HEIGHT, Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+
+	int Failed = 0;
+	for (UINT Poll = 0; Poll < 2; ++Poll)
+	{
+		FRAMERING Ring;
+		BENCH_RING Bench;
+		RtlZeroMemory(&Bench, sizeof(Bench));
+		Bench.Ring = &Ring;
+		Bench.Poll = (Poll != 0);
+		Bench.Latency = Latency;
+
+		HANDLE Thread = nullptr;
+		if (Ring.Init(Out, &Pool, BENCH_RING_SIZE) == DUPL_RETURN_SUCCESS && Ring.AddConsumer(&Bench.Consumer) == DUPL_RETURN_SUCCESS)
+		{
+			Thread = CreateThread(nullptr, 0, BenchRingConsumer, &Bench, 0, nullptr);
+		}
+		if (!Thread)
+		{
+			fprintf_s(Out, "Skipping ring handoff, the consumer could not be started.\n");
+			++Failed;
+			continue;
+		}
+
+		for (UINT i = 0; i < BENCH_RING_FRAMES; ++i)
+		{
+			while (ReadAcquire(&Bench.Count) < static_cast<LONG>(i))
+			{
+				SwitchToThread();
+			}
+			Ring.Publish(&View, i, nullptr);
+		}
+		Ring.Stop();
+		WaitForSingleObject(Thread, INFINITE);
+		CloseHandle(Thread);
+
+		UINT Count = static_cast<UINT>(Bench.Count);
+		double* Samples = new (std::nothrow) double[Count ? Count : 1];
+		if (!Samples)
+		{
+			++Failed;
+			continue;
+		}
+		for (UINT i = 0; i < Count; ++i)
+		{
+			Samples[i] = Latency[i] * 1e9 / Frequency.QuadPart;
+		}
+		qsort(Samples, Count, sizeof(double), CompareDouble);
+		if (Count)
+		{
+			fprintf_s(Out, "%-22s %-6s %14.1f ns median  p99 %12.1f ns  max %12.1f ns  (%u frames)\n",
+				Poll ? "ring_handoff_poll" : "ring_handoff_wait", "64x64", Samples[Count / 2],
+				Samples[Count * 99 / 100], Samples[Count - 1], Count);
+		}
+		delete [] Samples;
+	}
+
+	delete [] Pixels;
+	delete [] Latency;
+
+	return Failed;
+}
+
+//
+// Reader side of a shared frame handoff measurement, run in its own process. Each frame is read
+// in place, the latency is from Publish until the reader held it.
+//
+int RunShareReader(_In_ FILE* Out, _In_z_ const char* Name, UINT Frames)
+{
+	FRAMESHAREREADER Reader;
+	double* Samples = new (std::nothrow) double[Frames ? Frames : 1];
+	if (!Samples || Reader.Attach(Out, Name) != DUPL_RETURN_SUCCESS)
+	{
+		fprintf_s(Out, "Skipping shared frame handoff, %s could not be read.\n", Name);
+		delete [] Samples;
+		return 1;
+	}
+
+	LONGLONG Frequency = Reader.GetFrequency();
+	LONGLONG Last = Reader.GetHead();
+	UINT Count = 0;
+	UINT Torn = 0;
+	UINT Width = 0;
+	UINT Height = 0;
+	bool Timeout;
+	while (Count < Frames && Reader.Wait(Last, BENCH_SHARE_TIMEOUT_MS, &Timeout) == DUPL_RETURN_SUCCESS && !Timeout)
+	{
+		FRAMESHARE_VIEW View;
+		DUPL_RETURN Ret = Reader.BeginRead(0, &View);
+		if (Ret == DUPL_RETURN_ERROR_UNEXPECTED)
+		{
+			break;
+		}
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			continue;
+		}
+
+		UINT64 Now = GetTicks();
+		Sink += View.Image.Data[0];
+		if (!Reader.EndRead(&View))
+		{
+			++Torn;
+			continue;
+		}
+		Samples[Count++] = (Now - View.Frame.PublishTime.QuadPart) * 1e9 / Frequency;
+		Width = View.Frame.Width;
+		Height = View.Frame.Height;
+		Last = View.Sequence;
+	}
+	Reader.Detach();
+
+	qsort(Samples, Count, sizeof(double), CompareDouble);
+	if (Count)
+	{
+		char Size[32];
+		sprintf_s(Size, "%ux%u", Width, Height);
+		fprintf_s(Out, "%-22s %-6s %14.1f ns median  p99 %12.1f ns  max %12.1f ns  (%u frames, %u torn)\n",
+			"share_handoff", Size, Samples[Count / 2], Samples[Count * 99 / 100], Samples[Count - 1], Count, Torn);
+	}
+	delete [] Samples;
+
+	return Count ? 0 : 1;
+}
+
+//
+// Time from Publish until a reader in another process holds the frame. The reader is this
+// executable started with -attach, it reports the latency itself. Like the ring handoff each
+// frame is only published once the reader is done with the one before.
+//
+static int BenchShareHandoff(_In_ FILE* Out)
+{
+	static const UINT Pitch = BENCH_RING_WIDTH * BPP;
+	BYTE* Pixels = new (std::nothrow) BYTE[Pitch * BENCH_RING_HEIGHT];
+	char Path[MAX_PATH];
+	if (!Pixels || !GetModuleFileNameA(nullptr, Path, MAX_PATH))
+	{
+		fprintf_s(Out, "Skipping shared frame handoff, the reader could not be set up.\n");
+		delete [] Pixels;
+		return 1;
+	}
+	RtlZeroMemory(Pixels, Pitch * BENCH_RING_HEIGHT);
+	IMAGE_VIEW View = { Pixels, BENCH_RING_WIDTH, BENCH_RING_HEIGHT, Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+
+	char Name[64];
+	sprintf_s(Name, "DXGIConsoleApplication.bench.%u", GetCurrentProcessId());
+	FRAMESHARE Share;
+	if (Share.Init(Out, Name, Pitch * BENCH_RING_HEIGHT, BENCH_RING_SIZE) != DUPL_RETURN_SUCCESS)
+	{
+		delete [] Pixels;
+		return 1;
+	}
+
+	// The reader writes its result line to the same output
+	char CommandLine[2 * MAX_PATH];
+	sprintf_s(CommandLine, "\"%s\" -attach %s %u", Path, Name, BENCH_SHARE_FRAMES);
+	STARTUPINFOA Startup;
+	RtlZeroMemory(&Startup, sizeof(Startup));
+	Startup.cb = sizeof(Startup);
+	Startup.dwFlags = STARTF_USESTDHANDLES;
+	Startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	Startup.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+	Startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	PROCESS_INFORMATION Process;
+	fflush(Out);
+	if (!CreateProcessA(nullptr, CommandLine, nullptr, nullptr, TRUE, 0, nullptr, nullptr, &Startup, &Process))
+	{
+		fprintf_s(Out, "Skipping shared frame handoff, the reader could not be started with error %u.\n", GetLastError());
+		delete [] Pixels;
+		return 1;
+	}
+
+	ULONGLONG Deadline = GetTickCount64() + BENCH_SHARE_TIMEOUT_MS;
+	while (!Share.GetReaderCount() && GetTickCount64() < Deadline && WaitForSingleObject(Process.hProcess, 1) == WAIT_TIMEOUT)
+	{
+	}
+
+	bool Exited = !Share.GetReaderCount();
+	for (UINT i = 0; i < BENCH_SHARE_FRAMES && !Exited; ++i)
+	{
+		// The reader may share the core, so the wait gives it the rest of the time slice
+		while (Share.GetSlowestReader() < static_cast<LONGLONG>(i) && !Exited)
+		{
+			Exited = (WaitForSingleObject(Process.hProcess, 0) != WAIT_TIMEOUT);
+			SwitchToThread();
+		}
+		Share.Publish(&View, i, nullptr);
+	}
+	Share.Close();
+
+	DWORD ExitCode = 1;
+	WaitForSingleObject(Process.hProcess, INFINITE);
+	GetExitCodeProcess(Process.hProcess, &ExitCode);
+	CloseHandle(Process.hThread);
+	CloseHandle(Process.hProcess);
+	delete [] Pixels;
+
+	return (ExitCode == 0) ? 0 : 1;
+}
+
+//
+// One synchronous log call of the capture thread before the event log, like DisplayMsg used to make
+//
+static void BenchLogDirect(_In_ FILE* File, _In_ LPCWSTR Str, HRESULT hr)
+{
+	const UINT StringLen = (UINT)(wcslen(Str) + sizeof(" with HRESULT 0x########."));
+	wchar_t* OutStr = new (std::nothrow) wchar_t[StringLen];
+	if (!OutStr)
+	{
+		return;
+	}
+
+	if (swprintf_s(OutStr, StringLen, L"%ls with 0x%X.", Str, hr) != -1)
+	{
+		fprintf_s(File, "%ls\n", OutStr);
+	}
+
+	delete [] OutStr;
+}
+
+//
+// Cost of a log call on the thread making it: events that are logged, repeats the rate limit
+// drops and the synchronous fprintf_s the event log replaces. The events are formatted into
+// bench.log between batches, outside of the timed calls, so the ring never fills up.
+//
+static int BenchEventLog(_In_ FILE* Out)
+{
+	static const char* Names[] = { "log_event", "log_repeat", "log_fprintf" };
+	double* Samples = new (std::nothrow) double[BENCH_LOG_BATCHES];
+	FILE* File = nullptr;
+	if (!Samples || fopen_s(&File, "bench.log", "w") != 0 || !File)
+	{
+		fprintf_s(Out, "Skipping event log, bench.log could not be created.\n");
+		delete [] Samples;
+		return 1;
+	}
+
+	EVENTLOG Log;
+	if (Log.Init(File) != DUPL_RETURN_SUCCESS)
+	{
+		fclose(File);
+		delete [] Samples;
+		return 1;
+	}
+
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+
+	UINT64 Frame = 0;
+	for (UINT Kind = 0; Kind < ARRAYSIZE(Names); ++Kind)
+	{
+		// The first batch pays for the ring of the thread
+		for (UINT b = 0; b <= BENCH_LOG_BATCHES; ++b)
+		{
+			UINT64 Start = GetTicks();
+			for (UINT i = 0; i < BENCH_LOG_BATCH; ++i, ++Frame)
+			{
+				if (Kind == 0)
+				{
+					Log.Write("Frame %llu could not be acquired after %u ms.", DXGI_ERROR_WAIT_TIMEOUT, Frame, i);
+				}
+				else if (Kind == 1)
+				{
+					Log.Write("Failed to acquire next frame in DUPLICATIONMANAGER", DXGI_ERROR_ACCESS_LOST);
+				}
+				else
+				{
+					BenchLogDirect(File, L"Failed to acquire next frame in DUPLICATIONMANAGER", DXGI_ERROR_ACCESS_LOST);
+				}
+			}
+			UINT64 Elapsed = GetTicks() - Start;
+			if (b)
+			{
+				Samples[b - 1] = Elapsed * 1e9 / Frequency.QuadPart / BENCH_LOG_BATCH;
+			}
+			Log.Flush();
+		}
+
+		qsort(Samples, BENCH_LOG_BATCHES, sizeof(double), CompareDouble);
+		fprintf_s(Out, "%-22s %-6s %14.1f ns median  p99 %12.1f ns  max %12.1f ns  (%u calls)\n",
+			Names[Kind], "", Samples[BENCH_LOG_BATCHES / 2], Samples[BENCH_LOG_BATCHES * 99 / 100],
+			Samples[BENCH_LOG_BATCHES - 1], BENCH_LOG_BATCHES * BENCH_LOG_BATCH);
+	}
+	Log.Stop();
+
+	EVENTLOG_STATS Stats;
+	Log.GetStats(&Stats);
+	fclose(File);
+	DeleteFileA("bench.log");
+	delete [] Samples;
+
+	// Only repeats may go missing
+	return (Stats.Dropped == 0 && Stats.Written >= (BENCH_LOG_BATCHES + 1) * BENCH_LOG_BATCH) ? 0 : 1;
+}
+
+//
+// Cost of a failed AcquireNextFrame through DUPLICATIONMANAGER::ProcessFailure on a
+// CPUDUPLICATIONDEVICE: an error the capture loop expects, a removed device the error is
+// remapped for, and an unexpected error that is reported through the event log.
+//
+static int BenchProcessFailure(_In_ FILE* Out)
+{
+	static const char* Names[] = { "failure_expected", "failure_removed", "failure_unexpected" };
+	static const HRESULT Errors[] = { DXGI_ERROR_ACCESS_LOST, E_FAIL, E_FAIL };
+	static const HRESULT RemovedReasons[] = { S_OK, DXGI_ERROR_DEVICE_RESET, S_OK };
+	static const DUPL_RETURN Expected[] = { DUPL_RETURN_ERROR_EXPECTED, DUPL_RETURN_ERROR_EXPECTED, DUPL_RETURN_ERROR_UNEXPECTED };
+
+	double* Samples = new (std::nothrow) double[BENCH_LOG_BATCHES];
+	FILE* File = nullptr;
+	if (!Samples || fopen_s(&File, "bench.log", "w") != 0 || !File)
+	{
+		fprintf_s(Out, "Skipping failure handling, bench.log could not be created.\n");
+		delete [] Samples;
+		return 1;
+	}
+
+	CPUDUPLICATIONDEVICE Device;
+	DUPLICATIONMANAGER* Manager = new (std::nothrow) DUPLICATIONMANAGER(&Device);
+	BYTE* Image = nullptr;
+	EVENTLOG Log;
+	int Failed = 1;
+	if (Manager && Device.Init(BENCH_RING_WIDTH, BENCH_RING_HEIGHT, DXGI_MODE_ROTATION_IDENTITY, 1) &&
+		Manager->InitDupl(File, 0) == DUPL_RETURN_SUCCESS && Log.Init(File) == DUPL_RETURN_SUCCESS)
+	{
+		Image = new (std::nothrow) BYTE[Manager->GetImageBufferSize()];
+		Manager->SetEventLog(&Log);
+	}
+
+	if (Image)
+	{
+		LARGE_INTEGER Frequency;
+		QueryPerformanceFrequency(&Frequency);
+
+		Failed = 0;
+		for (UINT Kind = 0; Kind < ARRAYSIZE(Names); ++Kind)
+		{
+			Device.SetDeviceRemovedReason(RemovedReasons[Kind]);
+			for (UINT b = 0; b <= BENCH_LOG_BATCHES; ++b)
+			{
+				UINT64 Start = GetTicks();
+				for (UINT i = 0; i < BENCH_LOG_BATCH; ++i)
+				{
+					bool Timeout;
+					Device.FailNextCall(CPU_DUPLICATION_CALL_ACQUIRE, Errors[Kind]);
+					Failed |= (Manager->GetFrame(Image, &Timeout, 0) != Expected[Kind]) ? 1 : 0;
+				}
+				UINT64 Elapsed = GetTicks() - Start;
+				if (b)
+				{
+					Samples[b - 1] = Elapsed * 1e9 / Frequency.QuadPart / BENCH_LOG_BATCH;
+				}
+				Log.Flush();
+			}
+
+			qsort(Samples, BENCH_LOG_BATCHES, sizeof(double), CompareDouble);
+			fprintf_s(Out, "%-22s %-6s %14.1f ns median  p99 %12.1f ns  max %12.1f ns  (%u calls)\n",
+				Names[Kind], "", Samples[BENCH_LOG_BATCHES / 2], Samples[BENCH_LOG_BATCHES * 99 / 100],
+				Samples[BENCH_LOG_BATCHES - 1], BENCH_LOG_BATCHES * BENCH_LOG_BATCH);
+		}
+	}
+	else
+	{
+		fprintf_s(Out, "Skipping failure handling, the CPU duplication could not be set up.\n");
+	}
+
+	Log.Stop();
+	delete Manager;
+	delete [] Image;
+	fclose(File);
+	DeleteFileA("bench.log");
+	delete [] Samples;
+	return Failed;
+}
+
+//
+// Collect the dirty rects of every frame of a recording, as DXGI reported them when it was traced
+//
+static bool LoadRecordedRects(_In_ FILE* Out, _In_z_ const char* FileName, _Out_ BENCH_FRAME* Frame)
+{
+	RtlZeroMemory(Frame, sizeof(BENCH_FRAME));
+
+	RECORDINGREADER Reader;
+	if (Reader.Open(Out, FileName) != DUPL_RETURN_SUCCESS)
+	{
+		return false;
+	}
+
+	// Two passes, the first only counts
+	for (UINT Pass = 0; Pass < 2; ++Pass)
+	{
+		Frame->RecordedFrames = 0;
+		Frame->RecordedRects = 0;
+		for (UINT Entry = 0; Entry < Reader.GetFrameCount(); ++Entry)
+		{
+			RECORDING_FRAME Recorded;
+			if (Reader.GetFrame(Entry, &Recorded) != DUPL_RETURN_SUCCESS)
+			{
+				return false;
+			}
+
+			const RECORDING_FRAME_INFO* Info = &Recorded.Header->Info;
+			if (!Info->DirtyCount || Recorded.Header->MetaDataSize < Info->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT) + Info->DirtyCount * sizeof(RECT))
+			{
+				continue;
+			}
+
+			if (Pass)
+			{
+				memcpy(Frame->Recorded + Frame->RecordedRects, Recorded.MetaData + Info->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT), Info->DirtyCount * sizeof(RECT));
+				Frame->RecordedCounts[Frame->RecordedFrames] = Info->DirtyCount;
+			}
+			++Frame->RecordedFrames;
+			Frame->RecordedRects += Info->DirtyCount;
+		}
+
+		if (!Pass)
+		{
+			if (!Frame->RecordedRects)
+			{
+				fprintf_s(Out, "%s has no dirty rects.\n", FileName);
+				return false;
+			}
+
+			Frame->Recorded = new (std::nothrow) RECT[Frame->RecordedRects];
+			Frame->RecordedScratch = new (std::nothrow) RECT[Frame->RecordedRects];
+			Frame->RecordedCounts = new (std::nothrow) UINT[Frame->RecordedFrames];
+			if (!Frame->Recorded || !Frame->RecordedScratch || !Frame->RecordedCounts)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//
+// Time merging the recorded rects and report what merging does to them
+//
+static int BenchRecordedRects(_In_ FILE* Out, _In_z_ const char* FileName, UINT Repetitions)
+{
+	BENCH_FRAME Frame;
+	int Failed = 0;
+	if (!LoadRecordedRects(Out, FileName, &Frame))
+	{
+		fprintf_s(Out, "Skipping recorded rects, %s could not be read.\n", FileName);
+		Failed = 1;
+	}
+	else
+	{
+		BENCH_RESULT Result;
+		if (Measure(BenchCoalesceRecorded, &Frame, Repetitions, &Result))
+		{
+			Report(Out, "coalesce_recorded", "trace", &Result);
+		}
+
+		UINT Merged = 0;
+		RECT* Rects = Frame.RecordedScratch;
+		memcpy(Rects, Frame.Recorded, Frame.RecordedRects * sizeof(RECT));
+		for (UINT f = 0; f < Frame.RecordedFrames; ++f)
+		{
+			UINT Count = CoalesceRects(Rects, Frame.RecordedCounts[f], nullptr);
+			memmove(Frame.RecordedScratch + Merged, Rects, Count * sizeof(RECT));
+			Merged += Count;
+			Rects += Frame.RecordedCounts[f];
+		}
+
+		LONGLONG AreaBefore = GetRectsArea(Frame.Recorded, Frame.RecordedRects);
+		LONGLONG AreaAfter = GetRectsArea(Frame.RecordedScratch, Merged);
+		fprintf_s(Out, "%u frames, %u dirty rects merged into %u, %.1f ns per rect, %+.1f%% pixels copied\n",
+			Frame.RecordedFrames, Frame.RecordedRects, Merged, Result.MedianNs / Frame.RecordedRects,
+			AreaBefore ? (AreaAfter - AreaBefore) * 100.0 / AreaBefore : 0.0);
+	}
+
+	delete [] Frame.Recorded;
+	delete [] Frame.RecordedScratch;
+	delete [] Frame.RecordedCounts;
+
+	return Failed;
+}
+
+int RunBenchmarks(_In_ FILE* Out, UINT Repetitions, _In_opt_z_ const char* RectRecording)
+{
+	if (!Repetitions)
+	{
+		Repetitions = BENCH_DEFAULT_REPETITIONS;
+	}
+
+	static const struct
+	{
+		const char* Name;
+		BENCH_OP Op;
+		bool Disk;
+	} Benchmarks[] =
+	{
+		{ "dirty_typing", BenchTyping, false },
+		{ "dirty_window", BenchWindow, false },
+		{ "roi_window", BenchRegionWindow, false },
+		{ "roi_typing", BenchRegionTyping, false },
+		{ "dirty_slivers", BenchSlivers, false },
+		{ "dirty_slivers_merged", BenchSliversMerged, false },
+		{ "coalesce_typing", BenchCoalesceTyping, false },
+		{ "coalesce_slivers", BenchCoalesceSlivers, false },
+		{ "rotate_rects", BenchRotateRects, false },
+		{ "rotate_rects_by_rect", BenchRotateRectsPerRect, false },
+		{ "pointer_move", BenchPointerMove, false },
+		{ "move_scroll", BenchScroll, false },
+		{ "move_rect_identity", BenchMoveRectIdentity, false },
+		{ "move_rect_rotate90", BenchMoveRectRotate90, false },
+		{ "move_rect_rotate180", BenchMoveRectRotate180, false },
+		{ "move_rect_rotate270", BenchMoveRectRotate270, false },
+		{ "pack_frame", BenchPack, false },
+		{ "hash_frame", BenchHash, false },
+		{ "codec_encode_screen", BenchEncodeScreen, false },
+		{ "codec_decode_screen", BenchDecodeScreen, false },
+		{ "codec_encode_noise", BenchEncodeNoise, false },
+		{ "pyramid_box", BenchPyramidBox, false },
+		{ "downscale_bilinear_8x", BenchBilinear8x, false },
+		{ "pyramid_typing", BenchPyramidTyping, false },
+		{ "save_as_bitmap", BenchBitmap, true }
+	};
+
+	static const char* PathNames[] = { "i420_scalar", "i420_sse41", "i420_avx2" };
+	static const char* Nv12PathNames[] = { "nv12_scalar", "nv12_sse41", "nv12_avx2" };
+	static const char* Yuy2PathNames[] = { "yuy2_scalar", "yuy2_sse41", "yuy2_avx2" };
+	static const char* PyramidPathNames[] = { "pyramid_box_scalar", "pyramid_box_sse41", "pyramid_box_avx2" };
+	CONVERT_PATH SavedPath = GetConvertPath();
+
+	SYSTEM_INFO SystemInfo;
+	GetSystemInfo(&SystemInfo);
+	UINT Processors = SystemInfo.dwNumberOfProcessors;
+
+	fprintf_s(Out, "%u repetitions of at least %u ms each, medians reported, %u processors.\n", Repetitions, BENCH_MIN_REPETITION_MS, Processors);
+
+	int Failed = 0;
+	for (UINT r = 0; r < ARRAYSIZE(Resolutions); ++r)
+	{
+		BENCH_FRAME Frame;
+		if (!CreateFrame(&Frame, Resolutions[r].Width, Resolutions[r].Height))
+		{
+			fprintf_s(Out, "Skipping %s, frames could not be allocated.\n", Resolutions[r].Name);
+			DestroyFrame(&Frame);
+			++Failed;
+			continue;
+		}
+
+		// 1/2, 1/4 and 1/8 levels, the incremental benchmark updates the pyramid the full one built
+		Frame.BoxPyramid->Init(Out, PYRAMID_MAX_LEVELS, DOWNSCALE_FILTER_BOX);
+
+		BENCH_RESULT Result;
+		for (UINT b = 0; b < ARRAYSIZE(Benchmarks); ++b)
+		{
+			UINT Reps = Benchmarks[b].Disk ? min(Repetitions, BENCH_DISK_REPETITIONS) : Repetitions;
+			if (Measure(Benchmarks[b].Op, &Frame, Reps, &Result))
+			{
+				Report(Out, Benchmarks[b].Name, Resolutions[r].Name, &Result);
+			}
+		}
+
+		// Compression of the codec on desktop like content and on noise, which is its worst case
+		double RawBytes = static_cast<double>(Frame.Width) * BPP * Frame.Height;
+		UINT ScreenSize = EncodeScreenFrame(Frame.Encoded, Frame.EncodedCapacity, Frame.Screen, Frame.Pitch, Frame.Width, Frame.Height, SCREENCODEC_STRIP_ROWS);
+		UINT NoiseSize = EncodeScreenFrame(Frame.Encoded, Frame.EncodedCapacity, Frame.Src, Frame.Pitch, Frame.Width, Frame.Height, SCREENCODEC_STRIP_ROWS);
+		if (ScreenSize && NoiseSize)
+		{
+			fprintf_s(Out, "%-22s %-6s %10.2f:1 screen  %6.2f:1 noise\n", "codec_ratio", Resolutions[r].Name, RawBytes / ScreenSize, RawBytes / NoiseSize);
+		}
+
+		// Strip parallel scaling, 1, 2, 4 and so on threads up to every processor. Encoding the
+		// screen content leaves it in Frame.Encoded for the decode that follows.
+		for (UINT Threads = 1;; Threads = min(Threads * 2, Processors))
+		{
+			char Name[32];
+			SetScreenCodecThreads(Threads);
+			if (Measure(BenchEncodeScreen, &Frame, Repetitions, &Result))
+			{
+				sprintf_s(Name, "codec_encode_%ut", Threads);
+				Report(Out, Name, Resolutions[r].Name, &Result);
+			}
+			if (Measure(BenchDecodeScreen, &Frame, Repetitions, &Result))
+			{
+				sprintf_s(Name, "codec_decode_%ut", Threads);
+				Report(Out, Name, Resolutions[r].Name, &Result);
+			}
+			if (Threads >= Processors)
+			{
+				break;
+			}
+		}
+		SetScreenCodecThreads(0);
+
+		// Every color conversion and downscaling kernel the CPU supports
+		for (UINT p = CONVERT_PATH_SCALAR; p <= static_cast<UINT>(GetSupportedConvertPath()); ++p)
+		{
+			SetConvertPath(static_cast<CONVERT_PATH>(p));
+			if (Measure(BenchI420, &Frame, Repetitions, &Result))
+			{
+				Report(Out, PathNames[p], Resolutions[r].Name, &Result);
+			}
+			if (Measure(BenchNV12, &Frame, Repetitions, &Result))
+			{
+				Report(Out, Nv12PathNames[p], Resolutions[r].Name, &Result);
+			}
+			if (Measure(BenchYUY2, &Frame, Repetitions, &Result))
+			{
+				Report(Out, Yuy2PathNames[p], Resolutions[r].Name, &Result);
+			}
+			if (Measure(BenchPyramidBox, &Frame, Repetitions, &Result))
+			{
+				Report(Out, PyramidPathNames[p], Resolutions[r].Name, &Result);
+			}
+		}
+		SetConvertPath(SavedPath);
+
+		DestroyFrame(&Frame);
+	}
+
+	DeleteFileA("bench.bmp");
+
+	Failed += BenchRingHandoff(Out);
+	Failed += BenchShareHandoff(Out);
+	Failed += BenchEventLog(Out);
+	Failed += BenchProcessFailure(Out);
+
+	if (RectRecording)
+	{
+		Failed += BenchRecordedRects(Out, RectRecording, Repetitions);
+	}
+
+	return Failed ? 1 : 0;
+}
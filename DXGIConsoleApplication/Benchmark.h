@@ -0,0 +1,43 @@
+// Benchmark.h : Microbenchmarks of the CPU side frame paths over synthetic frames.
+//
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <windows.h>
+#include <sal.h>
+#include <stdio.h>
+
+// Repetitions of every benchmark the statistics are taken over
+#define BENCH_DEFAULT_REPETITIONS   15
+
+// Each repetition runs the operation for at least this long
+#define BENCH_MIN_REPETITION_MS     20
+
+//
+// Per repetition statistics of one benchmark
+//
+typedef struct _BENCH_RESULT
+{
+	UINT64 Iterations;          // Operations per repetition
+	UINT64 BytesPerOp;          // Pixel bytes touched by one operation
+	double MinNs;               // Per operation
+	double MedianNs;
+	double MeanNs;
+	double StdDevNs;
+} BENCH_RESULT;
+
+//
+// Run every benchmark at 1080p, 1440p, 4K and 8K and write one line per benchmark to Out.
+// With RectRecording the dirty rects of every frame of that recording are merged as well.
+// Returns 0 on success.
+//
+int RunBenchmarks(_In_ FILE* Out, UINT Repetitions, _In_opt_z_ const char* RectRecording);
+
+//
+// Attach to the shared frames Name as another process publishes them, read up to Frames frames
+// in place and write the latency from publish to read to Out. Returns 0 if any frame was read.
+//
+int RunShareReader(_In_ FILE* Out, _In_z_ const char* Name, UINT Frames);
+
+#endif
@@ -0,0 +1,690 @@
+// CaptureManager.cpp : One capture thread per output, published per output or as a virtual desktop.
+//
+
+#include "CaptureManager.h"
+#include "RegionCopy.h"
+#include <malloc.h>
+
+CAPTUREMANAGER::CAPTUREMANAGER() : m_log_file(nullptr),
+								   m_Mode(CAPTURE_MODE_PER_OUTPUT),
+								   m_OutputCount(0),
+								   m_Terminate(0),
+								   m_Started(false),
+								   m_ActiveThreads(0),
+								   m_Sequence(0),
+								   m_Composite(nullptr),
+								   m_CompositePitch(0),
+								   m_CompositeHeight(0),
+								   m_DeliveredSequence(0),
+								   m_FullCopyNeeded(true),
+								   m_PendingCount(0),
+								   m_PendingOverflow(false)
+{
+	RtlZeroMemory(m_Outputs, sizeof(m_Outputs));
+	RtlZeroMemory(&m_Bounds, sizeof(m_Bounds));
+	RtlZeroMemory(&m_PendingAcquireTime, sizeof(m_PendingAcquireTime));
+	RtlZeroMemory(&m_Meta, sizeof(m_Meta));
+	InitializeCriticalSection(&m_Lock);
+	InitializeConditionVariable(&m_FrameReady);
+}
+
+CAPTUREMANAGER::~CAPTUREMANAGER()
+{
+	Stop();
+	CleanRefs();
+	DeleteCriticalSection(&m_Lock);
+}
+
+//
+// Add a DUPLICATIONMANAGER for every output attached to the desktop, on every adapter.
+// Their dirty rects are merged with Coalesce, nullptr keeps them as DXGI reports them.
+// With DrawPointer set each output draws the pointer into its frames when it is on it.
+// Once initialized the outputs log their failures to EventLog, when there is one.
+//
+DUPL_RETURN CAPTUREMANAGER::EnumerateOutputs(_In_ FILE *log_file, _In_opt_ const COALESCE_PARAMS* Coalesce, bool DrawPointer, _In_opt_ EVENTLOG* EventLog)
+{
+	m_log_file = log_file;
+
+	IDXGIFactory1* Factory = nullptr;
+	HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&Factory));
+	if (FAILED(hr))
+	{
+		fprintf_s(m_log_file, "Failed to create DXGI factory with error %x.\n", hr);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	DUPL_RETURN Ret = DUPL_RETURN_SUCCESS;
+	IDXGIAdapter1* Adapter = nullptr;
+	for (UINT a = 0; Ret == DUPL_RETURN_SUCCESS && Factory->EnumAdapters1(a, &Adapter) != DXGI_ERROR_NOT_FOUND; ++a)
+	{
+		IDXGIOutput* Output = nullptr;
+		for (UINT o = 0; Ret == DUPL_RETURN_SUCCESS && Adapter->EnumOutputs(o, &Output) != DXGI_ERROR_NOT_FOUND; ++o)
+		{
+			DXGI_OUTPUT_DESC Desc;
+			hr = Output->GetDesc(&Desc);
+			Output->Release();
+			Output = nullptr;
+			if (FAILED(hr) || !Desc.AttachedToDesktop)
+			{
+				continue;
+			}
+
+			DUPLICATIONMANAGER* Dupl = new (std::nothrow) DUPLICATIONMANAGER;
+			if (!Dupl)
+			{
+				fprintf_s(m_log_file, "Failed to allocate duplication manager.\n");
+				Ret = DUPL_RETURN_ERROR_UNEXPECTED;
+				break;
+			}
+
+			DUPL_RETURN DuplRet = Dupl->InitDupl(m_log_file, o, Adapter);
+			if (DuplRet != DUPL_RETURN_SUCCESS)
+			{
+				// Outputs can go away while we enumerate, skip those
+				fprintf_s(m_log_file, "Skipping output %u on adapter %u.\n", o, a);
+				delete Dupl;
+				if (DuplRet == DUPL_RETURN_ERROR_UNEXPECTED)
+				{
+					Ret = DuplRet;
+				}
+				continue;
+			}
+			Dupl->SetDirtyRectReadback(true);
+			Dupl->SetRectCoalescing(Coalesce);
+			Dupl->SetPointerCompositing(DrawPointer);
+			Dupl->SetEventLog(EventLog);
+
+			Ret = AddSource(m_log_file, Dupl, true);
+		}
+
+		Adapter->Release();
+		Adapter = nullptr;
+	}
+
+	Factory->Release();
+	Factory = nullptr;
+
+	if (Ret == DUPL_RETURN_SUCCESS && !m_OutputCount)
+	{
+		fprintf_s(m_log_file, "No outputs attached to the desktop.\n");
+		Ret = DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	return Ret;
+}
+
+//
+// Capture from Source as one more output. Any FRAMESOURCE works, which is how simulated
+// outputs are plugged in. Source has to report its DesktopCoordinates in GetOutputDesc.
+//
+DUPL_RETURN CAPTUREMANAGER::AddSource(_In_ FILE *log_file, _In_ FRAMESOURCE* Source, bool OwnsSource)
+{
+	m_log_file = log_file;
+
+	if (m_Started || m_OutputCount == CAPTURE_MAX_OUTPUTS)
+	{
+		fprintf_s(m_log_file, "Cannot add another capture output.\n");
+		if (OwnsSource)
+		{
+			delete Source;
+		}
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	CAPTURE_OUTPUT* Output = &m_Outputs[m_OutputCount];
+	RtlZeroMemory(Output, sizeof(CAPTURE_OUTPUT));
+	Output->Manager = this;
+	Output->Source = Source;
+	Output->OwnsSource = OwnsSource;
+	Output->NeedsFullCopy = true;
+	Source->GetOutputDesc(&Output->Desc);
+	++m_OutputCount;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Lay out the published images and start a capture thread per output
+//
+DUPL_RETURN CAPTUREMANAGER::Start(CAPTURE_MODE Mode)
+{
+	if (m_Started || !m_OutputCount)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+	m_Mode = Mode;
+
+	// Virtual desktop is the union of all outputs, it can start at negative coordinates
+	m_Bounds = m_Outputs[0].Desc.DesktopCoordinates;
+	for (UINT i = 1; i < m_OutputCount; ++i)
+	{
+		RECT* Rect = &m_Outputs[i].Desc.DesktopCoordinates;
+		m_Bounds.left = min(m_Bounds.left, Rect->left);
+		m_Bounds.top = min(m_Bounds.top, Rect->top);
+		m_Bounds.right = max(m_Bounds.right, Rect->right);
+		m_Bounds.bottom = max(m_Bounds.bottom, Rect->bottom);
+	}
+
+	if (m_Mode == CAPTURE_MODE_COMPOSITE)
+	{
+		m_CompositePitch = (m_Bounds.right - m_Bounds.left) * BPP;
+		m_CompositeHeight = m_Bounds.bottom - m_Bounds.top;
+		m_Composite = reinterpret_cast<BYTE*>(_aligned_malloc(static_cast<SIZE_T>(m_CompositePitch) * m_CompositeHeight, 64));
+		if (!m_Composite)
+		{
+			fprintf_s(m_log_file, "Failed to allocate %ux%u virtual desktop.\n", m_CompositePitch / BPP, m_CompositeHeight);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		RtlZeroMemory(m_Composite, static_cast<SIZE_T>(m_CompositePitch) * m_CompositeHeight);
+		m_FullCopyNeeded = true;
+		m_PendingCount = 0;
+		m_PendingOverflow = false;
+		m_PendingAcquireTime.QuadPart = 0;
+	}
+
+	for (UINT i = 0; i < m_OutputCount; ++i)
+	{
+		CAPTURE_OUTPUT* Output = &m_Outputs[i];
+		Output->OffsetX = Output->Desc.DesktopCoordinates.left - m_Bounds.left;
+		Output->OffsetY = Output->Desc.DesktopCoordinates.top - m_Bounds.top;
+
+		Output->BufferSize = Output->Source->GetImageBufferSize();
+		Output->Buffer = reinterpret_cast<BYTE*>(_aligned_malloc(Output->BufferSize, 64));
+		if (!Output->Recovery)
+		{
+			Output->Recovery = new (std::nothrow) FRAMERECOVERY;
+		}
+		if (!Output->Recovery)
+		{
+			fprintf_s(m_log_file, "Failed to allocate recovery for output %u.\n", i);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		Output->Recovery->Init(m_log_file, Output->Source, Output->BufferSize);
+
+		UINT Width = Output->Desc.DesktopCoordinates.right - Output->Desc.DesktopCoordinates.left;
+		UINT Height = Output->Desc.DesktopCoordinates.bottom - Output->Desc.DesktopCoordinates.top;
+		if (m_Mode == CAPTURE_MODE_COMPOSITE)
+		{
+			Output->TargetPitch = m_CompositePitch;
+			Output->Target = m_Composite + Output->OffsetY * m_CompositePitch + Output->OffsetX * BPP;
+		}
+		else
+		{
+			Output->TargetPitch = Width * BPP;
+			Output->Published = reinterpret_cast<BYTE*>(_aligned_malloc(static_cast<SIZE_T>(Output->TargetPitch) * Height, 64));
+			Output->Target = Output->Published;
+		}
+
+		if (!Output->Buffer || !Output->Target)
+		{
+			fprintf_s(m_log_file, "Failed to allocate capture buffers for output %u.\n", i);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+
+		Output->View.Data = Output->Target;
+		Output->View.Width = Width;
+		Output->View.Height = Height;
+		Output->View.Pitch = Output->TargetPitch;
+		Output->View.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		Output->View.Rotation = DXGI_MODE_ROTATION_IDENTITY;
+	}
+
+	WriteRelease(&m_Terminate, 0);
+	m_Started = true;
+	// Counted before the threads start so one exiting early can't underflow the count
+	m_ActiveThreads = m_OutputCount;
+	for (UINT i = 0; i < m_OutputCount; ++i)
+	{
+		m_Outputs[i].Thread = CreateThread(nullptr, 0, CaptureProc, &m_Outputs[i], 0, nullptr);
+		if (!m_Outputs[i].Thread)
+		{
+			fprintf_s(m_log_file, "Failed to create capture thread for output %u.\n", i);
+			EnterCriticalSection(&m_Lock);
+			m_ActiveThreads -= m_OutputCount - i;
+			LeaveCriticalSection(&m_Lock);
+			Stop();
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Stop the capture threads and wait for them to exit. Buffers stay valid until destruction.
+//
+void CAPTUREMANAGER::Stop()
+{
+	if (!m_Started)
+	{
+		return;
+	}
+
+	InterlockedExchange(&m_Terminate, 1);
+	EnterCriticalSection(&m_Lock);
+	WakeAllConditionVariable(&m_FrameReady);
+	LeaveCriticalSection(&m_Lock);
+
+	for (UINT i = 0; i < m_OutputCount; ++i)
+	{
+		if (m_Outputs[i].Thread)
+		{
+			WaitForSingleObject(m_Outputs[i].Thread, INFINITE);
+			CloseHandle(m_Outputs[i].Thread);
+			m_Outputs[i].Thread = nullptr;
+		}
+
+		if (m_Outputs[i].LastError != DUPL_RETURN_SUCCESS)
+		{
+			fprintf_s(m_log_file, "Output %u stopped with error %d after %u frames.\n", i, m_Outputs[i].LastError, m_Outputs[i].FrameCount);
+		}
+
+		RECOVERY_STATS Stats;
+		m_Outputs[i].Recovery->GetStats(&Stats);
+		if (Stats.Losses)
+		{
+			fprintf_s(m_log_file, "Output %u was lost %u times, recovered %u (%u mode changes) in %u attempts, %u frames lost. Max recovery %.3f ms.\n",
+				i, Stats.Losses, Stats.Recoveries, Stats.ModeChanges, Stats.Attempts, Stats.FramesLost, Stats.MaxRecoverTicks * 1000.0 / Stats.Frequency);
+		}
+	}
+
+	m_Started = false;
+}
+
+UINT CAPTUREMANAGER::GetOutputCount()
+{
+	return m_OutputCount;
+}
+
+//
+// Wait until an output publishes a frame after *Sequence. Returns false on timeout or
+// when no capture thread is running any more. *Sequence is updated to the latest frame.
+//
+bool CAPTUREMANAGER::WaitForFrame(DWORD TimeoutMs, _Inout_ UINT64* Sequence)
+{
+	EnterCriticalSection(&m_Lock);
+
+	while (m_Sequence == *Sequence && m_ActiveThreads && !ReadAcquire(&m_Terminate))
+	{
+		if (!SleepConditionVariableCS(&m_FrameReady, &m_Lock, TimeoutMs))
+		{
+			break;
+		}
+	}
+
+	bool NewFrame = m_Sequence != *Sequence;
+	*Sequence = m_Sequence;
+
+	LeaveCriticalSection(&m_Lock);
+
+	return NewFrame;
+}
+
+//
+// Copy the published image of Output into Buffer with packed rows. The copy is made under the
+// lock, so it never has half of a frame the capture thread is publishing.
+//
+DUPL_RETURN CAPTUREMANAGER::CopyOutput(UINT Output, _Out_writes_bytes_(BufferSize) BYTE* Buffer, UINT BufferSize, _Out_ IMAGE_VIEW* View)
+{
+	RtlZeroMemory(View, sizeof(IMAGE_VIEW));
+	if (Output >= m_OutputCount || !m_Outputs[Output].Target)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	const IMAGE_VIEW* Published = &m_Outputs[Output].View;
+	UINT Pitch = GetPackedPitch(Published);
+	if (BufferSize / Pitch < Published->Height)
+	{
+		fprintf_s(m_log_file, "Buffer of %u bytes is too small for the %ux%u image of output %u.\n", BufferSize, Published->Width, Published->Height, Output);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	EnterCriticalSection(&m_Lock);
+	CopyImagePacked(Buffer, Pitch, Published, View);
+	LeaveCriticalSection(&m_Lock);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Capture thread. Frames are captured into the output's own buffer without the lock,
+// only publishing the changed regions is serialized with the other outputs. A lost output
+// times out until its recovery brings it back, which doesn't hold up the other outputs.
+//
+DWORD WINAPI CAPTUREMANAGER::CaptureProc(_In_ void* Param)
+{
+	CAPTURE_OUTPUT* Output = reinterpret_cast<CAPTURE_OUTPUT*>(Param);
+	CAPTUREMANAGER* Manager = Output->Manager;
+
+	while (!ReadAcquire(&Manager->m_Terminate))
+	{
+		bool Timeout;
+		DUPL_RETURN Ret = Output->Recovery->GetFrame(Output->Buffer, &Timeout, FRAME_TIMEOUT_DEFAULT);
+		if (Ret == DUPL_RETURN_ERROR_EXPECTED && Output->Recovery->GetState() == RECOVERY_STATE_MODE_CHANGED)
+		{
+			// Came back with larger frames, the buffer is the capture thread's own to replace
+			Ret = Manager->ResizeBuffer(Output);
+			if (Ret == DUPL_RETURN_SUCCESS)
+			{
+				continue;
+			}
+		}
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			Output->LastError = Ret;
+			break;
+		}
+		if (Timeout)
+		{
+			continue;
+		}
+
+		Ret = Manager->Publish(Output);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			Output->LastError = Ret;
+			break;
+		}
+		++Output->FrameCount;
+	}
+
+	EnterCriticalSection(&Manager->m_Lock);
+	--Manager->m_ActiveThreads;
+	WakeAllConditionVariable(&Manager->m_FrameReady);
+	LeaveCriticalSection(&Manager->m_Lock);
+
+	return 0;
+}
+
+//
+// Replace the capture buffer of Output with one its source's frames fit in after a mode change.
+// The output stays where Start laid it out, larger frames are clipped to that.
+//
+DUPL_RETURN CAPTUREMANAGER::ResizeBuffer(_Inout_ CAPTURE_OUTPUT* Output)
+{
+	UINT BufferSize = Output->Source->GetImageBufferSize();
+	BYTE* Buffer = reinterpret_cast<BYTE*>(_aligned_malloc(BufferSize, 64));
+	if (!Buffer)
+	{
+		fprintf_s(m_log_file, "Failed to allocate %u byte capture buffer for output %u.\n", BufferSize, static_cast<UINT>(Output - m_Outputs));
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	_aligned_free(Output->Buffer);
+	Output->Buffer = Buffer;
+	Output->BufferSize = BufferSize;
+	Output->Recovery->SetBufferSize(BufferSize);
+
+	EnterCriticalSection(&m_Lock);
+	Output->NeedsFullCopy = true;
+	LeaveCriticalSection(&m_Lock);
+
+	fprintf_s(m_log_file, "Output %u changed mode, it is published clipped to %ux%u.\n", static_cast<UINT>(Output - m_Outputs), Output->View.Width, Output->View.Height);
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Copy what changed in the output's last frame to where it is published, turned upright when
+// the output is rotated. Fails on formats other than 32bpp, which can't be published.
+//
+DUPL_RETURN CAPTUREMANAGER::Publish(_Inout_ CAPTURE_OUTPUT* Output)
+{
+	IMAGE_VIEW Image;
+	Output->Recovery->GetImageView(Output->Buffer, &Image);
+	const FRAME_METADATA* Meta = Output->Recovery->GetFrameMetaData();
+
+	if (GetFormatBytesPerPixel(Image.Format) != BPP)
+	{
+		fprintf_s(m_log_file, "Output %u has format %u, only 32bpp outputs can be published.\n", static_cast<UINT>(Output - m_Outputs), Image.Format);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	EnterCriticalSection(&m_Lock);
+
+	if (m_Mode == CAPTURE_MODE_COMPOSITE && m_PendingAcquireTime.QuadPart == 0)
+	{
+		if (Meta && Meta->AcquireTime.QuadPart)
+		{
+			m_PendingAcquireTime = Meta->AcquireTime;
+		}
+		else
+		{
+			QueryPerformanceCounter(&m_PendingAcquireTime);
+		}
+	}
+
+	// Image already has the moves applied, their destinations are just more changed pixels
+	RECT Full = { 0, 0, static_cast<LONG>(Image.Width), static_cast<LONG>(Image.Height) };
+	if (Output->NeedsFullCopy || !Meta || Meta->FullCopy || !GatherRects(Output, Meta))
+	{
+		PublishRects(Output, &Image, &Full, 1);
+		Output->NeedsFullCopy = false;
+	}
+	else
+	{
+		PublishRects(Output, &Image, Output->Rects, Meta->MoveCount + Meta->DirtyCount);
+	}
+
+	++m_Sequence;
+	WakeAllConditionVariable(&m_FrameReady);
+
+	LeaveCriticalSection(&m_Lock);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Put the move destinations and dirty rects of Meta one after the other into the rects of Output.
+// Returns false if they don't fit and the buffer can't be grown, the whole image is published then.
+//
+bool CAPTUREMANAGER::GatherRects(_Inout_ CAPTURE_OUTPUT* Output, _In_ const FRAME_METADATA* Meta)
+{
+	UINT Count = Meta->MoveCount + Meta->DirtyCount;
+	if (Count > Output->RectsSize)
+	{
+		if (Output->Rects)
+		{
+			delete [] Output->Rects;
+		}
+		Output->Rects = new (std::nothrow) RECT[Count];
+		if (!Output->Rects)
+		{
+			Output->RectsSize = 0;
+			return false;
+		}
+		Output->RectsSize = Count;
+	}
+
+	const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+	for (UINT i = 0; i < Meta->MoveCount; ++i)
+	{
+		Output->Rects[i] = MoveRects[i].DestinationRect;
+	}
+	if (Meta->DirtyCount)
+	{
+		memcpy_s(Output->Rects + Meta->MoveCount, Meta->DirtyCount * sizeof(RECT), Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)), Meta->DirtyCount * sizeof(RECT));
+	}
+	return true;
+}
+
+//
+// Copy the changed rects of the acquired image and, for the composite frame, note where they
+// landed on the virtual desktop. Rects are left mapped to the output. Called with m_Lock held.
+//
+void CAPTUREMANAGER::PublishRects(_Inout_ CAPTURE_OUTPUT* Output, _In_ const IMAGE_VIEW* Image, _Inout_updates_(Count) RECT* Rects, UINT Count)
+{
+	CopyRegionsRotated(Output->Target, Output->TargetPitch, Output->View.Width, Output->View.Height, Image->Data, Image->Pitch,
+		Image->Width, Image->Height, Image->Rotation, Rects, Count);
+
+	if (m_Mode != CAPTURE_MODE_COMPOSITE)
+	{
+		return;
+	}
+
+	// Where the rects are on the output, an output that doesn't match its desktop rect is clipped to it
+	RotateRects(Rects, Rects, Count, Image->Rotation, Image->Width, Image->Height);
+	RECT Bounds = { 0, 0, static_cast<LONG>(Output->View.Width), static_cast<LONG>(Output->View.Height) };
+	for (UINT i = 0; i < Count; ++i)
+	{
+		RECT Rect;
+		if (!IntersectRect(&Rect, &Rects[i], &Bounds))
+		{
+			continue;
+		}
+		if (m_PendingCount == CAPTURE_MAX_RECTS)
+		{
+			m_PendingOverflow = true;
+			return;
+		}
+		OffsetRect(&Rect, Output->OffsetX, Output->OffsetY);
+		m_PendingRects[m_PendingCount++] = Rect;
+	}
+}
+
+//
+// Composite mode: bring ImageData up to date with the virtual desktop. Only the rects the
+// outputs published since the last call are copied.
+//
+_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+DUPL_RETURN CAPTUREMANAGER::GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+{
+	*Timeout = false;
+	if (m_Mode != CAPTURE_MODE_COMPOSITE || !m_Started)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	if (!WaitForFrame(TimeoutMs, &m_DeliveredSequence))
+	{
+		EnterCriticalSection(&m_Lock);
+		UINT Active = m_ActiveThreads;
+		LeaveCriticalSection(&m_Lock);
+		if (!Active)
+		{
+			fprintf_s(m_log_file, "All capture outputs have stopped.\n");
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+
+		*Timeout = true;
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	EnterCriticalSection(&m_Lock);
+
+	// The first frame takes the whole virtual desktop, gaps between outputs included, and so
+	// does a frame with more rects than were kept
+	UINT Width = m_CompositePitch / BPP;
+	if (m_FullCopyNeeded || m_PendingOverflow)
+	{
+		RECT Full = { 0, 0, static_cast<LONG>(Width), static_cast<LONG>(m_CompositeHeight) };
+		CopyRegions(ImageData, m_CompositePitch, m_Composite, m_CompositePitch, Width, m_CompositeHeight, &Full, 1);
+		m_Meta.FullCopy = true;
+		m_Meta.DirtyCount = 0;
+	}
+	else
+	{
+		memcpy(m_FrameRects, m_PendingRects, m_PendingCount * sizeof(RECT));
+		CopyRegions(ImageData, m_CompositePitch, m_Composite, m_CompositePitch, Width, m_CompositeHeight, m_FrameRects, m_PendingCount);
+		m_Meta.FullCopy = false;
+		m_Meta.DirtyCount = m_PendingCount;
+	}
+	m_Meta.MetaData = reinterpret_cast<BYTE*>(m_FrameRects);
+	m_Meta.MetaDataSize = m_Meta.DirtyCount * sizeof(RECT);
+	m_Meta.MoveCount = 0;
+	m_Meta.Presented = true;
+	m_Meta.AcquireTime = m_PendingAcquireTime;
+	m_Meta.CopyTime = m_PendingAcquireTime;
+	m_Meta.MapTime = m_PendingAcquireTime;
+
+	m_FullCopyNeeded = false;
+	m_PendingOverflow = false;
+	m_PendingCount = 0;
+	m_PendingAcquireTime.QuadPart = 0;
+
+	LeaveCriticalSection(&m_Lock);
+
+	QueryPerformanceCounter(&m_Meta.ReadbackTime);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+void CAPTUREMANAGER::GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+{
+	View->Data = ImageData;
+	View->Width = m_CompositePitch / BPP;
+	View->Height = m_CompositeHeight;
+	View->Pitch = m_CompositePitch;
+	View->Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	View->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+}
+
+UINT CAPTUREMANAGER::GetImageBufferSize()
+{
+	return m_CompositePitch * m_CompositeHeight;
+}
+
+//
+// Composite frames carry the rects every output changed since the frame before, in virtual
+// desktop coordinates. Moves come out as dirty rects since their source may be on another output.
+//
+const FRAME_METADATA* CAPTUREMANAGER::GetFrameMetaData()
+{
+	return (m_Mode == CAPTURE_MODE_COMPOSITE) ? &m_Meta : nullptr;
+}
+
+//
+// Describes the virtual desktop
+//
+void CAPTUREMANAGER::GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+{
+	RtlZeroMemory(DescPtr, sizeof(DXGI_OUTPUT_DESC));
+	DescPtr->DesktopCoordinates = m_Bounds;
+	DescPtr->AttachedToDesktop = TRUE;
+	DescPtr->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+}
+
+//
+// Free the per output buffers and the sources the manager owns
+//
+void CAPTUREMANAGER::CleanRefs()
+{
+	for (UINT i = 0; i < m_OutputCount; ++i)
+	{
+		CAPTURE_OUTPUT* Output = &m_Outputs[i];
+		if (Output->Buffer)
+		{
+			_aligned_free(Output->Buffer);
+			Output->Buffer = nullptr;
+		}
+		if (Output->Published)
+		{
+			_aligned_free(Output->Published);
+			Output->Published = nullptr;
+		}
+		if (Output->Rects)
+		{
+			delete [] Output->Rects;
+			Output->Rects = nullptr;
+		}
+		Output->RectsSize = 0;
+		Output->Target = nullptr;
+		if (Output->Recovery)
+		{
+			delete Output->Recovery;
+			Output->Recovery = nullptr;
+		}
+		if (Output->OwnsSource)
+		{
+			delete Output->Source;
+		}
+		Output->Source = nullptr;
+	}
+	m_OutputCount = 0;
+
+	if (m_Composite)
+	{
+		_aligned_free(m_Composite);
+		m_Composite = nullptr;
+	}
+}
@@ -0,0 +1,126 @@
+// CaptureManager.h : Captures several outputs at once, one thread per output, and
+// publishes them either separately or composited into one virtual desktop image.
+//
+
+#ifndef _CAPTUREMANAGER_H_
+#define _CAPTUREMANAGER_H_
+
+#include "DuplicationManager.h"
+#include "CaptureRecovery.h"
+
+#define CAPTURE_MAX_OUTPUTS     16
+
+// Changed rects a composite frame collects from its outputs, past this it is copied whole
+#define CAPTURE_MAX_RECTS       256
+
+typedef enum
+{
+	CAPTURE_MODE_PER_OUTPUT = 0,    // Every output is published as its own image
+	CAPTURE_MODE_COMPOSITE = 1      // Outputs are placed into one image by their desktop coordinates
+} CAPTURE_MODE;
+
+class CAPTUREMANAGER;
+
+//
+// Per output state, owned by the output's capture thread except where noted
+//
+typedef struct _CAPTURE_OUTPUT
+{
+	CAPTUREMANAGER* Manager;
+	FRAMESOURCE* Source;
+	bool OwnsSource;
+	HANDLE Thread;
+
+	// Resets Source through desktop switches, mode changes and TDRs, the capture thread reads
+	// frames through it
+	FRAMERECOVERY* Recovery;
+
+	// Buffer the source writes into, only touched by the capture thread
+	_Field_size_bytes_(BufferSize) BYTE* Buffer;
+	UINT BufferSize;
+
+	// Changed rects of the frame being published, only touched by the capture thread
+	_Field_size_(RectsSize) RECT* Rects;
+	UINT RectsSize;
+
+	// Where the output's frames are published. Guarded by the manager lock.
+	BYTE* Target;
+	UINT TargetPitch;
+	BYTE* Published;                // Per output image in CAPTURE_MODE_PER_OUTPUT
+	IMAGE_VIEW View;                // Of the published image, upright like the desktop
+	bool NeedsFullCopy;
+
+	// Same idea as THREAD_DATA in the desktop duplication sample
+	INT OffsetX;
+	INT OffsetY;
+	DXGI_OUTPUT_DESC Desc;
+
+	UINT FrameCount;
+	DUPL_RETURN LastError;
+} CAPTURE_OUTPUT;
+
+//
+// Runs a FRAMESOURCE per output, each behind its own FRAMERECOVERY. In composite mode the manager is itself a frame source
+// producing the virtual desktop.
+//
+class CAPTUREMANAGER : public FRAMESOURCE
+{
+	public:
+		CAPTUREMANAGER();
+		~CAPTUREMANAGER();
+		DUPL_RETURN EnumerateOutputs(_In_ FILE *log_file, _In_opt_ const COALESCE_PARAMS* Coalesce, bool DrawPointer, _In_opt_ EVENTLOG* EventLog = nullptr);
+		DUPL_RETURN AddSource(_In_ FILE *log_file, _In_ FRAMESOURCE* Source, bool OwnsSource);
+		DUPL_RETURN Start(CAPTURE_MODE Mode);
+		void Stop();
+		UINT GetOutputCount();
+		bool WaitForFrame(DWORD TimeoutMs, _Inout_ UINT64* Sequence);
+		DUPL_RETURN CopyOutput(UINT Output, _Out_writes_bytes_(BufferSize) BYTE* Buffer, UINT BufferSize, _Out_ IMAGE_VIEW* View);
+
+		// FRAMESOURCE, composite mode only
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs = FRAME_TIMEOUT_DEFAULT);
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View);
+		UINT GetImageBufferSize();
+		const FRAME_METADATA* GetFrameMetaData();
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
+
+	private:
+		FILE *m_log_file;
+		CAPTURE_MODE m_Mode;
+		CAPTURE_OUTPUT m_Outputs[CAPTURE_MAX_OUTPUTS];
+		UINT m_OutputCount;
+		CRITICAL_SECTION m_Lock;
+		CONDITION_VARIABLE m_FrameReady;
+		volatile LONG m_Terminate;
+		bool m_Started;
+		UINT m_ActiveThreads;
+		UINT64 m_Sequence;
+
+		// Virtual desktop
+		RECT m_Bounds;
+		BYTE* m_Composite;
+		UINT m_CompositePitch;
+		UINT m_CompositeHeight;
+		UINT64 m_DeliveredSequence;
+		bool m_FullCopyNeeded;
+
+		// Changed rects in virtual desktop coordinates published since the last composite GetFrame.
+		// Guarded by the manager lock.
+		RECT m_PendingRects[CAPTURE_MAX_RECTS];
+		UINT m_PendingCount;
+		bool m_PendingOverflow;
+		LARGE_INTEGER m_PendingAcquireTime;
+
+		// Of the composite frame last delivered
+		RECT m_FrameRects[CAPTURE_MAX_RECTS];
+		FRAME_METADATA m_Meta;
+
+		static DWORD WINAPI CaptureProc(_In_ void* Param);
+		DUPL_RETURN Publish(_Inout_ CAPTURE_OUTPUT* Output);
+		DUPL_RETURN ResizeBuffer(_Inout_ CAPTURE_OUTPUT* Output);
+		bool GatherRects(_Inout_ CAPTURE_OUTPUT* Output, _In_ const FRAME_METADATA* Meta);
+		void PublishRects(_Inout_ CAPTURE_OUTPUT* Output, _In_ const IMAGE_VIEW* Image, _Inout_updates_(Count) RECT* Rects, UINT Count);
+		void CleanRefs();
+};
+
+#endif
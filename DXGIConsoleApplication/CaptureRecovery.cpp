@@ -0,0 +1,193 @@
+// CaptureRecovery.cpp : Reset with exponential backoff of a frame source that was lost.
+//
+
+#include "CaptureRecovery.h"
+
+FRAMERECOVERY::FRAMERECOVERY() : m_log_file(nullptr),
+								 m_Source(nullptr),
+								 m_Clock(nullptr),
+								 m_BufferSize(0),
+								 m_LostBufferSize(0),
+								 m_State(RECOVERY_STATE_RUNNING),
+								 m_LostTicks(0),
+								 m_NextAttempt(0),
+								 m_Backoff(0),
+								 m_LossAttempts(0)
+{
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+FRAMERECOVERY::~FRAMERECOVERY()
+{
+}
+
+//
+// Recover Source, whose frames go into buffers of BufferSize bytes. Backoff is timed
+// with Clock, or with QueryPerformanceCounter without one.
+//
+void FRAMERECOVERY::Init(_In_ FILE *log_file, _In_ FRAMESOURCE* Source, UINT BufferSize, _In_opt_ FRAMECLOCK* Clock)
+{
+	m_log_file = log_file;
+	m_Source = Source;
+	m_Clock = Clock ? Clock : &m_SystemClock;
+	m_BufferSize = BufferSize;
+	m_State = RECOVERY_STATE_RUNNING;
+
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_Stats.Frequency = m_Clock->GetFrequency();
+}
+
+_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+DUPL_RETURN FRAMERECOVERY::GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+{
+	*Timeout = true;
+
+	switch (m_State)
+	{
+		case RECOVERY_STATE_RUNNING:
+		{
+			DUPL_RETURN Ret = m_Source->GetFrame(ImageData, Timeout, TimeoutMs);
+			if (Ret == DUPL_RETURN_ERROR_UNEXPECTED)
+			{
+				m_State = RECOVERY_STATE_FAILED;
+			}
+			if (Ret != DUPL_RETURN_ERROR_EXPECTED)
+			{
+				return Ret;
+			}
+
+			// Lost, the first reset is tried right away
+			*Timeout = true;
+			m_State = RECOVERY_STATE_RECOVERING;
+			m_LostTicks = m_Clock->GetTicks();
+			m_NextAttempt = m_LostTicks;
+			m_Backoff = m_Stats.Frequency * RECOVERY_BACKOFF_INITIAL_MS / 1000;
+			m_LossAttempts = 0;
+			m_LostBufferSize = m_Source->GetImageBufferSize();
+			++m_Stats.Losses;
+			fprintf_s(m_log_file, "Capture was lost, recovering.\n");
+			return Recover(0);
+		}
+		case RECOVERY_STATE_RECOVERING:
+		{
+			return Recover(TimeoutMs);
+		}
+		case RECOVERY_STATE_MODE_CHANGED:
+		{
+			return DUPL_RETURN_ERROR_EXPECTED;
+		}
+		default:
+		{
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+	}
+}
+
+//
+// Wait at most TimeoutMs for the next reset to be due and try it. Every call is a frame lost.
+//
+DUPL_RETURN FRAMERECOVERY::Recover(UINT TimeoutMs)
+{
+	++m_Stats.FramesLost;
+
+	UINT64 Now = m_Clock->GetTicks();
+	if (Now < m_NextAttempt)
+	{
+		UINT64 Deadline = Now + m_Stats.Frequency * TimeoutMs / 1000;
+		if (Deadline < m_NextAttempt)
+		{
+			m_Clock->WaitUntil(Deadline);
+			return DUPL_RETURN_SUCCESS;
+		}
+		m_Clock->WaitUntil(m_NextAttempt);
+	}
+
+	++m_Stats.Attempts;
+	++m_LossAttempts;
+	DUPL_RETURN Ret = m_Source->Reset();
+	Now = m_Clock->GetTicks();
+	if (Ret == DUPL_RETURN_ERROR_EXPECTED)
+	{
+		// Transition still going on
+		m_NextAttempt = Now + m_Backoff;
+		m_Backoff = min(m_Backoff * 2, m_Stats.Frequency * RECOVERY_BACKOFF_MAX_MS / 1000);
+		return DUPL_RETURN_SUCCESS;
+	}
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		m_State = RECOVERY_STATE_FAILED;
+		fprintf_s(m_log_file, "Capture couldn't be recovered after %u attempts.\n", m_LossAttempts);
+		return Ret;
+	}
+
+	UINT64 Ticks = Now - m_LostTicks;
+	m_Stats.LastRecoverTicks = Ticks;
+	m_Stats.MaxRecoverTicks = max(m_Stats.MaxRecoverTicks, Ticks);
+	m_Stats.TotalRecoverTicks += Ticks;
+	++m_Stats.Recoveries;
+
+	UINT BufferSize = m_Source->GetImageBufferSize();
+	if (BufferSize != m_LostBufferSize)
+	{
+		++m_Stats.ModeChanges;
+	}
+	fprintf_s(m_log_file, "Capture recovered after %.3f ms and %u attempts.\n", Ticks * 1000.0 / m_Stats.Frequency, m_LossAttempts);
+
+	if (BufferSize > m_BufferSize)
+	{
+		m_State = RECOVERY_STATE_MODE_CHANGED;
+		fprintf_s(m_log_file, "Frames now need %u bytes, the buffers hold %u.\n", BufferSize, m_BufferSize);
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	m_State = RECOVERY_STATE_RUNNING;
+	return DUPL_RETURN_SUCCESS;
+}
+
+void FRAMERECOVERY::GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+{
+	m_Source->GetImageView(ImageData, View);
+}
+
+UINT FRAMERECOVERY::GetImageBufferSize()
+{
+	return m_Source->GetImageBufferSize();
+}
+
+const FRAME_METADATA* FRAMERECOVERY::GetFrameMetaData()
+{
+	return (m_State == RECOVERY_STATE_RUNNING) ? m_Source->GetFrameMetaData() : nullptr;
+}
+
+bool FRAMERECOVERY::IsFramePending()
+{
+	return (m_State == RECOVERY_STATE_RUNNING) && m_Source->IsFramePending();
+}
+
+void FRAMERECOVERY::GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+{
+	m_Source->GetOutputDesc(DescPtr);
+}
+
+//
+// The caller's buffers now hold BufferSize bytes. Resumes a source that came back larger
+// once they are large enough.
+//
+void FRAMERECOVERY::SetBufferSize(UINT BufferSize)
+{
+	m_BufferSize = BufferSize;
+	if (m_State == RECOVERY_STATE_MODE_CHANGED && m_Source->GetImageBufferSize() <= BufferSize)
+	{
+		m_State = RECOVERY_STATE_RUNNING;
+	}
+}
+
+RECOVERY_STATE FRAMERECOVERY::GetState()
+{
+	return m_State;
+}
+
+void FRAMERECOVERY::GetStats(_Out_ RECOVERY_STATS* Stats)
+{
+	*Stats = m_Stats;
+}
@@ -0,0 +1,80 @@
+// CaptureRecovery.h : Keeps a frame source going through desktop switches, mode changes and
+// TDRs by resetting it with exponential backoff instead of giving up on the first lost frame.
+//
+
+#ifndef _CAPTURERECOVERY_H_
+#define _CAPTURERECOVERY_H_
+
+#include "FramePacer.h"
+
+// The first reset is tried right away, the wait before each further one doubles up to the maximum
+#define RECOVERY_BACKOFF_INITIAL_MS     8
+#define RECOVERY_BACKOFF_MAX_MS         1000
+
+typedef enum
+{
+	RECOVERY_STATE_RUNNING = 0,
+	RECOVERY_STATE_RECOVERING = 1,      // Source was lost, waiting for the next reset
+	RECOVERY_STATE_MODE_CHANGED = 2,    // Source came back with an image larger than the caller's buffers
+	RECOVERY_STATE_FAILED = 3           // Source returned an unexpected error
+} RECOVERY_STATE;
+
+//
+// Counters of the recovery. Tick values are in the clock's ticks.
+//
+typedef struct _RECOVERY_STATS
+{
+	UINT Losses;                // Expected errors that started a recovery
+	UINT Recoveries;            // Losses the source came back from
+	UINT Attempts;              // Resets tried
+	UINT ModeChanges;           // Recoveries after which the source needed a different buffer size
+	UINT FramesLost;            // GetFrame calls answered without a frame while the source was lost
+	UINT64 LastRecoverTicks;    // From the error to the reset that succeeded
+	UINT64 MaxRecoverTicks;
+	UINT64 TotalRecoverTicks;
+	UINT64 Frequency;
+} RECOVERY_STATS;
+
+//
+// Frame source that passes frames through from Source. When Source returns
+// DUPL_RETURN_ERROR_EXPECTED it is reset until it comes back, and in the meantime GetFrame
+// times out so the caller keeps its loop and its buffers. Once recovered the next frame is
+// read back in full into the same buffer, unless the source now needs more than BufferSize
+// bytes. Then GetFrame returns DUPL_RETURN_ERROR_EXPECTED until SetBufferSize is called with
+// the size of the caller's new buffers. Unexpected errors end the capture as before.
+//
+class FRAMERECOVERY : public FRAMESOURCE
+{
+	public:
+		FRAMERECOVERY();
+		~FRAMERECOVERY();
+		void Init(_In_ FILE *log_file, _In_ FRAMESOURCE* Source, UINT BufferSize, _In_opt_ FRAMECLOCK* Clock = nullptr);
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs);
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View);
+		UINT GetImageBufferSize();
+		const FRAME_METADATA* GetFrameMetaData();
+		bool IsFramePending();
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
+		void SetBufferSize(UINT BufferSize);
+		RECOVERY_STATE GetState();
+		void GetStats(_Out_ RECOVERY_STATS* Stats);
+
+	private:
+		FILE *m_log_file;
+		FRAMESOURCE* m_Source;
+		FRAMECLOCK* m_Clock;
+		SYSTEMCLOCK m_SystemClock;
+		UINT m_BufferSize;
+		UINT m_LostBufferSize;      // Source's buffer size when it was lost
+		RECOVERY_STATE m_State;
+		UINT64 m_LostTicks;
+		UINT64 m_NextAttempt;
+		UINT64 m_Backoff;
+		UINT m_LossAttempts;        // Resets tried since the source was lost
+		RECOVERY_STATS m_Stats;
+
+		DUPL_RETURN Recover(UINT TimeoutMs);
+};
+
+#endif
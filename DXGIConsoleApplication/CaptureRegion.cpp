@@ -0,0 +1,107 @@
+// CaptureRegion.cpp : Mapping of capture regions onto the acquired image and clipping of
+// the frame's rects to them.
+//
+
+#include "CaptureRegion.h"
+
+void DesktopRectToImage(_Out_ RECT* ImageRect, _In_ const RECT* DesktopRect, DXGI_MODE_ROTATION Rotation, INT TexWidth, INT TexHeight)
+{
+	switch (Rotation)
+	{
+		case DXGI_MODE_ROTATION_ROTATE90:
+		{
+			ImageRect->left = DesktopRect->top;
+			ImageRect->top = TexHeight - DesktopRect->right;
+			ImageRect->right = DesktopRect->bottom;
+			ImageRect->bottom = TexHeight - DesktopRect->left;
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE180:
+		{
+			ImageRect->left = TexWidth - DesktopRect->right;
+			ImageRect->top = TexHeight - DesktopRect->bottom;
+			ImageRect->right = TexWidth - DesktopRect->left;
+			ImageRect->bottom = TexHeight - DesktopRect->top;
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE270:
+		{
+			ImageRect->left = TexWidth - DesktopRect->bottom;
+			ImageRect->top = DesktopRect->left;
+			ImageRect->right = TexWidth - DesktopRect->top;
+			ImageRect->bottom = DesktopRect->right;
+			break;
+		}
+		default:
+		{
+			*ImageRect = *DesktopRect;
+			break;
+		}
+	}
+}
+
+bool BuildRegionLayout(_Out_ REGION_LAYOUT* Layout, _In_reads_(Count) const RECT* DesktopRegions, UINT Count, _In_ const DXGI_OUTPUT_DESC* Desc, INT TexWidth, INT TexHeight)
+{
+	RtlZeroMemory(Layout, sizeof(REGION_LAYOUT));
+
+	const RECT* Output = &Desc->DesktopCoordinates;
+	RECT Bounds = { 0, 0, Output->right - Output->left, Output->bottom - Output->top };
+	for (UINT i = 0; i < Count && Layout->Count < CAPTURE_MAX_REGIONS; ++i)
+	{
+		// Relative to the output, clipped to it
+		RECT Relative = DesktopRegions[i];
+		OffsetRect(&Relative, -Output->left, -Output->top);
+		RECT Clipped;
+		if (!IntersectRect(&Clipped, &Relative, &Bounds))
+		{
+			continue;
+		}
+
+		CAPTURE_REGION* Region = &Layout->Regions[Layout->Count++];
+		DesktopRectToImage(&Region->Source, &Clipped, Desc->Rotation, TexWidth, TexHeight);
+		Region->Dest.x = 0;
+		Region->Dest.y = Layout->Height;
+
+		UINT Width = Region->Source.right - Region->Source.left;
+		Layout->Width = max(Layout->Width, Width);
+		Layout->Height += Region->Source.bottom - Region->Source.top;
+	}
+
+	return Layout->Count != 0;
+}
+
+//
+// Intersect Rect with every region and append the parts inside them in region image coordinates
+//
+static UINT ClipRect(_Out_writes_to_(Layout->Count, return) RECT* Out, _In_ const REGION_LAYOUT* Layout, _In_ const RECT* Rect)
+{
+	UINT Count = 0;
+	for (UINT i = 0; i < Layout->Count; ++i)
+	{
+		const CAPTURE_REGION* Region = &Layout->Regions[i];
+		if (IntersectRect(&Out[Count], Rect, &Region->Source))
+		{
+			OffsetRect(&Out[Count], Region->Dest.x - Region->Source.left, Region->Dest.y - Region->Source.top);
+			++Count;
+		}
+	}
+
+	return Count;
+}
+
+UINT ClipRectsToRegions(_Out_writes_to_((MoveCount + DirtyCount) * Layout->Count, return) RECT* Out, _In_ const REGION_LAYOUT* Layout,
+	_In_reads_(MoveCount) const DXGI_OUTDUPL_MOVE_RECT* MoveRects, UINT MoveCount, _In_reads_(DirtyCount) const RECT* DirtyRects, UINT DirtyCount)
+{
+	UINT Count = 0;
+	for (UINT i = 0; i < MoveCount; ++i)
+	{
+		Count += ClipRect(Out + Count, Layout, &MoveRects[i].DestinationRect);
+	}
+
+	for (UINT i = 0; i < DirtyCount; ++i)
+	{
+		Count += ClipRect(Out + Count, Layout, &DirtyRects[i]);
+	}
+
+	return Count;
+}
@@ -0,0 +1,56 @@
+// CaptureRegion.h : Regions of interest for capturing only part of an output. Regions are
+// given in desktop coordinates, mapped onto the acquired image and stacked into one region
+// image, which is all that is copied to the staging textures and read back.
+//
+
+#ifndef _CAPTUREREGION_H_
+#define _CAPTUREREGION_H_
+
+#include <windows.h>
+#include <sal.h>
+#include <dxgi1_2.h>
+
+// Regions one output can be captured with
+#define CAPTURE_MAX_REGIONS     8
+
+typedef struct _CAPTURE_REGION
+{
+	RECT Source;            // In the acquired image
+	POINT Dest;             // Top left in the region image
+} CAPTURE_REGION;
+
+//
+// Regions stacked top to bottom at the left edge of the region image, which is as wide as
+// the widest region. Like the acquired image the regions are not rotated with the output.
+//
+typedef struct _REGION_LAYOUT
+{
+	CAPTURE_REGION Regions[CAPTURE_MAX_REGIONS];
+	UINT Count;
+	UINT Width;
+	UINT Height;
+} REGION_LAYOUT;
+
+//
+// Inverse of the destination mapping of SetMoveRectForRotation. Converts a rect relative to
+// the top left of an output in desktop orientation into the acquired image, which is
+// TexWidth x TexHeight and not rotated.
+//
+void DesktopRectToImage(_Out_ RECT* ImageRect, _In_ const RECT* DesktopRect, DXGI_MODE_ROTATION Rotation, INT TexWidth, INT TexHeight);
+
+//
+// Lay out the DesktopRegions that are on the output Desc describes. Regions are clipped to the
+// output, the ones off it are left out. Returns false if no region is left.
+//
+bool BuildRegionLayout(_Out_ REGION_LAYOUT* Layout, _In_reads_(Count) const RECT* DesktopRegions, UINT Count, _In_ const DXGI_OUTPUT_DESC* Desc, INT TexWidth, INT TexHeight);
+
+//
+// Intersect the move destinations and dirty rects of an acquired image with every region and
+// translate them into the region image. Moved pixels may come from outside the regions, so
+// moves come out as dirty rects too. Out must hold (MoveCount + DirtyCount) * Layout->Count rects.
+// Returns the number of rects written, 0 if the frame left the regions untouched.
+//
+UINT ClipRectsToRegions(_Out_writes_to_((MoveCount + DirtyCount) * Layout->Count, return) RECT* Out, _In_ const REGION_LAYOUT* Layout,
+	_In_reads_(MoveCount) const DXGI_OUTDUPL_MOVE_RECT* MoveRects, UINT MoveCount, _In_reads_(DirtyCount) const RECT* DirtyRects, UINT DirtyCount);
+
+#endif
@@ -0,0 +1,340 @@
+// ColorConvert.cpp : Scalar reference, SSE4.1 and AVX2 kernels for BGRA to YUV conversion.
+//
+// All kernels use the same integer arithmetic so every path produces identical output:
+//   Y = ((YR * R + YG * G + YB * B + 128) >> 8) + 16
+//   U = ((UR * R + UG * G + UB * B + 128) >> 8) + 128
+//   V = ((VR * R + VG * G + VB * B + 128) >> 8) + 128
+// Chroma is computed from the rounded average of the 2x2 (4:2:0) or 2x1 (4:2:2) pixel block.
+//
+
+#include "ColorConvert.h"
+#include "ImageView.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+// Luma is written in chunks of this many pixels when it has to be interleaved afterwards
+#define YUY2_CHUNK  256
+
+typedef struct _COLOR_COEFFS
+{
+	short YB, YG, YR;
+	short UB, UG, UR;
+	short VB, VG, VR;
+} COLOR_COEFFS;
+
+// Indexed by COLOR_MATRIX. Same BT.601 values PixelShader.hlsl uses.
+static const COLOR_COEFFS ColorCoeffs[] =
+{
+	{ 25, 129, 66,   112, -74, -38,   -18, -94, 112 },
+	{ 16, 157, 47,   112, -86, -26,   -10, -102, 112 }
+};
+
+typedef void (*LUMA_ROW_FUNC)(_In_ const BYTE* Src, _Out_ BYTE* DstY, UINT Width, _In_ const COLOR_COEFFS* Coeffs);
+typedef void (*CHROMA_ROW_FUNC)(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* DstU, _Out_ BYTE* DstV, UINT Step, _In_ const COLOR_COEFFS* Coeffs);
+
+//
+// Scalar reference kernels
+//
+static void LumaRow_Scalar(_In_ const BYTE* Src, _Out_ BYTE* DstY, UINT Width, _In_ const COLOR_COEFFS* Coeffs)
+{
+	for (UINT x = 0; x < Width; ++x, Src += BPP)
+	{
+		DstY[x] = static_cast<BYTE>(((Coeffs->YB * Src[0] + Coeffs->YG * Src[1] + Coeffs->YR * Src[2] + 128) >> 8) + 16);
+	}
+}
+
+//
+// One chroma sample per two pixels of Row0 and Row1. Pass Row1 == Row0 for 4:2:2.
+// Samples are written Step bytes apart so the same kernel serves planar, NV12 and YUY2 output.
+//
+static void ChromaRow_Scalar(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* DstU, _Out_ BYTE* DstV, UINT Step, _In_ const COLOR_COEFFS* Coeffs)
+{
+	UINT ChromaWidth = (Width + 1) / 2;
+	for (UINT i = 0; i < ChromaWidth; ++i)
+	{
+		UINT x0 = 2 * i * BPP;
+		UINT x1 = (2 * i + 1 < Width) ? x0 + BPP : x0;
+
+		INT B = (Row0[x0] + Row0[x1] + Row1[x0] + Row1[x1] + 2) >> 2;
+		INT G = (Row0[x0 + 1] + Row0[x1 + 1] + Row1[x0 + 1] + Row1[x1 + 1] + 2) >> 2;
+		INT R = (Row0[x0 + 2] + Row0[x1 + 2] + Row1[x0 + 2] + Row1[x1 + 2] + 2) >> 2;
+
+		DstU[i * Step] = static_cast<BYTE>(((Coeffs->UB * B + Coeffs->UG * G + Coeffs->UR * R + 128) >> 8) + 128);
+		DstV[i * Step] = static_cast<BYTE>(((Coeffs->VB * B + Coeffs->VG * G + Coeffs->VR * R + 128) >> 8) + 128);
+	}
+}
+
+//
+// SSE4.1 kernels, 8 pixels per iteration
+//
+KERNEL_TARGET("sse4.1")
+static void LumaRow_SSE41(_In_ const BYTE* Src, _Out_ BYTE* DstY, UINT Width, _In_ const COLOR_COEFFS* Coeffs)
+{
+	const __m128i Coef = _mm_setr_epi16(Coeffs->YB, Coeffs->YG, Coeffs->YR, 0, Coeffs->YB, Coeffs->YG, Coeffs->YR, 0);
+	const __m128i Round = _mm_set1_epi32(128);
+	const __m128i Offset = _mm_set1_epi32(16);
+
+	UINT x = 0;
+	for (; x + 8 <= Width; x += 8)
+	{
+		__m128i PxA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + x * BPP));
+		__m128i PxB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + x * BPP + 16));
+
+		// Widen to 16 bit, madd gives B*YB + G*YG and R*YR per pixel, hadd finishes the dot product
+		__m128i SumA = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(PxA), Coef), _mm_madd_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(PxA, 8)), Coef));
+		__m128i SumB = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(PxB), Coef), _mm_madd_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(PxB, 8)), Coef));
+
+		SumA = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(SumA, Round), 8), Offset);
+		SumB = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(SumB, Round), 8), Offset);
+
+		__m128i Y = _mm_packs_epi32(SumA, SumB);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(DstY + x), _mm_packus_epi16(Y, Y));
+	}
+
+	LumaRow_Scalar(Src + x * BPP, DstY + x, Width - x, Coeffs);
+}
+
+KERNEL_TARGET("sse4.1")
+static void ChromaRow_SSE41(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* DstU, _Out_ BYTE* DstV, UINT Step, _In_ const COLOR_COEFFS* Coeffs)
+{
+	const __m128i CoefU = _mm_setr_epi16(Coeffs->UB, Coeffs->UG, Coeffs->UR, 0, Coeffs->UB, Coeffs->UG, Coeffs->UR, 0);
+	const __m128i CoefV = _mm_setr_epi16(Coeffs->VB, Coeffs->VG, Coeffs->VR, 0, Coeffs->VB, Coeffs->VG, Coeffs->VR, 0);
+	const __m128i Two = _mm_set1_epi16(2);
+	const __m128i Round = _mm_set1_epi32(128);
+	const __m128i Offset = _mm_set1_epi32(128);
+
+	UINT x = 0;
+	UINT i = 0;
+	for (; x + 8 <= Width; x += 8, i += 4)
+	{
+		__m128i Top[2];
+		__m128i Bottom[2];
+		Top[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row0 + x * BPP));
+		Top[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row0 + x * BPP + 16));
+		Bottom[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row1 + x * BPP));
+		Bottom[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row1 + x * BPP + 16));
+
+		__m128i Avg[2];
+		for (UINT j = 0; j < 2; ++j)
+		{
+			// Vertical sums of a pixel pair, then add the pair together
+			__m128i Pair0 = _mm_add_epi16(_mm_cvtepu8_epi16(Top[j]), _mm_cvtepu8_epi16(Bottom[j]));
+			__m128i Pair1 = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(Top[j], 8)), _mm_cvtepu8_epi16(_mm_srli_si128(Bottom[j], 8)));
+			Pair0 = _mm_add_epi16(Pair0, _mm_srli_si128(Pair0, 8));
+			Pair1 = _mm_add_epi16(Pair1, _mm_srli_si128(Pair1, 8));
+			Avg[j] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(Pair0, Pair1), Two), 2);
+		}
+
+		__m128i U = _mm_hadd_epi32(_mm_madd_epi16(Avg[0], CoefU), _mm_madd_epi16(Avg[1], CoefU));
+		__m128i V = _mm_hadd_epi32(_mm_madd_epi16(Avg[0], CoefV), _mm_madd_epi16(Avg[1], CoefV));
+		U = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(U, Round), 8), Offset);
+		V = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(V, Round), 8), Offset);
+
+		__m128i UV = _mm_packs_epi32(U, V);
+		UV = _mm_packus_epi16(UV, UV);
+
+		if (Step == 1)
+		{
+			*reinterpret_cast<INT*>(DstU + i) = _mm_cvtsi128_si32(UV);
+			*reinterpret_cast<INT*>(DstV + i) = _mm_extract_epi32(UV, 1);
+		}
+		else
+		{
+			BYTE Samples[16];
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(Samples), UV);
+			for (UINT k = 0; k < 4; ++k)
+			{
+				DstU[(i + k) * Step] = Samples[k];
+				DstV[(i + k) * Step] = Samples[k + 4];
+			}
+		}
+	}
+
+	ChromaRow_Scalar(Row0 + x * BPP, Row1 + x * BPP, Width - x, DstU + i * Step, DstV + i * Step, Step, Coeffs);
+}
+
+//
+// AVX2 luma kernel, 16 pixels per iteration. Chroma uses the SSE4.1 kernel.
+//
+KERNEL_TARGET("avx2")
+static void LumaRow_AVX2(_In_ const BYTE* Src, _Out_ BYTE* DstY, UINT Width, _In_ const COLOR_COEFFS* Coeffs)
+{
+	const __m256i Coef = _mm256_setr_epi16(Coeffs->YB, Coeffs->YG, Coeffs->YR, 0, Coeffs->YB, Coeffs->YG, Coeffs->YR, 0,
+		Coeffs->YB, Coeffs->YG, Coeffs->YR, 0, Coeffs->YB, Coeffs->YG, Coeffs->YR, 0);
+	const __m256i Round = _mm256_set1_epi32(128);
+	const __m256i Offset = _mm256_set1_epi32(16);
+
+	UINT x = 0;
+	for (; x + 16 <= Width; x += 16)
+	{
+		__m256i Sum[2];
+		for (UINT j = 0; j < 2; ++j)
+		{
+			const BYTE* Px = Src + (x + j * 8) * BPP;
+
+			// Lanes hold pixels [0 1 | 2 3] and [4 5 | 6 7]
+			__m256i Lo = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Px)));
+			__m256i Hi = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Px + 16)));
+
+			// In lane hadd leaves the pixels ordered 0 1 4 5 | 2 3 6 7, put them back in order
+			__m256i Dot = _mm256_hadd_epi32(_mm256_madd_epi16(Lo, Coef), _mm256_madd_epi16(Hi, Coef));
+			Dot = _mm256_permute4x64_epi64(Dot, _MM_SHUFFLE(3, 1, 2, 0));
+			Sum[j] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(Dot, Round), 8), Offset);
+		}
+
+		__m128i Y0 = _mm_packs_epi32(_mm256_castsi256_si128(Sum[0]), _mm256_extracti128_si256(Sum[0], 1));
+		__m128i Y1 = _mm_packs_epi32(_mm256_castsi256_si128(Sum[1]), _mm256_extracti128_si256(Sum[1], 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(DstY + x), _mm_packus_epi16(Y0, Y1));
+	}
+
+	LumaRow_SSE41(Src + x * BPP, DstY + x, Width - x, Coeffs);
+}
+
+typedef struct _CONVERT_KERNELS
+{
+	CONVERT_PATH Path;
+	LUMA_ROW_FUNC LumaRow;
+	CHROMA_ROW_FUNC ChromaRow;
+} CONVERT_KERNELS;
+
+// Indexed by CONVERT_PATH
+static const CONVERT_KERNELS ConvertKernels[] =
+{
+	{ CONVERT_PATH_SCALAR, LumaRow_Scalar, ChromaRow_Scalar },
+	{ CONVERT_PATH_SSE41, LumaRow_SSE41, ChromaRow_SSE41 },
+	{ CONVERT_PATH_AVX2, LumaRow_AVX2, ChromaRow_SSE41 }
+};
+
+// Entry of ConvertKernels SetConvertPath selected, nullptr until it is called
+static PVOID volatile g_Kernels = nullptr;
+
+CONVERT_PATH GetSupportedConvertPath()
+{
+	INT CpuInfo[4];
+
+	__cpuid(CpuInfo, 0);
+	INT MaxLeaf = CpuInfo[0];
+
+	__cpuid(CpuInfo, 1);
+	bool Sse41 = (CpuInfo[2] & (1 << 19)) != 0;
+	bool OsXSave = (CpuInfo[2] & (1 << 27)) != 0;
+	bool Avx = (CpuInfo[2] & (1 << 28)) != 0;
+
+	// AVX2 also needs the OS to save the YMM registers
+	if (Sse41 && Avx && OsXSave && MaxLeaf >= 7 && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(CpuInfo, 7, 0);
+		if (CpuInfo[1] & (1 << 5))
+		{
+			return CONVERT_PATH_AVX2;
+		}
+	}
+
+	return Sse41 ? CONVERT_PATH_SSE41 : CONVERT_PATH_SCALAR;
+}
+
+//
+// Kernels of the selected path. The kernels pointer is published as a whole, so converters
+// running on other threads see either the old or the new path, never half of each.
+//
+static const CONVERT_KERNELS* GetKernels()
+{
+	const CONVERT_KERNELS* Kernels = static_cast<const CONVERT_KERNELS*>(ReadPointerAcquire(&g_Kernels));
+	if (Kernels)
+	{
+		return Kernels;
+	}
+
+	// The CPU is queried once, the first converters may race here and local statics are initialized thread safely
+	static const CONVERT_KERNELS* const Supported = &ConvertKernels[GetSupportedConvertPath()];
+	return Supported;
+}
+
+CONVERT_PATH SetConvertPath(CONVERT_PATH Path)
+{
+	CONVERT_PATH Supported = GetSupportedConvertPath();
+	if (Path > Supported)
+	{
+		Path = Supported;
+	}
+
+	WritePointerRelease(&g_Kernels, const_cast<CONVERT_KERNELS*>(&ConvertKernels[Path]));
+
+	return Path;
+}
+
+CONVERT_PATH GetConvertPath()
+{
+	return GetKernels()->Path;
+}
+
+void ConvertBGRAToI420(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height,
+	_Out_ BYTE* DstY, UINT PitchY, _Out_ BYTE* DstU, UINT PitchU, _Out_ BYTE* DstV, UINT PitchV, COLOR_MATRIX Matrix)
+{
+	const CONVERT_KERNELS* Kernels = GetKernels();
+	const COLOR_COEFFS* Coeffs = &ColorCoeffs[Matrix];
+
+	for (UINT y = 0; y < Height; y += 2)
+	{
+		const BYTE* Row0 = Src + y * SrcPitch;
+		const BYTE* Row1 = (y + 1 < Height) ? Row0 + SrcPitch : Row0;
+
+		Kernels->LumaRow(Row0, DstY + y * PitchY, Width, Coeffs);
+		if (y + 1 < Height)
+		{
+			Kernels->LumaRow(Row1, DstY + (y + 1) * PitchY, Width, Coeffs);
+		}
+		Kernels->ChromaRow(Row0, Row1, Width, DstU + (y / 2) * PitchU, DstV + (y / 2) * PitchV, 1, Coeffs);
+	}
+}
+
+void ConvertBGRAToNV12(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height,
+	_Out_ BYTE* DstY, UINT PitchY, _Out_ BYTE* DstUV, UINT PitchUV, COLOR_MATRIX Matrix)
+{
+	const CONVERT_KERNELS* Kernels = GetKernels();
+	const COLOR_COEFFS* Coeffs = &ColorCoeffs[Matrix];
+
+	for (UINT y = 0; y < Height; y += 2)
+	{
+		const BYTE* Row0 = Src + y * SrcPitch;
+		const BYTE* Row1 = (y + 1 < Height) ? Row0 + SrcPitch : Row0;
+		BYTE* UV = DstUV + (y / 2) * PitchUV;
+
+		Kernels->LumaRow(Row0, DstY + y * PitchY, Width, Coeffs);
+		if (y + 1 < Height)
+		{
+			Kernels->LumaRow(Row1, DstY + (y + 1) * PitchY, Width, Coeffs);
+		}
+		Kernels->ChromaRow(Row0, Row1, Width, UV, UV + 1, 2, Coeffs);
+	}
+}
+
+void ConvertBGRAToYUY2(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height,
+	_Out_ BYTE* Dst, UINT DstPitch, COLOR_MATRIX Matrix)
+{
+	const CONVERT_KERNELS* Kernels = GetKernels();
+	const COLOR_COEFFS* Coeffs = &ColorCoeffs[Matrix];
+	BYTE Luma[YUY2_CHUNK];
+
+	for (UINT y = 0; y < Height; ++y)
+	{
+		const BYTE* Row = Src + y * SrcPitch;
+		BYTE* Out = Dst + y * DstPitch;
+
+		// Averaging a row with itself gives the 2x1 chroma average
+		Kernels->ChromaRow(Row, Row, Width, Out + 1, Out + 3, 4, Coeffs);
+
+		for (UINT x = 0; x < Width; x += YUY2_CHUNK)
+		{
+			UINT Count = min(Width - x, static_cast<UINT>(YUY2_CHUNK));
+			Kernels->LumaRow(Row + x * BPP, Luma, Count, Coeffs);
+
+			BYTE* Pair = Out + x * 2;
+			for (UINT i = 0; i < Count; i += 2, Pair += 4)
+			{
+				Pair[0] = Luma[i];
+				Pair[2] = (i + 1 < Count) ? Luma[i + 1] : Luma[i];
+			}
+		}
+	}
+}
@@ -0,0 +1,63 @@
+// ColorConvert.h : Converts the pitched BGRA frames returned by GetFrame into YUV
+// layouts used by video encoders.
+//
+
+#ifndef _COLORCONVERT_H_
+#define _COLORCONVERT_H_
+
+#include <windows.h>
+#include <sal.h>
+#include <intrin.h>
+
+// Marks a kernel built for a newer instruction set than the rest of its file, which is only
+// called after the CPU was checked. Visual C++ compiles intrinsics without it.
+#ifndef KERNEL_TARGET
+#define KERNEL_TARGET(Isa)
+#endif
+
+//
+// Studio swing RGB to YUV matrices in 8 bit fixed point
+//
+typedef enum
+{
+	COLOR_MATRIX_BT601 = 0,
+	COLOR_MATRIX_BT709 = 1
+} COLOR_MATRIX;
+
+//
+// Kernels available to the converters. Every path produces bit identical output.
+//
+typedef enum
+{
+	CONVERT_PATH_SCALAR = 0,
+	CONVERT_PATH_SSE41 = 1,
+	CONVERT_PATH_AVX2 = 2
+} CONVERT_PATH;
+
+// Fastest path the CPU and OS support
+CONVERT_PATH GetSupportedConvertPath();
+
+// Path used by the converters, defaults to GetSupportedConvertPath(). Returns the path actually selected.
+// Conversions already running on other threads finish on the path they started with.
+CONVERT_PATH SetConvertPath(CONVERT_PATH Path);
+CONVERT_PATH GetConvertPath();
+
+//
+// Planar 4:2:0, U and V planes are (Width + 1) / 2 x (Height + 1) / 2
+//
+void ConvertBGRAToI420(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height,
+	_Out_ BYTE* DstY, UINT PitchY, _Out_ BYTE* DstU, UINT PitchU, _Out_ BYTE* DstV, UINT PitchV, COLOR_MATRIX Matrix);
+
+//
+// Y plane followed by an interleaved UV plane of (Width + 1) / 2 x (Height + 1) / 2 samples
+//
+void ConvertBGRAToNV12(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height,
+	_Out_ BYTE* DstY, UINT PitchY, _Out_ BYTE* DstUV, UINT PitchUV, COLOR_MATRIX Matrix);
+
+//
+// Packed 4:2:2 as Y0 U Y1 V, each row is (Width + 1) / 2 * 4 bytes
+//
+void ConvertBGRAToYUY2(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height,
+	_Out_ BYTE* Dst, UINT DstPitch, COLOR_MATRIX Matrix);
+
+#endif
@@ -15,11 +15,11 @@
 #include <new>
 #include <warning.h>
 #include <DirectXMath.h>
+#include "ImageView.h"
 
 
 
 #define NUMVERTICES 6
-#define BPP         4
 
 #define OCCLUSION_STATUS_MSG WM_USER
 
@@ -2,98 +2,653 @@
 //
 
 #include "DuplicationManager.h"
-#include <time.h>
+#include "FrameWriter.h"
+#include "FrameHash.h"
+#include "RecordingFile.h"
+#include "LiveFrame.h"
+#include "FramePool.h"
+#include "CaptureManager.h"
+#include "FramePacer.h"
+#include "Benchmark.h"
+#include "FrameReplay.h"
+#include "Downscale.h"
+#include "CaptureRecovery.h"
+#include "FrameRing.h"
+#include "FrameShare.h"
+#include "EventLog.h"
+#include <stdlib.h>
 
-clock_t start = 0, stop = 0, duration = 0;
-int count = 0;
 FILE *log_file;
-char file_name[MAX_PATH];
 
-void save_as_bitmap(unsigned char *bitmap_data, int rowPitch, int height, char *filename)
+// Frames waiting to be written and the threads writing them
+#define WRITER_QUEUE_DEPTH  8
+#define WRITER_THREAD_COUNT 2
+
+// Frames the live frame and preview may fall behind by before their oldest are skipped
+#define SINK_RING_SIZE      4
+
+// Buffers the pool may hold: the capture buffer plus one per queued frame and per frame being
+// written, and with the sinks running the ring with the frame the sinks hold and the one being published
+#define FRAME_POOL_WRITER_BUFFERS   (1 + WRITER_QUEUE_DEPTH + WRITER_THREAD_COUNT)
+#define FRAME_POOL_SINK_BUFFERS     (SINK_RING_SIZE + 2)
+
+// Buffers allocated up front, the ones in use while the writers and sinks keep up. The pool grows
+// towards the limit only while the queue or the ring backs up.
+#define FRAME_POOL_WRITER_PREALLOCATE   (1 + WRITER_THREAD_COUNT)
+#define FRAME_POOL_SINK_PREALLOCATE     2
+
+// Iterations of the capture loop
+#define CAPTURE_FRAME_COUNT     100
+
+// Frames between two dumps of the latency histograms
+#define LATENCY_DUMP_INTERVAL   30
+
+//
+// Write frame Index of a recording out as a bitmap
+//
+int ExportFrame(_In_z_ const char* RecordingName, UINT Index, _In_z_ const char* BitmapName)
 {
-	// A file is created, this is where we will save the screen capture.
-
-	FILE *f;
-
-	BITMAPFILEHEADER   bmfHeader;
-	BITMAPINFOHEADER   bi;
-
-	bi.biSize = sizeof(BITMAPINFOHEADER);
-	bi.biWidth = rowPitch/4;
-	//Make the size negative if the image is upside down.
-	bi.biHeight = -height;
-	//There is only one plane in RGB color space where as 3 planes in YUV.
-	bi.biPlanes = 1;
-	//In windows RGB, 8 bit - depth for each of R, G, B and alpha.
-	bi.biBitCount = 32;
-	//We are not compressing the image.
-	bi.biCompression = BI_RGB;
-	// The size, in bytes, of the image. This may be set to zero for BI_RGB bitmaps.
-	bi.biSizeImage = 0;
-	bi.biXPelsPerMeter = 0;
-	bi.biYPelsPerMeter = 0;
-	bi.biClrUsed = 0;
-	bi.biClrImportant = 0;
-
-	// rowPitch = the size of the row in bytes.
-	DWORD dwSizeofImage = rowPitch * height;
-
-	// Add the size of the headers to the size of the bitmap to get the total file size
-	DWORD dwSizeofDIB = dwSizeofImage + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
-
-	//Offset to where the actual bitmap bits start.
-	bmfHeader.bfOffBits = (DWORD)sizeof(BITMAPFILEHEADER) + (DWORD)sizeof(BITMAPINFOHEADER);
-
-	//Size of the file
-	bmfHeader.bfSize = dwSizeofDIB;
-
-	//bfType must always be BM for Bitmaps
-	bmfHeader.bfType = 0x4D42; //BM   
-
-							   // TODO: Handle getting current directory
-	fopen_s(&f, filename, "wb");
-
-	DWORD dwBytesWritten = 0;
-	dwBytesWritten += fwrite(&bmfHeader, sizeof(BITMAPFILEHEADER), 1, f);
-	dwBytesWritten += fwrite(&bi, sizeof(BITMAPINFOHEADER), 1, f);
-	dwBytesWritten += fwrite(bitmap_data, 1, dwSizeofImage, f);
-
-	fclose(f);
+	RECORDINGREADER Reader;
+	if (Reader.Open(log_file, RecordingName) != DUPL_RETURN_SUCCESS)
+	{
+		return 1;
+	}
+
+	UINT Entry;
+	if (!Reader.FindFrame(Index, &Entry))
+	{
+		fprintf_s(log_file, "Frame %u is not in %s.\n", Index, RecordingName);
+		return 1;
+	}
+
+	return (Reader.ExportBitmap(Entry, BitmapName) == DUPL_RETURN_SUCCESS) ? 0 : 1;
 }
 
-int main()
+//
+// Sinks fed from the frame ring on their own thread
+//
+typedef struct _SINK_CONTEXT
 {
-	fopen_s(&log_file, "logY.txt", "w");
+	FRAMERING* Ring;
+	UINT Consumer;
+	LIVEFRAME* Live;            // Null without -live
+	FRAMEPYRAMID* Pyramid;      // Null without -preview
+	LIVEFRAME* Preview;
+	UINT PreviewLevel;
+} SINK_CONTEXT;
+
+//
+// Keep the live frame and the preview up to date with the frames of the ring, a slow
+// update makes the sinks skip frames instead of holding up the capture loop
+//
+DWORD WINAPI SinkProc(_In_ void* Param)
+{
+	SINK_CONTEXT* Sink = reinterpret_cast<SINK_CONTEXT*>(Param);
+	LONGLONG Previous = 0;
+	RING_FRAME* Frame;
+	bool Timeout;
 
+	while (Sink->Ring->Read(Sink->Consumer, &Frame, &Timeout, INFINITE) == DUPL_RETURN_SUCCESS)
+	{
+		if (Timeout)
+		{
+			continue;
+		}
+
+		// Only the changed bounds are redone, everything if frames were skipped
+		FRAME_METADATA Meta;
+		GetRingFrameMetaData(Frame, Previous, &Meta);
+		Previous = Frame->Sequence;
+
+		if (Sink->Live)
+		{
+			Sink->Live->Update(&Frame->Image, Frame->Index, &Meta);
+		}
+
+		bool PreviewChanged;
+		IMAGE_VIEW PreviewImage;
+		if (Sink->Pyramid && Sink->Pyramid->Update(&Frame->Image, &Meta, &PreviewChanged) == DUPL_RETURN_SUCCESS &&
+			PreviewChanged && Sink->Pyramid->GetLevel(Sink->PreviewLevel, &PreviewImage))
+		{
+			Sink->Preview->Update(&PreviewImage, Frame->Index, nullptr);
+		}
+
+		Sink->Ring->Release(Frame);
+	}
+
+	return 0;
+}
+
+//
+// Options of a capture, parsed from the command line
+//
+typedef struct _CAPTURE_ARGS
+{
+	const char* RecordingName;
+	const char* LiveName;
+	const char* PreviewName;
+	const char* ShareName;
+	UINT PreviewLevel;
+	bool AllOutputs;
+	UINT FramesPerSecond;
+	const char* LatencyName;
+	const char* TraceName;
+	const char* ReplayName;
+	double ReplaySpeed;
+	COALESCE_PARAMS Coalesce;
+	bool CoalesceEnabled;
+	bool DrawPointer;
+	bool Compress;
+	bool LargePages;
+	RECT Regions[CAPTURE_MAX_REGIONS];
+	UINT RegionCount;
+} CAPTURE_ARGS;
+
+//
+// Capture CAPTURE_FRAME_COUNT frames from the desktop or a recording into the sinks Args asks for.
+// Every failure is logged and returns here. The caller stops EventLog once everything that logs
+// to it is gone, and closes the log file.
+//
+static int RunCapture(_In_ const CAPTURE_ARGS* Args, _In_ EVENTLOG* EventLog)
+{
 	DUPLICATIONMANAGER DuplMgr;
+	CAPTUREMANAGER Capture;
+	FRAMEREPLAYER Replayer;
+	FRAMERECORDER Recorder;
+	FRAMERECOVERY Recovery;
+	bool Recovering = false;
+	FRAMESOURCE* Source = &DuplMgr;
 	DUPL_RETURN Ret;
 
 	UINT Output = 0;
+
+	if (Args->RegionCount && (Args->ReplayName || Args->AllOutputs))
+	{
+		fprintf_s(log_file, "Capture regions only apply when duplicating a single output, ignoring them.\n");
+	}
 	
-	// Make duplication manager
-	Ret = DuplMgr.InitDupl(log_file, Output);
+	if (Args->ReplayName)
+	{
+		// Frames come from a recording, no desktop needed
+		Ret = Replayer.Open(log_file, Args->ReplayName, Args->ReplaySpeed);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			fprintf_s(log_file, "Replay couldn't be opened.");
+			return 0;
+		}
+		Source = &Replayer;
+	}
+	else if (Args->AllOutputs)
+	{
+		// One duplication thread per output, composited by desktop coordinates
+		Ret = Capture.EnumerateOutputs(log_file, Args->CoalesceEnabled ? &Args->Coalesce : nullptr, Args->DrawPointer, EventLog);
+		if (Ret == DUPL_RETURN_SUCCESS)
+		{
+			Ret = Capture.Start(CAPTURE_MODE_COMPOSITE);
+		}
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			fprintf_s(log_file, "Capture Manager couldn't be initialized.");
+			return 0;
+		}
+		Source = &Capture;
+	}
+	else
+	{
+		// Make duplication manager, with -roi it only copies and reads back the regions
+		DuplMgr.SetCaptureRegions(Args->Regions, Args->RegionCount);
+		Ret = DuplMgr.InitDupl(log_file, Output);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			fprintf_s(log_file,"Duplication Manager couldn't be initialized.");
+			return 0;
+		}
+
+		// pBuf lives for the whole loop, so only the regions that changed need to be read back
+		DuplMgr.SetDirtyRectReadback(true);
+		DuplMgr.SetRectCoalescing(Args->CoalesceEnabled ? &Args->Coalesce : nullptr);
+		DuplMgr.SetPointerCompositing(Args->DrawPointer);
+		DuplMgr.SetEventLog(EventLog);
+
+		// Desktop switches, mode changes and TDRs reset the duplication instead of ending the capture,
+		// the pool buffers are kept as long as the frames still fit and replaced by larger ones after that
+		Recovery.Init(log_file, &DuplMgr, DuplMgr.GetImageBufferSize());
+		Recovering = true;
+		Source = &Recovery;
+	}
+
+	if (Args->TraceName)
+	{
+		Recorder.SetCompression(Args->Compress);
+		Ret = Recorder.Open(log_file, Source, Args->TraceName);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			fprintf_s(log_file, "Trace couldn't be created.");
+			return 0;
+		}
+		Source = &Recorder;
+	}
+
+	// Every frame buffer is sized for the source's actual pitch and height, the ring's buffers are
+	// only needed when there are sinks to feed
+	bool Sinks = (Args->LiveName || Args->PreviewName);
+	FRAMEPOOL Pool;
+	Ret = Pool.Init(log_file, Source->GetImageBufferSize(),
+		FRAME_POOL_WRITER_PREALLOCATE + (Sinks ? FRAME_POOL_SINK_PREALLOCATE : 0),
+		FRAME_POOL_WRITER_BUFFERS + (Sinks ? FRAME_POOL_SINK_BUFFERS : 0),
+		Args->LargePages ? FRAMEPOOL_FLAG_LARGE_PAGES : 0);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		fprintf_s(log_file, "Frame pool couldn't be initialized.");
+		return 0;
+	}
+
+	FRAME_BUFFER* CaptureBuffer;
+	if (Pool.Acquire(&CaptureBuffer) != DUPL_RETURN_SUCCESS)
+	{
+		fprintf_s(log_file, "Capture buffer couldn't be allocated.");
+		return 0;
+	}
+	BYTE* pBuf = CaptureBuffer->Data;
+
+	// Disk writes happen on the writer threads, the loop below only queues frames
+	FRAMEWRITER Writer;
+	Ret = Writer.Init(log_file, WRITER_QUEUE_DEPTH, WRITER_THREAD_COUNT, &Pool, FRAMEWRITER_POLICY_DROP_OLDEST);
 	if (Ret != DUPL_RETURN_SUCCESS)
 	{
-		fprintf_s(log_file,"Duplication Manager couldn't be initialized.");
+		fprintf_s(log_file, "Frame writer couldn't be initialized.");
+		Pool.Release(CaptureBuffer);
 		return 0;
 	}
 
-	BYTE* pBuf = new BYTE[10000000];
+	RECORDINGWRITER Recording;
+	if (Args->RecordingName)
+	{
+		Recording.SetCompression(Args->Compress);
+		Ret = Recording.Open(log_file, Args->RecordingName);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			fprintf_s(log_file, "Recording couldn't be created.");
+			Writer.Shutdown();
+			Pool.Release(CaptureBuffer);
+			return 0;
+		}
+		Writer.SetRecording(&Recording);
+	}
+
+	FILE* LatencyFile = nullptr;
+	if (Args->LatencyName && fopen_s(&LatencyFile, Args->LatencyName, "a") != 0)
+	{
+		fprintf_s(log_file, "Latency file %s couldn't be opened.\n", Args->LatencyName);
+		LatencyFile = nullptr;
+	}
+
+	// Updated in place on the sink thread, only the changed regions are written
+	LIVEFRAME Live;
+	if (Args->LiveName)
+	{
+		Live.Init(log_file, Args->LiveName);
+	}
+
+	// Shrunk copy of the frame, only the blocks under the changed regions are redone
+	FRAMEPYRAMID Pyramid;
+	UINT PreviewLevel = max(1U, min(Args->PreviewLevel, static_cast<UINT>(PYRAMID_MAX_LEVELS)));
+	LIVEFRAME Preview;
+	if (Args->PreviewName)
+	{
+		Pyramid.Init(log_file, PreviewLevel, DOWNSCALE_FILTER_BOX);
+		Preview.Init(log_file, Args->PreviewName);
+	}
+
+	// Other processes read the frames in place, only the regions that changed are copied in
+	FRAMESHARE Share;
+	bool Sharing = (Args->ShareName != nullptr);
+	if (Sharing && Share.Init(log_file, Args->ShareName, Source->GetImageBufferSize(), FRAMESHARE_DEFAULT_SLOTS) != DUPL_RETURN_SUCCESS)
+	{
+		fprintf_s(log_file, "Shared frames couldn't be created.\n");
+		Sharing = false;
+	}
+
+	// The sinks read the frames from a ring on their own thread
+	FRAMERING Ring;
+	SINK_CONTEXT Sink;
+	HANDLE SinkThread = nullptr;
+	if (Sinks)
+	{
+		Sink.Ring = &Ring;
+		Sink.Live = Args->LiveName ? &Live : nullptr;
+		Sink.Pyramid = Args->PreviewName ? &Pyramid : nullptr;
+		Sink.Preview = &Preview;
+		Sink.PreviewLevel = PreviewLevel;
+		if (Ring.Init(log_file, &Pool, SINK_RING_SIZE) == DUPL_RETURN_SUCCESS && Ring.AddConsumer(&Sink.Consumer) == DUPL_RETURN_SUCCESS)
+		{
+			SinkThread = CreateThread(nullptr, 0, SinkProc, &Sink, 0, nullptr);
+		}
+		if (!SinkThread)
+		{
+			fprintf_s(log_file, "Live frame and preview couldn't be started.\n");
+		}
+	}
 	
+	// Detects frames DXGI reported as new whose pixels are nevertheless identical
+	FRAMEHASH Hash;
+	IMAGE_VIEW Image;
+	bool Timeout;
+
+	// Without -fps every frame goes out as soon as it is captured
+	FRAMEPACER Pacer;
+	Pacer.Init(Args->FramesPerSecond);
+
 	// Main duplication loop
-	for (int i = 0; i < 100; i++)
+	for (int i = 0; i < CAPTURE_FRAME_COUNT; i++)
 	{
-		// Get new frame from desktop duplication
-		Ret = DuplMgr.GetFrame(pBuf);
+		if (LatencyFile && i && i % LATENCY_DUMP_INTERVAL == 0)
+		{
+			Writer.WriteLatency(LatencyFile, i);
+		}
+
+		// Get new frame from desktop duplication, waiting no longer than the next deadline
+		Ret = Source->GetFrame(pBuf, &Timeout, Pacer.BeginFrame());
+		if (Ret != DUPL_RETURN_SUCCESS && (!Recovering || Recovery.GetState() != RECOVERY_STATE_MODE_CHANGED))
+		{
+			// The source is gone. Replays and the capture manager, whose outputs recover on their own, are only ever gone.
+			EventLog->Write("Could not get the frame.");
+			break;
+		}
 		if (Ret != DUPL_RETURN_SUCCESS)
 		{
-			fprintf_s(log_file, "Could not get the frame.");
+			// The output came back in a mode the pool buffers are too small for. Frames from now on go into buffers
+			// of the new size, the ones still queued are freed once the sinks and writers are done with them.
+			UINT BufferSize = Source->GetImageBufferSize();
+			Pool.Release(CaptureBuffer);
+			Pool.Resize(BufferSize);
+			if (Pool.Acquire(&CaptureBuffer) != DUPL_RETURN_SUCCESS)
+			{
+				EventLog->Write("Capture buffer of %u bytes couldn't be allocated after a mode change.", E_OUTOFMEMORY, BufferSize);
+				CaptureBuffer = nullptr;
+				break;
+			}
+			pBuf = CaptureBuffer->Data;
+			Recovery.SetBufferSize(BufferSize);
+
+			// The first frame in the new mode is new whatever it shows, and is due a period after it was asked for
+			Hash.Reset();
+			Pacer.Restart();
+			EventLog->Write("Output mode changed, frames now take %u bytes.", S_OK, BufferSize);
+			continue;
+		}
+
+		if (Timeout && Source->IsFramePending())
+		{
+			// The frame still in the staging ring comes with the next call, by the same deadline.
+			// It is no repeat, its index is just left out.
+			continue;
+		}
+
+		Source->GetImageView(pBuf, &Image);
+		bool NewFrame = !Timeout && Hash.Update(Image.Data, Image.Pitch, Image.Width, Image.Height, Source->GetFrameMetaData());
+		Pacer.EndFrame(NewFrame);
+		if (!NewFrame)
+		{
+			// Nothing new on screen, record a repeat instead of writing the same pixels again
+			Writer.EnqueueRepeat(i);
+			continue;
 		}
-		sprintf_s(file_name, "%d.bmp", i);
-		save_as_bitmap(pBuf, DuplMgr.GetImagePitch(), DuplMgr.GetImageHeight(), file_name);
+
+		if (SinkThread)
+		{
+			Ring.Publish(&Image, i, Source->GetFrameMetaData());
+		}
+
+		if (Sharing)
+		{
+			Share.Publish(&Image, i, Source->GetFrameMetaData());
+		}
+
+		Writer.Enqueue(&Image, i, Source->GetFrameMetaData());
+	}
+
+	if (SinkThread)
+	{
+		Ring.Stop();
+		WaitForSingleObject(SinkThread, INFINITE);
+		CloseHandle(SinkThread);
+
+		FRAMERING_STATS RingStats;
+		Ring.GetStats(&RingStats);
+		fprintf_s(log_file, "Sink ring published %llu frames, failed %llu, sinks read %llu and skipped %llu.\n",
+			RingStats.Published, RingStats.Failed, RingStats.Read[0], RingStats.Dropped[0]);
+	}
+
+	if (Sharing)
+	{
+		FRAMESHARE_STATS ShareStats;
+		Share.GetStats(&ShareStats);
+		fprintf_s(log_file, "Shared %llu frames with %u readers, %llu whole, %llu bytes copied, %llu wakeups, failed %llu.\n",
+			ShareStats.Published, Share.GetReaderCount(), ShareStats.FullFrames, ShareStats.BytesCopied, ShareStats.Wakeups, ShareStats.Failed);
+		Share.Close();
+	}
+
+	Capture.Stop();
+	Recorder.Close();
+	Writer.Shutdown();
+	if (Args->RecordingName)
+	{
+		Recording.Close();
+	}
+
+	if (LatencyFile)
+	{
+		Writer.WriteLatency(LatencyFile, CAPTURE_FRAME_COUNT);
+		fclose(LatencyFile);
+	}
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	fprintf_s(log_file, "Frames queued %u (%u repeats), written %u, dropped %u, failed %u, max queue depth %u.\n",
+		Stats.Enqueued, Stats.Repeats, Stats.Written, Stats.Dropped, Stats.Failed, Stats.MaxQueueDepth);
+	if (Stats.Written)
+	{
+		fprintf_s(log_file, "Average write %.3f ms, max %.3f ms. Average capture to disk %.3f ms, max %.3f ms.\n",
+			Stats.TotalWriteTicks * 1000.0 / Stats.Frequency.QuadPart / Stats.Written,
+			Stats.MaxWriteTicks * 1000.0 / Stats.Frequency.QuadPart,
+			Stats.TotalLatencyTicks * 1000.0 / Stats.Frequency.QuadPart / Stats.Written,
+			Stats.MaxLatencyTicks * 1000.0 / Stats.Frequency.QuadPart);
+	}
+	if (CaptureBuffer)
+	{
+		Pool.Release(CaptureBuffer);
+	}
+
+	if (Args->FramesPerSecond)
+	{
+		FRAMEPACER_STATS PacerStats;
+		Pacer.GetStats(&PacerStats);
+		if (PacerStats.Frames)
+		{
+			fprintf_s(log_file, "Paced %u frames at %u fps, %u new, %u repeats, %u missed deadlines. Average jitter %.3f ms, max %.3f ms.\n",
+				PacerStats.Frames, Args->FramesPerSecond, PacerStats.NewFrames, PacerStats.Repeats, PacerStats.MissedDeadlines,
+				PacerStats.TotalJitterTicks * 1000.0 / PacerStats.Frequency / PacerStats.Frames,
+				PacerStats.MaxJitterTicks * 1000.0 / PacerStats.Frequency);
+		}
+	}
+
+	RECOVERY_STATS RecoveryStats;
+	Recovery.GetStats(&RecoveryStats);
+	if (Recovering && RecoveryStats.Losses)
+	{
+		fprintf_s(log_file, "Capture lost %u times, recovered %u (%u mode changes) in %u attempts, %u frames lost. Average recovery %.3f ms, max %.3f ms.\n",
+			RecoveryStats.Losses, RecoveryStats.Recoveries, RecoveryStats.ModeChanges, RecoveryStats.Attempts, RecoveryStats.FramesLost,
+			RecoveryStats.Recoveries ? RecoveryStats.TotalRecoverTicks * 1000.0 / RecoveryStats.Frequency / RecoveryStats.Recoveries : 0.0,
+			RecoveryStats.MaxRecoverTicks * 1000.0 / RecoveryStats.Frequency);
+	}
+
+	FRAMEPOOL_STATS PoolStats;
+	Pool.GetStats(&PoolStats);
+	fprintf_s(log_file, "Frame pool hits %u, misses %u, failed %u, peak %u buffers in use, peak %llu bytes%s.\n",
+		PoolStats.Hits, PoolStats.Misses, PoolStats.Failed, PoolStats.PeakOutstanding, PoolStats.PeakBytes,
+		PoolStats.LargePages ? " in large pages" : "");
+
+	return 0;
+}
+
+//
+// Usage:
+//   DXGIConsoleApplication                                    capture to one bitmap per frame
+//   DXGIConsoleApplication -record <file>                     capture into a single recording
+//   DXGIConsoleApplication -live <file>                       keep <file> updated with the latest frame
+//   DXGIConsoleApplication -preview <file> <level>            keep <file> updated with the frame shrunk by 2^level, 1 to 3
+//   DXGIConsoleApplication -share <name>                      publish frames to other processes in the section <name>
+//   DXGIConsoleApplication -attach <name> [frames]            read frames another process publishes with -share <name>
+//                                                             and report the latency from publish to read
+//   DXGIConsoleApplication -all                               capture every output into one virtual desktop image
+//   DXGIConsoleApplication -roi <left> <top> <right> <bottom> capture only this rect of the desktop, repeat for more
+//                                                             rects, which are stacked into one image
+//   DXGIConsoleApplication -fps <rate>                        emit frames at a steady rate, repeating unchanged ones
+//   DXGIConsoleApplication -latency <file>                    append per stage latency percentiles to <file> as JSON lines
+//   DXGIConsoleApplication -trace <file>                      record every captured frame with its rects and timing
+//   DXGIConsoleApplication -replay <file> [-speed <factor>]   capture from a recording instead of the desktop, 0 is unthrottled
+//   DXGIConsoleApplication -coalesce <pixels> | -nocoalesce   unchanged pixels a dirty rect merge may add, or keep DXGI's rects
+//   DXGIConsoleApplication -cursor                            draw the pointer into captured frames
+//   DXGIConsoleApplication -nocompress                        store recorded pixels as they are instead of encoded
+//   DXGIConsoleApplication -largepages                        back the frame buffers with large pages, needs the
+//                                                             lock pages in memory privilege
+//   DXGIConsoleApplication -export <file> <frame> <out.bmp>   write a recorded frame as a bitmap
+//   DXGIConsoleApplication -bench [repetitions] [recording]   time the CPU side frame paths on synthetic frames,
+//                                                             and rect merging on the dirty rects of a recording
+// -record, -live, -preview, -share, -all, -roi, -fps, -latency, -trace, -replay, -coalesce, -cursor, -nocompress
+// and -largepages can be combined.
+//
+int main(int argc, char* argv[])
+{
+	fopen_s(&log_file, "logY.txt", "w");
+
+	CAPTURE_ARGS Args;
+	RtlZeroMemory(&Args, sizeof(Args));
+	Args.ReplaySpeed = 1.0;
+	Args.Coalesce.RectCost = COALESCE_DEFAULT_RECT_COST;
+	Args.Coalesce.MaxWastePercent = COALESCE_DEFAULT_WASTE_PERCENT;
+	Args.CoalesceEnabled = true;
+	Args.Compress = true;
+	if (argc >= 5 && _stricmp(argv[1], "-export") == 0)
+	{
+		int Result = ExportFrame(argv[2], static_cast<UINT>(strtoul(argv[3], nullptr, 10)), argv[4]);
+		fclose(log_file);
+		return Result;
+	}
+	if (argc >= 2 && _stricmp(argv[1], "-bench") == 0)
+	{
+		int Result = RunBenchmarks(stdout, (argc >= 3) ? static_cast<UINT>(strtoul(argv[2], nullptr, 10)) : 0, (argc >= 4) ? argv[3] : nullptr);
+		fclose(log_file);
+		return Result;
+	}
+	if (argc >= 3 && _stricmp(argv[1], "-attach") == 0)
+	{
+		int Result = RunShareReader(stdout, argv[2], (argc >= 4) ? static_cast<UINT>(strtoul(argv[3], nullptr, 10)) : CAPTURE_FRAME_COUNT);
+		fclose(log_file);
+		return Result;
+	}
+	for (int Arg = 1; Arg < argc; ++Arg)
+	{
+		if (_stricmp(argv[Arg], "-record") == 0 && Arg + 1 < argc)
+		{
+			Args.RecordingName = argv[++Arg];
+		}
+		else if (_stricmp(argv[Arg], "-live") == 0 && Arg + 1 < argc)
+		{
+			Args.LiveName = argv[++Arg];
+		}
+		else if (_stricmp(argv[Arg], "-preview") == 0 && Arg + 2 < argc)
+		{
+			Args.PreviewName = argv[++Arg];
+			Args.PreviewLevel = static_cast<UINT>(strtoul(argv[++Arg], nullptr, 10));
+		}
+		else if (_stricmp(argv[Arg], "-share") == 0 && Arg + 1 < argc)
+		{
+			Args.ShareName = argv[++Arg];
+		}
+		else if (_stricmp(argv[Arg], "-roi") == 0 && Arg + 4 < argc)
+		{
+			LONG Left = strtol(argv[++Arg], nullptr, 10);
+			LONG Top = strtol(argv[++Arg], nullptr, 10);
+			LONG Right = strtol(argv[++Arg], nullptr, 10);
+			LONG Bottom = strtol(argv[++Arg], nullptr, 10);
+			if (Args.RegionCount < CAPTURE_MAX_REGIONS)
+			{
+				SetRect(&Args.Regions[Args.RegionCount++], Left, Top, Right, Bottom);
+			}
+		}
+		else if (_stricmp(argv[Arg], "-fps") == 0 && Arg + 1 < argc)
+		{
+			Args.FramesPerSecond = static_cast<UINT>(strtoul(argv[++Arg], nullptr, 10));
+		}
+		else if (_stricmp(argv[Arg], "-latency") == 0 && Arg + 1 < argc)
+		{
+			Args.LatencyName = argv[++Arg];
+		}
+		else if (_stricmp(argv[Arg], "-trace") == 0 && Arg + 1 < argc)
+		{
+			Args.TraceName = argv[++Arg];
+		}
+		else if (_stricmp(argv[Arg], "-replay") == 0 && Arg + 1 < argc)
+		{
+			Args.ReplayName = argv[++Arg];
+		}
+		else if (_stricmp(argv[Arg], "-speed") == 0 && Arg + 1 < argc)
+		{
+			Args.ReplaySpeed = strtod(argv[++Arg], nullptr);
+		}
+		else if (_stricmp(argv[Arg], "-coalesce") == 0 && Arg + 1 < argc)
+		{
+			Args.Coalesce.RectCost = static_cast<UINT>(strtoul(argv[++Arg], nullptr, 10));
+		}
+		else if (_stricmp(argv[Arg], "-nocoalesce") == 0)
+		{
+			Args.CoalesceEnabled = false;
+		}
+		else if (_stricmp(argv[Arg], "-nocompress") == 0)
+		{
+			Args.Compress = false;
+		}
+		else if (_stricmp(argv[Arg], "-cursor") == 0)
+		{
+			Args.DrawPointer = true;
+		}
+		else if (_stricmp(argv[Arg], "-all") == 0)
+		{
+			Args.AllOutputs = true;
+		}
+		else if (_stricmp(argv[Arg], "-largepages") == 0)
+		{
+			Args.LargePages = true;
+		}
+	}
+
+	// Failures on the capture path are formatted and written by the event log thread, it outlives
+	// every source that logs to it
+	EVENTLOG EventLog;
+	int Result = 0;
+	if (EventLog.Init(log_file) == DUPL_RETURN_SUCCESS)
+	{
+		Result = RunCapture(&Args, &EventLog);
+	}
+	else
+	{
+		fprintf_s(log_file, "Event log couldn't be started.");
+	}
+
+	// However the capture ended, what was logged is written out before the file is closed. Every
+	// source that logs to it is gone once RunCapture returned.
+	EventLog.Stop();
+
+	EVENTLOG_STATS LogStats;
+	EventLog.GetStats(&LogStats);
+	if (LogStats.Dropped || LogStats.Suppressed)
+	{
+		fprintf_s(log_file, "Event log wrote %llu events from %u threads, %llu were lost and %llu repeats not logged.\n",
+			LogStats.Written, LogStats.Threads, LogStats.Dropped, LogStats.Suppressed);
 	}
-	delete pBuf;
 
 	fclose(log_file);
-    return 0;
+	return Result;
 }
@@ -143,7 +143,7 @@ void DISPLAYMANAGER::SetMoveRect(_Out_ RECT* SrcRect, _Out_ RECT* DestRect, _In_
         }
         case DXGI_MODE_ROTATION_ROTATE270:
         {
-            SrcRect->left = MoveRect->SourcePoint.x;
+            SrcRect->left = MoveRect->SourcePoint.y;
             SrcRect->top = TexWidth - (MoveRect->SourcePoint.x + MoveRect->DestinationRect.right - MoveRect->DestinationRect.left);
             SrcRect->right = MoveRect->SourcePoint.y + MoveRect->DestinationRect.bottom - MoveRect->DestinationRect.top;
             SrcRect->bottom = TexWidth - MoveRect->SourcePoint.x;
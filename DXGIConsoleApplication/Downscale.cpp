@@ -0,0 +1,449 @@
+// Downscale.cpp : Scalar reference, SSE4.1 and AVX2 kernels for shrinking BGRA frames, and the
+// frame pyramid built from them.
+//
+// All kernels average a 2x2 pixel block per channel the same way, so every path produces identical output:
+//   D = (P00 + P01 + P10 + P11 + 2) >> 2
+// The SIMD kernels interleave the channels of neighbouring pixels and add each pair with a
+// multiply by one, then add the two rows and round in 16 bit.
+//
+
+#include "Downscale.h"
+#include "ColorConvert.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+typedef void (*HALVE_ROW_FUNC)(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* Dst);
+typedef void (*SAMPLE_ROW_FUNC)(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, UINT Factor, _Out_ BYTE* Dst);
+
+//
+// Scalar reference kernels
+//
+
+//
+// One pixel per two pixels of Row0 and Row1, the last pixel pairs with itself at odd widths
+//
+static void HalveRow_Scalar(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* Dst)
+{
+	UINT Count = (Width + 1) / 2;
+	for (UINT i = 0; i < Count; ++i, Dst += BPP)
+	{
+		UINT x0 = 2 * i * BPP;
+		UINT x1 = (2 * i + 1 < Width) ? x0 + BPP : x0;
+		for (UINT c = 0; c < BPP; ++c)
+		{
+			Dst[c] = static_cast<BYTE>((Row0[x0 + c] + Row0[x1 + c] + Row1[x0 + c] + Row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+//
+// One pixel per Factor pixels of Row0 and Row1 from the two pixels at the center of each block.
+// Rows are picked by the caller the same way.
+//
+static void SampleRow_Scalar(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, UINT Factor, _Out_ BYTE* Dst)
+{
+	UINT Count = (Width + Factor - 1) / Factor;
+	UINT Offset = Factor / 2 - 1;
+	for (UINT i = 0; i < Count; ++i, Dst += BPP)
+	{
+		UINT x0 = min(i * Factor + Offset, Width - 1);
+		UINT x1 = min(x0 + 1, Width - 1);
+		x0 *= BPP;
+		x1 *= BPP;
+		for (UINT c = 0; c < BPP; ++c)
+		{
+			Dst[c] = static_cast<BYTE>((Row0[x0 + c] + Row0[x1 + c] + Row1[x0 + c] + Row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+//
+// SSE4.1 kernels, 4 output pixels per iteration
+//
+KERNEL_TARGET("sse4.1")
+static void HalveRow_SSE41(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* Dst)
+{
+	// B0 B1 G0 G1 R0 R1 A0 A1 for both pixel pairs of 16 bytes
+	const __m128i Interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+	const __m128i Ones = _mm_set1_epi8(1);
+	const __m128i Two = _mm_set1_epi16(2);
+
+	UINT x = 0;
+	UINT i = 0;
+	for (; x + 8 <= Width; x += 8, i += 4)
+	{
+		__m128i Avg[2];
+		for (UINT j = 0; j < 2; ++j)
+		{
+			__m128i Top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row0 + (x + j * 4) * BPP));
+			__m128i Bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row1 + (x + j * 4) * BPP));
+			__m128i Sum = _mm_add_epi16(_mm_maddubs_epi16(_mm_shuffle_epi8(Top, Interleave), Ones),
+				_mm_maddubs_epi16(_mm_shuffle_epi8(Bottom, Interleave), Ones));
+			Avg[j] = _mm_srli_epi16(_mm_add_epi16(Sum, Two), 2);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i * BPP), _mm_packus_epi16(Avg[0], Avg[1]));
+	}
+
+	HalveRow_Scalar(Row0 + x * BPP, Row1 + x * BPP, Width - x, Dst + i * BPP);
+}
+
+KERNEL_TARGET("sse4.1")
+static void SampleRow_SSE41(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, UINT Factor, _Out_ BYTE* Dst)
+{
+	const __m128i Interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+	const __m128i Ones = _mm_set1_epi8(1);
+	const __m128i Two = _mm_set1_epi16(2);
+	UINT Offset = Factor / 2 - 1;
+	UINT Step = Factor * BPP;
+
+	// Whole blocks only, the pair at the center of the last block may be cut off by the edge
+	UINT i = 0;
+	for (; (i + 4) * Factor <= Width; i += 4)
+	{
+		__m128i Avg[2];
+		for (UINT j = 0; j < 2; ++j)
+		{
+			const BYTE* Px0 = Row0 + ((i + j * 2) * Factor + Offset) * BPP;
+			const BYTE* Px1 = Row1 + ((i + j * 2) * Factor + Offset) * BPP;
+
+			// Center pairs of two blocks side by side, then the same as halving
+			__m128i Top = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Px0)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(Px0 + Step)));
+			__m128i Bottom = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Px1)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(Px1 + Step)));
+			__m128i Sum = _mm_add_epi16(_mm_maddubs_epi16(_mm_shuffle_epi8(Top, Interleave), Ones),
+				_mm_maddubs_epi16(_mm_shuffle_epi8(Bottom, Interleave), Ones));
+			Avg[j] = _mm_srli_epi16(_mm_add_epi16(Sum, Two), 2);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i * BPP), _mm_packus_epi16(Avg[0], Avg[1]));
+	}
+
+	SampleRow_Scalar(Row0 + i * Step, Row1 + i * Step, Width - i * Factor, Factor, Dst + i * BPP);
+}
+
+//
+// AVX2 halving kernel, 8 output pixels per iteration. Sampling uses the SSE4.1 kernel.
+//
+KERNEL_TARGET("avx2")
+static void HalveRow_AVX2(_In_ const BYTE* Row0, _In_ const BYTE* Row1, UINT Width, _Out_ BYTE* Dst)
+{
+	const __m256i Interleave = _mm256_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15,
+		0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+	const __m256i Ones = _mm256_set1_epi8(1);
+	const __m256i Two = _mm256_set1_epi16(2);
+
+	UINT x = 0;
+	UINT i = 0;
+	for (; x + 16 <= Width; x += 16, i += 8)
+	{
+		__m256i Avg[2];
+		for (UINT j = 0; j < 2; ++j)
+		{
+			__m256i Top = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Row0 + (x + j * 8) * BPP));
+			__m256i Bottom = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Row1 + (x + j * 8) * BPP));
+			__m256i Sum = _mm256_add_epi16(_mm256_maddubs_epi16(_mm256_shuffle_epi8(Top, Interleave), Ones),
+				_mm256_maddubs_epi16(_mm256_shuffle_epi8(Bottom, Interleave), Ones));
+			Avg[j] = _mm256_srli_epi16(_mm256_add_epi16(Sum, Two), 2);
+		}
+
+		// Lanes hold outputs [0 1 | 2 3] and [4 5 | 6 7], the in lane pack leaves them 0 1 4 5 | 2 3 6 7
+		__m256i Out = _mm256_permute4x64_epi64(_mm256_packus_epi16(Avg[0], Avg[1]), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(Dst + i * BPP), Out);
+	}
+
+	HalveRow_SSE41(Row0 + x * BPP, Row1 + x * BPP, Width - x, Dst + i * BPP);
+}
+
+typedef struct _DOWNSCALE_KERNELS
+{
+	HALVE_ROW_FUNC HalveRow;
+	SAMPLE_ROW_FUNC SampleRow;
+} DOWNSCALE_KERNELS;
+
+// Indexed by CONVERT_PATH
+static const DOWNSCALE_KERNELS DownscaleKernels[] =
+{
+	{ HalveRow_Scalar, SampleRow_Scalar },
+	{ HalveRow_SSE41, SampleRow_SSE41 },
+	{ HalveRow_AVX2, SampleRow_SSE41 }
+};
+
+//
+// Kernels of the path the color converters use, so SetConvertPath switches every kernel at once.
+// The path comes from the kernels pointer SetConvertPath publishes, a shrink running on another
+// thread takes both its kernels from the same entry.
+//
+static const DOWNSCALE_KERNELS* GetKernels()
+{
+	return &DownscaleKernels[GetConvertPath()];
+}
+
+UINT GetDownscaledSize(UINT Size, UINT Level)
+{
+	return (Size + (1 << Level) - 1) >> Level;
+}
+
+void DownscaleBGRA2x(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _Out_ BYTE* Dst, UINT DstPitch)
+{
+	const DOWNSCALE_KERNELS* Kernels = GetKernels();
+	for (UINT y = 0; y < Height; y += 2)
+	{
+		const BYTE* Row0 = Src + y * SrcPitch;
+		const BYTE* Row1 = (y + 1 < Height) ? Row0 + SrcPitch : Row0;
+		Kernels->HalveRow(Row0, Row1, Width, Dst + (y / 2) * DstPitch);
+	}
+}
+
+void DownscaleBGRABilinear(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _Out_ BYTE* Dst, UINT DstPitch, UINT Factor)
+{
+	// The center of a 2x2 block is the block itself
+	if (Factor <= 2)
+	{
+		DownscaleBGRA2x(Src, SrcPitch, Width, Height, Dst, DstPitch);
+		return;
+	}
+
+	const DOWNSCALE_KERNELS* Kernels = GetKernels();
+	UINT Offset = Factor / 2 - 1;
+	for (UINT y = 0; y < Height; y += Factor)
+	{
+		UINT y0 = min(y + Offset, Height - 1);
+		UINT y1 = min(y0 + 1, Height - 1);
+		Kernels->SampleRow(Src + y0 * SrcPitch, Src + y1 * SrcPitch, Width, Factor, Dst + (y / Factor) * DstPitch);
+	}
+}
+
+//
+// Widen Rect to whole blocks of the smallest level and clip it to the frame. Blocks at the
+// right and bottom edge may be partial, the kernels treat them the same as over the whole frame.
+//
+static bool AlignRect(_In_ const RECT* Rect, UINT Align, UINT Width, UINT Height, _Out_ RECT* Aligned)
+{
+	LONG Left = max(Rect->left, 0L);
+	LONG Top = max(Rect->top, 0L);
+	LONG Right = min(Rect->right, static_cast<LONG>(Width));
+	LONG Bottom = min(Rect->bottom, static_cast<LONG>(Height));
+	if (Left >= Right || Top >= Bottom)
+	{
+		return false;
+	}
+
+	Aligned->left = Left & ~static_cast<LONG>(Align - 1);
+	Aligned->top = Top & ~static_cast<LONG>(Align - 1);
+	Aligned->right = min((Right + static_cast<LONG>(Align) - 1) & ~static_cast<LONG>(Align - 1), static_cast<LONG>(Width));
+	Aligned->bottom = min((Bottom + static_cast<LONG>(Align) - 1) & ~static_cast<LONG>(Align - 1), static_cast<LONG>(Height));
+	return true;
+}
+
+FRAMEPYRAMID::FRAMEPYRAMID() : m_log_file(nullptr),
+							   m_Levels(PYRAMID_MAX_LEVELS),
+							   m_Filter(DOWNSCALE_FILTER_BOX),
+							   m_Buffer(nullptr),
+							   m_BufferSize(0),
+							   m_Width(0),
+							   m_Height(0),
+							   m_Valid(false)
+{
+	RtlZeroMemory(m_Level, sizeof(m_Level));
+}
+
+FRAMEPYRAMID::~FRAMEPYRAMID()
+{
+	if (m_Buffer)
+	{
+		delete [] m_Buffer;
+		m_Buffer = nullptr;
+	}
+}
+
+//
+// Levels is how many levels to keep, 1 to PYRAMID_MAX_LEVELS
+//
+void FRAMEPYRAMID::Init(_In_ FILE *log_file, UINT Levels, DOWNSCALE_FILTER Filter)
+{
+	m_log_file = log_file;
+	m_Levels = max(1U, min(Levels, static_cast<UINT>(PYRAMID_MAX_LEVELS)));
+	m_Filter = Filter;
+	m_Valid = false;
+}
+
+//
+// Forget the pyramid, the next Update rebuilds all of it
+//
+void FRAMEPYRAMID::Invalidate()
+{
+	m_Valid = false;
+}
+
+//
+// Size the levels for Image, each level is a packed block of the one buffer
+//
+DUPL_RETURN FRAMEPYRAMID::Allocate(_In_ const IMAGE_VIEW* Image)
+{
+	UINT Size = 0;
+	for (UINT Level = 1; Level <= m_Levels; ++Level)
+	{
+		Size += GetDownscaledSize(Image->Width, Level) * BPP * GetDownscaledSize(Image->Height, Level);
+	}
+
+	if (Size > m_BufferSize)
+	{
+		if (m_Buffer)
+		{
+			delete [] m_Buffer;
+		}
+		m_Buffer = new (std::nothrow) BYTE[Size];
+		if (!m_Buffer)
+		{
+			m_BufferSize = 0;
+			fprintf_s(m_log_file, "Failed to allocate a %u byte frame pyramid.\n", Size);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_BufferSize = Size;
+	}
+
+	BYTE* Data = m_Buffer;
+	for (UINT Level = 1; Level <= m_Levels; ++Level)
+	{
+		IMAGE_VIEW* View = &m_Level[Level - 1];
+		View->Data = Data;
+		View->Width = GetDownscaledSize(Image->Width, Level);
+		View->Height = GetDownscaledSize(Image->Height, Level);
+		View->Pitch = View->Width * BPP;
+		View->Format = Image->Format;
+		Data += View->Pitch * View->Height;
+	}
+
+	m_Width = Image->Width;
+	m_Height = Image->Height;
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Redo every level under Rect, which AlignRect returned. The rect is done in bands of one
+// row of the smallest level so the rows a box level is made from are still in the cache.
+//
+void FRAMEPYRAMID::Build(_In_ const IMAGE_VIEW* Image, _In_ const RECT* Rect)
+{
+	UINT Band = 1 << m_Levels;
+	UINT Width = Rect->right - Rect->left;
+	for (UINT Top = Rect->top; Top < static_cast<UINT>(Rect->bottom); Top += Band)
+	{
+		const BYTE* Frame = Image->Data + Top * Image->Pitch + Rect->left * BPP;
+		UINT Height = min(Band, static_cast<UINT>(Rect->bottom) - Top);
+
+		// Box levels are made from the level above, bilinear levels straight from the frame
+		const BYTE* Src = Frame;
+		UINT SrcPitch = Image->Pitch;
+		UINT SrcWidth = Width;
+		UINT SrcHeight = Height;
+		for (UINT Level = 1; Level <= m_Levels; ++Level)
+		{
+			IMAGE_VIEW* View = &m_Level[Level - 1];
+			BYTE* Dst = View->Data + (Top >> Level) * View->Pitch + (Rect->left >> Level) * BPP;
+			if (m_Filter == DOWNSCALE_FILTER_BILINEAR)
+			{
+				DownscaleBGRABilinear(Frame, Image->Pitch, Width, Height, Dst, View->Pitch, 1 << Level);
+			}
+			else
+			{
+				DownscaleBGRA2x(Src, SrcPitch, SrcWidth, SrcHeight, Dst, View->Pitch);
+				Src = Dst;
+				SrcPitch = View->Pitch;
+				SrcWidth = (SrcWidth + 1) / 2;
+				SrcHeight = (SrcHeight + 1) / 2;
+			}
+		}
+	}
+}
+
+//
+// Bring the pyramid up to date with Image. With Meta only the blocks under its move
+// destinations and dirty rects are redone. Changed tells whether any level was written.
+//
+DUPL_RETURN FRAMEPYRAMID::Update(_In_ const IMAGE_VIEW* Image, _In_opt_ const FRAME_METADATA* Meta, _Out_opt_ bool* Changed)
+{
+	if (Changed)
+	{
+		*Changed = false;
+	}
+
+	if (GetFormatBytesPerPixel(Image->Format) != BPP)
+	{
+		fprintf_s(m_log_file, "Frame pyramid only supports 32bpp images.\n");
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	bool Rebuild = !m_Valid || !Meta || Meta->FullCopy;
+	if (!m_Valid || Image->Width != m_Width || Image->Height != m_Height)
+	{
+		m_Valid = false;
+		DUPL_RETURN Ret = Allocate(Image);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			return Ret;
+		}
+		Rebuild = true;
+	}
+
+	UINT Align = 1 << m_Levels;
+	RECT Aligned;
+	if (Rebuild)
+	{
+		RECT Whole = { 0, 0, static_cast<LONG>(Image->Width), static_cast<LONG>(Image->Height) };
+		Build(Image, &Whole);
+	}
+	else if (Meta->MoveCount + Meta->DirtyCount == 0)
+	{
+		// Same pixels as last time
+		return DUPL_RETURN_SUCCESS;
+	}
+	else
+	{
+		const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+		for (UINT i = 0; i < Meta->MoveCount; ++i)
+		{
+			if (AlignRect(&MoveRects[i].DestinationRect, Align, Image->Width, Image->Height, &Aligned))
+			{
+				Build(Image, &Aligned);
+			}
+		}
+
+		const RECT* DirtyRects = reinterpret_cast<const RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+		for (UINT i = 0; i < Meta->DirtyCount; ++i)
+		{
+			if (AlignRect(&DirtyRects[i], Align, Image->Width, Image->Height, &Aligned))
+			{
+				Build(Image, &Aligned);
+			}
+		}
+	}
+
+	for (UINT Level = 0; Level < m_Levels; ++Level)
+	{
+		m_Level[Level].Rotation = Image->Rotation;
+	}
+
+	m_Valid = true;
+	if (Changed)
+	{
+		*Changed = true;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// View of level 1 (half size) to the levels passed to Init. False until the first Update.
+//
+bool FRAMEPYRAMID::GetLevel(UINT Level, _Out_ IMAGE_VIEW* View)
+{
+	if (!m_Valid || Level < 1 || Level > m_Levels)
+	{
+		RtlZeroMemory(View, sizeof(IMAGE_VIEW));
+		return false;
+	}
+
+	*View = m_Level[Level - 1];
+	return true;
+}
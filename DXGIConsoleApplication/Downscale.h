@@ -0,0 +1,71 @@
+// Downscale.h : Shrinks the pitched BGRA frames returned by GetFrame by 2, 4 and 8 for
+// previews and thumbnails, and keeps a pyramid of those sizes up to date with the frame.
+//
+
+#ifndef _DOWNSCALE_H_
+#define _DOWNSCALE_H_
+
+#include "DuplicationManager.h"
+
+// Pyramid levels, level n is 1 / 2^n of the frame
+#define PYRAMID_MAX_LEVELS      3
+
+//
+// Box averages every pixel of a block, a level is the 2x2 average of the level above like a mip chain.
+// Bilinear samples the frame between the four pixels at the center of each block at the price of
+// aliasing. Both are the same at 2x, so a bilinear pyramid costs as much as a box one, but a
+// bilinear 4x or 8x shrink on its own reads only two rows of every block.
+//
+typedef enum
+{
+	DOWNSCALE_FILTER_BOX = 0,
+	DOWNSCALE_FILTER_BILINEAR = 1
+} DOWNSCALE_FILTER;
+
+// Size of a Size pixel edge shrunk by 2^Level, a partial block at the end makes a whole pixel
+UINT GetDownscaledSize(UINT Size, UINT Level);
+
+//
+// Halve a BGRA image, each pixel of Dst is the rounded average of a 2x2 block. Dst is
+// (Width + 1) / 2 x (Height + 1) / 2, the last column and row are repeated at odd sizes.
+// Uses the kernels of GetConvertPath(), every path produces bit identical output.
+//
+void DownscaleBGRA2x(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _Out_ BYTE* Dst, UINT DstPitch);
+
+//
+// Shrink a BGRA image by Factor of 2, 4 or 8, each pixel of Dst is the rounded average of the
+// 2x2 pixels at the center of a Factor x Factor block. Blocks cut off by the edge use its last pixels.
+//
+void DownscaleBGRABilinear(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _Out_ BYTE* Dst, UINT DstPitch, UINT Factor);
+
+//
+// Keeps 1/2, 1/4 and 1/8 sized copies of a frame. All levels are built together in a single
+// pass over bands of the frame, and afterwards only the blocks under the frame's move and
+// dirty rects are redone. A frame without rects leaves the pyramid as it is.
+//
+class FRAMEPYRAMID
+{
+	public:
+		FRAMEPYRAMID();
+		~FRAMEPYRAMID();
+		void Init(_In_ FILE *log_file, UINT Levels, DOWNSCALE_FILTER Filter);
+		DUPL_RETURN Update(_In_ const IMAGE_VIEW* Image, _In_opt_ const FRAME_METADATA* Meta, _Out_opt_ bool* Changed);
+		bool GetLevel(UINT Level, _Out_ IMAGE_VIEW* View);
+		void Invalidate();
+
+	private:
+		FILE *m_log_file;
+		UINT m_Levels;
+		DOWNSCALE_FILTER m_Filter;
+		BYTE* m_Buffer;
+		UINT m_BufferSize;
+		IMAGE_VIEW m_Level[PYRAMID_MAX_LEVELS];
+		UINT m_Width;
+		UINT m_Height;
+		bool m_Valid;
+
+		DUPL_RETURN Allocate(_In_ const IMAGE_VIEW* Image);
+		void Build(_In_ const IMAGE_VIEW* Image, _In_ const RECT* Rect);
+};
+
+#endif
@@ -0,0 +1,973 @@
+// DuplicationDevice.cpp : Direct3D and CPU implementations of DUPLICATIONDEVICE.
+//
+
+#include "DuplicationDevice.h"
+#include "ImageView.h"
+
+//
+// Constructor sets up references / variables
+//
+DXGIDUPLICATIONDEVICE::DXGIDUPLICATIONDEVICE() : m_Device(nullptr),
+												 m_Context(nullptr),
+												 m_DeskDupl(nullptr),
+												 m_AcquiredDesktopImage(nullptr),
+												 m_StagingCount(0)
+{
+	RtlZeroMemory(m_Staging, sizeof(m_Staging));
+}
+
+DXGIDUPLICATIONDEVICE::~DXGIDUPLICATIONDEVICE()
+{
+	ReleaseDuplication();
+	ReleaseDevice();
+}
+
+//
+// Create the device. It has to live on the adapter the output is connected to, without an
+// adapter the first driver type that works is used.
+//
+HRESULT DXGIDUPLICATIONDEVICE::CreateDevice(_In_opt_ IDXGIAdapter* Adapter)
+{
+	HRESULT hr = S_OK;
+
+	// Driver types supported
+	D3D_DRIVER_TYPE DriverTypes[] =
+	{
+		D3D_DRIVER_TYPE_HARDWARE,
+		D3D_DRIVER_TYPE_WARP,
+		D3D_DRIVER_TYPE_REFERENCE,
+	};
+	UINT NumDriverTypes = ARRAYSIZE(DriverTypes);
+
+	// Feature levels supported
+	D3D_FEATURE_LEVEL FeatureLevels[] =
+	{
+		D3D_FEATURE_LEVEL_11_0,
+		D3D_FEATURE_LEVEL_10_1,
+		D3D_FEATURE_LEVEL_10_0,
+		D3D_FEATURE_LEVEL_9_1
+	};
+	UINT NumFeatureLevels = ARRAYSIZE(FeatureLevels);
+
+	D3D_FEATURE_LEVEL FeatureLevel;
+
+	// An explicit adapter requires the unknown driver type
+	if (Adapter)
+	{
+		hr = D3D11CreateDevice(Adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, 0, FeatureLevels, NumFeatureLevels,
+			D3D11_SDK_VERSION, &m_Device, &FeatureLevel, &m_Context);
+		NumDriverTypes = 0;
+	}
+
+	for (UINT DriverTypeIndex = 0; DriverTypeIndex < NumDriverTypes; ++DriverTypeIndex)
+	{
+		hr = D3D11CreateDevice(nullptr, DriverTypes[DriverTypeIndex], nullptr, 0, FeatureLevels, NumFeatureLevels,
+			D3D11_SDK_VERSION, &m_Device, &FeatureLevel, &m_Context);
+		if (SUCCEEDED(hr))
+		{
+			// Device creation success, no need to loop anymore
+			break;
+		}
+	}
+
+	return hr;
+}
+
+//
+// Release the device and everything created on it except the duplication
+//
+void DXGIDUPLICATIONDEVICE::ReleaseDevice()
+{
+	ReleaseStagingTextures();
+	if (m_Context)
+	{
+		m_Context->Release();
+		m_Context = nullptr;
+	}
+	if (m_Device)
+	{
+		m_Device->Release();
+		m_Device = nullptr;
+	}
+}
+
+bool DXGIDUPLICATIONDEVICE::HasDevice()
+{
+	return m_Device != nullptr;
+}
+
+HRESULT DXGIDUPLICATIONDEVICE::GetDeviceRemovedReason()
+{
+	return m_Device ? m_Device->GetDeviceRemovedReason() : DXGI_ERROR_DEVICE_REMOVED;
+}
+
+//
+// Duplicate output Output of the device's adapter. FailedStep tells which call failed.
+//
+HRESULT DXGIDUPLICATIONDEVICE::DuplicateOutput(UINT Output, _Out_ DXGI_OUTPUT_DESC* OutputDesc, _Out_ DXGI_OUTDUPL_DESC* DuplDesc, _Out_ DUPLICATION_STEP* FailedStep)
+{
+	RtlZeroMemory(OutputDesc, sizeof(DXGI_OUTPUT_DESC));
+	RtlZeroMemory(DuplDesc, sizeof(DXGI_OUTDUPL_DESC));
+	*FailedStep = DUPLICATION_STEP_NONE;
+
+	// Get DXGI device
+	IDXGIDevice* DxgiDevice = nullptr;
+	HRESULT hr = m_Device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&DxgiDevice));
+	if (FAILED(hr))
+	{
+		*FailedStep = DUPLICATION_STEP_DXGI_DEVICE;
+		return hr;
+	}
+
+	// Get DXGI adapter
+	IDXGIAdapter* DxgiAdapter = nullptr;
+	hr = DxgiDevice->GetParent(__uuidof(IDXGIAdapter), reinterpret_cast<void**>(&DxgiAdapter));
+	DxgiDevice->Release();
+	DxgiDevice = nullptr;
+	if (FAILED(hr))
+	{
+		*FailedStep = DUPLICATION_STEP_ADAPTER;
+		return hr;
+	}
+
+	// Get output
+	IDXGIOutput* DxgiOutput = nullptr;
+	hr = DxgiAdapter->EnumOutputs(Output, &DxgiOutput);
+	DxgiAdapter->Release();
+	DxgiAdapter = nullptr;
+	if (FAILED(hr))
+	{
+		*FailedStep = DUPLICATION_STEP_OUTPUT;
+		return hr;
+	}
+
+	DxgiOutput->GetDesc(OutputDesc);
+
+	// QI for Output 1
+	IDXGIOutput1* DxgiOutput1 = nullptr;
+	hr = DxgiOutput->QueryInterface(__uuidof(DxgiOutput1), reinterpret_cast<void**>(&DxgiOutput1));
+	DxgiOutput->Release();
+	DxgiOutput = nullptr;
+	if (FAILED(hr))
+	{
+		*FailedStep = DUPLICATION_STEP_OUTPUT1;
+		return hr;
+	}
+
+	// Create desktop duplication
+	hr = DxgiOutput1->DuplicateOutput(m_Device, &m_DeskDupl);
+	DxgiOutput1->Release();
+	DxgiOutput1 = nullptr;
+	if (FAILED(hr))
+	{
+		*FailedStep = DUPLICATION_STEP_DUPLICATE;
+		return hr;
+	}
+
+	m_DeskDupl->GetDesc(DuplDesc);
+
+	return S_OK;
+}
+
+//
+// Release the duplication and the frame held from it
+//
+void DXGIDUPLICATIONDEVICE::ReleaseDuplication()
+{
+	if (m_AcquiredDesktopImage)
+	{
+		m_AcquiredDesktopImage->Release();
+		m_AcquiredDesktopImage = nullptr;
+	}
+	if (m_DeskDupl)
+	{
+		m_DeskDupl->Release();
+		m_DeskDupl = nullptr;
+	}
+}
+
+bool DXGIDUPLICATIONDEVICE::HasDuplication()
+{
+	return m_DeskDupl != nullptr;
+}
+
+//
+// Acquire the next frame and hold on to its texture until ReleaseFrame
+//
+HRESULT DXGIDUPLICATIONDEVICE::AcquireNextFrame(UINT TimeoutMs, _Out_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo)
+{
+	IDXGIResource* DesktopResource = nullptr;
+	HRESULT hr = m_DeskDupl->AcquireNextFrame(TimeoutMs, FrameInfo, &DesktopResource);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// If still holding old frame, destroy it
+	if (m_AcquiredDesktopImage)
+	{
+		m_AcquiredDesktopImage->Release();
+		m_AcquiredDesktopImage = nullptr;
+	}
+
+	// QI for IDXGIResource
+	hr = DesktopResource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void **>(&m_AcquiredDesktopImage));
+	DesktopResource->Release();
+	DesktopResource = nullptr;
+	if (FAILED(hr))
+	{
+		m_DeskDupl->ReleaseFrame();
+	}
+
+	return hr;
+}
+
+HRESULT DXGIDUPLICATIONDEVICE::GetFrameMoveRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) DXGI_OUTDUPL_MOVE_RECT* Buffer, _Out_ UINT* RequiredSize)
+{
+	return m_DeskDupl->GetFrameMoveRects(BufferSize, Buffer, RequiredSize);
+}
+
+HRESULT DXGIDUPLICATIONDEVICE::GetFrameDirtyRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) RECT* Buffer, _Out_ UINT* RequiredSize)
+{
+	return m_DeskDupl->GetFrameDirtyRects(BufferSize, Buffer, RequiredSize);
+}
+
+HRESULT DXGIDUPLICATIONDEVICE::GetFramePointerShape(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) void* Buffer, _Out_ UINT* RequiredSize, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO* ShapeInfo)
+{
+	return m_DeskDupl->GetFramePointerShape(BufferSize, Buffer, RequiredSize, ShapeInfo);
+}
+
+//
+// Hand the frame back to DXGI. Copies already queued from it still see its pixels.
+//
+HRESULT DXGIDUPLICATIONDEVICE::ReleaseFrame()
+{
+	HRESULT hr = m_DeskDupl->ReleaseFrame();
+	if (m_AcquiredDesktopImage)
+	{
+		m_AcquiredDesktopImage->Release();
+		m_AcquiredDesktopImage = nullptr;
+	}
+	return hr;
+}
+
+//
+// Create Count CPU readable textures of the acquired image's size or the region image's
+//
+HRESULT DXGIDUPLICATIONDEVICE::CreateStagingTextures(UINT Count, UINT Width, UINT Height, DXGI_FORMAT Format)
+{
+	ReleaseStagingTextures();
+
+	D3D11_TEXTURE2D_DESC desc;
+	desc.Width = Width;
+	desc.Height = Height;
+	desc.Format = Format;
+	desc.ArraySize = 1;
+	desc.BindFlags = 0;
+	desc.MiscFlags = 0;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.MipLevels = 1;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.Usage = D3D11_USAGE_STAGING;
+
+	for (UINT i = 0; i < Count && i < DUPLICATION_MAX_STAGING; ++i)
+	{
+		HRESULT hr = m_Device->CreateTexture2D(&desc, NULL, &m_Staging[i]);
+		if (FAILED(hr))
+		{
+			ReleaseStagingTextures();
+			return hr;
+		}
+		if (!m_Staging[i])
+		{
+			ReleaseStagingTextures();
+			return E_UNEXPECTED;
+		}
+		++m_StagingCount;
+	}
+
+	return S_OK;
+}
+
+void DXGIDUPLICATIONDEVICE::ReleaseStagingTextures()
+{
+	for (UINT i = 0; i < DUPLICATION_MAX_STAGING; ++i)
+	{
+		if (m_Staging[i])
+		{
+			m_Staging[i]->Release();
+			m_Staging[i] = nullptr;
+		}
+	}
+	m_StagingCount = 0;
+}
+
+bool DXGIDUPLICATIONDEVICE::HasStagingTextures()
+{
+	return m_StagingCount != 0;
+}
+
+void DXGIDUPLICATIONDEVICE::CopyFrame(UINT Slot)
+{
+	m_Context->CopyResource(m_Staging[Slot], m_AcquiredDesktopImage);
+}
+
+void DXGIDUPLICATIONDEVICE::CopyFrameRegion(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source)
+{
+	D3D11_BOX Box;
+	Box.left = Source->left;
+	Box.top = Source->top;
+	Box.front = 0;
+	Box.right = Source->right;
+	Box.bottom = Source->bottom;
+	Box.back = 1;
+	m_Context->CopySubresourceRegion(m_Staging[Slot], 0, DestX, DestY, 0, m_AcquiredDesktopImage, 0, &Box);
+}
+
+//
+// Map the staging texture for reading, waits for the copies into it to finish
+//
+HRESULT DXGIDUPLICATIONDEVICE::MapStaging(UINT Slot, _Out_ D3D11_MAPPED_SUBRESOURCE* Mapped)
+{
+	return m_Context->Map(m_Staging[Slot], D3D11CalcSubresource(0, 0, 0), D3D11_MAP_READ, 0, Mapped);
+}
+
+void DXGIDUPLICATIONDEVICE::UnmapStaging(UINT Slot)
+{
+	m_Context->Unmap(m_Staging[Slot], D3D11CalcSubresource(0, 0, 0));
+}
+
+//
+// Staging rows are padded to this many bytes, like the pitch of real staging textures
+//
+#define CPU_DUPLICATION_PITCH_ALIGNMENT 256
+
+// Size of the pointer shape handed out, a 32bpp color shape
+#define CPU_DUPLICATION_POINTER_SIZE 16
+
+CPUDUPLICATIONDEVICE::CPUDUPLICATIONDEVICE() : m_Width(0),
+											   m_Height(0),
+											   m_Pitch(0),
+											   m_Rotation(DXGI_MODE_ROTATION_IDENTITY),
+											   m_Format(DXGI_FORMAT_B8G8R8A8_UNORM),
+											   m_Desktop(nullptr),
+											   m_Queue(nullptr),
+											   m_QueueSize(0),
+											   m_QueueHead(0),
+											   m_QueueCount(0),
+											   m_Acquired(nullptr),
+											   m_HasDevice(false),
+											   m_HasDuplication(false),
+											   m_DeviceRemovedReason(S_OK),
+											   m_StagingCount(0),
+											   m_StagingWidth(0),
+											   m_StagingHeight(0),
+											   m_StagingPitch(0),
+											   m_PointerVisible(false),
+											   m_ShapeSent(false)
+{
+	RtlZeroMemory(m_FailNext, sizeof(m_FailNext));
+	RtlZeroMemory(m_Staging, sizeof(m_Staging));
+	RtlZeroMemory(&m_Pointer, sizeof(m_Pointer));
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+CPUDUPLICATIONDEVICE::~CPUDUPLICATIONDEVICE()
+{
+	ReleaseDuplication();
+	ReleaseDevice();
+	if (m_Queue)
+	{
+		delete [] m_Queue;
+		m_Queue = nullptr;
+	}
+	if (m_Desktop)
+	{
+		delete [] m_Desktop;
+		m_Desktop = nullptr;
+	}
+}
+
+//
+// Desktop of Width x Height 32bpp pixels, which is the size of the acquired image. The output
+// is rotated by Rotation, so its desktop coordinates are Height x Width for 90 and 270 degrees.
+// At most MaxQueuedFrames presented frames wait to be acquired.
+//
+bool CPUDUPLICATIONDEVICE::Init(UINT Width, UINT Height, DXGI_MODE_ROTATION Rotation, UINT MaxQueuedFrames)
+{
+	m_Width = Width;
+	m_Height = Height;
+	m_Pitch = Width * 4;
+	m_Rotation = Rotation;
+	m_QueueSize = MaxQueuedFrames ? MaxQueuedFrames : 1;
+
+	m_Desktop = new (std::nothrow) BYTE[m_Pitch * m_Height];
+	m_Queue = new (std::nothrow) CPU_DUPLICATION_FRAME*[m_QueueSize];
+	if (!m_Desktop || !m_Queue)
+	{
+		return false;
+	}
+	RtlZeroMemory(m_Desktop, m_Pitch * m_Height);
+
+	return true;
+}
+
+BYTE* CPUDUPLICATIONDEVICE::GetDesktop()
+{
+	return m_Desktop;
+}
+
+UINT CPUDUPLICATIONDEVICE::GetDesktopPitch()
+{
+	return m_Pitch;
+}
+
+//
+// Present what was drawn into the desktop since the last call. MoveRects and DirtyRects are
+// reported with the frame as given. Returns false if the frame queue is full.
+//
+bool CPUDUPLICATIONDEVICE::PresentFrame(_In_reads_opt_(MoveCount) const DXGI_OUTDUPL_MOVE_RECT* MoveRects, UINT MoveCount, _In_reads_opt_(DirtyCount) const RECT* DirtyRects, UINT DirtyCount)
+{
+	CPU_DUPLICATION_FRAME* Frame = new (std::nothrow) CPU_DUPLICATION_FRAME;
+	if (!Frame)
+	{
+		return false;
+	}
+	RtlZeroMemory(Frame, sizeof(CPU_DUPLICATION_FRAME));
+	Frame->RefCount = 1;
+	Frame->Pixels = new (std::nothrow) BYTE[m_Pitch * m_Height];
+	Frame->MoveRects = MoveCount ? new (std::nothrow) DXGI_OUTDUPL_MOVE_RECT[MoveCount] : nullptr;
+	Frame->DirtyRects = DirtyCount ? new (std::nothrow) RECT[DirtyCount] : nullptr;
+	if (!Frame->Pixels || (MoveCount && !Frame->MoveRects) || (DirtyCount && !Frame->DirtyRects))
+	{
+		ReleaseFrameRef(Frame);
+		return false;
+	}
+
+	memcpy_s(Frame->Pixels, m_Pitch * m_Height, m_Desktop, m_Pitch * m_Height);
+	if (MoveCount)
+	{
+		memcpy_s(Frame->MoveRects, MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT), MoveRects, MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT));
+	}
+	if (DirtyCount)
+	{
+		memcpy_s(Frame->DirtyRects, DirtyCount * sizeof(RECT), DirtyRects, DirtyCount * sizeof(RECT));
+	}
+	Frame->MoveCount = MoveCount;
+	Frame->DirtyCount = DirtyCount;
+	Frame->Pointer = m_Pointer;
+	Frame->PointerVisible = m_PointerVisible;
+	QueryPerformanceCounter(&Frame->PresentTime);
+
+	return Queue(Frame);
+}
+
+//
+// Move the pointer without presenting a new desktop image
+//
+bool CPUDUPLICATIONDEVICE::PresentPointer(INT X, INT Y, bool Visible)
+{
+	m_Pointer.x = X;
+	m_Pointer.y = Y;
+	m_PointerVisible = Visible;
+
+	CPU_DUPLICATION_FRAME* Frame = new (std::nothrow) CPU_DUPLICATION_FRAME;
+	if (!Frame)
+	{
+		return false;
+	}
+	RtlZeroMemory(Frame, sizeof(CPU_DUPLICATION_FRAME));
+	Frame->RefCount = 1;
+	Frame->Pointer = m_Pointer;
+	Frame->PointerVisible = Visible;
+	QueryPerformanceCounter(&Frame->PresentTime);
+
+	return Queue(Frame);
+}
+
+bool CPUDUPLICATIONDEVICE::Queue(_In_ CPU_DUPLICATION_FRAME* Frame)
+{
+	if (m_QueueCount == m_QueueSize)
+	{
+		ReleaseFrameRef(Frame);
+		return false;
+	}
+	m_Queue[(m_QueueHead + m_QueueCount) % m_QueueSize] = Frame;
+	++m_QueueCount;
+	++m_Stats.FramesPresented;
+	return true;
+}
+
+void CPUDUPLICATIONDEVICE::ReleaseFrameRef(_In_opt_ CPU_DUPLICATION_FRAME* Frame)
+{
+	if (!Frame || --Frame->RefCount)
+	{
+		return;
+	}
+	if (Frame->Pixels)
+	{
+		delete [] Frame->Pixels;
+	}
+	if (Frame->MoveRects)
+	{
+		delete [] Frame->MoveRects;
+	}
+	if (Frame->DirtyRects)
+	{
+		delete [] Frame->DirtyRects;
+	}
+	delete Frame;
+}
+
+//
+// The next call of this kind fails with hr instead of doing its work
+//
+void CPUDUPLICATIONDEVICE::FailNextCall(CPU_DUPLICATION_CALL Call, HRESULT hr)
+{
+	m_FailNext[Call] = hr;
+}
+
+//
+// What GetDeviceRemovedReason reports, S_OK while the device is fine
+//
+void CPUDUPLICATIONDEVICE::SetDeviceRemovedReason(HRESULT Reason)
+{
+	m_DeviceRemovedReason = Reason;
+}
+
+//
+// Format DuplicateOutput reports for the desktop. The desktop image itself stays 32bpp.
+//
+void CPUDUPLICATIONDEVICE::SetDesktopFormat(DXGI_FORMAT Format)
+{
+	m_Format = Format;
+}
+
+void CPUDUPLICATIONDEVICE::GetStats(_Out_ CPU_DUPLICATION_STATS* Stats)
+{
+	*Stats = m_Stats;
+}
+
+//
+// Count the call and return the failure FailNextCall set up for it, if any
+//
+HRESULT CPUDUPLICATIONDEVICE::Enter(CPU_DUPLICATION_CALL Call)
+{
+	++m_Stats.Calls[Call];
+	HRESULT hr = m_FailNext[Call];
+	m_FailNext[Call] = S_OK;
+	return hr;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::CreateDevice(_In_opt_ IDXGIAdapter* Adapter)
+{
+	UNREFERENCED_PARAMETER(Adapter);
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_CREATE_DEVICE);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	m_HasDevice = true;
+	m_DeviceRemovedReason = S_OK;
+	return S_OK;
+}
+
+void CPUDUPLICATIONDEVICE::ReleaseDevice()
+{
+	ReleaseStagingTextures();
+	m_HasDevice = false;
+}
+
+bool CPUDUPLICATIONDEVICE::HasDevice()
+{
+	return m_HasDevice;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::GetDeviceRemovedReason()
+{
+	return m_DeviceRemovedReason;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::DuplicateOutput(UINT Output, _Out_ DXGI_OUTPUT_DESC* OutputDesc, _Out_ DXGI_OUTDUPL_DESC* DuplDesc, _Out_ DUPLICATION_STEP* FailedStep)
+{
+	RtlZeroMemory(OutputDesc, sizeof(DXGI_OUTPUT_DESC));
+	RtlZeroMemory(DuplDesc, sizeof(DXGI_OUTDUPL_DESC));
+	*FailedStep = DUPLICATION_STEP_NONE;
+
+	if (!m_HasDevice)
+	{
+		++m_Stats.Violations;
+		*FailedStep = DUPLICATION_STEP_DXGI_DEVICE;
+		return DXGI_ERROR_INVALID_CALL;
+	}
+	if (Output)
+	{
+		*FailedStep = DUPLICATION_STEP_OUTPUT;
+		return DXGI_ERROR_NOT_FOUND;
+	}
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_DUPLICATE);
+	if (FAILED(hr))
+	{
+		*FailedStep = DUPLICATION_STEP_DUPLICATE;
+		return hr;
+	}
+
+	bool Portrait = (m_Rotation == DXGI_MODE_ROTATION_ROTATE90 || m_Rotation == DXGI_MODE_ROTATION_ROTATE270);
+	SetRect(&OutputDesc->DesktopCoordinates, 0, 0, Portrait ? m_Height : m_Width, Portrait ? m_Width : m_Height);
+	OutputDesc->AttachedToDesktop = TRUE;
+	OutputDesc->Rotation = m_Rotation;
+	DuplDesc->ModeDesc.Width = m_Width;
+	DuplDesc->ModeDesc.Height = m_Height;
+	DuplDesc->ModeDesc.Format = m_Format;
+	DuplDesc->Rotation = m_Rotation;
+
+	m_HasDuplication = true;
+	m_ShapeSent = false;
+	return S_OK;
+}
+
+//
+// Frames presented before the duplication went away are lost, like on a desktop switch
+//
+void CPUDUPLICATIONDEVICE::ReleaseDuplication()
+{
+	ReleaseFrameRef(m_Acquired);
+	m_Acquired = nullptr;
+	while (m_QueueCount)
+	{
+		ReleaseFrameRef(m_Queue[m_QueueHead]);
+		m_QueueHead = (m_QueueHead + 1) % m_QueueSize;
+		--m_QueueCount;
+	}
+	m_HasDuplication = false;
+}
+
+bool CPUDUPLICATIONDEVICE::HasDuplication()
+{
+	return m_HasDuplication;
+}
+
+//
+// Hand out the oldest presented frame. Never waits, an empty queue times out straight away.
+//
+HRESULT CPUDUPLICATIONDEVICE::AcquireNextFrame(UINT TimeoutMs, _Out_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo)
+{
+	UNREFERENCED_PARAMETER(TimeoutMs);
+	RtlZeroMemory(FrameInfo, sizeof(DXGI_OUTDUPL_FRAME_INFO));
+
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_ACQUIRE);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (!m_HasDuplication || m_Acquired)
+	{
+		// The previous frame has to be released first
+		++m_Stats.Violations;
+		return DXGI_ERROR_INVALID_CALL;
+	}
+	if (!m_QueueCount)
+	{
+		return DXGI_ERROR_WAIT_TIMEOUT;
+	}
+
+	m_Acquired = m_Queue[m_QueueHead];
+	m_QueueHead = (m_QueueHead + 1) % m_QueueSize;
+	--m_QueueCount;
+	++m_Stats.FramesAcquired;
+
+	FrameInfo->AccumulatedFrames = 1;
+	if (m_Acquired->Pixels)
+	{
+		FrameInfo->LastPresentTime = m_Acquired->PresentTime;
+		FrameInfo->TotalMetadataBufferSize = m_Acquired->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT) + m_Acquired->DirtyCount * sizeof(RECT);
+	}
+	FrameInfo->LastMouseUpdateTime = m_Acquired->PresentTime;
+	FrameInfo->PointerPosition.Position = m_Acquired->Pointer;
+	FrameInfo->PointerPosition.Visible = m_Acquired->PointerVisible;
+	if (!m_ShapeSent)
+	{
+		FrameInfo->PointerShapeBufferSize = CPU_DUPLICATION_POINTER_SIZE * CPU_DUPLICATION_POINTER_SIZE * 4;
+	}
+
+	return S_OK;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::GetFrameMoveRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) DXGI_OUTDUPL_MOVE_RECT* Buffer, _Out_ UINT* RequiredSize)
+{
+	*RequiredSize = 0;
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_MOVE_RECTS);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (!m_Acquired)
+	{
+		++m_Stats.Violations;
+		return DXGI_ERROR_INVALID_CALL;
+	}
+
+	*RequiredSize = m_Acquired->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT);
+	if (*RequiredSize > BufferSize)
+	{
+		return DXGI_ERROR_MORE_DATA;
+	}
+	if (*RequiredSize)
+	{
+		memcpy_s(Buffer, BufferSize, m_Acquired->MoveRects, *RequiredSize);
+	}
+	return S_OK;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::GetFrameDirtyRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) RECT* Buffer, _Out_ UINT* RequiredSize)
+{
+	*RequiredSize = 0;
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_DIRTY_RECTS);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (!m_Acquired)
+	{
+		++m_Stats.Violations;
+		return DXGI_ERROR_INVALID_CALL;
+	}
+
+	*RequiredSize = m_Acquired->DirtyCount * sizeof(RECT);
+	if (*RequiredSize > BufferSize)
+	{
+		return DXGI_ERROR_MORE_DATA;
+	}
+	if (*RequiredSize)
+	{
+		memcpy_s(Buffer, BufferSize, m_Acquired->DirtyRects, *RequiredSize);
+	}
+	return S_OK;
+}
+
+//
+// A white square with a transparent border
+//
+HRESULT CPUDUPLICATIONDEVICE::GetFramePointerShape(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) void* Buffer, _Out_ UINT* RequiredSize, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO* ShapeInfo)
+{
+	*RequiredSize = 0;
+	RtlZeroMemory(ShapeInfo, sizeof(DXGI_OUTDUPL_POINTER_SHAPE_INFO));
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_POINTER_SHAPE);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (!m_Acquired)
+	{
+		++m_Stats.Violations;
+		return DXGI_ERROR_INVALID_CALL;
+	}
+
+	*RequiredSize = CPU_DUPLICATION_POINTER_SIZE * CPU_DUPLICATION_POINTER_SIZE * 4;
+	if (*RequiredSize > BufferSize)
+	{
+		return DXGI_ERROR_MORE_DATA;
+	}
+
+	UINT* Shape = reinterpret_cast<UINT*>(Buffer);
+	for (UINT y = 0; y < CPU_DUPLICATION_POINTER_SIZE; ++y)
+	{
+		for (UINT x = 0; x < CPU_DUPLICATION_POINTER_SIZE; ++x)
+		{
+			bool Border = (x < 2 || y < 2 || x >= CPU_DUPLICATION_POINTER_SIZE - 2 || y >= CPU_DUPLICATION_POINTER_SIZE - 2);
+			Shape[y * CPU_DUPLICATION_POINTER_SIZE + x] = Border ? 0x00000000 : 0xFFFFFFFF;
+		}
+	}
+	ShapeInfo->Type = DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR;
+	ShapeInfo->Width = CPU_DUPLICATION_POINTER_SIZE;
+	ShapeInfo->Height = CPU_DUPLICATION_POINTER_SIZE;
+	ShapeInfo->Pitch = CPU_DUPLICATION_POINTER_SIZE * 4;
+	m_ShapeSent = true;
+
+	return S_OK;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::ReleaseFrame()
+{
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_RELEASE_FRAME);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (!m_Acquired)
+	{
+		++m_Stats.Violations;
+		return DXGI_ERROR_INVALID_CALL;
+	}
+
+	// Copies queued from the frame keep it alive until they are carried out
+	ReleaseFrameRef(m_Acquired);
+	m_Acquired = nullptr;
+	return S_OK;
+}
+
+HRESULT CPUDUPLICATIONDEVICE::CreateStagingTextures(UINT Count, UINT Width, UINT Height, DXGI_FORMAT Format)
+{
+	ReleaseStagingTextures();
+
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_CREATE_STAGING);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (!m_HasDevice || Count > DUPLICATION_MAX_STAGING || Format != m_Format || GetFormatBytesPerPixel(Format) != 4)
+	{
+		++m_Stats.Violations;
+		return E_INVALIDARG;
+	}
+
+	m_StagingWidth = Width;
+	m_StagingHeight = Height;
+	m_StagingPitch = (Width * 4 + CPU_DUPLICATION_PITCH_ALIGNMENT - 1) & ~(CPU_DUPLICATION_PITCH_ALIGNMENT - 1);
+	for (UINT i = 0; i < Count; ++i)
+	{
+		m_Staging[i].Pixels = new (std::nothrow) BYTE[m_StagingPitch * Height];
+		if (!m_Staging[i].Pixels)
+		{
+			ReleaseStagingTextures();
+			return E_OUTOFMEMORY;
+		}
+
+		// Whatever the texture held before, never what a frame had
+		memset(m_Staging[i].Pixels, 0xCD, m_StagingPitch * Height);
+		++m_StagingCount;
+	}
+
+	return S_OK;
+}
+
+void CPUDUPLICATIONDEVICE::ReleaseStagingTextures()
+{
+	for (UINT i = 0; i < DUPLICATION_MAX_STAGING; ++i)
+	{
+		CPU_DUPLICATION_STAGING* Staging = &m_Staging[i];
+		if (Staging->Mapped)
+		{
+			++m_Stats.Violations;
+			Staging->Mapped = false;
+		}
+		DropPendingCopies(Staging);
+		if (Staging->Pixels)
+		{
+			delete [] Staging->Pixels;
+			Staging->Pixels = nullptr;
+		}
+	}
+	m_StagingCount = 0;
+}
+
+bool CPUDUPLICATIONDEVICE::HasStagingTextures()
+{
+	return m_StagingCount != 0;
+}
+
+void CPUDUPLICATIONDEVICE::DropPendingCopies(_Inout_ CPU_DUPLICATION_STAGING* Staging)
+{
+	for (UINT i = 0; i < Staging->PendingCount; ++i)
+	{
+		ReleaseFrameRef(Staging->Sources[i]);
+		Staging->Sources[i] = nullptr;
+	}
+	Staging->PendingCount = 0;
+}
+
+void CPUDUPLICATIONDEVICE::CopyFrame(UINT Slot)
+{
+	RECT Source;
+	SetRect(&Source, 0, 0, m_Width, m_Height);
+	QueueCopy(Slot, 0, 0, &Source);
+}
+
+void CPUDUPLICATIONDEVICE::CopyFrameRegion(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source)
+{
+	QueueCopy(Slot, DestX, DestY, Source);
+}
+
+//
+// Remember the copy until the texture is mapped, the frame stays alive until then
+//
+void CPUDUPLICATIONDEVICE::QueueCopy(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source)
+{
+	++m_Stats.Copies;
+	if (Slot >= m_StagingCount || !m_Acquired || !m_Acquired->Pixels || m_Staging[Slot].Mapped ||
+		Source->left < 0 || Source->top < 0 || Source->right > static_cast<LONG>(m_Width) || Source->bottom > static_cast<LONG>(m_Height) ||
+		DestX + (Source->right - Source->left) > m_StagingWidth || DestY + (Source->bottom - Source->top) > m_StagingHeight)
+	{
+		++m_Stats.Violations;
+		return;
+	}
+
+	CPU_DUPLICATION_STAGING* Staging = &m_Staging[Slot];
+	if (Staging->PendingCount == CPU_DUPLICATION_MAX_COPIES)
+	{
+		// More copies than this test needs, carry the oldest ones out now
+		D3D11_MAPPED_SUBRESOURCE Mapped;
+		MapStaging(Slot, &Mapped);
+		UnmapStaging(Slot);
+		--m_Stats.Calls[CPU_DUPLICATION_CALL_MAP];
+		--m_Stats.Maps;
+		--m_Stats.Unmaps;
+	}
+
+	UINT i = Staging->PendingCount++;
+	Staging->Sources[i] = m_Acquired;
+	++m_Acquired->RefCount;
+	Staging->SourceRects[i] = *Source;
+	Staging->Dest[i].x = DestX;
+	Staging->Dest[i].y = DestY;
+}
+
+//
+// Carry out the copies queued into the texture, then hand out its pixels
+//
+HRESULT CPUDUPLICATIONDEVICE::MapStaging(UINT Slot, _Out_ D3D11_MAPPED_SUBRESOURCE* Mapped)
+{
+	RtlZeroMemory(Mapped, sizeof(D3D11_MAPPED_SUBRESOURCE));
+	HRESULT hr = Enter(CPU_DUPLICATION_CALL_MAP);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (Slot >= m_StagingCount || m_Staging[Slot].Mapped)
+	{
+		++m_Stats.Violations;
+		return E_INVALIDARG;
+	}
+
+	CPU_DUPLICATION_STAGING* Staging = &m_Staging[Slot];
+	for (UINT i = 0; i < Staging->PendingCount; ++i)
+	{
+		const RECT* Source = &Staging->SourceRects[i];
+		UINT RowBytes = (Source->right - Source->left) * 4;
+		for (LONG y = Source->top; y < Source->bottom; ++y)
+		{
+			memcpy_s(Staging->Pixels + (Staging->Dest[i].y + y - Source->top) * m_StagingPitch + Staging->Dest[i].x * 4, RowBytes,
+				Staging->Sources[i]->Pixels + y * m_Pitch + Source->left * 4, RowBytes);
+		}
+	}
+	DropPendingCopies(Staging);
+
+	Staging->Mapped = true;
+	++m_Stats.Maps;
+	Mapped->pData = Staging->Pixels;
+	Mapped->RowPitch = m_StagingPitch;
+	Mapped->DepthPitch = m_StagingPitch * m_StagingHeight;
+	return S_OK;
+}
+
+void CPUDUPLICATIONDEVICE::UnmapStaging(UINT Slot)
+{
+	++m_Stats.Unmaps;
+	if (Slot >= m_StagingCount || !m_Staging[Slot].Mapped)
+	{
+		++m_Stats.Violations;
+		return;
+	}
+	m_Staging[Slot].Mapped = false;
+}
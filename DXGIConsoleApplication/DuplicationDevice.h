@@ -0,0 +1,248 @@
+// DuplicationDevice.h : The Direct3D device and output duplication DUPLICATIONMANAGER drives,
+// behind an interface so the staging ring can be run against a CPU implementation.
+//
+
+#ifndef _DUPLICATIONDEVICE_H_
+#define _DUPLICATIONDEVICE_H_
+
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <sal.h>
+#include <new>
+
+// Most staging textures a device keeps
+#define DUPLICATION_MAX_STAGING 8
+
+//
+// Call of DuplicateOutput that failed, DUPLICATIONMANAGER reports each one differently
+//
+typedef enum
+{
+	DUPLICATION_STEP_NONE = 0,
+	DUPLICATION_STEP_DXGI_DEVICE = 1,       // QueryInterface for the DXGI device
+	DUPLICATION_STEP_ADAPTER = 2,           // Parent adapter of the device
+	DUPLICATION_STEP_OUTPUT = 3,            // EnumOutputs
+	DUPLICATION_STEP_OUTPUT1 = 4,           // QueryInterface for IDXGIOutput1
+	DUPLICATION_STEP_DUPLICATE = 5          // IDXGIOutput1::DuplicateOutput
+} DUPLICATION_STEP;
+
+//
+// Everything DUPLICATIONMANAGER needs from Direct3D and DXGI. Methods returning HRESULT fail
+// like the calls they wrap. The order rules are those of the real calls: the acquired frame
+// may only be copied while it is held, a staging texture may not be copied into while it is
+// mapped, and the copy is only guaranteed to be in the texture once it is mapped.
+//
+class DUPLICATIONDEVICE
+{
+	public:
+		virtual ~DUPLICATIONDEVICE() {}
+
+		// Device, on Adapter or on the default adapter
+		virtual HRESULT CreateDevice(_In_opt_ IDXGIAdapter* Adapter) = 0;
+		virtual void ReleaseDevice() = 0;
+		virtual bool HasDevice() = 0;
+		virtual HRESULT GetDeviceRemovedReason() = 0;
+
+		// Duplication of output Output of the device's adapter
+		virtual HRESULT DuplicateOutput(UINT Output, _Out_ DXGI_OUTPUT_DESC* OutputDesc, _Out_ DXGI_OUTDUPL_DESC* DuplDesc, _Out_ DUPLICATION_STEP* FailedStep) = 0;
+		virtual void ReleaseDuplication() = 0;
+		virtual bool HasDuplication() = 0;
+
+		// The acquired frame is held from a successful AcquireNextFrame until ReleaseFrame
+		virtual HRESULT AcquireNextFrame(UINT TimeoutMs, _Out_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo) = 0;
+		virtual HRESULT GetFrameMoveRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) DXGI_OUTDUPL_MOVE_RECT* Buffer, _Out_ UINT* RequiredSize) = 0;
+		virtual HRESULT GetFrameDirtyRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) RECT* Buffer, _Out_ UINT* RequiredSize) = 0;
+		virtual HRESULT GetFramePointerShape(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) void* Buffer, _Out_ UINT* RequiredSize, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO* ShapeInfo) = 0;
+		virtual HRESULT ReleaseFrame() = 0;
+
+		// Staging textures the acquired frame is copied into and read back from
+		virtual HRESULT CreateStagingTextures(UINT Count, UINT Width, UINT Height, DXGI_FORMAT Format) = 0;
+		virtual void ReleaseStagingTextures() = 0;
+		virtual bool HasStagingTextures() = 0;
+		virtual void CopyFrame(UINT Slot) = 0;
+		virtual void CopyFrameRegion(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source) = 0;
+		virtual HRESULT MapStaging(UINT Slot, _Out_ D3D11_MAPPED_SUBRESOURCE* Mapped) = 0;
+		virtual void UnmapStaging(UINT Slot) = 0;
+};
+
+//
+// The real thing, a D3D11 device and an IDXGIOutputDuplication
+//
+class DXGIDUPLICATIONDEVICE : public DUPLICATIONDEVICE
+{
+	public:
+		DXGIDUPLICATIONDEVICE();
+		~DXGIDUPLICATIONDEVICE();
+
+		HRESULT CreateDevice(_In_opt_ IDXGIAdapter* Adapter);
+		void ReleaseDevice();
+		bool HasDevice();
+		HRESULT GetDeviceRemovedReason();
+		HRESULT DuplicateOutput(UINT Output, _Out_ DXGI_OUTPUT_DESC* OutputDesc, _Out_ DXGI_OUTDUPL_DESC* DuplDesc, _Out_ DUPLICATION_STEP* FailedStep);
+		void ReleaseDuplication();
+		bool HasDuplication();
+		HRESULT AcquireNextFrame(UINT TimeoutMs, _Out_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo);
+		HRESULT GetFrameMoveRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) DXGI_OUTDUPL_MOVE_RECT* Buffer, _Out_ UINT* RequiredSize);
+		HRESULT GetFrameDirtyRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) RECT* Buffer, _Out_ UINT* RequiredSize);
+		HRESULT GetFramePointerShape(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) void* Buffer, _Out_ UINT* RequiredSize, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO* ShapeInfo);
+		HRESULT ReleaseFrame();
+		HRESULT CreateStagingTextures(UINT Count, UINT Width, UINT Height, DXGI_FORMAT Format);
+		void ReleaseStagingTextures();
+		bool HasStagingTextures();
+		void CopyFrame(UINT Slot);
+		void CopyFrameRegion(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source);
+		HRESULT MapStaging(UINT Slot, _Out_ D3D11_MAPPED_SUBRESOURCE* Mapped);
+		void UnmapStaging(UINT Slot);
+
+	private:
+		ID3D11Device* m_Device;
+		ID3D11DeviceContext* m_Context;
+		IDXGIOutputDuplication* m_DeskDupl;
+		ID3D11Texture2D* m_AcquiredDesktopImage;
+		ID3D11Texture2D* m_Staging[DUPLICATION_MAX_STAGING];
+		UINT m_StagingCount;
+};
+
+//
+// Calls of CPUDUPLICATIONDEVICE that FailNextCall can make fail
+//
+typedef enum
+{
+	CPU_DUPLICATION_CALL_CREATE_DEVICE = 0,
+	CPU_DUPLICATION_CALL_DUPLICATE = 1,
+	CPU_DUPLICATION_CALL_ACQUIRE = 2,
+	CPU_DUPLICATION_CALL_MOVE_RECTS = 3,
+	CPU_DUPLICATION_CALL_DIRTY_RECTS = 4,
+	CPU_DUPLICATION_CALL_POINTER_SHAPE = 5,
+	CPU_DUPLICATION_CALL_RELEASE_FRAME = 6,
+	CPU_DUPLICATION_CALL_CREATE_STAGING = 7,
+	CPU_DUPLICATION_CALL_MAP = 8,
+	CPU_DUPLICATION_CALL_COUNT = 9
+} CPU_DUPLICATION_CALL;
+
+//
+// What CPUDUPLICATIONDEVICE saw. Violations are calls the real device would reject or that
+// would read undefined pixels, such as copying a frame that is not held or mapping a
+// texture twice.
+//
+typedef struct _CPU_DUPLICATION_STATS
+{
+	UINT Calls[CPU_DUPLICATION_CALL_COUNT];
+	UINT Copies;                    // CopyFrame and CopyFrameRegion
+	UINT Maps;                      // That succeeded
+	UINT Unmaps;
+	UINT FramesPresented;
+	UINT FramesAcquired;
+	UINT Violations;
+} CPU_DUPLICATION_STATS;
+
+//
+// A presented frame: the desktop as it was and the rects that changed since the previous one
+//
+typedef struct _CPU_DUPLICATION_FRAME
+{
+	BYTE* Pixels;                   // Null for pointer only updates
+	DXGI_OUTDUPL_MOVE_RECT* MoveRects;
+	UINT MoveCount;
+	RECT* DirtyRects;
+	UINT DirtyCount;
+	POINT Pointer;
+	bool PointerVisible;
+	LARGE_INTEGER PresentTime;
+	UINT RefCount;                  // Held by the queue, the acquired frame and pending copies
+} CPU_DUPLICATION_FRAME;
+
+// Copies a staging texture can have queued before it is mapped
+#define CPU_DUPLICATION_MAX_COPIES 32
+
+//
+// Staging texture and the copies queued into it, they are carried out by the next MapStaging
+//
+typedef struct _CPU_DUPLICATION_STAGING
+{
+	BYTE* Pixels;
+	CPU_DUPLICATION_FRAME* Sources[CPU_DUPLICATION_MAX_COPIES];
+	RECT SourceRects[CPU_DUPLICATION_MAX_COPIES];
+	POINT Dest[CPU_DUPLICATION_MAX_COPIES];
+	UINT PendingCount;
+	bool Mapped;
+} CPU_DUPLICATION_STAGING;
+
+//
+// Desktop duplication simulated on the CPU. The test draws into the desktop image and calls
+// PresentFrame with the rects it touched, AcquireNextFrame then hands out the frames in order.
+// Copies into the staging textures are only carried out when the texture is mapped, like a GPU
+// copy that has not run yet, so reading a texture that was never mapped shows stale pixels.
+// Not thread safe, the capture loop and the test take turns.
+//
+class CPUDUPLICATIONDEVICE : public DUPLICATIONDEVICE
+{
+	public:
+		CPUDUPLICATIONDEVICE();
+		~CPUDUPLICATIONDEVICE();
+		bool Init(UINT Width, UINT Height, DXGI_MODE_ROTATION Rotation, UINT MaxQueuedFrames);
+
+		// Test side
+		BYTE* GetDesktop();
+		UINT GetDesktopPitch();
+		bool PresentFrame(_In_reads_opt_(MoveCount) const DXGI_OUTDUPL_MOVE_RECT* MoveRects, UINT MoveCount, _In_reads_opt_(DirtyCount) const RECT* DirtyRects, UINT DirtyCount);
+		bool PresentPointer(INT X, INT Y, bool Visible);
+		void FailNextCall(CPU_DUPLICATION_CALL Call, HRESULT hr);
+		void SetDeviceRemovedReason(HRESULT Reason);
+		void SetDesktopFormat(DXGI_FORMAT Format);
+		void GetStats(_Out_ CPU_DUPLICATION_STATS* Stats);
+
+		HRESULT CreateDevice(_In_opt_ IDXGIAdapter* Adapter);
+		void ReleaseDevice();
+		bool HasDevice();
+		HRESULT GetDeviceRemovedReason();
+		HRESULT DuplicateOutput(UINT Output, _Out_ DXGI_OUTPUT_DESC* OutputDesc, _Out_ DXGI_OUTDUPL_DESC* DuplDesc, _Out_ DUPLICATION_STEP* FailedStep);
+		void ReleaseDuplication();
+		bool HasDuplication();
+		HRESULT AcquireNextFrame(UINT TimeoutMs, _Out_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo);
+		HRESULT GetFrameMoveRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) DXGI_OUTDUPL_MOVE_RECT* Buffer, _Out_ UINT* RequiredSize);
+		HRESULT GetFrameDirtyRects(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) RECT* Buffer, _Out_ UINT* RequiredSize);
+		HRESULT GetFramePointerShape(UINT BufferSize, _Out_writes_bytes_to_(BufferSize, *RequiredSize) void* Buffer, _Out_ UINT* RequiredSize, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO* ShapeInfo);
+		HRESULT ReleaseFrame();
+		HRESULT CreateStagingTextures(UINT Count, UINT Width, UINT Height, DXGI_FORMAT Format);
+		void ReleaseStagingTextures();
+		bool HasStagingTextures();
+		void CopyFrame(UINT Slot);
+		void CopyFrameRegion(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source);
+		HRESULT MapStaging(UINT Slot, _Out_ D3D11_MAPPED_SUBRESOURCE* Mapped);
+		void UnmapStaging(UINT Slot);
+
+	private:
+		UINT m_Width;
+		UINT m_Height;
+		UINT m_Pitch;
+		DXGI_MODE_ROTATION m_Rotation;
+		DXGI_FORMAT m_Format;
+		BYTE* m_Desktop;
+		CPU_DUPLICATION_FRAME** m_Queue;
+		UINT m_QueueSize;
+		UINT m_QueueHead;
+		UINT m_QueueCount;
+		CPU_DUPLICATION_FRAME* m_Acquired;
+		bool m_HasDevice;
+		bool m_HasDuplication;
+		HRESULT m_DeviceRemovedReason;
+		HRESULT m_FailNext[CPU_DUPLICATION_CALL_COUNT];
+		CPU_DUPLICATION_STAGING m_Staging[DUPLICATION_MAX_STAGING];
+		UINT m_StagingCount;
+		UINT m_StagingWidth;
+		UINT m_StagingHeight;
+		UINT m_StagingPitch;
+		POINT m_Pointer;
+		bool m_PointerVisible;
+		bool m_ShapeSent;               // The pointer shape goes with the first pointer update of a duplication
+		CPU_DUPLICATION_STATS m_Stats;
+
+		HRESULT Enter(CPU_DUPLICATION_CALL Call);
+		bool Queue(_In_ CPU_DUPLICATION_FRAME* Frame);
+		void ReleaseFrameRef(_In_opt_ CPU_DUPLICATION_FRAME* Frame);
+		void DropPendingCopies(_Inout_ CPU_DUPLICATION_STAGING* Staging);
+		void QueueCopy(UINT Slot, UINT DestX, UINT DestY, _In_ const RECT* Source);
+};
+
+#endif
@@ -5,6 +5,7 @@
 //
 // Copyright (c) Microsoft Corporation. All rights reserved
 #include "DuplicationManager.h"
+#include "EventLog.h"
 
 // Below are lists of errors expect from Dxgi API calls when a transition event like mode change, PnpStop, PnpStart
 // desktop switch, TDR or session disconnect/reconnect. In all these cases we want the application to clean up the threads that process
@@ -46,14 +47,39 @@ HRESULT EnumOutputsExpectedErrors[] = {
 //
 // Constructor sets up references / variables
 //
-DUPLICATIONMANAGER::DUPLICATIONMANAGER() : m_DeskDupl(nullptr),
-                                           m_AcquiredDesktopImage(nullptr),
-										   m_DestImage(nullptr),
+DUPLICATIONMANAGER::DUPLICATIONMANAGER(_In_opt_ DUPLICATIONDEVICE* Device) : m_Device(Device),
+										   m_OwnsDevice(false),
+										   m_RingHead(0),
+										   m_RingCount(0),
+										   m_RingPrimed(false),
+										   m_DirtyRectReadback(false),
+										   m_Coalesce(true),
+										   m_DrawPointer(false),
+										   m_RegionRequestCount(0),
+										   m_ClipRects(nullptr),
+										   m_ClipRectsSize(0),
+										   m_FullCopyNeeded(true),
+										   m_FramePending(false),
+										   m_DeliveredMeta(nullptr),
+										   m_ImageFormat(DXGI_FORMAT_UNKNOWN),
+										   m_TextureWidth(0),
+										   m_TextureHeight(0),
+										   m_ImageWidth(0),
+										   m_ImageHeight(0),
+										   m_StagingPitch(0),
                                            m_OutputNumber(0),
 										   m_ImagePitch(0),
-										   m_DxRes(nullptr)
+										   m_Adapter(nullptr),
+										   m_EventLog(nullptr)
 {
     RtlZeroMemory(&m_OutputDesc, sizeof(m_OutputDesc));
+	RtlZeroMemory(m_RingMeta, sizeof(m_RingMeta));
+	m_CoalesceParams.RectCost = COALESCE_DEFAULT_RECT_COST;
+	m_CoalesceParams.MaxWastePercent = COALESCE_DEFAULT_WASTE_PERCENT;
+	RtlZeroMemory(&m_Pointer, sizeof(m_Pointer));
+	RtlZeroMemory(&m_PointerMeta, sizeof(m_PointerMeta));
+	RtlZeroMemory(m_RegionRequest, sizeof(m_RegionRequest));
+	RtlZeroMemory(&m_Regions, sizeof(m_Regions));
 }
 
 //
@@ -61,221 +87,911 @@ DUPLICATIONMANAGER::DUPLICATIONMANAGER() : m_DeskDupl(nullptr),
 //
 DUPLICATIONMANAGER::~DUPLICATIONMANAGER()
 {
-    if (m_DeskDupl)
-    {
-        m_DeskDupl->Release();
-        m_DeskDupl = nullptr;
-    }
-    if (m_AcquiredDesktopImage)
-    {
-        m_AcquiredDesktopImage->Release();
-        m_AcquiredDesktopImage = nullptr;
-    }
-	if (m_DestImage)
+	ReleaseDuplication();
+	ReleaseDx();
+	for (UINT i = 0; i < STAGING_RING_SIZE; ++i)
 	{
-		m_DestImage->Release();
-		m_DestImage = nullptr;
+		if (m_RingMeta[i].MetaData)
+		{
+			delete [] m_RingMeta[i].MetaData;
+			m_RingMeta[i].MetaData = nullptr;
+		}
 	}
-    if (m_DxRes->Device)
-    {
-		m_DxRes->Device->Release();
-		m_DxRes->Device = nullptr;
-    }
-	if (m_DxRes->Device)
+	if (m_Pointer.ShapeBuffer)
+	{
+		delete [] m_Pointer.ShapeBuffer;
+		m_Pointer.ShapeBuffer = nullptr;
+	}
+	if (m_PointerMeta.MetaData)
+	{
+		delete [] m_PointerMeta.MetaData;
+		m_PointerMeta.MetaData = nullptr;
+	}
+	if (m_ClipRects)
+	{
+		delete [] m_ClipRects;
+		m_ClipRects = nullptr;
+	}
+	if (m_OwnsDevice)
 	{
-		m_DxRes->Device->Release();
-		m_DxRes->Device = nullptr;
+		delete m_Device;
+		m_Device = nullptr;
 	}
-	if (m_DxRes->Context)
+	if (m_Adapter)
 	{
-		m_DxRes->Context->Release();
-		m_DxRes->Context = nullptr;
+		m_Adapter->Release();
+		m_Adapter = nullptr;
 	}
 }
 
 //
-// Initialize duplication interfaces
+// Initialize duplication interfaces. Output is enumerated on Adapter, or on the adapter
+// of the default device if no adapter is given. Can be called again, everything the
+// previous call created is released first.
 //
-DUPL_RETURN DUPLICATIONMANAGER::InitDupl(_In_ FILE *log_file, UINT Output)
+DUPL_RETURN DUPLICATIONMANAGER::InitDupl(_In_ FILE *log_file, UINT Output, _In_opt_ IDXGIAdapter* Adapter)
 {
 	m_log_file = log_file;
-	m_DxRes = new (std::nothrow) DX_RESOURCES;
-	RtlZeroMemory(m_DxRes, sizeof(DX_RESOURCES));
-	DUPL_RETURN Ret = InitializeDx(); 
+	m_OutputNumber = Output;
+	ReleaseDuplication();
+	ReleaseDx();
+
+	if (Adapter)
+	{
+		Adapter->AddRef();
+	}
+	if (m_Adapter)
+	{
+		m_Adapter->Release();
+	}
+	m_Adapter = Adapter;
+
+	if (!m_Device)
+	{
+		m_Device = new (std::nothrow) DXGIDUPLICATIONDEVICE;
+		if (!m_Device)
+		{
+			fprintf_s(log_file, "DUPLICATIONDEVICE couldn't be allocated.");
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_OwnsDevice = true;
+	}
+
+	DUPL_RETURN Ret = InitializeDx(Adapter); 
 	if (Ret != DUPL_RETURN_SUCCESS)
 	{
 		fprintf_s(log_file, "DX_RESOURCES couldn't be initialized.");
 		return Ret;
 	}
-    m_OutputNumber = Output;
 
-    // Get DXGI device
-    IDXGIDevice* DxgiDevice = nullptr;
-    HRESULT hr = m_DxRes->Device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&DxgiDevice));
-    if (FAILED(hr))
-    {
-        return ProcessFailure(nullptr, L"Failed to QI for DXGI Device", hr);
-    }
+	bool ModeChanged;
+	Ret = CreateDuplication(&ModeChanged);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
 
-    // Get DXGI adapter
-    IDXGIAdapter* DxgiAdapter = nullptr;
-    hr = DxgiDevice->GetParent(__uuidof(IDXGIAdapter), reinterpret_cast<void**>(&DxgiAdapter));
-    DxgiDevice->Release();
-    DxgiDevice = nullptr;
-    if (FAILED(hr))
-    {
-        return ProcessFailure(m_DxRes->Device, L"Failed to get parent DXGI Adapter", hr, SystemTransitionsExpectedErrors);
-    }
+	Ret = CreateStagingRing();
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
 
-    // Get output
-    IDXGIOutput* DxgiOutput = nullptr;
-    hr = DxgiAdapter->EnumOutputs(Output, &DxgiOutput);
-    DxgiAdapter->Release();
-    DxgiAdapter = nullptr;
-    if (FAILED(hr))
-    {
-        return ProcessFailure(m_DxRes->Device, L"Failed to get specified output in DUPLICATIONMANAGER", hr, EnumOutputsExpectedErrors);
-    }
+	ResetRing();
 
-    DxgiOutput->GetDesc(&m_OutputDesc);
+    return DUPL_RETURN_SUCCESS;
+}
 
-    // QI for Output 1
-    IDXGIOutput1* DxgiOutput1 = nullptr;
-    hr = DxgiOutput->QueryInterface(__uuidof(DxgiOutput1), reinterpret_cast<void**>(&DxgiOutput1));
-    DxgiOutput->Release();
-    DxgiOutput = nullptr;
-    if (FAILED(hr))
-    {
-        return ProcessFailure(nullptr, L"Failed to QI for DxgiOutput1 in DUPLICATIONMANAGER", hr);
-    }
+//
+// Recreate the duplication after GetFrame returned DUPL_RETURN_ERROR_EXPECTED. A desktop switch
+// or mode change only invalidates the duplication, the device and the staging textures are
+// kept unless the device was removed or the image size or format changed. The next frame
+// is read back in full. Returns DUPL_RETURN_ERROR_EXPECTED while the transition is still going on.
+//
+DUPL_RETURN DUPLICATIONMANAGER::Reset()
+{
+	ReleaseDuplication();
+	ResetRing();
 
-    // Create desktop duplication
-    hr = DxgiOutput1->DuplicateOutput(m_DxRes->Device, &m_DeskDupl);
-    DxgiOutput1->Release();
-    DxgiOutput1 = nullptr;
-    if (FAILED(hr))
-    {
-        if (hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE)
-        {
-            MessageBoxW(nullptr, L"There is already the maximum number of applications using the Desktop Duplication API running, please close one of those applications and then try again.", L"Error", MB_OK);
-            return DUPL_RETURN_ERROR_UNEXPECTED;
-        }
-        return ProcessFailure(m_DxRes->Device, L"Failed to get duplicate output in DUPLICATIONMANAGER", hr, CreateDuplicationExpectedErrors);
-    }
+	if (!m_Device)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
 
-	D3D11_TEXTURE2D_DESC desc; 
-	DXGI_OUTDUPL_DESC lOutputDuplDesc;
-	m_DeskDupl->GetDesc(&lOutputDuplDesc);
-	desc.Width = lOutputDuplDesc.ModeDesc.Width;
-	desc.Height = lOutputDuplDesc.ModeDesc.Height;
-	desc.Format = lOutputDuplDesc.ModeDesc.Format;
-	desc.ArraySize = 1;
-	desc.BindFlags = 0;
-	desc.MiscFlags = 0;
-	desc.SampleDesc.Count = 1;
-	desc.SampleDesc.Quality = 0;
-	desc.MipLevels = 1;
-	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-	desc.Usage = D3D11_USAGE_STAGING;
-
-	hr = m_DxRes->Device->CreateTexture2D(&desc, NULL, &m_DestImage);
+	bool DeviceLost = !m_Device->HasDevice() || m_Device->GetDeviceRemovedReason() != S_OK;
+	if (DeviceLost)
+	{
+		ReleaseDx();
+		DUPL_RETURN Ret = InitializeDx(m_Adapter);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			return Ret;
+		}
+	}
+
+	bool ModeChanged;
+	DUPL_RETURN Ret = CreateDuplication(&ModeChanged);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
 
+	if (ModeChanged || !m_Device->HasStagingTextures())
+	{
+		ReleaseStagingRing();
+		Ret = CreateStagingRing();
+	}
+
+	return Ret;
+}
+
+//
+// Duplicate output m_OutputNumber of the device's adapter and lay out the capture regions on it.
+// ModeChanged is set if the image the staging textures have to hold is not the one of before.
+//
+DUPL_RETURN DUPLICATIONMANAGER::CreateDuplication(_Out_ bool* ModeChanged)
+{
+	*ModeChanged = true;
+
+	DXGI_OUTDUPL_DESC lOutputDuplDesc;
+	DUPLICATION_STEP FailedStep;
+	HRESULT hr = m_Device->DuplicateOutput(m_OutputNumber, &m_OutputDesc, &lOutputDuplDesc, &FailedStep);
 	if (FAILED(hr))
 	{
-		ProcessFailure(nullptr, L"Creating cpu accessable texture failed.", hr);
-		return DUPL_RETURN_ERROR_UNEXPECTED;
+		switch (FailedStep)
+		{
+		case DUPLICATION_STEP_DXGI_DEVICE:
+			return ProcessFailure(nullptr, L"Failed to QI for DXGI Device", hr);
+
+		case DUPLICATION_STEP_ADAPTER:
+			return ProcessFailure(m_Device, L"Failed to get parent DXGI Adapter", hr, SystemTransitionsExpectedErrors);
+
+		case DUPLICATION_STEP_OUTPUT:
+			return ProcessFailure(m_Device, L"Failed to get specified output in DUPLICATIONMANAGER", hr, EnumOutputsExpectedErrors);
+
+		case DUPLICATION_STEP_OUTPUT1:
+			return ProcessFailure(nullptr, L"Failed to QI for DxgiOutput1 in DUPLICATIONMANAGER", hr);
+
+		default:
+			if (hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE)
+			{
+				MessageBoxW(nullptr, L"There is already the maximum number of applications using the Desktop Duplication API running, please close one of those applications and then try again.", L"Error", MB_OK);
+				return DUPL_RETURN_ERROR_UNEXPECTED;
+			}
+			return ProcessFailure(m_Device, L"Failed to get duplicate output in DUPLICATIONMANAGER", hr, CreateDuplicationExpectedErrors);
+		}
 	}
 
-	if (m_DestImage == nullptr)
+	// Region copies, hashing and every sink work on 4 byte pixels. DuplicateOutput only returns
+	// 32bpp desktops, this keeps a wider format from ever reaching them.
+	if (GetFormatBytesPerPixel(lOutputDuplDesc.ModeDesc.Format) != BPP)
 	{
-		ProcessFailure(nullptr, L"Creating cpu accessable texture failed.", hr);
+		fprintf_s(m_log_file, "Output %u has desktop format %u, only 32bpp formats can be captured.\n", m_OutputNumber, lOutputDuplDesc.ModeDesc.Format);
 		return DUPL_RETURN_ERROR_UNEXPECTED;
 	}
 
-    return DUPL_RETURN_SUCCESS;
+	UINT ImageWidth = m_ImageWidth;
+	UINT ImageHeight = m_ImageHeight;
+	DXGI_FORMAT ImageFormat = m_ImageFormat;
+	m_ImageFormat = lOutputDuplDesc.ModeDesc.Format;
+	m_TextureWidth = lOutputDuplDesc.ModeDesc.Width;
+	m_TextureHeight = lOutputDuplDesc.ModeDesc.Height;
+	m_ImageWidth = m_TextureWidth;
+	m_ImageHeight = m_TextureHeight;
+
+	// Capturing regions, the staging textures only hold the region image
+	RtlZeroMemory(&m_Regions, sizeof(m_Regions));
+	if (m_RegionRequestCount)
+	{
+		if (!BuildRegionLayout(&m_Regions, m_RegionRequest, m_RegionRequestCount, &m_OutputDesc, m_TextureWidth, m_TextureHeight))
+		{
+			fprintf_s(m_log_file, "None of the capture regions is on output %u.\n", m_OutputNumber);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_ImageWidth = m_Regions.Width;
+		m_ImageHeight = m_Regions.Height;
+	}
+
+	*ModeChanged = (m_ImageWidth != ImageWidth || m_ImageHeight != ImageHeight || m_ImageFormat != ImageFormat);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Create the staging textures the image is read back from and find out their pitch
+//
+DUPL_RETURN DUPLICATIONMANAGER::CreateStagingRing()
+{
+	HRESULT hr = m_Device->CreateStagingTextures(STAGING_RING_SIZE, m_ImageWidth, m_ImageHeight, m_ImageFormat);
+	if (FAILED(hr))
+	{
+		return ProcessFailure(m_Device, L"Creating cpu accessable texture failed.", hr, SystemTransitionsExpectedErrors);
+	}
+
+	// The row pitch of the staging textures is only known once one is mapped
+	D3D11_MAPPED_SUBRESOURCE resource;
+	hr = m_Device->MapStaging(0, &resource);
+	if (FAILED(hr))
+	{
+		return ProcessFailure(m_Device, L"Failed to map staging texture in DUPLICATIONMANAGER", hr, SystemTransitionsExpectedErrors);
+	}
+	m_StagingPitch = resource.RowPitch;
+	m_Device->UnmapStaging(0);
+
+	return DUPL_RETURN_SUCCESS;
 }
 
+//
+// Release the duplication and the frame held from it
+//
+void DUPLICATIONMANAGER::ReleaseDuplication()
+{
+	if (m_Device)
+	{
+		m_Device->ReleaseDuplication();
+	}
+}
+
+void DUPLICATIONMANAGER::ReleaseStagingRing()
+{
+	if (m_Device)
+	{
+		m_Device->ReleaseStagingTextures();
+	}
+}
 
 //
-// Get next frame and write it into Data
+// Release the device and everything created on it except the duplication
+//
+void DUPLICATIONMANAGER::ReleaseDx()
+{
+	if (m_Device)
+	{
+		m_Device->ReleaseDevice();
+	}
+}
+
+//
+// Forget the frames in the staging ring, the next frame is read back in full
+//
+void DUPLICATIONMANAGER::ResetRing()
+{
+	m_RingHead = 0;
+	m_RingCount = 0;
+	m_RingPrimed = false;
+	m_FullCopyNeeded = true;
+	m_DeliveredMeta = nullptr;
+	m_PointerCompositor.Forget();
+}
+
+
+//
+// Get next frame and write it into Data, waiting at most TimeoutMs for one.
+// Timeout is set when ImageData was left untouched, because there is no new desktop image or
+// because the new one is still in the staging ring, which IsFramePending tells apart.
 //
 _Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
-DUPL_RETURN DUPLICATIONMANAGER::GetFrame(_Inout_ BYTE* ImageData)
+DUPL_RETURN DUPLICATIONMANAGER::GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
 {
-    IDXGIResource* DesktopResource = nullptr;
     DXGI_OUTDUPL_FRAME_INFO FrameInfo;
+	LARGE_INTEGER AcquireTime;
+
+    *Timeout = true;
+	m_DeliveredMeta = nullptr;
+	m_FramePending = false;
+
+	// A Reset that didn't get through left no duplication behind
+	if (!m_Device || !m_Device->HasDuplication())
+	{
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
 
     // Get new frame
-    HRESULT hr = m_DeskDupl->AcquireNextFrame(500, &FrameInfo, &DesktopResource);
+    HRESULT hr = m_Device->AcquireNextFrame(TimeoutMs, &FrameInfo);
+	QueryPerformanceCounter(&AcquireTime);
     if (hr == DXGI_ERROR_WAIT_TIMEOUT)
     {
+		// Screen went idle with frames still in the ring, deliver them now instead of
+		// holding them back until the desktop changes again
+		if (m_RingCount)
+		{
+			return CopyImage(ImageData, Timeout);
+		}
         return DUPL_RETURN_SUCCESS;
     }
 
     if (FAILED(hr))
     {
-        return ProcessFailure(m_DxRes->Device, L"Failed to acquire next frame in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
+        return ProcessFailure(m_Device, L"Failed to acquire next frame in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
     }
 
-    // If still holding old frame, destroy it
-    if (m_AcquiredDesktopImage)
-    {
-        m_AcquiredDesktopImage->Release();
-        m_AcquiredDesktopImage = nullptr;
-    }
+	// Pointer shape can only be read while the frame is held
+	DUPL_RETURN Ret = UpdatePointer(&FrameInfo);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		DoneWithFrame();
+		return Ret;
+	}
 
-    // QI for IDXGIResource
-    hr = DesktopResource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void **>(&m_AcquiredDesktopImage));
-    DesktopResource->Release();
-    DesktopResource = nullptr;
-    if (FAILED(hr))
-    {
-        return ProcessFailure(nullptr, L"Failed to QI for ID3D11Texture2D from acquired IDXGIResource in DUPLICATIONMANAGER", hr);
-    }
+	// Only the pointer changed, there is nothing to copy on the GPU or read back
+	if (!FrameInfo.LastPresentTime.QuadPart && m_RingPrimed && !m_FullCopyNeeded)
+	{
+		Ret = DoneWithFrame();
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			return Ret;
+		}
 
-	CopyImage(ImageData);
-	
+		// Frames still in the ring are delivered as on a timeout, they redraw the pointer as well
+		if (m_RingCount)
+		{
+			return CopyImage(ImageData, Timeout);
+		}
+		return DeliverPointerFrame(ImageData, Timeout, AcquireTime);
+	}
+
+	// Queue the GPU copy and hand the frame back to DXGI straight away
+	bool Skipped;
+	Ret = QueueCopy(&FrameInfo, AcquireTime, &Skipped);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
+
+	// Nothing changed inside the capture regions, same as a timeout
+	if (Skipped)
+	{
+		if (m_RingCount)
+		{
+			return CopyImage(ImageData, Timeout);
+		}
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	// The very first frame is read back synchronously so ImageData is never uninitialized.
+	// After that only the oldest slot is read, its copy was queued STAGING_RING_SIZE - 1 calls ago.
+	// Until the ring fills up again ImageData keeps holding the last frame that was read back.
+	if (!m_RingPrimed || m_RingCount == STAGING_RING_SIZE)
+	{
+		m_RingPrimed = true;
+		return CopyImage(ImageData, Timeout);
+	}
+
+	m_FramePending = true;
     return DUPL_RETURN_SUCCESS;
 }
 
-void  DUPLICATIONMANAGER::CopyImage(BYTE* ImageData)
+//
+// Whether the last GetFrame set Timeout although it captured a new frame. The frame is still
+// being copied into the staging ring and a later GetFrame delivers it, so it is no repeat.
+//
+bool DUPLICATIONMANAGER::IsFramePending()
+{
+	return m_FramePending;
+}
+
+//
+// Copy the acquired frame into the next free staging texture and release the frame.
+// When capturing regions only they are copied, and Skipped is set instead if the
+// frame left them untouched.
+//
+DUPL_RETURN DUPLICATIONMANAGER::QueueCopy(_In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo, LARGE_INTEGER AcquireTime, _Out_ bool* Skipped)
+{
+	*Skipped = false;
+	UINT Slot = (m_RingHead + m_RingCount) % STAGING_RING_SIZE;
+	FRAME_METADATA* Meta = &m_RingMeta[Slot];
+
+	Meta->FrameInfo = *FrameInfo;
+	Meta->AcquireTime = AcquireTime;
+
+	// Nothing but the pointer changed if no new desktop image was presented
+	Meta->Presented = (FrameInfo->LastPresentTime.QuadPart != 0);
+	Meta->PointerMoved = false;
+
+	// Rects have to be read before the frame is released. Regions need them to tell
+	// whether the frame touched them at all.
+	if (m_DirtyRectReadback || m_Regions.Count)
+	{
+		DUPL_RETURN Ret = GetMetaData(FrameInfo, Meta);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			// Nothing is queued for a frame whose rects are unknown, and the image it changed
+			// is only whole again after a full copy
+			m_FullCopyNeeded = true;
+			DoneWithFrame();
+			return Ret;
+		}
+	}
+	else
+	{
+		Meta->FullCopy = true;
+	}
+
+	if (m_Regions.Count)
+	{
+		if (!Meta->FullCopy)
+		{
+			ClipToRegions(Meta);
+
+			// ImageData already holds what this frame has inside the regions
+			if (!Meta->FullCopy && !Meta->DirtyCount && m_RingPrimed && !m_FullCopyNeeded)
+			{
+				*Skipped = true;
+				return DoneWithFrame();
+			}
+		}
+
+		// Whole regions are copied so the slot is complete however much of it is read back
+		for (UINT i = 0; i < m_Regions.Count; ++i)
+		{
+			const CAPTURE_REGION* Region = &m_Regions.Regions[i];
+			m_Device->CopyFrameRegion(Slot, Region->Dest.x, Region->Dest.y, &Region->Source);
+		}
+
+		if (!m_DirtyRectReadback)
+		{
+			Meta->FullCopy = true;
+		}
+	}
+	else
+	{
+		m_Device->CopyFrame(Slot);
+	}
+	++m_RingCount;
+	QueryPerformanceCounter(&Meta->CopyTime);
+
+	return DoneWithFrame();
+}
+
+//
+// Get the move and dirty rects of the acquired frame into the slot's metadata buffer
+//
+DUPL_RETURN DUPLICATIONMANAGER::GetMetaData(_In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo, _Inout_ FRAME_METADATA* Meta)
+{
+	Meta->MoveCount = 0;
+	Meta->DirtyCount = 0;
+	Meta->FullCopy = false;
+
+	if (!FrameInfo->TotalMetadataBufferSize)
+	{
+		// Only the pointer changed when there is no new desktop image, otherwise play safe
+		Meta->FullCopy = (FrameInfo->LastPresentTime.QuadPart != 0);
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	// Old buffer too small
+	if (FrameInfo->TotalMetadataBufferSize > Meta->MetaDataSize)
+	{
+		if (Meta->MetaData)
+		{
+			delete [] Meta->MetaData;
+			Meta->MetaData = nullptr;
+		}
+		Meta->MetaData = new (std::nothrow) BYTE[FrameInfo->TotalMetadataBufferSize];
+		if (!Meta->MetaData)
+		{
+			Meta->MetaDataSize = 0;
+			Meta->FullCopy = true;
+			return ProcessFailure(nullptr, L"Failed to allocate memory for metadata in DUPLICATIONMANAGER", E_OUTOFMEMORY);
+		}
+		Meta->MetaDataSize = FrameInfo->TotalMetadataBufferSize;
+	}
+
+	UINT BufSize = FrameInfo->TotalMetadataBufferSize;
+
+	// Get move rectangles
+	HRESULT hr = m_Device->GetFrameMoveRects(BufSize, reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData), &BufSize);
+	if (FAILED(hr))
+	{
+		Meta->FullCopy = true;
+		return ProcessFailure(nullptr, L"Failed to get frame move rects in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
+	}
+	Meta->MoveCount = BufSize / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+
+	BYTE* DirtyRects = Meta->MetaData + BufSize;
+	BufSize = FrameInfo->TotalMetadataBufferSize - BufSize;
+
+	// Get dirty rectangles
+	hr = m_Device->GetFrameDirtyRects(BufSize, reinterpret_cast<RECT*>(DirtyRects), &BufSize);
+	if (FAILED(hr))
+	{
+		Meta->MoveCount = 0;
+		Meta->FullCopy = true;
+		return ProcessFailure(nullptr, L"Failed to get frame dirty rects in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
+	}
+	Meta->DirtyCount = BufSize / sizeof(RECT);
+
+	// Everything downstream copies, hashes or records the merged rects
+	if (m_Coalesce)
+	{
+		Meta->DirtyCount = CoalesceRects(reinterpret_cast<RECT*>(DirtyRects), Meta->DirtyCount, &m_CoalesceParams);
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Replace the rects of the acquired image with their parts inside the capture regions, in
+// region image coordinates. If they don't fit the frame is reported as a full copy instead.
+//
+void DUPLICATIONMANAGER::ClipToRegions(_Inout_ FRAME_METADATA* Meta)
+{
+	UINT Capacity = (Meta->MoveCount + Meta->DirtyCount) * m_Regions.Count;
+	if (Capacity > m_ClipRectsSize)
+	{
+		if (m_ClipRects)
+		{
+			delete [] m_ClipRects;
+		}
+		m_ClipRects = new (std::nothrow) RECT[Capacity];
+		if (!m_ClipRects)
+		{
+			m_ClipRectsSize = 0;
+			Meta->FullCopy = true;
+			return;
+		}
+		m_ClipRectsSize = Capacity;
+	}
+
+	const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+	const RECT* DirtyRects = reinterpret_cast<RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+	UINT Count = ClipRectsToRegions(m_ClipRects, &m_Regions, MoveRects, Meta->MoveCount, DirtyRects, Meta->DirtyCount);
+
+	// A rect can be in several regions and end up in the buffer more than once
+	UINT Required = Count * sizeof(RECT);
+	if (Required > Meta->MetaDataSize)
+	{
+		delete [] Meta->MetaData;
+		Meta->MetaData = new (std::nothrow) BYTE[Required];
+		if (!Meta->MetaData)
+		{
+			Meta->MetaDataSize = 0;
+			Meta->MoveCount = 0;
+			Meta->DirtyCount = 0;
+			Meta->FullCopy = true;
+			return;
+		}
+		Meta->MetaDataSize = Required;
+	}
+
+	if (Count)
+	{
+		memcpy_s(Meta->MetaData, Meta->MetaDataSize, m_ClipRects, Required);
+	}
+	Meta->MoveCount = 0;
+	Meta->DirtyCount = Count;
+}
+
+//
+// Read back the oldest staging texture in the ring into ImageData.
+// With dirty rect readback enabled only the regions that changed since the
+// previous frame are copied, so ImageData must be the same buffer on every call.
+//
+DUPL_RETURN DUPLICATIONMANAGER::CopyImage(_Inout_ BYTE* ImageData, _Out_ bool* Timeout)
 {
-	m_DxRes->Context->CopyResource(m_DestImage, m_AcquiredDesktopImage);
+	UINT Slot = m_RingHead;
+	FRAME_METADATA* Meta = &m_RingMeta[m_RingHead];
+	m_RingHead = (m_RingHead + 1) % STAGING_RING_SIZE;
+	--m_RingCount;
+
+	// Pointer only updates leave the desktop image as it was, don't read it back at all
+	if (!Meta->Presented && !m_FullCopyNeeded)
+	{
+		return DeliverPointerFrame(ImageData, Timeout, Meta->AcquireTime);
+	}
+
 	D3D11_MAPPED_SUBRESOURCE resource;
-	UINT subresource = D3D11CalcSubresource(0, 0, 0);
-	m_DxRes->Context->Map(m_DestImage, subresource, D3D11_MAP_READ, 0, &resource);
+	HRESULT hr = m_Device->MapStaging(Slot, &resource);
+	if (FAILED(hr))
+	{
+		// ImageData missed a frame, patching it with the next frame's rects would be wrong
+		m_FullCopyNeeded = true;
+		return ProcessFailure(m_Device, L"Failed to map staging texture in DUPLICATIONMANAGER", hr, SystemTransitionsExpectedErrors);
+	}
+	QueryPerformanceCounter(&Meta->MapTime);
 
 	BYTE* sptr = reinterpret_cast<BYTE*>(resource.pData);
 
+	// The pointer was drawn over the previous frame, take it out before moves and dirty rects are applied around it
+	RECT PointerRects[2];
+	UINT PointerCount = m_PointerCompositor.Erase(ImageData, m_ImagePitch, &PointerRects[0]) ? 1 : 0;
+
+	// The staging texture has the size of the acquired image, which is not rotated with the output, or of the region image
+	UINT height = m_ImageHeight;
+	if (m_FullCopyNeeded || Meta->FullCopy || resource.RowPitch != static_cast<UINT>(m_ImagePitch))
+	{
+		memcpy_s(ImageData, resource.RowPitch*height, sptr, resource.RowPitch*height);
+		m_FullCopyNeeded = false;
+
+		// Whole image was replaced, the rects don't describe what changed in ImageData
+		Meta->FullCopy = true;
+	}
+	else
+	{
+		// Move and dirty rects are in the coordinates of the acquired image, which is what the staging texture holds.
+		// Moves are applied to the previous frame already in ImageData, no need to read those pixels back.
+		// ImageData is laid out like the acquired image whatever the output's rotation, which consumers get
+		// from the image view and turn upright themselves, so the moves are applied unrotated. Region images
+		// never get here with moves, ClipToRegions made them dirty rects of the region image.
+		DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+		ApplyMoveRects(ImageData, resource.RowPitch, m_TextureWidth, m_TextureHeight, MoveRects, Meta->MoveCount, DXGI_MODE_ROTATION_IDENTITY, m_TextureWidth, m_TextureHeight);
+
+		RECT* DirtyRects = reinterpret_cast<RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+		CopyRegions(ImageData, resource.RowPitch, sptr, resource.RowPitch, m_ImageWidth, m_ImageHeight, DirtyRects, Meta->DirtyCount);
+	}
+
 	//Store Image Pitch
 	m_ImagePitch = resource.RowPitch;
 
-	int height = GetImageHeight();
-	memcpy_s(ImageData, resource.RowPitch*height, sptr, resource.RowPitch*height);
+	if (DrawPointer(ImageData, &PointerRects[PointerCount]))
+	{
+		++PointerCount;
+	}
+	Meta->PointerMoved = (PointerCount != 0);
+	if (PointerCount && !Meta->FullCopy)
+	{
+		AddPointerRects(Meta, PointerRects, PointerCount);
+	}
+
+	m_Device->UnmapStaging(Slot);
+	QueryPerformanceCounter(&Meta->ReadbackTime);
+	m_DeliveredMeta = Meta;
+	*Timeout = false;
 
-	m_DxRes->Context->Unmap(m_DestImage, subresource);
-	DoneWithFrame();
+	return DUPL_RETURN_SUCCESS;
 }
 
-int DUPLICATIONMANAGER::GetImageHeight()
+int DUPLICATIONMANAGER::GetImagePitch()
 {
-	DXGI_OUTDUPL_DESC lOutputDuplDesc;
-	m_DeskDupl->GetDesc(&lOutputDuplDesc);
-	return m_OutputDesc.DesktopCoordinates.bottom - m_OutputDesc.DesktopCoordinates.top;
+	return m_ImagePitch;
+}
+
+//
+// Describe the image GetFrame wrote into ImageData. Width and Height are those of the
+// acquired image, or of the region image when capturing regions. Pitch is the row pitch
+// of the staging texture it was read from.
+//
+void DUPLICATIONMANAGER::GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+{
+	View->Data = ImageData;
+	View->Width = m_ImageWidth;
+	View->Height = m_ImageHeight;
+	View->Pitch = m_ImagePitch;
+	View->Format = m_ImageFormat;
+	View->Rotation = m_OutputDesc.Rotation;
 }
 
+//
+// Bytes GetFrame needs in ImageData
+//
+UINT DUPLICATIONMANAGER::GetImageBufferSize()
+{
+	return m_StagingPitch * m_ImageHeight;
+}
 
-int DUPLICATIONMANAGER::GetImageWidth()
+//
+// Frame info and rects of the frame last written into ImageData, valid until the next GetFrame.
+// Returns nullptr if GetFrame did not deliver a frame since.
+//
+const FRAME_METADATA* DUPLICATIONMANAGER::GetFrameMetaData()
 {
-	DXGI_OUTDUPL_DESC lOutputDuplDesc;
-	m_DeskDupl->GetDesc(&lOutputDuplDesc);
-	return m_OutputDesc.DesktopCoordinates.right - m_OutputDesc.DesktopCoordinates.left;
+	return m_DeliveredMeta;
+}
+
+//
+// When enabled GetFrame only copies the regions DXGI reports as changed into ImageData
+//
+void DUPLICATIONMANAGER::SetDirtyRectReadback(bool Enable)
+{
+	if (Enable && !m_DirtyRectReadback)
+	{
+		// Frames already in the ring were queued without their rects
+		m_FullCopyNeeded = true;
+	}
+	m_DirtyRectReadback = Enable;
 }
 
+//
+// Dirty rects are merged with the given cost model as they are read, nullptr leaves them as DXGI reported them
+//
+void DUPLICATIONMANAGER::SetRectCoalescing(_In_opt_ const COALESCE_PARAMS* Params)
+{
+	m_Coalesce = (Params != nullptr);
+	if (Params)
+	{
+		m_CoalesceParams = *Params;
+	}
+}
 
-int DUPLICATIONMANAGER::GetImagePitch()
+//
+// Draw the pointer into the frames GetFrame delivers. Turning it off takes a full copy
+// to get the pointer out of ImageData.
+//
+void DUPLICATIONMANAGER::SetPointerCompositing(bool Enable)
 {
-	return m_ImagePitch;
+	if (m_DrawPointer && !Enable)
+	{
+		m_PointerCompositor.Forget();
+		m_FullCopyNeeded = true;
+	}
+	m_DrawPointer = Enable;
+}
+
+//
+// Capture only these rects of the desktop instead of the whole output, they are stacked
+// into one image top to bottom. Takes effect at the next InitDupl, no rects captures everything.
+//
+void DUPLICATIONMANAGER::SetCaptureRegions(_In_reads_(Count) const RECT* Regions, UINT Count)
+{
+	m_RegionRequestCount = min(Count, static_cast<UINT>(CAPTURE_MAX_REGIONS));
+	if (m_RegionRequestCount)
+	{
+		memcpy_s(m_RegionRequest, sizeof(m_RegionRequest), Regions, m_RegionRequestCount * sizeof(RECT));
+	}
+}
+
+//
+// Hand the failures of GetFrame and Reset to Log instead of writing them on the capture thread
+//
+void DUPLICATIONMANAGER::SetEventLog(_In_opt_ EVENTLOG* Log)
+{
+	m_EventLog = Log;
+}
+
+//
+// Keep track of the pointer position and shape. Has to be called while the frame is held.
+//
+DUPL_RETURN DUPLICATIONMANAGER::UpdatePointer(_In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo)
+{
+	// Neither position nor shape changed
+	if (!FrameInfo->LastMouseUpdateTime.QuadPart)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	m_Pointer.Position = FrameInfo->PointerPosition.Position;
+	m_Pointer.Visible = (FrameInfo->PointerPosition.Visible != FALSE);
+	m_Pointer.LastTimeStamp = FrameInfo->LastMouseUpdateTime;
+
+	// No new shape
+	if (!FrameInfo->PointerShapeBufferSize)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	// Old buffer too small
+	if (FrameInfo->PointerShapeBufferSize > m_Pointer.BufferSize)
+	{
+		if (m_Pointer.ShapeBuffer)
+		{
+			delete [] m_Pointer.ShapeBuffer;
+			m_Pointer.ShapeBuffer = nullptr;
+		}
+		m_Pointer.ShapeBuffer = new (std::nothrow) BYTE[FrameInfo->PointerShapeBufferSize];
+		if (!m_Pointer.ShapeBuffer)
+		{
+			m_Pointer.BufferSize = 0;
+			m_Pointer.HasShape = false;
+			return ProcessFailure(nullptr, L"Failed to allocate memory for pointer shape in DUPLICATIONMANAGER", E_OUTOFMEMORY);
+		}
+		m_Pointer.BufferSize = FrameInfo->PointerShapeBufferSize;
+	}
+
+	UINT BufferSizeRequired;
+	HRESULT hr = m_Device->GetFramePointerShape(FrameInfo->PointerShapeBufferSize, m_Pointer.ShapeBuffer, &BufferSizeRequired, &m_Pointer.ShapeInfo);
+	if (FAILED(hr))
+	{
+		m_Pointer.HasShape = false;
+		return ProcessFailure(nullptr, L"Failed to get frame pointer shape in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
+	}
+	m_Pointer.HasShape = true;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Pointer positions are in desktop orientation and ImageData holds the acquired image,
+// which is not rotated, so the pointer is only drawn for outputs that aren't rotated.
+// Nor is it drawn into region images.
+//
+bool DUPLICATIONMANAGER::DrawPointer(_Inout_ BYTE* ImageData, _Out_ RECT* Rect)
+{
+	if (!m_DrawPointer || m_Regions.Count ||
+		(m_OutputDesc.Rotation != DXGI_MODE_ROTATION_IDENTITY && m_OutputDesc.Rotation != DXGI_MODE_ROTATION_UNSPECIFIED))
+	{
+		RtlZeroMemory(Rect, sizeof(RECT));
+		return false;
+	}
+
+	return m_PointerCompositor.Draw(ImageData, m_ImagePitch, m_TextureWidth, m_TextureHeight, &m_Pointer, Rect);
+}
+
+//
+// Report the pixels the pointer was drawn over as dirty. If the rects don't fit the
+// frame is reported as a full copy instead, which is always correct.
+//
+void DUPLICATIONMANAGER::AddPointerRects(_Inout_ FRAME_METADATA* Meta, _In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	UINT Used = Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT) + Meta->DirtyCount * sizeof(RECT);
+	UINT Required = Used + Count * sizeof(RECT);
+	if (Required > Meta->MetaDataSize)
+	{
+		BYTE* MetaData = new (std::nothrow) BYTE[Required];
+		if (!MetaData)
+		{
+			Meta->FullCopy = true;
+			return;
+		}
+		if (Meta->MetaData)
+		{
+			memcpy_s(MetaData, Required, Meta->MetaData, Used);
+			delete [] Meta->MetaData;
+		}
+		Meta->MetaData = MetaData;
+		Meta->MetaDataSize = Required;
+	}
+
+	memcpy_s(Meta->MetaData + Used, Meta->MetaDataSize - Used, Rects, Count * sizeof(RECT));
+	Meta->DirtyCount += Count;
+}
+
+//
+// Only the pointer changed. The pointer is moved in ImageData and the frame is delivered
+// with where it was and where it is now as dirty rects, without reading anything back.
+//
+DUPL_RETURN DUPLICATIONMANAGER::DeliverPointerFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, LARGE_INTEGER AcquireTime)
+{
+	*Timeout = true;
+	if (!m_DrawPointer)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	if (!m_PointerMeta.MetaData)
+	{
+		m_PointerMeta.MetaData = new (std::nothrow) BYTE[2 * sizeof(RECT)];
+		if (!m_PointerMeta.MetaData)
+		{
+			return ProcessFailure(nullptr, L"Failed to allocate memory for pointer metadata in DUPLICATIONMANAGER", E_OUTOFMEMORY);
+		}
+		m_PointerMeta.MetaDataSize = 2 * sizeof(RECT);
+	}
+
+	RECT* Rects = reinterpret_cast<RECT*>(m_PointerMeta.MetaData);
+	UINT Count = 0;
+	if (m_PointerCompositor.Erase(ImageData, m_ImagePitch, &Rects[Count]))
+	{
+		++Count;
+	}
+	if (DrawPointer(ImageData, &Rects[Count]))
+	{
+		++Count;
+	}
+
+	// Hidden before and after
+	if (!Count)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	m_PointerMeta.MoveCount = 0;
+	m_PointerMeta.DirtyCount = Count;
+	m_PointerMeta.FullCopy = false;
+	m_PointerMeta.Presented = false;
+	m_PointerMeta.PointerMoved = true;
+	RtlZeroMemory(&m_PointerMeta.FrameInfo, sizeof(m_PointerMeta.FrameInfo));
+	m_PointerMeta.FrameInfo.LastMouseUpdateTime = m_Pointer.LastTimeStamp;
+	m_PointerMeta.FrameInfo.PointerPosition.Position = m_Pointer.Position;
+	m_PointerMeta.FrameInfo.PointerPosition.Visible = m_Pointer.Visible;
+	m_PointerMeta.AcquireTime = AcquireTime;
+	QueryPerformanceCounter(&m_PointerMeta.CopyTime);
+	m_PointerMeta.MapTime = m_PointerMeta.CopyTime;
+	m_PointerMeta.ReadbackTime = m_PointerMeta.CopyTime;
+
+	m_DeliveredMeta = &m_PointerMeta;
+	*Timeout = false;
+
+	return DUPL_RETURN_SUCCESS;
 }
 
 //
@@ -283,16 +999,10 @@ int DUPLICATIONMANAGER::GetImagePitch()
 //
 DUPL_RETURN DUPLICATIONMANAGER::DoneWithFrame()
 {
-    HRESULT hr = m_DeskDupl->ReleaseFrame();
+    HRESULT hr = m_Device->ReleaseFrame();
     if (FAILED(hr))
     {
-        return ProcessFailure(m_DxRes->Device, L"Failed to release frame in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
-    }
-
-    if (m_AcquiredDesktopImage)
-    {
-        m_AcquiredDesktopImage->Release();
-        m_AcquiredDesktopImage = nullptr;
+        return ProcessFailure(m_Device, L"Failed to release frame in DUPLICATIONMANAGER", hr, FrameInfoExpectedErrors);
     }
 
     return DUPL_RETURN_SUCCESS;
@@ -307,7 +1017,7 @@ void DUPLICATIONMANAGER::GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
 }
 
 _Post_satisfies_(return != DUPL_RETURN_SUCCESS)
-DUPL_RETURN DUPLICATIONMANAGER::ProcessFailure(_In_opt_ ID3D11Device* Device, _In_ LPCWSTR Str, HRESULT hr, _In_opt_z_ HRESULT* ExpectedErrors)
+DUPL_RETURN DUPLICATIONMANAGER::ProcessFailure(_In_opt_ DUPLICATIONDEVICE* Device, _In_z_ LPCWSTR Str, HRESULT hr, _In_opt_z_ HRESULT* ExpectedErrors)
 {
 	HRESULT TranslatedHr;
 
@@ -368,77 +1078,37 @@ DUPL_RETURN DUPLICATIONMANAGER::ProcessFailure(_In_opt_ ID3D11Device* Device, _I
 }
 
 //
-// Displays a message
+// Displays a message. Str has to be a string literal: with an event log only its address is stored,
+// and the writer thread reads the string whenever it gets to the event.
 //
-void DUPLICATIONMANAGER::DisplayMsg(_In_ LPCWSTR Str, HRESULT hr)
+void DUPLICATIONMANAGER::DisplayMsg(_In_z_ LPCWSTR Str, HRESULT hr)
 {
-	if (SUCCEEDED(hr))
+	if (m_EventLog)
 	{
-		fprintf_s(m_log_file, "%ls\n", Str);
+		m_EventLog->Write("%ls", hr, LogArg(Str));
 		return;
 	}
 
-	const UINT StringLen = (UINT)(wcslen(Str) + sizeof(" with HRESULT 0x########."));
-	wchar_t* OutStr = new wchar_t[StringLen];
-	if (!OutStr)
+	if (SUCCEEDED(hr))
 	{
-		return;
+		fprintf_s(m_log_file, "%ls\n", Str);
 	}
-
-	INT LenWritten = swprintf_s(OutStr, StringLen, L"%s with 0x%X.", Str, hr);
-	if (LenWritten != -1)
+	else
 	{
-		fprintf_s(m_log_file, "%ls\n", OutStr);
+		fprintf_s(m_log_file, "%ls with 0x%X.\n", Str, hr);
 	}
-
-	delete[] OutStr;
 }
 
 //
-// Get DX_RESOURCES
+// Create the device. It has to live on the adapter the output is connected to.
 //
-DUPL_RETURN DUPLICATIONMANAGER::InitializeDx()
+DUPL_RETURN DUPLICATIONMANAGER::InitializeDx(_In_opt_ IDXGIAdapter* Adapter)
 {
-
-	HRESULT hr = S_OK;
-
-	// Driver types supported
-	D3D_DRIVER_TYPE DriverTypes[] =
-	{
-		D3D_DRIVER_TYPE_HARDWARE,
-		D3D_DRIVER_TYPE_WARP,
-		D3D_DRIVER_TYPE_REFERENCE,
-	};
-	UINT NumDriverTypes = ARRAYSIZE(DriverTypes);
-
-	// Feature levels supported
-	D3D_FEATURE_LEVEL FeatureLevels[] =
-	{
-		D3D_FEATURE_LEVEL_11_0,
-		D3D_FEATURE_LEVEL_10_1,
-		D3D_FEATURE_LEVEL_10_0,
-		D3D_FEATURE_LEVEL_9_1
-	};
-	UINT NumFeatureLevels = ARRAYSIZE(FeatureLevels);
-
-	D3D_FEATURE_LEVEL FeatureLevel;
-
-	// Create device
-	for (UINT DriverTypeIndex = 0; DriverTypeIndex < NumDriverTypes; ++DriverTypeIndex)
-	{
-		hr = D3D11CreateDevice(nullptr, DriverTypes[DriverTypeIndex], nullptr, 0, FeatureLevels, NumFeatureLevels,
-			D3D11_SDK_VERSION, &m_DxRes->Device, &FeatureLevel, &m_DxRes->Context);
-		if (SUCCEEDED(hr))
-		{
-			// Device creation success, no need to loop anymore
-			break;
-		}
-	}
+	HRESULT hr = m_Device->CreateDevice(Adapter);
 	if (FAILED(hr))
 	{
-
 		return ProcessFailure(nullptr, L"Failed to create device in InitializeDx", hr);
 	}
 
 	return DUPL_RETURN_SUCCESS;
-}
\ No newline at end of file
+}
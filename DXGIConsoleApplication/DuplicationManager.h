@@ -13,6 +13,12 @@
 #include <sal.h>
 #include <new>
 #include <stdio.h>
+#include "RegionCopy.h"
+#include "RectCoalesce.h"
+#include "PointerComposite.h"
+#include "ImageView.h"
+#include "CaptureRegion.h"
+#include "DuplicationDevice.h"
 
 extern HRESULT SystemTransitionsExpectedErrors[];
 extern HRESULT CreateDuplicationExpectedErrors[];
@@ -20,6 +26,16 @@ extern HRESULT FrameInfoExpectedErrors[];
 extern HRESULT AcquireFrameExpectedError[];
 extern HRESULT EnumOutputsExpectedErrors[];
 
+// How long GetFrame waits for a new frame when the caller has no deadline of its own
+#define FRAME_TIMEOUT_DEFAULT 500
+
+// Number of staging textures frames are copied into before they are read back.
+// A frame is mapped STAGING_RING_SIZE - 1 calls to GetFrame after its copy was queued
+// so the GPU copy overlaps with the readback of the previous frame, or by the first
+// GetFrame that times out.
+#define STAGING_RING_SIZE 2
+static_assert(STAGING_RING_SIZE <= DUPLICATION_MAX_STAGING, "Staging ring larger than a device keeps");
+
 typedef _Return_type_success_(return == DUPL_RETURN_SUCCESS) enum
 {
 	DUPL_RETURN_SUCCESS = 0,
@@ -42,44 +58,138 @@ typedef struct _DX_RESOURCES
 } DX_RESOURCES;
 
 
+//
+// Move and dirty rects of a frame waiting in the staging ring.
+// MetaData holds MoveCount DXGI_OUTDUPL_MOVE_RECTs followed by DirtyCount RECTs.
+//
+typedef struct _FRAME_METADATA
+{
+	_Field_size_bytes_(MetaDataSize) BYTE* MetaData;
+	UINT MetaDataSize;
+	UINT MoveCount;
+	UINT DirtyCount;
+	bool FullCopy;      // Rects are not usable, the whole frame has to be read back
+	bool Presented;     // False if only the pointer changed and the desktop image is the same
+	bool PointerMoved;  // Dirty rects include where the pointer was drawn before and after this frame
+	DXGI_OUTDUPL_FRAME_INFO FrameInfo;
+	LARGE_INTEGER AcquireTime;      // QueryPerformanceCounter ticks when AcquireNextFrame returned
+	LARGE_INTEGER CopyTime;         // Copy into the staging texture was queued
+	LARGE_INTEGER MapTime;          // Staging texture was mapped, so the GPU copy had finished
+	LARGE_INTEGER ReadbackTime;     // Pixels were in ImageData
+} FRAME_METADATA;
+
+//
+// Anything that produces desktop frames, so capture scheduling and compositing don't depend
+// on a real duplication. GetFrame has the semantics of DUPLICATIONMANAGER::GetFrame: ImageData
+// must be the same buffer of at least GetImageBufferSize() bytes on every call and only the
+// regions that changed may be updated. It waits at most TimeoutMs for a new frame. The other methods describe the frame last delivered.
+// After GetFrame returned DUPL_RETURN_ERROR_EXPECTED, Reset recreates whatever the transition
+// invalidated. Sources that cannot recover keep the default, which fails.
+//
+class FRAMESOURCE
+{
+	public:
+		virtual ~FRAMESOURCE() {}
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		virtual DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs) = 0;
+		virtual void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View) = 0;
+		virtual UINT GetImageBufferSize() = 0;
+		virtual const FRAME_METADATA* GetFrameMetaData() = 0;
+		virtual void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr) = 0;
+		virtual DUPL_RETURN Reset() { return DUPL_RETURN_ERROR_UNEXPECTED; }
+
+		// True if the last GetFrame set Timeout for a new frame a later call delivers, rather
+		// than for no new frame at all
+		virtual bool IsFramePending() { return false; }
+};
+
+class EVENTLOG;
 
 //
-// Handles the task of duplicating an output.
+// Handles the task of duplicating an output. The Direct3D calls go through a DUPLICATIONDEVICE,
+// a DXGIDUPLICATIONDEVICE unless the caller hands in its own.
 //
-class DUPLICATIONMANAGER
+class DUPLICATIONMANAGER : public FRAMESOURCE
 {
     public:
 		
 	//methods
-        DUPLICATIONMANAGER();
+        DUPLICATIONMANAGER(_In_opt_ DUPLICATIONDEVICE* Device = nullptr);
         ~DUPLICATIONMANAGER();
         _Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS) 
-		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData);
-        DUPL_RETURN InitDupl(_In_ FILE *log_file, UINT Output);
-		int GetImageHeight();
-		int GetImageWidth();
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs = FRAME_TIMEOUT_DEFAULT);
+        DUPL_RETURN InitDupl(_In_ FILE *log_file, UINT Output, _In_opt_ IDXGIAdapter* Adapter = nullptr);
+		DUPL_RETURN Reset();
 		int GetImagePitch();
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View);
+		UINT GetImageBufferSize();
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
+		const FRAME_METADATA* GetFrameMetaData();
+		bool IsFramePending();
+		void SetDirtyRectReadback(bool Enable);
+		void SetRectCoalescing(_In_opt_ const COALESCE_PARAMS* Params);
+		void SetPointerCompositing(bool Enable);
+		void SetCaptureRegions(_In_reads_(Count) const RECT* Regions, UINT Count);
+		void SetEventLog(_In_opt_ EVENTLOG* Log);
 	//vars
 
     private:
 
     // vars
-        IDXGIOutputDuplication* m_DeskDupl;
-        ID3D11Texture2D* m_AcquiredDesktopImage;
-		ID3D11Texture2D* m_DestImage;
+		DUPLICATIONDEVICE* m_Device;
+		bool m_OwnsDevice;              // Created by InitDupl, deleted with the manager
+		UINT m_RingHead;
+		UINT m_RingCount;
+		bool m_RingPrimed;
+		FRAME_METADATA m_RingMeta[STAGING_RING_SIZE];
+		bool m_DirtyRectReadback;
+		bool m_Coalesce;
+		COALESCE_PARAMS m_CoalesceParams;
+		POINTER_STATE m_Pointer;
+		POINTERCOMPOSITOR m_PointerCompositor;
+		bool m_DrawPointer;
+		FRAME_METADATA m_PointerMeta;   // Delivered for frames where only the pointer changed
+		RECT m_RegionRequest[CAPTURE_MAX_REGIONS];      // In desktop coordinates, laid out by InitDupl
+		UINT m_RegionRequestCount;
+		REGION_LAYOUT m_Regions;        // No regions when the whole output is captured
+		RECT* m_ClipRects;
+		UINT m_ClipRectsSize;
+		bool m_FullCopyNeeded;
+		bool m_FramePending;           // Last GetFrame queued a copy it did not read back yet
+		FRAME_METADATA* m_DeliveredMeta;
+		DXGI_FORMAT m_ImageFormat;
+		UINT m_TextureWidth;
+		UINT m_TextureHeight;
+		UINT m_ImageWidth;              // Of ImageData, the region image when capturing regions
+		UINT m_ImageHeight;
+		UINT m_StagingPitch;
         UINT m_OutputNumber;
         DXGI_OUTPUT_DESC m_OutputDesc;
-		DX_RESOURCES *m_DxRes;
+		IDXGIAdapter* m_Adapter;        // Given to InitDupl, Reset creates the device on it again
 		FILE *m_log_file;
+		EVENTLOG* m_EventLog;           // Errors are written to m_log_file right away without one
 		int m_ImagePitch;
 
 	//methods
-		DUPL_RETURN InitializeDx();
+		DUPL_RETURN InitializeDx(_In_opt_ IDXGIAdapter* Adapter);
+		DUPL_RETURN CreateDuplication(_Out_ bool* ModeChanged);
+		DUPL_RETURN CreateStagingRing();
+		void ReleaseDuplication();
+		void ReleaseStagingRing();
+		void ReleaseDx();
+		void ResetRing();
+		// Str has to be a string literal, the event log formats it on its own thread long after the call
 		_Post_satisfies_(return != DUPL_RETURN_SUCCESS)
-		DUPL_RETURN ProcessFailure(_In_opt_ ID3D11Device* Device, _In_ LPCWSTR Str, HRESULT hr, _In_opt_z_ HRESULT* ExpectedErrors = nullptr);
-		void DisplayMsg(_In_ LPCWSTR Str, HRESULT hr);
-		void CopyImage(BYTE* ImageData);
-		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
+		DUPL_RETURN ProcessFailure(_In_opt_ DUPLICATIONDEVICE* Device, _In_z_ LPCWSTR Str, HRESULT hr, _In_opt_z_ HRESULT* ExpectedErrors = nullptr);
+		void DisplayMsg(_In_z_ LPCWSTR Str, HRESULT hr);
+		DUPL_RETURN QueueCopy(_In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo, LARGE_INTEGER AcquireTime, _Out_ bool* Skipped);
+		DUPL_RETURN GetMetaData(_In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo, _Inout_ FRAME_METADATA* Meta);
+		void ClipToRegions(_Inout_ FRAME_METADATA* Meta);
+		DUPL_RETURN UpdatePointer(_In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo);
+		bool DrawPointer(_Inout_ BYTE* ImageData, _Out_ RECT* Rect);
+		void AddPointerRects(_Inout_ FRAME_METADATA* Meta, _In_reads_(Count) const RECT* Rects, UINT Count);
+		DUPL_RETURN DeliverPointerFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, LARGE_INTEGER AcquireTime);
+		DUPL_RETURN CopyImage(_Inout_ BYTE* ImageData, _Out_ bool* Timeout);
 		DUPL_RETURN DoneWithFrame();
 
 };
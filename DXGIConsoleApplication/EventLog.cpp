@@ -0,0 +1,483 @@
+// EventLog.cpp : Per thread rings of binary log events, formatted on a writer thread.
+//
+
+#include "EventLog.h"
+
+// Longest message an event is formatted into, longer ones are cut
+#define EVENTLOG_LINE_SIZE      512
+
+#define EVENTLOG_RING_MASK      (EVENTLOG_RING_EVENTS - 1)
+
+// Ring of the calling thread in the log it last wrote to
+static __declspec(thread) LONG t_LogId;
+static __declspec(thread) LOG_RING* t_Ring;
+
+static volatile LONG s_NextLogId;
+
+//
+// Format Event->Format into Line. Every conversion takes the next argument as the type its
+// length and conversion character call for, there is no varargs list to get wrong.
+//
+static void FormatEvent(_Out_writes_z_(Size) char* Line, UINT Size, _In_ const LOG_EVENT* Event)
+{
+	UINT Used = 0;
+	UINT Arg = 0;
+	const char* Format = Event->Format;
+	while (*Format && Used + 1 < Size)
+	{
+		if (*Format != '%')
+		{
+			Line[Used++] = *Format++;
+			continue;
+		}
+
+		// Flags, width, precision and length are kept, the value is passed as one argument
+		char Spec[32];
+		UINT SpecLength = 0;
+		Spec[SpecLength++] = *Format++;
+		while (*Format && !strchr("diouxXcfeEgGsp%", *Format) && SpecLength < sizeof(Spec) - 2)
+		{
+			Spec[SpecLength++] = *Format++;
+		}
+		if (!*Format)
+		{
+			break;
+		}
+		char Conversion = *Format++;
+		Spec[SpecLength++] = Conversion;
+		Spec[SpecLength] = '\0';
+		if (Conversion == '%')
+		{
+			Line[Used++] = '%';
+			continue;
+		}
+
+		UINT64 Value = (Arg < EVENTLOG_MAX_ARGS) ? Event->Args[Arg++] : 0;
+		bool LongLong = (strstr(Spec, "ll") || strstr(Spec, "I64"));
+		bool Long = !LongLong && strchr(Spec, 'l');
+		char* Out = Line + Used;
+		size_t Left = Size - Used;
+		int Written;
+		switch (Conversion)
+		{
+			case 'd':
+			case 'i':
+			{
+				Written = LongLong ? _snprintf_s(Out, Left, _TRUNCATE, Spec, static_cast<LONGLONG>(Value)) :
+					Long ? _snprintf_s(Out, Left, _TRUNCATE, Spec, static_cast<long>(Value)) :
+					_snprintf_s(Out, Left, _TRUNCATE, Spec, static_cast<int>(Value));
+				break;
+			}
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'c':
+			{
+				Written = LongLong ? _snprintf_s(Out, Left, _TRUNCATE, Spec, static_cast<ULONGLONG>(Value)) :
+					Long ? _snprintf_s(Out, Left, _TRUNCATE, Spec, static_cast<unsigned long>(Value)) :
+					_snprintf_s(Out, Left, _TRUNCATE, Spec, static_cast<unsigned int>(Value));
+				break;
+			}
+			case 'f':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			{
+				double Double;
+				memcpy(&Double, &Value, sizeof(Double));
+				Written = _snprintf_s(Out, Left, _TRUNCATE, Spec, Double);
+				break;
+			}
+			case 's':
+			{
+				// %ls is a wide string, like DisplayMsg's messages
+				const void* String = reinterpret_cast<const void*>(static_cast<UINT_PTR>(Value));
+				if (!String)
+				{
+					Written = _snprintf_s(Out, Left, _TRUNCATE, "(null)");
+				}
+				else if (Long)
+				{
+					Written = _snprintf_s(Out, Left, _TRUNCATE, Spec, reinterpret_cast<const wchar_t*>(String));
+				}
+				else
+				{
+					Written = _snprintf_s(Out, Left, _TRUNCATE, Spec, reinterpret_cast<const char*>(String));
+				}
+				break;
+			}
+			default:
+			{
+				Written = _snprintf_s(Out, Left, _TRUNCATE, Spec, reinterpret_cast<const void*>(static_cast<UINT_PTR>(Value)));
+				break;
+			}
+		}
+		if (Written < 0 || static_cast<size_t>(Written) >= Left)
+		{
+			Used = Size - 1;
+			break;
+		}
+		Used += Written;
+	}
+
+	Line[Used] = '\0';
+}
+
+EVENTLOG::EVENTLOG() : m_log_file(nullptr),
+					   m_Rings(nullptr),
+					   m_StartTime(0),
+					   m_LockInitialized(false),
+					   m_WakeEvent(nullptr),
+					   m_Stopping(0),
+					   m_Thread(nullptr),
+					   m_Written(0)
+{
+	m_Id = InterlockedIncrement(&s_NextLogId);
+
+	// Write can rate limit before Init
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+	m_Frequency = Frequency.QuadPart;
+	m_RateWindowTicks = m_Frequency * EVENTLOG_RATE_WINDOW_MS / 1000;
+}
+
+EVENTLOG::~EVENTLOG()
+{
+	Stop();
+
+	LOG_RING* Ring = m_Rings;
+	while (Ring)
+	{
+		LOG_RING* Next = Ring->Next;
+		delete Ring;
+		Ring = Next;
+	}
+	m_Rings = nullptr;
+
+	if (m_WakeEvent)
+	{
+		CloseHandle(m_WakeEvent);
+		m_WakeEvent = nullptr;
+	}
+	if (m_LockInitialized)
+	{
+		DeleteCriticalSection(&m_DrainLock);
+		m_LockInitialized = false;
+	}
+}
+
+//
+// Start the writer thread, event times in the log are from now
+//
+DUPL_RETURN EVENTLOG::Init(_In_ FILE *log_file)
+{
+	m_log_file = log_file;
+
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+	m_StartTime = Now.QuadPart;
+
+	if (!m_LockInitialized)
+	{
+		InitializeCriticalSection(&m_DrainLock);
+		m_LockInitialized = true;
+	}
+
+	m_WakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (!m_WakeEvent)
+	{
+		fprintf_s(m_log_file, "Failed to create the event log wake event with error %u.\n", GetLastError());
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	m_Thread = CreateThread(nullptr, 0, WriterProc, this, 0, nullptr);
+	if (!m_Thread)
+	{
+		fprintf_s(m_log_file, "Failed to create the event log thread with error %u.\n", GetLastError());
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Ring of the calling thread, created the first time the thread logs
+//
+LOG_RING* EVENTLOG::GetRing()
+{
+	if (t_LogId == m_Id)
+	{
+		return t_Ring;
+	}
+
+	// The thread switched logs or logs for the first time
+	DWORD ThreadId = GetCurrentThreadId();
+	LOG_RING* Ring = reinterpret_cast<LOG_RING*>(ReadPointerAcquire(reinterpret_cast<void* const volatile*>(&m_Rings)));
+	while (Ring && Ring->ThreadId != ThreadId)
+	{
+		Ring = Ring->Next;
+	}
+
+	if (!Ring)
+	{
+		Ring = new (std::nothrow) LOG_RING;
+		if (!Ring)
+		{
+			return nullptr;
+		}
+		RtlZeroMemory(Ring, sizeof(LOG_RING));
+		Ring->ThreadId = ThreadId;
+
+		LOG_RING* Head;
+		do
+		{
+			Head = m_Rings;
+			Ring->Next = Head;
+		} while (InterlockedCompareExchangePointer(reinterpret_cast<void* volatile*>(&m_Rings), Ring, Head) != Head);
+	}
+
+	t_LogId = m_Id;
+	t_Ring = Ring;
+
+	return Ring;
+}
+
+//
+// Log an event. Format is not copied and has to outlive the log, a string literal.
+//
+void EVENTLOG::Write(_In_z_ const char* Format, HRESULT Hr, UINT64 Arg0, UINT64 Arg1, UINT64 Arg2, UINT64 Arg3)
+{
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+
+	LOG_RING* Ring = GetRing();
+	if (!Ring)
+	{
+		return;
+	}
+
+	// Repeats beyond the burst of their window are only counted
+	LOG_RATE* Rate = &Ring->Rates[((reinterpret_cast<UINT_PTR>(Format) >> 4) ^ static_cast<UINT>(Hr) ^ static_cast<UINT>(Arg0)) & (EVENTLOG_RATE_ENTRIES - 1)];
+	bool Repeat = (Rate->Format == Format && Rate->Hr == Hr && Rate->Arg == Arg0);
+	if (!Repeat)
+	{
+		// The writer thread reports what the previous event of the entry still had dropped
+		if (ReadNoFence(&Rate->Suppressed))
+		{
+			WriteRelease(&Ring->Evicted, Ring->Evicted + InterlockedExchange(&Rate->Suppressed, 0));
+		}
+		WritePointerRelease(&Rate->Format, const_cast<char*>(Format));
+		Rate->Hr = Hr;
+		Rate->Arg = Arg0;
+	}
+	if (!Repeat || Now.QuadPart - Rate->WindowStart >= m_RateWindowTicks)
+	{
+		WriteRelease64(&Rate->WindowStart, Now.QuadPart);
+		Rate->Count = 0;
+	}
+	if (Rate->Count >= EVENTLOG_RATE_BURST)
+	{
+		InterlockedIncrement(&Rate->Suppressed);
+		WriteRelease(&Ring->Suppressed, Ring->Suppressed + 1);
+		return;
+	}
+	++Rate->Count;
+
+	LONG Head = Ring->Head;
+	LONG Waiting = Head - ReadAcquire(&Ring->Tail);
+	if (Waiting >= EVENTLOG_RING_EVENTS)
+	{
+		WriteRelease(&Ring->Dropped, Ring->Dropped + 1);
+		return;
+	}
+
+	LOG_EVENT* Event = &Ring->Events[Head & EVENTLOG_RING_MASK];
+	Event->Time = Now;
+	Event->Format = Format;
+	Event->Hr = Hr;
+	Event->Suppressed = ReadNoFence(&Rate->Suppressed) ? InterlockedExchange(&Rate->Suppressed, 0) : 0;
+	Event->ThreadId = Ring->ThreadId;
+	Event->Args[0] = Arg0;
+	Event->Args[1] = Arg1;
+	Event->Args[2] = Arg2;
+	Event->Args[3] = Arg3;
+
+	WriteRelease(&Ring->Head, Head + 1);
+
+	// A burst would fill the ring before the writer thread's next round
+	if (Waiting == EVENTLOG_RING_EVENTS / 2 && m_WakeEvent)
+	{
+		SetEvent(m_WakeEvent);
+	}
+}
+
+void EVENTLOG::WriteEvent(_In_ const LOG_EVENT* Event)
+{
+	char Message[EVENTLOG_LINE_SIZE];
+	FormatEvent(Message, sizeof(Message), Event);
+
+	fprintf_s(m_log_file, "%10.3f [%u] %s", (Event->Time.QuadPart - m_StartTime) * 1000.0 / m_Frequency, Event->ThreadId, Message);
+	if (FAILED(Event->Hr))
+	{
+		fprintf_s(m_log_file, " with 0x%X.", Event->Hr);
+	}
+	if (Event->Suppressed)
+	{
+		fprintf_s(m_log_file, " (%u repeats not logged)", Event->Suppressed);
+	}
+	fprintf_s(m_log_file, "\n");
+
+	++m_Written;
+}
+
+//
+// Format every waiting event, oldest first across all threads, and report the repeats the rate limit
+// dropped that no logged event reported. Those of a window still running are left to the next repeat
+// unless this is the final round.
+//
+void EVENTLOG::Drain(bool Final)
+{
+	if (!m_LockInitialized || !m_log_file)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&m_DrainLock);
+
+	UINT64 Written = m_Written;
+	bool Lost = false;
+	LOG_RING* Rings;
+	for (;;)
+	{
+		// Threads that start logging meanwhile may have older events than the ones still waiting
+		Rings = reinterpret_cast<LOG_RING*>(ReadPointerAcquire(reinterpret_cast<void* const volatile*>(&m_Rings)));
+		LOG_RING* Oldest = nullptr;
+		for (LOG_RING* Ring = Rings; Ring; Ring = Ring->Next)
+		{
+			if (ReadAcquire(&Ring->Head) == Ring->Tail)
+			{
+				continue;
+			}
+			if (!Oldest || Ring->Events[Ring->Tail & EVENTLOG_RING_MASK].Time.QuadPart < Oldest->Events[Oldest->Tail & EVENTLOG_RING_MASK].Time.QuadPart)
+			{
+				Oldest = Ring;
+			}
+		}
+		if (!Oldest)
+		{
+			break;
+		}
+
+		WriteEvent(&Oldest->Events[Oldest->Tail & EVENTLOG_RING_MASK]);
+		WriteRelease(&Oldest->Tail, Oldest->Tail + 1);
+	}
+
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+	for (LOG_RING* Ring = Rings; Ring; Ring = Ring->Next)
+	{
+		LONG Dropped = ReadAcquire(&Ring->Dropped);
+		if (Dropped != Ring->ReportedDropped)
+		{
+			fprintf_s(m_log_file, "%u events of thread %u were lost, its log ring was full.\n", Dropped - Ring->ReportedDropped, Ring->ThreadId);
+			Ring->ReportedDropped = Dropped;
+			Lost = true;
+		}
+
+		// The logging thread takes the count back if it logs a repeat first, so each is reported once
+		LONG Evicted = ReadAcquire(&Ring->Evicted);
+		UINT Unnamed = Evicted - Ring->ReportedEvicted;
+		Ring->ReportedEvicted = Evicted;
+		for (UINT Entry = 0; Entry < EVENTLOG_RATE_ENTRIES; ++Entry)
+		{
+			LOG_RATE* Rate = &Ring->Rates[Entry];
+			if (!ReadNoFence(&Rate->Suppressed) || (!Final && Now.QuadPart - ReadNoFence64(&Rate->WindowStart) < m_RateWindowTicks))
+			{
+				continue;
+			}
+
+			const char* Format = reinterpret_cast<const char*>(ReadPointerAcquire(&Rate->Format));
+			LONG Suppressed = InterlockedExchange(&Rate->Suppressed, 0);
+			if (Suppressed && ReadPointerAcquire(&Rate->Format) == Format)
+			{
+				fprintf_s(m_log_file, "%u repeats of \"%s\" of thread %u were not logged.\n", Suppressed, Format, Ring->ThreadId);
+				Lost = true;
+			}
+			else
+			{
+				// The entry went to another event meanwhile
+				Unnamed += Suppressed;
+			}
+		}
+		if (Unnamed)
+		{
+			fprintf_s(m_log_file, "%u repeats of earlier events of thread %u were not logged.\n", Unnamed, Ring->ThreadId);
+			Lost = true;
+		}
+	}
+
+	if (Written != m_Written || Lost)
+	{
+		fflush(m_log_file);
+	}
+
+	LeaveCriticalSection(&m_DrainLock);
+}
+
+//
+// Format what was logged so far right away, for example before writing to the log file directly
+//
+void EVENTLOG::Flush()
+{
+	Drain(false);
+}
+
+DWORD WINAPI EVENTLOG::WriterProc(_In_ void* Param)
+{
+	EVENTLOG* Log = reinterpret_cast<EVENTLOG*>(Param);
+
+	while (!ReadAcquire(&Log->m_Stopping))
+	{
+		WaitForSingleObject(Log->m_WakeEvent, EVENTLOG_FLUSH_INTERVAL_MS);
+		Log->Drain(false);
+	}
+
+	return 0;
+}
+
+//
+// Stop the writer thread after it formatted everything logged so far
+//
+void EVENTLOG::Stop()
+{
+	if (m_Thread)
+	{
+		WriteRelease(&m_Stopping, 1);
+		SetEvent(m_WakeEvent);
+		WaitForSingleObject(m_Thread, INFINITE);
+		CloseHandle(m_Thread);
+		m_Thread = nullptr;
+	}
+
+	Drain(true);
+}
+
+void EVENTLOG::GetStats(_Out_ EVENTLOG_STATS* Stats)
+{
+	RtlZeroMemory(Stats, sizeof(EVENTLOG_STATS));
+	for (LOG_RING* Ring = reinterpret_cast<LOG_RING*>(ReadPointerAcquire(reinterpret_cast<void* const volatile*>(&m_Rings))); Ring; Ring = Ring->Next)
+	{
+		Stats->Dropped += ReadAcquire(&Ring->Dropped);
+		Stats->Suppressed += ReadAcquire(&Ring->Suppressed);
+		++Stats->Threads;
+	}
+
+	if (m_LockInitialized)
+	{
+		EnterCriticalSection(&m_DrainLock);
+		Stats->Written = m_Written;
+		LeaveCriticalSection(&m_DrainLock);
+	}
+}
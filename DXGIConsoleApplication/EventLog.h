@@ -0,0 +1,138 @@
+// EventLog.h : Low overhead logging for the capture threads. A call only stores a fixed size
+// binary event in a ring of the calling thread, a background thread formats the events and
+// writes them to the log file.
+//
+
+#ifndef _EVENTLOG_H_
+#define _EVENTLOG_H_
+
+#include "DuplicationManager.h"
+
+// Arguments an event carries
+#define EVENTLOG_MAX_ARGS           4
+
+// Events each thread can have waiting to be written, a power of two
+#define EVENTLOG_RING_EVENTS        256
+
+// Repeats of an event a thread logs per window, further ones are only counted
+#define EVENTLOG_RATE_BURST         4
+#define EVENTLOG_RATE_WINDOW_MS     1000
+
+// Events whose rate each thread tracks at once, a power of two
+#define EVENTLOG_RATE_ENTRIES       16
+
+// The writer thread formats what was logged at least this often, and right away once a ring
+// is half full
+#define EVENTLOG_FLUSH_INTERVAL_MS  50
+
+//
+// One call to EVENTLOG::Write, 64 bytes on x64
+//
+typedef struct _LOG_EVENT
+{
+	LARGE_INTEGER Time;             // QueryPerformanceCounter ticks of the call
+	const char* Format;             // Only the pointer is stored, so it must outlive the log
+	HRESULT Hr;                     // Appended to the message if it is a failure
+	UINT Suppressed;                // Repeats of the event the rate limit dropped before this one
+	DWORD ThreadId;
+	UINT64 Args[EVENTLOG_MAX_ARGS];
+} LOG_EVENT;
+
+//
+// Rate limit state of one event, owned by the logging thread. The writer thread reads Format and
+// WindowStart and takes Suppressed once the window is over.
+//
+typedef struct _LOG_RATE
+{
+	PVOID volatile Format;          // Format of the event, a const char*
+	HRESULT Hr;
+	UINT64 Arg;
+	volatile LONGLONG WindowStart;
+	UINT Count;                     // Events logged in the window
+	volatile LONG Suppressed;       // Events dropped and not reported yet
+} LOG_RATE;
+
+//
+// Events of one thread. The thread moves Head, the writer thread moves Tail.
+//
+typedef struct _LOG_RING
+{
+	volatile LONG Head;
+	BYTE HeadPadding[64 - sizeof(LONG)];
+	volatile LONG Tail;
+	BYTE TailPadding[64 - sizeof(LONG)];
+	DWORD ThreadId;
+	volatile LONG Dropped;          // Events lost because the ring was full
+	volatile LONG Suppressed;       // Events dropped by the rate limit
+	volatile LONG Evicted;          // Of those, the ones whose rate entry another event took over
+	LONG ReportedDropped;           // Writer thread's own
+	LONG ReportedEvicted;
+	LOG_RATE Rates[EVENTLOG_RATE_ENTRIES];
+	struct _LOG_RING* Next;
+	LOG_EVENT Events[EVENTLOG_RING_EVENTS];
+} LOG_RING;
+
+typedef struct _EVENTLOG_STATS
+{
+	UINT64 Written;                 // Events formatted into the log file
+	UINT64 Dropped;
+	UINT64 Suppressed;
+	UINT Threads;                   // Threads that logged
+} EVENTLOG_STATS;
+
+//
+// Write never blocks, allocates only the first time a thread logs and never touches the file,
+// its only system call wakes the writer thread when the ring of the thread fills up.
+// Events are written in timestamp order across threads, as "<ms since Init> [<thread>] <message>",
+// where the message is Format printf formatted with Args and " with 0x<Hr>." for failures.
+// A repeat, an event with the same format, HRESULT and first argument, is only logged
+// EVENTLOG_RATE_BURST times per window, so put what identifies an event first and counters after it.
+// The next repeat logged carries the count of the ones dropped before it, the writer thread reports
+// the count itself once the window is over without one, or the entry went to another event.
+// A ring that is full drops the newest events and the loss is logged once there is room.
+//
+class EVENTLOG
+{
+	public:
+		EVENTLOG();
+		~EVENTLOG();
+		DUPL_RETURN Init(_In_ FILE *log_file);
+		void Write(_In_z_ const char* Format, HRESULT Hr = S_OK, UINT64 Arg0 = 0, UINT64 Arg1 = 0, UINT64 Arg2 = 0, UINT64 Arg3 = 0);
+		void Flush();
+		void Stop();
+		void GetStats(_Out_ EVENTLOG_STATS* Stats);
+
+	private:
+		FILE *m_log_file;
+		LONG m_Id;                      // Tells the thread's cached ring apart from one of another log
+		LOG_RING* volatile m_Rings;     // Pushed by every thread the first time it logs
+		LONGLONG m_StartTime;
+		LONGLONG m_Frequency;
+		LONGLONG m_RateWindowTicks;
+		CRITICAL_SECTION m_DrainLock;   // Serializes the writer thread and Flush, never taken by Write
+		bool m_LockInitialized;
+		HANDLE m_WakeEvent;
+		volatile LONG m_Stopping;
+		HANDLE m_Thread;
+		UINT64 m_Written;
+
+		LOG_RING* GetRing();
+		void Drain(bool Final);
+		void WriteEvent(_In_ const LOG_EVENT* Event);
+		static DWORD WINAPI WriterProc(_In_ void* Param);
+};
+
+// Arguments that are not integers go into an event through these
+inline UINT64 LogArg(_In_opt_ const void* Pointer)
+{
+	return reinterpret_cast<UINT_PTR>(Pointer);
+}
+
+inline UINT64 LogArg(double Value)
+{
+	UINT64 Bits;
+	memcpy(&Bits, &Value, sizeof(Bits));
+	return Bits;
+}
+
+#endif
@@ -0,0 +1,143 @@
+// FrameHash.cpp : Cheap change detection for captured frames.
+//
+
+#include "FrameHash.h"
+
+#define HASH_PRIME  0x9E3779B97F4A7C15ULL
+
+static inline UINT64 MixLane(UINT64 Lane, UINT64 Word)
+{
+	Lane = (Lane ^ Word) * HASH_PRIME;
+	return Lane ^ (Lane >> 29);
+}
+
+UINT64 HashBytes(_In_reads_bytes_(Bytes) const BYTE* Data, UINT Bytes)
+{
+	UINT64 Lane[4] = { 1, 2, 3, 4 };
+	UINT Offset = 0;
+
+	for (; Offset + 32 <= Bytes; Offset += 32)
+	{
+		UINT64 Words[4];
+		memcpy(Words, Data + Offset, sizeof(Words));
+		Lane[0] = MixLane(Lane[0], Words[0]);
+		Lane[1] = MixLane(Lane[1], Words[1]);
+		Lane[2] = MixLane(Lane[2], Words[2]);
+		Lane[3] = MixLane(Lane[3], Words[3]);
+	}
+
+	for (; Offset + 8 <= Bytes; Offset += 8)
+	{
+		UINT64 Word;
+		memcpy(&Word, Data + Offset, sizeof(Word));
+		Lane[0] = MixLane(Lane[0], Word);
+	}
+
+	if (Offset < Bytes)
+	{
+		UINT64 Word = 0;
+		memcpy(&Word, Data + Offset, Bytes - Offset);
+		Lane[1] = MixLane(Lane[1], Word);
+	}
+
+	UINT64 Hash = MixLane(Lane[0], Bytes);
+	Hash = MixLane(Hash, Lane[1]);
+	Hash = MixLane(Hash, Lane[2]);
+	return MixLane(Hash, Lane[3]);
+}
+
+FRAMEHASH::FRAMEHASH() : m_RowHashes(nullptr),
+						 m_Rows(0),
+						 m_Width(0),
+						 m_Valid(false)
+{
+}
+
+FRAMEHASH::~FRAMEHASH()
+{
+	if (m_RowHashes)
+	{
+		delete [] m_RowHashes;
+		m_RowHashes = nullptr;
+	}
+}
+
+//
+// Hash the rows of the image that Meta reports as changed, or every row without usable rects,
+// ignoring the padding past Width pixels. Returns true if the image differs from the one passed
+// to the previous call.
+//
+bool FRAMEHASH::Update(_In_ const BYTE* Image, UINT Pitch, UINT Width, UINT Height, _In_opt_ const FRAME_METADATA* Meta)
+{
+	if (Height != m_Rows || Width != m_Width)
+	{
+		if (m_RowHashes)
+		{
+			delete [] m_RowHashes;
+			m_RowHashes = nullptr;
+		}
+		m_RowHashes = new (std::nothrow) UINT64[Height];
+		m_Rows = m_RowHashes ? Height : 0;
+		m_Width = Width;
+		m_Valid = false;
+		if (!m_RowHashes)
+		{
+			// Can't tell, treat it as changed
+			return true;
+		}
+	}
+
+	if (!m_Valid || !Meta || Meta->FullCopy)
+	{
+		// The first frame is always new, whatever the stale hashes happen to hold
+		bool Changed = UpdateRows(Image, Pitch, Width, 0, Height) || !m_Valid;
+		m_Valid = true;
+		return Changed;
+	}
+
+	// The image already has the moves applied, their destinations are just more changed pixels
+	const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+	const RECT* DirtyRects = reinterpret_cast<const RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+	bool Changed = false;
+	for (UINT i = 0; i < Meta->MoveCount + Meta->DirtyCount; ++i)
+	{
+		const RECT* Rect = (i < Meta->MoveCount) ? &MoveRects[i].DestinationRect : &DirtyRects[i - Meta->MoveCount];
+		UINT Top = static_cast<UINT>(max(Rect->top, 0L));
+		UINT Bottom = static_cast<UINT>(max(min(Rect->bottom, static_cast<LONG>(Height)), 0L));
+		if (UpdateRows(Image, Pitch, Width, Top, Bottom))
+		{
+			Changed = true;
+		}
+	}
+
+	return Changed;
+}
+
+//
+// Hash rows Top up to Bottom and store the hashes. Returns true if any of them changed.
+//
+bool FRAMEHASH::UpdateRows(_In_ const BYTE* Image, UINT Pitch, UINT Width, UINT Top, UINT Bottom)
+{
+	bool Changed = false;
+
+	Image += static_cast<size_t>(Top) * Pitch;
+	for (UINT y = Top; y < Bottom; ++y, Image += Pitch)
+	{
+		UINT64 Hash = HashBytes(Image, Width * BPP);
+		if (Hash != m_RowHashes[y])
+		{
+			m_RowHashes[y] = Hash;
+			Changed = true;
+		}
+	}
+
+	return Changed;
+}
+
+//
+// Forget the previous frame so the next Update reports a change
+//
+void FRAMEHASH::Reset()
+{
+	m_Valid = false;
+}
@@ -0,0 +1,37 @@
+// FrameHash.h : Per row content hashes used to detect frames whose pixels did not change.
+//
+
+#ifndef _FRAMEHASH_H_
+#define _FRAMEHASH_H_
+
+#include "DuplicationManager.h"
+
+//
+// 64 bit hash of Bytes bytes. Four independent lanes are mixed so the loop vectorizes
+// and is not bound by the latency of a single multiply chain.
+//
+UINT64 HashBytes(_In_reads_bytes_(Bytes) const BYTE* Data, UINT Bytes);
+
+//
+// Remembers the row hashes of the last frame it saw. Given the frame's metadata only the rows
+// under its move and dirty rects are hashed again, the other rows can't have changed.
+//
+class FRAMEHASH
+{
+	public:
+		FRAMEHASH();
+		~FRAMEHASH();
+		bool Update(_In_ const BYTE* Image, UINT Pitch, UINT Width, UINT Height, _In_opt_ const FRAME_METADATA* Meta = nullptr);
+		void Reset();
+
+	private:
+		UINT64* m_RowHashes;
+		UINT m_Rows;
+		UINT m_Width;
+		bool m_Valid;
+
+	//methods
+		bool UpdateRows(_In_ const BYTE* Image, UINT Pitch, UINT Width, UINT Top, UINT Bottom);
+};
+
+#endif
@@ -0,0 +1,148 @@
+// FramePacer.cpp : Deadline based frame pacing.
+//
+
+#include "FramePacer.h"
+
+// Sleep is only accurate to a scheduler quantum, the rest of a wait is spun
+#define FRAMEPACER_SPIN_MS  2
+
+SYSTEMCLOCK::SYSTEMCLOCK()
+{
+	QueryPerformanceFrequency(&m_Frequency);
+}
+
+UINT64 SYSTEMCLOCK::GetTicks()
+{
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+	return Now.QuadPart;
+}
+
+UINT64 SYSTEMCLOCK::GetFrequency()
+{
+	return m_Frequency.QuadPart;
+}
+
+void SYSTEMCLOCK::WaitUntil(UINT64 Ticks)
+{
+	UINT64 Now = GetTicks();
+	while (Now < Ticks)
+	{
+		UINT64 RemainingMs = (Ticks - Now) * 1000 / m_Frequency.QuadPart;
+		if (RemainingMs > FRAMEPACER_SPIN_MS)
+		{
+			Sleep(static_cast<DWORD>(RemainingMs - FRAMEPACER_SPIN_MS));
+		}
+		else
+		{
+			YieldProcessor();
+		}
+		Now = GetTicks();
+	}
+}
+
+FRAMEPACER::FRAMEPACER() : m_Clock(nullptr),
+						   m_Period(0),
+						   m_Deadline(0),
+						   m_Started(false)
+{
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+FRAMEPACER::~FRAMEPACER()
+{
+}
+
+//
+// Pace to FramesPerSecond using Clock, or QueryPerformanceCounter without one.
+// A rate of 0 disables pacing, every frame uses the default timeout and goes out right away.
+//
+void FRAMEPACER::Init(UINT FramesPerSecond, _In_opt_ FRAMECLOCK* Clock)
+{
+	m_Clock = Clock ? Clock : &m_SystemClock;
+	m_Period = FramesPerSecond ? m_Clock->GetFrequency() / FramesPerSecond : 0;
+	m_Started = false;
+
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_Stats.Frequency = m_Clock->GetFrequency();
+}
+
+//
+// Returns how long GetFrame may wait for a new frame before the next deadline is due
+//
+UINT FRAMEPACER::BeginFrame()
+{
+	if (!m_Period)
+	{
+		return FRAME_TIMEOUT_DEFAULT;
+	}
+
+	UINT64 Now = m_Clock->GetTicks();
+	if (!m_Started)
+	{
+		// First frame is due one period from now
+		m_Deadline = Now + m_Period;
+		m_Started = true;
+	}
+
+	if (Now >= m_Deadline)
+	{
+		return 0;
+	}
+
+	return static_cast<UINT>((m_Deadline - Now) * 1000 / m_Stats.Frequency);
+}
+
+//
+// Wait for the current deadline and account for the frame emitted at it, a repeat of the
+// previous one unless NewFrame. Returns the number of deadlines that were missed because
+// the frame came too late, those are skipped rather than emitted in a burst.
+//
+UINT FRAMEPACER::EndFrame(bool NewFrame)
+{
+	++m_Stats.Frames;
+	if (NewFrame)
+	{
+		++m_Stats.NewFrames;
+	}
+	else
+	{
+		++m_Stats.Repeats;
+	}
+
+	if (!m_Period)
+	{
+		return 0;
+	}
+
+	m_Clock->WaitUntil(m_Deadline);
+
+	UINT64 Now = m_Clock->GetTicks();
+	UINT64 Jitter = Now - m_Deadline;
+	m_Stats.TotalJitterTicks += Jitter;
+	if (Jitter > m_Stats.MaxJitterTicks)
+	{
+		m_Stats.MaxJitterTicks = Jitter;
+	}
+
+	// Keep the schedule anchored to the first deadline so lateness doesn't accumulate
+	UINT Missed = static_cast<UINT>(Jitter / m_Period);
+	m_Stats.MissedDeadlines += Missed;
+	m_Deadline += (Missed + 1) * m_Period;
+
+	return Missed;
+}
+
+//
+// Start the schedule over one period after the next BeginFrame, after a stall such as a mode
+// change that would otherwise count as deadlines missed. The counters keep going.
+//
+void FRAMEPACER::Restart()
+{
+	m_Started = false;
+}
+
+void FRAMEPACER::GetStats(_Out_ FRAMEPACER_STATS* Stats)
+{
+	*Stats = m_Stats;
+}
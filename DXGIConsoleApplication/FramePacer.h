@@ -0,0 +1,76 @@
+// FramePacer.h : Paces the capture loop to a target frame rate by turning frame
+// deadlines into GetFrame timeouts.
+//
+
+#ifndef _FRAMEPACER_H_
+#define _FRAMEPACER_H_
+
+#include "DuplicationManager.h"
+
+//
+// Time source of the pacer, so pacing can be driven by a simulated clock.
+// Ticks are in units of GetFrequency() per second.
+//
+class FRAMECLOCK
+{
+	public:
+		virtual ~FRAMECLOCK() {}
+		virtual UINT64 GetTicks() = 0;
+		virtual UINT64 GetFrequency() = 0;
+		virtual void WaitUntil(UINT64 Ticks) = 0;
+};
+
+//
+// QueryPerformanceCounter clock
+//
+class SYSTEMCLOCK : public FRAMECLOCK
+{
+	public:
+		SYSTEMCLOCK();
+		UINT64 GetTicks();
+		UINT64 GetFrequency();
+		void WaitUntil(UINT64 Ticks);
+
+	private:
+		LARGE_INTEGER m_Frequency;
+};
+
+//
+// Counters of the pacer. Tick values are in the pacer clock's ticks.
+//
+typedef struct _FRAMEPACER_STATS
+{
+	UINT Frames;                // Deadlines met or missed, one frame emitted for each
+	UINT NewFrames;
+	UINT Repeats;               // Deadlines where the previous frame was emitted again
+	UINT MissedDeadlines;       // Deadlines skipped because a frame took longer than a period
+	UINT64 TotalJitterTicks;    // How late frames were emitted relative to their deadline
+	UINT64 MaxJitterTicks;
+	UINT64 Frequency;
+} FRAMEPACER_STATS;
+
+//
+// Call BeginFrame, pass its timeout to FRAMESOURCE::GetFrame, then call EndFrame which
+// waits for the deadline so frames leave at a steady rate.
+//
+class FRAMEPACER
+{
+	public:
+		FRAMEPACER();
+		~FRAMEPACER();
+		void Init(UINT FramesPerSecond, _In_opt_ FRAMECLOCK* Clock = nullptr);
+		UINT BeginFrame();
+		UINT EndFrame(bool NewFrame);
+		void Restart();
+		void GetStats(_Out_ FRAMEPACER_STATS* Stats);
+
+	private:
+		FRAMECLOCK* m_Clock;
+		SYSTEMCLOCK m_SystemClock;
+		UINT64 m_Period;
+		UINT64 m_Deadline;
+		bool m_Started;
+		FRAMEPACER_STATS m_Stats;
+};
+
+#endif
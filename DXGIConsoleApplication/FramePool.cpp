@@ -0,0 +1,291 @@
+// FramePool.cpp : Reference counted frame buffer pool.
+//
+
+#include "FramePool.h"
+#include <malloc.h>
+
+//
+// Large page allocations need SeLockMemoryPrivilege enabled on the process token
+//
+static bool EnableLockMemoryPrivilege()
+{
+	HANDLE Token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &Token))
+	{
+		return false;
+	}
+
+	TOKEN_PRIVILEGES Privileges;
+	Privileges.PrivilegeCount = 1;
+	Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool Enabled = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &Privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(Token, FALSE, &Privileges, 0, nullptr, nullptr) &&
+		GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(Token);
+	return Enabled;
+}
+
+FRAMEPOOL::FRAMEPOOL() : m_log_file(nullptr),
+						 m_LockInitialized(false),
+						 m_FreeList(nullptr),
+						 m_BufferSize(0),
+						 m_AllocationSize(0),
+						 m_MaxCount(0),
+						 m_LargePages(false)
+{
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+//
+// Frees the buffers in the pool. Buffers still held by consumers are leaked and reported.
+//
+FRAMEPOOL::~FRAMEPOOL()
+{
+	while (m_FreeList)
+	{
+		FRAME_BUFFER* Buffer = m_FreeList;
+		m_FreeList = Buffer->Next;
+		Free(Buffer);
+	}
+
+	if (m_Stats.Outstanding)
+	{
+		fprintf_s(m_log_file, "Frame pool destroyed with %u buffers still in use.\n", m_Stats.Outstanding);
+	}
+
+	if (m_LockInitialized)
+	{
+		DeleteCriticalSection(&m_Lock);
+		m_LockInitialized = false;
+	}
+}
+
+//
+// BufferSize bytes per buffer, PreallocateCount of them allocated up front.
+// MaxCount limits the number of buffers, 0 for no limit.
+//
+DUPL_RETURN FRAMEPOOL::Init(_In_ FILE *log_file, UINT BufferSize, UINT PreallocateCount, UINT MaxCount, UINT Flags)
+{
+	m_log_file = log_file;
+	m_BufferSize = BufferSize;
+	m_MaxCount = MaxCount;
+
+	if (Flags & FRAMEPOOL_FLAG_LARGE_PAGES)
+	{
+		if (GetLargePageMinimum() && EnableLockMemoryPrivilege())
+		{
+			m_LargePages = true;
+		}
+		else
+		{
+			fprintf_s(m_log_file, "Large pages are not available, frame pool uses regular pages.\n");
+		}
+	}
+	m_AllocationSize = GetAllocationSize(BufferSize);
+
+	InitializeCriticalSection(&m_Lock);
+	m_LockInitialized = true;
+
+	for (UINT i = 0; i < PreallocateCount && (!m_MaxCount || i < m_MaxCount); ++i)
+	{
+		FRAME_BUFFER* Buffer = Allocate();
+		if (!Buffer)
+		{
+			fprintf_s(m_log_file, "Failed to preallocate frame pool buffers.\n");
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		Buffer->Next = m_FreeList;
+		m_FreeList = Buffer;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Keep every buffer a whole number of cache lines, and of large pages when they back the buffers
+//
+UINT FRAMEPOOL::GetAllocationSize(UINT BufferSize)
+{
+	UINT AllocationSize = (BufferSize + FRAMEPOOL_ALIGNMENT - 1) & ~(FRAMEPOOL_ALIGNMENT - 1);
+	if (m_LargePages)
+	{
+		SIZE_T LargePage = GetLargePageMinimum();
+		AllocationSize = static_cast<UINT>((AllocationSize + LargePage - 1) & ~(LargePage - 1));
+	}
+	return AllocationSize;
+}
+
+//
+// Allocate a buffer and account for it. Called with m_Lock held or before the pool is shared.
+//
+FRAME_BUFFER* FRAMEPOOL::Allocate()
+{
+	FRAME_BUFFER* Buffer = new (std::nothrow) FRAME_BUFFER;
+	if (!Buffer)
+	{
+		return nullptr;
+	}
+	RtlZeroMemory(Buffer, sizeof(FRAME_BUFFER));
+	Buffer->Size = m_BufferSize;
+	Buffer->AllocationSize = m_AllocationSize;
+
+	if (m_LargePages)
+	{
+		Buffer->Data = reinterpret_cast<BYTE*>(VirtualAlloc(nullptr, m_AllocationSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+		if (Buffer->Data)
+		{
+			Buffer->LargePage = true;
+			m_Stats.LargePages = true;
+		}
+	}
+
+	// Large pages can run out once physical memory is fragmented, fall back to regular pages
+	if (!Buffer->Data)
+	{
+		Buffer->Data = reinterpret_cast<BYTE*>(_aligned_malloc(m_AllocationSize, FRAMEPOOL_ALIGNMENT));
+		if (!Buffer->Data)
+		{
+			delete Buffer;
+			return nullptr;
+		}
+	}
+
+	++m_Stats.BufferCount;
+	m_Stats.Bytes += m_AllocationSize;
+	if (m_Stats.Bytes > m_Stats.PeakBytes)
+	{
+		m_Stats.PeakBytes = m_Stats.Bytes;
+	}
+
+	return Buffer;
+}
+
+void FRAMEPOOL::Free(_In_ FRAME_BUFFER* Buffer)
+{
+	if (Buffer->LargePage)
+	{
+		VirtualFree(Buffer->Data, 0, MEM_RELEASE);
+	}
+	else
+	{
+		_aligned_free(Buffer->Data);
+	}
+
+	--m_Stats.BufferCount;
+	m_Stats.Bytes -= Buffer->AllocationSize;
+	delete Buffer;
+}
+
+//
+// Hand out a buffer with a reference count of one
+//
+DUPL_RETURN FRAMEPOOL::Acquire(_Outptr_ FRAME_BUFFER** Buffer)
+{
+	*Buffer = nullptr;
+
+	EnterCriticalSection(&m_Lock);
+
+	FRAME_BUFFER* Found = m_FreeList;
+	if (Found)
+	{
+		m_FreeList = Found->Next;
+		++m_Stats.Hits;
+	}
+	else if (!m_MaxCount || m_Stats.BufferCount < m_MaxCount)
+	{
+		Found = Allocate();
+		++m_Stats.Misses;
+	}
+
+	if (!Found)
+	{
+		++m_Stats.Failed;
+		LeaveCriticalSection(&m_Lock);
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	++m_Stats.Outstanding;
+	if (m_Stats.Outstanding > m_Stats.PeakOutstanding)
+	{
+		m_Stats.PeakOutstanding = m_Stats.Outstanding;
+	}
+
+	LeaveCriticalSection(&m_Lock);
+
+	Found->Next = nullptr;
+	Found->RefCount = 1;
+	*Buffer = Found;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+void FRAMEPOOL::AddRef(_In_ FRAME_BUFFER* Buffer)
+{
+	InterlockedIncrement(&Buffer->RefCount);
+}
+
+//
+// Drop a reference, the last one returns the buffer to the pool. Buffers acquired before the
+// pool was resized are freed instead.
+//
+void FRAMEPOOL::Release(_In_ FRAME_BUFFER* Buffer)
+{
+	if (InterlockedDecrement(&Buffer->RefCount) != 0)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&m_Lock);
+	if (Buffer->Size == m_BufferSize)
+	{
+		Buffer->Next = m_FreeList;
+		m_FreeList = Buffer;
+	}
+	else
+	{
+		Free(Buffer);
+	}
+	--m_Stats.Outstanding;
+	LeaveCriticalSection(&m_Lock);
+}
+
+//
+// Buffers acquired from now on hold BufferSize bytes, after a mode change. The free buffers are
+// freed right away, the ones still in use once their last reference is released.
+// Call it from the thread that calls GetBufferSize.
+//
+void FRAMEPOOL::Resize(UINT BufferSize)
+{
+	EnterCriticalSection(&m_Lock);
+	if (BufferSize != m_BufferSize)
+	{
+		m_BufferSize = BufferSize;
+		m_AllocationSize = GetAllocationSize(BufferSize);
+		while (m_FreeList)
+		{
+			FRAME_BUFFER* Buffer = m_FreeList;
+			m_FreeList = Buffer->Next;
+			Free(Buffer);
+		}
+	}
+	LeaveCriticalSection(&m_Lock);
+}
+
+UINT FRAMEPOOL::GetBufferSize()
+{
+	return m_BufferSize;
+}
+
+void FRAMEPOOL::GetStats(_Out_ FRAMEPOOL_STATS* Stats)
+{
+	if (!m_LockInitialized)
+	{
+		*Stats = m_Stats;
+		return;
+	}
+
+	EnterCriticalSection(&m_Lock);
+	*Stats = m_Stats;
+	LeaveCriticalSection(&m_Lock);
+}
@@ -0,0 +1,73 @@
+// FramePool.h : Pool of equally sized, cache line aligned frame buffers handed out
+// as reference counted handles.
+//
+
+#ifndef _FRAMEPOOL_H_
+#define _FRAMEPOOL_H_
+
+#include "DuplicationManager.h"
+
+#define FRAMEPOOL_ALIGNMENT     64
+
+// Back the buffers with large pages when the process may lock memory
+#define FRAMEPOOL_FLAG_LARGE_PAGES  0x1
+
+//
+// A pooled buffer. Goes back to the pool when the last reference is released.
+//
+typedef struct _FRAME_BUFFER
+{
+	_Field_size_bytes_(Size) BYTE* Data;
+	UINT Size;
+	UINT AllocationSize;                    // Size rounded up to cache lines, or to large pages
+	volatile LONG RefCount;
+	bool LargePage;
+	struct _FRAME_BUFFER* Next;             // Free list link while the buffer is in the pool
+} FRAME_BUFFER;
+
+//
+// Counters for sizing the pool
+//
+typedef struct _FRAMEPOOL_STATS
+{
+	UINT Hits;                  // Acquires served from the free list
+	UINT Misses;                // Acquires that had to allocate
+	UINT Failed;                // Acquires refused because the pool was at its limit or out of memory
+	UINT BufferCount;
+	UINT Outstanding;
+	UINT PeakOutstanding;
+	UINT64 Bytes;               // Memory held by the pool, including buffers in use
+	UINT64 PeakBytes;
+	bool LargePages;            // Large pages were requested and granted
+} FRAMEPOOL_STATS;
+
+class FRAMEPOOL
+{
+	public:
+		FRAMEPOOL();
+		~FRAMEPOOL();
+		DUPL_RETURN Init(_In_ FILE *log_file, UINT BufferSize, UINT PreallocateCount, UINT MaxCount, UINT Flags);
+		DUPL_RETURN Acquire(_Outptr_ FRAME_BUFFER** Buffer);
+		void AddRef(_In_ FRAME_BUFFER* Buffer);
+		void Release(_In_ FRAME_BUFFER* Buffer);
+		void Resize(UINT BufferSize);
+		UINT GetBufferSize();
+		void GetStats(_Out_ FRAMEPOOL_STATS* Stats);
+
+	private:
+		FILE *m_log_file;
+		CRITICAL_SECTION m_Lock;
+		bool m_LockInitialized;
+		FRAME_BUFFER* m_FreeList;
+		UINT m_BufferSize;
+		UINT m_AllocationSize;
+		UINT m_MaxCount;
+		bool m_LargePages;
+		FRAMEPOOL_STATS m_Stats;
+
+		UINT GetAllocationSize(UINT BufferSize);
+		FRAME_BUFFER* Allocate();
+		void Free(_In_ FRAME_BUFFER* Buffer);
+};
+
+#endif
@@ -0,0 +1,396 @@
+// FrameReplay.cpp : Recording and replaying frame sources.
+//
+
+#include "FrameReplay.h"
+
+FRAMERECORDER::FRAMERECORDER() : m_log_file(nullptr),
+								 m_Source(nullptr),
+								 m_Open(false),
+								 m_FrameCount(0),
+								 m_Packed(nullptr),
+								 m_PackedSize(0)
+{
+}
+
+FRAMERECORDER::~FRAMERECORDER()
+{
+	Close();
+	if (m_Packed)
+	{
+		delete [] m_Packed;
+		m_Packed = nullptr;
+	}
+}
+
+//
+// Record the frames Source delivers into FileName
+//
+DUPL_RETURN FRAMERECORDER::Open(_In_ FILE *log_file, _In_ FRAMESOURCE* Source, _In_z_ const char* FileName)
+{
+	m_log_file = log_file;
+	m_Source = Source;
+	m_FrameCount = 0;
+
+	DUPL_RETURN Ret = m_Recording.Open(log_file, FileName);
+	m_Open = (Ret == DUPL_RETURN_SUCCESS);
+
+	return Ret;
+}
+
+DUPL_RETURN FRAMERECORDER::Close()
+{
+	if (!m_Open)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	m_Open = false;
+	return m_Recording.Close();
+}
+
+void FRAMERECORDER::SetCompression(bool Compress)
+{
+	m_Recording.SetCompression(Compress);
+}
+
+UINT FRAMERECORDER::GetFrameCount()
+{
+	return m_FrameCount;
+}
+
+_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+DUPL_RETURN FRAMERECORDER::GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+{
+	DUPL_RETURN Ret = m_Source->GetFrame(ImageData, Timeout, TimeoutMs);
+	if (Ret != DUPL_RETURN_SUCCESS || *Timeout || !m_Open)
+	{
+		return Ret;
+	}
+
+	IMAGE_VIEW Image;
+	m_Source->GetImageView(ImageData, &Image);
+	const FRAME_METADATA* Meta = m_Source->GetFrameMetaData();
+
+	UINT Pitch = GetPackedPitch(&Image);
+	UINT DataSize = Pitch * Image.Height;
+	if (DataSize > m_PackedSize)
+	{
+		if (m_Packed)
+		{
+			delete [] m_Packed;
+		}
+		m_Packed = new (std::nothrow) BYTE[DataSize];
+		if (!m_Packed)
+		{
+			m_PackedSize = 0;
+			fprintf_s(m_log_file, "Failed to allocate %u bytes for the trace recorder.\n", DataSize);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_PackedSize = DataSize;
+	}
+	CopyImagePacked(m_Packed, Pitch, &Image, nullptr);
+
+	RECORDING_FRAME_INFO Info;
+	RtlZeroMemory(&Info, sizeof(Info));
+	Info.Index = m_FrameCount;
+	QueryPerformanceFrequency(&Info.Frequency);
+	if (Meta)
+	{
+		Info.CaptureTime = Meta->AcquireTime;
+		Info.FrameInfo = Meta->FrameInfo;
+	}
+	else
+	{
+		QueryPerformanceCounter(&Info.CaptureTime);
+	}
+	Info.Width = Image.Width;
+	Info.Height = Image.Height;
+	Info.Pitch = Pitch;
+	Info.Format = Image.Format;
+
+	// Without rects the replayer treats the frame as a full update
+	const BYTE* MetaData = nullptr;
+	UINT MetaDataSize = 0;
+	if (Meta && !Meta->FullCopy)
+	{
+		Info.MoveCount = Meta->MoveCount;
+		Info.DirtyCount = Meta->DirtyCount;
+		MetaData = Meta->MetaData;
+		MetaDataSize = Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT) + Meta->DirtyCount * sizeof(RECT);
+	}
+
+	Ret = m_Recording.Append(&Info, MetaData, MetaDataSize, m_Packed, DataSize);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		fprintf_s(m_log_file, "Failed to record frame %u.\n", m_FrameCount);
+		return Ret;
+	}
+	++m_FrameCount;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+void FRAMERECORDER::GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+{
+	m_Source->GetImageView(ImageData, View);
+}
+
+UINT FRAMERECORDER::GetImageBufferSize()
+{
+	return m_Source->GetImageBufferSize();
+}
+
+const FRAME_METADATA* FRAMERECORDER::GetFrameMetaData()
+{
+	return m_Source->GetFrameMetaData();
+}
+
+bool FRAMERECORDER::IsFramePending()
+{
+	return m_Source->IsFramePending();
+}
+
+void FRAMERECORDER::GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+{
+	m_Source->GetOutputDesc(DescPtr);
+}
+
+FRAMEREPLAYER::FRAMEREPLAYER() : m_log_file(nullptr),
+								 m_Clock(nullptr),
+								 m_Speed(1.0),
+								 m_NextEntry(0),
+								 m_Started(false),
+								 m_StartTicks(0),
+								 m_TraceStart(0),
+								 m_FullCopyNeeded(true),
+								 m_LastIndex(0),
+								 m_DeliveredMeta(nullptr),
+								 m_Width(0),
+								 m_Height(0),
+								 m_Pitch(0),
+								 m_Format(DXGI_FORMAT_B8G8R8A8_UNORM)
+{
+	RtlZeroMemory(&m_Meta, sizeof(m_Meta));
+}
+
+FRAMEREPLAYER::~FRAMEREPLAYER()
+{
+	Close();
+}
+
+//
+// Replay FileName at Speed times the recorded rate, timed by Clock or QueryPerformanceCounter.
+// A Speed of 0 hands out frames as fast as GetFrame is called.
+//
+DUPL_RETURN FRAMEREPLAYER::Open(_In_ FILE *log_file, _In_z_ const char* FileName, double Speed, _In_opt_ FRAMECLOCK* Clock)
+{
+	m_log_file = log_file;
+	m_Clock = Clock ? Clock : &m_SystemClock;
+	m_Speed = (Speed > 0) ? Speed : 0;
+	m_NextEntry = 0;
+	m_Started = false;
+	m_FullCopyNeeded = true;
+
+	DUPL_RETURN Ret = m_Reader.Open(log_file, FileName);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
+
+	// Every frame of the replay has the size of the first one that carries pixels
+	for (UINT Entry = 0; Entry < m_Reader.GetFrameCount(); ++Entry)
+	{
+		RECORDING_FRAME Frame;
+		if (m_Reader.GetFrame(Entry, &Frame) == DUPL_RETURN_SUCCESS && Frame.DataSize)
+		{
+			m_Width = Frame.Header->Info.Width;
+			m_Height = Frame.Header->Info.Height;
+			m_Pitch = Frame.Header->Info.Pitch;
+			m_Format = Frame.Header->Info.Format;
+			return DUPL_RETURN_SUCCESS;
+		}
+	}
+
+	fprintf_s(m_log_file, "Recording %s has no frames to replay.\n", FileName);
+	m_Reader.Close();
+	return DUPL_RETURN_ERROR_UNEXPECTED;
+}
+
+void FRAMEREPLAYER::Close()
+{
+	m_Reader.Close();
+	if (m_Meta.MetaData)
+	{
+		delete [] m_Meta.MetaData;
+		m_Meta.MetaData = nullptr;
+	}
+	m_Meta.MetaDataSize = 0;
+	m_DeliveredMeta = nullptr;
+}
+
+//
+// Clock ticks at which a frame is due, keeping the recorded spacing from the first frame
+//
+UINT64 FRAMEREPLAYER::GetDueTicks(_In_ const RECORDING_FRAME_INFO* Info)
+{
+	if (!m_Speed || Info->CaptureTime.QuadPart <= m_TraceStart || !Info->Frequency.QuadPart)
+	{
+		return m_StartTicks;
+	}
+
+	double Seconds = static_cast<double>(Info->CaptureTime.QuadPart - m_TraceStart) / Info->Frequency.QuadPart / m_Speed;
+	return m_StartTicks + static_cast<UINT64>(Seconds * m_Clock->GetFrequency());
+}
+
+//
+// Wait until the next recorded frame is due, at most TimeoutMs, and bring ImageData up to date with it.
+// Returns DUPL_RETURN_ERROR_EXPECTED once the recording is exhausted.
+//
+_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+DUPL_RETURN FRAMEREPLAYER::GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+{
+	*Timeout = true;
+	m_DeliveredMeta = nullptr;
+
+	if (m_NextEntry >= m_Reader.GetFrameCount())
+	{
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	RECORDING_FRAME Frame;
+	DUPL_RETURN Ret = m_Reader.GetFrame(m_NextEntry, &Frame);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
+	const RECORDING_FRAME_INFO* Info = &Frame.Header->Info;
+
+	UINT64 Now = m_Clock->GetTicks();
+	if (!m_Started)
+	{
+		m_StartTicks = Now;
+		m_TraceStart = Info->CaptureTime.QuadPart;
+		m_Started = true;
+	}
+
+	// Like AcquireNextFrame, give up when the frame is not due within the timeout
+	UINT64 Due = GetDueTicks(Info);
+	UINT64 Deadline = Now + static_cast<UINT64>(TimeoutMs) * m_Clock->GetFrequency() / 1000;
+	if (Due > Deadline)
+	{
+		m_Clock->WaitUntil(Deadline);
+		return DUPL_RETURN_SUCCESS;
+	}
+	m_Clock->WaitUntil(Due);
+	++m_NextEntry;
+
+	// Rects only describe the change from the frame right before, which a lossy recording may have dropped
+	if (m_NextEntry > 1 && Info->Index != m_LastIndex + 1)
+	{
+		m_FullCopyNeeded = true;
+	}
+	m_LastIndex = Info->Index;
+
+	// Repeats carry nothing new
+	if (Info->Flags & RECORDING_FLAG_REPEAT)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	Ret = m_Reader.DecodeFrame(&Frame);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
+
+	if (Info->Width != m_Width || Info->Height != m_Height || Info->Pitch != m_Pitch || Frame.DataSize < m_Pitch * m_Height)
+	{
+		fprintf_s(m_log_file, "Recorded frame %u does not match the replay size.\n", Info->Index);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	// The metadata buffer is handed out through GetFrameMetaData and may not point into the mapping
+	if (Frame.Header->MetaDataSize > m_Meta.MetaDataSize)
+	{
+		if (m_Meta.MetaData)
+		{
+			delete [] m_Meta.MetaData;
+		}
+		m_Meta.MetaData = new (std::nothrow) BYTE[Frame.Header->MetaDataSize];
+		if (!m_Meta.MetaData)
+		{
+			m_Meta.MetaDataSize = 0;
+			fprintf_s(m_log_file, "Failed to allocate replay metadata.\n");
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_Meta.MetaDataSize = Frame.Header->MetaDataSize;
+	}
+	if (Frame.Header->MetaDataSize)
+	{
+		memcpy_s(m_Meta.MetaData, m_Meta.MetaDataSize, Frame.MetaData, Frame.Header->MetaDataSize);
+	}
+
+	m_Meta.MoveCount = Info->MoveCount;
+	m_Meta.DirtyCount = Info->DirtyCount;
+	m_Meta.FullCopy = m_FullCopyNeeded || (!Info->MoveCount && !Info->DirtyCount);
+	m_Meta.Presented = true;
+	m_Meta.FrameInfo = Info->FrameInfo;
+
+	// Stamps are of the replay, so latency is measured for this run and not the recorded one
+	QueryPerformanceCounter(&m_Meta.AcquireTime);
+	m_Meta.CopyTime = m_Meta.AcquireTime;
+	m_Meta.MapTime = m_Meta.AcquireTime;
+
+	if (m_Meta.FullCopy)
+	{
+		memcpy_s(ImageData, m_Pitch * m_Height, Frame.Data, m_Pitch * m_Height);
+		m_FullCopyNeeded = false;
+	}
+	else
+	{
+		// Recorded frames are complete, the move destinations are just more changed pixels
+		const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(m_Meta.MetaData);
+		for (UINT i = 0; i < m_Meta.MoveCount; ++i)
+		{
+			CopyRegions(ImageData, m_Pitch, Frame.Data, m_Pitch, m_Width, m_Height, &MoveRects[i].DestinationRect, 1);
+		}
+
+		const RECT* DirtyRects = reinterpret_cast<const RECT*>(m_Meta.MetaData + (m_Meta.MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+		CopyRegions(ImageData, m_Pitch, Frame.Data, m_Pitch, m_Width, m_Height, DirtyRects, m_Meta.DirtyCount);
+	}
+
+	QueryPerformanceCounter(&m_Meta.ReadbackTime);
+	m_DeliveredMeta = &m_Meta;
+	*Timeout = false;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+void FRAMEREPLAYER::GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+{
+	View->Data = ImageData;
+	View->Width = m_Width;
+	View->Height = m_Height;
+	View->Pitch = m_Pitch;
+	View->Format = m_Format;
+	View->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+}
+
+UINT FRAMEREPLAYER::GetImageBufferSize()
+{
+	return m_Pitch * m_Height;
+}
+
+const FRAME_METADATA* FRAMEREPLAYER::GetFrameMetaData()
+{
+	return m_DeliveredMeta;
+}
+
+void FRAMEREPLAYER::GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+{
+	RtlZeroMemory(DescPtr, sizeof(DXGI_OUTPUT_DESC));
+	DescPtr->DesktopCoordinates.right = m_Width;
+	DescPtr->DesktopCoordinates.bottom = m_Height;
+	DescPtr->AttachedToDesktop = TRUE;
+	DescPtr->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+}
@@ -0,0 +1,87 @@
+// FrameReplay.h : Records a frame source into a recording file and replays a recording
+// through the FRAMESOURCE contract, so the pipeline can run without a live duplication.
+//
+
+#ifndef _FRAMEREPLAY_H_
+#define _FRAMEREPLAY_H_
+
+#include "DuplicationManager.h"
+#include "RecordingFile.h"
+#include "FramePacer.h"
+
+//
+// Passes frames of another source through and appends every new one to a recording,
+// with its DXGI_OUTDUPL_FRAME_INFO, move and dirty rects and capture time. Frames are
+// written on the capture thread so none are dropped, unlike FRAMEWRITER.
+//
+class FRAMERECORDER : public FRAMESOURCE
+{
+	public:
+		FRAMERECORDER();
+		~FRAMERECORDER();
+		DUPL_RETURN Open(_In_ FILE *log_file, _In_ FRAMESOURCE* Source, _In_z_ const char* FileName);
+		DUPL_RETURN Close();
+		void SetCompression(bool Compress);
+		UINT GetFrameCount();
+
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs = FRAME_TIMEOUT_DEFAULT);
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View);
+		UINT GetImageBufferSize();
+		const FRAME_METADATA* GetFrameMetaData();
+		bool IsFramePending();
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
+
+	private:
+		FILE *m_log_file;
+		FRAMESOURCE* m_Source;
+		RECORDINGWRITER m_Recording;
+		bool m_Open;
+		UINT m_FrameCount;
+		BYTE* m_Packed;
+		UINT m_PackedSize;
+};
+
+//
+// Feeds the frames of a recording back with their original spacing, scaled by Speed.
+// Only the recorded move and dirty rects of a frame are written to ImageData, as a
+// duplication with dirty rect readback would.
+//
+class FRAMEREPLAYER : public FRAMESOURCE
+{
+	public:
+		FRAMEREPLAYER();
+		~FRAMEREPLAYER();
+		DUPL_RETURN Open(_In_ FILE *log_file, _In_z_ const char* FileName, double Speed, _In_opt_ FRAMECLOCK* Clock = nullptr);
+		void Close();
+
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs = FRAME_TIMEOUT_DEFAULT);
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View);
+		UINT GetImageBufferSize();
+		const FRAME_METADATA* GetFrameMetaData();
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
+
+	private:
+		FILE *m_log_file;
+		RECORDINGREADER m_Reader;
+		FRAMECLOCK* m_Clock;
+		SYSTEMCLOCK m_SystemClock;
+		double m_Speed;                 // 0 replays as fast as frames are asked for
+		UINT m_NextEntry;
+		bool m_Started;
+		UINT64 m_StartTicks;            // Clock ticks when the first frame was replayed
+		LONGLONG m_TraceStart;          // Capture time of the first frame
+		bool m_FullCopyNeeded;
+		UINT m_LastIndex;               // Recorded index of the last frame replayed
+		FRAME_METADATA m_Meta;
+		FRAME_METADATA* m_DeliveredMeta;
+		UINT m_Width;
+		UINT m_Height;
+		UINT m_Pitch;
+		DXGI_FORMAT m_Format;
+
+		UINT64 GetDueTicks(_In_ const RECORDING_FRAME_INFO* Info);
+};
+
+#endif
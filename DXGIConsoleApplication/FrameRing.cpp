@@ -0,0 +1,462 @@
+// FrameRing.cpp : Lock free single producer, multiple consumer ring of frames.
+//
+
+#include "FrameRing.h"
+
+FRAMERING::FRAMERING() : m_log_file(nullptr),
+						 m_Pool(nullptr),
+						 m_Slots(nullptr),
+						 m_Size(0),
+						 m_ConsumerCount(0),
+						 m_Head(0),
+						 m_Sleepers(0),
+						 m_Stopped(0),
+						 m_LockInitialized(false),
+						 m_FreeList(nullptr),
+						 m_Returned(nullptr),
+						 m_AllEntries(nullptr),
+						 m_PreviousWidth(0),
+						 m_PreviousHeight(0),
+						 m_ChangedUnknown(true)
+{
+	RtlZeroMemory(m_Consumers, sizeof(m_Consumers));
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+//
+// Consumers must have released every frame they read
+//
+FRAMERING::~FRAMERING()
+{
+	while (m_AllEntries)
+	{
+		RING_ENTRY* Entry = m_AllEntries;
+		m_AllEntries = Entry->AllNext;
+		if (Entry->Frame.Buffer)
+		{
+			m_Pool->Release(Entry->Frame.Buffer);
+		}
+		delete Entry;
+	}
+
+	if (m_Slots)
+	{
+		_aligned_free(m_Slots);
+		m_Slots = nullptr;
+	}
+
+	if (m_LockInitialized)
+	{
+		DeleteCriticalSection(&m_Lock);
+		m_LockInitialized = false;
+	}
+}
+
+//
+// Keep the last Size frames, copied into buffers of Pool
+//
+DUPL_RETURN FRAMERING::Init(_In_ FILE *log_file, _In_ FRAMEPOOL* Pool, UINT Size)
+{
+	m_log_file = log_file;
+	m_Pool = Pool;
+
+	if (!Size)
+	{
+		fprintf_s(m_log_file, "Frame ring needs at least one slot.\n");
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	m_Slots = reinterpret_cast<RING_SLOT*>(_aligned_malloc(Size * sizeof(RING_SLOT), sizeof(RING_SLOT)));
+	if (!m_Slots)
+	{
+		fprintf_s(m_log_file, "Failed to allocate %u frame ring slots.\n", Size);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+	RtlZeroMemory(m_Slots, Size * sizeof(RING_SLOT));
+	m_Size = Size;
+
+	InitializeCriticalSection(&m_Lock);
+	InitializeConditionVariable(&m_FrameReady);
+	m_LockInitialized = true;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Register a consumer, it reads from the next frame published on. Call before the
+// consumer's thread starts reading.
+//
+DUPL_RETURN FRAMERING::AddConsumer(_Out_ UINT* Consumer)
+{
+	LONG Count = ReadAcquire(&m_ConsumerCount);
+	for (;;)
+	{
+		if (Count >= FRAMERING_MAX_CONSUMERS)
+		{
+			fprintf_s(m_log_file, "Frame ring already has %u consumers.\n", FRAMERING_MAX_CONSUMERS);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+
+		LONG Seen = InterlockedCompareExchange(&m_ConsumerCount, Count + 1, Count);
+		if (Seen == Count)
+		{
+			break;
+		}
+		Count = Seen;
+	}
+
+	RING_CONSUMER* Cursor = &m_Consumers[Count];
+	Cursor->Next = ReadAcquire64(&m_Head) + 1;
+	Cursor->Read = 0;
+	Cursor->Dropped = 0;
+	*Consumer = static_cast<UINT>(Count);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Take an entry off the producer's free list, refilled with the entries consumers gave back.
+// The ring only grows when every entry is still in a slot or held by a consumer.
+//
+RING_ENTRY* FRAMERING::AllocateEntry()
+{
+	if (!m_FreeList)
+	{
+		// Taking the whole list at once leaves nothing for another thread to pop, so no ABA
+		m_FreeList = reinterpret_cast<RING_ENTRY*>(InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_Returned), nullptr));
+	}
+
+	RING_ENTRY* Entry = m_FreeList;
+	if (Entry)
+	{
+		m_FreeList = Entry->Next;
+		return Entry;
+	}
+
+	Entry = new (std::nothrow) RING_ENTRY;
+	if (!Entry)
+	{
+		return nullptr;
+	}
+	RtlZeroMemory(Entry, sizeof(RING_ENTRY));
+
+	if (m_Pool->Acquire(&Entry->Frame.Buffer) != DUPL_RETURN_SUCCESS)
+	{
+		delete Entry;
+		return nullptr;
+	}
+
+	Entry->AllNext = m_AllEntries;
+	m_AllEntries = Entry;
+	++m_Stats.Entries;
+
+	return Entry;
+}
+
+//
+// Drop a reference, the last one gives the entry back to the producer with its buffer
+//
+void FRAMERING::ReleaseEntry(_In_ RING_ENTRY* Entry)
+{
+	if (InterlockedDecrement(&Entry->RefCount) != 0)
+	{
+		return;
+	}
+
+	RING_ENTRY* Head = reinterpret_cast<RING_ENTRY*>(ReadPointerAcquire(reinterpret_cast<void* const volatile*>(&m_Returned)));
+	for (;;)
+	{
+		Entry->Next = Head;
+		RING_ENTRY* Seen = reinterpret_cast<RING_ENTRY*>(InterlockedCompareExchangePointer(reinterpret_cast<void* volatile*>(&m_Returned), Entry, Head));
+		if (Seen == Head)
+		{
+			break;
+		}
+		Head = Seen;
+	}
+}
+
+//
+// Bounds of what changed in Image since the frame published before
+//
+void FRAMERING::GetChanged(_In_ const IMAGE_VIEW* Image, _In_opt_ const FRAME_METADATA* Meta, _Out_ RECT* Changed)
+{
+	bool Whole = m_ChangedUnknown || !Meta || Meta->FullCopy ||
+		Image->Width != m_PreviousWidth || Image->Height != m_PreviousHeight;
+	m_ChangedUnknown = false;
+	m_PreviousWidth = Image->Width;
+	m_PreviousHeight = Image->Height;
+
+	if (Whole)
+	{
+		SetRect(Changed, 0, 0, Image->Width, Image->Height);
+		return;
+	}
+
+	SetRectEmpty(Changed);
+	const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+	const RECT* DirtyRects = reinterpret_cast<const RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+	for (UINT i = 0; i < Meta->MoveCount + Meta->DirtyCount; ++i)
+	{
+		const RECT* Rect = (i < Meta->MoveCount) ? &MoveRects[i].DestinationRect : &DirtyRects[i - Meta->MoveCount];
+		if (Changed->right <= Changed->left || Changed->bottom <= Changed->top)
+		{
+			*Changed = *Rect;
+			continue;
+		}
+		Changed->left = min(Changed->left, Rect->left);
+		Changed->top = min(Changed->top, Rect->top);
+		Changed->right = max(Changed->right, Rect->right);
+		Changed->bottom = max(Changed->bottom, Rect->bottom);
+	}
+}
+
+//
+// Copy Image into the ring as the newest frame, replacing the oldest one. Only the producer
+// thread may call this. Returns DUPL_RETURN_ERROR_EXPECTED if no buffer was left for the frame.
+//
+DUPL_RETURN FRAMERING::Publish(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta)
+{
+	LARGE_INTEGER PublishTime;
+	QueryPerformanceCounter(&PublishTime);
+
+	RING_ENTRY* Entry = AllocateEntry();
+	if (!Entry)
+	{
+		++m_Stats.Failed;
+		m_ChangedUnknown = true;
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	RING_FRAME* Frame = &Entry->Frame;
+	if (static_cast<UINT64>(GetPackedPitch(Image)) * Image->Height > Frame->Buffer->Size)
+	{
+		fprintf_s(m_log_file, "Frame of %ux%u doesn't fit into a ring buffer of %u bytes.\n", Image->Width, Image->Height, Frame->Buffer->Size);
+		Entry->Next = m_FreeList;
+		m_FreeList = Entry;
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	// Nobody can reference the entry until it is in a slot, the slot's reference is the first
+	LONGLONG Sequence = m_Head + 1;
+	InterlockedExchange(&Entry->RefCount, 1);
+	CopyImagePacked(Frame->Buffer->Data, GetPackedPitch(Image), Image, &Frame->Image);
+	Frame->Sequence = Sequence;
+	Frame->Index = Index;
+	GetChanged(Image, Meta, &Frame->Changed);
+	Frame->CaptureTime = Meta ? Meta->AcquireTime : PublishTime;
+	Frame->PublishTime = PublishTime;
+
+	// Consumers that see the old sequence after taking their reference got the old frame intact
+	RING_SLOT* Slot = &m_Slots[Sequence % m_Size];
+	RING_ENTRY* Old = Slot->Entry;
+	WriteRelease64(&Slot->Sequence, 0);
+	WritePointerRelease(reinterpret_cast<void* volatile*>(&Slot->Entry), Entry);
+	WriteRelease64(&Slot->Sequence, Sequence);
+	InterlockedExchange64(&m_Head, Sequence);
+	if (Old)
+	{
+		ReleaseEntry(Old);
+	}
+	++m_Stats.Published;
+
+	// The exchange above orders the new head before this, a consumer going to sleep either
+	// sees the frame or is counted here
+	if (ReadAcquire(&m_Sleepers))
+	{
+		EnterCriticalSection(&m_Lock);
+		WakeAllConditionVariable(&m_FrameReady);
+		LeaveCriticalSection(&m_Lock);
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Reference the entry of frame Sequence if it is still in its slot
+//
+bool FRAMERING::TryReference(LONGLONG Sequence, _Outptr_result_maybenull_ RING_ENTRY** Entry)
+{
+	*Entry = nullptr;
+
+	RING_SLOT* Slot = &m_Slots[Sequence % m_Size];
+	if (ReadAcquire64(&Slot->Sequence) != Sequence)
+	{
+		return false;
+	}
+
+	RING_ENTRY* Found = reinterpret_cast<RING_ENTRY*>(ReadPointerAcquire(reinterpret_cast<void* const volatile*>(&Slot->Entry)));
+	if (!Found)
+	{
+		return false;
+	}
+
+	// An entry nobody references is on its way back to the producer
+	LONG Count = ReadAcquire(&Found->RefCount);
+	for (;;)
+	{
+		if (!Count)
+		{
+			return false;
+		}
+
+		LONG Seen = InterlockedCompareExchange(&Found->RefCount, Count + 1, Count);
+		if (Seen == Count)
+		{
+			break;
+		}
+		Count = Seen;
+	}
+
+	// The slot only lets go of its reference after its sequence changed
+	if (ReadAcquire64(&Slot->Sequence) != Sequence)
+	{
+		ReleaseEntry(Found);
+		return false;
+	}
+
+	*Entry = Found;
+	return true;
+}
+
+//
+// Hand Consumer the frame after the one it read last, waiting at most TimeoutMs for it to be
+// published. Frames overwritten in the meantime are skipped and counted as dropped.
+// Returns DUPL_RETURN_ERROR_EXPECTED once the ring was stopped and the consumer has read everything.
+//
+_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+DUPL_RETURN FRAMERING::Read(UINT Consumer, _Outptr_result_maybenull_ RING_FRAME** Frame, _Out_ bool* Timeout, UINT TimeoutMs)
+{
+	RING_CONSUMER* Cursor = &m_Consumers[Consumer];
+	*Frame = nullptr;
+	*Timeout = true;
+
+	for (;;)
+	{
+		LONGLONG Head = ReadAcquire64(&m_Head);
+		if (Cursor->Next <= Head)
+		{
+			LONGLONG Oldest = Head - m_Size + 1;
+			if (Cursor->Next < Oldest)
+			{
+				Cursor->Dropped += Oldest - Cursor->Next;
+				Cursor->Next = Oldest;
+			}
+
+			RING_ENTRY* Entry;
+			if (TryReference(Cursor->Next, &Entry))
+			{
+				++Cursor->Next;
+				++Cursor->Read;
+				*Frame = &Entry->Frame;
+				*Timeout = false;
+				return DUPL_RETURN_SUCCESS;
+			}
+
+			// Overwritten while it was being read
+			++Cursor->Dropped;
+			++Cursor->Next;
+			continue;
+		}
+
+		if (ReadAcquire(&m_Stopped))
+		{
+			return DUPL_RETURN_ERROR_EXPECTED;
+		}
+
+		if (!TimeoutMs)
+		{
+			return DUPL_RETURN_SUCCESS;
+		}
+
+		// Caught up, sleep until Publish wakes the consumers
+		InterlockedIncrement(&m_Sleepers);
+		EnterCriticalSection(&m_Lock);
+		if (ReadAcquire64(&m_Head) < Cursor->Next && !ReadAcquire(&m_Stopped))
+		{
+			SleepConditionVariableCS(&m_FrameReady, &m_Lock, TimeoutMs);
+		}
+		LeaveCriticalSection(&m_Lock);
+		InterlockedDecrement(&m_Sleepers);
+
+		// One more look, a wake up without a frame is a timeout
+		TimeoutMs = 0;
+	}
+}
+
+//
+// Reference the newest frame regardless of any consumer's cursor. Fails if nothing was
+// published yet or the producer kept overwriting the newest slot while it was read.
+//
+bool FRAMERING::ReadLatest(_Outptr_result_maybenull_ RING_FRAME** Frame)
+{
+	*Frame = nullptr;
+
+	for (UINT i = 0; i < FRAMERING_LATEST_TRIES; ++i)
+	{
+		LONGLONG Head = ReadAcquire64(&m_Head);
+		if (!Head)
+		{
+			return false;
+		}
+
+		RING_ENTRY* Entry;
+		if (TryReference(Head, &Entry))
+		{
+			*Frame = &Entry->Frame;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Give back a frame returned by Read or ReadLatest
+//
+void FRAMERING::Release(_In_ RING_FRAME* Frame)
+{
+	ReleaseEntry(reinterpret_cast<RING_ENTRY*>(Frame));
+}
+
+//
+// No more frames will be published, consumers waiting in Read return once they have read the rest
+//
+void FRAMERING::Stop()
+{
+	InterlockedExchange(&m_Stopped, 1);
+	if (m_LockInitialized)
+	{
+		EnterCriticalSection(&m_Lock);
+		WakeAllConditionVariable(&m_FrameReady);
+		LeaveCriticalSection(&m_Lock);
+	}
+}
+
+//
+// Consumer counters are exact once the consumers stopped reading
+//
+void FRAMERING::GetStats(_Out_ FRAMERING_STATS* Stats)
+{
+	*Stats = m_Stats;
+	Stats->ConsumerCount = static_cast<UINT>(ReadAcquire(&m_ConsumerCount));
+	for (UINT i = 0; i < Stats->ConsumerCount; ++i)
+	{
+		Stats->Read[i] = m_Consumers[i].Read;
+		Stats->Dropped[i] = m_Consumers[i].Dropped;
+	}
+}
+
+void GetRingFrameMetaData(_In_ const RING_FRAME* Frame, LONGLONG PreviousSequence, _Out_ FRAME_METADATA* Meta)
+{
+	RtlZeroMemory(Meta, sizeof(FRAME_METADATA));
+	Meta->Presented = true;
+	Meta->AcquireTime = Frame->CaptureTime;
+	Meta->FullCopy = (Frame->Sequence != PreviousSequence + 1);
+	if (!Meta->FullCopy && Frame->Changed.right > Frame->Changed.left && Frame->Changed.bottom > Frame->Changed.top)
+	{
+		Meta->MetaData = reinterpret_cast<BYTE*>(const_cast<RECT*>(&Frame->Changed));
+		Meta->MetaDataSize = sizeof(RECT);
+		Meta->DirtyCount = 1;
+	}
+}
@@ -0,0 +1,134 @@
+// FrameRing.h : Hands frames from the capture thread to any number of consumer threads
+// without locks. Every frame published gets the next sequence number, each consumer follows
+// with its own cursor and skips the frames that were overwritten before it got to them.
+//
+
+#ifndef _FRAMERING_H_
+#define _FRAMERING_H_
+
+#include "DuplicationManager.h"
+#include "FramePool.h"
+
+// Consumers one ring can be read by
+#define FRAMERING_MAX_CONSUMERS     8
+
+// Attempts of ReadLatest, each fails only if the producer lapped the ring while it read
+#define FRAMERING_LATEST_TRIES      4
+
+//
+// A published frame. Consumers get it referenced and give it back with FRAMERING::Release,
+// until then neither the description nor the pixels in Buffer change.
+//
+typedef struct _RING_FRAME
+{
+	FRAME_BUFFER* Buffer;
+	IMAGE_VIEW Image;               // Packed copy of the frame in Buffer
+	LONGLONG Sequence;              // 1 for the first frame published
+	UINT Index;                     // Given to Publish
+	RECT Changed;                   // Bounds of what changed since the frame before, the whole image if that isn't known
+	LARGE_INTEGER CaptureTime;      // AcquireTime of the frame, or when it was published if there is none
+	LARGE_INTEGER PublishTime;      // QueryPerformanceCounter ticks
+} RING_FRAME;
+
+//
+// Holder of a RING_FRAME and the pool buffer it keeps between frames. Entries are only freed
+// with the ring, so a consumer may try to take a reference on one that is being recycled and
+// back off when the slot's sequence moved on.
+//
+typedef struct _RING_ENTRY
+{
+	RING_FRAME Frame;
+	volatile LONG RefCount;         // One for the slot, one per consumer holding the frame
+	struct _RING_ENTRY* Next;       // Free list link, consumers return entries to the producer through it
+	struct _RING_ENTRY* AllNext;    // Links every entry of the ring
+} RING_ENTRY;
+
+//
+// Sequence is 0 while the slot is being replaced
+//
+typedef struct _RING_SLOT
+{
+	volatile LONGLONG Sequence;
+	RING_ENTRY* volatile Entry;
+	BYTE Padding[64 - sizeof(LONGLONG) - sizeof(RING_ENTRY*)];
+} RING_SLOT;
+
+//
+// Counters of one consumer, written only by the consumer's thread
+//
+typedef struct _RING_CONSUMER
+{
+	LONGLONG Next;                  // Sequence the consumer reads next
+	UINT64 Read;
+	UINT64 Dropped;                 // Frames overwritten before the consumer got to them
+	BYTE Padding[64 - sizeof(LONGLONG) - 2 * sizeof(UINT64)];
+} RING_CONSUMER;
+
+typedef struct _FRAMERING_STATS
+{
+	UINT64 Published;
+	UINT64 Failed;                  // Frames not published because the pool had no buffer left
+	UINT Entries;                   // Entries and pool buffers the ring holds
+	UINT64 Read[FRAMERING_MAX_CONSUMERS];
+	UINT64 Dropped[FRAMERING_MAX_CONSUMERS];
+	UINT ConsumerCount;
+} FRAMERING_STATS;
+
+//
+// Single producer ring of the last Size frames. Publish copies a frame into a buffer and
+// replaces the oldest frame with it, so a slow consumer only ever loses the oldest frames and
+// never holds up the producer. Read hands every consumer the frames in order, ReadLatest the
+// newest frame in a bounded number of steps. Buffers are taken from Pool as the ring grows and
+// are kept until it is destroyed, so Pool needs one for every slot, every frame consumers hold
+// at once and the one being published. Consumers only sleep in Read when they have caught up,
+// Publish takes no lock unless one of them does or the ring has to grow.
+//
+class FRAMERING
+{
+	public:
+		FRAMERING();
+		~FRAMERING();
+		DUPL_RETURN Init(_In_ FILE *log_file, _In_ FRAMEPOOL* Pool, UINT Size);
+		DUPL_RETURN AddConsumer(_Out_ UINT* Consumer);
+		DUPL_RETURN Publish(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta);
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN Read(UINT Consumer, _Outptr_result_maybenull_ RING_FRAME** Frame, _Out_ bool* Timeout, UINT TimeoutMs);
+		bool ReadLatest(_Outptr_result_maybenull_ RING_FRAME** Frame);
+		void Release(_In_ RING_FRAME* Frame);
+		void Stop();
+		void GetStats(_Out_ FRAMERING_STATS* Stats);
+
+	private:
+		FILE *m_log_file;
+		FRAMEPOOL* m_Pool;
+		RING_SLOT* m_Slots;
+		UINT m_Size;
+		RING_CONSUMER m_Consumers[FRAMERING_MAX_CONSUMERS];
+		volatile LONG m_ConsumerCount;
+		volatile LONGLONG m_Head;       // Sequence of the newest frame, 0 before the first
+		volatile LONG m_Sleepers;       // Consumers about to wait in Read
+		volatile LONG m_Stopped;
+		CRITICAL_SECTION m_Lock;        // Only taken by consumers that sleep and to wake them
+		CONDITION_VARIABLE m_FrameReady;
+		bool m_LockInitialized;
+		RING_ENTRY* m_FreeList;         // Producer's own
+		RING_ENTRY* volatile m_Returned;        // Pushed by whoever drops the last reference
+		RING_ENTRY* m_AllEntries;
+		UINT m_PreviousWidth;           // Of the frame published before
+		UINT m_PreviousHeight;
+		bool m_ChangedUnknown;          // A frame was not published, the next one counts as changed everywhere
+		FRAMERING_STATS m_Stats;
+
+		RING_ENTRY* AllocateEntry();
+		void ReleaseEntry(_In_ RING_ENTRY* Entry);
+		bool TryReference(LONGLONG Sequence, _Outptr_result_maybenull_ RING_ENTRY** Entry);
+		void GetChanged(_In_ const IMAGE_VIEW* Image, _In_opt_ const FRAME_METADATA* Meta, _Out_ RECT* Changed);
+};
+
+//
+// Metadata with the changed bounds of Frame as its only dirty rect for sinks that update
+// incrementally. Needs a full copy if the consumer's frame before was not Frame's predecessor.
+//
+void GetRingFrameMetaData(_In_ const RING_FRAME* Frame, LONGLONG PreviousSequence, _Out_ FRAME_METADATA* Meta);
+
+#endif
@@ -0,0 +1,647 @@
+// FrameShare.cpp : Ring of frames in a named section shared with reader processes.
+//
+
+#include "FrameShare.h"
+#include "RegionCopy.h"
+
+// Torn reads tolerated by FRAMESHAREREADER::ReadFrame before it gives up
+#define FRAMESHARE_READ_ATTEMPTS    16
+
+// Name of the event of a reader entry, from the section name and the entry
+#define FRAMESHARE_EVENT_FORMAT     "%s.ready.%u"
+
+static UINT64 RoundUpToPage(UINT64 Size)
+{
+	return (Size + FRAMESHARE_PAGE_SIZE - 1) & ~static_cast<UINT64>(FRAMESHARE_PAGE_SIZE - 1);
+}
+
+//
+// Grow Bounds to include Rect, an empty Bounds becomes Rect
+//
+static void AddToBounds(_Inout_ RECT* Bounds, _In_ const RECT* Rect)
+{
+	if (Bounds->right <= Bounds->left || Bounds->bottom <= Bounds->top)
+	{
+		*Bounds = *Rect;
+		return;
+	}
+	Bounds->left = min(Bounds->left, Rect->left);
+	Bounds->top = min(Bounds->top, Rect->top);
+	Bounds->right = max(Bounds->right, Rect->right);
+	Bounds->bottom = max(Bounds->bottom, Rect->bottom);
+}
+
+FRAMESHARE::FRAMESHARE() : m_log_file(nullptr),
+						   m_Mapping(nullptr),
+						   m_View(nullptr),
+						   m_Header(nullptr),
+						   m_Width(0),
+						   m_Height(0),
+						   m_Format(DXGI_FORMAT_UNKNOWN),
+						   m_ChangedUnknown(false)
+{
+	m_Name[0] = '\0';
+	RtlZeroMemory(m_ReaderEvents, sizeof(m_ReaderEvents));
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+FRAMESHARE::~FRAMESHARE()
+{
+	Close();
+}
+
+//
+// Create the section Name with SlotCount slots of SlotSize pixel bytes each. Fails if another
+// publisher already owns the name.
+//
+DUPL_RETURN FRAMESHARE::Init(_In_ FILE *log_file, _In_z_ const char* Name, UINT SlotSize, UINT SlotCount)
+{
+	m_log_file = log_file;
+	if (strcpy_s(m_Name, Name) != 0)
+	{
+		fprintf_s(m_log_file, "Shared frame name is too long.\n");
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	SlotCount = max(2U, min(SlotCount, static_cast<UINT>(FRAMESHARE_MAX_SLOTS)));
+	UINT64 HeaderSize = RoundUpToPage(sizeof(FRAMESHARE_HEADER));
+	UINT64 SlotStride = RoundUpToPage(SlotSize);
+	UINT64 SectionSize = HeaderSize + SlotStride * SlotCount;
+
+	// Backed by the paging file, so it starts out zeroed and goes away with the last handle
+	m_Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(SectionSize >> 32), static_cast<DWORD>(SectionSize), m_Name);
+	if (!m_Mapping || GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		fprintf_s(m_log_file, "Failed to create shared frames %s with error %u.\n", m_Name, GetLastError());
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	m_View = reinterpret_cast<BYTE*>(MapViewOfFile(m_Mapping, FILE_MAP_WRITE, 0, 0, 0));
+	if (!m_View)
+	{
+		fprintf_s(m_log_file, "Failed to map shared frames %s with error %u.\n", m_Name, GetLastError());
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+	m_Header = reinterpret_cast<FRAMESHARE_HEADER*>(m_View);
+
+	m_Header->Version = FRAMESHARE_VERSION;
+	m_Header->PublisherProcessId = GetCurrentProcessId();
+	m_Header->SlotCount = SlotCount;
+	m_Header->SlotSize = SlotSize;
+	m_Header->SectionSize = SectionSize;
+	QueryPerformanceFrequency(&m_Header->Frequency);
+	for (UINT i = 0; i < SlotCount; ++i)
+	{
+		m_Header->Slots[i].Frame.Offset = HeaderSize + SlotStride * i;
+		SetRectEmpty(&m_Stale[i]);
+		m_StaleAll[i] = true;
+	}
+	WriteRelease(reinterpret_cast<volatile LONG*>(&m_Header->Magic), FRAMESHARE_MAGIC);
+
+	m_Width = 0;
+	m_Height = 0;
+	m_Format = DXGI_FORMAT_UNKNOWN;
+	m_ChangedUnknown = false;
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Make Image the newest frame, replacing the oldest. Only one thread may publish. Returns
+// DUPL_RETURN_ERROR_EXPECTED if the frame doesn't fit into a slot.
+//
+DUPL_RETURN FRAMESHARE::Publish(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta)
+{
+	if (!m_Header)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	LARGE_INTEGER PublishTime;
+	QueryPerformanceCounter(&PublishTime);
+
+	UINT Pitch = GetPackedPitch(Image);
+	if (GetFormatBytesPerPixel(Image->Format) != BPP || static_cast<UINT64>(Pitch) * Image->Height > m_Header->SlotSize)
+	{
+		fprintf_s(m_log_file, "Frame %u of %ux%u doesn't fit into the shared frames.\n", Index, Image->Width, Image->Height);
+		++m_Stats.Failed;
+		m_ChangedUnknown = true;
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	// Every slot has to be rewritten whole after a mode change
+	if (Image->Width != m_Width || Image->Height != m_Height || Image->Format != m_Format)
+	{
+		for (UINT i = 0; i < m_Header->SlotCount; ++i)
+		{
+			m_StaleAll[i] = true;
+		}
+		m_Width = Image->Width;
+		m_Height = Image->Height;
+		m_Format = Image->Format;
+		m_ChangedUnknown = true;
+	}
+	bool Whole = m_ChangedUnknown || !Meta || Meta->FullCopy;
+	m_ChangedUnknown = false;
+
+	LONGLONG Sequence = m_Header->Head + 1;
+	UINT SlotIndex = static_cast<UINT>((Sequence - 1) % m_Header->SlotCount);
+	FRAMESHARE_SLOT* Slot = &m_Header->Slots[SlotIndex];
+	FRAMESHARE_FRAME* Frame = &Slot->Frame;
+	BYTE* Pixels = m_View + Frame->Offset;
+
+	// Readers that see 0, or a different sequence after reading, drop what they read
+	InterlockedExchange64(&Slot->Sequence, 0);
+
+	// The slot still holds the frame from SlotCount frames ago, what changed in between is its
+	// stale bounds plus the rects of this frame
+	UINT Copied = 0;
+	RECT Changed;
+	SetRectEmpty(&Changed);
+	Frame->DirtyCount = 0;
+	if (Whole || m_StaleAll[SlotIndex])
+	{
+		Copied = CopyImagePacked(Pixels, Pitch, Image, nullptr);
+		++m_Stats.FullFrames;
+	}
+	else
+	{
+		Copied = CopyRegions(Pixels, Pitch, Image->Data, Image->Pitch, Image->Width, Image->Height, &m_Stale[SlotIndex], 1);
+	}
+
+	if (!Whole)
+	{
+		// Image already has the moves applied, their destinations are just more changed pixels
+		const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+		const RECT* DirtyRects = reinterpret_cast<const RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+		UINT RectCount = Meta->MoveCount + Meta->DirtyCount;
+		for (UINT i = 0; i < RectCount; ++i)
+		{
+			const RECT* Rect = (i < Meta->MoveCount) ? &MoveRects[i].DestinationRect : &DirtyRects[i - Meta->MoveCount];
+			if (!m_StaleAll[SlotIndex])
+			{
+				Copied += CopyRegions(Pixels, Pitch, Image->Data, Image->Pitch, Image->Width, Image->Height, Rect, 1);
+			}
+			if (RectCount <= FRAMESHARE_MAX_DIRTY_RECTS)
+			{
+				Frame->Dirty[Frame->DirtyCount++] = *Rect;
+			}
+			AddToBounds(&Changed, Rect);
+		}
+		if (RectCount > FRAMESHARE_MAX_DIRTY_RECTS)
+		{
+			Frame->Dirty[Frame->DirtyCount++] = Changed;
+		}
+	}
+
+	Frame->Index = Index;
+	Frame->Width = Image->Width;
+	Frame->Height = Image->Height;
+	Frame->Pitch = Pitch;
+	Frame->Format = Image->Format;
+	Frame->Rotation = Image->Rotation;
+	Frame->CaptureTime = Meta ? Meta->AcquireTime : PublishTime;
+	Frame->PublishTime = PublishTime;
+	Frame->FullFrame = Whole ? TRUE : FALSE;
+
+	WriteRelease64(&Slot->Sequence, Sequence);
+	InterlockedExchange64(&m_Header->Head, Sequence);
+
+	// The other slots now miss this frame's changes
+	for (UINT i = 0; i < m_Header->SlotCount; ++i)
+	{
+		if (i == SlotIndex)
+		{
+			SetRectEmpty(&m_Stale[i]);
+			m_StaleAll[i] = false;
+		}
+		else if (Whole)
+		{
+			m_StaleAll[i] = true;
+		}
+		else if (!IsRectEmpty(&Changed))
+		{
+			AddToBounds(&m_Stale[i], &Changed);
+		}
+	}
+
+	++m_Stats.Published;
+	m_Stats.BytesCopied += Copied;
+
+	WakeReaders();
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Signal the readers that wait for a frame. The exchange that moved Head or set Closed orders
+// it before the Waiting flags are read.
+//
+void FRAMESHARE::WakeReaders()
+{
+	for (UINT i = 0; i < FRAMESHARE_MAX_READERS; ++i)
+	{
+		FRAMESHARE_READER* Reader = &m_Header->Readers[i];
+		if (!ReadAcquire(&Reader->ProcessId) || !ReadAcquire(&Reader->Waiting) || !InterlockedExchange(&Reader->Waiting, 0))
+		{
+			continue;
+		}
+
+		// Keeping the event open keeps it alive for whichever reader gets the entry next
+		if (!m_ReaderEvents[i])
+		{
+			char EventName[MAX_PATH];
+			sprintf_s(EventName, FRAMESHARE_EVENT_FORMAT, m_Name, i);
+			m_ReaderEvents[i] = OpenEventA(EVENT_MODIFY_STATE, FALSE, EventName);
+		}
+		if (m_ReaderEvents[i])
+		{
+			SetEvent(m_ReaderEvents[i]);
+			++m_Stats.Wakeups;
+		}
+	}
+}
+
+UINT FRAMESHARE::GetReaderCount()
+{
+	UINT Count = 0;
+	for (UINT i = 0; m_Header && i < FRAMESHARE_MAX_READERS; ++i)
+	{
+		if (ReadAcquire(&m_Header->Readers[i].ProcessId))
+		{
+			++Count;
+		}
+	}
+
+	return Count;
+}
+
+//
+// Sequence of the last frame the reader furthest behind finished with, the newest frame's without readers
+//
+LONGLONG FRAMESHARE::GetSlowestReader()
+{
+	if (!m_Header)
+	{
+		return 0;
+	}
+
+	LONGLONG Slowest = m_Header->Head;
+	for (UINT i = 0; i < FRAMESHARE_MAX_READERS; ++i)
+	{
+		FRAMESHARE_READER* Reader = &m_Header->Readers[i];
+		if (ReadAcquire(&Reader->ProcessId))
+		{
+			Slowest = min(Slowest, ReadAcquire64(&Reader->LastRead));
+		}
+	}
+
+	return Slowest;
+}
+
+void FRAMESHARE::GetStats(_Out_ FRAMESHARE_STATS* Stats)
+{
+	*Stats = m_Stats;
+}
+
+//
+// Tell the readers no frame will follow and let go of the section, it is gone once they detached
+//
+void FRAMESHARE::Close()
+{
+	if (m_Header)
+	{
+		InterlockedExchange(&m_Header->Closed, 1);
+		WakeReaders();
+		m_Header = nullptr;
+	}
+	if (m_View)
+	{
+		UnmapViewOfFile(m_View);
+		m_View = nullptr;
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+	for (UINT i = 0; i < FRAMESHARE_MAX_READERS; ++i)
+	{
+		if (m_ReaderEvents[i])
+		{
+			CloseHandle(m_ReaderEvents[i]);
+			m_ReaderEvents[i] = nullptr;
+		}
+	}
+}
+
+FRAMESHAREREADER::FRAMESHAREREADER() : m_log_file(nullptr),
+									   m_Mapping(nullptr),
+									   m_Header(nullptr),
+									   m_View(nullptr),
+									   m_Reader(FRAMESHARE_MAX_READERS),
+									   m_Event(nullptr)
+{
+}
+
+FRAMESHAREREADER::~FRAMESHAREREADER()
+{
+	Detach();
+}
+
+//
+// Map the shared frames Name and take a reader entry, the first frame read can be the newest
+//
+DUPL_RETURN FRAMESHAREREADER::Attach(_In_ FILE *log_file, _In_z_ const char* Name)
+{
+	m_log_file = log_file;
+	Detach();
+
+	m_Mapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, Name);
+	if (m_Mapping)
+	{
+		m_Header = reinterpret_cast<FRAMESHARE_HEADER*>(MapViewOfFile(m_Mapping, FILE_MAP_WRITE, 0, 0, sizeof(FRAMESHARE_HEADER)));
+		m_View = reinterpret_cast<const BYTE*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (!m_Header || !m_View || ReadAcquire(reinterpret_cast<volatile LONG*>(&m_Header->Magic)) != FRAMESHARE_MAGIC ||
+		m_Header->Version != FRAMESHARE_VERSION || m_Header->SlotCount > FRAMESHARE_MAX_SLOTS)
+	{
+		fprintf_s(m_log_file, "Failed to open shared frames %s.\n", Name);
+		Detach();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	if (!ClaimReader())
+	{
+		fprintf_s(m_log_file, "Shared frames %s already have %u readers.\n", Name, FRAMESHARE_MAX_READERS);
+		Detach();
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	char EventName[MAX_PATH];
+	sprintf_s(EventName, FRAMESHARE_EVENT_FORMAT, Name, m_Reader);
+	m_Event = CreateEventA(nullptr, FALSE, FALSE, EventName);
+	if (!m_Event)
+	{
+		fprintf_s(m_log_file, "Failed to create reader event %s with error %u.\n", EventName, GetLastError());
+		Detach();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Take a free reader entry. When none is left the entries of processes that exited without
+// detaching are reclaimed.
+//
+bool FRAMESHAREREADER::ClaimReader()
+{
+	LONG ProcessId = static_cast<LONG>(GetCurrentProcessId());
+	for (UINT Pass = 0; Pass < 2; ++Pass)
+	{
+		for (UINT i = 0; i < FRAMESHARE_MAX_READERS; ++i)
+		{
+			FRAMESHARE_READER* Reader = &m_Header->Readers[i];
+			if (InterlockedCompareExchange(&Reader->ProcessId, ProcessId, 0) == 0)
+			{
+				Reader->Waiting = 0;
+				WriteRelease64(&Reader->LastRead, ReadAcquire64(&m_Header->Head));
+				m_Reader = i;
+				return true;
+			}
+		}
+
+		for (UINT i = 0; Pass == 0 && i < FRAMESHARE_MAX_READERS; ++i)
+		{
+			LONG Owner = ReadAcquire(&m_Header->Readers[i].ProcessId);
+			HANDLE Process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(Owner));
+			bool Exited = Process ? (WaitForSingleObject(Process, 0) == WAIT_OBJECT_0) : (GetLastError() == ERROR_INVALID_PARAMETER);
+			if (Process)
+			{
+				CloseHandle(Process);
+			}
+			if (Owner && Exited)
+			{
+				InterlockedCompareExchange(&m_Header->Readers[i].ProcessId, 0, Owner);
+			}
+		}
+	}
+
+	return false;
+}
+
+//
+// Wait at most TimeoutMs for a frame newer than After. Returns DUPL_RETURN_ERROR_EXPECTED once
+// the publisher closed and every frame up to the last is older than After.
+//
+_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+DUPL_RETURN FRAMESHAREREADER::Wait(LONGLONG After, UINT TimeoutMs, _Out_ bool* Timeout)
+{
+	*Timeout = false;
+	if (!m_Header)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	FRAMESHARE_READER* Reader = &m_Header->Readers[m_Reader];
+	ULONGLONG Deadline = GetTickCount64() + TimeoutMs;
+	for (;;)
+	{
+		if (ReadAcquire64(&m_Header->Head) > After)
+		{
+			return DUPL_RETURN_SUCCESS;
+		}
+		if (ReadAcquire(&m_Header->Closed))
+		{
+			return DUPL_RETURN_ERROR_EXPECTED;
+		}
+
+		// Either the publisher sees the flag after moving Head, or Head is seen here
+		InterlockedExchange(&Reader->Waiting, 1);
+		if (ReadAcquire64(&m_Header->Head) > After || ReadAcquire(&m_Header->Closed))
+		{
+			InterlockedExchange(&Reader->Waiting, 0);
+			continue;
+		}
+
+		ULONGLONG Now = GetTickCount64();
+		DWORD Remaining = (TimeoutMs == INFINITE) ? INFINITE : static_cast<DWORD>((Deadline > Now) ? (Deadline - Now) : 0);
+		DWORD Result = WaitForSingleObject(m_Event, Remaining);
+		if (Result == WAIT_TIMEOUT)
+		{
+			InterlockedExchange(&Reader->Waiting, 0);
+			if (ReadAcquire64(&m_Header->Head) <= After)
+			{
+				*Timeout = true;
+				return DUPL_RETURN_SUCCESS;
+			}
+		}
+		else if (Result != WAIT_OBJECT_0)
+		{
+			fprintf_s(m_log_file, "Failed to wait for a shared frame with error %u.\n", GetLastError());
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+	}
+}
+
+LONGLONG FRAMESHAREREADER::GetHead()
+{
+	return m_Header ? ReadAcquire64(&m_Header->Head) : 0;
+}
+
+LONGLONG FRAMESHAREREADER::GetFrequency()
+{
+	return m_Header ? m_Header->Frequency.QuadPart : 0;
+}
+
+//
+// Start reading frame Sequence in place, or the newest frame with 0. Returns
+// DUPL_RETURN_ERROR_EXPECTED if the frame isn't in the ring. The pixels in View->Image may be
+// overwritten while they are used, EndRead tells whether they were.
+//
+DUPL_RETURN FRAMESHAREREADER::BeginRead(LONGLONG Sequence, _Out_ FRAMESHARE_VIEW* View)
+{
+	RtlZeroMemory(View, sizeof(FRAMESHARE_VIEW));
+	if (!m_Header)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	UINT SlotCount = m_Header->SlotCount;
+	LONGLONG Head = ReadAcquire64(&m_Header->Head);
+	if (!Sequence)
+	{
+		Sequence = Head;
+	}
+	if (Sequence <= 0 || Sequence > Head || Sequence <= Head - SlotCount)
+	{
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	UINT SlotIndex = static_cast<UINT>((Sequence - 1) % SlotCount);
+	const FRAMESHARE_SLOT* Slot = &m_Header->Slots[SlotIndex];
+	if (ReadAcquire64(&Slot->Sequence) != Sequence)
+	{
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+	View->Frame = Slot->Frame;
+	MemoryBarrier();
+	if (ReadNoFence64(&Slot->Sequence) != Sequence)
+	{
+		return DUPL_RETURN_ERROR_EXPECTED;
+	}
+
+	const FRAMESHARE_FRAME* Frame = &View->Frame;
+	if (Frame->DirtyCount > FRAMESHARE_MAX_DIRTY_RECTS || Frame->Offset + static_cast<UINT64>(Frame->Pitch) * Frame->Height > m_Header->SectionSize)
+	{
+		fprintf_s(m_log_file, "Shared frame %lld is corrupt.\n", Sequence);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	View->Sequence = Sequence;
+	View->Slot = SlotIndex;
+	View->Image.Data = const_cast<BYTE*>(m_View + Frame->Offset);
+	View->Image.Width = Frame->Width;
+	View->Image.Height = Frame->Height;
+	View->Image.Pitch = Frame->Pitch;
+	View->Image.Format = Frame->Format;
+	View->Image.Rotation = Frame->Rotation;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Finish reading View. Returns false if the publisher replaced the frame meanwhile, then
+// whatever was read from View->Image has to be thrown away.
+//
+bool FRAMESHAREREADER::EndRead(_In_ const FRAMESHARE_VIEW* View)
+{
+	MemoryBarrier();
+	if (ReadNoFence64(&m_Header->Slots[View->Slot].Sequence) != View->Sequence)
+	{
+		return false;
+	}
+
+	FRAMESHARE_READER* Reader = &m_Header->Readers[m_Reader];
+	if (ReadAcquire64(&Reader->LastRead) < View->Sequence)
+	{
+		WriteRelease64(&Reader->LastRead, View->Sequence);
+	}
+
+	return true;
+}
+
+//
+// Copy frame Sequence, or the newest one with 0, into Buffer. Gives up on the newest frame
+// after a few torn reads, on a given one after the first.
+//
+DUPL_RETURN FRAMESHAREREADER::ReadFrame(LONGLONG Sequence, _Out_writes_bytes_(BufferSize) BYTE* Buffer, UINT BufferSize, _Out_ FRAMESHARE_VIEW* View)
+{
+	for (UINT Attempt = 0; Attempt < FRAMESHARE_READ_ATTEMPTS; ++Attempt)
+	{
+		DUPL_RETURN Ret = BeginRead(Sequence, View);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			return Ret;
+		}
+
+		UINT Bytes = View->Image.Pitch * View->Image.Height;
+		if (Bytes > BufferSize)
+		{
+			fprintf_s(m_log_file, "Shared frame %lld does not fit into %u bytes.\n", View->Sequence, BufferSize);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		memcpy(Buffer, View->Image.Data, Bytes);
+
+		if (EndRead(View))
+		{
+			View->Image.Data = Buffer;
+			return DUPL_RETURN_SUCCESS;
+		}
+		if (Sequence)
+		{
+			break;
+		}
+	}
+
+	return DUPL_RETURN_ERROR_EXPECTED;
+}
+
+//
+// Give back the reader entry and unmap the section
+//
+void FRAMESHAREREADER::Detach()
+{
+	if (m_Header && m_Reader < FRAMESHARE_MAX_READERS)
+	{
+		FRAMESHARE_READER* Reader = &m_Header->Readers[m_Reader];
+		Reader->Waiting = 0;
+		InterlockedCompareExchange(&Reader->ProcessId, 0, static_cast<LONG>(GetCurrentProcessId()));
+	}
+	m_Reader = FRAMESHARE_MAX_READERS;
+	if (m_Event)
+	{
+		CloseHandle(m_Event);
+		m_Event = nullptr;
+	}
+	if (m_View)
+	{
+		UnmapViewOfFile(m_View);
+		m_View = nullptr;
+	}
+	if (m_Header)
+	{
+		UnmapViewOfFile(m_Header);
+		m_Header = nullptr;
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+}
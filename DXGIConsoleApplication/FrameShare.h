@@ -0,0 +1,169 @@
+// FrameShare.h : Publishes captured frames to any number of other processes through a named
+// section. The section holds a header and a small ring of frames that readers map and read
+// in place, so a frame is copied once, into the section, no matter how many processes read it.
+//
+// Readers follow the sequence protocol of each slot:
+//   read Sequence, skip the slot while it is 0, use the frame, read Sequence again.
+//   The frame was intact if both values are equal.
+// FRAMESHAREREADER implements it and the wakeup protocol described with FRAMESHARE_READER.
+//
+
+#ifndef _FRAMESHARE_H_
+#define _FRAMESHARE_H_
+
+#include "DuplicationManager.h"
+
+#define FRAMESHARE_MAGIC            0x45524853      // "SHRE"
+#define FRAMESHARE_VERSION          1
+
+#define FRAMESHARE_MAX_SLOTS        8
+#define FRAMESHARE_DEFAULT_SLOTS    4
+#define FRAMESHARE_MAX_READERS      8
+
+// Dirty rects a frame carries, frames with more carry only their bounds
+#define FRAMESHARE_MAX_DIRTY_RECTS  64
+
+// The pixels of every slot start on a page of their own
+#define FRAMESHARE_PAGE_SIZE        4096
+
+//
+// Description of the frame in a slot
+//
+typedef struct _FRAMESHARE_FRAME
+{
+	UINT64 Offset;                  // Of the pixels from the start of the section, fixed for the slot
+	UINT Index;                     // Given to Publish
+	UINT Width;
+	UINT Height;
+	UINT Pitch;                     // Rows are packed, Width * 4 bytes
+	DXGI_FORMAT Format;
+	DXGI_MODE_ROTATION Rotation;
+	LARGE_INTEGER CaptureTime;      // QueryPerformanceCounter ticks, which all processes share
+	LARGE_INTEGER PublishTime;
+	BOOL FullFrame;                 // Everything changed since the frame before, Dirty is empty
+	UINT DirtyCount;
+	RECT Dirty[FRAMESHARE_MAX_DIRTY_RECTS];     // Changed since the frame before, moves included
+} FRAMESHARE_FRAME;
+
+typedef struct _FRAMESHARE_SLOT
+{
+	volatile LONGLONG Sequence;     // Of the frame in the slot, 0 while it is replaced
+	FRAMESHARE_FRAME Frame;
+} FRAMESHARE_SLOT;
+
+//
+// Entry of a reader process. A reader about to wait sets Waiting and checks Head once more,
+// the publisher clears Waiting after it moved Head and only then signals the reader's event
+// <name>.ready.<entry>, so readers that keep up cost the publisher no system call.
+//
+typedef struct _FRAMESHARE_READER
+{
+	volatile LONG ProcessId;        // 0 while the entry is free
+	volatile LONG Waiting;
+	volatile LONGLONG LastRead;     // Sequence of the last frame the reader finished with
+	BYTE Padding[64 - 2 * sizeof(LONG) - sizeof(LONGLONG)];
+} FRAMESHARE_READER;
+
+//
+// Start of the section. Magic is written last, readers must not use a section without it.
+//
+typedef struct _FRAMESHARE_HEADER
+{
+	DWORD Magic;
+	DWORD Version;
+	DWORD PublisherProcessId;
+	UINT SlotCount;
+	UINT SlotSize;                  // Pixel bytes each slot has room for
+	UINT64 SectionSize;
+	LARGE_INTEGER Frequency;        // Of QueryPerformanceCounter
+	volatile LONGLONG Head;         // Sequence of the newest frame, 0 before the first
+	volatile LONG Closed;           // The publisher is gone, no frame will follow
+	FRAMESHARE_READER Readers[FRAMESHARE_MAX_READERS];
+	FRAMESHARE_SLOT Slots[FRAMESHARE_MAX_SLOTS];        // Frame with sequence S is in slot (S - 1) % SlotCount
+} FRAMESHARE_HEADER;
+
+typedef struct _FRAMESHARE_STATS
+{
+	UINT64 Published;
+	UINT64 Failed;                  // Frames not published because they didn't fit into a slot
+	UINT64 FullFrames;              // Frames copied whole instead of by their changed regions
+	UINT64 BytesCopied;             // Into the section
+	UINT64 Wakeups;                 // Events signaled for waiting readers
+} FRAMESHARE_STATS;
+
+//
+// Publisher side. Publish copies into the slot being replaced only what changed since the
+// frame that slot held, and wakes the readers waiting for a frame. A reader that is slower
+// than the ring loses the oldest frames and never holds up the publisher.
+//
+class FRAMESHARE
+{
+	public:
+		FRAMESHARE();
+		~FRAMESHARE();
+		DUPL_RETURN Init(_In_ FILE *log_file, _In_z_ const char* Name, UINT SlotSize, UINT SlotCount);
+		DUPL_RETURN Publish(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta);
+		UINT GetReaderCount();
+		LONGLONG GetSlowestReader();
+		void GetStats(_Out_ FRAMESHARE_STATS* Stats);
+		void Close();
+
+	private:
+		FILE *m_log_file;
+		char m_Name[MAX_PATH];
+		HANDLE m_Mapping;
+		BYTE* m_View;
+		FRAMESHARE_HEADER* m_Header;
+		HANDLE m_ReaderEvents[FRAMESHARE_MAX_READERS];     // Opened the first time the reader waits
+		RECT m_Stale[FRAMESHARE_MAX_SLOTS];                 // Bounds of what changed since the slot was written
+		bool m_StaleAll[FRAMESHARE_MAX_SLOTS];
+		UINT m_Width;                   // Of the frame published before
+		UINT m_Height;
+		DXGI_FORMAT m_Format;
+		bool m_ChangedUnknown;          // A frame was not published, the next one counts as changed everywhere
+		FRAMESHARE_STATS m_Stats;
+
+		void WakeReaders();
+};
+
+//
+// A frame read in place. Image points into the section, which the reader maps read only.
+//
+typedef struct _FRAMESHARE_VIEW
+{
+	LONGLONG Sequence;
+	UINT Slot;
+	FRAMESHARE_FRAME Frame;
+	IMAGE_VIEW Image;
+} FRAMESHARE_VIEW;
+
+//
+// Reader side, used by the process that maps the section
+//
+class FRAMESHAREREADER
+{
+	public:
+		FRAMESHAREREADER();
+		~FRAMESHAREREADER();
+		DUPL_RETURN Attach(_In_ FILE *log_file, _In_z_ const char* Name);
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN Wait(LONGLONG After, UINT TimeoutMs, _Out_ bool* Timeout);
+		LONGLONG GetHead();
+		LONGLONG GetFrequency();
+		DUPL_RETURN BeginRead(LONGLONG Sequence, _Out_ FRAMESHARE_VIEW* View);
+		bool EndRead(_In_ const FRAMESHARE_VIEW* View);
+		DUPL_RETURN ReadFrame(LONGLONG Sequence, _Out_writes_bytes_(BufferSize) BYTE* Buffer, UINT BufferSize, _Out_ FRAMESHARE_VIEW* View);
+		void Detach();
+
+	private:
+		FILE *m_log_file;
+		HANDLE m_Mapping;
+		FRAMESHARE_HEADER* m_Header;    // Writable, for the reader entry
+		const BYTE* m_View;             // Whole section, read only
+		UINT m_Reader;                  // FRAMESHARE_MAX_READERS without an entry
+		HANDLE m_Event;
+
+		bool ClaimReader();
+};
+
+#endif
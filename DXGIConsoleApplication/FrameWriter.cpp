@@ -0,0 +1,641 @@
+// FrameWriter.cpp : Asynchronous bitmap writer used by the capture loop.
+//
+
+#include "FrameWriter.h"
+
+//
+// Fill in the headers of a top down 32bpp bitmap without padding between rows
+//
+void fill_bitmap_headers(_Out_ BITMAPFILEHEADER *bmfHeader, _Out_ BITMAPINFOHEADER *bi, int width, int height)
+{
+	RtlZeroMemory(bmfHeader, sizeof(BITMAPFILEHEADER));
+	RtlZeroMemory(bi, sizeof(BITMAPINFOHEADER));
+
+	bi->biSize = sizeof(BITMAPINFOHEADER);
+	bi->biWidth = width;
+	//Make the size negative if the image is upside down.
+	bi->biHeight = -height;
+	//There is only one plane in RGB color space where as 3 planes in YUV.
+	bi->biPlanes = 1;
+	//In windows RGB, 8 bit - depth for each of R, G, B and alpha.
+	bi->biBitCount = 32;
+	//We are not compressing the image.
+	bi->biCompression = BI_RGB;
+	// The size, in bytes, of the image. This may be set to zero for BI_RGB bitmaps.
+	bi->biSizeImage = 0;
+	bi->biXPelsPerMeter = 0;
+	bi->biYPelsPerMeter = 0;
+	bi->biClrUsed = 0;
+	bi->biClrImportant = 0;
+
+	// 32bpp rows are always a multiple of 4 bytes, so they need no padding
+	DWORD dwSizeofImage = width * 4 * height;
+
+	// Add the size of the headers to the size of the bitmap to get the total file size
+	DWORD dwSizeofDIB = dwSizeofImage + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+
+	//Offset to where the actual bitmap bits start.
+	bmfHeader->bfOffBits = (DWORD)sizeof(BITMAPFILEHEADER) + (DWORD)sizeof(BITMAPINFOHEADER);
+
+	//Size of the file
+	bmfHeader->bfSize = dwSizeofDIB;
+
+	//bfType must always be BM for Bitmaps
+	bmfHeader->bfType = 0x4D42; //BM
+}
+
+//
+// Write Image as a bitmap. Only the Width pixels of each row are written, whatever the pitch.
+//
+bool save_as_bitmap(_In_ const IMAGE_VIEW *Image, _In_z_ const char *filename)
+{
+	// A file is created, this is where we will save the screen capture.
+
+	FILE *f;
+
+	BITMAPFILEHEADER   bmfHeader;
+	BITMAPINFOHEADER   bi;
+
+	if (GetFormatBytesPerPixel(Image->Format) != 4)
+	{
+		return false;
+	}
+
+	fill_bitmap_headers(&bmfHeader, &bi, Image->Width, Image->Height);
+
+	DWORD dwRowSize = GetPackedPitch(Image);
+	DWORD dwSizeofImage = dwRowSize * Image->Height;
+
+							   // TODO: Handle getting current directory
+	if (fopen_s(&f, filename, "wb") != 0)
+	{
+		return false;
+	}
+
+	DWORD dwBytesWritten = 0;
+	dwBytesWritten += fwrite(&bmfHeader, sizeof(BITMAPFILEHEADER), 1, f);
+	dwBytesWritten += fwrite(&bi, sizeof(BITMAPINFOHEADER), 1, f);
+	if (Image->Pitch == dwRowSize)
+	{
+		dwBytesWritten += fwrite(Image->Data, 1, dwSizeofImage, f);
+	}
+	else
+	{
+		// Leave the padding at the end of each row behind
+		for (UINT y = 0; y < Image->Height; ++y)
+		{
+			dwBytesWritten += fwrite(Image->Data + y * Image->Pitch, 1, dwRowSize, f);
+		}
+	}
+
+	fclose(f);
+
+	return dwBytesWritten == dwSizeofImage + 2;
+}
+
+//
+// Constructor sets up references / variables. The lock lives as long as the writer, Init may run again
+// after Shutdown.
+//
+FRAMEWRITER::FRAMEWRITER() : m_log_file(nullptr),
+							 m_Policy(FRAMEWRITER_POLICY_BLOCK),
+							 m_Terminate(false),
+							 m_Producer(0),
+							 m_LastFrameIndex(RECORDING_NO_FRAME),
+							 m_Queue(nullptr),
+							 m_QueueDepth(0),
+							 m_QueueHead(0),
+							 m_QueueCount(0),
+							 m_Pool(nullptr),
+							 m_Threads(nullptr),
+							 m_ThreadCount(0),
+							 m_Recording(nullptr),
+							 m_RepeatFile(nullptr),
+							 m_CompletionHead(0),
+							 m_CompletionCount(0)
+{
+	RtlZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_Directory[0] = '\0';
+	InitializeCriticalSection(&m_Lock);
+	InitializeConditionVariable(&m_NotEmpty);
+	InitializeConditionVariable(&m_NotFull);
+}
+
+//
+// Destructor drains the queue and stops the writer threads
+//
+FRAMEWRITER::~FRAMEWRITER()
+{
+	Shutdown();
+	DeleteCriticalSection(&m_Lock);
+}
+
+//
+// Allocate the queue and start the writer threads. Frames are copied into buffers from Pool,
+// which should allow QueueDepth + ThreadCount buffers for the writer on top of its other users.
+//
+DUPL_RETURN FRAMEWRITER::Init(_In_ FILE *log_file, UINT QueueDepth, UINT ThreadCount, _In_ FRAMEPOOL* Pool, FRAMEWRITER_POLICY Policy)
+{
+	m_log_file = log_file;
+	if (m_Threads)
+	{
+		fprintf_s(m_log_file, "Frame writer is already running.\n");
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	m_Policy = Policy;
+	m_QueueDepth = QueueDepth ? QueueDepth : 1;
+	m_ThreadCount = ThreadCount ? ThreadCount : 1;
+	m_Pool = Pool;
+	m_Terminate = false;
+	m_Producer = 0;
+
+	QueryPerformanceFrequency(&m_Stats.Frequency);
+	m_Latency.SetFrequency(m_Stats.Frequency.QuadPart);
+
+	m_Queue = new (std::nothrow) FRAME_JOB[m_QueueDepth];
+	m_Threads = new (std::nothrow) HANDLE[m_ThreadCount];
+	if (!m_Queue || !m_Threads)
+	{
+		fprintf_s(m_log_file, "Failed to allocate frame writer queue.\n");
+		CleanRefs();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+	RtlZeroMemory(m_Threads, sizeof(HANDLE) * m_ThreadCount);
+
+	for (UINT i = 0; i < m_ThreadCount; ++i)
+	{
+		m_Threads[i] = CreateThread(nullptr, 0, WriterProc, this, 0, nullptr);
+		if (!m_Threads[i])
+		{
+			fprintf_s(m_log_file, "Failed to create frame writer thread.\n");
+			Shutdown();
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Append frames to Recording instead of writing one bitmap per frame. Call before the first Enqueue.
+//
+void FRAMEWRITER::SetRecording(_In_opt_ RECORDINGWRITER* Recording)
+{
+	m_Recording = Recording;
+}
+
+//
+// Write bitmaps and the repeat file into Directory instead of the working directory. Call before the
+// first Enqueue.
+//
+DUPL_RETURN FRAMEWRITER::SetDirectory(_In_opt_z_ const char* Directory)
+{
+	if (!Directory || !*Directory)
+	{
+		m_Directory[0] = '\0';
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	size_t Length = strlen(Directory);
+	bool Separator = (Directory[Length - 1] == '/' || Directory[Length - 1] == '\\');
+	if (Length + 1 + 16 > sizeof(m_Directory))
+	{
+		fprintf_s(m_log_file ? m_log_file : stderr, "Frame writer directory %s is too long.\n", Directory);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+	sprintf_s(m_Directory, "%s%s", Directory, Separator ? "" : "/");
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Copy the frame into a writer owned buffer without its row padding and queue it. Never touches the disk.
+// Meta is the duplication manager's description of the frame and only used when recording.
+//
+DUPL_RETURN FRAMEWRITER::Enqueue(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta)
+{
+	return QueueJob(Image, Index, Meta);
+}
+
+//
+// Queue an entry recording that frame Index is identical to the one before it, a zero byte chunk
+// when recording and a line in FRAMEWRITER_REPEAT_FILE otherwise
+//
+DUPL_RETURN FRAMEWRITER::EnqueueRepeat(UINT Index)
+{
+	return QueueJob(nullptr, Index, nullptr);
+}
+
+DUPL_RETURN FRAMEWRITER::QueueJob(_In_opt_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta)
+{
+	// The first caller becomes the producer, see the class comment
+	LONG Thread = static_cast<LONG>(GetCurrentThreadId());
+	LONG Producer = InterlockedCompareExchange(&m_Producer, Thread, 0);
+	if (Producer && Producer != Thread)
+	{
+		fprintf_s(m_log_file, "Frame %u was queued from thread %u, the frame writer only takes frames from thread %u.\n",
+			Index, static_cast<UINT>(Thread), static_cast<UINT>(Producer));
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	FRAME_JOB NewJob;
+	RtlZeroMemory(&NewJob, sizeof(NewJob));
+	if (Image)
+	{
+		NewJob.Image = *Image;
+		NewJob.Image.Pitch = GetPackedPitch(Image);
+	}
+	NewJob.Index = Index;
+	NewJob.RepeatOf = Image ? RECORDING_NO_FRAME : m_LastFrameIndex;
+
+	UINT FrameBytes = NewJob.Image.Pitch * NewJob.Image.Height;
+	if (FrameBytes > m_Pool->GetBufferSize())
+	{
+		fprintf_s(m_log_file, "Frame %u is larger than the frame writer buffers.\n", Index);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	QueryPerformanceCounter(&NewJob.EnqueueTime);
+
+	// Repeats show this frame's pixels even if it ends up dropped, the recording then reports them as unresolvable
+	if (Image)
+	{
+		m_LastFrameIndex = Index;
+	}
+
+	// Where the frame spent its time before it got here, pointer only updates have no present time
+	if (Image)
+	{
+		LATENCY_STAMPS* Stamps = &NewJob.Stamps;
+		if (Meta)
+		{
+			Stamps->Ticks[LATENCY_STAMP_PRESENT] = Meta->FrameInfo.LastPresentTime.QuadPart;
+			Stamps->Ticks[LATENCY_STAMP_ACQUIRE] = Meta->AcquireTime.QuadPart;
+			Stamps->Ticks[LATENCY_STAMP_COPY] = Meta->CopyTime.QuadPart;
+			Stamps->Ticks[LATENCY_STAMP_MAP] = Meta->MapTime.QuadPart;
+			Stamps->Ticks[LATENCY_STAMP_READBACK] = Meta->ReadbackTime.QuadPart;
+		}
+		else
+		{
+			Stamps->Ticks[LATENCY_STAMP_READBACK] = NewJob.EnqueueTime.QuadPart;
+		}
+	}
+
+	if (m_Recording)
+	{
+		RECORDING_FRAME_INFO* Info = &NewJob.Info;
+		Info->Index = Index;
+		Info->Flags = Image ? 0 : RECORDING_FLAG_REPEAT;
+		Info->CaptureTime = Meta ? Meta->AcquireTime : NewJob.EnqueueTime;
+		Info->Frequency = m_Stats.Frequency;
+		Info->Width = NewJob.Image.Width;
+		Info->Height = NewJob.Image.Height;
+		Info->Pitch = NewJob.Image.Pitch;
+		Info->Format = NewJob.Image.Format;
+		if (Meta)
+		{
+			Info->FrameInfo = Meta->FrameInfo;
+		}
+
+		// Rects are only worth keeping when they describe the change from the previous frame
+		if (Meta && !Meta->FullCopy && (Meta->MoveCount || Meta->DirtyCount))
+		{
+			NewJob.MetaDataSize = Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT) + Meta->DirtyCount * sizeof(RECT);
+			NewJob.MetaData = new (std::nothrow) BYTE[NewJob.MetaDataSize];
+			if (NewJob.MetaData)
+			{
+				memcpy_s(NewJob.MetaData, NewJob.MetaDataSize, Meta->MetaData, NewJob.MetaDataSize);
+				Info->MoveCount = Meta->MoveCount;
+				Info->DirtyCount = Meta->DirtyCount;
+			}
+			else
+			{
+				NewJob.MetaDataSize = 0;
+			}
+		}
+	}
+
+	EnterCriticalSection(&m_Lock);
+
+	if (m_QueueCount == m_QueueDepth)
+	{
+		switch (m_Policy)
+		{
+			case FRAMEWRITER_POLICY_DROP_NEWEST:
+			{
+				++m_Stats.Dropped;
+				Complete(&NewJob, FRAMEWRITER_RESULT_DROPPED, 0, 0);
+				LeaveCriticalSection(&m_Lock);
+				FreeJob(&NewJob);
+				return DUPL_RETURN_SUCCESS;
+			}
+			case FRAMEWRITER_POLICY_DROP_OLDEST:
+			{
+				Complete(&m_Queue[m_QueueHead], FRAMEWRITER_RESULT_DROPPED, 0, 0);
+				FreeJob(&m_Queue[m_QueueHead]);
+				m_QueueHead = (m_QueueHead + 1) % m_QueueDepth;
+				--m_QueueCount;
+				++m_Stats.Dropped;
+				break;
+			}
+			default:
+			{
+				while (m_QueueCount == m_QueueDepth && !m_Terminate)
+				{
+					SleepConditionVariableCS(&m_NotFull, &m_Lock, INFINITE);
+				}
+				break;
+			}
+		}
+	}
+
+	if (m_Terminate)
+	{
+		LeaveCriticalSection(&m_Lock);
+		FreeJob(&NewJob);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	if (Image)
+	{
+		if (m_Pool->Acquire(&NewJob.Buffer) != DUPL_RETURN_SUCCESS)
+		{
+			// Pool is shared and exhausted, treat it like a full queue
+			++m_Stats.Dropped;
+			Complete(&NewJob, FRAMEWRITER_RESULT_DROPPED, 0, 0);
+			LeaveCriticalSection(&m_Lock);
+			FreeJob(&NewJob);
+			return DUPL_RETURN_SUCCESS;
+		}
+
+		// Copy outside of the lock so writers are not held up by the copy
+		LeaveCriticalSection(&m_Lock);
+		CopyImagePacked(NewJob.Buffer->Data, NewJob.Image.Pitch, Image, &NewJob.Image);
+		LARGE_INTEGER EncodeTime;
+		QueryPerformanceCounter(&EncodeTime);
+		NewJob.Stamps.Ticks[LATENCY_STAMP_ENCODE] = EncodeTime.QuadPart;
+		EnterCriticalSection(&m_Lock);
+	}
+	else
+	{
+		++m_Stats.Repeats;
+	}
+
+	m_Queue[(m_QueueHead + m_QueueCount) % m_QueueDepth] = NewJob;
+	++m_QueueCount;
+
+	++m_Stats.Enqueued;
+	if (m_QueueCount > m_Stats.MaxQueueDepth)
+	{
+		m_Stats.MaxQueueDepth = m_QueueCount;
+	}
+
+	LeaveCriticalSection(&m_Lock);
+	WakeConditionVariable(&m_NotEmpty);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Write out anything still queued, then stop and release the writer threads
+//
+void FRAMEWRITER::Shutdown()
+{
+	EnterCriticalSection(&m_Lock);
+	m_Terminate = true;
+	LeaveCriticalSection(&m_Lock);
+	WakeAllConditionVariable(&m_NotEmpty);
+	WakeAllConditionVariable(&m_NotFull);
+
+	if (m_Threads)
+	{
+		for (UINT i = 0; i < m_ThreadCount; ++i)
+		{
+			if (m_Threads[i])
+			{
+				WaitForSingleObject(m_Threads[i], INFINITE);
+				CloseHandle(m_Threads[i]);
+				m_Threads[i] = nullptr;
+			}
+		}
+	}
+
+	CleanRefs();
+}
+
+//
+// Snapshot of the writer counters
+//
+void FRAMEWRITER::GetStats(_Out_ FRAMEWRITER_STATS* Stats)
+{
+	EnterCriticalSection(&m_Lock);
+	*Stats = m_Stats;
+	LeaveCriticalSection(&m_Lock);
+}
+
+//
+// Move the completions of the frames that finished since the last call into Completions, oldest
+// first. Frames finish out of Index order when there are several writer threads.
+//
+UINT FRAMEWRITER::GetCompletions(_Out_writes_to_(MaxCount, return) FRAMEWRITER_COMPLETION* Completions, UINT MaxCount)
+{
+	EnterCriticalSection(&m_Lock);
+	UINT Count = min(MaxCount, m_CompletionCount);
+	for (UINT i = 0; i < Count; ++i)
+	{
+		Completions[i] = m_Completions[m_CompletionHead];
+		m_CompletionHead = (m_CompletionHead + 1) % FRAMEWRITER_COMPLETIONS;
+	}
+	m_CompletionCount -= Count;
+	LeaveCriticalSection(&m_Lock);
+
+	return Count;
+}
+
+//
+// Record how a frame ended, overwriting the oldest completion nobody read. Called with m_Lock held.
+//
+void FRAMEWRITER::Complete(_In_ const FRAME_JOB* Job, FRAMEWRITER_RESULT Result, LONGLONG WriteTicks, LONGLONG LatencyTicks)
+{
+	if (m_CompletionCount == FRAMEWRITER_COMPLETIONS)
+	{
+		m_CompletionHead = (m_CompletionHead + 1) % FRAMEWRITER_COMPLETIONS;
+		--m_CompletionCount;
+		++m_Stats.CompletionsLost;
+	}
+
+	FRAMEWRITER_COMPLETION* Completion = &m_Completions[(m_CompletionHead + m_CompletionCount) % FRAMEWRITER_COMPLETIONS];
+	Completion->Index = Job->Index;
+	Completion->Result = Result;
+	Completion->Repeat = (Job->Image.Width == 0);
+	Completion->WriteTicks = WriteTicks;
+	Completion->LatencyTicks = LatencyTicks;
+	++m_CompletionCount;
+}
+
+//
+// Append the latency percentiles of every frame written so far to File
+//
+void FRAMEWRITER::WriteLatency(_In_ FILE* File, UINT FrameIndex)
+{
+	EnterCriticalSection(&m_Lock);
+	m_Latency.Write(File, FrameIndex);
+	LeaveCriticalSection(&m_Lock);
+}
+
+//
+// Writer thread entry point. Exits once termination is requested and the queue is empty.
+//
+DWORD WINAPI FRAMEWRITER::WriterProc(_In_ void* Param)
+{
+	FRAMEWRITER* Writer = reinterpret_cast<FRAMEWRITER*>(Param);
+
+	EnterCriticalSection(&Writer->m_Lock);
+	while (true)
+	{
+		while (!Writer->m_QueueCount && !Writer->m_Terminate)
+		{
+			SleepConditionVariableCS(&Writer->m_NotEmpty, &Writer->m_Lock, INFINITE);
+		}
+
+		if (!Writer->m_QueueCount)
+		{
+			break;
+		}
+
+		FRAME_JOB Job = Writer->m_Queue[Writer->m_QueueHead];
+		Writer->m_QueueHead = (Writer->m_QueueHead + 1) % Writer->m_QueueDepth;
+		--Writer->m_QueueCount;
+		LeaveCriticalSection(&Writer->m_Lock);
+		WakeConditionVariable(&Writer->m_NotFull);
+
+		Writer->WriteJob(&Job);
+
+		EnterCriticalSection(&Writer->m_Lock);
+		Writer->FreeJob(&Job);
+	}
+	LeaveCriticalSection(&Writer->m_Lock);
+
+	return 0;
+}
+
+//
+// Write a single frame and record how long it took
+//
+void FRAMEWRITER::WriteJob(_In_ FRAME_JOB* Job)
+{
+	char FileName[MAX_PATH];
+	bool Written = false;
+
+	LARGE_INTEGER WriteStart, WriteEnd;
+	QueryPerformanceCounter(&WriteStart);
+	if (m_Recording)
+	{
+		sprintf_s(FileName, "recording");
+		UINT DataSize = Job->Buffer ? Job->Image.Pitch * Job->Image.Height : 0;
+		Written = m_Recording->Append(&Job->Info, Job->MetaData, Job->MetaDataSize, Job->Buffer ? Job->Image.Data : nullptr, DataSize, Job->RepeatOf) == DUPL_RETURN_SUCCESS;
+	}
+	else if (Job->Buffer)
+	{
+		sprintf_s(FileName, "%s%u.bmp", m_Directory, Job->Index);
+		Written = save_as_bitmap(&Job->Image, FileName);
+	}
+	else
+	{
+		// Repeats are a line in the repeat file, the pixels are those of the previous .bmp
+		sprintf_s(FileName, "%s" FRAMEWRITER_REPEAT_FILE, m_Directory);
+		EnterCriticalSection(&m_Lock);
+		if (!m_RepeatFile && fopen_s(&m_RepeatFile, FileName, "w") != 0)
+		{
+			m_RepeatFile = nullptr;
+		}
+		Written = m_RepeatFile && fprintf_s(m_RepeatFile, "%u\n", Job->Index) > 0;
+		LeaveCriticalSection(&m_Lock);
+	}
+	QueryPerformanceCounter(&WriteEnd);
+
+	LONGLONG WriteTicks = WriteEnd.QuadPart - WriteStart.QuadPart;
+	LONGLONG LatencyTicks = WriteEnd.QuadPart - Job->EnqueueTime.QuadPart;
+
+	EnterCriticalSection(&m_Lock);
+	if (Written)
+	{
+		++m_Stats.Written;
+		m_Stats.TotalWriteTicks += WriteTicks;
+		m_Stats.TotalLatencyTicks += LatencyTicks;
+		if (WriteTicks > m_Stats.MaxWriteTicks)
+		{
+			m_Stats.MaxWriteTicks = WriteTicks;
+		}
+		if (LatencyTicks > m_Stats.MaxLatencyTicks)
+		{
+			m_Stats.MaxLatencyTicks = LatencyTicks;
+		}
+
+		if (Job->Buffer)
+		{
+			Job->Stamps.Ticks[LATENCY_STAMP_WRITTEN] = WriteEnd.QuadPart;
+			m_Latency.Record(&Job->Stamps);
+		}
+	}
+	else
+	{
+		++m_Stats.Failed;
+	}
+	Complete(Job, Written ? FRAMEWRITER_RESULT_WRITTEN : FRAMEWRITER_RESULT_FAILED, WriteTicks, LatencyTicks);
+	LeaveCriticalSection(&m_Lock);
+
+	// Write times are in the stats and the latency report, only failures are worth a line each
+	if (!Written)
+	{
+		fprintf_s(m_log_file, "Failed to write frame %u to %s.\n", Job->Index, FileName);
+	}
+}
+
+//
+// Give the job's buffer back to the pool and release its metadata
+//
+void FRAMEWRITER::FreeJob(_Inout_ FRAME_JOB* Job)
+{
+	if (Job->Buffer)
+	{
+		m_Pool->Release(Job->Buffer);
+		Job->Buffer = nullptr;
+	}
+	if (Job->MetaData)
+	{
+		delete [] Job->MetaData;
+		Job->MetaData = nullptr;
+	}
+}
+
+//
+// Release the queue, returning the buffers of frames that were never written to the pool
+//
+void FRAMEWRITER::CleanRefs()
+{
+	if (m_Queue)
+	{
+		while (m_QueueCount)
+		{
+			FreeJob(&m_Queue[m_QueueHead]);
+			m_QueueHead = (m_QueueHead + 1) % m_QueueDepth;
+			--m_QueueCount;
+		}
+
+		delete [] m_Queue;
+		m_Queue = nullptr;
+	}
+
+	if (m_RepeatFile)
+	{
+		fclose(m_RepeatFile);
+		m_RepeatFile = nullptr;
+	}
+
+	if (m_Threads)
+	{
+		delete [] m_Threads;
+		m_Threads = nullptr;
+	}
+}
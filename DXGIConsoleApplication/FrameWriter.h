@@ -0,0 +1,160 @@
+// FrameWriter.h : Writes captured frames to disk on a pool of background threads
+// so the duplication loop never waits on the file system.
+//
+
+#ifndef _FRAMEWRITER_H_
+#define _FRAMEWRITER_H_
+
+#include "DuplicationManager.h"
+#include "RecordingFile.h"
+#include "FramePool.h"
+#include "LatencyHistogram.h"
+
+// Indices of the frames that repeat the one before them, one per line, when writing bitmaps
+#define FRAMEWRITER_REPEAT_FILE "repeats.txt"
+
+// Completions of the most recent frames kept until GetCompletions reads them
+#define FRAMEWRITER_COMPLETIONS 256
+
+//
+// What Enqueue does when every queue slot is already holding a frame
+//
+typedef enum
+{
+	FRAMEWRITER_POLICY_BLOCK = 0,           // Capture thread waits until a writer frees a slot
+	FRAMEWRITER_POLICY_DROP_NEWEST = 1,     // The incoming frame is discarded
+	FRAMEWRITER_POLICY_DROP_OLDEST = 2      // The oldest queued frame is discarded to make room
+} FRAMEWRITER_POLICY;
+
+//
+// Counters collected by the writer threads. Tick values are QueryPerformanceCounter ticks.
+//
+typedef struct _FRAMEWRITER_STATS
+{
+	UINT Enqueued;
+	UINT Repeats;       // Frames that did not change, zero byte chunks or lines in FRAMEWRITER_REPEAT_FILE
+	UINT Written;
+	UINT Dropped;
+	UINT Failed;
+	UINT MaxQueueDepth;
+	LONGLONG TotalWriteTicks;       // Time spent writing the bitmap or recording chunk
+	LONGLONG MaxWriteTicks;
+	LONGLONG TotalLatencyTicks;     // Time from Enqueue until the frame is on disk
+	LONGLONG MaxLatencyTicks;
+	LARGE_INTEGER Frequency;
+	UINT CompletionsLost;           // Completions overwritten before GetCompletions read them
+} FRAMEWRITER_STATS;
+
+typedef enum
+{
+	FRAMEWRITER_RESULT_WRITTEN = 0,
+	FRAMEWRITER_RESULT_FAILED = 1,
+	FRAMEWRITER_RESULT_DROPPED = 2  // By the queue policy or an exhausted pool, never written
+} FRAMEWRITER_RESULT;
+
+//
+// How one queued frame ended. Tick values are QueryPerformanceCounter ticks, zero for dropped frames.
+//
+typedef struct _FRAMEWRITER_COMPLETION
+{
+	UINT Index;
+	FRAMEWRITER_RESULT Result;
+	bool Repeat;
+	LONGLONG WriteTicks;
+	LONGLONG LatencyTicks;          // From Enqueue until the frame is on disk
+} FRAMEWRITER_COMPLETION;
+
+//
+// A queued frame. The job holds a reference on Buffer and owns MetaData until the frame is written.
+// Image describes the packed copy of the frame in Buffer. A null Buffer marks a repeat of the previous frame.
+//
+typedef struct _FRAME_JOB
+{
+	FRAME_BUFFER* Buffer;
+	IMAGE_VIEW Image;
+	UINT Index;
+	UINT RepeatOf;                      // Frame a repeat shows, the last one queued with pixels before it
+	LARGE_INTEGER EnqueueTime;
+	RECORDING_FRAME_INFO Info;
+	_Field_size_bytes_(MetaDataSize) BYTE* MetaData;
+	UINT MetaDataSize;
+	LATENCY_STAMPS Stamps;
+} FRAME_JOB;
+
+void fill_bitmap_headers(_Out_ BITMAPFILEHEADER *bmfHeader, _Out_ BITMAPINFOHEADER *bi, int width, int height);
+bool save_as_bitmap(_In_ const IMAGE_VIEW *Image, _In_z_ const char *filename);
+
+//
+// Bounded frame queue drained by a configurable number of writer threads.
+// Enqueue and EnqueueRepeat must always be called from the same thread: the frame is copied
+// outside of the lock after its buffer was taken, which relies on no other producer touching
+// the queue in between. A second producer thread is refused with DUPL_RETURN_ERROR_UNEXPECTED.
+//
+class FRAMEWRITER
+{
+	public:
+
+	//methods
+		FRAMEWRITER();
+		~FRAMEWRITER();
+		DUPL_RETURN Init(_In_ FILE *log_file, UINT QueueDepth, UINT ThreadCount, _In_ FRAMEPOOL* Pool, FRAMEWRITER_POLICY Policy);
+		void SetRecording(_In_opt_ RECORDINGWRITER* Recording);
+		DUPL_RETURN SetDirectory(_In_opt_z_ const char* Directory);
+		DUPL_RETURN Enqueue(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta = nullptr);
+		DUPL_RETURN EnqueueRepeat(UINT Index);
+		void Shutdown();
+		void GetStats(_Out_ FRAMEWRITER_STATS* Stats);
+		UINT GetCompletions(_Out_writes_to_(MaxCount, return) FRAMEWRITER_COMPLETION* Completions, UINT MaxCount);
+		void WriteLatency(_In_ FILE* File, UINT FrameIndex);
+
+	private:
+
+	// vars
+		FILE *m_log_file;
+		FRAMEWRITER_POLICY m_Policy;
+		CRITICAL_SECTION m_Lock;
+		CONDITION_VARIABLE m_NotEmpty;
+		CONDITION_VARIABLE m_NotFull;
+		bool m_Terminate;
+		volatile LONG m_Producer;       // Thread id of the only thread that may queue frames
+		UINT m_LastFrameIndex;          // Last frame queued with pixels, only touched by the producer
+
+		// Ring of queued jobs
+		FRAME_JOB* m_Queue;
+		UINT m_QueueDepth;
+		UINT m_QueueHead;
+		UINT m_QueueCount;
+
+		// Frames are copied into buffers from here
+		FRAMEPOOL* m_Pool;
+
+		HANDLE* m_Threads;
+		UINT m_ThreadCount;
+
+		FRAMEWRITER_STATS m_Stats;
+		LATENCYREPORT m_Latency;
+
+		// Frames are appended here instead of written as bitmaps when set
+		RECORDINGWRITER* m_Recording;
+
+		// Opened by the first repeat written as bitmaps, guarded by m_Lock
+		FILE* m_RepeatFile;
+
+		// Bitmaps and the repeat file go here, empty for the working directory
+		char m_Directory[MAX_PATH];
+
+		// Ring of the frames that finished since GetCompletions last ran, guarded by m_Lock
+		FRAMEWRITER_COMPLETION m_Completions[FRAMEWRITER_COMPLETIONS];
+		UINT m_CompletionHead;
+		UINT m_CompletionCount;
+
+	//methods
+		static DWORD WINAPI WriterProc(_In_ void* Param);
+		DUPL_RETURN QueueJob(_In_opt_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta);
+		void FreeJob(_Inout_ FRAME_JOB* Job);
+		void WriteJob(_In_ FRAME_JOB* Job);
+		void Complete(_In_ const FRAME_JOB* Job, FRAMEWRITER_RESULT Result, LONGLONG WriteTicks, LONGLONG LatencyTicks);
+		void CleanRefs();
+};
+
+#endif
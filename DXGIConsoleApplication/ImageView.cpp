@@ -0,0 +1,94 @@
+// ImageView.cpp : Pixel size lookup and packed row copier for IMAGE_VIEW.
+//
+
+#include "ImageView.h"
+#include <emmintrin.h>
+#include <string.h>
+
+UINT GetFormatBytesPerPixel(DXGI_FORMAT Format)
+{
+	switch (Format)
+	{
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_R10G10B10A2_UNORM:
+		{
+			return 4;
+		}
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		{
+			return 8;
+		}
+		default:
+		{
+			return 0;
+		}
+	}
+}
+
+UINT GetPackedPitch(_In_ const IMAGE_VIEW* View)
+{
+	return View->Width * GetFormatBytesPerPixel(View->Format);
+}
+
+//
+// One row, 64 bytes per iteration. SSE2 is part of the x64 baseline and the default for x86 builds.
+//
+static void CopyRow(_Out_writes_bytes_(Bytes) BYTE* Dst, _In_reads_bytes_(Bytes) const BYTE* Src, UINT Bytes)
+{
+	UINT i = 0;
+	for (; i + 64 <= Bytes; i += 64)
+	{
+		__m128i A = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i));
+		__m128i B = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i + 16));
+		__m128i C = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i + 32));
+		__m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i + 48));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i), A);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i + 16), B);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i + 32), C);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i + 48), D);
+	}
+	for (; i + 16 <= Bytes; i += 16)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i)));
+	}
+	if (i < Bytes)
+	{
+		memcpy(Dst + i, Src + i, Bytes - i);
+	}
+}
+
+UINT CopyImagePacked(_Out_writes_bytes_(DstPitch * Src->Height) BYTE* Dst, UINT DstPitch, _In_ const IMAGE_VIEW* Src, _Out_opt_ IMAGE_VIEW* DstView)
+{
+	UINT RowBytes = GetPackedPitch(Src);
+	if (RowBytes > DstPitch)
+	{
+		RowBytes = DstPitch;
+	}
+
+	if (DstView)
+	{
+		*DstView = *Src;
+		DstView->Data = Dst;
+		DstView->Pitch = DstPitch;
+	}
+
+	// Neither side has padding, the image is one contiguous block
+	if (Src->Pitch == RowBytes && DstPitch == RowBytes)
+	{
+		memcpy(Dst, Src->Data, RowBytes * Src->Height);
+		return RowBytes * Src->Height;
+	}
+
+	const BYTE* SrcRow = Src->Data;
+	for (UINT y = 0; y < Src->Height; ++y)
+	{
+		CopyRow(Dst, SrcRow, RowBytes);
+		Dst += DstPitch;
+		SrcRow += Src->Pitch;
+	}
+
+	return RowBytes * Src->Height;
+}
@@ -0,0 +1,42 @@
+// ImageView.h : Non owning description of a pitched image and a row copier that drops
+// the padding at the end of each row.
+//
+
+#ifndef _IMAGEVIEW_H_
+#define _IMAGEVIEW_H_
+
+#include <windows.h>
+#include <sal.h>
+#include <dxgi1_2.h>
+
+// Bytes per pixel of the BGRA images captured, converted and written
+#define BPP         4
+
+//
+// Pixels of Width x Height in Format, rows are Pitch bytes apart. Pitch may be larger
+// than Width times the pixel size. Rotation is the rotation of the output the image was
+// captured from, the pixels themselves are not rotated.
+//
+typedef struct _IMAGE_VIEW
+{
+	BYTE* Data;
+	UINT Width;
+	UINT Height;
+	UINT Pitch;
+	DXGI_FORMAT Format;
+	DXGI_MODE_ROTATION Rotation;
+} IMAGE_VIEW;
+
+// Bytes per pixel of the formats desktop duplication can return, 0 for anything else
+UINT GetFormatBytesPerPixel(DXGI_FORMAT Format);
+
+// Size of a row without padding
+UINT GetPackedPitch(_In_ const IMAGE_VIEW* View);
+
+//
+// Copy the rows of Src into Dst spaced DstPitch bytes apart, only the Width pixels of each row
+// are copied. Dst gets the view of the copy. Returns the number of bytes copied.
+//
+UINT CopyImagePacked(_Out_writes_bytes_(DstPitch * Src->Height) BYTE* Dst, UINT DstPitch, _In_ const IMAGE_VIEW* Src, _Out_opt_ IMAGE_VIEW* DstView);
+
+#endif
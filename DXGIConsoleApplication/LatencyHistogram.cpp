@@ -0,0 +1,244 @@
+// LatencyHistogram.cpp : Log-linear latency histograms of the capture pipeline stages.
+//
+
+#include "LatencyHistogram.h"
+#include <string.h>
+
+static const char* StageNames[LATENCY_STAGE_COUNT] =
+{
+	"present_to_acquire",
+	"acquire_to_copy",
+	"copy_to_map",
+	"map_to_readback",
+	"readback_to_encode",
+	"encode_to_written",
+	"total"
+};
+
+LATENCYHISTOGRAM::LATENCYHISTOGRAM()
+{
+	Reset();
+}
+
+void LATENCYHISTOGRAM::Reset()
+{
+	memset(m_Buckets, 0, sizeof(m_Buckets));
+	m_Count = 0;
+	m_Min = UINT64_MAX;
+	m_Max = 0;
+	m_Sum = 0;
+}
+
+//
+// Values below LATENCY_SUB_BUCKETS get a bucket each. Above that every power of two
+// [2^e, 2^(e+1)) is split into LATENCY_SUB_BUCKETS buckets of 2^(e - LATENCY_SUB_BUCKET_BITS).
+//
+unsigned LATENCYHISTOGRAM::GetBucket(uint64_t Value)
+{
+	if (Value < LATENCY_SUB_BUCKETS)
+	{
+		return static_cast<unsigned>(Value);
+	}
+
+	unsigned Exponent = 0;
+	for (uint64_t v = Value; v > 1; v >>= 1)
+	{
+		++Exponent;
+	}
+
+	if (Exponent >= LATENCY_MAX_EXPONENT)
+	{
+		return LATENCY_BUCKET_COUNT - 1;
+	}
+
+	unsigned Shift = Exponent - LATENCY_SUB_BUCKET_BITS;
+	return (Shift + 1) * LATENCY_SUB_BUCKETS + static_cast<unsigned>((Value >> Shift) - LATENCY_SUB_BUCKETS);
+}
+
+//
+// Largest value that lands in Bucket
+//
+uint64_t LATENCYHISTOGRAM::GetBucketUpperBound(unsigned Bucket)
+{
+	if (Bucket < LATENCY_SUB_BUCKETS)
+	{
+		return Bucket;
+	}
+
+	unsigned Shift = Bucket / LATENCY_SUB_BUCKETS - 1;
+	uint64_t Lower = static_cast<uint64_t>(LATENCY_SUB_BUCKETS + Bucket % LATENCY_SUB_BUCKETS) << Shift;
+	return Lower + (static_cast<uint64_t>(1) << Shift) - 1;
+}
+
+void LATENCYHISTOGRAM::Record(uint64_t Value)
+{
+	++m_Buckets[GetBucket(Value)];
+	++m_Count;
+	m_Sum += static_cast<double>(Value);
+	if (Value < m_Min)
+	{
+		m_Min = Value;
+	}
+	if (Value > m_Max)
+	{
+		m_Max = Value;
+	}
+}
+
+void LATENCYHISTOGRAM::Merge(const LATENCYHISTOGRAM* Other)
+{
+	for (unsigned i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+	{
+		m_Buckets[i] += Other->m_Buckets[i];
+	}
+	m_Count += Other->m_Count;
+	m_Sum += Other->m_Sum;
+	if (Other->m_Min < m_Min)
+	{
+		m_Min = Other->m_Min;
+	}
+	if (Other->m_Max > m_Max)
+	{
+		m_Max = Other->m_Max;
+	}
+}
+
+uint64_t LATENCYHISTOGRAM::GetCount() const
+{
+	return m_Count;
+}
+
+uint64_t LATENCYHISTOGRAM::GetMin() const
+{
+	return m_Count ? m_Min : 0;
+}
+
+uint64_t LATENCYHISTOGRAM::GetMax() const
+{
+	return m_Max;
+}
+
+double LATENCYHISTOGRAM::GetMean() const
+{
+	return m_Count ? m_Sum / m_Count : 0;
+}
+
+//
+// Smallest bucket bound that at least Percentile percent of the values are at or below,
+// clamped to the largest value recorded
+//
+uint64_t LATENCYHISTOGRAM::GetPercentile(double Percentile) const
+{
+	if (!m_Count)
+	{
+		return 0;
+	}
+
+	uint64_t Rank = static_cast<uint64_t>(Percentile / 100.0 * m_Count + 0.5);
+	if (Rank < 1)
+	{
+		Rank = 1;
+	}
+	if (Rank > m_Count)
+	{
+		Rank = m_Count;
+	}
+
+	uint64_t Seen = 0;
+	for (unsigned i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+	{
+		Seen += m_Buckets[i];
+		if (Seen >= Rank)
+		{
+			uint64_t Bound = GetBucketUpperBound(i);
+			return (Bound < m_Max) ? Bound : m_Max;
+		}
+	}
+
+	return m_Max;
+}
+
+LATENCYREPORT::LATENCYREPORT() : m_Frequency(0)
+{
+}
+
+void LATENCYREPORT::SetFrequency(int64_t TicksPerSecond)
+{
+	m_Frequency = TicksPerSecond;
+}
+
+//
+// Add a frame. Stages whose stamps are missing are left out, the total runs from
+// the earliest stamp taken to the frame being written.
+//
+void LATENCYREPORT::Record(const LATENCY_STAMPS* Stamps)
+{
+	if (m_Frequency <= 0)
+	{
+		return;
+	}
+
+	int64_t First = 0;
+	for (unsigned i = 0; i < LATENCY_STAMP_COUNT; ++i)
+	{
+		int64_t Ticks = Stamps->Ticks[i];
+		if (!Ticks)
+		{
+			continue;
+		}
+		if (!First)
+		{
+			First = Ticks;
+		}
+
+		int64_t Previous = i ? Stamps->Ticks[i - 1] : 0;
+		if (Previous && Ticks >= Previous)
+		{
+			m_Stages[i - 1].Record(static_cast<uint64_t>((Ticks - Previous) * 1000000 / m_Frequency));
+		}
+	}
+
+	int64_t Last = Stamps->Ticks[LATENCY_STAMP_WRITTEN];
+	if (First && Last >= First)
+	{
+		m_Stages[LATENCY_STAGE_TOTAL].Record(static_cast<uint64_t>((Last - First) * 1000000 / m_Frequency));
+	}
+}
+
+void LATENCYREPORT::Reset()
+{
+	for (unsigned i = 0; i < LATENCY_STAGE_COUNT; ++i)
+	{
+		m_Stages[i].Reset();
+	}
+}
+
+const LATENCYHISTOGRAM* LATENCYREPORT::GetStage(LATENCY_STAGE Stage) const
+{
+	return &m_Stages[Stage];
+}
+
+const char* LATENCYREPORT::GetStageName(LATENCY_STAGE Stage)
+{
+	return StageNames[Stage];
+}
+
+//
+// One JSON object per stage and line, all values in microseconds
+//
+void LATENCYREPORT::Write(FILE* File, uint32_t FrameIndex) const
+{
+	for (unsigned i = 0; i < LATENCY_STAGE_COUNT; ++i)
+	{
+		const LATENCYHISTOGRAM* Stage = &m_Stages[i];
+		fprintf(File, "{\"frame\":%u,\"stage\":\"%s\",\"count\":%llu,\"min_us\":%llu,\"mean_us\":%.1f,"
+			"\"p50_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}\n",
+			FrameIndex, StageNames[i], static_cast<unsigned long long>(Stage->GetCount()),
+			static_cast<unsigned long long>(Stage->GetMin()), Stage->GetMean(),
+			static_cast<unsigned long long>(Stage->GetPercentile(50.0)),
+			static_cast<unsigned long long>(Stage->GetPercentile(99.0)),
+			static_cast<unsigned long long>(Stage->GetPercentile(99.9)),
+			static_cast<unsigned long long>(Stage->GetMax()));
+	}
+	fflush(File);
+}
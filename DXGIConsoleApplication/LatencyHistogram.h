@@ -0,0 +1,105 @@
+// LatencyHistogram.h : Log-linear latency histograms of the capture pipeline stages.
+// Only depends on the C runtime, timestamps are passed in as plain tick counts.
+//
+
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Every power of two is split into 2^LATENCY_SUB_BUCKET_BITS linear buckets,
+// so a reported value is at most 1/16th above the recorded one
+#define LATENCY_SUB_BUCKET_BITS     4
+#define LATENCY_SUB_BUCKETS         (1 << LATENCY_SUB_BUCKET_BITS)
+
+// Values are clamped to 2^LATENCY_MAX_EXPONENT, about 12 days in microseconds
+#define LATENCY_MAX_EXPONENT        40
+#define LATENCY_BUCKET_COUNT        ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+//
+// Points in the life of a frame, in pipeline order
+//
+typedef enum
+{
+	LATENCY_STAMP_PRESENT = 0,      // DXGI_OUTDUPL_FRAME_INFO::LastPresentTime
+	LATENCY_STAMP_ACQUIRE = 1,      // AcquireNextFrame returned
+	LATENCY_STAMP_COPY = 2,         // Copy into the staging texture was queued
+	LATENCY_STAMP_MAP = 3,          // Staging texture mapped, the GPU copy is done
+	LATENCY_STAMP_READBACK = 4,     // Pixels are in the capture buffer
+	LATENCY_STAMP_ENCODE = 5,       // Frame copied into its writer buffer
+	LATENCY_STAMP_WRITTEN = 6,      // Frame on disk
+	LATENCY_STAMP_COUNT = 7
+} LATENCY_STAMP;
+
+//
+// Time between two consecutive stamps, plus the whole pipeline
+//
+typedef enum
+{
+	LATENCY_STAGE_PRESENT_TO_ACQUIRE = 0,
+	LATENCY_STAGE_ACQUIRE_TO_COPY = 1,
+	LATENCY_STAGE_COPY_TO_MAP = 2,
+	LATENCY_STAGE_MAP_TO_READBACK = 3,
+	LATENCY_STAGE_READBACK_TO_ENCODE = 4,
+	LATENCY_STAGE_ENCODE_TO_WRITTEN = 5,
+	LATENCY_STAGE_TOTAL = 6,
+	LATENCY_STAGE_COUNT = 7
+} LATENCY_STAGE;
+
+//
+// Tick counts of one frame, 0 where the stamp was not taken
+//
+typedef struct _LATENCY_STAMPS
+{
+	int64_t Ticks[LATENCY_STAMP_COUNT];
+} LATENCY_STAMPS;
+
+//
+// Histogram with constant relative error. Not thread safe, the owner serializes access.
+//
+class LATENCYHISTOGRAM
+{
+	public:
+		LATENCYHISTOGRAM();
+		void Record(uint64_t Value);
+		void Merge(const LATENCYHISTOGRAM* Other);
+		void Reset();
+		uint64_t GetCount() const;
+		uint64_t GetMin() const;
+		uint64_t GetMax() const;
+		double GetMean() const;
+		uint64_t GetPercentile(double Percentile) const;
+
+		static unsigned GetBucket(uint64_t Value);
+		static uint64_t GetBucketUpperBound(unsigned Bucket);
+
+	private:
+		uint64_t m_Buckets[LATENCY_BUCKET_COUNT];
+		uint64_t m_Count;
+		uint64_t m_Min;
+		uint64_t m_Max;
+		double m_Sum;
+};
+
+//
+// One histogram per stage, values in microseconds
+//
+class LATENCYREPORT
+{
+	public:
+		LATENCYREPORT();
+		void SetFrequency(int64_t TicksPerSecond);
+		void Record(const LATENCY_STAMPS* Stamps);
+		void Reset();
+		const LATENCYHISTOGRAM* GetStage(LATENCY_STAGE Stage) const;
+		void Write(FILE* File, uint32_t FrameIndex) const;
+
+		static const char* GetStageName(LATENCY_STAGE Stage);
+
+	private:
+		LATENCYHISTOGRAM m_Stages[LATENCY_STAGE_COUNT];
+		int64_t m_Frequency;
+};
+
+#endif
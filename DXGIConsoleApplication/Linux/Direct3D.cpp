@@ -0,0 +1,38 @@
+// Direct3D and DXGI entry points of the Linux build. There is no GPU duplication to be had,
+// so they fail the way they fail on a system without a usable adapter and the capture paths
+// report it through their usual error handling.
+
+#include <d3d11.h>
+#include <dxgi1_2.h>
+
+HRESULT CreateDXGIFactory1(REFIID Riid, void** Factory)
+{
+	UNREFERENCED_PARAMETER(Riid);
+	*Factory = nullptr;
+	return DXGI_ERROR_UNSUPPORTED;
+}
+
+HRESULT D3D11CreateDevice(IDXGIAdapter* Adapter, D3D_DRIVER_TYPE DriverType, HMODULE Software, UINT Flags, const D3D_FEATURE_LEVEL* FeatureLevels,
+	UINT FeatureLevelCount, UINT SDKVersion, ID3D11Device** Device, D3D_FEATURE_LEVEL* FeatureLevel, ID3D11DeviceContext** ImmediateContext)
+{
+	UNREFERENCED_PARAMETER(Adapter);
+	UNREFERENCED_PARAMETER(DriverType);
+	UNREFERENCED_PARAMETER(Software);
+	UNREFERENCED_PARAMETER(Flags);
+	UNREFERENCED_PARAMETER(FeatureLevels);
+	UNREFERENCED_PARAMETER(FeatureLevelCount);
+	UNREFERENCED_PARAMETER(SDKVersion);
+	if (Device)
+	{
+		*Device = nullptr;
+	}
+	if (FeatureLevel)
+	{
+		*FeatureLevel = D3D_FEATURE_LEVEL_9_1;
+	}
+	if (ImmediateContext)
+	{
+		*ImmediateContext = nullptr;
+	}
+	return DXGI_ERROR_UNSUPPORTED;
+}
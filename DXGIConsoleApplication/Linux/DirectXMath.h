@@ -0,0 +1,28 @@
+// Stand-in for the DirectXMath types the vertex layouts are declared with
+
+#ifndef _LINUX_DIRECTXMATH_H_
+#define _LINUX_DIRECTXMATH_H_
+
+namespace DirectX
+{
+	struct XMFLOAT2
+	{
+		float x;
+		float y;
+
+		XMFLOAT2() {}
+		XMFLOAT2(float X, float Y) : x(X), y(Y) {}
+	};
+
+	struct XMFLOAT3
+	{
+		float x;
+		float y;
+		float z;
+
+		XMFLOAT3() {}
+		XMFLOAT3(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
+	};
+}
+
+#endif
@@ -0,0 +1,6 @@
+// Stand-in for the Windows SDK version header, there is no SDK version to target here
+
+#ifndef _LINUX_SDKDDKVER_H_
+#define _LINUX_SDKDDKVER_H_
+
+#endif
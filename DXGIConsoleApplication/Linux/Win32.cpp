@@ -0,0 +1,1962 @@
+// Kernel32 functions of the Linux build on top of pthreads and POSIX files.
+// HANDLEs point at a LINUX_OBJECT that records what kind of object it is, so
+// WaitForSingleObject and CloseHandle work on threads, events, processes and files alike.
+// Named events and sections are POSIX shared memory objects, so other processes can open them.
+
+#define _GNU_SOURCE 1
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <new>
+#include <stdio.h>
+#include <windows.h>
+
+typedef enum
+{
+	LINUX_OBJECT_THREAD,
+	LINUX_OBJECT_EVENT,
+	LINUX_OBJECT_FILE,
+	LINUX_OBJECT_MAPPING,
+	LINUX_OBJECT_PROCESS,
+	LINUX_OBJECT_TOKEN
+} LINUX_OBJECT_TYPE;
+
+// How long opening a named object waits for another process to finish creating or removing it
+#define LINUX_SHARED_TIMEOUT_MS 1000
+
+//
+// Every handle points at one of these. References are held by the handle and, for threads,
+// by the running thread, the object is freed when the last one is dropped.
+//
+typedef struct _LINUX_OBJECT
+{
+	LINUX_OBJECT_TYPE Type;
+	volatile LONG References;
+} LINUX_OBJECT;
+
+//
+// Events and thread completion are both a flag guarded by a mutex
+//
+typedef struct _LINUX_SIGNAL
+{
+	pthread_mutex_t Lock;
+	pthread_cond_t Changed;
+	bool ManualReset;
+	bool Signaled;
+} LINUX_SIGNAL;
+
+//
+// First page of a named object. It counts the handles open on the object in every process,
+// the last one closed removes the name like the last handle of a named object does on Windows.
+// Objects of processes that were killed stay in /dev/shm until they are removed by hand.
+//
+typedef struct _LINUX_SHARED
+{
+	volatile LONG References;       // 0 while the object is created or removed
+	LINUX_OBJECT_TYPE Type;
+	volatile LONG Signaled;         // Futex word of an event
+	BOOL ManualReset;
+} LINUX_SHARED;
+
+typedef struct _LINUX_NAMED
+{
+	LINUX_SHARED* Shared;           // Mapped read write in every process
+	char Name[NAME_MAX + 1];        // Of the shared memory object
+} LINUX_NAMED;
+
+//
+// Unnamed events are a LINUX_SIGNAL, named ones the futex word of their LINUX_SHARED
+//
+typedef struct _LINUX_EVENT
+{
+	LINUX_OBJECT Object;
+	LINUX_SIGNAL Signal;
+	LINUX_NAMED* Named;
+} LINUX_EVENT;
+
+typedef struct _LINUX_THREAD
+{
+	LINUX_OBJECT Object;
+	LINUX_SIGNAL Finished;
+	pthread_t Thread;
+	LPTHREAD_START_ROUTINE StartAddress;
+	LPVOID Parameter;
+	volatile LONG ThreadId;
+} LINUX_THREAD;
+
+typedef struct _LINUX_FILE
+{
+	LINUX_OBJECT Object;
+	int Fd;
+	bool Owned;                 // False for the standard handles
+} LINUX_FILE;
+
+typedef struct _LINUX_MAPPING
+{
+	LINUX_OBJECT Object;
+	int Fd;
+	UINT64 Offset;              // Of the section in Fd, past the first page of a named one
+	UINT64 Size;
+	bool Writable;
+	LINUX_NAMED* Named;
+} LINUX_MAPPING;
+
+//
+// Process handles wait on a pidfd, which becomes readable when the process exits
+//
+typedef struct _LINUX_PROCESS
+{
+	LINUX_OBJECT Object;
+	int PidFd;
+	pid_t Pid;
+	bool Child;                 // Started by CreateProcessA, its exit code can be collected
+	bool Reaped;
+	DWORD ExitCode;
+} LINUX_PROCESS;
+
+//
+// Views and VirtualAlloc blocks are unmapped by address only, their length is looked up here
+//
+typedef struct _LINUX_REGION
+{
+	void* Base;
+	size_t Length;
+	_LINUX_REGION* Next;
+} LINUX_REGION;
+
+static __thread DWORD LastError = ERROR_SUCCESS;
+static pthread_mutex_t RegionLock = PTHREAD_MUTEX_INITIALIZER;
+static LINUX_REGION* Regions = nullptr;
+static LINUX_OBJECT TokenObject = { LINUX_OBJECT_TOKEN, 1 };
+static LINUX_FILE StdFiles[3] =
+{
+	{ { LINUX_OBJECT_FILE, 1 }, STDIN_FILENO, false },
+	{ { LINUX_OBJECT_FILE, 1 }, STDOUT_FILENO, false },
+	{ { LINUX_OBJECT_FILE, 1 }, STDERR_FILENO, false }
+};
+
+//
+// Win32 error for the errno of a failed call
+//
+static DWORD TranslateErrno(int Error)
+{
+	switch (Error)
+	{
+	case ENOENT:
+		return ERROR_FILE_NOT_FOUND;
+	case EACCES:
+	case EPERM:
+		return ERROR_ACCESS_DENIED;
+	case EBADF:
+		return ERROR_INVALID_HANDLE;
+	case ENOMEM:
+		return ERROR_NOT_ENOUGH_MEMORY;
+	case EEXIST:
+		return ERROR_FILE_EXISTS;
+	case ENOTSUP:
+		return ERROR_NOT_SUPPORTED;
+	default:
+		return ERROR_INVALID_PARAMETER;
+	}
+}
+
+static BOOL FailWithErrno()
+{
+	LastError = TranslateErrno(errno);
+	return FALSE;
+}
+
+DWORD GetLastError()
+{
+	return LastError;
+}
+
+void SetLastError(DWORD Error)
+{
+	LastError = Error;
+}
+
+//
+// Absolute CLOCK_MONOTONIC deadline Milliseconds from now
+//
+static void GetDeadline(DWORD Milliseconds, _Out_ timespec* Deadline)
+{
+	clock_gettime(CLOCK_MONOTONIC, Deadline);
+	Deadline->tv_sec += Milliseconds / 1000;
+	Deadline->tv_nsec += static_cast<long>(Milliseconds % 1000) * 1000000;
+	if (Deadline->tv_nsec >= 1000000000)
+	{
+		Deadline->tv_sec += 1;
+		Deadline->tv_nsec -= 1000000000;
+	}
+}
+
+static void InitCondition(_Out_ pthread_cond_t* Condition)
+{
+	pthread_condattr_t Attributes;
+	pthread_condattr_init(&Attributes);
+	pthread_condattr_setclock(&Attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(Condition, &Attributes);
+	pthread_condattr_destroy(&Attributes);
+}
+
+static void InitSignal(_Out_ LINUX_SIGNAL* Signal, bool ManualReset, bool Signaled)
+{
+	pthread_mutex_init(&Signal->Lock, nullptr);
+	InitCondition(&Signal->Changed);
+	Signal->ManualReset = ManualReset;
+	Signal->Signaled = Signaled;
+}
+
+static void DestroySignal(_Inout_ LINUX_SIGNAL* Signal)
+{
+	pthread_cond_destroy(&Signal->Changed);
+	pthread_mutex_destroy(&Signal->Lock);
+}
+
+static void SetSignal(_Inout_ LINUX_SIGNAL* Signal)
+{
+	pthread_mutex_lock(&Signal->Lock);
+	Signal->Signaled = true;
+	if (Signal->ManualReset)
+	{
+		pthread_cond_broadcast(&Signal->Changed);
+	}
+	else
+	{
+		pthread_cond_signal(&Signal->Changed);
+	}
+	pthread_mutex_unlock(&Signal->Lock);
+}
+
+static DWORD WaitForSignal(_Inout_ LINUX_SIGNAL* Signal, DWORD Milliseconds)
+{
+	timespec Deadline;
+	if (Milliseconds != INFINITE)
+	{
+		GetDeadline(Milliseconds, &Deadline);
+	}
+
+	DWORD Result = WAIT_OBJECT_0;
+	pthread_mutex_lock(&Signal->Lock);
+	while (!Signal->Signaled)
+	{
+		if (Milliseconds == INFINITE)
+		{
+			pthread_cond_wait(&Signal->Changed, &Signal->Lock);
+		}
+		else if (pthread_cond_timedwait(&Signal->Changed, &Signal->Lock, &Deadline) == ETIMEDOUT)
+		{
+			Result = Signal->Signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+			break;
+		}
+	}
+	if (Result == WAIT_OBJECT_0 && !Signal->ManualReset)
+	{
+		Signal->Signaled = false;
+	}
+	pthread_mutex_unlock(&Signal->Lock);
+
+	return Result;
+}
+
+static size_t GetPageSize()
+{
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+//
+// Drop the reference of Named on its object, the last one removes the name
+//
+static void CloseNamed(_In_ LINUX_NAMED* Named)
+{
+	if (!InterlockedDecrement(&Named->Shared->References))
+	{
+		shm_unlink(Named->Name);
+	}
+	munmap(Named->Shared, GetPageSize());
+	delete Named;
+}
+
+//
+// Open the named object Name of Initial->Type, or create it from Initial with Size bytes after
+// its first page. Returns its descriptor, or -1 with LastError set. Like on Windows opening an
+// existing object to create it sets LastError to ERROR_ALREADY_EXISTS.
+//
+static int OpenNamed(_In_z_ LPCSTR Name, _In_ const LINUX_SHARED* Initial, bool Create, UINT64 Size, _Outptr_result_maybenull_ LINUX_NAMED** Named)
+{
+	*Named = new (std::nothrow) LINUX_NAMED;
+	if (!*Named)
+	{
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return -1;
+	}
+
+	// Shared memory names have a single slash, the one they start with
+	int Length = snprintf((*Named)->Name, sizeof((*Named)->Name), "/%s", Name);
+	if (Length <= 1 || Length >= static_cast<int>(sizeof((*Named)->Name)))
+	{
+		delete *Named;
+		*Named = nullptr;
+		LastError = ERROR_INVALID_PARAMETER;
+		return -1;
+	}
+	for (char* Char = (*Named)->Name + 1; *Char; ++Char)
+	{
+		if (*Char == '/' || *Char == '\\')
+		{
+			*Char = '_';
+		}
+	}
+
+	const char* SharedName = (*Named)->Name;
+	size_t PageSize = GetPageSize();
+	ULONGLONG Deadline = GetTickCount64() + LINUX_SHARED_TIMEOUT_MS;
+	DWORD Error = ERROR_SUCCESS;
+	for (;;)
+	{
+		int Fd = Create ? shm_open(SharedName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR) : -1;
+		if (Fd != -1)
+		{
+			void* Page = MAP_FAILED;
+			if (ftruncate(Fd, static_cast<off_t>(PageSize + Size)) == -1 ||
+				(Page = mmap(nullptr, PageSize, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0)) == MAP_FAILED)
+			{
+				Error = TranslateErrno(errno);
+				close(Fd);
+				shm_unlink(SharedName);
+				break;
+			}
+
+			// Openers wait for the reference, so they see the object initialized
+			(*Named)->Shared = reinterpret_cast<LINUX_SHARED*>(Page);
+			*(*Named)->Shared = *Initial;
+			WriteRelease(&(*Named)->Shared->References, 1);
+			LastError = ERROR_SUCCESS;
+			return Fd;
+		}
+		if (Create && errno != EEXIST)
+		{
+			Error = TranslateErrno(errno);
+			break;
+		}
+
+		Fd = shm_open(SharedName, O_RDWR | O_CLOEXEC, 0);
+		if (Fd == -1)
+		{
+			// Removed since, make a new one
+			if (Create && errno == ENOENT)
+			{
+				continue;
+			}
+			Error = TranslateErrno(errno);
+			break;
+		}
+
+		// Only a reference taken before the count dropped to 0 keeps the object
+		struct stat Status;
+		void* Page = (fstat(Fd, &Status) == 0 && static_cast<size_t>(Status.st_size) >= PageSize) ?
+			mmap(nullptr, PageSize, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0) : MAP_FAILED;
+		if (Page != MAP_FAILED)
+		{
+			LINUX_SHARED* Shared = reinterpret_cast<LINUX_SHARED*>(Page);
+			LONG References = ReadAcquire(&Shared->References);
+			while (References)
+			{
+				LONG Seen = InterlockedCompareExchange(&Shared->References, References + 1, References);
+				if (Seen == References)
+				{
+					break;
+				}
+				References = Seen;
+			}
+			if (References)
+			{
+				(*Named)->Shared = Shared;
+				if (Shared->Type != Initial->Type)
+				{
+					close(Fd);
+					CloseNamed(*Named);
+					*Named = nullptr;
+					LastError = ERROR_INVALID_HANDLE;
+					return -1;
+				}
+				LastError = Create ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS;
+				return Fd;
+			}
+			munmap(Page, PageSize);
+		}
+		close(Fd);
+
+		// Another process is between creating the object and taking its reference, or removing it
+		if (GetTickCount64() > Deadline)
+		{
+			Error = ERROR_TIMEOUT;
+			break;
+		}
+		sched_yield();
+	}
+
+	delete *Named;
+	*Named = nullptr;
+	LastError = Error;
+	return -1;
+}
+
+static void SetShared(_Inout_ LINUX_SHARED* Shared)
+{
+	InterlockedExchange(&Shared->Signaled, 1);
+	syscall(SYS_futex, &Shared->Signaled, FUTEX_WAKE, Shared->ManualReset ? INT_MAX : 1, nullptr, nullptr, 0);
+}
+
+//
+// Futex wait on the event word, it returns at once if the word changed from 0 since it was read
+//
+static DWORD WaitForShared(_Inout_ LINUX_SHARED* Shared, DWORD Milliseconds)
+{
+	timespec Deadline;
+	if (Milliseconds != INFINITE)
+	{
+		GetDeadline(Milliseconds, &Deadline);
+	}
+
+	for (;;)
+	{
+		bool Signaled = Shared->ManualReset ? (ReadAcquire(&Shared->Signaled) != 0) : (InterlockedCompareExchange(&Shared->Signaled, 0, 1) == 1);
+		if (Signaled)
+		{
+			return WAIT_OBJECT_0;
+		}
+
+		// The bitset wait takes an absolute CLOCK_MONOTONIC deadline
+		if (syscall(SYS_futex, &Shared->Signaled, FUTEX_WAIT_BITSET, 0, (Milliseconds == INFINITE) ? nullptr : &Deadline, nullptr, FUTEX_BITSET_MATCH_ANY) == -1 &&
+			errno == ETIMEDOUT)
+		{
+			Signaled = Shared->ManualReset ? (ReadAcquire(&Shared->Signaled) != 0) : (InterlockedCompareExchange(&Shared->Signaled, 0, 1) == 1);
+			return Signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+		}
+	}
+}
+
+//
+// Collect the exit code of a child that exited, so it doesn't stay a zombie
+//
+static void ReapProcess(_Inout_ LINUX_PROCESS* Process)
+{
+	int Status;
+	if (!Process->Child || Process->Reaped || waitpid(Process->Pid, &Status, WNOHANG) != Process->Pid)
+	{
+		return;
+	}
+	Process->Reaped = true;
+
+	// Killed processes report their signal the way shells do
+	Process->ExitCode = WIFEXITED(Status) ? static_cast<DWORD>(WEXITSTATUS(Status)) : 128 + static_cast<DWORD>(WTERMSIG(Status));
+}
+
+static DWORD WaitForProcess(_Inout_ LINUX_PROCESS* Process, DWORD Milliseconds)
+{
+	ULONGLONG Deadline = GetTickCount64() + Milliseconds;
+	for (;;)
+	{
+		int Timeout = -1;
+		if (Milliseconds != INFINITE)
+		{
+			ULONGLONG Now = GetTickCount64();
+			Timeout = static_cast<int>(min(static_cast<ULONGLONG>(INT_MAX), (Deadline > Now) ? (Deadline - Now) : 0));
+		}
+
+		pollfd Poll = { Process->PidFd, POLLIN, 0 };
+		int Result = poll(&Poll, 1, Timeout);
+		if (Result > 0)
+		{
+			return WAIT_OBJECT_0;
+		}
+		if (!Result)
+		{
+			return WAIT_TIMEOUT;
+		}
+		if (errno != EINTR)
+		{
+			FailWithErrno();
+			return WAIT_FAILED;
+		}
+	}
+}
+
+static void ReleaseObject(_Inout_ LINUX_OBJECT* Object)
+{
+	if (InterlockedDecrement(&Object->References))
+	{
+		return;
+	}
+
+	switch (Object->Type)
+	{
+	case LINUX_OBJECT_THREAD:
+	{
+		LINUX_THREAD* Thread = reinterpret_cast<LINUX_THREAD*>(Object);
+		DestroySignal(&Thread->Finished);
+		delete Thread;
+		break;
+	}
+	case LINUX_OBJECT_EVENT:
+	{
+		LINUX_EVENT* Event = reinterpret_cast<LINUX_EVENT*>(Object);
+		if (Event->Named)
+		{
+			CloseNamed(Event->Named);
+		}
+		DestroySignal(&Event->Signal);
+		delete Event;
+		break;
+	}
+	case LINUX_OBJECT_FILE:
+	{
+		LINUX_FILE* File = reinterpret_cast<LINUX_FILE*>(Object);
+		if (File->Owned)
+		{
+			close(File->Fd);
+			delete File;
+		}
+		break;
+	}
+	case LINUX_OBJECT_MAPPING:
+	{
+		LINUX_MAPPING* Mapping = reinterpret_cast<LINUX_MAPPING*>(Object);
+		if (Mapping->Named)
+		{
+			CloseNamed(Mapping->Named);
+		}
+		close(Mapping->Fd);
+		delete Mapping;
+		break;
+	}
+	case LINUX_OBJECT_PROCESS:
+	{
+		LINUX_PROCESS* Process = reinterpret_cast<LINUX_PROCESS*>(Object);
+		ReapProcess(Process);
+		close(Process->PidFd);
+		delete Process;
+		break;
+	}
+	case LINUX_OBJECT_TOKEN:
+		break;
+	}
+}
+
+static LINUX_FILE* GetFile(_In_ HANDLE Handle)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(Handle);
+	if (!Object || Handle == INVALID_HANDLE_VALUE || Object->Type != LINUX_OBJECT_FILE)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return nullptr;
+	}
+	return reinterpret_cast<LINUX_FILE*>(Object);
+}
+
+//
+// Critical sections are recursive like on Windows
+//
+void InitializeCriticalSection(_Out_ CRITICAL_SECTION* CriticalSection)
+{
+	pthread_mutexattr_t Attributes;
+	pthread_mutexattr_init(&Attributes);
+	pthread_mutexattr_settype(&Attributes, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_t* Lock = new pthread_mutex_t;
+	pthread_mutex_init(Lock, &Attributes);
+	pthread_mutexattr_destroy(&Attributes);
+	CriticalSection->Lock = Lock;
+}
+
+void DeleteCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection)
+{
+	pthread_mutex_t* Lock = reinterpret_cast<pthread_mutex_t*>(CriticalSection->Lock);
+	pthread_mutex_destroy(Lock);
+	delete Lock;
+	CriticalSection->Lock = nullptr;
+}
+
+void EnterCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection)
+{
+	pthread_mutex_lock(reinterpret_cast<pthread_mutex_t*>(CriticalSection->Lock));
+}
+
+BOOL TryEnterCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection)
+{
+	return pthread_mutex_trylock(reinterpret_cast<pthread_mutex_t*>(CriticalSection->Lock)) == 0;
+}
+
+void LeaveCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection)
+{
+	pthread_mutex_unlock(reinterpret_cast<pthread_mutex_t*>(CriticalSection->Lock));
+}
+
+void InitializeConditionVariable(_Out_ CONDITION_VARIABLE* ConditionVariable)
+{
+	pthread_cond_t* Condition = new pthread_cond_t;
+	InitCondition(Condition);
+	ConditionVariable->Condition = Condition;
+}
+
+BOOL SleepConditionVariableCS(_Inout_ CONDITION_VARIABLE* ConditionVariable, _Inout_ CRITICAL_SECTION* CriticalSection, DWORD Milliseconds)
+{
+	pthread_cond_t* Condition = reinterpret_cast<pthread_cond_t*>(ConditionVariable->Condition);
+	pthread_mutex_t* Lock = reinterpret_cast<pthread_mutex_t*>(CriticalSection->Lock);
+	if (Milliseconds == INFINITE)
+	{
+		pthread_cond_wait(Condition, Lock);
+		return TRUE;
+	}
+
+	timespec Deadline;
+	GetDeadline(Milliseconds, &Deadline);
+	if (pthread_cond_timedwait(Condition, Lock, &Deadline) == ETIMEDOUT)
+	{
+		LastError = WAIT_TIMEOUT;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void WakeConditionVariable(_Inout_ CONDITION_VARIABLE* ConditionVariable)
+{
+	pthread_cond_signal(reinterpret_cast<pthread_cond_t*>(ConditionVariable->Condition));
+}
+
+void WakeAllConditionVariable(_Inout_ CONDITION_VARIABLE* ConditionVariable)
+{
+	pthread_cond_broadcast(reinterpret_cast<pthread_cond_t*>(ConditionVariable->Condition));
+}
+
+//
+// Threads
+//
+static void* ThreadStart(_In_ void* Param)
+{
+	LINUX_THREAD* Thread = reinterpret_cast<LINUX_THREAD*>(Param);
+	WriteRelease(&Thread->ThreadId, static_cast<LONG>(GetCurrentThreadId()));
+	Thread->StartAddress(Thread->Parameter);
+	SetSignal(&Thread->Finished);
+	ReleaseObject(&Thread->Object);
+	return nullptr;
+}
+
+HANDLE CreateThread(_In_opt_ void* Attributes, SIZE_T StackSize, _In_ LPTHREAD_START_ROUTINE StartAddress, _In_opt_ LPVOID Parameter, DWORD CreationFlags, _Out_opt_ LPDWORD ThreadId)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+	UNREFERENCED_PARAMETER(CreationFlags);
+
+	LINUX_THREAD* Thread = new (std::nothrow) LINUX_THREAD;
+	if (!Thread)
+	{
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return nullptr;
+	}
+	Thread->Object.Type = LINUX_OBJECT_THREAD;
+	Thread->Object.References = 2;
+	InitSignal(&Thread->Finished, true, false);
+	Thread->StartAddress = StartAddress;
+	Thread->Parameter = Parameter;
+	Thread->ThreadId = 0;
+
+	pthread_attr_t ThreadAttributes;
+	pthread_attr_init(&ThreadAttributes);
+	pthread_attr_setdetachstate(&ThreadAttributes, PTHREAD_CREATE_DETACHED);
+	if (StackSize)
+	{
+		pthread_attr_setstacksize(&ThreadAttributes, StackSize);
+	}
+	int Error = pthread_create(&Thread->Thread, &ThreadAttributes, ThreadStart, Thread);
+	pthread_attr_destroy(&ThreadAttributes);
+	if (Error)
+	{
+		DestroySignal(&Thread->Finished);
+		delete Thread;
+		LastError = TranslateErrno(Error);
+		return nullptr;
+	}
+
+	if (ThreadId)
+	{
+		while (!ReadAcquire(&Thread->ThreadId))
+		{
+			sched_yield();
+		}
+		*ThreadId = static_cast<DWORD>(Thread->ThreadId);
+	}
+
+	return Thread;
+}
+
+DWORD GetCurrentThreadId()
+{
+	return static_cast<DWORD>(syscall(SYS_gettid));
+}
+
+DWORD GetCurrentProcessId()
+{
+	return static_cast<DWORD>(getpid());
+}
+
+HANDLE GetCurrentProcess()
+{
+	// Pseudo handle, like on Windows
+	return reinterpret_cast<HANDLE>(static_cast<LONG_PTR>(-1));
+}
+
+void Sleep(DWORD Milliseconds)
+{
+	if (!Milliseconds)
+	{
+		sched_yield();
+		return;
+	}
+
+	timespec Duration;
+	Duration.tv_sec = Milliseconds / 1000;
+	Duration.tv_nsec = static_cast<long>(Milliseconds % 1000) * 1000000;
+	while (nanosleep(&Duration, &Duration) == -1 && errno == EINTR)
+	{
+	}
+}
+
+BOOL SwitchToThread()
+{
+	return sched_yield() == 0;
+}
+
+//
+// Events. Named events are shared with other processes, the reset mode and initial state of
+// one that already exists are those it was created with.
+//
+static HANDLE CreateNamedEvent(_In_z_ LPCSTR Name, bool Create, BOOL ManualReset, BOOL InitialState)
+{
+	LINUX_EVENT* Event = new (std::nothrow) LINUX_EVENT;
+	if (!Event)
+	{
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return nullptr;
+	}
+
+	LINUX_SHARED Initial = { 0, LINUX_OBJECT_EVENT, InitialState ? 1 : 0, ManualReset };
+	int Fd = OpenNamed(Name, &Initial, Create, 0, &Event->Named);
+	if (Fd == -1)
+	{
+		delete Event;
+		return nullptr;
+	}
+	close(Fd);
+	Event->Object.Type = LINUX_OBJECT_EVENT;
+	Event->Object.References = 1;
+	InitSignal(&Event->Signal, false, false);
+
+	return Event;
+}
+
+HANDLE CreateEventA(_In_opt_ void* Attributes, BOOL ManualReset, BOOL InitialState, _In_opt_ LPCSTR Name)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+	if (Name)
+	{
+		return CreateNamedEvent(Name, true, ManualReset, InitialState);
+	}
+
+	LINUX_EVENT* Event = new (std::nothrow) LINUX_EVENT;
+	if (!Event)
+	{
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return nullptr;
+	}
+	Event->Object.Type = LINUX_OBJECT_EVENT;
+	Event->Object.References = 1;
+	Event->Named = nullptr;
+	InitSignal(&Event->Signal, ManualReset != FALSE, InitialState != FALSE);
+	LastError = ERROR_SUCCESS;
+
+	return Event;
+}
+
+HANDLE CreateEventW(_In_opt_ void* Attributes, BOOL ManualReset, BOOL InitialState, _In_opt_ LPCWSTR Name)
+{
+	char NarrowName[NAME_MAX];
+	if (Name && wcstombs(NarrowName, Name, sizeof(NarrowName)) >= sizeof(NarrowName))
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return nullptr;
+	}
+	return CreateEventA(Attributes, ManualReset, InitialState, Name ? NarrowName : nullptr);
+}
+
+HANDLE OpenEventA(DWORD DesiredAccess, BOOL InheritHandle, _In_ LPCSTR Name)
+{
+	UNREFERENCED_PARAMETER(DesiredAccess);
+	UNREFERENCED_PARAMETER(InheritHandle);
+	return CreateNamedEvent(Name, false, FALSE, FALSE);
+}
+
+BOOL SetEvent(_In_ HANDLE Event)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(Event);
+	if (!Object || Object->Type != LINUX_OBJECT_EVENT)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	LINUX_EVENT* Target = reinterpret_cast<LINUX_EVENT*>(Object);
+	if (Target->Named)
+	{
+		SetShared(Target->Named->Shared);
+		return TRUE;
+	}
+	SetSignal(&Target->Signal);
+	return TRUE;
+}
+
+BOOL ResetEvent(_In_ HANDLE Event)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(Event);
+	if (!Object || Object->Type != LINUX_OBJECT_EVENT)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	LINUX_EVENT* Target = reinterpret_cast<LINUX_EVENT*>(Object);
+	if (Target->Named)
+	{
+		InterlockedExchange(&Target->Named->Shared->Signaled, 0);
+		return TRUE;
+	}
+	LINUX_SIGNAL* Signal = &Target->Signal;
+	pthread_mutex_lock(&Signal->Lock);
+	Signal->Signaled = false;
+	pthread_mutex_unlock(&Signal->Lock);
+	return TRUE;
+}
+
+DWORD WaitForSingleObject(_In_ HANDLE Handle, DWORD Milliseconds)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(Handle);
+	if (!Object || Handle == INVALID_HANDLE_VALUE)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return WAIT_FAILED;
+	}
+
+	switch (Object->Type)
+	{
+	case LINUX_OBJECT_THREAD:
+		return WaitForSignal(&reinterpret_cast<LINUX_THREAD*>(Object)->Finished, Milliseconds);
+	case LINUX_OBJECT_EVENT:
+	{
+		LINUX_EVENT* Event = reinterpret_cast<LINUX_EVENT*>(Object);
+		return Event->Named ? WaitForShared(Event->Named->Shared, Milliseconds) : WaitForSignal(&Event->Signal, Milliseconds);
+	}
+	case LINUX_OBJECT_PROCESS:
+		return WaitForProcess(reinterpret_cast<LINUX_PROCESS*>(Object), Milliseconds);
+	default:
+		LastError = ERROR_INVALID_HANDLE;
+		return WAIT_FAILED;
+	}
+}
+
+//
+// Waits on the handles one after the other, which is only equivalent when all of them are waited for
+//
+DWORD WaitForMultipleObjects(DWORD Count, _In_reads_(Count) const HANDLE* Handles, BOOL WaitAll, DWORD Milliseconds)
+{
+	if (!WaitAll || Milliseconds != INFINITE)
+	{
+		LastError = ERROR_NOT_SUPPORTED;
+		return WAIT_FAILED;
+	}
+	for (DWORD i = 0; i < Count; ++i)
+	{
+		if (WaitForSingleObject(Handles[i], INFINITE) != WAIT_OBJECT_0)
+		{
+			return WAIT_FAILED;
+		}
+	}
+	return WAIT_OBJECT_0;
+}
+
+BOOL CloseHandle(_In_ HANDLE Handle)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(Handle);
+	if (!Object || Handle == INVALID_HANDLE_VALUE)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	ReleaseObject(Object);
+	return TRUE;
+}
+
+//
+// Thread pool. Submitted callbacks are queued to worker threads that are started with the
+// first submission, one per processor.
+//
+struct _TP_WORK
+{
+	PTP_WORK_CALLBACK Callback;
+	PVOID Context;
+	UINT Pending;               // Submitted and not finished yet, guarded by PoolLock
+	pthread_cond_t Idle;
+};
+
+typedef struct _POOL_ITEM
+{
+	PTP_WORK Work;
+	_POOL_ITEM* Next;
+} POOL_ITEM;
+
+static pthread_mutex_t PoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PoolWake = PTHREAD_COND_INITIALIZER;
+static POOL_ITEM* PoolHead = nullptr;
+static POOL_ITEM* PoolTail = nullptr;
+static bool PoolStarted = false;
+
+static void* PoolWorker(_In_ void* Param)
+{
+	UNREFERENCED_PARAMETER(Param);
+
+	pthread_mutex_lock(&PoolLock);
+	for (;;)
+	{
+		while (!PoolHead)
+		{
+			pthread_cond_wait(&PoolWake, &PoolLock);
+		}
+		POOL_ITEM* Item = PoolHead;
+		PoolHead = Item->Next;
+		if (!PoolHead)
+		{
+			PoolTail = nullptr;
+		}
+		pthread_mutex_unlock(&PoolLock);
+
+		PTP_WORK Work = Item->Work;
+		delete Item;
+		Work->Callback(nullptr, Work->Context, Work);
+
+		pthread_mutex_lock(&PoolLock);
+		if (!--Work->Pending)
+		{
+			pthread_cond_broadcast(&Work->Idle);
+		}
+	}
+	return nullptr;
+}
+
+PTP_WORK CreateThreadpoolWork(_In_ PTP_WORK_CALLBACK Callback, _Inout_opt_ PVOID Context, _In_opt_ PTP_CALLBACK_ENVIRON Environment)
+{
+	UNREFERENCED_PARAMETER(Environment);
+
+	PTP_WORK Work = new (std::nothrow) TP_WORK;
+	if (!Work)
+	{
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return nullptr;
+	}
+	Work->Callback = Callback;
+	Work->Context = Context;
+	Work->Pending = 0;
+	pthread_cond_init(&Work->Idle, nullptr);
+	return Work;
+}
+
+void SubmitThreadpoolWork(_Inout_ PTP_WORK Work)
+{
+	POOL_ITEM* Item = new POOL_ITEM;
+	Item->Work = Work;
+	Item->Next = nullptr;
+
+	pthread_mutex_lock(&PoolLock);
+	if (!PoolStarted)
+	{
+		long Workers = sysconf(_SC_NPROCESSORS_ONLN);
+		for (long i = 0; i < max(Workers, 2L); ++i)
+		{
+			pthread_t Thread;
+			if (pthread_create(&Thread, nullptr, PoolWorker, nullptr) == 0)
+			{
+				pthread_detach(Thread);
+			}
+		}
+		PoolStarted = true;
+	}
+	++Work->Pending;
+	if (PoolTail)
+	{
+		PoolTail->Next = Item;
+	}
+	else
+	{
+		PoolHead = Item;
+	}
+	PoolTail = Item;
+	pthread_cond_signal(&PoolWake);
+	pthread_mutex_unlock(&PoolLock);
+}
+
+void WaitForThreadpoolWorkCallbacks(_Inout_ PTP_WORK Work, BOOL CancelPendingCallbacks)
+{
+	pthread_mutex_lock(&PoolLock);
+	if (CancelPendingCallbacks)
+	{
+		POOL_ITEM** Link = &PoolHead;
+		PoolTail = nullptr;
+		while (*Link)
+		{
+			POOL_ITEM* Item = *Link;
+			if (Item->Work == Work)
+			{
+				*Link = Item->Next;
+				--Work->Pending;
+				delete Item;
+				continue;
+			}
+			PoolTail = Item;
+			Link = &Item->Next;
+		}
+	}
+	while (Work->Pending)
+	{
+		pthread_cond_wait(&Work->Idle, &PoolLock);
+	}
+	pthread_mutex_unlock(&PoolLock);
+}
+
+void CloseThreadpoolWork(_Inout_ PTP_WORK Work)
+{
+	WaitForThreadpoolWorkCallbacks(Work, FALSE);
+	pthread_cond_destroy(&Work->Idle);
+	delete Work;
+}
+
+//
+// Timing. The performance counter runs at 10 MHz like it does on most Windows systems.
+//
+#define LINUX_COUNTER_FREQUENCY 10000000LL
+
+BOOL QueryPerformanceCounter(_Out_ LARGE_INTEGER* PerformanceCount)
+{
+	timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	PerformanceCount->QuadPart = static_cast<LONGLONG>(Now.tv_sec) * LINUX_COUNTER_FREQUENCY + Now.tv_nsec / (1000000000LL / LINUX_COUNTER_FREQUENCY);
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(_Out_ LARGE_INTEGER* Frequency)
+{
+	Frequency->QuadPart = LINUX_COUNTER_FREQUENCY;
+	return TRUE;
+}
+
+ULONGLONG GetTickCount64()
+{
+	timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return static_cast<ULONGLONG>(Now.tv_sec) * 1000 + Now.tv_nsec / 1000000;
+}
+
+DWORD GetTickCount()
+{
+	return static_cast<DWORD>(GetTickCount64());
+}
+
+//
+// Memory
+//
+static void AddRegion(_In_ void* Base, size_t Length)
+{
+	LINUX_REGION* Region = new LINUX_REGION;
+	Region->Base = Base;
+	Region->Length = Length;
+	pthread_mutex_lock(&RegionLock);
+	Region->Next = Regions;
+	Regions = Region;
+	pthread_mutex_unlock(&RegionLock);
+}
+
+//
+// Forget the region starting at Base and return its length, 0 if there is none
+//
+static size_t RemoveRegion(_In_ const void* Base)
+{
+	size_t Length = 0;
+	pthread_mutex_lock(&RegionLock);
+	for (LINUX_REGION** Link = &Regions; *Link; Link = &(*Link)->Next)
+	{
+		if ((*Link)->Base == Base)
+		{
+			LINUX_REGION* Region = *Link;
+			*Link = Region->Next;
+			Length = Region->Length;
+			delete Region;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&RegionLock);
+	return Length;
+}
+
+static size_t FindRegion(_In_ const void* Base)
+{
+	size_t Length = 0;
+	pthread_mutex_lock(&RegionLock);
+	for (LINUX_REGION* Region = Regions; Region; Region = Region->Next)
+	{
+		if (Region->Base == Base)
+		{
+			Length = Region->Length;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&RegionLock);
+	return Length;
+}
+
+//
+// Large pages come from the hugetlb pool. Unless huge pages were reserved that fails, then
+// regular pages are mapped and the kernel is asked to back them with transparent huge pages.
+//
+LPVOID VirtualAlloc(_In_opt_ LPVOID Address, SIZE_T Size, DWORD AllocationType, DWORD Protect)
+{
+	if (Address || !(AllocationType & MEM_COMMIT) || !Size)
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return nullptr;
+	}
+
+	int Protection = (Protect == PAGE_READONLY) ? PROT_READ : (PROT_READ | PROT_WRITE);
+	void* Memory = MAP_FAILED;
+	if (AllocationType & MEM_LARGE_PAGES)
+	{
+		Memory = mmap(nullptr, Size, Protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	if (Memory == MAP_FAILED)
+	{
+		Memory = mmap(nullptr, Size, Protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (Memory == MAP_FAILED)
+		{
+			FailWithErrno();
+			return nullptr;
+		}
+
+		// Only advice, kernels without transparent huge pages keep regular pages
+		if (AllocationType & MEM_LARGE_PAGES)
+		{
+			madvise(Memory, Size, MADV_HUGEPAGE);
+		}
+	}
+	AddRegion(Memory, Size);
+	return Memory;
+}
+
+BOOL VirtualFree(_In_ LPVOID Address, SIZE_T Size, DWORD FreeType)
+{
+	if (FreeType != MEM_RELEASE || Size)
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+	size_t Length = RemoveRegion(Address);
+	if (!Length)
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+	munmap(Address, Length);
+	return TRUE;
+}
+
+//
+// Size of the default huge page, 0 if the kernel has none
+//
+SIZE_T GetLargePageMinimum()
+{
+	FILE* MemInfo = fopen("/proc/meminfo", "r");
+	if (!MemInfo)
+	{
+		return 0;
+	}
+
+	SIZE_T Size = 0;
+	char Line[128];
+	while (fgets(Line, sizeof(Line), MemInfo))
+	{
+		unsigned long Kilobytes;
+		if (sscanf(Line, "Hugepagesize: %lu kB", &Kilobytes) == 1)
+		{
+			Size = static_cast<SIZE_T>(Kilobytes) * 1024;
+			break;
+		}
+	}
+	fclose(MemInfo);
+	return Size;
+}
+
+void GetSystemInfo(_Out_ SYSTEM_INFO* SystemInfo)
+{
+	RtlZeroMemory(SystemInfo, sizeof(SYSTEM_INFO));
+	SystemInfo->dwPageSize = static_cast<DWORD>(sysconf(_SC_PAGESIZE));
+	SystemInfo->dwAllocationGranularity = 65536;
+	long Processors = sysconf(_SC_NPROCESSORS_ONLN);
+	SystemInfo->dwNumberOfProcessors = static_cast<DWORD>(max(Processors, 1L));
+}
+
+//
+// Files. Sharing modes are not enforced.
+//
+HANDLE CreateFileA(_In_ LPCSTR FileName, DWORD DesiredAccess, DWORD ShareMode, _In_opt_ void* Attributes, DWORD CreationDisposition, DWORD FlagsAndAttributes, _In_opt_ HANDLE TemplateFile)
+{
+	UNREFERENCED_PARAMETER(ShareMode);
+	UNREFERENCED_PARAMETER(Attributes);
+	UNREFERENCED_PARAMETER(FlagsAndAttributes);
+	UNREFERENCED_PARAMETER(TemplateFile);
+
+	int Flags = O_CLOEXEC;
+	if ((DesiredAccess & GENERIC_READ) && (DesiredAccess & GENERIC_WRITE))
+	{
+		Flags |= O_RDWR;
+	}
+	else if (DesiredAccess & GENERIC_WRITE)
+	{
+		Flags |= O_WRONLY;
+	}
+	else
+	{
+		Flags |= O_RDONLY;
+	}
+
+	switch (CreationDisposition)
+	{
+	case CREATE_NEW:
+		Flags |= O_CREAT | O_EXCL;
+		break;
+	case CREATE_ALWAYS:
+		Flags |= O_CREAT | O_TRUNC;
+		break;
+	case OPEN_ALWAYS:
+		Flags |= O_CREAT;
+		break;
+	case TRUNCATE_EXISTING:
+		Flags |= O_TRUNC;
+		break;
+	case OPEN_EXISTING:
+		break;
+	default:
+		LastError = ERROR_INVALID_PARAMETER;
+		return INVALID_HANDLE_VALUE;
+	}
+
+	int Fd = open(FileName, Flags, 0644);
+	if (Fd == -1)
+	{
+		FailWithErrno();
+		return INVALID_HANDLE_VALUE;
+	}
+
+	LINUX_FILE* File = new (std::nothrow) LINUX_FILE;
+	if (!File)
+	{
+		close(Fd);
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return INVALID_HANDLE_VALUE;
+	}
+	File->Object.Type = LINUX_OBJECT_FILE;
+	File->Object.References = 1;
+	File->Fd = Fd;
+	File->Owned = true;
+	LastError = ERROR_SUCCESS;
+
+	return File;
+}
+
+//
+// With an OVERLAPPED the transfer is positional and leaves the file pointer alone, otherwise
+// it is synchronous at the file pointer. Overlapped completion is not supported.
+//
+BOOL ReadFile(_In_ HANDLE Handle, _Out_writes_bytes_(BytesToRead) LPVOID Buffer, DWORD BytesToRead, _Out_opt_ LPDWORD BytesRead, _Inout_opt_ OVERLAPPED* Overlapped)
+{
+	LINUX_FILE* File = GetFile(Handle);
+	if (!File)
+	{
+		return FALSE;
+	}
+
+	off_t Offset = Overlapped ? static_cast<off_t>((static_cast<UINT64>(Overlapped->OffsetHigh) << 32) | Overlapped->Offset) : 0;
+	BYTE* Data = reinterpret_cast<BYTE*>(Buffer);
+	DWORD Done = 0;
+	while (Done < BytesToRead)
+	{
+		ssize_t Result = Overlapped ? pread(File->Fd, Data + Done, BytesToRead - Done, Offset + Done) : read(File->Fd, Data + Done, BytesToRead - Done);
+		if (Result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (Result < 0)
+		{
+			return FailWithErrno();
+		}
+		if (!Result)
+		{
+			break;
+		}
+		Done += static_cast<DWORD>(Result);
+	}
+	if (BytesRead)
+	{
+		*BytesRead = Done;
+	}
+	return TRUE;
+}
+
+BOOL WriteFile(_In_ HANDLE Handle, _In_reads_bytes_(BytesToWrite) LPCVOID Buffer, DWORD BytesToWrite, _Out_opt_ LPDWORD BytesWritten, _Inout_opt_ OVERLAPPED* Overlapped)
+{
+	LINUX_FILE* File = GetFile(Handle);
+	if (!File)
+	{
+		return FALSE;
+	}
+
+	off_t Offset = Overlapped ? static_cast<off_t>((static_cast<UINT64>(Overlapped->OffsetHigh) << 32) | Overlapped->Offset) : 0;
+	const BYTE* Data = reinterpret_cast<const BYTE*>(Buffer);
+	DWORD Done = 0;
+	while (Done < BytesToWrite)
+	{
+		ssize_t Result = Overlapped ? pwrite(File->Fd, Data + Done, BytesToWrite - Done, Offset + Done) : write(File->Fd, Data + Done, BytesToWrite - Done);
+		if (Result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (Result <= 0)
+		{
+			if (BytesWritten)
+			{
+				*BytesWritten = Done;
+			}
+			return FailWithErrno();
+		}
+		Done += static_cast<DWORD>(Result);
+	}
+	if (BytesWritten)
+	{
+		*BytesWritten = Done;
+	}
+	return TRUE;
+}
+
+BOOL SetFilePointerEx(_In_ HANDLE Handle, LARGE_INTEGER DistanceToMove, _Out_opt_ LARGE_INTEGER* NewFilePointer, DWORD MoveMethod)
+{
+	LINUX_FILE* File = GetFile(Handle);
+	if (!File)
+	{
+		return FALSE;
+	}
+
+	int Whence = (MoveMethod == FILE_END) ? SEEK_END : (MoveMethod == FILE_CURRENT) ? SEEK_CUR : SEEK_SET;
+	off_t Position = lseek(File->Fd, static_cast<off_t>(DistanceToMove.QuadPart), Whence);
+	if (Position == -1)
+	{
+		return FailWithErrno();
+	}
+	if (NewFilePointer)
+	{
+		NewFilePointer->QuadPart = Position;
+	}
+	return TRUE;
+}
+
+BOOL SetEndOfFile(_In_ HANDLE Handle)
+{
+	LINUX_FILE* File = GetFile(Handle);
+	if (!File)
+	{
+		return FALSE;
+	}
+
+	off_t Position = lseek(File->Fd, 0, SEEK_CUR);
+	if (Position == -1 || ftruncate(File->Fd, Position) == -1)
+	{
+		return FailWithErrno();
+	}
+	return TRUE;
+}
+
+BOOL GetFileSizeEx(_In_ HANDLE Handle, _Out_ LARGE_INTEGER* FileSize)
+{
+	LINUX_FILE* File = GetFile(Handle);
+	if (!File)
+	{
+		return FALSE;
+	}
+
+	struct stat Status;
+	if (fstat(File->Fd, &Status) == -1)
+	{
+		return FailWithErrno();
+	}
+	FileSize->QuadPart = Status.st_size;
+	return TRUE;
+}
+
+BOOL FlushFileBuffers(_In_ HANDLE Handle)
+{
+	LINUX_FILE* File = GetFile(Handle);
+	if (!File)
+	{
+		return FALSE;
+	}
+	return (fdatasync(File->Fd) == 0) ? TRUE : FailWithErrno();
+}
+
+BOOL DeleteFileA(_In_ LPCSTR FileName)
+{
+	return (unlink(FileName) == 0) ? TRUE : FailWithErrno();
+}
+
+BOOL CreateDirectoryA(_In_ LPCSTR PathName, _In_opt_ void* Attributes)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+	return (mkdir(PathName, 0777) == 0) ? TRUE : FailWithErrno();
+}
+
+BOOL RemoveDirectoryA(_In_ LPCSTR PathName)
+{
+	return (rmdir(PathName) == 0) ? TRUE : FailWithErrno();
+}
+
+//
+// $TMPDIR or /tmp, with the trailing slash GetTempPath always ends in
+//
+DWORD GetTempPathA(DWORD BufferLength, _Out_writes_to_opt_(BufferLength, return + 1) LPSTR Buffer)
+{
+	const char* Directory = getenv("TMPDIR");
+	if (!Directory || !*Directory)
+	{
+		Directory = "/tmp";
+	}
+	size_t Length = strlen(Directory);
+	bool Slash = (Directory[Length - 1] != '/');
+	DWORD Needed = static_cast<DWORD>(Length + (Slash ? 1 : 0));
+	if (!Buffer || BufferLength <= Needed)
+	{
+		return Needed + 1;
+	}
+	memcpy(Buffer, Directory, Length);
+	if (Slash)
+	{
+		Buffer[Length] = '/';
+	}
+	Buffer[Needed] = '\0';
+	return Needed;
+}
+
+//
+// File mappings. A mapping of INVALID_HANDLE_VALUE is backed by an anonymous memory file, or by
+// a shared memory object other processes open by name. Named mappings of files are not supported.
+//
+static HANDLE CreateMapping(int Fd, UINT64 Offset, UINT64 Size, bool Writable, _In_opt_ LINUX_NAMED* Named)
+{
+	LINUX_MAPPING* Mapping = new (std::nothrow) LINUX_MAPPING;
+	if (!Mapping)
+	{
+		if (Named)
+		{
+			CloseNamed(Named);
+		}
+		close(Fd);
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return nullptr;
+	}
+	Mapping->Object.Type = LINUX_OBJECT_MAPPING;
+	Mapping->Object.References = 1;
+	Mapping->Fd = Fd;
+	Mapping->Offset = Offset;
+	Mapping->Size = Size;
+	Mapping->Writable = Writable;
+	Mapping->Named = Named;
+
+	return Mapping;
+}
+
+//
+// Named section of Size bytes, or the existing one of that name with the size it was created with
+//
+static HANDLE OpenNamedMapping(_In_z_ LPCSTR Name, bool Create, UINT64 Size, bool Writable)
+{
+	LINUX_SHARED Initial = { 0, LINUX_OBJECT_MAPPING, 0, FALSE };
+	LINUX_NAMED* Named;
+	int Fd = OpenNamed(Name, &Initial, Create, Size, &Named);
+	if (Fd == -1)
+	{
+		return nullptr;
+	}
+	DWORD Error = LastError;
+
+	struct stat Status;
+	if (fstat(Fd, &Status) == -1)
+	{
+		FailWithErrno();
+		CloseNamed(Named);
+		close(Fd);
+		return nullptr;
+	}
+	UINT64 PageSize = GetPageSize();
+	HANDLE Mapping = CreateMapping(Fd, PageSize, static_cast<UINT64>(Status.st_size) - PageSize, Writable, Named);
+	if (Mapping)
+	{
+		LastError = Error;
+	}
+
+	return Mapping;
+}
+
+HANDLE CreateFileMappingA(_In_ HANDLE File, _In_opt_ void* Attributes, DWORD Protect, DWORD MaximumSizeHigh, DWORD MaximumSizeLow, _In_opt_ LPCSTR Name)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+
+	UINT64 Size = (static_cast<UINT64>(MaximumSizeHigh) << 32) | MaximumSizeLow;
+	bool Writable = (Protect == PAGE_READWRITE);
+	int Fd;
+	if (Name && File != INVALID_HANDLE_VALUE)
+	{
+		LastError = ERROR_NOT_SUPPORTED;
+		return nullptr;
+	}
+	if (File == INVALID_HANDLE_VALUE)
+	{
+		if (!Size)
+		{
+			LastError = ERROR_INVALID_PARAMETER;
+			return nullptr;
+		}
+		if (Name)
+		{
+			return OpenNamedMapping(Name, true, Size, Writable);
+		}
+		Fd = memfd_create("section", MFD_CLOEXEC);
+		if (Fd == -1 || ftruncate(Fd, static_cast<off_t>(Size)) == -1)
+		{
+			FailWithErrno();
+			if (Fd != -1)
+			{
+				close(Fd);
+			}
+			return nullptr;
+		}
+	}
+	else
+	{
+		LINUX_FILE* Backing = GetFile(File);
+		if (!Backing)
+		{
+			return nullptr;
+		}
+		Fd = dup(Backing->Fd);
+		struct stat Status;
+		if (Fd == -1 || fstat(Fd, &Status) == -1)
+		{
+			FailWithErrno();
+			if (Fd != -1)
+			{
+				close(Fd);
+			}
+			return nullptr;
+		}
+
+		// Like on Windows a mapping larger than its file grows the file, a size of 0 maps all of it
+		if (!Size)
+		{
+			Size = static_cast<UINT64>(Status.st_size);
+		}
+		else if (Size > static_cast<UINT64>(Status.st_size) && (!Writable || ftruncate(Fd, static_cast<off_t>(Size)) == -1))
+		{
+			LastError = Writable ? TranslateErrno(errno) : ERROR_ACCESS_DENIED;
+			close(Fd);
+			return nullptr;
+		}
+		if (!Size)
+		{
+			LastError = ERROR_INVALID_PARAMETER;
+			close(Fd);
+			return nullptr;
+		}
+	}
+
+	HANDLE Mapping = CreateMapping(Fd, 0, Size, Writable, nullptr);
+	if (Mapping)
+	{
+		LastError = ERROR_SUCCESS;
+	}
+
+	return Mapping;
+}
+
+HANDLE OpenFileMappingA(DWORD DesiredAccess, BOOL InheritHandle, _In_ LPCSTR Name)
+{
+	UNREFERENCED_PARAMETER(InheritHandle);
+	return OpenNamedMapping(Name, false, 0, (DesiredAccess & FILE_MAP_WRITE) != 0);
+}
+
+LPVOID MapViewOfFile(_In_ HANDLE FileMappingObject, DWORD DesiredAccess, DWORD FileOffsetHigh, DWORD FileOffsetLow, SIZE_T NumberOfBytesToMap)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(FileMappingObject);
+	if (!Object || Object->Type != LINUX_OBJECT_MAPPING)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return nullptr;
+	}
+	LINUX_MAPPING* Mapping = reinterpret_cast<LINUX_MAPPING*>(Object);
+
+	UINT64 Offset = (static_cast<UINT64>(FileOffsetHigh) << 32) | FileOffsetLow;
+	bool Write = (DesiredAccess & FILE_MAP_WRITE) != 0;
+	if (Offset >= Mapping->Size || (Write && !Mapping->Writable))
+	{
+		LastError = Write ? ERROR_ACCESS_DENIED : ERROR_INVALID_PARAMETER;
+		return nullptr;
+	}
+	size_t Length = NumberOfBytesToMap ? NumberOfBytesToMap : static_cast<size_t>(Mapping->Size - Offset);
+
+	void* View = mmap(nullptr, Length, Write ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, Mapping->Fd, static_cast<off_t>(Mapping->Offset + Offset));
+	if (View == MAP_FAILED)
+	{
+		FailWithErrno();
+		return nullptr;
+	}
+	AddRegion(View, Length);
+	return View;
+}
+
+BOOL UnmapViewOfFile(_In_ LPCVOID BaseAddress)
+{
+	size_t Length = RemoveRegion(BaseAddress);
+	if (!Length)
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+	munmap(const_cast<void*>(BaseAddress), Length);
+	return TRUE;
+}
+
+BOOL FlushViewOfFile(_In_ LPCVOID BaseAddress, SIZE_T NumberOfBytesToFlush)
+{
+	size_t Length = NumberOfBytesToFlush ? NumberOfBytesToFlush : FindRegion(BaseAddress);
+	if (!Length)
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+	return (msync(const_cast<void*>(BaseAddress), Length, MS_ASYNC) == 0) ? TRUE : FailWithErrno();
+}
+
+//
+// Processes
+//
+HANDLE GetStdHandle(DWORD StdHandle)
+{
+	switch (StdHandle)
+	{
+	case STD_INPUT_HANDLE:
+		return &StdFiles[0];
+	case STD_OUTPUT_HANDLE:
+		return &StdFiles[1];
+	case STD_ERROR_HANDLE:
+		return &StdFiles[2];
+	default:
+		LastError = ERROR_INVALID_PARAMETER;
+		return INVALID_HANDLE_VALUE;
+	}
+}
+
+DWORD GetModuleFileNameA(_In_opt_ HMODULE Module, _Out_writes_(Size) LPSTR FileName, DWORD Size)
+{
+	if (Module || !Size)
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return 0;
+	}
+
+	ssize_t Length = readlink("/proc/self/exe", FileName, Size - 1);
+	if (Length <= 0)
+	{
+		FailWithErrno();
+		return 0;
+	}
+	FileName[Length] = '\0';
+	return static_cast<DWORD>(Length);
+}
+
+//
+// Split a command line into arguments the way the C runtime does on Windows. Spaces outside
+// quotes separate arguments, backslashes only escape quotes. Arguments are written to Buffer,
+// which is as long as CommandLine.
+//
+static int SplitCommandLine(_In_z_ LPCSTR CommandLine, _Out_ char* Buffer, _Out_writes_(MaxArguments) char** Arguments, int MaxArguments)
+{
+	int Count = 0;
+	const char* Char = CommandLine;
+	for (;;)
+	{
+		while (*Char == ' ' || *Char == '\t')
+		{
+			++Char;
+		}
+		if (!*Char || Count == MaxArguments - 1)
+		{
+			break;
+		}
+
+		Arguments[Count++] = Buffer;
+		bool Quoted = false;
+		while (*Char && (Quoted || (*Char != ' ' && *Char != '\t')))
+		{
+			UINT Backslashes = 0;
+			while (*Char == '\\')
+			{
+				++Backslashes;
+				++Char;
+			}
+			if (*Char == '"')
+			{
+				// 2n backslashes are n and the quote toggles quoting, 2n + 1 escape the quote
+				for (UINT i = 0; i < Backslashes / 2; ++i)
+				{
+					*Buffer++ = '\\';
+				}
+				if (Backslashes % 2)
+				{
+					*Buffer++ = '"';
+				}
+				else
+				{
+					Quoted = !Quoted;
+				}
+				++Char;
+				continue;
+			}
+			for (UINT i = 0; i < Backslashes; ++i)
+			{
+				*Buffer++ = '\\';
+			}
+			if (*Char && (Quoted || (*Char != ' ' && *Char != '\t')))
+			{
+				*Buffer++ = *Char++;
+			}
+		}
+		*Buffer++ = '\0';
+	}
+	Arguments[Count] = nullptr;
+
+	return Count;
+}
+
+static HANDLE OpenProcessObject(pid_t Pid, bool Child)
+{
+	LINUX_PROCESS* Process = new (std::nothrow) LINUX_PROCESS;
+	if (!Process)
+	{
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return nullptr;
+	}
+
+	Process->PidFd = static_cast<int>(syscall(SYS_pidfd_open, Pid, 0));
+	if (Process->PidFd == -1)
+	{
+		FailWithErrno();
+		delete Process;
+		return nullptr;
+	}
+	Process->Object.Type = LINUX_OBJECT_PROCESS;
+	Process->Object.References = 1;
+	Process->Pid = Pid;
+	Process->Child = Child;
+	Process->Reaped = false;
+	Process->ExitCode = STILL_ACTIVE;
+
+	return Process;
+}
+
+//
+// Start a process with posix_spawn. Without ApplicationName the first argument is looked up in
+// PATH. The standard handles of StartupInfo are used if it asks for them, every other
+// descriptor not opened close on exec is inherited. A process has no thread handle of its own,
+// hThread is another handle to the process.
+//
+BOOL CreateProcessA(_In_opt_ LPCSTR ApplicationName, _Inout_opt_ LPSTR CommandLine, _In_opt_ void* ProcessAttributes, _In_opt_ void* ThreadAttributes,
+	BOOL InheritHandles, DWORD CreationFlags, _In_opt_ LPVOID Environment, _In_opt_ LPCSTR CurrentDirectory, _In_ STARTUPINFOA* StartupInfo, _Out_ PROCESS_INFORMATION* ProcessInformation)
+{
+	UNREFERENCED_PARAMETER(ProcessAttributes);
+	UNREFERENCED_PARAMETER(ThreadAttributes);
+	UNREFERENCED_PARAMETER(InheritHandles);
+	UNREFERENCED_PARAMETER(CreationFlags);
+	RtlZeroMemory(ProcessInformation, sizeof(PROCESS_INFORMATION));
+	if (Environment || CurrentDirectory || (!ApplicationName && !CommandLine))
+	{
+		LastError = Environment || CurrentDirectory ? ERROR_NOT_SUPPORTED : ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+
+	const char* Line = CommandLine ? CommandLine : ApplicationName;
+	size_t Length = strlen(Line) + 1;
+	int MaxArguments = static_cast<int>(Length / 2 + 2);
+	char* Buffer = new (std::nothrow) char[Length];
+	char** Arguments = new (std::nothrow) char*[MaxArguments];
+	if (!Buffer || !Arguments)
+	{
+		delete [] Buffer;
+		delete [] Arguments;
+		LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return FALSE;
+	}
+	if (!SplitCommandLine(Line, Buffer, Arguments, MaxArguments))
+	{
+		delete [] Buffer;
+		delete [] Arguments;
+		LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+
+	posix_spawn_file_actions_t Actions;
+	posix_spawn_file_actions_init(&Actions);
+	if (StartupInfo->dwFlags & STARTF_USESTDHANDLES)
+	{
+		HANDLE StdHandles[3] = { StartupInfo->hStdInput, StartupInfo->hStdOutput, StartupInfo->hStdError };
+		for (int i = 0; i < 3; ++i)
+		{
+			LINUX_FILE* File = StdHandles[i] ? GetFile(StdHandles[i]) : nullptr;
+			if (File)
+			{
+				posix_spawn_file_actions_adddup2(&Actions, File->Fd, i);
+			}
+		}
+	}
+
+	pid_t Pid;
+	int Error = ApplicationName ? posix_spawn(&Pid, ApplicationName, &Actions, nullptr, Arguments, environ) :
+		posix_spawnp(&Pid, Arguments[0], &Actions, nullptr, Arguments, environ);
+	posix_spawn_file_actions_destroy(&Actions);
+	delete [] Buffer;
+	delete [] Arguments;
+	if (Error)
+	{
+		LastError = TranslateErrno(Error);
+		return FALSE;
+	}
+
+	LINUX_PROCESS* Process = reinterpret_cast<LINUX_PROCESS*>(OpenProcessObject(Pid, true));
+	if (!Process)
+	{
+		// The process runs on, only there is no handle to wait for it
+		return FALSE;
+	}
+	Process->Object.References = 2;
+	ProcessInformation->hProcess = Process;
+	ProcessInformation->hThread = Process;
+	ProcessInformation->dwProcessId = static_cast<DWORD>(Pid);
+	ProcessInformation->dwThreadId = static_cast<DWORD>(Pid);
+	LastError = ERROR_SUCCESS;
+
+	return TRUE;
+}
+
+//
+// Handles to processes can only be waited for. Like on Windows a process that doesn't exist
+// fails with ERROR_INVALID_PARAMETER.
+//
+HANDLE OpenProcess(DWORD DesiredAccess, BOOL InheritHandle, DWORD ProcessId)
+{
+	UNREFERENCED_PARAMETER(DesiredAccess);
+	UNREFERENCED_PARAMETER(InheritHandle);
+	if (!ProcessId || ProcessId > static_cast<DWORD>(INT_MAX))
+	{
+		LastError = ERROR_INVALID_PARAMETER;
+		return nullptr;
+	}
+	return OpenProcessObject(static_cast<pid_t>(ProcessId), false);
+}
+
+//
+// Exit codes are known of processes started by CreateProcessA only
+//
+BOOL GetExitCodeProcess(_In_ HANDLE Process, _Out_ LPDWORD ExitCode)
+{
+	LINUX_OBJECT* Object = reinterpret_cast<LINUX_OBJECT*>(Process);
+	*ExitCode = 0;
+	if (!Object || Process == INVALID_HANDLE_VALUE || Object->Type != LINUX_OBJECT_PROCESS)
+	{
+		LastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+
+	LINUX_PROCESS* Target = reinterpret_cast<LINUX_PROCESS*>(Object);
+	ReapProcess(Target);
+	if (!Target->Child && WaitForProcess(Target, 0) == WAIT_OBJECT_0)
+	{
+		LastError = ERROR_ACCESS_DENIED;
+		return FALSE;
+	}
+	*ExitCode = Target->ExitCode;
+
+	return TRUE;
+}
+
+//
+// Privileges
+//
+BOOL OpenProcessToken(_In_ HANDLE ProcessHandle, DWORD DesiredAccess, _Out_ HANDLE* TokenHandle)
+{
+	UNREFERENCED_PARAMETER(ProcessHandle);
+	UNREFERENCED_PARAMETER(DesiredAccess);
+	InterlockedIncrement(&TokenObject.References);
+	*TokenHandle = &TokenObject;
+	return TRUE;
+}
+
+BOOL LookupPrivilegeValueW(_In_opt_ LPCWSTR SystemName, _In_ LPCWSTR Name, _Out_ LUID* Luid)
+{
+	UNREFERENCED_PARAMETER(SystemName);
+	UNREFERENCED_PARAMETER(Name);
+	Luid->LowPart = 0;
+	Luid->HighPart = 0;
+	return TRUE;
+}
+
+BOOL AdjustTokenPrivileges(_In_ HANDLE TokenHandle, BOOL DisableAllPrivileges, _In_opt_ TOKEN_PRIVILEGES* NewState, DWORD BufferLength, _Out_opt_ TOKEN_PRIVILEGES* PreviousState, _Out_opt_ LPDWORD ReturnLength)
+{
+	UNREFERENCED_PARAMETER(TokenHandle);
+	UNREFERENCED_PARAMETER(DisableAllPrivileges);
+	UNREFERENCED_PARAMETER(NewState);
+	UNREFERENCED_PARAMETER(BufferLength);
+	UNREFERENCED_PARAMETER(PreviousState);
+	if (ReturnLength)
+	{
+		*ReturnLength = 0;
+	}
+	LastError = ERROR_SUCCESS;
+	return TRUE;
+}
+
+int MessageBoxW(_In_opt_ HWND Window, _In_opt_ LPCWSTR Text, _In_opt_ LPCWSTR Caption, UINT Type)
+{
+	UNREFERENCED_PARAMETER(Window);
+	UNREFERENCED_PARAMETER(Type);
+	fprintf(stderr, "%ls: %ls\n", Caption ? Caption : L"", Text ? Text : L"");
+	return 1;
+}
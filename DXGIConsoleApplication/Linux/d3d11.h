@@ -0,0 +1,202 @@
+// Stand-in for the Direct3D 11 interfaces the capture sources use. There is no Direct3D on
+// Linux, D3D11CreateDevice fails with DXGI_ERROR_UNSUPPORTED so no interface is ever handed
+// out. The interfaces are declared as on Windows so the sources compile unchanged.
+
+#ifndef _LINUX_D3D11_H_
+#define _LINUX_D3D11_H_
+
+#include <windows.h>
+#include <dxgi1_2.h>
+
+//
+// Types
+//
+typedef enum D3D_DRIVER_TYPE
+{
+	D3D_DRIVER_TYPE_UNKNOWN = 0,
+	D3D_DRIVER_TYPE_HARDWARE = 1,
+	D3D_DRIVER_TYPE_REFERENCE = 2,
+	D3D_DRIVER_TYPE_NULL = 3,
+	D3D_DRIVER_TYPE_SOFTWARE = 4,
+	D3D_DRIVER_TYPE_WARP = 5
+} D3D_DRIVER_TYPE;
+
+typedef enum D3D_FEATURE_LEVEL
+{
+	D3D_FEATURE_LEVEL_9_1 = 0x9100,
+	D3D_FEATURE_LEVEL_10_0 = 0xa000,
+	D3D_FEATURE_LEVEL_10_1 = 0xa100,
+	D3D_FEATURE_LEVEL_11_0 = 0xb000
+} D3D_FEATURE_LEVEL;
+
+typedef enum D3D11_MAP
+{
+	D3D11_MAP_READ = 1,
+	D3D11_MAP_WRITE = 2,
+	D3D11_MAP_READ_WRITE = 3,
+	D3D11_MAP_WRITE_DISCARD = 4,
+	D3D11_MAP_WRITE_NO_OVERWRITE = 5
+} D3D11_MAP;
+
+typedef enum D3D11_USAGE
+{
+	D3D11_USAGE_DEFAULT = 0,
+	D3D11_USAGE_IMMUTABLE = 1,
+	D3D11_USAGE_DYNAMIC = 2,
+	D3D11_USAGE_STAGING = 3
+} D3D11_USAGE;
+
+#define D3D11_SDK_VERSION 7
+#define D3D11_BIND_VERTEX_BUFFER 0x1L
+#define D3D11_BIND_SHADER_RESOURCE 0x8L
+#define D3D11_BIND_RENDER_TARGET 0x20L
+#define D3D11_CPU_ACCESS_WRITE 0x10000L
+#define D3D11_CPU_ACCESS_READ 0x20000L
+#define D3D11_MAP_FLAG_DO_NOT_WAIT 0x100000L
+#define D3D11_SRV_DIMENSION_TEXTURE2D 4
+#define D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST 4
+
+typedef struct D3D11_TEXTURE2D_DESC
+{
+	UINT Width;
+	UINT Height;
+	UINT MipLevels;
+	UINT ArraySize;
+	DXGI_FORMAT Format;
+	DXGI_SAMPLE_DESC SampleDesc;
+	D3D11_USAGE Usage;
+	UINT BindFlags;
+	UINT CPUAccessFlags;
+	UINT MiscFlags;
+} D3D11_TEXTURE2D_DESC;
+
+typedef struct D3D11_BUFFER_DESC
+{
+	UINT ByteWidth;
+	D3D11_USAGE Usage;
+	UINT BindFlags;
+	UINT CPUAccessFlags;
+	UINT MiscFlags;
+	UINT StructureByteStride;
+} D3D11_BUFFER_DESC;
+
+typedef struct D3D11_SUBRESOURCE_DATA
+{
+	const void* pSysMem;
+	UINT SysMemPitch;
+	UINT SysMemSlicePitch;
+} D3D11_SUBRESOURCE_DATA;
+
+typedef struct D3D11_MAPPED_SUBRESOURCE
+{
+	void* pData;
+	UINT RowPitch;
+	UINT DepthPitch;
+} D3D11_MAPPED_SUBRESOURCE;
+
+typedef struct D3D11_BOX
+{
+	UINT left;
+	UINT top;
+	UINT front;
+	UINT right;
+	UINT bottom;
+	UINT back;
+} D3D11_BOX;
+
+typedef struct D3D11_TEX2D_SRV
+{
+	UINT MostDetailedMip;
+	UINT MipLevels;
+} D3D11_TEX2D_SRV;
+
+typedef struct D3D11_SHADER_RESOURCE_VIEW_DESC
+{
+	DXGI_FORMAT Format;
+	UINT ViewDimension;
+	D3D11_TEX2D_SRV Texture2D;
+} D3D11_SHADER_RESOURCE_VIEW_DESC;
+
+typedef struct D3D11_VIEWPORT
+{
+	FLOAT TopLeftX;
+	FLOAT TopLeftY;
+	FLOAT Width;
+	FLOAT Height;
+	FLOAT MinDepth;
+	FLOAT MaxDepth;
+} D3D11_VIEWPORT;
+
+inline UINT D3D11CalcSubresource(UINT MipSlice, UINT ArraySlice, UINT MipLevels)
+{
+	return MipSlice + ArraySlice * MipLevels;
+}
+
+//
+// Interfaces
+//
+struct ID3D11DeviceChild : public IUnknown
+{
+};
+
+struct ID3D11Resource : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11Texture2D : public ID3D11Resource
+{
+	virtual void STDMETHODCALLTYPE GetDesc(D3D11_TEXTURE2D_DESC* Desc) = 0;
+};
+
+struct ID3D11Buffer : public ID3D11Resource
+{
+	virtual void STDMETHODCALLTYPE GetDesc(D3D11_BUFFER_DESC* Desc) = 0;
+};
+
+struct ID3D11ShaderResourceView : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11RenderTargetView : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11VertexShader : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11PixelShader : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11InputLayout : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11SamplerState : public ID3D11DeviceChild
+{
+};
+
+struct ID3D11DeviceContext : public ID3D11DeviceChild
+{
+	virtual void STDMETHODCALLTYPE CopySubresourceRegion(ID3D11Resource* DstResource, UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ,
+		ID3D11Resource* SrcResource, UINT SrcSubresource, const D3D11_BOX* SrcBox) = 0;
+	virtual void STDMETHODCALLTYPE CopyResource(ID3D11Resource* DstResource, ID3D11Resource* SrcResource) = 0;
+	virtual HRESULT STDMETHODCALLTYPE Map(ID3D11Resource* Resource, UINT Subresource, D3D11_MAP MapType, UINT MapFlags, D3D11_MAPPED_SUBRESOURCE* MappedResource) = 0;
+	virtual void STDMETHODCALLTYPE Unmap(ID3D11Resource* Resource, UINT Subresource) = 0;
+	virtual void STDMETHODCALLTYPE Flush() = 0;
+};
+
+struct ID3D11Device : public IUnknown
+{
+	virtual HRESULT STDMETHODCALLTYPE CreateBuffer(const D3D11_BUFFER_DESC* Desc, const D3D11_SUBRESOURCE_DATA* InitialData, ID3D11Buffer** Buffer) = 0;
+	virtual HRESULT STDMETHODCALLTYPE CreateTexture2D(const D3D11_TEXTURE2D_DESC* Desc, const D3D11_SUBRESOURCE_DATA* InitialData, ID3D11Texture2D** Texture2D) = 0;
+	virtual HRESULT STDMETHODCALLTYPE CreateShaderResourceView(ID3D11Resource* Resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* Desc, ID3D11ShaderResourceView** View) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() = 0;
+	virtual void STDMETHODCALLTYPE GetImmediateContext(ID3D11DeviceContext** ImmediateContext) = 0;
+};
+
+HRESULT D3D11CreateDevice(IDXGIAdapter* Adapter, D3D_DRIVER_TYPE DriverType, HMODULE Software, UINT Flags, const D3D_FEATURE_LEVEL* FeatureLevels,
+	UINT FeatureLevelCount, UINT SDKVersion, ID3D11Device** Device, D3D_FEATURE_LEVEL* FeatureLevel, ID3D11DeviceContext** ImmediateContext);
+
+#endif
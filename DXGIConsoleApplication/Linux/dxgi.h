@@ -0,0 +1,8 @@
+// Stand-in for the DXGI header, the 1.2 header declares everything
+
+#ifndef _LINUX_DXGI_H_
+#define _LINUX_DXGI_H_
+
+#include <dxgi1_2.h>
+
+#endif
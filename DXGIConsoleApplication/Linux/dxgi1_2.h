@@ -0,0 +1,227 @@
+// Stand-in for the DXGI 1.2 interfaces the capture sources use. There is no DXGI on Linux,
+// CreateDXGIFactory1 fails with DXGI_ERROR_UNSUPPORTED so no interface is ever handed out.
+// The interfaces are declared as on Windows so the sources compile unchanged.
+
+#ifndef _LINUX_DXGI1_2_H_
+#define _LINUX_DXGI1_2_H_
+
+#include <windows.h>
+
+typedef struct _GUID
+{
+	DWORD Data1;
+	WORD Data2;
+	WORD Data3;
+	BYTE Data4[8];
+} GUID;
+
+typedef GUID IID;
+typedef const IID& REFIID;
+
+// No interface is queried for by identity here, every IID is the null GUID
+#define __uuidof(Type) (IID())
+
+#define STDMETHODCALLTYPE
+
+struct IUnknown
+{
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID Riid, void** Object) = 0;
+	virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+	virtual ULONG STDMETHODCALLTYPE Release() = 0;
+	virtual ~IUnknown() {}
+};
+
+//
+// Types
+//
+typedef enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+	DXGI_FORMAT_R10G10B10A2_UNORM = 24,
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+	DXGI_FORMAT_B8G8R8X8_UNORM = 88,
+	DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+	DXGI_FORMAT_NV12 = 103,
+	DXGI_FORMAT_YUY2 = 107
+} DXGI_FORMAT;
+
+typedef enum DXGI_MODE_ROTATION
+{
+	DXGI_MODE_ROTATION_UNSPECIFIED = 0,
+	DXGI_MODE_ROTATION_IDENTITY = 1,
+	DXGI_MODE_ROTATION_ROTATE90 = 2,
+	DXGI_MODE_ROTATION_ROTATE180 = 3,
+	DXGI_MODE_ROTATION_ROTATE270 = 4
+} DXGI_MODE_ROTATION;
+
+typedef struct DXGI_RATIONAL
+{
+	UINT Numerator;
+	UINT Denominator;
+} DXGI_RATIONAL;
+
+typedef struct DXGI_SAMPLE_DESC
+{
+	UINT Count;
+	UINT Quality;
+} DXGI_SAMPLE_DESC;
+
+typedef struct DXGI_MODE_DESC
+{
+	UINT Width;
+	UINT Height;
+	DXGI_RATIONAL RefreshRate;
+	DXGI_FORMAT Format;
+	UINT ScanlineOrdering;
+	UINT Scaling;
+} DXGI_MODE_DESC;
+
+typedef struct DXGI_OUTPUT_DESC
+{
+	WCHAR DeviceName[32];
+	RECT DesktopCoordinates;
+	BOOL AttachedToDesktop;
+	DXGI_MODE_ROTATION Rotation;
+	HANDLE Monitor;
+} DXGI_OUTPUT_DESC;
+
+typedef struct DXGI_ADAPTER_DESC1
+{
+	WCHAR Description[128];
+	UINT VendorId;
+	UINT DeviceId;
+	UINT SubSysId;
+	UINT Revision;
+	SIZE_T DedicatedVideoMemory;
+	SIZE_T DedicatedSystemMemory;
+	SIZE_T SharedSystemMemory;
+	LUID AdapterLuid;
+	UINT Flags;
+} DXGI_ADAPTER_DESC1;
+
+typedef struct DXGI_OUTDUPL_DESC
+{
+	DXGI_MODE_DESC ModeDesc;
+	DXGI_MODE_ROTATION Rotation;
+	BOOL DesktopImageInSystemMemory;
+} DXGI_OUTDUPL_DESC;
+
+typedef struct DXGI_OUTDUPL_POINTER_POSITION
+{
+	POINT Position;
+	BOOL Visible;
+} DXGI_OUTDUPL_POINTER_POSITION;
+
+typedef struct DXGI_OUTDUPL_FRAME_INFO
+{
+	LARGE_INTEGER LastPresentTime;
+	LARGE_INTEGER LastMouseUpdateTime;
+	UINT AccumulatedFrames;
+	BOOL RectsCoalesced;
+	BOOL ProtectedContentMaskedOut;
+	DXGI_OUTDUPL_POINTER_POSITION PointerPosition;
+	UINT TotalMetadataBufferSize;
+	UINT PointerShapeBufferSize;
+} DXGI_OUTDUPL_FRAME_INFO;
+
+typedef struct DXGI_OUTDUPL_MOVE_RECT
+{
+	POINT SourcePoint;
+	RECT DestinationRect;
+} DXGI_OUTDUPL_MOVE_RECT;
+
+typedef enum DXGI_OUTDUPL_POINTER_SHAPE_TYPE
+{
+	DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME = 1,
+	DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR = 2,
+	DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR = 4
+} DXGI_OUTDUPL_POINTER_SHAPE_TYPE;
+
+typedef struct DXGI_OUTDUPL_POINTER_SHAPE_INFO
+{
+	UINT Type;
+	UINT Width;
+	UINT Height;
+	UINT Pitch;
+	POINT HotSpot;
+} DXGI_OUTDUPL_POINTER_SHAPE_INFO;
+
+//
+// Errors
+//
+#define DXGI_ERROR_INVALID_CALL ((HRESULT)0x887A0001)
+#define DXGI_ERROR_NOT_FOUND ((HRESULT)0x887A0002)
+#define DXGI_ERROR_MORE_DATA ((HRESULT)0x887A0003)
+#define DXGI_ERROR_UNSUPPORTED ((HRESULT)0x887A0004)
+#define DXGI_ERROR_DEVICE_REMOVED ((HRESULT)0x887A0005)
+#define DXGI_ERROR_DEVICE_HUNG ((HRESULT)0x887A0006)
+#define DXGI_ERROR_DEVICE_RESET ((HRESULT)0x887A0007)
+#define DXGI_ERROR_WAS_STILL_DRAWING ((HRESULT)0x887A000A)
+#define DXGI_ERROR_DRIVER_INTERNAL_ERROR ((HRESULT)0x887A0020)
+#define DXGI_ERROR_NOT_CURRENTLY_AVAILABLE ((HRESULT)0x887A0022)
+#define DXGI_ERROR_ACCESS_LOST ((HRESULT)0x887A0026)
+#define DXGI_ERROR_WAIT_TIMEOUT ((HRESULT)0x887A0027)
+#define DXGI_ERROR_SESSION_DISCONNECTED ((HRESULT)0x887A0028)
+
+//
+// Interfaces
+//
+struct IDXGIObject : public IUnknown
+{
+	virtual HRESULT STDMETHODCALLTYPE GetParent(REFIID Riid, void** Parent) = 0;
+};
+
+struct IDXGIDeviceSubObject : public IDXGIObject
+{
+};
+
+struct IDXGIResource : public IDXGIDeviceSubObject
+{
+};
+
+struct IDXGIOutput : public IDXGIObject
+{
+	virtual HRESULT STDMETHODCALLTYPE GetDesc(DXGI_OUTPUT_DESC* Desc) = 0;
+};
+
+struct IDXGIOutputDuplication : public IDXGIObject
+{
+	virtual void STDMETHODCALLTYPE GetDesc(DXGI_OUTDUPL_DESC* Desc) = 0;
+	virtual HRESULT STDMETHODCALLTYPE AcquireNextFrame(UINT TimeoutInMilliseconds, DXGI_OUTDUPL_FRAME_INFO* FrameInfo, IDXGIResource** DesktopResource) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetFrameDirtyRects(UINT DirtyRectsBufferSize, RECT* DirtyRectsBuffer, UINT* DirtyRectsBufferSizeRequired) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetFrameMoveRects(UINT MoveRectsBufferSize, DXGI_OUTDUPL_MOVE_RECT* MoveRectBuffer, UINT* MoveRectsBufferSizeRequired) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetFramePointerShape(UINT PointerShapeBufferSize, void* PointerShapeBuffer, UINT* PointerShapeBufferSizeRequired, DXGI_OUTDUPL_POINTER_SHAPE_INFO* PointerShapeInfo) = 0;
+	virtual HRESULT STDMETHODCALLTYPE ReleaseFrame() = 0;
+};
+
+struct IDXGIOutput1 : public IDXGIOutput
+{
+	virtual HRESULT STDMETHODCALLTYPE DuplicateOutput(IUnknown* Device, IDXGIOutputDuplication** OutputDuplication) = 0;
+};
+
+struct IDXGIAdapter : public IDXGIObject
+{
+	virtual HRESULT STDMETHODCALLTYPE EnumOutputs(UINT Output, IDXGIOutput** Output1) = 0;
+};
+
+struct IDXGIAdapter1 : public IDXGIAdapter
+{
+	virtual HRESULT STDMETHODCALLTYPE GetDesc1(DXGI_ADAPTER_DESC1* Desc) = 0;
+};
+
+struct IDXGIDevice : public IDXGIObject
+{
+	virtual HRESULT STDMETHODCALLTYPE GetAdapter(IDXGIAdapter** Adapter) = 0;
+};
+
+struct IDXGIFactory1 : public IDXGIObject
+{
+	virtual HRESULT STDMETHODCALLTYPE EnumAdapters1(UINT Adapter, IDXGIAdapter1** Adapter1) = 0;
+};
+
+HRESULT CreateDXGIFactory1(REFIID Riid, void** Factory);
+
+#endif
@@ -0,0 +1,33 @@
+// Stand-in for the compiler intrinsics header of Visual C++. CPUID and XGETBV are written with
+// inline assembly, the SIMD intrinsics come from the x86 headers.
+
+#ifndef _LINUX_INTRIN_H_
+#define _LINUX_INTRIN_H_
+
+#include <x86intrin.h>
+#include <cpuid.h>
+
+// cpuid.h has a five argument __cpuid macro and, in newer compilers, its own __cpuidex
+#undef __cpuid
+#define __cpuid(CpuInfo, FunctionId) LinuxCpuid((CpuInfo), (FunctionId), 0)
+#define __cpuidex(CpuInfo, FunctionId, SubFunctionId) LinuxCpuid((CpuInfo), (FunctionId), (SubFunctionId))
+#define _xgetbv(Register) LinuxXgetbv(Register)
+
+// GCC only emits the instructions of an intrinsic inside a function built for its instruction set
+#define KERNEL_TARGET(Isa) __attribute__((target(Isa)))
+
+inline void LinuxCpuid(int CpuInfo[4], int FunctionId, int SubFunctionId)
+{
+	__cpuid_count(FunctionId, SubFunctionId, CpuInfo[0], CpuInfo[1], CpuInfo[2], CpuInfo[3]);
+}
+
+// Only called once CPUID reported OSXSAVE, so the instruction exists
+inline unsigned long long LinuxXgetbv(unsigned int Register)
+{
+	unsigned int Low;
+	unsigned int High;
+	__asm__ __volatile__("xgetbv" : "=a"(Low), "=d"(High) : "c"(Register));
+	return (static_cast<unsigned long long>(High) << 32) | Low;
+}
+
+#endif
@@ -0,0 +1,19 @@
+// Stand-in for the aligned allocation functions of the Microsoft C runtime
+
+#ifndef _LINUX_MALLOC_H_
+#define _LINUX_MALLOC_H_
+
+#include <stdlib.h>
+
+inline void* _aligned_malloc(size_t Size, size_t Alignment)
+{
+	void* Memory = nullptr;
+	return (posix_memalign(&Memory, Alignment, Size ? Size : 1) == 0) ? Memory : nullptr;
+}
+
+inline void _aligned_free(void* Memory)
+{
+	free(Memory);
+}
+
+#endif
@@ -0,0 +1,41 @@
+// Stand-in for the source annotation language header. The annotations only matter to the
+// Visual Studio code analysis, they expand to nothing here.
+
+#ifndef _LINUX_SAL_H_
+#define _LINUX_SAL_H_
+
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_opt_z_
+#define _In_reads_(Size)
+#define _In_reads_opt_(Size)
+#define _In_reads_bytes_(Size)
+#define _In_reads_bytes_opt_(Size)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(Size)
+#define _Out_writes_opt_(Size)
+#define _Out_writes_z_(Size)
+#define _Out_writes_to_(Size, Count)
+#define _Out_writes_to_opt_(Size, Count)
+#define _Out_writes_bytes_(Size)
+#define _Out_writes_bytes_opt_(Size)
+#define _Out_writes_bytes_to_(Size, Count)
+#define _Outptr_
+#define _Outptr_result_maybenull_
+#define _Inout_
+#define _Inout_opt_
+#define _Inout_updates_(Size)
+#define _Inout_updates_bytes_(Size)
+#define _Field_size_(Size)
+#define _Field_size_opt_(Size)
+#define _Field_size_bytes_(Size)
+#define _Ret_maybenull_
+#define _Success_(Expression)
+#define _Post_satisfies_(Expression)
+#define _Return_type_success_(Expression)
+#define _Printf_format_string_
+#define _Analysis_assume_(Expression)
+
+#endif
@@ -0,0 +1,10 @@
+// Stand-in for the generic text mappings, the application only uses the narrow ones
+
+#ifndef _LINUX_TCHAR_H_
+#define _LINUX_TCHAR_H_
+
+typedef char TCHAR;
+#define _T(Text) Text
+#define _tmain main
+
+#endif
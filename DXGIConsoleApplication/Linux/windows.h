@@ -0,0 +1,650 @@
+// Stand-in for the parts of the Windows SDK the capture sources use, so the CPU side of the
+// application builds and runs on Linux. Types keep their Windows sizes (LONG is 32 bits).
+// Kernel objects are implemented on top of pthreads and POSIX files in Win32.cpp.
+
+#ifndef _LINUX_WINDOWS_H_
+#define _LINUX_WINDOWS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <wchar.h>
+#include <sal.h>
+#include <malloc.h>
+
+//
+// Base types
+//
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef uint32_t DWORD;
+typedef int BOOL;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef int8_t INT8;
+typedef uint8_t UINT8;
+typedef int16_t INT16;
+typedef uint16_t UINT16;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef long long INT64;
+typedef unsigned long long UINT64;
+typedef intptr_t INT_PTR;
+typedef uintptr_t UINT_PTR;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef float FLOAT;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* HWND;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef DWORD* LPDWORD;
+typedef int32_t HRESULT;
+typedef long long __int64;
+
+#define VOID void
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define CALLBACK
+#define __cdecl
+#define __stdcall
+#define __forceinline inline __attribute__((always_inline))
+#define __declspec(x) __declspec_##x
+#define __declspec_thread __thread
+#define __declspec_noinline __attribute__((noinline))
+#define __declspec_align(x) __attribute__((aligned(x)))
+
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFF
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+#define ARRAYSIZE(A) (sizeof(A) / sizeof((A)[0]))
+#define _countof(A) (sizeof(A) / sizeof((A)[0]))
+
+// The C++ library headers use std::min and std::max, they are pulled in before the macros exist
+#include <math.h>
+#include <limits>
+#include <new>
+
+#ifndef NOMINMAX
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#endif
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _LUID
+{
+	DWORD LowPart;
+	LONG HighPart;
+} LUID;
+
+typedef struct tagRECT
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+} RECT;
+
+typedef struct tagPOINT
+{
+	LONG x;
+	LONG y;
+} POINT;
+
+//
+// HRESULTs and error codes
+//
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_ACCESSDENIED ((HRESULT)0x80070005)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFF)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_NOT_SUPPORTED 50L
+#define ERROR_FILE_EXISTS 80L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_NOT_ALL_ASSIGNED 1300L
+#define ERROR_TIMEOUT 1460L
+
+#define WAIT_OBJECT_0 0x00000000L
+#define WAIT_ABANDONED 0x00000080L
+#define WAIT_TIMEOUT 258L
+#define WAIT_FAILED ((DWORD)0xFFFFFFFF)
+
+DWORD GetLastError();
+void SetLastError(DWORD Error);
+
+//
+// Memory
+//
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define ZeroMemory RtlZeroMemory
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define CopyMemory RtlCopyMemory
+
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+#define MEM_LARGE_PAGES 0x20000000
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+
+LPVOID VirtualAlloc(_In_opt_ LPVOID Address, SIZE_T Size, DWORD AllocationType, DWORD Protect);
+BOOL VirtualFree(_In_ LPVOID Address, SIZE_T Size, DWORD FreeType);
+SIZE_T GetLargePageMinimum();
+
+typedef struct _SYSTEM_INFO
+{
+	WORD wProcessorArchitecture;
+	WORD wReserved;
+	DWORD dwPageSize;
+	LPVOID lpMinimumApplicationAddress;
+	LPVOID lpMaximumApplicationAddress;
+	ULONG_PTR dwActiveProcessorMask;
+	DWORD dwNumberOfProcessors;
+	DWORD dwProcessorType;
+	DWORD dwAllocationGranularity;
+	WORD wProcessorLevel;
+	WORD wProcessorRevision;
+} SYSTEM_INFO;
+
+void GetSystemInfo(_Out_ SYSTEM_INFO* SystemInfo);
+
+//
+// Interlocked operations and barriers, full barriers like their Windows counterparts
+//
+inline LONG InterlockedIncrement(_Inout_ volatile LONG* Addend) { return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(_Inout_ volatile LONG* Addend) { return __atomic_sub_fetch(Addend, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(_Inout_ volatile LONG* Target, LONG Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(_Inout_ volatile LONG* Addend, LONG Value) { return __atomic_fetch_add(Addend, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedCompareExchange(_Inout_ volatile LONG* Destination, LONG Exchange, LONG Comparand)
+{
+	__atomic_compare_exchange_n(Destination, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+inline LONGLONG InterlockedIncrement64(_Inout_ volatile LONGLONG* Addend) { return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedDecrement64(_Inout_ volatile LONGLONG* Addend) { return __atomic_sub_fetch(Addend, 1, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedExchange64(_Inout_ volatile LONGLONG* Target, LONGLONG Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedExchangeAdd64(_Inout_ volatile LONGLONG* Addend, LONGLONG Value) { return __atomic_fetch_add(Addend, Value, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedCompareExchange64(_Inout_ volatile LONGLONG* Destination, LONGLONG Exchange, LONGLONG Comparand)
+{
+	__atomic_compare_exchange_n(Destination, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+inline PVOID InterlockedExchangePointer(_Inout_ PVOID volatile* Target, PVOID Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline PVOID InterlockedCompareExchangePointer(_Inout_ PVOID volatile* Destination, PVOID Exchange, PVOID Comparand)
+{
+	__atomic_compare_exchange_n(Destination, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+
+inline LONG ReadAcquire(_In_ const volatile LONG* Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline LONGLONG ReadAcquire64(_In_ const volatile LONGLONG* Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline PVOID ReadPointerAcquire(_In_ PVOID const volatile* Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline LONG ReadNoFence(_In_ const volatile LONG* Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+inline LONGLONG ReadNoFence64(_In_ const volatile LONGLONG* Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+inline void WriteRelease(_Out_ volatile LONG* Destination, LONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WriteRelease64(_Out_ volatile LONGLONG* Destination, LONGLONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WritePointerRelease(_Out_ PVOID volatile* Destination, PVOID Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WriteNoFence(_Out_ volatile LONG* Destination, LONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELAXED); }
+
+#ifdef CAPTURE_TSAN
+// ThreadSanitizer does not model fences, a locked RMW orders the same on x86 and it sees that
+inline void MemoryBarrier()
+{
+	static volatile LONG Barrier;
+	__atomic_fetch_add(&Barrier, 0, __ATOMIC_SEQ_CST);
+}
+#else
+inline void MemoryBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#endif
+inline void _ReadWriteBarrier() { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+#if defined(__x86_64__) || defined(__i386__)
+inline void YieldProcessor() { __builtin_ia32_pause(); }
+#else
+inline void YieldProcessor() {}
+#endif
+
+//
+// Threads and synchronization
+//
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID Parameter);
+
+typedef struct _CRITICAL_SECTION
+{
+	void* Lock;
+} CRITICAL_SECTION;
+
+typedef struct _CONDITION_VARIABLE
+{
+	void* Condition;
+} CONDITION_VARIABLE;
+
+
+void InitializeCriticalSection(_Out_ CRITICAL_SECTION* CriticalSection);
+void DeleteCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection);
+void EnterCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection);
+BOOL TryEnterCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection);
+void LeaveCriticalSection(_Inout_ CRITICAL_SECTION* CriticalSection);
+
+void InitializeConditionVariable(_Out_ CONDITION_VARIABLE* ConditionVariable);
+BOOL SleepConditionVariableCS(_Inout_ CONDITION_VARIABLE* ConditionVariable, _Inout_ CRITICAL_SECTION* CriticalSection, DWORD Milliseconds);
+void WakeConditionVariable(_Inout_ CONDITION_VARIABLE* ConditionVariable);
+void WakeAllConditionVariable(_Inout_ CONDITION_VARIABLE* ConditionVariable);
+
+HANDLE CreateThread(_In_opt_ void* Attributes, SIZE_T StackSize, _In_ LPTHREAD_START_ROUTINE StartAddress, _In_opt_ LPVOID Parameter, DWORD CreationFlags, _Out_opt_ LPDWORD ThreadId);
+DWORD GetCurrentThreadId();
+DWORD GetCurrentProcessId();
+HANDLE GetCurrentProcess();
+void Sleep(DWORD Milliseconds);
+BOOL SwitchToThread();
+
+HANDLE CreateEventA(_In_opt_ void* Attributes, BOOL ManualReset, BOOL InitialState, _In_opt_ LPCSTR Name);
+HANDLE CreateEventW(_In_opt_ void* Attributes, BOOL ManualReset, BOOL InitialState, _In_opt_ LPCWSTR Name);
+HANDLE OpenEventA(DWORD DesiredAccess, BOOL InheritHandle, _In_ LPCSTR Name);
+#define CreateEvent CreateEventA
+#define OpenEvent OpenEventA
+BOOL SetEvent(_In_ HANDLE Event);
+BOOL ResetEvent(_In_ HANDLE Event);
+
+DWORD WaitForSingleObject(_In_ HANDLE Handle, DWORD Milliseconds);
+DWORD WaitForMultipleObjects(DWORD Count, _In_reads_(Count) const HANDLE* Handles, BOOL WaitAll, DWORD Milliseconds);
+BOOL CloseHandle(_In_ HANDLE Object);
+
+#define SYNCHRONIZE 0x00100000L
+#define EVENT_MODIFY_STATE 0x0002
+#define EVENT_ALL_ACCESS 0x1F0003
+
+//
+// Thread pool work objects, run on a process wide pool of worker threads
+//
+typedef struct _TP_WORK TP_WORK, *PTP_WORK;
+typedef struct _TP_CALLBACK_INSTANCE TP_CALLBACK_INSTANCE, *PTP_CALLBACK_INSTANCE;
+typedef struct _TP_CALLBACK_ENVIRON TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
+typedef void (CALLBACK *PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work);
+
+PTP_WORK CreateThreadpoolWork(_In_ PTP_WORK_CALLBACK Callback, _Inout_opt_ PVOID Context, _In_opt_ PTP_CALLBACK_ENVIRON Environment);
+void SubmitThreadpoolWork(_Inout_ PTP_WORK Work);
+void WaitForThreadpoolWorkCallbacks(_Inout_ PTP_WORK Work, BOOL CancelPendingCallbacks);
+void CloseThreadpoolWork(_Inout_ PTP_WORK Work);
+
+//
+// Timing
+//
+BOOL QueryPerformanceCounter(_Out_ LARGE_INTEGER* PerformanceCount);
+BOOL QueryPerformanceFrequency(_Out_ LARGE_INTEGER* Frequency);
+DWORD GetTickCount();
+ULONGLONG GetTickCount64();
+
+//
+// Files and file mappings
+//
+#define GENERIC_READ 0x80000000L
+#define GENERIC_WRITE 0x40000000L
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_WRITE 0x00000002
+#define FILE_SHARE_DELETE 0x00000004
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define FILE_MAP_WRITE 0x0002
+#define FILE_MAP_READ 0x0004
+#define FILE_MAP_ALL_ACCESS 0xF001F
+
+typedef struct _OVERLAPPED
+{
+	ULONG_PTR Internal;
+	ULONG_PTR InternalHigh;
+	union
+	{
+		struct
+		{
+			DWORD Offset;
+			DWORD OffsetHigh;
+		};
+		PVOID Pointer;
+	};
+	HANDLE hEvent;
+} OVERLAPPED;
+
+HANDLE CreateFileA(_In_ LPCSTR FileName, DWORD DesiredAccess, DWORD ShareMode, _In_opt_ void* Attributes, DWORD CreationDisposition, DWORD FlagsAndAttributes, _In_opt_ HANDLE TemplateFile);
+BOOL ReadFile(_In_ HANDLE File, _Out_writes_bytes_(BytesToRead) LPVOID Buffer, DWORD BytesToRead, _Out_opt_ LPDWORD BytesRead, _Inout_opt_ OVERLAPPED* Overlapped);
+BOOL WriteFile(_In_ HANDLE File, _In_reads_bytes_(BytesToWrite) LPCVOID Buffer, DWORD BytesToWrite, _Out_opt_ LPDWORD BytesWritten, _Inout_opt_ OVERLAPPED* Overlapped);
+BOOL SetFilePointerEx(_In_ HANDLE File, LARGE_INTEGER DistanceToMove, _Out_opt_ LARGE_INTEGER* NewFilePointer, DWORD MoveMethod);
+BOOL SetEndOfFile(_In_ HANDLE File);
+BOOL GetFileSizeEx(_In_ HANDLE File, _Out_ LARGE_INTEGER* FileSize);
+BOOL FlushFileBuffers(_In_ HANDLE File);
+BOOL DeleteFileA(_In_ LPCSTR FileName);
+BOOL CreateDirectoryA(_In_ LPCSTR PathName, _In_opt_ void* Attributes);
+BOOL RemoveDirectoryA(_In_ LPCSTR PathName);
+DWORD GetTempPathA(DWORD BufferLength, _Out_writes_to_opt_(BufferLength, return + 1) LPSTR Buffer);
+
+HANDLE CreateFileMappingA(_In_ HANDLE File, _In_opt_ void* Attributes, DWORD Protect, DWORD MaximumSizeHigh, DWORD MaximumSizeLow, _In_opt_ LPCSTR Name);
+HANDLE OpenFileMappingA(DWORD DesiredAccess, BOOL InheritHandle, _In_ LPCSTR Name);
+LPVOID MapViewOfFile(_In_ HANDLE FileMappingObject, DWORD DesiredAccess, DWORD FileOffsetHigh, DWORD FileOffsetLow, SIZE_T NumberOfBytesToMap);
+BOOL UnmapViewOfFile(_In_ LPCVOID BaseAddress);
+BOOL FlushViewOfFile(_In_ LPCVOID BaseAddress, SIZE_T NumberOfBytesToFlush);
+
+//
+// Processes
+//
+#define STARTF_USESTDHANDLES 0x00000100
+#define STD_INPUT_HANDLE ((DWORD)-10)
+#define STD_OUTPUT_HANDLE ((DWORD)-11)
+#define STD_ERROR_HANDLE ((DWORD)-12)
+#define STILL_ACTIVE 259
+
+typedef struct _STARTUPINFOA
+{
+	DWORD cb;
+	LPSTR lpReserved;
+	LPSTR lpDesktop;
+	LPSTR lpTitle;
+	DWORD dwX;
+	DWORD dwY;
+	DWORD dwXSize;
+	DWORD dwYSize;
+	DWORD dwXCountChars;
+	DWORD dwYCountChars;
+	DWORD dwFillAttribute;
+	DWORD dwFlags;
+	WORD wShowWindow;
+	WORD cbReserved2;
+	BYTE* lpReserved2;
+	HANDLE hStdInput;
+	HANDLE hStdOutput;
+	HANDLE hStdError;
+} STARTUPINFOA;
+
+typedef struct _PROCESS_INFORMATION
+{
+	HANDLE hProcess;
+	HANDLE hThread;
+	DWORD dwProcessId;
+	DWORD dwThreadId;
+} PROCESS_INFORMATION;
+
+HANDLE GetStdHandle(DWORD StdHandle);
+DWORD GetModuleFileNameA(_In_opt_ HMODULE Module, _Out_writes_(Size) LPSTR FileName, DWORD Size);
+BOOL CreateProcessA(_In_opt_ LPCSTR ApplicationName, _Inout_opt_ LPSTR CommandLine, _In_opt_ void* ProcessAttributes, _In_opt_ void* ThreadAttributes,
+	BOOL InheritHandles, DWORD CreationFlags, _In_opt_ LPVOID Environment, _In_opt_ LPCSTR CurrentDirectory, _In_ STARTUPINFOA* StartupInfo, _Out_ PROCESS_INFORMATION* ProcessInformation);
+HANDLE OpenProcess(DWORD DesiredAccess, BOOL InheritHandle, DWORD ProcessId);
+BOOL GetExitCodeProcess(_In_ HANDLE Process, _Out_ LPDWORD ExitCode);
+
+//
+// Privileges, large pages need no privilege on Linux so these only report success
+//
+#define TOKEN_ADJUST_PRIVILEGES 0x0020
+#define TOKEN_QUERY 0x0008
+#define SE_PRIVILEGE_ENABLED 0x00000002L
+#define SE_LOCK_MEMORY_NAME L"SeLockMemoryPrivilege"
+
+typedef struct _LUID_AND_ATTRIBUTES
+{
+	LUID Luid;
+	DWORD Attributes;
+} LUID_AND_ATTRIBUTES;
+
+typedef struct _TOKEN_PRIVILEGES
+{
+	DWORD PrivilegeCount;
+	LUID_AND_ATTRIBUTES Privileges[1];
+} TOKEN_PRIVILEGES;
+
+BOOL OpenProcessToken(_In_ HANDLE ProcessHandle, DWORD DesiredAccess, _Out_ HANDLE* TokenHandle);
+BOOL LookupPrivilegeValueW(_In_opt_ LPCWSTR SystemName, _In_ LPCWSTR Name, _Out_ LUID* Luid);
+BOOL AdjustTokenPrivileges(_In_ HANDLE TokenHandle, BOOL DisableAllPrivileges, _In_opt_ TOKEN_PRIVILEGES* NewState, DWORD BufferLength, _Out_opt_ TOKEN_PRIVILEGES* PreviousState, _Out_opt_ LPDWORD ReturnLength);
+
+//
+// Rects
+//
+inline BOOL SetRect(_Out_ RECT* Rect, int Left, int Top, int Right, int Bottom)
+{
+	Rect->left = Left;
+	Rect->top = Top;
+	Rect->right = Right;
+	Rect->bottom = Bottom;
+	return TRUE;
+}
+
+inline BOOL SetRectEmpty(_Out_ RECT* Rect)
+{
+	return SetRect(Rect, 0, 0, 0, 0);
+}
+
+inline BOOL IsRectEmpty(_In_ const RECT* Rect)
+{
+	return Rect->left >= Rect->right || Rect->top >= Rect->bottom;
+}
+
+inline BOOL EqualRect(_In_ const RECT* Rect1, _In_ const RECT* Rect2)
+{
+	return Rect1->left == Rect2->left && Rect1->top == Rect2->top &&
+		Rect1->right == Rect2->right && Rect1->bottom == Rect2->bottom;
+}
+
+inline BOOL OffsetRect(_Inout_ RECT* Rect, int Dx, int Dy)
+{
+	Rect->left += Dx;
+	Rect->right += Dx;
+	Rect->top += Dy;
+	Rect->bottom += Dy;
+	return TRUE;
+}
+
+inline BOOL IntersectRect(_Out_ RECT* Dest, _In_ const RECT* Src1, _In_ const RECT* Src2)
+{
+	Dest->left = max(Src1->left, Src2->left);
+	Dest->top = max(Src1->top, Src2->top);
+	Dest->right = min(Src1->right, Src2->right);
+	Dest->bottom = min(Src1->bottom, Src2->bottom);
+	if (IsRectEmpty(Dest))
+	{
+		SetRectEmpty(Dest);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+inline BOOL UnionRect(_Out_ RECT* Dest, _In_ const RECT* Src1, _In_ const RECT* Src2)
+{
+	if (IsRectEmpty(Src1))
+	{
+		*Dest = *Src2;
+	}
+	else if (IsRectEmpty(Src2))
+	{
+		*Dest = *Src1;
+	}
+	else
+	{
+		Dest->left = min(Src1->left, Src2->left);
+		Dest->top = min(Src1->top, Src2->top);
+		Dest->right = max(Src1->right, Src2->right);
+		Dest->bottom = max(Src1->bottom, Src2->bottom);
+	}
+	return !IsRectEmpty(Dest);
+}
+
+//
+// User interface, messages go to stderr
+//
+#define MB_OK 0x00000000L
+#define MB_ICONERROR 0x00000010L
+int MessageBoxW(_In_opt_ HWND Window, _In_opt_ LPCWSTR Text, _In_opt_ LPCWSTR Caption, UINT Type);
+
+//
+// Bitmaps
+//
+#define BI_RGB 0L
+
+#pragma pack(push, 2)
+typedef struct tagBITMAPFILEHEADER
+{
+	WORD bfType;
+	DWORD bfSize;
+	WORD bfReserved1;
+	WORD bfReserved2;
+	DWORD bfOffBits;
+} BITMAPFILEHEADER;
+#pragma pack(pop)
+
+typedef struct tagBITMAPINFOHEADER
+{
+	DWORD biSize;
+	LONG biWidth;
+	LONG biHeight;
+	WORD biPlanes;
+	WORD biBitCount;
+	DWORD biCompression;
+	DWORD biSizeImage;
+	LONG biXPelsPerMeter;
+	LONG biYPelsPerMeter;
+	DWORD biClrUsed;
+	DWORD biClrImportant;
+} BITMAPINFOHEADER;
+
+//
+// Secure CRT functions
+//
+typedef int errno_t;
+#define _TRUNCATE ((size_t)-1)
+
+inline errno_t fopen_s(_Out_ FILE** File, _In_z_ const char* FileName, _In_z_ const char* Mode)
+{
+	*File = fopen(FileName, Mode);
+	return *File ? 0 : 1;
+}
+
+inline errno_t memcpy_s(_Out_writes_bytes_(DestinationSize) void* Destination, size_t DestinationSize, _In_reads_bytes_(Count) const void* Source, size_t Count)
+{
+	if (Count > DestinationSize)
+	{
+		return 1;
+	}
+	memcpy(Destination, Source, Count);
+	return 0;
+}
+
+inline errno_t memmove_s(_Out_writes_bytes_(DestinationSize) void* Destination, size_t DestinationSize, _In_reads_bytes_(Count) const void* Source, size_t Count)
+{
+	if (Count > DestinationSize)
+	{
+		return 1;
+	}
+	memmove(Destination, Source, Count);
+	return 0;
+}
+
+inline errno_t strcpy_s(_Out_writes_z_(DestinationSize) char* Destination, size_t DestinationSize, _In_z_ const char* Source)
+{
+	size_t Length = strlen(Source);
+	if (Length >= DestinationSize)
+	{
+		if (DestinationSize)
+		{
+			Destination[0] = '\0';
+		}
+		return 1;
+	}
+	memcpy(Destination, Source, Length + 1);
+	return 0;
+}
+
+template <size_t Size>
+inline errno_t strcpy_s(char (&Destination)[Size], _In_z_ const char* Source)
+{
+	return strcpy_s(Destination, Size, Source);
+}
+
+#define fprintf_s fprintf
+#define printf_s printf
+#define vfprintf_s vfprintf
+#define swprintf_s swprintf
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+#define sscanf_s sscanf
+
+template <size_t Size>
+inline int sprintf_s(char (&Buffer)[Size], _In_z_ _Printf_format_string_ const char* Format, ...) __attribute__((format(printf, 2, 3)));
+
+template <size_t Size>
+inline int sprintf_s(char (&Buffer)[Size], _In_z_ _Printf_format_string_ const char* Format, ...)
+{
+	va_list Args;
+	va_start(Args, Format);
+	int Length = vsnprintf(Buffer, Size, Format, Args);
+	va_end(Args);
+	return Length;
+}
+
+// Only the _TRUNCATE form, which returns -1 when the output was cut short
+inline int _snprintf_s(_Out_writes_(Size) char* Buffer, size_t Size, size_t Count, _In_z_ _Printf_format_string_ const char* Format, ...) __attribute__((format(printf, 4, 5)));
+
+inline int _snprintf_s(_Out_writes_(Size) char* Buffer, size_t Size, size_t Count, _In_z_ _Printf_format_string_ const char* Format, ...)
+{
+	UNREFERENCED_PARAMETER(Count);
+	if (!Size)
+	{
+		return -1;
+	}
+	va_list Args;
+	va_start(Args, Format);
+	int Length = vsnprintf(Buffer, Size, Format, Args);
+	va_end(Args);
+	return (Length < 0 || static_cast<size_t>(Length) >= Size) ? -1 : Length;
+}
+
+#endif
@@ -0,0 +1,342 @@
+// LiveFrame.cpp : Memory mapped bitmap updated in place from the dirty and move rects.
+//
+
+#include "LiveFrame.h"
+#include "FrameWriter.h"
+
+// Torn reads tolerated by ReadLiveFrame before it gives up
+#define LIVEFRAME_READ_ATTEMPTS 16
+
+#define LIVEFRAME_HEADERS_SIZE  (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+
+//
+// Map Size bytes of FileName, creating the file if Write is set. Existing files are kept,
+// mapping more than they hold grows them. MappedSize receives the size of the view.
+//
+static BYTE* MapFile(_In_z_ const char* FileName, UINT64 Size, bool Write, _Out_ HANDLE* File, _Out_ HANDLE* Mapping, _Out_opt_ UINT64* MappedSize = nullptr)
+{
+	*Mapping = nullptr;
+	*File = CreateFileA(FileName, Write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		Write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (*File == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+
+	// A view of the whole file can be no smaller than the file is now
+	if (!Size)
+	{
+		LARGE_INTEGER FileSize;
+		if (!GetFileSizeEx(*File, &FileSize) || !FileSize.QuadPart)
+		{
+			return nullptr;
+		}
+		if (MappedSize)
+		{
+			*MappedSize = FileSize.QuadPart;
+		}
+	}
+	else if (MappedSize)
+	{
+		*MappedSize = Size;
+	}
+
+	// Mapping a writable file with an explicit size grows it to that size
+	*Mapping = CreateFileMappingA(*File, nullptr, Write ? PAGE_READWRITE : PAGE_READONLY,
+		static_cast<DWORD>(Size >> 32), static_cast<DWORD>(Size), nullptr);
+	if (!*Mapping)
+	{
+		return nullptr;
+	}
+
+	return reinterpret_cast<BYTE*>(MapViewOfFile(*Mapping, Write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(Size)));
+}
+
+static void UnmapFile(_In_opt_ const void* View, _Inout_ HANDLE* File, _Inout_ HANDLE* Mapping)
+{
+	if (View)
+	{
+		UnmapViewOfFile(View);
+	}
+	if (*Mapping)
+	{
+		CloseHandle(*Mapping);
+		*Mapping = nullptr;
+	}
+	if (*File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(*File);
+		*File = INVALID_HANDLE_VALUE;
+	}
+}
+
+LIVEFRAME::LIVEFRAME() : m_log_file(nullptr),
+						 m_File(INVALID_HANDLE_VALUE),
+						 m_Mapping(nullptr),
+						 m_View(nullptr),
+						 m_SeqFile(INVALID_HANDLE_VALUE),
+						 m_SeqMapping(nullptr),
+						 m_Header(nullptr),
+						 m_Width(0),
+						 m_Height(0)
+{
+	m_FileName[0] = '\0';
+}
+
+LIVEFRAME::~LIVEFRAME()
+{
+	Close();
+}
+
+//
+// Remember where the live frame goes, the file is created with the first frame
+//
+DUPL_RETURN LIVEFRAME::Init(_In_ FILE *log_file, _In_z_ const char* FileName)
+{
+	m_log_file = log_file;
+	if (strcpy_s(m_FileName, FileName) != 0)
+	{
+		fprintf_s(m_log_file, "Live frame file name is too long.\n");
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Map the side header. One left behind by an earlier run is continued, so readers that still
+// have it mapped never see the sequence go back.
+//
+DUPL_RETURN LIVEFRAME::OpenHeader()
+{
+	char SeqName[MAX_PATH];
+	sprintf_s(SeqName, "%s.seq", m_FileName);
+	m_Header = reinterpret_cast<LIVEFRAME_HEADER*>(MapFile(SeqName, sizeof(LIVEFRAME_HEADER), true, &m_SeqFile, &m_SeqMapping));
+	if (!m_Header)
+	{
+		fprintf_s(m_log_file, "Failed to map live frame header %s with error %u.\n", SeqName, GetLastError());
+		UnmapFile(m_Header, &m_SeqFile, &m_SeqMapping);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	if (m_Header->Magic != LIVEFRAME_MAGIC)
+	{
+		m_Header->Sequence = 0;
+		m_Header->Generation = 0;
+	}
+	else if (m_Header->Sequence & 1)
+	{
+		// The earlier writer stopped in the middle of an update
+		InterlockedIncrement(&m_Header->Sequence);
+	}
+	m_Header->Width = 0;
+	m_Header->Height = 0;
+	m_Header->Pitch = 0;
+	WriteRelease(reinterpret_cast<volatile LONG*>(&m_Header->Magic), LIVEFRAME_MAGIC);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Map the bitmap for frames of the given size and write its headers. Called with the sequence odd.
+//
+DUPL_RETURN LIVEFRAME::Create(UINT Width, UINT Height)
+{
+	UnmapFile(m_View, &m_File, &m_Mapping);
+	m_View = nullptr;
+	m_Width = 0;
+	m_Height = 0;
+	m_Header->Width = 0;
+	m_Header->Height = 0;
+	m_Header->Pitch = 0;
+
+	// Bitmap rows have no padding
+	UINT Pitch = Width * BPP;
+
+	m_View = MapFile(m_FileName, LIVEFRAME_HEADERS_SIZE + static_cast<UINT64>(Pitch) * Height, true, &m_File, &m_Mapping);
+	if (!m_View)
+	{
+		fprintf_s(m_log_file, "Failed to map live frame %s with error %u.\n", m_FileName, GetLastError());
+		UnmapFile(m_View, &m_File, &m_Mapping);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	BITMAPFILEHEADER bmfHeader;
+	BITMAPINFOHEADER bi;
+	fill_bitmap_headers(&bmfHeader, &bi, Width, Height);
+	memcpy(m_View, &bmfHeader, sizeof(bmfHeader));
+	memcpy(m_View + sizeof(bmfHeader), &bi, sizeof(bi));
+
+	++m_Header->Generation;
+	m_Header->FrameIndex = 0;
+	m_Header->Width = Width;
+	m_Header->Height = Height;
+	m_Header->Pitch = Pitch;
+	m_Header->CaptureTime.QuadPart = 0;
+
+	m_Width = Width;
+	m_Height = Height;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Bring the live frame up to date with Image. With Meta only its move destinations
+// and dirty rects are written, otherwise or after a size change the whole image is.
+//
+DUPL_RETURN LIVEFRAME::Update(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta)
+{
+	if (GetFormatBytesPerPixel(Image->Format) != BPP)
+	{
+		fprintf_s(m_log_file, "Live frame only supports 32bpp images.\n");
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	if (!m_Header)
+	{
+		DUPL_RETURN Ret = OpenHeader();
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			return Ret;
+		}
+	}
+
+	// Odd sequence tells readers an update is in progress
+	InterlockedIncrement(&m_Header->Sequence);
+
+	bool FullCopy = !Meta || Meta->FullCopy;
+	if (!m_View || Image->Width != m_Width || Image->Height != m_Height)
+	{
+		DUPL_RETURN Ret = Create(Image->Width, Image->Height);
+		if (Ret != DUPL_RETURN_SUCCESS)
+		{
+			// Readers see an empty frame until the next update succeeds
+			InterlockedIncrement(&m_Header->Sequence);
+			return Ret;
+		}
+		FullCopy = true;
+	}
+
+	BYTE* Pixels = m_View + LIVEFRAME_HEADERS_SIZE;
+	UINT Pitch = m_Width * BPP;
+
+	if (FullCopy)
+	{
+		CopyImagePacked(Pixels, Pitch, Image, nullptr);
+	}
+	else
+	{
+		// Image already has the moves applied, their destinations are just more changed pixels
+		const DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(Meta->MetaData);
+		for (UINT i = 0; i < Meta->MoveCount; ++i)
+		{
+			CopyRegions(Pixels, Pitch, Image->Data, Image->Pitch, m_Width, m_Height, &MoveRects[i].DestinationRect, 1);
+		}
+
+		const RECT* DirtyRects = reinterpret_cast<const RECT*>(Meta->MetaData + (Meta->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+		CopyRegions(Pixels, Pitch, Image->Data, Image->Pitch, m_Width, m_Height, DirtyRects, Meta->DirtyCount);
+	}
+
+	m_Header->FrameIndex = Index;
+	if (Meta)
+	{
+		m_Header->CaptureTime = Meta->AcquireTime;
+	}
+	else
+	{
+		QueryPerformanceCounter(&m_Header->CaptureTime);
+	}
+
+	InterlockedIncrement(&m_Header->Sequence);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+void LIVEFRAME::CloseMapping()
+{
+	UnmapFile(m_View, &m_File, &m_Mapping);
+	m_View = nullptr;
+	UnmapFile(m_Header, &m_SeqFile, &m_SeqMapping);
+	m_Header = nullptr;
+	m_Width = 0;
+	m_Height = 0;
+}
+
+void LIVEFRAME::Close()
+{
+	CloseMapping();
+}
+
+//
+// Reader side of the sequence protocol described in LiveFrame.h. The size in the header is
+// checked against the mapped bitmap on every attempt, the writer may change it in between.
+//
+DUPL_RETURN ReadLiveFrame(_In_ FILE *log_file, _In_z_ const char* FileName, _Out_writes_bytes_(BufferSize) BYTE* Buffer, UINT BufferSize, _Out_ LIVEFRAME_HEADER* Header)
+{
+	RtlZeroMemory(Header, sizeof(LIVEFRAME_HEADER));
+
+	char SeqName[MAX_PATH];
+	sprintf_s(SeqName, "%s.seq", FileName);
+
+	HANDLE SeqFile, SeqMapping, File, Mapping;
+	UINT64 SeqSize = 0;
+	UINT64 ViewSize = 0;
+	const LIVEFRAME_HEADER* Shared = reinterpret_cast<const LIVEFRAME_HEADER*>(MapFile(SeqName, 0, false, &SeqFile, &SeqMapping, &SeqSize));
+	const BYTE* View = MapFile(FileName, 0, false, &File, &Mapping, &ViewSize);
+	if (!Shared || !View || SeqSize < sizeof(LIVEFRAME_HEADER) || ReadAcquire(reinterpret_cast<const volatile LONG*>(&Shared->Magic)) != LIVEFRAME_MAGIC)
+	{
+		fprintf_s(log_file, "Failed to open live frame %s.\n", FileName);
+		UnmapFile(View, &File, &Mapping);
+		UnmapFile(Shared, &SeqFile, &SeqMapping);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	DUPL_RETURN Ret = DUPL_RETURN_ERROR_EXPECTED;
+	for (UINT Attempt = 0; Attempt < LIVEFRAME_READ_ATTEMPTS; ++Attempt)
+	{
+		LONG Before = ReadAcquire(&Shared->Sequence);
+		if (Before & 1)
+		{
+			YieldProcessor();
+			continue;
+		}
+
+		*Header = *Shared;
+		UINT64 Bytes = static_cast<UINT64>(Header->Pitch) * Header->Height;
+		if (!Header->Width || !Header->Height || Header->Pitch != Header->Width * BPP || LIVEFRAME_HEADERS_SIZE + Bytes > ViewSize)
+		{
+			// No frame yet, a size change caught half way, or a bitmap grown past this mapping
+			MemoryBarrier();
+			if (ReadNoFence(&Shared->Sequence) == Before)
+			{
+				break;
+			}
+			continue;
+		}
+		if (Bytes > BufferSize)
+		{
+			// Only a size the writer really published is an error
+			MemoryBarrier();
+			if (ReadNoFence(&Shared->Sequence) != Before)
+			{
+				continue;
+			}
+			fprintf_s(log_file, "Live frame %s does not fit into %u bytes.\n", FileName, BufferSize);
+			Ret = DUPL_RETURN_ERROR_UNEXPECTED;
+			break;
+		}
+		memcpy(Buffer, View + LIVEFRAME_HEADERS_SIZE, static_cast<size_t>(Bytes));
+
+		MemoryBarrier();
+		if (ReadNoFence(&Shared->Sequence) == Before)
+		{
+			Ret = DUPL_RETURN_SUCCESS;
+			break;
+		}
+	}
+
+	UnmapFile(View, &File, &Mapping);
+	UnmapFile(Shared, &SeqFile, &SeqMapping);
+
+	return Ret;
+}
@@ -0,0 +1,68 @@
+// LiveFrame.h : Keeps a single memory mapped bitmap up to date with the latest frame,
+// writing only the regions that changed.
+//
+// Readers map <name>.seq and follow the LIVEFRAME_HEADER sequence protocol:
+//   read Sequence, retry while it is odd, copy the pixels, read Sequence again.
+//   The copy is consistent if both values are equal.
+// Neither file is ever truncated, a new frame size only grows the bitmap, so a reader's
+// mapping stays valid. Sequence never goes back, not even when the bitmap is recreated.
+//
+
+#ifndef _LIVEFRAME_H_
+#define _LIVEFRAME_H_
+
+#include "DuplicationManager.h"
+
+#define LIVEFRAME_MAGIC     0x4556494C      // "LIVE"
+
+//
+// Side header shared with readers
+//
+typedef struct _LIVEFRAME_HEADER
+{
+	DWORD Magic;
+	volatile LONG Sequence;                 // Odd while the bitmap is being updated
+	UINT Generation;                        // Incremented whenever the bitmap is recreated for a new size
+	UINT FrameIndex;
+	UINT Width;
+	UINT Height;
+	UINT Pitch;                             // Rows are packed, Width * 4 bytes
+	LARGE_INTEGER CaptureTime;              // QueryPerformanceCounter ticks
+} LIVEFRAME_HEADER;
+
+//
+// Writer side of the live frame
+//
+class LIVEFRAME
+{
+	public:
+		LIVEFRAME();
+		~LIVEFRAME();
+		DUPL_RETURN Init(_In_ FILE *log_file, _In_z_ const char* FileName);
+		DUPL_RETURN Update(_In_ const IMAGE_VIEW* Image, UINT Index, _In_opt_ const FRAME_METADATA* Meta);
+		void Close();
+
+	private:
+		FILE *m_log_file;
+		char m_FileName[MAX_PATH];
+		HANDLE m_File;
+		HANDLE m_Mapping;
+		BYTE* m_View;
+		HANDLE m_SeqFile;
+		HANDLE m_SeqMapping;
+		LIVEFRAME_HEADER* m_Header;
+		UINT m_Width;
+		UINT m_Height;
+
+		DUPL_RETURN OpenHeader();
+		DUPL_RETURN Create(UINT Width, UINT Height);
+		void CloseMapping();
+};
+
+//
+// Copy the latest consistent live frame into Buffer. Gives up after a few torn reads, and
+// returns DUPL_RETURN_ERROR_EXPECTED while there is no frame or it outgrew the reader's mapping.
+//
+DUPL_RETURN ReadLiveFrame(_In_ FILE *log_file, _In_z_ const char* FileName, _Out_writes_bytes_(BufferSize) BYTE* Buffer, UINT BufferSize, _Out_ LIVEFRAME_HEADER* Header);
+
+#endif
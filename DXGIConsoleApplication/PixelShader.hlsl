@@ -29,6 +29,6 @@ float4 PS(PS_INPUT input) : SV_Target
 	float y = ((66 * a + 129 * b + 25 * c + 128) / 256.0) + 16;
 	float u = ((-38 * a - 74 * b + 112 * c + 128) / 256.0) + 128;
 	float v = ((112 * a - 94 * b - 18 * c + 128) / 256.0) + 128;
-	tar = ( y / 255.0 , u / 255.0, v / 255.0);
+	tar = float4(y / 255.0, u / 255.0, v / 255.0, 1.0);
 	return tar;
 }
\ No newline at end of file
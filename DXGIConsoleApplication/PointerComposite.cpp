@@ -0,0 +1,315 @@
+// PointerComposite.cpp : Draws the desktop pointer into captured frames, touching only
+// the pixels under the pointer so it can be taken out again before the next update.
+//
+// Every kernel writes the same pixels as the scalar code for its remainder:
+//   Color         D = (S * A + D * (255 - A) + 128) / 255 rounded as below, alpha set to 0xFF
+//   Masked color  D = (A == 0xFF) ? (D ^ S) | 0xFF000000 : S | 0xFF000000
+//   Monochrome    D = (D & (AND ? 0xFFFFFFFF : 0xFF000000)) ^ (XOR ? 0x00FFFFFF : 0)
+// which are the rules the duplication sample draws the pointer with.
+//
+
+#include "PointerComposite.h"
+#include "ImageView.h"
+#include <new>
+#include <string.h>
+#include <emmintrin.h>
+
+#define ALPHA_MASK  0xFF000000
+#define COLOR_MASK  0x00FFFFFF
+
+// Exact X / 255 for X up to 255 * 255, rounded to nearest
+static inline UINT Div255(UINT X)
+{
+	X += 128;
+	return (X + (X >> 8)) >> 8;
+}
+
+static inline __m128i Div255_SSE2(__m128i X)
+{
+	X = _mm_add_epi16(X, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(X, _mm_srli_epi16(X, 8)), 8);
+}
+
+//
+// Straight alpha blend of 32bpp BGRA shape pixels
+//
+static void BlendColorRow(_Inout_ UINT* Dst, _In_ const UINT* Src, UINT Width)
+{
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i Max = _mm_set1_epi16(255);
+	const __m128i Alpha = _mm_set1_epi32(ALPHA_MASK);
+
+	UINT x = 0;
+	for (; x + 4 <= Width; x += 4)
+	{
+		__m128i S = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + x));
+		__m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Dst + x));
+
+		__m128i SLo = _mm_unpacklo_epi8(S, Zero);
+		__m128i SHi = _mm_unpackhi_epi8(S, Zero);
+		__m128i DLo = _mm_unpacklo_epi8(D, Zero);
+		__m128i DHi = _mm_unpackhi_epi8(D, Zero);
+
+		// Each pixel's alpha in all four of its channels
+		__m128i ALo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(SLo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m128i AHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(SHi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+		__m128i Lo = _mm_add_epi16(_mm_mullo_epi16(SLo, ALo), _mm_mullo_epi16(DLo, _mm_sub_epi16(Max, ALo)));
+		__m128i Hi = _mm_add_epi16(_mm_mullo_epi16(SHi, AHi), _mm_mullo_epi16(DHi, _mm_sub_epi16(Max, AHi)));
+
+		__m128i Out = _mm_packus_epi16(Div255_SSE2(Lo), Div255_SSE2(Hi));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + x), _mm_or_si128(Out, Alpha));
+	}
+
+	for (; x < Width; ++x)
+	{
+		UINT S = Src[x];
+		UINT D = Dst[x];
+		UINT A = S >> 24;
+		UINT Out = ALPHA_MASK;
+		for (UINT Shift = 0; Shift < 24; Shift += 8)
+		{
+			UINT Channel = Div255(((S >> Shift) & 0xFF) * A + ((D >> Shift) & 0xFF) * (255 - A));
+			Out |= Channel << Shift;
+		}
+		Dst[x] = Out;
+	}
+}
+
+//
+// Shape alpha is a mask, 0xFF XORs the shape color into the pixel and 0 replaces the pixel
+//
+static void BlendMaskedColorRow(_Inout_ UINT* Dst, _In_ const UINT* Src, UINT Width)
+{
+	const __m128i Alpha = _mm_set1_epi32(ALPHA_MASK);
+
+	UINT x = 0;
+	for (; x + 4 <= Width; x += 4)
+	{
+		__m128i S = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + x));
+		__m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Dst + x));
+
+		__m128i Xor = _mm_cmpeq_epi32(_mm_and_si128(S, Alpha), Alpha);
+		__m128i Out = _mm_or_si128(_mm_and_si128(Xor, _mm_xor_si128(D, S)), _mm_andnot_si128(Xor, S));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + x), _mm_or_si128(Out, Alpha));
+	}
+
+	for (; x < Width; ++x)
+	{
+		UINT S = Src[x];
+		Dst[x] = (((S & ALPHA_MASK) == ALPHA_MASK) ? (Dst[x] ^ S) : S) | ALPHA_MASK;
+	}
+}
+
+//
+// Eight mask bits starting at bit Bit of Row, most significant bit first like the shape
+//
+static inline UINT GetMaskBits(_In_ const BYTE* Row, UINT Bit)
+{
+	UINT Offset = Bit & 7;
+	UINT Bits = static_cast<UINT>(Row[Bit >> 3]) << 8;
+	if (Offset)
+	{
+		Bits |= Row[(Bit >> 3) + 1];
+	}
+	return ((Bits << Offset) >> 8) & 0xFF;
+}
+
+static inline UINT GetMaskBit(_In_ const BYTE* Row, UINT Bit)
+{
+	return (Row[Bit >> 3] >> (7 - (Bit & 7))) & 1;
+}
+
+//
+// 1bpp AND and XOR masks starting at bit FirstBit of their rows
+//
+static void BlendMonochromeRow(_Inout_ UINT* Dst, _In_ const BYTE* AndRow, _In_ const BYTE* XorRow, UINT FirstBit, UINT Width)
+{
+	const __m128i HighBits = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+	const __m128i LowBits = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+	const __m128i Alpha = _mm_set1_epi32(ALPHA_MASK);
+	const __m128i Color = _mm_set1_epi32(COLOR_MASK);
+
+	UINT x = 0;
+	for (; x + 8 <= Width; x += 8)
+	{
+		__m128i And = _mm_set1_epi32(GetMaskBits(AndRow, FirstBit + x));
+		__m128i Xor = _mm_set1_epi32(GetMaskBits(XorRow, FirstBit + x));
+
+		for (UINT Half = 0; Half < 2; ++Half)
+		{
+			__m128i Bits = Half ? LowBits : HighBits;
+			__m128i AndMask = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(And, Bits), Bits), Alpha);
+			__m128i XorMask = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(Xor, Bits), Bits), Color);
+
+			__m128i* Pixels = reinterpret_cast<__m128i*>(Dst + x + Half * 4);
+			__m128i D = _mm_loadu_si128(Pixels);
+			_mm_storeu_si128(Pixels, _mm_xor_si128(_mm_and_si128(D, AndMask), XorMask));
+		}
+	}
+
+	for (; x < Width; ++x)
+	{
+		UINT AndMask = GetMaskBit(AndRow, FirstBit + x) ? 0xFFFFFFFF : ALPHA_MASK;
+		UINT XorMask = GetMaskBit(XorRow, FirstBit + x) ? COLOR_MASK : 0;
+		Dst[x] = (Dst[x] & AndMask) ^ XorMask;
+	}
+}
+
+//
+// Monochrome shapes are twice as high as the pointer, the AND mask above the XOR mask
+//
+static UINT GetPointerHeight(_In_ const DXGI_OUTDUPL_POINTER_SHAPE_INFO* Shape)
+{
+	return (Shape->Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME) ? Shape->Height / 2 : Shape->Height;
+}
+
+bool GetPointerRect(_In_ const POINTER_STATE* Pointer, UINT Width, UINT Height, _Out_ RECT* Rect)
+{
+	RtlZeroMemory(Rect, sizeof(RECT));
+	if (!Pointer->Visible || !Pointer->HasShape)
+	{
+		return false;
+	}
+
+	LONG Right = Pointer->Position.x + static_cast<LONG>(Pointer->ShapeInfo.Width);
+	LONG Bottom = Pointer->Position.y + static_cast<LONG>(GetPointerHeight(&Pointer->ShapeInfo));
+
+	Rect->left = max(Pointer->Position.x, 0L);
+	Rect->top = max(Pointer->Position.y, 0L);
+	Rect->right = min(Right, static_cast<LONG>(Width));
+	Rect->bottom = min(Bottom, static_cast<LONG>(Height));
+
+	return Rect->left < Rect->right && Rect->top < Rect->bottom;
+}
+
+void BlendPointerShape(_Inout_ BYTE* Image, UINT Pitch, _In_ const RECT* Rect, _In_ const POINTER_STATE* Pointer)
+{
+	const DXGI_OUTDUPL_POINTER_SHAPE_INFO* Shape = &Pointer->ShapeInfo;
+	UINT Width = Rect->right - Rect->left;
+	UINT Rows = Rect->bottom - Rect->top;
+
+	// Where the clipped rect starts in the shape
+	UINT ShapeX = Rect->left - Pointer->Position.x;
+	UINT ShapeY = Rect->top - Pointer->Position.y;
+
+	BYTE* DstRow = Image + Rect->top * Pitch + Rect->left * BPP;
+	for (UINT y = 0; y < Rows; ++y, DstRow += Pitch)
+	{
+		UINT* Dst = reinterpret_cast<UINT*>(DstRow);
+		const BYTE* ShapeRow = Pointer->ShapeBuffer + (ShapeY + y) * Shape->Pitch;
+
+		switch (Shape->Type)
+		{
+			case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR:
+			{
+				BlendColorRow(Dst, reinterpret_cast<const UINT*>(ShapeRow) + ShapeX, Width);
+				break;
+			}
+			case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR:
+			{
+				BlendMaskedColorRow(Dst, reinterpret_cast<const UINT*>(ShapeRow) + ShapeX, Width);
+				break;
+			}
+			case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
+			{
+				const BYTE* XorRow = ShapeRow + (Shape->Height / 2) * Shape->Pitch;
+				BlendMonochromeRow(Dst, ShapeRow, XorRow, ShapeX, Width);
+				break;
+			}
+			default:
+			{
+				return;
+			}
+		}
+	}
+}
+
+POINTERCOMPOSITOR::POINTERCOMPOSITOR() : m_SaveUnder(nullptr),
+                                         m_SaveUnderSize(0),
+                                         m_IsDrawn(false)
+{
+	RtlZeroMemory(&m_Drawn, sizeof(m_Drawn));
+}
+
+POINTERCOMPOSITOR::~POINTERCOMPOSITOR()
+{
+	if (m_SaveUnder)
+	{
+		delete [] m_SaveUnder;
+		m_SaveUnder = nullptr;
+	}
+}
+
+//
+// Save the pixels under the pointer, then draw it. Rect gets the pixels drawn over.
+// Returns false if the pointer is hidden, off the image or there was no memory to save under it.
+//
+bool POINTERCOMPOSITOR::Draw(_Inout_ BYTE* Image, UINT Pitch, UINT Width, UINT Height, _In_ const POINTER_STATE* Pointer, _Out_ RECT* Rect)
+{
+	if (m_IsDrawn || !GetPointerRect(Pointer, Width, Height, Rect))
+	{
+		return false;
+	}
+
+	UINT RowBytes = (Rect->right - Rect->left) * BPP;
+	UINT Rows = Rect->bottom - Rect->top;
+	if (RowBytes * Rows > m_SaveUnderSize)
+	{
+		if (m_SaveUnder)
+		{
+			delete [] m_SaveUnder;
+		}
+		m_SaveUnder = new (std::nothrow) BYTE[RowBytes * Rows];
+		if (!m_SaveUnder)
+		{
+			m_SaveUnderSize = 0;
+			return false;
+		}
+		m_SaveUnderSize = RowBytes * Rows;
+	}
+
+	const BYTE* Row = Image + Rect->top * Pitch + Rect->left * BPP;
+	for (UINT y = 0; y < Rows; ++y, Row += Pitch)
+	{
+		memcpy(m_SaveUnder + y * RowBytes, Row, RowBytes);
+	}
+
+	BlendPointerShape(Image, Pitch, Rect, Pointer);
+
+	m_Drawn = *Rect;
+	m_IsDrawn = true;
+	return true;
+}
+
+//
+// Put back the pixels the last Draw covered. Rect gets where they were.
+// Returns false if the pointer isn't drawn.
+//
+bool POINTERCOMPOSITOR::Erase(_Inout_ BYTE* Image, UINT Pitch, _Out_ RECT* Rect)
+{
+	*Rect = m_Drawn;
+	if (!m_IsDrawn)
+	{
+		return false;
+	}
+
+	UINT RowBytes = (m_Drawn.right - m_Drawn.left) * BPP;
+	UINT Rows = m_Drawn.bottom - m_Drawn.top;
+	BYTE* Row = Image + m_Drawn.top * Pitch + m_Drawn.left * BPP;
+	for (UINT y = 0; y < Rows; ++y, Row += Pitch)
+	{
+		memcpy(Row, m_SaveUnder + y * RowBytes, RowBytes);
+	}
+
+	m_IsDrawn = false;
+	return true;
+}
+
+//
+// The image was replaced as a whole, there is no pointer in it to erase
+//
+void POINTERCOMPOSITOR::Forget()
+{
+	m_IsDrawn = false;
+}
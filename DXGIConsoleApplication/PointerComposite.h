@@ -0,0 +1,58 @@
+// PointerComposite.h : Draws the desktop pointer into captured frames, touching only
+// the pixels under the pointer so it can be taken out again before the next update.
+//
+
+#ifndef _POINTERCOMPOSITE_H_
+#define _POINTERCOMPOSITE_H_
+
+#include <windows.h>
+#include <sal.h>
+#include <dxgi1_2.h>
+
+//
+// Pointer as last reported by DXGI, the same as PTR_INFO without the multi output bookkeeping
+//
+typedef struct _POINTER_STATE
+{
+	_Field_size_bytes_(BufferSize) BYTE* ShapeBuffer;
+	UINT BufferSize;
+	DXGI_OUTDUPL_POINTER_SHAPE_INFO ShapeInfo;
+	POINT Position;             // Top left of the shape relative to the output
+	bool Visible;
+	bool HasShape;              // ShapeBuffer and ShapeInfo have been filled in
+	LARGE_INTEGER LastTimeStamp;
+} POINTER_STATE;
+
+//
+// Part of a Width x Height image the pointer covers. Returns false if it covers nothing.
+//
+bool GetPointerRect(_In_ const POINTER_STATE* Pointer, UINT Width, UINT Height, _Out_ RECT* Rect);
+
+//
+// Draw the pointer shape into the 32bpp image within Rect, which GetPointerRect returned.
+// Color shapes are alpha blended, masked color shapes replace or XOR the pixels and
+// monochrome shapes apply their AND and XOR masks. Four pixels are done at a time.
+//
+void BlendPointerShape(_Inout_ BYTE* Image, UINT Pitch, _In_ const RECT* Rect, _In_ const POINTER_STATE* Pointer);
+
+//
+// Keeps the pixels the pointer was drawn over so a frame that is only patched with dirty
+// rects can have the pointer taken out before it is patched and put back afterwards.
+//
+class POINTERCOMPOSITOR
+{
+	public:
+		POINTERCOMPOSITOR();
+		~POINTERCOMPOSITOR();
+		bool Draw(_Inout_ BYTE* Image, UINT Pitch, UINT Width, UINT Height, _In_ const POINTER_STATE* Pointer, _Out_ RECT* Rect);
+		bool Erase(_Inout_ BYTE* Image, UINT Pitch, _Out_ RECT* Rect);
+		void Forget();
+
+	private:
+		BYTE* m_SaveUnder;
+		UINT m_SaveUnderSize;
+		RECT m_Drawn;
+		bool m_IsDrawn;
+};
+
+#endif
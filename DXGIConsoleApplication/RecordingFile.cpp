@@ -0,0 +1,778 @@
+// RecordingFile.cpp : Writer and memory mapped reader for the recording container.
+//
+
+#include "RecordingFile.h"
+#include "FrameWriter.h"
+#include <stdlib.h>
+#include <limits.h>
+
+//
+// qsort callback ordering index entries by frame index
+//
+static int __cdecl CompareIndexEntries(const void* Left, const void* Right)
+{
+	UINT LeftIndex = reinterpret_cast<const RECORDING_INDEX_ENTRY*>(Left)->Index;
+	UINT RightIndex = reinterpret_cast<const RECORDING_INDEX_ENTRY*>(Right)->Index;
+
+	return (LeftIndex < RightIndex) ? -1 : (LeftIndex > RightIndex) ? 1 : 0;
+}
+
+//
+// Binary search the first Count sorted entries for frame Index. Entry is where it is or would be.
+//
+static bool FindEntry(_In_reads_(Count) const RECORDING_INDEX_ENTRY* Entries, UINT Count, UINT Index, _Out_ UINT* Entry)
+{
+	UINT Low = 0;
+	UINT High = Count;
+	while (Low < High)
+	{
+		UINT Mid = Low + (High - Low) / 2;
+		if (Entries[Mid].Index < Index)
+		{
+			Low = Mid + 1;
+		}
+		else
+		{
+			High = Mid;
+		}
+	}
+
+	*Entry = Low;
+	return Low < Count && Entries[Low].Index == Index;
+}
+
+//
+// Point every repeat at the pixels of the frame it repeats, which was captured before it.
+// Entries must be sorted. Returns the number of repeats whose frame is not in the recording,
+// those are left with a zero DataChunkOffset.
+//
+static UINT ResolveRepeats(_Inout_updates_(Count) RECORDING_INDEX_ENTRY* Entries, UINT Count)
+{
+	UINT Unresolved = 0;
+
+	for (UINT i = 0; i < Count; ++i)
+	{
+		Entries[i].DataChunkOffset = Entries[i].ChunkOffset;
+		if (Entries[i].Flags & RECORDING_FLAG_REPEAT)
+		{
+			// Entries before i are resolved already, so a repeat of a repeat finds the pixels too
+			UINT Source;
+			if (FindEntry(Entries, i, Entries[i].RepeatOf, &Source) && Entries[Source].DataChunkOffset)
+			{
+				Entries[i].DataChunkOffset = Entries[Source].DataChunkOffset;
+			}
+			else
+			{
+				Entries[i].DataChunkOffset = 0;
+				++Unresolved;
+			}
+		}
+	}
+
+	return Unresolved;
+}
+
+RECORDINGWRITER::RECORDINGWRITER() : m_log_file(nullptr),
+									 m_File(INVALID_HANDLE_VALUE),
+									 m_LockInitialized(false),
+									 m_Compress(true),
+									 m_EncodeBufferCount(0),
+									 m_EncodeBufferSize(0),
+									 m_WriteOffset(0),
+									 m_AllocatedSize(0),
+									 m_Index(nullptr),
+									 m_IndexCount(0),
+									 m_IndexCapacity(0)
+{
+}
+
+RECORDINGWRITER::~RECORDINGWRITER()
+{
+	Close();
+}
+
+//
+// Create the file and write a header marking the recording as not yet closed
+//
+DUPL_RETURN RECORDINGWRITER::Open(_In_ FILE *log_file, _In_z_ const char* FileName)
+{
+	m_log_file = log_file;
+
+	m_File = CreateFileA(FileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		fprintf_s(m_log_file, "Failed to create recording %s with error %u.\n", FileName, GetLastError());
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	InitializeCriticalSection(&m_Lock);
+	m_LockInitialized = true;
+
+	RECORDING_FILE_HEADER Header;
+	RtlZeroMemory(&Header, sizeof(Header));
+	Header.Magic = RECORDING_MAGIC;
+	Header.Version = RECORDING_VERSION;
+
+	m_WriteOffset = sizeof(Header);
+	m_AllocatedSize = 0;
+	if (!WriteAt(0, &Header, sizeof(Header)))
+	{
+		fprintf_s(m_log_file, "Failed to write recording header.\n");
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Store pixels as they are instead of encoding them. Set before the first Append.
+//
+void RECORDINGWRITER::SetCompression(bool Compress)
+{
+	m_Compress = Compress;
+}
+
+//
+// Hand out a buffer of at least Size bytes to encode a frame into, reusing one of a
+// previous frame when there is one. Returns nullptr if none could be allocated.
+//
+BYTE* RECORDINGWRITER::AcquireEncodeBuffer(UINT Size)
+{
+	BYTE* Buffer = nullptr;
+
+	EnterCriticalSection(&m_Lock);
+	if (Size > m_EncodeBufferSize)
+	{
+		// Frames got larger, the kept buffers are of no use anymore
+		while (m_EncodeBufferCount)
+		{
+			delete [] m_EncodeBuffers[--m_EncodeBufferCount];
+		}
+		m_EncodeBufferSize = Size;
+	}
+	if (m_EncodeBufferCount)
+	{
+		Buffer = m_EncodeBuffers[--m_EncodeBufferCount];
+	}
+	Size = m_EncodeBufferSize;
+	LeaveCriticalSection(&m_Lock);
+
+	if (!Buffer)
+	{
+		Buffer = new (std::nothrow) BYTE[Size];
+	}
+
+	return Buffer;
+}
+
+void RECORDINGWRITER::ReleaseEncodeBuffer(_In_ BYTE* Buffer, UINT Size)
+{
+	EnterCriticalSection(&m_Lock);
+	if (Size >= m_EncodeBufferSize && m_EncodeBufferCount < RECORDING_ENCODE_BUFFERS)
+	{
+		m_EncodeBuffers[m_EncodeBufferCount++] = Buffer;
+		Buffer = nullptr;
+	}
+	LeaveCriticalSection(&m_Lock);
+
+	if (Buffer)
+	{
+		delete [] Buffer;
+	}
+}
+
+//
+// Positional write, lets several threads fill their reserved ranges at the same time
+//
+bool RECORDINGWRITER::WriteAt(UINT64 Offset, _In_reads_bytes_(Size) const void* Buffer, DWORD Size)
+{
+	OVERLAPPED Overlapped;
+	RtlZeroMemory(&Overlapped, sizeof(Overlapped));
+	Overlapped.Offset = static_cast<DWORD>(Offset);
+	Overlapped.OffsetHigh = static_cast<DWORD>(Offset >> 32);
+
+	DWORD Written = 0;
+	return WriteFile(m_File, Buffer, Size, &Written, &Overlapped) && Written == Size;
+}
+
+//
+// Hand out the next Size bytes of the file, growing it a whole extent at a time
+// so appends don't extend the file on every frame. Called with m_Lock held.
+//
+DUPL_RETURN RECORDINGWRITER::Reserve(UINT64 Size, _Out_ UINT64* Offset)
+{
+	if (m_WriteOffset + Size > m_AllocatedSize)
+	{
+		UINT64 NewSize = m_AllocatedSize + RECORDING_EXTENT_SIZE;
+		if (NewSize < m_WriteOffset + Size)
+		{
+			NewSize = m_WriteOffset + Size + RECORDING_EXTENT_SIZE;
+		}
+
+		LARGE_INTEGER End;
+		End.QuadPart = NewSize;
+		if (!SetFilePointerEx(m_File, End, nullptr, FILE_BEGIN) || !SetEndOfFile(m_File))
+		{
+			fprintf_s(m_log_file, "Failed to grow recording with error %u.\n", GetLastError());
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_AllocatedSize = NewSize;
+	}
+
+	*Offset = m_WriteOffset;
+	m_WriteOffset += Size;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Append one frame. Only the space reservation is serialized, encoding and writing the data
+// are done unlocked. RepeatOf is the index of the frame a RECORDING_FLAG_REPEAT frame shows.
+//
+DUPL_RETURN RECORDINGWRITER::Append(_In_ const RECORDING_FRAME_INFO* Info, _In_reads_bytes_opt_(MetaDataSize) const BYTE* MetaData, UINT MetaDataSize, _In_reads_bytes_opt_(DataSize) const BYTE* Data, UINT DataSize, UINT RepeatOf)
+{
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	RECORDING_CHUNK_HEADER Chunk;
+	RtlZeroMemory(&Chunk, sizeof(Chunk));
+	Chunk.Magic = RECORDING_CHUNK_MAGIC;
+	Chunk.Info = *Info;
+	Chunk.MetaDataSize = MetaData ? MetaDataSize : 0;
+	Chunk.DataSize = Data ? DataSize : 0;
+	Chunk.RepeatOf = (Info->Flags & RECORDING_FLAG_REPEAT) ? RepeatOf : RECORDING_NO_FRAME;
+
+	// Frames that can't be encoded, or a buffer that can't be had, are stored as they are
+	BYTE* EncodeBuffer = nullptr;
+	UINT EncodeBufferSize = 0;
+	if (m_Compress && Chunk.DataSize && GetFormatBytesPerPixel(Info->Format) == sizeof(UINT) &&
+		Info->Width * sizeof(UINT) <= Info->Pitch && static_cast<UINT64>(Info->Pitch) * Info->Height <= Chunk.DataSize)
+	{
+		EncodeBufferSize = GetMaxEncodedSize(Info->Width, Info->Height, SCREENCODEC_STRIP_ROWS);
+		EncodeBuffer = AcquireEncodeBuffer(EncodeBufferSize);
+		UINT EncodedSize = EncodeBuffer ? EncodeScreenFrame(EncodeBuffer, EncodeBufferSize, Data, Info->Pitch, Info->Width, Info->Height, SCREENCODEC_STRIP_ROWS) : 0;
+		if (EncodedSize)
+		{
+			Data = EncodeBuffer;
+			Chunk.DataSize = EncodedSize;
+			Chunk.Info.Flags |= RECORDING_FLAG_ENCODED;
+		}
+	}
+
+	UINT64 Offset;
+	EnterCriticalSection(&m_Lock);
+
+	// Index grows by doubling
+	if (m_IndexCount == m_IndexCapacity)
+	{
+		UINT NewCapacity = m_IndexCapacity ? m_IndexCapacity * 2 : 1024;
+		RECORDING_INDEX_ENTRY* NewIndex = new (std::nothrow) RECORDING_INDEX_ENTRY[NewCapacity];
+		if (!NewIndex)
+		{
+			LeaveCriticalSection(&m_Lock);
+			if (EncodeBuffer)
+			{
+				ReleaseEncodeBuffer(EncodeBuffer, EncodeBufferSize);
+			}
+			fprintf_s(m_log_file, "Failed to grow recording index.\n");
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		if (m_Index)
+		{
+			memcpy(NewIndex, m_Index, m_IndexCount * sizeof(RECORDING_INDEX_ENTRY));
+			delete [] m_Index;
+		}
+		m_Index = NewIndex;
+		m_IndexCapacity = NewCapacity;
+	}
+
+	DUPL_RETURN Ret = Reserve(sizeof(Chunk) + Chunk.MetaDataSize + Chunk.DataSize, &Offset);
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		LeaveCriticalSection(&m_Lock);
+		if (EncodeBuffer)
+		{
+			ReleaseEncodeBuffer(EncodeBuffer, EncodeBufferSize);
+		}
+		return Ret;
+	}
+
+	RECORDING_INDEX_ENTRY* Entry = &m_Index[m_IndexCount++];
+	Entry->ChunkOffset = Offset;
+	Entry->DataChunkOffset = Offset;
+	Entry->Index = Info->Index;
+	Entry->Flags = Chunk.Info.Flags;
+	Entry->CaptureTime = Info->CaptureTime;
+	Entry->RepeatOf = Chunk.RepeatOf;
+	Entry->Reserved = 0;
+
+	LeaveCriticalSection(&m_Lock);
+
+	bool Written = WriteAt(Offset, &Chunk, sizeof(Chunk));
+	if (Written && Chunk.MetaDataSize)
+	{
+		Written = WriteAt(Offset + sizeof(Chunk), MetaData, Chunk.MetaDataSize);
+	}
+	if (Written && Chunk.DataSize)
+	{
+		Written = WriteAt(Offset + sizeof(Chunk) + Chunk.MetaDataSize, Data, Chunk.DataSize);
+	}
+	if (EncodeBuffer)
+	{
+		ReleaseEncodeBuffer(EncodeBuffer, EncodeBufferSize);
+	}
+	if (!Written)
+	{
+		fprintf_s(m_log_file, "Failed to write frame %u to recording with error %u.\n", Info->Index, GetLastError());
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Write the sorted index and footer, patch the header and trim the unused extent
+//
+DUPL_RETURN RECORDINGWRITER::Close()
+{
+	DUPL_RETURN Ret = DUPL_RETURN_SUCCESS;
+
+	if (m_File != INVALID_HANDLE_VALUE)
+	{
+		if (m_IndexCount)
+		{
+			qsort(m_Index, m_IndexCount, sizeof(RECORDING_INDEX_ENTRY), CompareIndexEntries);
+			UINT Unresolved = ResolveRepeats(m_Index, m_IndexCount);
+			if (Unresolved)
+			{
+				fprintf_s(m_log_file, "%u repeated frames show frames missing from the recording.\n", Unresolved);
+			}
+		}
+
+		RECORDING_FILE_FOOTER Footer;
+		Footer.Magic = RECORDING_FOOTER_MAGIC;
+		Footer.FrameCount = m_IndexCount;
+		Footer.IndexOffset = m_WriteOffset;
+
+		RECORDING_FILE_HEADER Header;
+		RtlZeroMemory(&Header, sizeof(Header));
+		Header.Magic = RECORDING_MAGIC;
+		Header.Version = RECORDING_VERSION;
+		Header.IndexOffset = m_WriteOffset;
+		Header.FrameCount = m_IndexCount;
+
+		UINT64 IndexSize = static_cast<UINT64>(m_IndexCount) * sizeof(RECORDING_INDEX_ENTRY);
+		bool Written = (!IndexSize || WriteAt(m_WriteOffset, m_Index, static_cast<DWORD>(IndexSize))) &&
+			WriteAt(m_WriteOffset + IndexSize, &Footer, sizeof(Footer)) &&
+			WriteAt(0, &Header, sizeof(Header));
+
+		LARGE_INTEGER End;
+		End.QuadPart = m_WriteOffset + IndexSize + sizeof(Footer);
+		if (!Written || !SetFilePointerEx(m_File, End, nullptr, FILE_BEGIN) || !SetEndOfFile(m_File))
+		{
+			fprintf_s(m_log_file, "Failed to finalize recording with error %u.\n", GetLastError());
+			Ret = DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+
+		CloseHandle(m_File);
+		m_File = INVALID_HANDLE_VALUE;
+	}
+
+	if (m_Index)
+	{
+		delete [] m_Index;
+		m_Index = nullptr;
+	}
+	m_IndexCount = 0;
+	m_IndexCapacity = 0;
+
+	while (m_EncodeBufferCount)
+	{
+		delete [] m_EncodeBuffers[--m_EncodeBufferCount];
+	}
+	m_EncodeBufferSize = 0;
+
+	if (m_LockInitialized)
+	{
+		DeleteCriticalSection(&m_Lock);
+		m_LockInitialized = false;
+	}
+
+	return Ret;
+}
+
+RECORDINGREADER::RECORDINGREADER() : m_log_file(nullptr),
+									 m_File(INVALID_HANDLE_VALUE),
+									 m_Mapping(nullptr),
+									 m_View(nullptr),
+									 m_Size(0),
+									 m_Index(nullptr),
+									 m_FrameCount(0),
+									 m_Entries(nullptr),
+									 m_FirstIndex(0),
+									 m_IndexSpan(0),
+									 m_Decoded(nullptr),
+									 m_DecodedSize(0),
+									 m_DecodedChunk(nullptr)
+{
+}
+
+RECORDINGREADER::~RECORDINGREADER()
+{
+	Close();
+}
+
+//
+// Map the whole recording read only and locate its index
+//
+DUPL_RETURN RECORDINGREADER::Open(_In_ FILE *log_file, _In_z_ const char* FileName)
+{
+	m_log_file = log_file;
+
+	m_File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		fprintf_s(m_log_file, "Failed to open recording %s with error %u.\n", FileName, GetLastError());
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	LARGE_INTEGER Size;
+	if (!GetFileSizeEx(m_File, &Size) || Size.QuadPart < static_cast<LONGLONG>(sizeof(RECORDING_FILE_HEADER)))
+	{
+		fprintf_s(m_log_file, "Recording %s is too small.\n", FileName);
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+	m_Size = Size.QuadPart;
+
+	m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping)
+	{
+		m_View = reinterpret_cast<const BYTE*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (!m_View)
+	{
+		fprintf_s(m_log_file, "Failed to map recording %s with error %u.\n", FileName, GetLastError());
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	const RECORDING_FILE_HEADER* Header = reinterpret_cast<const RECORDING_FILE_HEADER*>(m_View);
+	if (Header->Magic != RECORDING_MAGIC || Header->Version != RECORDING_VERSION)
+	{
+		fprintf_s(m_log_file, "%s is not a recording.\n", FileName);
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	// A recording that was never closed has no index
+	UINT64 IndexEnd = Header->IndexOffset + static_cast<UINT64>(Header->FrameCount) * sizeof(RECORDING_INDEX_ENTRY);
+	if (!Header->IndexOffset || IndexEnd + sizeof(RECORDING_FILE_FOOTER) > m_Size)
+	{
+		fprintf_s(m_log_file, "Recording %s was not closed.\n", FileName);
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	const RECORDING_FILE_FOOTER* Footer = reinterpret_cast<const RECORDING_FILE_FOOTER*>(m_View + IndexEnd);
+	if (Footer->Magic != RECORDING_FOOTER_MAGIC || Footer->FrameCount != Header->FrameCount || Footer->IndexOffset != Header->IndexOffset)
+	{
+		fprintf_s(m_log_file, "Index of recording %s is damaged.\n", FileName);
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	m_Index = reinterpret_cast<const RECORDING_INDEX_ENTRY*>(m_View + Header->IndexOffset);
+	m_FrameCount = Header->FrameCount;
+
+	return BuildEntries();
+}
+
+//
+// Table from frame index to entry, from the first frame index of the recording to its last.
+// Entries are sorted, indexes missing from the recording are left RECORDING_NO_FRAME.
+//
+DUPL_RETURN RECORDINGREADER::BuildEntries()
+{
+	if (!m_FrameCount)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	for (UINT Entry = 1; Entry < m_FrameCount; ++Entry)
+	{
+		if (m_Index[Entry].Index < m_Index[Entry - 1].Index)
+		{
+			fprintf_s(m_log_file, "Recording index is not sorted.\n");
+			Close();
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+	}
+
+	m_FirstIndex = m_Index[0].Index;
+	m_IndexSpan = m_Index[m_FrameCount - 1].Index - m_FirstIndex + 1;
+
+	// Zero if the indexes span all of UINT
+	m_Entries = m_IndexSpan ? new (std::nothrow) UINT[m_IndexSpan] : nullptr;
+	if (!m_Entries)
+	{
+		fprintf_s(m_log_file, "Failed to allocate the entries of %u recorded frame indexes.\n", m_IndexSpan);
+		Close();
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	for (UINT i = 0; i < m_IndexSpan; ++i)
+	{
+		m_Entries[i] = RECORDING_NO_FRAME;
+	}
+	for (UINT Entry = m_FrameCount; Entry > 0; --Entry)
+	{
+		// Walked backwards so a frame index appended twice finds its first entry
+		m_Entries[m_Index[Entry - 1].Index - m_FirstIndex] = Entry - 1;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Returns the chunk at Offset if it is complete and lies inside the file
+//
+const RECORDING_CHUNK_HEADER* RECORDINGREADER::GetChunk(UINT64 Offset)
+{
+	if (!Offset || Offset + sizeof(RECORDING_CHUNK_HEADER) > m_Size)
+	{
+		return nullptr;
+	}
+
+	const RECORDING_CHUNK_HEADER* Chunk = reinterpret_cast<const RECORDING_CHUNK_HEADER*>(m_View + Offset);
+	if (Chunk->Magic != RECORDING_CHUNK_MAGIC ||
+		Offset + sizeof(RECORDING_CHUNK_HEADER) + Chunk->MetaDataSize + Chunk->DataSize > m_Size)
+	{
+		return nullptr;
+	}
+
+	return Chunk;
+}
+
+void RECORDINGREADER::Close()
+{
+	if (m_View)
+	{
+		UnmapViewOfFile(m_View);
+		m_View = nullptr;
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+	if (m_File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_File);
+		m_File = INVALID_HANDLE_VALUE;
+	}
+	if (m_Entries)
+	{
+		delete [] m_Entries;
+		m_Entries = nullptr;
+	}
+	m_FirstIndex = 0;
+	m_IndexSpan = 0;
+	if (m_Decoded)
+	{
+		delete [] m_Decoded;
+		m_Decoded = nullptr;
+	}
+	m_DecodedSize = 0;
+	m_DecodedChunk = nullptr;
+	m_Index = nullptr;
+	m_FrameCount = 0;
+	m_Size = 0;
+}
+
+UINT RECORDINGREADER::GetFrameCount()
+{
+	return m_FrameCount;
+}
+
+//
+// Look up the Entry'th frame of the index, entries are ordered by frame index
+//
+DUPL_RETURN RECORDINGREADER::GetFrame(UINT Entry, _Out_ RECORDING_FRAME* Frame)
+{
+	RtlZeroMemory(Frame, sizeof(RECORDING_FRAME));
+
+	if (Entry >= m_FrameCount)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	// A repeat of a frame the recording doesn't have is still a valid entry, only without pixels
+	const RECORDING_CHUNK_HEADER* Chunk = GetChunk(m_Index[Entry].ChunkOffset);
+	const RECORDING_CHUNK_HEADER* DataChunk = GetChunk(m_Index[Entry].DataChunkOffset);
+	if (!Chunk || (!DataChunk && m_Index[Entry].DataChunkOffset))
+	{
+		fprintf_s(m_log_file, "Recording entry %u is corrupt.\n", Entry);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	Frame->Header = Chunk;
+	Frame->MetaData = reinterpret_cast<const BYTE*>(Chunk + 1);
+	if (!DataChunk)
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+	Frame->DataHeader = DataChunk;
+	Frame->Data = reinterpret_cast<const BYTE*>(DataChunk + 1) + DataChunk->MetaDataSize;
+	Frame->DataSize = DataChunk->DataSize;
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Point Frame at its pixels decoded, if they are encoded. The decoded pixels stay valid until
+// the next DecodeFrame, decoding the same chunk twice in a row is free.
+//
+DUPL_RETURN RECORDINGREADER::DecodeFrame(_Inout_ RECORDING_FRAME* Frame)
+{
+	const RECORDING_CHUNK_HEADER* DataChunk = Frame->DataHeader;
+	if (!DataChunk || !(DataChunk->Info.Flags & RECORDING_FLAG_ENCODED))
+	{
+		return DUPL_RETURN_SUCCESS;
+	}
+
+	const RECORDING_FRAME_INFO* Info = &DataChunk->Info;
+	UINT64 Size = static_cast<UINT64>(Info->Pitch) * Info->Height;
+	if (Info->Width * sizeof(UINT) > Info->Pitch || Size > UINT_MAX)
+	{
+		fprintf_s(m_log_file, "Recorded frame %u has an invalid size.\n", Info->Index);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	if (m_DecodedChunk != DataChunk)
+	{
+		if (Size > m_DecodedSize)
+		{
+			if (m_Decoded)
+			{
+				delete [] m_Decoded;
+			}
+			m_Decoded = new (std::nothrow) BYTE[static_cast<UINT>(Size)];
+			if (!m_Decoded)
+			{
+				m_DecodedSize = 0;
+				m_DecodedChunk = nullptr;
+				fprintf_s(m_log_file, "Failed to allocate %llu bytes to decode recorded frames.\n", Size);
+				return DUPL_RETURN_ERROR_UNEXPECTED;
+			}
+			m_DecodedSize = static_cast<UINT>(Size);
+		}
+
+		m_DecodedChunk = nullptr;
+		if (!DecodeScreenFrame(m_Decoded, Info->Pitch, Info->Width, Info->Height, Frame->Data, Frame->DataSize))
+		{
+			fprintf_s(m_log_file, "Recorded frame %u could not be decoded.\n", Info->Index);
+			return DUPL_RETURN_ERROR_UNEXPECTED;
+		}
+		m_DecodedChunk = DataChunk;
+	}
+
+	Frame->Data = m_Decoded;
+	Frame->DataSize = static_cast<UINT>(Size);
+
+	return DUPL_RETURN_SUCCESS;
+}
+
+//
+// Entry holding frame Index. Entry is GetFrameCount() if the recording doesn't have it.
+//
+bool RECORDINGREADER::FindFrame(UINT Index, _Out_ UINT* Entry)
+{
+	*Entry = m_FrameCount;
+	if (Index - m_FirstIndex >= m_IndexSpan || m_Entries[Index - m_FirstIndex] == RECORDING_NO_FRAME)
+	{
+		return false;
+	}
+
+	*Entry = m_Entries[Index - m_FirstIndex];
+	return true;
+}
+
+//
+// Binary search for the last frame captured at or before CaptureTime
+//
+bool RECORDINGREADER::FindFrameByTime(LONGLONG CaptureTime, _Out_ UINT* Entry)
+{
+	*Entry = 0;
+	if (!m_FrameCount || m_Index[0].CaptureTime.QuadPart > CaptureTime)
+	{
+		return false;
+	}
+
+	UINT Low = 0;
+	UINT High = m_FrameCount;
+	while (High - Low > 1)
+	{
+		UINT Mid = Low + (High - Low) / 2;
+		if (m_Index[Mid].CaptureTime.QuadPart <= CaptureTime)
+		{
+			Low = Mid;
+		}
+		else
+		{
+			High = Mid;
+		}
+	}
+
+	*Entry = Low;
+	return true;
+}
+
+//
+// Write the Entry'th frame out as a bitmap
+//
+DUPL_RETURN RECORDINGREADER::ExportBitmap(UINT Entry, _In_z_ const char* FileName)
+{
+	RECORDING_FRAME Frame;
+	DUPL_RETURN Ret = GetFrame(Entry, &Frame);
+	if (Ret == DUPL_RETURN_SUCCESS)
+	{
+		Ret = DecodeFrame(&Frame);
+	}
+	if (Ret != DUPL_RETURN_SUCCESS)
+	{
+		return Ret;
+	}
+
+	if (!Frame.DataHeader)
+	{
+		fprintf_s(m_log_file, "Recording entry %u repeats frame %u, which is not in the recording.\n", Entry, m_Index[Entry].RepeatOf);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	// Repeat chunks have no geometry of their own, the pixels are described by their chunk
+	const RECORDING_FRAME_INFO* Info = &Frame.DataHeader->Info;
+	if (!Frame.DataSize || Frame.DataSize < Info->Pitch * Info->Height)
+	{
+		fprintf_s(m_log_file, "Recording entry %u has no pixels.\n", Entry);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	IMAGE_VIEW Image;
+	Image.Data = const_cast<BYTE*>(Frame.Data);
+	Image.Width = Info->Width;
+	Image.Height = Info->Height;
+	Image.Pitch = Info->Pitch;
+	Image.Format = Info->Format;
+	Image.Rotation = DXGI_MODE_ROTATION_IDENTITY;
+	if (!save_as_bitmap(&Image, FileName))
+	{
+		fprintf_s(m_log_file, "Failed to write %s.\n", FileName);
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	return DUPL_RETURN_SUCCESS;
+}
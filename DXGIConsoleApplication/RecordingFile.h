@@ -0,0 +1,175 @@
+// RecordingFile.h : Single file, seekable container for captured frames.
+//
+// Layout:
+//   RECORDING_FILE_HEADER
+//   RECORDING_CHUNK_HEADER, move/dirty rect metadata, pixels     (one chunk per frame)
+//                                      pixels are ScreenCodec encoded if RECORDING_FLAG_ENCODED is set
+//   ...
+//   RECORDING_INDEX_ENTRY[FrameCount] sorted by frame index
+//   RECORDING_FILE_FOOTER
+// The file grows in RECORDING_EXTENT_SIZE steps while recording and is trimmed on Close.
+//
+
+#ifndef _RECORDINGFILE_H_
+#define _RECORDINGFILE_H_
+
+#include "DuplicationManager.h"
+#include "ScreenCodec.h"
+
+#define RECORDING_MAGIC         0x52475844      // "DXGR"
+#define RECORDING_CHUNK_MAGIC   0x4D415246      // "FRAM"
+#define RECORDING_FOOTER_MAGIC  0x58444E49      // "INDX"
+#define RECORDING_VERSION       1
+#define RECORDING_EXTENT_SIZE   (64 * 1024 * 1024)
+
+// Frame is identical to an earlier one, RepeatOf, and carries no pixels
+#define RECORDING_FLAG_REPEAT   0x1
+
+// RepeatOf of frames that aren't repeats, or repeats with nothing captured before them
+#define RECORDING_NO_FRAME      0xFFFFFFFF
+
+// Pixels are encoded with EncodeScreenFrame, DataSize is the encoded size
+#define RECORDING_FLAG_ENCODED  0x2
+
+// Encode buffers kept for reuse, one per writer thread is enough
+#define RECORDING_ENCODE_BUFFERS    8
+
+//
+// Everything stored about a frame besides its metadata and pixels
+//
+typedef struct _RECORDING_FRAME_INFO
+{
+	UINT Index;
+	UINT Flags;
+	LARGE_INTEGER CaptureTime;              // QueryPerformanceCounter ticks
+	LARGE_INTEGER Frequency;
+	DXGI_OUTDUPL_FRAME_INFO FrameInfo;
+	UINT Width;
+	UINT Height;
+	UINT Pitch;
+	DXGI_FORMAT Format;
+	UINT MoveCount;
+	UINT DirtyCount;
+} RECORDING_FRAME_INFO;
+
+typedef struct _RECORDING_FILE_HEADER
+{
+	DWORD Magic;
+	DWORD Version;
+	UINT64 IndexOffset;                     // Zero until the recording is closed
+	UINT FrameCount;
+	UINT Reserved;
+} RECORDING_FILE_HEADER;
+
+typedef struct _RECORDING_CHUNK_HEADER
+{
+	DWORD Magic;
+	UINT MetaDataSize;                      // MoveCount DXGI_OUTDUPL_MOVE_RECTs then DirtyCount RECTs
+	RECORDING_FRAME_INFO Info;
+	UINT DataSize;
+	UINT RepeatOf;                          // Index of the frame a repeat shows
+} RECORDING_CHUNK_HEADER;
+
+typedef struct _RECORDING_INDEX_ENTRY
+{
+	UINT64 ChunkOffset;
+	UINT64 DataChunkOffset;                 // Chunk holding the pixels, differs from ChunkOffset for repeats
+	                                        // and is zero for repeats of frames missing from the recording
+	UINT Index;
+	UINT Flags;
+	LARGE_INTEGER CaptureTime;
+	UINT RepeatOf;
+	UINT Reserved;
+} RECORDING_INDEX_ENTRY;
+
+typedef struct _RECORDING_FILE_FOOTER
+{
+	DWORD Magic;
+	UINT FrameCount;
+	UINT64 IndexOffset;
+} RECORDING_FILE_FOOTER;
+
+//
+// A frame as seen through the reader's mapping. Pointers stay valid until the reader is closed.
+//
+typedef struct _RECORDING_FRAME
+{
+	const RECORDING_CHUNK_HEADER* Header;
+	_Field_size_bytes_(Header->MetaDataSize) const BYTE* MetaData;
+	const RECORDING_CHUNK_HEADER* DataHeader;   // Chunk the pixels are in, nullptr if a repeat can't be resolved
+	const BYTE* Data;                       // Pixels, taken from the repeated frame for repeats
+	UINT DataSize;
+} RECORDING_FRAME;
+
+//
+// Appends frames to a recording. Append may be called from several threads at once.
+// 32bpp pixels are encoded with the screen codec unless compression is turned off.
+//
+class RECORDINGWRITER
+{
+	public:
+		RECORDINGWRITER();
+		~RECORDINGWRITER();
+		DUPL_RETURN Open(_In_ FILE *log_file, _In_z_ const char* FileName);
+		DUPL_RETURN Append(_In_ const RECORDING_FRAME_INFO* Info, _In_reads_bytes_opt_(MetaDataSize) const BYTE* MetaData, UINT MetaDataSize, _In_reads_bytes_opt_(DataSize) const BYTE* Data, UINT DataSize, UINT RepeatOf = RECORDING_NO_FRAME);
+		DUPL_RETURN Close();
+		void SetCompression(bool Compress);
+
+	private:
+		FILE *m_log_file;
+		HANDLE m_File;
+		CRITICAL_SECTION m_Lock;
+		bool m_LockInitialized;
+		bool m_Compress;
+		BYTE* m_EncodeBuffers[RECORDING_ENCODE_BUFFERS];
+		UINT m_EncodeBufferCount;
+		UINT m_EncodeBufferSize;
+		UINT64 m_WriteOffset;
+		UINT64 m_AllocatedSize;
+		RECORDING_INDEX_ENTRY* m_Index;
+		UINT m_IndexCount;
+		UINT m_IndexCapacity;
+
+		bool WriteAt(UINT64 Offset, _In_reads_bytes_(Size) const void* Buffer, DWORD Size);
+		DUPL_RETURN Reserve(UINT64 Size, _Out_ UINT64* Offset);
+		BYTE* AcquireEncodeBuffer(UINT Size);
+		void ReleaseEncodeBuffer(_In_ BYTE* Buffer, UINT Size);
+};
+
+//
+// Memory maps a closed recording and gives O(1) access to frame N, by entry or by frame index
+//
+class RECORDINGREADER
+{
+	public:
+		RECORDINGREADER();
+		~RECORDINGREADER();
+		DUPL_RETURN Open(_In_ FILE *log_file, _In_z_ const char* FileName);
+		void Close();
+		UINT GetFrameCount();
+		DUPL_RETURN GetFrame(UINT Entry, _Out_ RECORDING_FRAME* Frame);
+		DUPL_RETURN DecodeFrame(_Inout_ RECORDING_FRAME* Frame);
+		bool FindFrame(UINT Index, _Out_ UINT* Entry);
+		bool FindFrameByTime(LONGLONG CaptureTime, _Out_ UINT* Entry);
+		DUPL_RETURN ExportBitmap(UINT Entry, _In_z_ const char* FileName);
+
+	private:
+		FILE *m_log_file;
+		HANDLE m_File;
+		HANDLE m_Mapping;
+		const BYTE* m_View;
+		UINT64 m_Size;
+		const RECORDING_INDEX_ENTRY* m_Index;
+		UINT m_FrameCount;
+		UINT* m_Entries;                    // Entry of each frame index from m_FirstIndex on, RECORDING_NO_FRAME in gaps
+		UINT m_FirstIndex;
+		UINT m_IndexSpan;
+		BYTE* m_Decoded;
+		UINT m_DecodedSize;
+		const RECORDING_CHUNK_HEADER* m_DecodedChunk;    // Chunk m_Decoded holds the pixels of
+
+		DUPL_RETURN BuildEntries();
+		const RECORDING_CHUNK_HEADER* GetChunk(UINT64 Offset);
+};
+
+#endif
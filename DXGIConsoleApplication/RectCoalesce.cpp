@@ -0,0 +1,217 @@
+// RectCoalesce.cpp : Merges overlapping and adjacent dirty rects before they are drawn or copied.
+//
+
+#include "RectCoalesce.h"
+#include <stdlib.h>
+
+// Below this many rects an insertion sort beats qsort, DXGI mostly reports them in order already
+#define COALESCE_INSERTION_SORT_MAX     64
+
+//
+// A merged rect still open for merging and the pixels of it that changed, as far as known
+//
+typedef struct _COALESCE_ENTRY
+{
+	RECT Rect;
+	LONGLONG Covered;
+} COALESCE_ENTRY;
+
+static inline LONGLONG GetArea(_In_ const RECT* Rect)
+{
+	return static_cast<LONGLONG>(Rect->right - Rect->left) * (Rect->bottom - Rect->top);
+}
+
+static inline bool IsAbove(_In_ const RECT* a, _In_ const RECT* b)
+{
+	return (a->top < b->top) || (a->top == b->top && a->left < b->left);
+}
+
+static int CompareRects(const void* a, const void* b)
+{
+	const RECT* x = reinterpret_cast<const RECT*>(a);
+	const RECT* y = reinterpret_cast<const RECT*>(b);
+	return IsAbove(x, y) ? -1 : IsAbove(y, x) ? 1 : 0;
+}
+
+//
+// Merge Other into Entry if the cost model allows it
+//
+static bool TryMerge(_Inout_ COALESCE_ENTRY* Entry, _In_ const COALESCE_ENTRY* Other, _In_ const COALESCE_PARAMS* Params)
+{
+	RECT Union;
+	Union.left = min(Entry->Rect.left, Other->Rect.left);
+	Union.top = min(Entry->Rect.top, Other->Rect.top);
+	Union.right = max(Entry->Rect.right, Other->Rect.right);
+	Union.bottom = max(Entry->Rect.bottom, Other->Rect.bottom);
+
+	LONGLONG OverlapWidth = min(Entry->Rect.right, Other->Rect.right) - max(Entry->Rect.left, Other->Rect.left);
+	LONGLONG OverlapHeight = min(Entry->Rect.bottom, Other->Rect.bottom) - max(Entry->Rect.top, Other->Rect.top);
+	LONGLONG Overlap = (OverlapWidth > 0 && OverlapHeight > 0) ? OverlapWidth * OverlapHeight : 0;
+
+	// Pixels the union adds over the two rects, wasted when the union is copied
+	LONGLONG UnionArea = GetArea(&Union);
+	LONGLONG Waste = UnionArea - GetArea(&Entry->Rect) - GetArea(&Other->Rect) + Overlap;
+	if (Waste > static_cast<LONGLONG>(Params->RectCost))
+	{
+		return false;
+	}
+
+	// Earlier merges may have wasted pixels already, the share is of the pixels known to have changed
+	LONGLONG Covered = min(Entry->Covered + Other->Covered - Overlap, UnionArea);
+	if ((UnionArea - Covered) * 100 > static_cast<LONGLONG>(Params->MaxWastePercent) * UnionArea)
+	{
+		return false;
+	}
+
+	Entry->Rect = Union;
+	Entry->Covered = Covered;
+	return true;
+}
+
+//
+// Sort by top, then left, so rects that can merge are close to each other
+//
+static void SortRects(_Inout_updates_(Count) RECT* Rects, UINT Count)
+{
+	if (Count > COALESCE_INSERTION_SORT_MAX)
+	{
+		qsort(Rects, Count, sizeof(RECT), CompareRects);
+		return;
+	}
+
+	for (UINT i = 1; i < Count; ++i)
+	{
+		RECT Rect = Rects[i];
+		UINT j = i;
+		while (j > 0 && IsAbove(&Rect, &Rects[j - 1]))
+		{
+			Rects[j] = Rects[j - 1];
+			--j;
+		}
+		Rects[j] = Rect;
+	}
+}
+
+//
+// Rects are swept top to bottom and merged into a small window of open rects. A merge
+// grows the rect, so it is then tried against the rest of the window again. When the
+// window is full the open rect that ends highest up is written out, later rects are the
+// least likely to reach it. Open rects too far above to ever be merged again are written
+// out as soon as the sweep passes them. Written rects are never more than the rects read so far,
+// which lets the result go into the input array.
+//
+UINT CoalesceRects(_Inout_updates_(Count) RECT* Rects, UINT Count, _In_opt_ const COALESCE_PARAMS* Params)
+{
+	COALESCE_PARAMS Defaults = { COALESCE_DEFAULT_RECT_COST, COALESCE_DEFAULT_WASTE_PERCENT };
+	if (!Params)
+	{
+		Params = &Defaults;
+	}
+
+	// Drop empty rects
+	UINT Valid = 0;
+	for (UINT i = 0; i < Count; ++i)
+	{
+		if (Rects[i].left < Rects[i].right && Rects[i].top < Rects[i].bottom)
+		{
+			Rects[Valid++] = Rects[i];
+		}
+	}
+	if (Valid < 2)
+	{
+		return Valid;
+	}
+
+	SortRects(Rects, Valid);
+
+	COALESCE_ENTRY Window[COALESCE_WINDOW];
+	UINT Open = 0;
+	UINT Written = 0;
+
+	for (UINT i = 0; i < Valid; ++i)
+	{
+		COALESCE_ENTRY Next;
+		Next.Rect = Rects[i];
+		Next.Covered = GetArea(&Next.Rect);
+
+		UINT Merged = COALESCE_WINDOW;
+		for (UINT j = Open; j-- > 0;)
+		{
+			// Bridging the rows between an open rect and this one wastes at least that many rows
+			// of the open rect's width, and later rects only start further down
+			LONGLONG Gap = Next.Rect.top - Window[j].Rect.bottom;
+			if (Gap > 0 && Gap * (Window[j].Rect.right - Window[j].Rect.left) > static_cast<LONGLONG>(Params->RectCost))
+			{
+				Rects[Written++] = Window[j].Rect;
+				Window[j] = Window[--Open];
+				continue;
+			}
+
+			if (TryMerge(&Window[j], &Next, Params))
+			{
+				Merged = j;
+				break;
+			}
+		}
+
+		if (Merged == COALESCE_WINDOW)
+		{
+			if (Open == COALESCE_WINDOW)
+			{
+				UINT Highest = 0;
+				for (UINT j = 1; j < Open; ++j)
+				{
+					if (Window[j].Rect.bottom < Window[Highest].Rect.bottom)
+					{
+						Highest = j;
+					}
+				}
+				Rects[Written++] = Window[Highest].Rect;
+				Window[Highest] = Window[--Open];
+			}
+			Window[Open++] = Next;
+			continue;
+		}
+
+		// The grown rect may reach other open rects now
+		bool Grew = true;
+		while (Grew)
+		{
+			Grew = false;
+			for (UINT j = 0; j < Open; ++j)
+			{
+				if (j != Merged && TryMerge(&Window[Merged], &Window[j], Params))
+				{
+					Window[j] = Window[--Open];
+					if (Merged == Open)
+					{
+						Merged = j;
+					}
+					Grew = true;
+					break;
+				}
+			}
+		}
+	}
+
+	for (UINT j = 0; j < Open; ++j)
+	{
+		Rects[Written++] = Window[j].Rect;
+	}
+
+	return Written;
+}
+
+LONGLONG GetRectsArea(_In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	LONGLONG Area = 0;
+	for (UINT i = 0; i < Count; ++i)
+	{
+		if (Rects[i].left < Rects[i].right && Rects[i].top < Rects[i].bottom)
+		{
+			Area += GetArea(&Rects[i]);
+		}
+	}
+
+	return Area;
+}
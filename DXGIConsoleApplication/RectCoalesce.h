@@ -0,0 +1,43 @@
+// RectCoalesce.h : Merges overlapping and adjacent dirty rects before they are drawn or copied.
+//
+
+#ifndef _RECTCOALESCE_H_
+#define _RECTCOALESCE_H_
+
+#include <windows.h>
+#include <sal.h>
+
+// Unchanged pixels one rect less is worth, about what the per rect overhead of a copy or draw costs
+#define COALESCE_DEFAULT_RECT_COST      4096
+
+// Largest share of a merged rect that may be unchanged pixels
+#define COALESCE_DEFAULT_WASTE_PERCENT  50
+
+// Merged rects still open for merging while the rects are swept top to bottom
+#define COALESCE_WINDOW                 16
+
+//
+// Cost model of a merge. Two rects are replaced by their bounding rect when the pixels
+// the bounding rect adds that neither of them covered are at most RectCost, and the
+// result stays within MaxWastePercent of unchanged pixels. A RectCost of 0 still merges
+// rects that overlap, touch along a full edge or contain each other, as that wastes nothing.
+//
+typedef struct _COALESCE_PARAMS
+{
+	UINT RectCost;
+	UINT MaxWastePercent;
+} COALESCE_PARAMS;
+
+//
+// Merge the rects in place and return how many are left. Empty rects are dropped and
+// the order of the result is not that of the input. Every pixel covered by the input is
+// covered by the result. Params may be nullptr for the defaults.
+//
+UINT CoalesceRects(_Inout_updates_(Count) RECT* Rects, UINT Count, _In_opt_ const COALESCE_PARAMS* Params);
+
+//
+// Pixels covered by the rects, counting overlapping pixels once per rect
+//
+LONGLONG GetRectsArea(_In_reads_(Count) const RECT* Rects, UINT Count);
+
+#endif
@@ -0,0 +1,332 @@
+// RegionCopy.cpp : CPU side counterpart of the dirty rect processing in DISPLAYMANAGER.
+//
+
+#include "RegionCopy.h"
+
+//
+// Clip a rect against the image bounds. Returns false if nothing is left.
+//
+static bool ClipRect(_Inout_ RECT* Rect, UINT Width, UINT Height)
+{
+	if (Rect->left < 0)
+	{
+		Rect->left = 0;
+	}
+	if (Rect->top < 0)
+	{
+		Rect->top = 0;
+	}
+	if (Rect->right > static_cast<LONG>(Width))
+	{
+		Rect->right = Width;
+	}
+	if (Rect->bottom > static_cast<LONG>(Height))
+	{
+		Rect->bottom = Height;
+	}
+
+	return Rect->left < Rect->right && Rect->top < Rect->bottom;
+}
+
+UINT CopyRegions(_Inout_ BYTE* Dst, UINT DstPitch, _In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	UINT BytesCopied = 0;
+
+	for (UINT i = 0; i < Count; ++i)
+	{
+		RECT Rect = Rects[i];
+		if (!ClipRect(&Rect, Width, Height))
+		{
+			continue;
+		}
+
+		UINT RowBytes = (Rect.right - Rect.left) * BPP;
+		UINT Rows = Rect.bottom - Rect.top;
+		BYTE* DstRow = Dst + Rect.top * DstPitch + Rect.left * BPP;
+		const BYTE* SrcRow = Src + Rect.top * SrcPitch + Rect.left * BPP;
+
+		// Full width rects of identically laid out images are one contiguous block
+		if (Rect.left == 0 && Rect.right == static_cast<LONG>(Width) && DstPitch == SrcPitch)
+		{
+			memcpy(DstRow, SrcRow, (Rows - 1) * DstPitch + RowBytes);
+		}
+		else
+		{
+			for (UINT y = 0; y < Rows; ++y, DstRow += DstPitch, SrcRow += SrcPitch)
+			{
+				memcpy(DstRow, SrcRow, RowBytes);
+			}
+		}
+
+		BytesCopied += Rows * RowBytes;
+	}
+
+	return BytesCopied;
+}
+
+void SetMoveRectForRotation(_Out_ RECT* SrcRect, _Out_ RECT* DestRect, DXGI_MODE_ROTATION Rotation, _In_ const DXGI_OUTDUPL_MOVE_RECT* MoveRect, INT TexWidth, INT TexHeight)
+{
+	INT MoveWidth = MoveRect->DestinationRect.right - MoveRect->DestinationRect.left;
+	INT MoveHeight = MoveRect->DestinationRect.bottom - MoveRect->DestinationRect.top;
+
+	switch (Rotation)
+	{
+		case DXGI_MODE_ROTATION_UNSPECIFIED:
+		case DXGI_MODE_ROTATION_IDENTITY:
+		{
+			SrcRect->left = MoveRect->SourcePoint.x;
+			SrcRect->top = MoveRect->SourcePoint.y;
+			SrcRect->right = MoveRect->SourcePoint.x + MoveWidth;
+			SrcRect->bottom = MoveRect->SourcePoint.y + MoveHeight;
+
+			*DestRect = MoveRect->DestinationRect;
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE90:
+		{
+			SrcRect->left = TexHeight - (MoveRect->SourcePoint.y + MoveHeight);
+			SrcRect->top = MoveRect->SourcePoint.x;
+			SrcRect->right = TexHeight - MoveRect->SourcePoint.y;
+			SrcRect->bottom = MoveRect->SourcePoint.x + MoveWidth;
+
+			DestRect->left = TexHeight - MoveRect->DestinationRect.bottom;
+			DestRect->top = MoveRect->DestinationRect.left;
+			DestRect->right = TexHeight - MoveRect->DestinationRect.top;
+			DestRect->bottom = MoveRect->DestinationRect.right;
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE180:
+		{
+			SrcRect->left = TexWidth - (MoveRect->SourcePoint.x + MoveWidth);
+			SrcRect->top = TexHeight - (MoveRect->SourcePoint.y + MoveHeight);
+			SrcRect->right = TexWidth - MoveRect->SourcePoint.x;
+			SrcRect->bottom = TexHeight - MoveRect->SourcePoint.y;
+
+			DestRect->left = TexWidth - MoveRect->DestinationRect.right;
+			DestRect->top = TexHeight - MoveRect->DestinationRect.bottom;
+			DestRect->right = TexWidth - MoveRect->DestinationRect.left;
+			DestRect->bottom = TexHeight - MoveRect->DestinationRect.top;
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE270:
+		{
+			SrcRect->left = MoveRect->SourcePoint.y;
+			SrcRect->top = TexWidth - (MoveRect->SourcePoint.x + MoveWidth);
+			SrcRect->right = MoveRect->SourcePoint.y + MoveHeight;
+			SrcRect->bottom = TexWidth - MoveRect->SourcePoint.x;
+
+			DestRect->left = MoveRect->DestinationRect.top;
+			DestRect->top = TexWidth - MoveRect->DestinationRect.right;
+			DestRect->right = MoveRect->DestinationRect.bottom;
+			DestRect->bottom = TexWidth - MoveRect->DestinationRect.left;
+			break;
+		}
+		default:
+		{
+			RtlZeroMemory(DestRect, sizeof(RECT));
+			RtlZeroMemory(SrcRect, sizeof(RECT));
+			break;
+		}
+	}
+}
+
+//
+// Same mapping as the destination of SetMoveRectForRotation, the rotation is picked once per batch
+// so every loop is a plain pass over the rects
+//
+void RotateRects(_Out_writes_(Count) RECT* Dst, _In_reads_(Count) const RECT* Src, UINT Count, DXGI_MODE_ROTATION Rotation, INT TexWidth, INT TexHeight)
+{
+	switch (Rotation)
+	{
+		case DXGI_MODE_ROTATION_UNSPECIFIED:
+		case DXGI_MODE_ROTATION_IDENTITY:
+		{
+			if (Dst != Src)
+			{
+				memmove(Dst, Src, Count * sizeof(RECT));
+			}
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE90:
+		{
+			for (UINT i = 0; i < Count; ++i)
+			{
+				RECT Rect = Src[i];
+				Dst[i].left = TexHeight - Rect.bottom;
+				Dst[i].top = Rect.left;
+				Dst[i].right = TexHeight - Rect.top;
+				Dst[i].bottom = Rect.right;
+			}
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE180:
+		{
+			for (UINT i = 0; i < Count; ++i)
+			{
+				RECT Rect = Src[i];
+				Dst[i].left = TexWidth - Rect.right;
+				Dst[i].top = TexHeight - Rect.bottom;
+				Dst[i].right = TexWidth - Rect.left;
+				Dst[i].bottom = TexHeight - Rect.top;
+			}
+			break;
+		}
+		case DXGI_MODE_ROTATION_ROTATE270:
+		{
+			for (UINT i = 0; i < Count; ++i)
+			{
+				RECT Rect = Src[i];
+				Dst[i].left = Rect.top;
+				Dst[i].top = TexWidth - Rect.right;
+				Dst[i].right = Rect.bottom;
+				Dst[i].bottom = TexWidth - Rect.left;
+			}
+			break;
+		}
+		default:
+		{
+			RtlZeroMemory(Dst, Count * sizeof(RECT));
+			break;
+		}
+	}
+}
+
+//
+// Clip a source / destination pair of equally sized rects so both stay inside the image
+//
+static bool ClipMove(_Inout_ RECT* SrcRect, _Inout_ RECT* DestRect, UINT Width, UINT Height)
+{
+	LONG Delta;
+
+	Delta = max(max(-SrcRect->left, -DestRect->left), 0L);
+	SrcRect->left += Delta;
+	DestRect->left += Delta;
+
+	Delta = max(max(-SrcRect->top, -DestRect->top), 0L);
+	SrcRect->top += Delta;
+	DestRect->top += Delta;
+
+	Delta = max(max(SrcRect->right - static_cast<LONG>(Width), DestRect->right - static_cast<LONG>(Width)), 0L);
+	SrcRect->right -= Delta;
+	DestRect->right -= Delta;
+
+	Delta = max(max(SrcRect->bottom - static_cast<LONG>(Height), DestRect->bottom - static_cast<LONG>(Height)), 0L);
+	SrcRect->bottom -= Delta;
+	DestRect->bottom -= Delta;
+
+	return SrcRect->left < SrcRect->right && SrcRect->top < SrcRect->bottom;
+}
+
+UINT ApplyMoveRects(_Inout_ BYTE* Image, UINT Pitch, UINT Width, UINT Height, _In_reads_(Count) const DXGI_OUTDUPL_MOVE_RECT* MoveRects, UINT Count, DXGI_MODE_ROTATION Rotation, INT TexWidth, INT TexHeight)
+{
+	UINT BytesMoved = 0;
+
+	for (UINT i = 0; i < Count; ++i)
+	{
+		RECT SrcRect;
+		RECT DestRect;
+
+		SetMoveRectForRotation(&SrcRect, &DestRect, Rotation, &MoveRects[i], TexWidth, TexHeight);
+		if (!ClipMove(&SrcRect, &DestRect, Width, Height))
+		{
+			continue;
+		}
+
+		UINT RowBytes = (SrcRect.right - SrcRect.left) * BPP;
+		UINT Rows = SrcRect.bottom - SrcRect.top;
+		BYTE* SrcRow = Image + SrcRect.top * Pitch + SrcRect.left * BPP;
+		BYTE* DestRow = Image + DestRect.top * Pitch + DestRect.left * BPP;
+
+		if (DestRect.top > SrcRect.top)
+		{
+			// Moving down, walk bottom up so source rows are read before they are overwritten
+			SrcRow += (Rows - 1) * Pitch;
+			DestRow += (Rows - 1) * Pitch;
+			for (UINT y = 0; y < Rows; ++y, SrcRow -= Pitch, DestRow -= Pitch)
+			{
+				memmove(DestRow, SrcRow, RowBytes);
+			}
+		}
+		else
+		{
+			// Moving up or sideways, memmove handles the overlap within a row
+			for (UINT y = 0; y < Rows; ++y, SrcRow += Pitch, DestRow += Pitch)
+			{
+				memmove(DestRow, SrcRow, RowBytes);
+			}
+		}
+
+		BytesMoved += Rows * RowBytes;
+	}
+
+	return BytesMoved;
+}
+
+UINT CopyRegionsRotated(_Inout_ BYTE* Dst, UINT DstPitch, UINT DstWidth, UINT DstHeight, _In_ const BYTE* Src, UINT SrcPitch, INT TexWidth, INT TexHeight,
+	DXGI_MODE_ROTATION Rotation, _In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	if (Rotation == DXGI_MODE_ROTATION_IDENTITY || Rotation == DXGI_MODE_ROTATION_UNSPECIFIED)
+	{
+		return CopyRegions(Dst, DstPitch, Src, SrcPitch, min(DstWidth, static_cast<UINT>(TexWidth)), min(DstHeight, static_cast<UINT>(TexHeight)), Rects, Count);
+	}
+
+	UINT BytesCopied = 0;
+
+	for (UINT i = 0; i < Count; ++i)
+	{
+		// Where the rect ends up on the desktop, the same mapping as a move destination
+		DXGI_OUTDUPL_MOVE_RECT Move;
+		RtlZeroMemory(&Move, sizeof(Move));
+		Move.DestinationRect = Rects[i];
+		if (!ClipRect(&Move.DestinationRect, TexWidth, TexHeight))
+		{
+			continue;
+		}
+		RECT Unused;
+		RECT Rect;
+		SetMoveRectForRotation(&Unused, &Rect, Rotation, &Move, TexWidth, TexHeight);
+		if (!ClipRect(&Rect, DstWidth, DstHeight))
+		{
+			continue;
+		}
+
+		// Each destination row is a column or a reversed row of the source
+		UINT Width = Rect.right - Rect.left;
+		for (LONG y = Rect.top; y < Rect.bottom; ++y)
+		{
+			UINT* DstPixel = reinterpret_cast<UINT*>(Dst + y * DstPitch + Rect.left * BPP);
+			const BYTE* SrcPixel;
+			INT Step;
+			switch (Rotation)
+			{
+				case DXGI_MODE_ROTATION_ROTATE90:
+				{
+					SrcPixel = Src + (TexHeight - 1 - Rect.left) * SrcPitch + y * BPP;
+					Step = -static_cast<INT>(SrcPitch);
+					break;
+				}
+				case DXGI_MODE_ROTATION_ROTATE180:
+				{
+					SrcPixel = Src + (TexHeight - 1 - y) * SrcPitch + (TexWidth - 1 - Rect.left) * BPP;
+					Step = -BPP;
+					break;
+				}
+				default:
+				{
+					SrcPixel = Src + Rect.left * SrcPitch + (TexWidth - 1 - y) * BPP;
+					Step = static_cast<INT>(SrcPitch);
+					break;
+				}
+			}
+
+			for (UINT x = 0; x < Width; ++x, SrcPixel += Step)
+			{
+				DstPixel[x] = *reinterpret_cast<const UINT*>(SrcPixel);
+			}
+		}
+
+		BytesCopied += Width * (Rect.bottom - Rect.top) * BPP;
+	}
+
+	return BytesCopied;
+}
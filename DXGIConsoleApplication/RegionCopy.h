@@ -0,0 +1,47 @@
+// RegionCopy.h : Copies rectangular regions between two pitched 32bpp images and
+// applies DXGI move rects to an image in place.
+//
+
+#ifndef _REGIONCOPY_H_
+#define _REGIONCOPY_H_
+
+#include <windows.h>
+#include <sal.h>
+#include <dxgi1_2.h>
+#include "ImageView.h"
+
+//
+// Copy every rect from Src to the same position in Dst. Rects are clipped to Width x Height.
+// Returns the number of pixel bytes copied.
+//
+UINT CopyRegions(_Inout_ BYTE* Dst, UINT DstPitch, _In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _In_reads_(Count) const RECT* Rects, UINT Count);
+
+//
+// CPU equivalent of DISPLAYMANAGER::SetMoveRect. Converts a move rect from the acquired image
+// into source and destination rects of a surface laid out for the given output rotation.
+//
+void SetMoveRectForRotation(_Out_ RECT* SrcRect, _Out_ RECT* DestRect, DXGI_MODE_ROTATION Rotation, _In_ const DXGI_OUTDUPL_MOVE_RECT* MoveRect, INT TexWidth, INT TexHeight);
+
+//
+// Destination rects of SetMoveRectForRotation for a batch of rects of the acquired image, which is
+// TexWidth x TexHeight. Dst may be Src.
+//
+void RotateRects(_Out_writes_(Count) RECT* Dst, _In_reads_(Count) const RECT* Src, UINT Count, DXGI_MODE_ROTATION Rotation, INT TexWidth, INT TexHeight);
+
+//
+// CPU equivalent of DISPLAYMANAGER::CopyMove. Applies the move rects in order to Image in place,
+// without an intermediate surface. Image is laid out for Rotation and is Width x Height pixels,
+// TexWidth x TexHeight is the size of the acquired image. Returns the number of pixel bytes moved.
+//
+UINT ApplyMoveRects(_Inout_ BYTE* Image, UINT Pitch, UINT Width, UINT Height, _In_reads_(Count) const DXGI_OUTDUPL_MOVE_RECT* MoveRects, UINT Count, DXGI_MODE_ROTATION Rotation, INT TexWidth, INT TexHeight);
+
+//
+// Copy the rects of the acquired image Src, which is TexWidth x TexHeight, into Dst turned upright
+// for an output with the given Rotation, so Dst is laid out like the desktop. Rects are in Src and
+// clipped to it, what they cover in Dst is clipped to DstWidth x DstHeight. Returns the number of
+// pixel bytes copied.
+//
+UINT CopyRegionsRotated(_Inout_ BYTE* Dst, UINT DstPitch, UINT DstWidth, UINT DstHeight, _In_ const BYTE* Src, UINT SrcPitch, INT TexWidth, INT TexHeight,
+	DXGI_MODE_ROTATION Rotation, _In_reads_(Count) const RECT* Rects, UINT Count);
+
+#endif
@@ -0,0 +1,623 @@
+// ScreenCodec.cpp : Strip parallel lossless codec for recorded frames.
+//
+
+#include "ScreenCodec.h"
+#include <string.h>
+
+#define OP_INDEX    0x00
+#define OP_DIFF     0x40
+#define OP_LUMA     0x80
+#define OP_RUN      0xC0
+#define OP_UP       0xE0
+#define OP_BGR      0xFE
+#define OP_BGRA     0xFF
+
+// Run lengths up to Short fit in the op, longer ones take one or two more bytes
+#define RUN_SHORT   30
+#define UP_SHORT    14
+
+// Bytes a literal pixel takes at most
+#define MAX_PIXEL_BYTES     5
+
+// Both ends start from opaque black, like QOI
+#define START_PIXEL 0xFF000000
+
+//
+// One frame being encoded or decoded. Workers take strips off NextStrip until none are left.
+//
+typedef struct _SCREENCODEC_JOB
+{
+	bool Decode;
+	const BYTE* Src;            // Image when encoding, strip data when decoding
+	UINT SrcPitch;
+	BYTE* Dst;                  // Strip budgets when encoding, image when decoding
+	UINT DstPitch;
+	UINT Width;
+	UINT Height;
+	UINT StripRows;
+	UINT StripCount;
+	UINT* Sizes;
+	volatile LONG NextStrip;
+	volatile LONG Failed;
+} SCREENCODEC_JOB;
+
+static inline UINT HashPixel(UINT Pixel)
+{
+	return (Pixel * 2654435761u) >> 26;
+}
+
+static inline UINT GetStripBytes(UINT Width, UINT Rows)
+{
+	return Width * sizeof(UINT) * Rows;
+}
+
+//
+// Emit a run of Length pixels, in pieces if it is longer than one op holds. Returns nullptr if it doesn't fit.
+//
+static BYTE* PutRun(_Out_writes_bytes_to_(End - p, return - p) BYTE* p, _In_ const BYTE* End, BYTE Op, UINT Short, UINT Length)
+{
+	const UINT Max = Short + 256 + 65536;
+	while (Length)
+	{
+		if (End - p < 3)
+		{
+			return nullptr;
+		}
+
+		UINT Piece = (Length < Max) ? Length : Max;
+		if (Piece <= Short)
+		{
+			*p++ = static_cast<BYTE>(Op | (Piece - 1));
+		}
+		else if (Piece <= Short + 256)
+		{
+			*p++ = static_cast<BYTE>(Op | Short);
+			*p++ = static_cast<BYTE>(Piece - Short - 1);
+		}
+		else
+		{
+			UINT Extra = Piece - Short - 257;
+			*p++ = static_cast<BYTE>(Op | (Short + 1));
+			*p++ = static_cast<BYTE>(Extra);
+			*p++ = static_cast<BYTE>(Extra >> 8);
+		}
+		Length -= Piece;
+	}
+
+	return p;
+}
+
+//
+// Read the length of a run op whose low bits are Code. Returns false if the stream ends early.
+//
+static inline bool GetRun(_Inout_ const BYTE** s, _In_ const BYTE* End, UINT Code, UINT Short, _Out_ UINT* Length)
+{
+	if (Code < Short)
+	{
+		*Length = Code + 1;
+		return true;
+	}
+	if (Code == Short)
+	{
+		if (End - *s < 1)
+		{
+			return false;
+		}
+		*Length = Short + 1 + (*s)[0];
+		*s += 1;
+		return true;
+	}
+
+	if (End - *s < 2)
+	{
+		return false;
+	}
+	*Length = Short + 257 + ((*s)[0] | ((*s)[1] << 8));
+	*s += 2;
+	return true;
+}
+
+//
+// Emit a pixel that isn't part of a run, as the cheapest of cache hit, difference or literal
+//
+static inline BYTE* PutPixel(_Out_writes_bytes_(MAX_PIXEL_BYTES) BYTE* p, UINT Pixel, UINT Prev, _Inout_updates_(64) UINT* Cache)
+{
+	UINT Hash = HashPixel(Pixel);
+	if (Cache[Hash] == Pixel)
+	{
+		*p++ = static_cast<BYTE>(OP_INDEX | Hash);
+		return p;
+	}
+	Cache[Hash] = Pixel;
+
+	if ((Pixel ^ Prev) >> 24)
+	{
+		*p++ = OP_BGRA;
+		memcpy(p, &Pixel, sizeof(Pixel));
+		return p + sizeof(Pixel);
+	}
+
+	INT db = static_cast<signed char>((Pixel & 0xFF) - (Prev & 0xFF));
+	INT dg = static_cast<signed char>(((Pixel >> 8) & 0xFF) - ((Prev >> 8) & 0xFF));
+	INT dr = static_cast<signed char>(((Pixel >> 16) & 0xFF) - ((Prev >> 16) & 0xFF));
+	if (static_cast<UINT>(db + 2) < 4 && static_cast<UINT>(dg + 2) < 4 && static_cast<UINT>(dr + 2) < 4)
+	{
+		*p++ = static_cast<BYTE>(OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+		return p;
+	}
+
+	INT drg = dr - dg;
+	INT dbg = db - dg;
+	if (static_cast<UINT>(dg + 32) < 64 && static_cast<UINT>(drg + 8) < 16 && static_cast<UINT>(dbg + 8) < 16)
+	{
+		*p++ = static_cast<BYTE>(OP_LUMA | (dg + 32));
+		*p++ = static_cast<BYTE>(((drg + 8) << 4) | (dbg + 8));
+		return p;
+	}
+
+	*p++ = OP_BGR;
+	*p++ = static_cast<BYTE>(Pixel);
+	*p++ = static_cast<BYTE>(Pixel >> 8);
+	*p++ = static_cast<BYTE>(Pixel >> 16);
+	return p;
+}
+
+//
+// Runs are found by scanning ahead instead of pixel by pixel, screen content is mostly
+// runs of the same color or rows repeating the one above. A run still open at the end of
+// a row carries on into the next one.
+//
+UINT EncodeStrip(_Out_writes_bytes_to_(Capacity, return) BYTE* Dst, UINT Capacity, _In_ const BYTE* Src, UINT Pitch, UINT Width, UINT Rows)
+{
+	if (Capacity < MAX_PIXEL_BYTES)
+	{
+		return 0;
+	}
+
+	BYTE* p = Dst;
+	const BYTE* End = Dst + Capacity;
+	const BYTE* Limit = End - MAX_PIXEL_BYTES;
+
+	UINT Cache[64];
+	RtlZeroMemory(Cache, sizeof(Cache));
+	UINT Prev = START_PIXEL;
+	UINT Run = 0;
+	UINT Up = 0;
+
+	for (UINT y = 0; y < Rows; ++y)
+	{
+		const UINT* Row = reinterpret_cast<const UINT*>(Src + static_cast<SIZE_T>(y) * Pitch);
+		const UINT* Above = y ? reinterpret_cast<const UINT*>(Src + static_cast<SIZE_T>(y - 1) * Pitch) : nullptr;
+
+		UINT x = 0;
+		while (x < Width)
+		{
+			if (Up)
+			{
+				UINT Next = x;
+				while (Next < Width && Row[Next] == Above[Next])
+				{
+					++Next;
+				}
+				Up += Next - x;
+				if (Next > x)
+				{
+					Prev = Row[Next - 1];
+				}
+				x = Next;
+				if (x == Width)
+				{
+					break;
+				}
+				p = PutRun(p, End, OP_UP, UP_SHORT, Up);
+				Up = 0;
+			}
+			else if (Run)
+			{
+				UINT Next = x;
+				while (Next < Width && Row[Next] == Prev)
+				{
+					++Next;
+				}
+				Run += Next - x;
+				x = Next;
+				if (x == Width)
+				{
+					break;
+				}
+				p = PutRun(p, End, OP_RUN, RUN_SHORT, Run);
+				Run = 0;
+			}
+			if (!p)
+			{
+				return 0;
+			}
+
+			UINT Pixel = Row[x++];
+			if (Pixel == Prev)
+			{
+				Run = 1;
+				continue;
+			}
+			if (Above && Pixel == Above[x - 1])
+			{
+				Up = 1;
+				Prev = Pixel;
+				continue;
+			}
+
+			if (p > Limit)
+			{
+				return 0;
+			}
+			p = PutPixel(p, Pixel, Prev, Cache);
+			Prev = Pixel;
+		}
+	}
+
+	if (Run)
+	{
+		p = PutRun(p, End, OP_RUN, RUN_SHORT, Run);
+	}
+	else if (Up)
+	{
+		p = PutRun(p, End, OP_UP, UP_SHORT, Up);
+	}
+
+	return p ? static_cast<UINT>(p - Dst) : 0;
+}
+
+//
+// Anything that would write outside the strip or read past the data fails the strip
+//
+bool DecodeStrip(_Out_writes_bytes_(Pitch * Rows) BYTE* Dst, UINT Pitch, UINT Width, UINT Rows, _In_reads_bytes_(SrcSize) const BYTE* Src, UINT SrcSize)
+{
+	const BYTE* s = Src;
+	const BYTE* End = Src + SrcSize;
+
+	UINT Cache[64];
+	RtlZeroMemory(Cache, sizeof(Cache));
+	UINT Prev = START_PIXEL;
+	UINT Run = 0;
+	UINT Up = 0;
+
+	for (UINT y = 0; y < Rows; ++y)
+	{
+		UINT* Row = reinterpret_cast<UINT*>(Dst + static_cast<SIZE_T>(y) * Pitch);
+		const UINT* Above = y ? reinterpret_cast<const UINT*>(Dst + static_cast<SIZE_T>(y - 1) * Pitch) : nullptr;
+
+		UINT x = 0;
+		while (x < Width)
+		{
+			if (Run)
+			{
+				UINT Count = (Run < Width - x) ? Run : Width - x;
+				for (UINT i = 0; i < Count; ++i)
+				{
+					Row[x + i] = Prev;
+				}
+				x += Count;
+				Run -= Count;
+				continue;
+			}
+			if (Up)
+			{
+				if (!Above)
+				{
+					return false;
+				}
+				UINT Count = (Up < Width - x) ? Up : Width - x;
+				memcpy(Row + x, Above + x, Count * sizeof(UINT));
+				x += Count;
+				Up -= Count;
+				Prev = Row[x - 1];
+				continue;
+			}
+
+			if (s >= End)
+			{
+				return false;
+			}
+			BYTE Op = *s++;
+
+			UINT Pixel;
+			if (Op < OP_DIFF)
+			{
+				Prev = Cache[Op];
+				Row[x++] = Prev;
+				continue;
+			}
+			else if (Op < OP_LUMA)
+			{
+				UINT b = ((Prev & 0xFF) + (Op & 3) - 2) & 0xFF;
+				UINT g = (((Prev >> 8) & 0xFF) + ((Op >> 2) & 3) - 2) & 0xFF;
+				UINT r = (((Prev >> 16) & 0xFF) + ((Op >> 4) & 3) - 2) & 0xFF;
+				Pixel = (Prev & 0xFF000000) | (r << 16) | (g << 8) | b;
+			}
+			else if (Op < OP_RUN)
+			{
+				if (s >= End)
+				{
+					return false;
+				}
+				INT dg = static_cast<INT>(Op & 0x3F) - 32;
+				INT dr = dg + static_cast<INT>(*s >> 4) - 8;
+				INT db = dg + static_cast<INT>(*s & 0xF) - 8;
+				++s;
+				UINT b = ((Prev & 0xFF) + db) & 0xFF;
+				UINT g = (((Prev >> 8) & 0xFF) + dg) & 0xFF;
+				UINT r = (((Prev >> 16) & 0xFF) + dr) & 0xFF;
+				Pixel = (Prev & 0xFF000000) | (r << 16) | (g << 8) | b;
+			}
+			else if (Op < OP_UP)
+			{
+				if (!GetRun(&s, End, Op & 0x1F, RUN_SHORT, &Run))
+				{
+					return false;
+				}
+				continue;
+			}
+			else if (Op < 0xF0)
+			{
+				if (!GetRun(&s, End, Op & 0xF, UP_SHORT, &Up))
+				{
+					return false;
+				}
+				continue;
+			}
+			else if (Op == OP_BGR)
+			{
+				if (End - s < 3)
+				{
+					return false;
+				}
+				Pixel = (Prev & 0xFF000000) | (s[2] << 16) | (s[1] << 8) | s[0];
+				s += 3;
+			}
+			else if (Op == OP_BGRA)
+			{
+				if (End - s < 4)
+				{
+					return false;
+				}
+				memcpy(&Pixel, s, sizeof(Pixel));
+				s += 4;
+			}
+			else
+			{
+				return false;
+			}
+
+			Cache[HashPixel(Pixel)] = Pixel;
+			Row[x++] = Pixel;
+			Prev = Pixel;
+		}
+	}
+
+	// Runs reaching past the strip or trailing data mean the strip is not what was encoded
+	return !Run && !Up && s == End;
+}
+
+//
+// Encode strip Strip into its budget in Dst, or store it as is when encoding doesn't pay off
+//
+static void EncodeJobStrip(_Inout_ SCREENCODEC_JOB* Job, UINT Strip)
+{
+	UINT FirstRow = Strip * Job->StripRows;
+	UINT Rows = (Job->Height - FirstRow < Job->StripRows) ? Job->Height - FirstRow : Job->StripRows;
+	const BYTE* Src = Job->Src + static_cast<SIZE_T>(FirstRow) * Job->SrcPitch;
+	BYTE* Dst = Job->Dst + static_cast<SIZE_T>(Strip) * GetStripBytes(Job->Width, Job->StripRows);
+	UINT Budget = GetStripBytes(Job->Width, Rows);
+
+	UINT Size = EncodeStrip(Dst, Budget, Src, Job->SrcPitch, Job->Width, Rows);
+	if (!Size)
+	{
+		UINT RowBytes = Job->Width * sizeof(UINT);
+		for (UINT y = 0; y < Rows; ++y)
+		{
+			memcpy(Dst + y * RowBytes, Src + static_cast<SIZE_T>(y) * Job->SrcPitch, RowBytes);
+		}
+		Size = Budget | SCREENCODEC_STRIP_RAW;
+	}
+	Job->Sizes[Strip] = Size;
+}
+
+static void DecodeJobStrip(_Inout_ SCREENCODEC_JOB* Job, UINT Strip)
+{
+	// Strips are a few dozen, adding up the sizes before this one is cheaper than keeping offsets
+	const BYTE* Src = Job->Src;
+	for (UINT i = 0; i < Strip; ++i)
+	{
+		Src += Job->Sizes[i] & ~SCREENCODEC_STRIP_RAW;
+	}
+	UINT Size = Job->Sizes[Strip] & ~SCREENCODEC_STRIP_RAW;
+
+	UINT FirstRow = Strip * Job->StripRows;
+	UINT Rows = (Job->Height - FirstRow < Job->StripRows) ? Job->Height - FirstRow : Job->StripRows;
+	BYTE* Dst = Job->Dst + static_cast<SIZE_T>(FirstRow) * Job->DstPitch;
+
+	if (Job->Sizes[Strip] & SCREENCODEC_STRIP_RAW)
+	{
+		UINT RowBytes = Job->Width * sizeof(UINT);
+		for (UINT y = 0; y < Rows; ++y)
+		{
+			memcpy(Dst + static_cast<SIZE_T>(y) * Job->DstPitch, Src + y * RowBytes, RowBytes);
+		}
+	}
+	else if (!DecodeStrip(Dst, Job->DstPitch, Job->Width, Rows, Src, Size))
+	{
+		InterlockedExchange(&Job->Failed, 1);
+	}
+}
+
+static void ProcessStrips(_Inout_ SCREENCODEC_JOB* Job)
+{
+	LONG Strip;
+	while ((Strip = InterlockedIncrement(&Job->NextStrip) - 1) < static_cast<LONG>(Job->StripCount))
+	{
+		if (Job->Decode)
+		{
+			DecodeJobStrip(Job, Strip);
+		}
+		else
+		{
+			EncodeJobStrip(Job, Strip);
+		}
+	}
+}
+
+static VOID CALLBACK StripWorkProc(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context, _Inout_ PTP_WORK Work)
+{
+	UNREFERENCED_PARAMETER(Instance);
+	UNREFERENCED_PARAMETER(Work);
+
+	ProcessStrips(reinterpret_cast<SCREENCODEC_JOB*>(Context));
+}
+
+// Limit of SetScreenCodecThreads, 0 for every processor
+static volatile LONG g_MaxThreads = 0;
+
+UINT SetScreenCodecThreads(UINT MaxThreads)
+{
+	return static_cast<UINT>(InterlockedExchange(&g_MaxThreads, static_cast<LONG>(MaxThreads)));
+}
+
+//
+// Spread the strips over the thread pool, the calling thread takes strips as well.
+// If no work can be created the calling thread does them all.
+//
+static void RunJob(_Inout_ SCREENCODEC_JOB* Job)
+{
+	SYSTEM_INFO SystemInfo;
+	GetSystemInfo(&SystemInfo);
+	UINT Workers = (SystemInfo.dwNumberOfProcessors < Job->StripCount) ? SystemInfo.dwNumberOfProcessors : Job->StripCount;
+	UINT MaxThreads = static_cast<UINT>(ReadAcquire(&g_MaxThreads));
+	if (MaxThreads && Workers > MaxThreads)
+	{
+		Workers = MaxThreads;
+	}
+
+	PTP_WORK Work = (Workers > 1) ? CreateThreadpoolWork(StripWorkProc, Job, nullptr) : nullptr;
+	if (Work)
+	{
+		for (UINT i = 1; i < Workers; ++i)
+		{
+			SubmitThreadpoolWork(Work);
+		}
+	}
+
+	ProcessStrips(Job);
+
+	if (Work)
+	{
+		WaitForThreadpoolWorkCallbacks(Work, FALSE);
+		CloseThreadpoolWork(Work);
+	}
+}
+
+static inline UINT GetStripCount(UINT Height, UINT StripRows)
+{
+	return (Height + StripRows - 1) / StripRows;
+}
+
+UINT GetMaxEncodedSize(UINT Width, UINT Height, UINT StripRows)
+{
+	if (!StripRows)
+	{
+		StripRows = SCREENCODEC_STRIP_ROWS;
+	}
+
+	return sizeof(SCREENCODEC_HEADER) + GetStripCount(Height, StripRows) * sizeof(UINT) + GetStripBytes(Width, Height);
+}
+
+//
+// Each strip is encoded into the space it would take as is, so workers never share output.
+// The strips are then moved down to follow each other.
+//
+UINT EncodeScreenFrame(_Out_writes_bytes_to_(Capacity, return) BYTE* Dst, UINT Capacity, _In_ const BYTE* Src, UINT Pitch, UINT Width, UINT Height, UINT StripRows)
+{
+	if (!StripRows)
+	{
+		StripRows = SCREENCODEC_STRIP_ROWS;
+	}
+	if (!Width || !Height || Capacity < GetMaxEncodedSize(Width, Height, StripRows))
+	{
+		return 0;
+	}
+
+	SCREENCODEC_HEADER* Header = reinterpret_cast<SCREENCODEC_HEADER*>(Dst);
+	Header->Magic = SCREENCODEC_MAGIC;
+	Header->Width = Width;
+	Header->Height = Height;
+	Header->StripRows = StripRows;
+	Header->StripCount = GetStripCount(Height, StripRows);
+
+	SCREENCODEC_JOB Job;
+	RtlZeroMemory(&Job, sizeof(Job));
+	Job.Decode = false;
+	Job.Src = Src;
+	Job.SrcPitch = Pitch;
+	Job.Sizes = reinterpret_cast<UINT*>(Header + 1);
+	Job.Dst = reinterpret_cast<BYTE*>(Job.Sizes + Header->StripCount);
+	Job.Width = Width;
+	Job.Height = Height;
+	Job.StripRows = StripRows;
+	Job.StripCount = Header->StripCount;
+	RunJob(&Job);
+
+	UINT StripBytes = GetStripBytes(Width, StripRows);
+	UINT Offset = Job.Sizes[0] & ~SCREENCODEC_STRIP_RAW;
+	for (UINT i = 1; i < Job.StripCount; ++i)
+	{
+		UINT Size = Job.Sizes[i] & ~SCREENCODEC_STRIP_RAW;
+		memmove(Job.Dst + Offset, Job.Dst + static_cast<SIZE_T>(i) * StripBytes, Size);
+		Offset += Size;
+	}
+
+	return static_cast<UINT>(Job.Dst + Offset - Dst);
+}
+
+bool DecodeScreenFrame(_Out_writes_bytes_(DstPitch * Height) BYTE* Dst, UINT DstPitch, UINT Width, UINT Height, _In_reads_bytes_(SrcSize) const BYTE* Src, UINT SrcSize)
+{
+	const SCREENCODEC_HEADER* Header = reinterpret_cast<const SCREENCODEC_HEADER*>(Src);
+	if (SrcSize < sizeof(SCREENCODEC_HEADER) || Header->Magic != SCREENCODEC_MAGIC ||
+		Header->Width != Width || Header->Height != Height || !Header->StripRows ||
+		Header->StripCount != GetStripCount(Height, Header->StripRows) ||
+		(SrcSize - sizeof(SCREENCODEC_HEADER)) / sizeof(UINT) < Header->StripCount)
+	{
+		return false;
+	}
+
+	// Every strip has to lie inside the data, raw strips have to be exactly their pixels
+	const UINT* Sizes = reinterpret_cast<const UINT*>(Header + 1);
+	UINT64 Total = 0;
+	for (UINT i = 0; i < Header->StripCount; ++i)
+	{
+		UINT Rows = (Height - i * Header->StripRows < Header->StripRows) ? Height - i * Header->StripRows : Header->StripRows;
+		if ((Sizes[i] & SCREENCODEC_STRIP_RAW) && (Sizes[i] & ~SCREENCODEC_STRIP_RAW) != GetStripBytes(Width, Rows))
+		{
+			return false;
+		}
+		Total += Sizes[i] & ~SCREENCODEC_STRIP_RAW;
+	}
+	UINT DataOffset = sizeof(SCREENCODEC_HEADER) + Header->StripCount * sizeof(UINT);
+	if (Total > SrcSize - DataOffset)
+	{
+		return false;
+	}
+
+	SCREENCODEC_JOB Job;
+	RtlZeroMemory(&Job, sizeof(Job));
+	Job.Decode = true;
+	Job.Src = Src + DataOffset;
+	Job.Dst = Dst;
+	Job.DstPitch = DstPitch;
+	Job.Width = Width;
+	Job.Height = Height;
+	Job.StripRows = Header->StripRows;
+	Job.StripCount = Header->StripCount;
+	Job.Sizes = const_cast<UINT*>(Sizes);
+	RunJob(&Job);
+
+	return !Job.Failed;
+}
@@ -0,0 +1,73 @@
+// ScreenCodec.h : Fast lossless codec for 32bpp screen content. Frames are cut into
+// horizontal strips that are encoded and decoded independently on the thread pool.
+//
+// Layout:
+//   SCREENCODEC_HEADER
+//   UINT StripSizes[StripCount]       bytes of each strip, SCREENCODEC_STRIP_RAW if stored as is
+//   strip data, one after the other
+//
+// A strip is a stream of byte aligned ops over its pixels in row order, in the spirit of QOI:
+//   00iiiiii                       pixel from the 64 entry cache of recently seen pixels
+//   01rrggbb                       small difference to the previous pixel, -2..1 per channel
+//   10gggggg rrrrbbbb              difference to the previous pixel, green -32..31 and red
+//                                  and blue -8..7 relative to green
+//   110nnnnn [n8 | n16]            previous pixel repeated
+//   1110nnnn [n8 | n16]            pixels copied from the row above
+//   11111110 b g r                 literal, alpha of the previous pixel
+//   11111111 b g r a               literal
+// Copies from above never reach into the strip before, so strips don't depend on each other.
+//
+
+#ifndef _SCREENCODEC_H_
+#define _SCREENCODEC_H_
+
+#include <windows.h>
+#include <sal.h>
+
+#define SCREENCODEC_MAGIC           0x31435344      // "DSC1"
+
+// Rows per strip, a 4K frame is 34 strips
+#define SCREENCODEC_STRIP_ROWS      64
+
+// Strip was larger encoded than as is and holds the packed pixels
+#define SCREENCODEC_STRIP_RAW       0x80000000
+
+typedef struct _SCREENCODEC_HEADER
+{
+	DWORD Magic;
+	UINT Width;
+	UINT Height;
+	UINT StripRows;
+	UINT StripCount;
+} SCREENCODEC_HEADER;
+
+//
+// Largest encoding of a Width x Height frame, never more than the packed pixels plus the headers
+//
+UINT GetMaxEncodedSize(UINT Width, UINT Height, UINT StripRows);
+
+//
+// Encode the 32bpp image Src of Width x Height with rows Pitch bytes apart into Dst.
+// Returns the bytes written, 0 if Capacity is below GetMaxEncodedSize.
+//
+UINT EncodeScreenFrame(_Out_writes_bytes_to_(Capacity, return) BYTE* Dst, UINT Capacity, _In_ const BYTE* Src, UINT Pitch, UINT Width, UINT Height, UINT StripRows);
+
+//
+// Decode a frame EncodeScreenFrame wrote into Dst, rows DstPitch bytes apart.
+// Returns false if Src is not a Width x Height frame or is corrupt.
+//
+bool DecodeScreenFrame(_Out_writes_bytes_(DstPitch * Height) BYTE* Dst, UINT DstPitch, UINT Width, UINT Height, _In_reads_bytes_(SrcSize) const BYTE* Src, UINT SrcSize);
+
+//
+// Most threads, the calling one included, a frame is encoded or decoded on. 0, the default,
+// uses every processor. Returns the limit that was set before.
+//
+UINT SetScreenCodecThreads(UINT MaxThreads);
+
+//
+// Single strip kernels, run on the calling thread. EncodeStrip returns 0 if the strip doesn't fit Capacity.
+//
+UINT EncodeStrip(_Out_writes_bytes_to_(Capacity, return) BYTE* Dst, UINT Capacity, _In_ const BYTE* Src, UINT Pitch, UINT Width, UINT Rows);
+bool DecodeStrip(_Out_writes_bytes_(Pitch * Rows) BYTE* Dst, UINT Pitch, UINT Width, UINT Rows, _In_reads_bytes_(SrcSize) const BYTE* Src, UINT SrcSize);
+
+#endif
@@ -0,0 +1,445 @@
+// CaptureManagerTest.cpp : Publishing simulated outputs per output and as a virtual desktop,
+// rotated ones included, and outputs recovering from a loss.
+//
+
+#include "TestCommon.h"
+#include "CaptureManager.h"
+#include "CaptureRegion.h"
+
+#define TEST_TEX_WIDTH      40
+#define TEST_TEX_HEIGHT     24
+#define TEST_PADDING        32
+#define TEST_WAIT_MS        5000
+
+//
+// Output that delivers the frames the test hands it, one at a time, and times out in between
+//
+class TESTSOURCE : public FRAMESOURCE
+{
+	public:
+		TESTSOURCE(LONG Left, LONG Top, DXGI_MODE_ROTATION Rotation, DXGI_FORMAT Format = DXGI_FORMAT_B8G8R8A8_UNORM)
+		{
+			m_Format = Format;
+			m_Seed = 0;
+			m_Pending = 0;
+			m_Lose = 0;
+			m_Resets = 0;
+			m_ResetResult = DUPL_RETURN_SUCCESS;
+			m_BufferSize = (TEST_TEX_WIDTH * BPP + TEST_PADDING) * TEST_TEX_HEIGHT;
+			m_NextBufferSize = m_BufferSize;
+			bool Portrait = (Rotation == DXGI_MODE_ROTATION_ROTATE90 || Rotation == DXGI_MODE_ROTATION_ROTATE270);
+			RtlZeroMemory(&m_Desc, sizeof(m_Desc));
+			SetRect(&m_Desc.DesktopCoordinates, Left, Top, Left + (Portrait ? TEST_TEX_HEIGHT : TEST_TEX_WIDTH), Top + (Portrait ? TEST_TEX_WIDTH : TEST_TEX_HEIGHT));
+			m_Desc.AttachedToDesktop = TRUE;
+			m_Desc.Rotation = Rotation;
+			RtlZeroMemory(&m_Meta, sizeof(m_Meta));
+		}
+
+		//
+		// Next frame is the test image Seed, with only Rects reported as changed. Without rects the
+		// whole frame is new.
+		//
+		void Deliver(UINT Seed, _In_reads_(Count) const RECT* Rects, UINT Count)
+		{
+			m_Seed = Seed;
+			if (Count)
+			{
+				memcpy(m_Rects, Rects, Count * sizeof(RECT));
+			}
+			m_Meta.MetaData = reinterpret_cast<BYTE*>(m_Rects);
+			m_Meta.MetaDataSize = Count * sizeof(RECT);
+			m_Meta.DirtyCount = Count;
+			m_Meta.FullCopy = (Count == 0);
+			m_Meta.Presented = true;
+			WriteRelease(&m_Pending, 1);
+		}
+
+		//
+		// Next GetFrame fails like a desktop switch. Reset then returns ResetResult, and after a
+		// successful one frames need BufferSize bytes.
+		//
+		void Lose(DUPL_RETURN ResetResult, UINT BufferSize)
+		{
+			m_ResetResult = ResetResult;
+			m_NextBufferSize = BufferSize;
+			WriteRelease(&m_Lose, 1);
+		}
+
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+		{
+			UNREFERENCED_PARAMETER(TimeoutMs);
+			*Timeout = false;
+			if (ReadAcquire(&m_Lose))
+			{
+				return DUPL_RETURN_ERROR_EXPECTED;
+			}
+
+			*Timeout = !ReadAcquire(&m_Pending);
+			if (*Timeout)
+			{
+				Sleep(1);
+				return DUPL_RETURN_SUCCESS;
+			}
+
+			// Every pixel is new, the rects say which ones the manager may take
+			FillTestImage(ImageData, TEST_TEX_WIDTH, TEST_TEX_HEIGHT, TEST_TEX_WIDTH * BPP + TEST_PADDING, m_Seed);
+			QueryPerformanceCounter(&m_Meta.AcquireTime);
+			WriteRelease(&m_Pending, 0);
+			return DUPL_RETURN_SUCCESS;
+		}
+
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+		{
+			View->Data = ImageData;
+			View->Width = TEST_TEX_WIDTH;
+			View->Height = TEST_TEX_HEIGHT;
+			View->Pitch = TEST_TEX_WIDTH * BPP + TEST_PADDING;
+			View->Format = m_Format;
+			View->Rotation = m_Desc.Rotation;
+		}
+
+		UINT GetImageBufferSize()
+		{
+			return m_BufferSize;
+		}
+
+		DUPL_RETURN Reset()
+		{
+			InterlockedIncrement(&m_Resets);
+			if (m_ResetResult == DUPL_RETURN_SUCCESS)
+			{
+				m_BufferSize = m_NextBufferSize;
+				WriteRelease(&m_Lose, 0);
+			}
+			return m_ResetResult;
+		}
+
+		const FRAME_METADATA* GetFrameMetaData()
+		{
+			return &m_Meta;
+		}
+
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+		{
+			*DescPtr = m_Desc;
+		}
+
+		bool IsPending()
+		{
+			return ReadAcquire(&m_Pending) != 0;
+		}
+
+		LONG GetResets()
+		{
+			return ReadAcquire(&m_Resets);
+		}
+
+	private:
+		DXGI_OUTPUT_DESC m_Desc;
+		DXGI_FORMAT m_Format;
+		UINT m_Seed;
+		RECT m_Rects[CAPTURE_MAX_RECTS + 8];
+		FRAME_METADATA m_Meta;
+		volatile LONG m_Pending;
+		volatile LONG m_Lose;
+		volatile LONG m_Resets;
+		DUPL_RETURN m_ResetResult;
+		UINT m_BufferSize;
+		UINT m_NextBufferSize;
+};
+
+//
+// Pixel of the test image Seed that shows at X, Y of the output, found through the mapping of
+// desktop rects onto the acquired image
+//
+static UINT DesktopPixel(DXGI_MODE_ROTATION Rotation, LONG X, LONG Y, UINT Seed)
+{
+	static BYTE Image[TEST_TEX_WIDTH * BPP * TEST_TEX_HEIGHT];
+	FillTestImage(Image, TEST_TEX_WIDTH, TEST_TEX_HEIGHT, TEST_TEX_WIDTH * BPP, Seed);
+	RECT Desktop = { X, Y, X + 1, Y + 1 };
+	RECT Source;
+	DesktopRectToImage(&Source, &Desktop, Rotation, TEST_TEX_WIDTH, TEST_TEX_HEIGHT);
+	return reinterpret_cast<const UINT*>(Image + Source.top * TEST_TEX_WIDTH * BPP)[Source.left];
+}
+
+//
+// Rect of the output the image rect ImageRect shows on, from the pixels it covers
+//
+static RECT DesktopRectOf(DXGI_MODE_ROTATION Rotation, _In_ const RECT* ImageRect, LONG Width, LONG Height)
+{
+	RECT Bounds = { Width, Height, 0, 0 };
+	for (LONG y = 0; y < Height; ++y)
+	{
+		for (LONG x = 0; x < Width; ++x)
+		{
+			RECT Desktop = { x, y, x + 1, y + 1 };
+			RECT Source;
+			DesktopRectToImage(&Source, &Desktop, Rotation, TEST_TEX_WIDTH, TEST_TEX_HEIGHT);
+			if (Source.left >= ImageRect->left && Source.left < ImageRect->right && Source.top >= ImageRect->top && Source.top < ImageRect->bottom)
+			{
+				Bounds.left = min(Bounds.left, x);
+				Bounds.top = min(Bounds.top, y);
+				Bounds.right = max(Bounds.right, x + 1);
+				Bounds.bottom = max(Bounds.bottom, y + 1);
+			}
+		}
+	}
+	return Bounds;
+}
+
+static bool WaitDelivered(_In_ TESTSOURCE* Source)
+{
+	for (UINT i = 0; i < TEST_WAIT_MS && Source->IsPending(); ++i)
+	{
+		Sleep(1);
+	}
+	return !Source->IsPending();
+}
+
+//
+// Frames of every rotation are published upright, then only the pixels under a dirty rect
+// are taken from the next frame
+//
+static void TestRotatedOutputs()
+{
+	const DXGI_MODE_ROTATION Rotations[] = { DXGI_MODE_ROTATION_IDENTITY, DXGI_MODE_ROTATION_ROTATE90, DXGI_MODE_ROTATION_ROTATE180, DXGI_MODE_ROTATION_ROTATE270 };
+	for (UINT r = 0; r < ARRAYSIZE(Rotations); ++r)
+	{
+		TESTSOURCE* Source = new TESTSOURCE(0, 0, Rotations[r]);
+		CAPTUREMANAGER Capture;
+		REQUIRE(Capture.AddSource(stderr, Source, true) == DUPL_RETURN_SUCCESS);
+		REQUIRE(Capture.Start(CAPTURE_MODE_PER_OUTPUT) == DUPL_RETURN_SUCCESS);
+
+		UINT64 Sequence = 0;
+		Source->Deliver(1, nullptr, 0);
+		REQUIRE(Capture.WaitForFrame(TEST_WAIT_MS, &Sequence));
+
+		static BYTE Published[TEST_TEX_WIDTH * TEST_TEX_HEIGHT * BPP];
+		IMAGE_VIEW View;
+		REQUIRE(Capture.CopyOutput(0, Published, sizeof(Published), &View) == DUPL_RETURN_SUCCESS);
+		DXGI_OUTPUT_DESC Desc;
+		Source->GetOutputDesc(&Desc);
+		CHECK_EQUAL(Desc.DesktopCoordinates.right, View.Width);
+		CHECK_EQUAL(Desc.DesktopCoordinates.bottom, View.Height);
+		CHECK_EQUAL(View.Width * BPP, View.Pitch);
+		CHECK(View.Data == Published);
+
+		UINT Mismatches = 0;
+		for (LONG y = 0; y < static_cast<LONG>(View.Height); ++y)
+		{
+			for (LONG x = 0; x < static_cast<LONG>(View.Width); ++x)
+			{
+				Mismatches += (reinterpret_cast<UINT*>(Published + y * View.Pitch)[x] != DesktopPixel(Rotations[r], x, y, 1)) ? 1 : 0;
+			}
+		}
+		CHECK_EQUAL(0, Mismatches);
+
+		RECT Dirty = { 3, 5, 17, 11 };
+		Source->Deliver(2, &Dirty, 1);
+		REQUIRE(Capture.WaitForFrame(TEST_WAIT_MS, &Sequence));
+		REQUIRE(Capture.CopyOutput(0, Published, sizeof(Published), &View) == DUPL_RETURN_SUCCESS);
+
+		RECT Changed = DesktopRectOf(Rotations[r], &Dirty, View.Width, View.Height);
+		Mismatches = 0;
+		for (LONG y = 0; y < static_cast<LONG>(View.Height); ++y)
+		{
+			for (LONG x = 0; x < static_cast<LONG>(View.Width); ++x)
+			{
+				bool Inside = x >= Changed.left && x < Changed.right && y >= Changed.top && y < Changed.bottom;
+				Mismatches += (reinterpret_cast<UINT*>(Published + y * View.Pitch)[x] != DesktopPixel(Rotations[r], x, y, Inside ? 2 : 1)) ? 1 : 0;
+			}
+		}
+		CHECK_EQUAL(0, Mismatches);
+
+		// Too small a buffer is refused, not partly filled
+		CHECK(Capture.CopyOutput(0, Published, View.Pitch * View.Height - 1, &View) == DUPL_RETURN_ERROR_UNEXPECTED);
+		CHECK(Capture.CopyOutput(1, Published, sizeof(Published), &View) == DUPL_RETURN_ERROR_UNEXPECTED);
+
+		Capture.Stop();
+	}
+}
+
+//
+// The composite frame reports the rects its outputs changed in virtual desktop coordinates
+// and copies only those
+//
+static void TestCompositeRects()
+{
+	// A landscape output and a portrait one left of and above it
+	TESTSOURCE* Landscape = new TESTSOURCE(0, 0, DXGI_MODE_ROTATION_IDENTITY);
+	TESTSOURCE* Portrait = new TESTSOURCE(-TEST_TEX_HEIGHT, -10, DXGI_MODE_ROTATION_ROTATE90);
+	CAPTUREMANAGER Capture;
+	REQUIRE(Capture.AddSource(stderr, Landscape, true) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Capture.AddSource(stderr, Portrait, true) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Capture.Start(CAPTURE_MODE_COMPOSITE) == DUPL_RETURN_SUCCESS);
+
+	IMAGE_VIEW Image;
+	BYTE* Composite = new BYTE[Capture.GetImageBufferSize()];
+	Capture.GetImageView(Composite, &Image);
+	CHECK_EQUAL(TEST_TEX_HEIGHT + TEST_TEX_WIDTH, Image.Width);
+	CHECK_EQUAL(TEST_TEX_WIDTH, Image.Height);
+
+	// First frame is the whole virtual desktop
+	bool Timeout;
+	Landscape->Deliver(1, nullptr, 0);
+	REQUIRE(Capture.GetFrame(Composite, &Timeout, TEST_WAIT_MS) == DUPL_RETURN_SUCCESS && !Timeout);
+	const FRAME_METADATA* Meta = Capture.GetFrameMetaData();
+	REQUIRE(Meta);
+	CHECK(Meta->FullCopy);
+	CHECK(Meta->Presented);
+	CHECK(Meta->AcquireTime.QuadPart != 0);
+
+	// A whole output frame is one rect the size of the output
+	Portrait->Deliver(2, nullptr, 0);
+	REQUIRE(Capture.GetFrame(Composite, &Timeout, TEST_WAIT_MS) == DUPL_RETURN_SUCCESS && !Timeout);
+	Meta = Capture.GetFrameMetaData();
+	CHECK(!Meta->FullCopy);
+	CHECK_EQUAL(0, Meta->MoveCount);
+	REQUIRE(Meta->DirtyCount == 1);
+	RECT PortraitRect = { 0, 0, TEST_TEX_HEIGHT, TEST_TEX_WIDTH };
+	CHECK(memcmp(Meta->MetaData, &PortraitRect, sizeof(RECT)) == 0);
+
+	// Pixels outside the reported rects are left alone
+	const LONG MarkerX = TEST_TEX_HEIGHT + TEST_TEX_WIDTH - 1;
+	const LONG MarkerY = TEST_TEX_WIDTH - 1;
+	reinterpret_cast<UINT*>(Composite + MarkerY * Image.Pitch)[MarkerX] = 0xDEADBEEF;
+
+	RECT Dirty[] = { { 0, 0, 4, 3 }, { 30, 20, 40, 24 } };
+	Landscape->Deliver(3, Dirty, 1);
+	REQUIRE(WaitDelivered(Landscape));
+	Portrait->Deliver(4, &Dirty[1], 1);
+	REQUIRE(WaitDelivered(Portrait));
+	for (UINT Rects = 0; Rects < 2; )
+	{
+		REQUIRE(Capture.GetFrame(Composite, &Timeout, TEST_WAIT_MS) == DUPL_RETURN_SUCCESS && !Timeout);
+		Meta = Capture.GetFrameMetaData();
+		REQUIRE(!Meta->FullCopy);
+		Rects += Meta->DirtyCount;
+		REQUIRE(Rects <= 2);
+	}
+	CHECK_EQUAL(0xDEADBEEF, reinterpret_cast<UINT*>(Composite + MarkerY * Image.Pitch)[MarkerX]);
+
+	// Landscape sits TEST_TEX_HEIGHT right of and 10 below the virtual desktop's origin
+	UINT Mismatches = 0;
+	RECT PortraitChanged = DesktopRectOf(DXGI_MODE_ROTATION_ROTATE90, &Dirty[1], TEST_TEX_HEIGHT, TEST_TEX_WIDTH);
+	for (LONG y = 0; y < static_cast<LONG>(Image.Height); ++y)
+	{
+		for (LONG x = 0; x < static_cast<LONG>(Image.Width); ++x)
+		{
+			UINT Expected;
+			if (x < TEST_TEX_HEIGHT)
+			{
+				bool Inside = x >= PortraitChanged.left && x < PortraitChanged.right && y >= PortraitChanged.top && y < PortraitChanged.bottom;
+				Expected = DesktopPixel(DXGI_MODE_ROTATION_ROTATE90, x, y, Inside ? 4 : 2);
+			}
+			else if (y >= 10 && y < 10 + TEST_TEX_HEIGHT)
+			{
+				LONG OutputX = x - TEST_TEX_HEIGHT;
+				LONG OutputY = y - 10;
+				bool Inside = OutputX < Dirty[0].right && OutputY < Dirty[0].bottom;
+				Expected = DesktopPixel(DXGI_MODE_ROTATION_IDENTITY, OutputX, OutputY, Inside ? 3 : 1);
+			}
+			else
+			{
+				continue;
+			}
+			Mismatches += (reinterpret_cast<UINT*>(Composite + y * Image.Pitch)[x] != Expected) ? 1 : 0;
+		}
+	}
+	CHECK_EQUAL(0, Mismatches);
+
+	// More rects than a frame keeps is a whole frame again
+	static RECT Many[CAPTURE_MAX_RECTS + 1];
+	for (UINT i = 0; i < ARRAYSIZE(Many); ++i)
+	{
+		SetRect(&Many[i], i % TEST_TEX_WIDTH, 0, i % TEST_TEX_WIDTH + 1, 1);
+	}
+	Landscape->Deliver(5, Many, ARRAYSIZE(Many));
+	REQUIRE(Capture.GetFrame(Composite, &Timeout, TEST_WAIT_MS) == DUPL_RETURN_SUCCESS && !Timeout);
+	CHECK(Capture.GetFrameMetaData()->FullCopy);
+
+	Capture.Stop();
+	delete [] Composite;
+}
+
+//
+// An output that isn't 32bpp stops its capture thread with an error instead of being skipped
+//
+static void TestUnsupportedFormatStops()
+{
+	TESTSOURCE* Source = new TESTSOURCE(0, 0, DXGI_MODE_ROTATION_IDENTITY, DXGI_FORMAT_R16G16B16A16_FLOAT);
+	CAPTUREMANAGER Capture;
+	REQUIRE(Capture.AddSource(stderr, Source, true) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Capture.Start(CAPTURE_MODE_COMPOSITE) == DUPL_RETURN_SUCCESS);
+
+	BYTE* Composite = new BYTE[Capture.GetImageBufferSize()];
+	Source->Deliver(1, nullptr, 0);
+	bool Timeout = true;
+	DUPL_RETURN Ret = DUPL_RETURN_SUCCESS;
+	for (UINT i = 0; i < 100 && Ret == DUPL_RETURN_SUCCESS && Timeout; ++i)
+	{
+		Ret = Capture.GetFrame(Composite, &Timeout, 100);
+	}
+	CHECK(Ret == DUPL_RETURN_ERROR_UNEXPECTED);
+
+	Capture.Stop();
+	delete [] Composite;
+}
+
+//
+// Full frames of Seed delivered to Source are published on output 0
+//
+static bool PublishedWhole(_In_ CAPTUREMANAGER* Capture, _In_ TESTSOURCE* Source, UINT Seed, _Inout_ UINT64* Sequence)
+{
+	static BYTE Published[TEST_TEX_WIDTH * TEST_TEX_HEIGHT * BPP];
+	static BYTE Expected[TEST_TEX_WIDTH * TEST_TEX_HEIGHT * BPP];
+	Source->Deliver(Seed, nullptr, 0);
+	IMAGE_VIEW View;
+	if (!Capture->WaitForFrame(TEST_WAIT_MS, Sequence) || Capture->CopyOutput(0, Published, sizeof(Published), &View) != DUPL_RETURN_SUCCESS)
+	{
+		return false;
+	}
+	FillTestImage(Expected, TEST_TEX_WIDTH, TEST_TEX_HEIGHT, TEST_TEX_WIDTH * BPP, Seed);
+	return memcmp(Published, Expected, sizeof(Expected)) == 0;
+}
+
+//
+// An output that is lost is reset by its recovery and goes on publishing, also when it comes
+// back needing a larger buffer. One that can't be reset stops its thread.
+//
+static void TestLostOutputRecovers()
+{
+	TESTSOURCE* Source = new TESTSOURCE(0, 0, DXGI_MODE_ROTATION_IDENTITY);
+	CAPTUREMANAGER Capture;
+	REQUIRE(Capture.AddSource(stderr, Source, true) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Capture.Start(CAPTURE_MODE_PER_OUTPUT) == DUPL_RETURN_SUCCESS);
+
+	UINT64 Sequence = 0;
+	CHECK(PublishedWhole(&Capture, Source, 1, &Sequence));
+
+	Source->Lose(DUPL_RETURN_SUCCESS, Source->GetImageBufferSize());
+	CHECK(PublishedWhole(&Capture, Source, 2, &Sequence));
+	CHECK_EQUAL(1, Source->GetResets());
+
+	// A mode with larger frames, the capture buffer is replaced by the capture thread
+	Source->Lose(DUPL_RETURN_SUCCESS, Source->GetImageBufferSize() * 2);
+	CHECK(PublishedWhole(&Capture, Source, 3, &Sequence));
+	CHECK_EQUAL(2, Source->GetResets());
+
+	Source->Lose(DUPL_RETURN_ERROR_UNEXPECTED, Source->GetImageBufferSize());
+	Source->Deliver(4, nullptr, 0);
+	CHECK(!Capture.WaitForFrame(TEST_WAIT_MS, &Sequence));
+	CHECK_EQUAL(3, Source->GetResets());
+
+	Capture.Stop();
+}
+
+int main()
+{
+	RUN_TEST(TestRotatedOutputs);
+	RUN_TEST(TestCompositeRects);
+	RUN_TEST(TestUnsupportedFormatStops);
+	RUN_TEST(TestLostOutputRecovers);
+	return TEST_RESULT();
+}
@@ -0,0 +1,381 @@
+// CaptureRecoveryTest.cpp : Backoff, mode changes and failures of FRAMERECOVERY on a fake clock,
+// and a simulated duplication brought back from access lost.
+//
+
+#include "TestCommon.h"
+#include "CaptureRecovery.h"
+#include "DuplicationManager.h"
+
+#define TEST_FREQUENCY  10000000
+#define TEST_WIDTH      64
+#define TEST_HEIGHT     32
+#define TEST_MAX_RESETS 64
+
+class FAKECLOCK : public FRAMECLOCK
+{
+	public:
+		FAKECLOCK() : m_Ticks(1000) {}
+		UINT64 GetTicks() { return m_Ticks; }
+		UINT64 GetFrequency() { return TEST_FREQUENCY; }
+		void WaitUntil(UINT64 Ticks) { m_Ticks = max(m_Ticks, Ticks); }
+
+	private:
+		UINT64 m_Ticks;
+};
+
+//
+// Source that is lost when the test says so. Its next ResetFailures resets find the transition
+// still going on, the one after that returns ResetResult and on success switches to the buffer
+// size the test asked for. The clock ticks of every reset are kept.
+//
+class LOSSSOURCE : public FRAMESOURCE
+{
+	public:
+		LOSSSOURCE(_In_ FAKECLOCK* Clock) : m_Frames(0), m_FramesWhileLost(0), m_Resets(0), m_Clock(Clock), m_Lost(false), m_ResetFailures(0), m_ResetResult(DUPL_RETURN_SUCCESS),
+											m_NextError(DUPL_RETURN_SUCCESS), m_BufferSize(TEST_WIDTH * BPP * TEST_HEIGHT), m_NextBufferSize(0)
+		{
+			RtlZeroMemory(&m_Meta, sizeof(m_Meta));
+		}
+
+		void Lose(UINT ResetFailures, DUPL_RETURN ResetResult, UINT NextBufferSize)
+		{
+			m_NextError = DUPL_RETURN_ERROR_EXPECTED;
+			m_ResetFailures = ResetFailures;
+			m_ResetResult = ResetResult;
+			m_NextBufferSize = NextBufferSize ? NextBufferSize : m_BufferSize;
+		}
+
+		void FailNext(DUPL_RETURN Error)
+		{
+			m_NextError = Error;
+		}
+
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+		{
+			UNREFERENCED_PARAMETER(TimeoutMs);
+			*Timeout = false;
+			if (m_Lost)
+			{
+				// A lost source stays lost until it is reset
+				++m_FramesWhileLost;
+				return DUPL_RETURN_ERROR_EXPECTED;
+			}
+			if (m_NextError != DUPL_RETURN_SUCCESS)
+			{
+				DUPL_RETURN Error = m_NextError;
+				m_NextError = DUPL_RETURN_SUCCESS;
+				m_Lost = (Error == DUPL_RETURN_ERROR_EXPECTED);
+				return Error;
+			}
+
+			ImageData[0] = static_cast<BYTE>(++m_Frames);
+			m_Meta.Presented = true;
+			m_Meta.FullCopy = true;
+			return DUPL_RETURN_SUCCESS;
+		}
+
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+		{
+			View->Data = ImageData;
+			View->Width = TEST_WIDTH;
+			View->Height = m_BufferSize / (TEST_WIDTH * BPP);
+			View->Pitch = TEST_WIDTH * BPP;
+			View->Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+			View->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+		}
+
+		UINT GetImageBufferSize()
+		{
+			return m_BufferSize;
+		}
+
+		const FRAME_METADATA* GetFrameMetaData()
+		{
+			return &m_Meta;
+		}
+
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+		{
+			RtlZeroMemory(DescPtr, sizeof(DXGI_OUTPUT_DESC));
+		}
+
+		DUPL_RETURN Reset()
+		{
+			if (m_Resets < TEST_MAX_RESETS)
+			{
+				m_ResetTicks[m_Resets] = m_Clock->GetTicks();
+			}
+			++m_Resets;
+
+			if (m_ResetFailures)
+			{
+				--m_ResetFailures;
+				return DUPL_RETURN_ERROR_EXPECTED;
+			}
+			if (m_ResetResult == DUPL_RETURN_SUCCESS)
+			{
+				m_Lost = false;
+				m_BufferSize = m_NextBufferSize;
+			}
+			return m_ResetResult;
+		}
+
+		UINT m_Frames;
+		UINT m_FramesWhileLost;
+		UINT m_Resets;
+		UINT64 m_ResetTicks[TEST_MAX_RESETS];
+
+	private:
+		FAKECLOCK* m_Clock;
+		bool m_Lost;
+		UINT m_ResetFailures;
+		DUPL_RETURN m_ResetResult;
+		DUPL_RETURN m_NextError;
+		UINT m_BufferSize;
+		UINT m_NextBufferSize;
+		FRAME_METADATA m_Meta;
+};
+
+static BYTE Image[TEST_WIDTH * BPP * TEST_HEIGHT * 2];
+
+static UINT64 Ms(UINT64 Milliseconds)
+{
+	return Milliseconds * TEST_FREQUENCY / 1000;
+}
+
+//
+// Frames and errors other than a loss go through as they are, and after an unexpected error
+// the source isn't asked again
+//
+static void TestPassThrough()
+{
+	FAKECLOCK Clock;
+	LOSSSOURCE Source(&Clock);
+	FRAMERECOVERY Recovery;
+	Recovery.Init(stderr, &Source, Source.GetImageBufferSize(), &Clock);
+
+	bool Timeout = true;
+	for (UINT i = 1; i <= 3; ++i)
+	{
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 10));
+		CHECK(!Timeout);
+		CHECK_EQUAL(i, Image[0]);
+	}
+	CHECK(Recovery.GetFrameMetaData() == Source.GetFrameMetaData());
+	CHECK_EQUAL(RECOVERY_STATE_RUNNING, Recovery.GetState());
+
+	Source.FailNext(DUPL_RETURN_ERROR_UNEXPECTED);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK_EQUAL(RECOVERY_STATE_FAILED, Recovery.GetState());
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK_EQUAL(3, Source.m_Frames);
+	CHECK_EQUAL(0, Source.m_Resets);
+
+	RECOVERY_STATS Stats;
+	Recovery.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Losses);
+	CHECK_EQUAL(TEST_FREQUENCY, Stats.Frequency);
+}
+
+//
+// The first reset is tried the moment the loss is seen, the waits before the ones after it
+// double from RECOVERY_BACKOFF_INITIAL_MS up to RECOVERY_BACKOFF_MAX_MS. Meanwhile every GetFrame
+// times out within its timeout and there is no metadata. Once back the frames flow again.
+//
+static void TestBackoff()
+{
+	const UINT Failures = 10;
+	FAKECLOCK Clock;
+	LOSSSOURCE Source(&Clock);
+	FRAMERECOVERY Recovery;
+	Recovery.Init(stderr, &Source, Source.GetImageBufferSize(), &Clock);
+
+	bool Timeout;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 10));
+	Source.Lose(Failures, DUPL_RETURN_SUCCESS, 0);
+
+	UINT64 LostTicks = Clock.GetTicks();
+	UINT Calls = 0;
+	do
+	{
+		UINT64 Before = Clock.GetTicks();
+		Timeout = false;
+		REQUIRE(Recovery.GetFrame(Image, &Timeout, 50) == DUPL_RETURN_SUCCESS);
+		CHECK(Timeout);
+		CHECK(Clock.GetTicks() - Before <= Ms(50));
+		CHECK(Recovery.GetFrameMetaData() == nullptr || Recovery.GetState() == RECOVERY_STATE_RUNNING);
+		++Calls;
+	} while (Recovery.GetState() == RECOVERY_STATE_RECOVERING && Calls < 1000);
+	REQUIRE(Recovery.GetState() == RECOVERY_STATE_RUNNING);
+	CHECK_EQUAL(Failures + 1, Source.m_Resets);
+	CHECK_EQUAL(0, Source.m_FramesWhileLost);
+
+	CHECK_EQUAL(LostTicks, Source.m_ResetTicks[0]);
+	UINT64 Backoff = Ms(RECOVERY_BACKOFF_INITIAL_MS);
+	for (UINT i = 1; i < Source.m_Resets; ++i)
+	{
+		CHECK_EQUAL(Backoff, Source.m_ResetTicks[i] - Source.m_ResetTicks[i - 1]);
+		Backoff = min(Backoff * 2, Ms(RECOVERY_BACKOFF_MAX_MS));
+	}
+
+	RECOVERY_STATS Stats;
+	Recovery.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Losses);
+	CHECK_EQUAL(1, Stats.Recoveries);
+	CHECK_EQUAL(Failures + 1, Stats.Attempts);
+	CHECK_EQUAL(0, Stats.ModeChanges);
+	CHECK_EQUAL(Calls, Stats.FramesLost);
+	CHECK_EQUAL(Source.m_ResetTicks[Failures] - LostTicks, Stats.LastRecoverTicks);
+	CHECK_EQUAL(Stats.LastRecoverTicks, Stats.MaxRecoverTicks);
+
+	UINT Frames = Source.m_Frames;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK(!Timeout);
+	CHECK_EQUAL(Frames + 1, Source.m_Frames);
+	CHECK(Recovery.GetFrameMetaData() != nullptr);
+
+	// A second loss starts over from the initial backoff
+	Source.Lose(1, DUPL_RETURN_SUCCESS, 0);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 1000));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 1000));
+	CHECK_EQUAL(RECOVERY_STATE_RUNNING, Recovery.GetState());
+	CHECK_EQUAL(Ms(RECOVERY_BACKOFF_INITIAL_MS), Source.m_ResetTicks[Failures + 2] - Source.m_ResetTicks[Failures + 1]);
+	Recovery.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.Losses);
+	CHECK_EQUAL(2, Stats.Recoveries);
+	CHECK_EQUAL(Stats.TotalRecoverTicks, Stats.MaxRecoverTicks + Stats.LastRecoverTicks);
+}
+
+//
+// A source that comes back needing larger buffers holds the capture with an expected error
+// until the caller's buffers are large enough, one that comes back smaller goes right on
+//
+static void TestModeChange()
+{
+	FAKECLOCK Clock;
+	LOSSSOURCE Source(&Clock);
+	FRAMERECOVERY Recovery;
+	UINT Size = Source.GetImageBufferSize();
+	Recovery.Init(stderr, &Source, Size, &Clock);
+
+	bool Timeout;
+	Source.Lose(0, DUPL_RETURN_SUCCESS, Size * 2);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK_EQUAL(RECOVERY_STATE_MODE_CHANGED, Recovery.GetState());
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK_EQUAL(1, Source.m_Resets);
+	CHECK(Recovery.GetFrameMetaData() == nullptr);
+
+	Recovery.SetBufferSize(Size * 2 - 1);
+	CHECK_EQUAL(RECOVERY_STATE_MODE_CHANGED, Recovery.GetState());
+	Recovery.SetBufferSize(Size * 2);
+	CHECK_EQUAL(RECOVERY_STATE_RUNNING, Recovery.GetState());
+	CHECK_EQUAL(Size * 2, Recovery.GetImageBufferSize());
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK(!Timeout);
+
+	Source.Lose(0, DUPL_RETURN_SUCCESS, Size);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 10));
+	CHECK_EQUAL(RECOVERY_STATE_RUNNING, Recovery.GetState());
+
+	RECOVERY_STATS Stats;
+	Recovery.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.Recoveries);
+	CHECK_EQUAL(2, Stats.ModeChanges);
+}
+
+//
+// A reset that fails for any other reason than the transition ends the capture
+//
+static void TestResetFails()
+{
+	FAKECLOCK Clock;
+	LOSSSOURCE Source(&Clock);
+	FRAMERECOVERY Recovery;
+	Recovery.Init(stderr, &Source, Source.GetImageBufferSize(), &Clock);
+
+	bool Timeout;
+	Source.Lose(2, DUPL_RETURN_ERROR_UNEXPECTED, 0);
+	DUPL_RETURN Ret = DUPL_RETURN_SUCCESS;
+	for (UINT i = 0; i < 10 && Ret == DUPL_RETURN_SUCCESS; ++i)
+	{
+		Ret = Recovery.GetFrame(Image, &Timeout, 1000);
+	}
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Ret);
+	CHECK_EQUAL(RECOVERY_STATE_FAILED, Recovery.GetState());
+	CHECK_EQUAL(3, Source.m_Resets);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Recovery.GetFrame(Image, &Timeout, 1000));
+	CHECK_EQUAL(3, Source.m_Resets);
+
+	RECOVERY_STATS Stats;
+	Recovery.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Losses);
+	CHECK_EQUAL(0, Stats.Recoveries);
+}
+
+//
+// Access lost on a simulated duplication, with the output still switching on the first reset,
+// is recovered and the next frame is the whole desktop
+//
+static void TestRecoversDuplication()
+{
+	CPUDUPLICATIONDEVICE Device;
+	REQUIRE(Device.Init(TEST_WIDTH, TEST_HEIGHT, DXGI_MODE_ROTATION_IDENTITY, 4));
+	DUPLICATIONMANAGER Manager(&Device);
+	REQUIRE(Manager.InitDupl(stderr, 0) == DUPL_RETURN_SUCCESS);
+	Manager.SetDirtyRectReadback(true);
+	REQUIRE(Manager.GetImageBufferSize() <= sizeof(Image));
+
+	FAKECLOCK Clock;
+	FRAMERECOVERY Recovery;
+	Recovery.Init(stderr, &Manager, Manager.GetImageBufferSize(), &Clock);
+
+	bool Timeout;
+	RECT Whole = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	FillTestImage(Device.GetDesktop(), TEST_WIDTH, TEST_HEIGHT, Device.GetDesktopPitch(), 1);
+	Device.PresentFrame(nullptr, 0, &Whole, 1);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 0));
+
+	Device.FailNextCall(CPU_DUPLICATION_CALL_ACQUIRE, DXGI_ERROR_ACCESS_LOST);
+	Device.FailNextCall(CPU_DUPLICATION_CALL_DUPLICATE, E_ACCESSDENIED);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 0));
+	CHECK(Timeout);
+	CHECK_EQUAL(RECOVERY_STATE_RECOVERING, Recovery.GetState());
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 100));
+	CHECK_EQUAL(RECOVERY_STATE_RUNNING, Recovery.GetState());
+
+	// Only a corner is reported, the frame is copied whole anyway
+	FillTestImage(Device.GetDesktop(), TEST_WIDTH, TEST_HEIGHT, Device.GetDesktopPitch(), 2);
+	RECT Corner = { 0, 0, 4, 4 };
+	Device.PresentFrame(nullptr, 0, &Corner, 1);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recovery.GetFrame(Image, &Timeout, 0));
+	REQUIRE(!Timeout);
+	const FRAME_METADATA* Meta = Recovery.GetFrameMetaData();
+	REQUIRE(Meta != nullptr);
+	CHECK(Meta->FullCopy);
+
+	IMAGE_VIEW View;
+	Recovery.GetImageView(Image, &View);
+	UINT Mismatches = 0;
+	for (UINT y = 0; y < TEST_HEIGHT; ++y)
+	{
+		Mismatches += (memcmp(View.Data + y * View.Pitch, Device.GetDesktop() + y * Device.GetDesktopPitch(), TEST_WIDTH * BPP) != 0) ? 1 : 0;
+	}
+	CHECK_EQUAL(0, Mismatches);
+
+	RECOVERY_STATS Stats;
+	Recovery.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Recoveries);
+	CHECK_EQUAL(2, Stats.Attempts);
+}
+
+int main()
+{
+	RUN_TEST(TestPassThrough);
+	RUN_TEST(TestBackoff);
+	RUN_TEST(TestModeChange);
+	RUN_TEST(TestResetFails);
+	RUN_TEST(TestRecoversDuplication);
+	return TEST_RESULT();
+}
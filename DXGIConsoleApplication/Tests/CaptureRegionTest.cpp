@@ -0,0 +1,194 @@
+// CaptureRegionTest.cpp : Mapping capture regions onto the acquired image and clipping the frame's rects to them.
+//
+
+#include "TestCommon.h"
+#include "CaptureRegion.h"
+#include "RegionCopy.h"
+
+#define TEST_TEX_WIDTH  200
+#define TEST_TEX_HEIGHT 120
+
+static const DXGI_MODE_ROTATION Rotations[] = { DXGI_MODE_ROTATION_IDENTITY, DXGI_MODE_ROTATION_ROTATE90, DXGI_MODE_ROTATION_ROTATE180, DXGI_MODE_ROTATION_ROTATE270 };
+
+static bool IsPortrait(DXGI_MODE_ROTATION Rotation)
+{
+	return Rotation == DXGI_MODE_ROTATION_ROTATE90 || Rotation == DXGI_MODE_ROTATION_ROTATE270;
+}
+
+static void RandomRect(_Out_ RECT* Rect, LONG Width, LONG Height, _Inout_ UINT* Random)
+{
+	Rect->left = TestRandom(Random) % Width;
+	Rect->top = TestRandom(Random) % Height;
+	Rect->right = Rect->left + 1 + TestRandom(Random) % (Width - Rect->left);
+	Rect->bottom = Rect->top + 1 + TestRandom(Random) % (Height - Rect->top);
+}
+
+//
+// Desktop to image and back through the destination mapping of the move rects is the identity
+//
+static void TestDesktopRectToImageInverse()
+{
+	UINT Random = 5;
+	for (UINT r = 0; r < ARRAYSIZE(Rotations); ++r)
+	{
+		LONG DesktopWidth = IsPortrait(Rotations[r]) ? TEST_TEX_HEIGHT : TEST_TEX_WIDTH;
+		LONG DesktopHeight = IsPortrait(Rotations[r]) ? TEST_TEX_WIDTH : TEST_TEX_HEIGHT;
+		for (UINT i = 0; i < 200; ++i)
+		{
+			RECT Desktop;
+			RandomRect(&Desktop, DesktopWidth, DesktopHeight, &Random);
+
+			DXGI_OUTDUPL_MOVE_RECT Move;
+			RtlZeroMemory(&Move, sizeof(Move));
+			DesktopRectToImage(&Move.DestinationRect, &Desktop, Rotations[r], TEST_TEX_WIDTH, TEST_TEX_HEIGHT);
+			CHECK(Move.DestinationRect.left >= 0 && Move.DestinationRect.right <= TEST_TEX_WIDTH);
+			CHECK(Move.DestinationRect.top >= 0 && Move.DestinationRect.bottom <= TEST_TEX_HEIGHT);
+			CHECK_EQUAL((Desktop.right - Desktop.left) * (Desktop.bottom - Desktop.top),
+				(Move.DestinationRect.right - Move.DestinationRect.left) * (Move.DestinationRect.bottom - Move.DestinationRect.top));
+
+			RECT Source, Back;
+			SetMoveRectForRotation(&Source, &Back, Rotations[r], &Move, TEST_TEX_WIDTH, TEST_TEX_HEIGHT);
+			CHECK(memcmp(&Back, &Desktop, sizeof(RECT)) == 0);
+		}
+	}
+
+	// The top left corner of a portrait desktop is the bottom left of the image
+	RECT Desktop = { 0, 0, 10, 20 };
+	RECT Image;
+	DesktopRectToImage(&Image, &Desktop, DXGI_MODE_ROTATION_ROTATE90, TEST_TEX_WIDTH, TEST_TEX_HEIGHT);
+	RECT Expected = { 0, TEST_TEX_HEIGHT - 10, 20, TEST_TEX_HEIGHT };
+	CHECK(memcmp(&Image, &Expected, sizeof(RECT)) == 0);
+}
+
+//
+// Regions are made relative to the output, clipped to it, stacked, and left out when off it
+//
+static void TestBuildRegionLayout()
+{
+	DXGI_OUTPUT_DESC Desc;
+	RtlZeroMemory(&Desc, sizeof(Desc));
+	SetRect(&Desc.DesktopCoordinates, 1000, -50, 1000 + TEST_TEX_WIDTH, -50 + TEST_TEX_HEIGHT);
+	Desc.Rotation = DXGI_MODE_ROTATION_IDENTITY;
+
+	RECT Regions[] = { { 1010, -40, 1050, -10 }, { 0, 0, 100, 100 }, { 1180, 50, 1300, 200 } };
+	REGION_LAYOUT Layout;
+	REQUIRE(BuildRegionLayout(&Layout, Regions, ARRAYSIZE(Regions), &Desc, TEST_TEX_WIDTH, TEST_TEX_HEIGHT));
+	CHECK_EQUAL(2, Layout.Count);
+	RECT First = { 10, 10, 50, 40 };
+	RECT Second = { 180, 100, 200, 120 };
+	CHECK(memcmp(&Layout.Regions[0].Source, &First, sizeof(RECT)) == 0);
+	CHECK(memcmp(&Layout.Regions[1].Source, &Second, sizeof(RECT)) == 0);
+	CHECK_EQUAL(0, Layout.Regions[0].Dest.y);
+	CHECK_EQUAL(30, Layout.Regions[1].Dest.y);
+	CHECK_EQUAL(40, Layout.Width);
+	CHECK_EQUAL(50, Layout.Height);
+
+	// Nothing on the output
+	CHECK(!BuildRegionLayout(&Layout, &Regions[1], 1, &Desc, TEST_TEX_WIDTH, TEST_TEX_HEIGHT));
+	CHECK_EQUAL(0, Layout.Count);
+
+	// Regions past the limit are dropped
+	RECT Many[CAPTURE_MAX_REGIONS + 3];
+	for (UINT i = 0; i < ARRAYSIZE(Many); ++i)
+	{
+		SetRect(&Many[i], 1000 + i, -50, 1001 + i, -49);
+	}
+	REQUIRE(BuildRegionLayout(&Layout, Many, ARRAYSIZE(Many), &Desc, TEST_TEX_WIDTH, TEST_TEX_HEIGHT));
+	CHECK_EQUAL(CAPTURE_MAX_REGIONS, Layout.Count);
+	CHECK_EQUAL(CAPTURE_MAX_REGIONS, Layout.Height);
+}
+
+static bool InRect(_In_ const RECT* Rect, LONG x, LONG y)
+{
+	return x >= Rect->left && x < Rect->right && y >= Rect->top && y < Rect->bottom;
+}
+
+//
+// Pixel by pixel, a region image pixel is covered by the clipped rects exactly when the image
+// pixel it comes from is under a move destination or a dirty rect
+//
+static void TestClipRectsMatchesPixels()
+{
+	UINT Random = 17;
+	for (UINT Round = 0; Round < 100; ++Round)
+	{
+		DXGI_OUTPUT_DESC Desc;
+		RtlZeroMemory(&Desc, sizeof(Desc));
+		Desc.Rotation = Rotations[Round % ARRAYSIZE(Rotations)];
+		SetRect(&Desc.DesktopCoordinates, 0, 0, IsPortrait(Desc.Rotation) ? TEST_TEX_HEIGHT : TEST_TEX_WIDTH, IsPortrait(Desc.Rotation) ? TEST_TEX_WIDTH : TEST_TEX_HEIGHT);
+
+		RECT Regions[3];
+		for (UINT i = 0; i < ARRAYSIZE(Regions); ++i)
+		{
+			RandomRect(&Regions[i], Desc.DesktopCoordinates.right, Desc.DesktopCoordinates.bottom, &Random);
+		}
+		REGION_LAYOUT Layout;
+		REQUIRE(BuildRegionLayout(&Layout, Regions, ARRAYSIZE(Regions), &Desc, TEST_TEX_WIDTH, TEST_TEX_HEIGHT));
+
+		DXGI_OUTDUPL_MOVE_RECT Moves[2];
+		RECT Dirty[3];
+		RtlZeroMemory(Moves, sizeof(Moves));
+		UINT MoveCount = TestRandom(&Random) % (ARRAYSIZE(Moves) + 1);
+		UINT DirtyCount = TestRandom(&Random) % (ARRAYSIZE(Dirty) + 1);
+		for (UINT i = 0; i < MoveCount; ++i)
+		{
+			RandomRect(&Moves[i].DestinationRect, TEST_TEX_WIDTH / 3, TEST_TEX_HEIGHT / 3, &Random);
+			OffsetRect(&Moves[i].DestinationRect, TestRandom(&Random) % (TEST_TEX_WIDTH / 2), TestRandom(&Random) % (TEST_TEX_HEIGHT / 2));
+		}
+		for (UINT i = 0; i < DirtyCount; ++i)
+		{
+			RandomRect(&Dirty[i], TEST_TEX_WIDTH / 3, TEST_TEX_HEIGHT / 3, &Random);
+			OffsetRect(&Dirty[i], TestRandom(&Random) % (TEST_TEX_WIDTH / 2), TestRandom(&Random) % (TEST_TEX_HEIGHT / 2));
+		}
+
+		RECT Out[(ARRAYSIZE(Moves) + ARRAYSIZE(Dirty)) * CAPTURE_MAX_REGIONS];
+		UINT OutCount = ClipRectsToRegions(Out, &Layout, Moves, MoveCount, Dirty, DirtyCount);
+		REQUIRE(OutCount <= (MoveCount + DirtyCount) * Layout.Count);
+
+		UINT Mismatches = 0;
+		for (UINT i = 0; i < Layout.Count; ++i)
+		{
+			const CAPTURE_REGION* Region = &Layout.Regions[i];
+			for (LONG y = Region->Source.top; y < Region->Source.bottom; ++y)
+			{
+				for (LONG x = Region->Source.left; x < Region->Source.right; ++x)
+				{
+					bool Changed = false;
+					for (UINT m = 0; m < MoveCount; ++m)
+					{
+						Changed = Changed || InRect(&Moves[m].DestinationRect, x, y);
+					}
+					for (UINT d = 0; d < DirtyCount; ++d)
+					{
+						Changed = Changed || InRect(&Dirty[d], x, y);
+					}
+
+					LONG DestX = Region->Dest.x + x - Region->Source.left;
+					LONG DestY = Region->Dest.y + y - Region->Source.top;
+					bool Covered = false;
+					for (UINT o = 0; o < OutCount; ++o)
+					{
+						Covered = Covered || InRect(&Out[o], DestX, DestY);
+					}
+					Mismatches += (Changed != Covered) ? 1 : 0;
+				}
+			}
+		}
+		CHECK_EQUAL(0, Mismatches);
+
+		// Every rect stays inside the region image
+		for (UINT o = 0; o < OutCount; ++o)
+		{
+			CHECK(Out[o].left >= 0 && Out[o].top >= 0 && Out[o].right <= static_cast<LONG>(Layout.Width) && Out[o].bottom <= static_cast<LONG>(Layout.Height));
+			CHECK(Out[o].left < Out[o].right && Out[o].top < Out[o].bottom);
+		}
+	}
+}
+
+int main()
+{
+	RUN_TEST(TestDesktopRectToImageInverse);
+	RUN_TEST(TestBuildRegionLayout);
+	RUN_TEST(TestClipRectsMatchesPixels);
+	return TEST_RESULT();
+}
@@ -0,0 +1,192 @@
+// ColorConvertTest.cpp : The converters against a floating point reference, and every kernel
+// path against the scalar one.
+//
+
+#include "TestCommon.h"
+#include "ColorConvert.h"
+#include <math.h>
+
+#define TEST_WIDTH      37
+#define TEST_HEIGHT     6
+
+//
+// Luma weights of the red and blue primaries, green gets the rest
+//
+typedef struct _TEST_MATRIX
+{
+	COLOR_MATRIX Matrix;
+	const char* Name;
+	double Kr;
+	double Kb;
+} TEST_MATRIX;
+
+static const TEST_MATRIX TestMatrices[] =
+{
+	{ COLOR_MATRIX_BT601, "BT.601", 0.299, 0.114 },
+	{ COLOR_MATRIX_BT709, "BT.709", 0.2126, 0.0722 }
+};
+
+//
+// Studio swing Y, U and V of a full swing RGB color, unrounded
+//
+static void ReferenceYUV(_In_ const TEST_MATRIX* Matrix, double R, double G, double B, _Out_writes_(3) double* Yuv)
+{
+	double Luma = Matrix->Kr * R + (1.0 - Matrix->Kr - Matrix->Kb) * G + Matrix->Kb * B;
+	Yuv[0] = 16.0 + 219.0 / 255.0 * Luma;
+	Yuv[1] = 128.0 + 224.0 / 255.0 * (B - Luma) / (2.0 * (1.0 - Matrix->Kb));
+	Yuv[2] = 128.0 + 224.0 / 255.0 * (R - Luma) / (2.0 * (1.0 - Matrix->Kr));
+}
+
+static void FillSolid(_Out_writes_bytes_(TEST_WIDTH * 4 * TEST_HEIGHT) BYTE* Image, BYTE R, BYTE G, BYTE B)
+{
+	for (UINT i = 0; i < TEST_WIDTH * TEST_HEIGHT; ++i)
+	{
+		Image[i * 4] = B;
+		Image[i * 4 + 1] = G;
+		Image[i * 4 + 2] = R;
+		Image[i * 4 + 3] = 0xFF;
+	}
+}
+
+//
+// Convert a solid image to every layout and check every sample is within 1 of the reference.
+// Gray has to come out with chroma of exactly 128, the rows of each chroma matrix sum to zero.
+//
+static void CheckSolidColor(_In_ const TEST_MATRIX* Matrix, BYTE R, BYTE G, BYTE B)
+{
+	const UINT ChromaWidth = (TEST_WIDTH + 1) / 2;
+	const UINT ChromaHeight = (TEST_HEIGHT + 1) / 2;
+	BYTE Image[TEST_WIDTH * 4 * TEST_HEIGHT];
+	BYTE Y[TEST_WIDTH * TEST_HEIGHT];
+	BYTE U[ChromaWidth * ChromaHeight];
+	BYTE V[ChromaWidth * ChromaHeight];
+	BYTE UV[ChromaWidth * 2 * ChromaHeight];
+	BYTE Yuy2[ChromaWidth * 4 * TEST_HEIGHT];
+	FillSolid(Image, R, G, B);
+
+	double Expected[3];
+	ReferenceYUV(Matrix, R, G, B, Expected);
+	bool Gray = (R == G && G == B);
+
+	ConvertBGRAToI420(Image, TEST_WIDTH * 4, TEST_WIDTH, TEST_HEIGHT, Y, TEST_WIDTH, U, ChromaWidth, V, ChromaWidth, Matrix->Matrix);
+	ConvertBGRAToNV12(Image, TEST_WIDTH * 4, TEST_WIDTH, TEST_HEIGHT, Y, TEST_WIDTH, UV, ChromaWidth * 2, Matrix->Matrix);
+	ConvertBGRAToYUY2(Image, TEST_WIDTH * 4, TEST_WIDTH, TEST_HEIGHT, Yuy2, ChromaWidth * 4, Matrix->Matrix);
+
+	// Every sample of a solid image is the same, check the first and the last of each plane
+	const BYTE Samples[][3] =
+	{
+		{ Y[0], U[0], V[0] },
+		{ Y[TEST_WIDTH * TEST_HEIGHT - 1], U[ChromaWidth * ChromaHeight - 1], V[ChromaWidth * ChromaHeight - 1] },
+		{ Y[0], UV[0], UV[1] },
+		{ Y[0], UV[ChromaWidth * 2 * ChromaHeight - 2], UV[ChromaWidth * 2 * ChromaHeight - 1] },
+		{ Yuy2[0], Yuy2[1], Yuy2[3] },
+		{ Yuy2[(ChromaWidth * 4 * TEST_HEIGHT) - 2], Yuy2[(ChromaWidth * 4 * TEST_HEIGHT) - 3], Yuy2[(ChromaWidth * 4 * TEST_HEIGHT) - 1] }
+	};
+	for (UINT s = 0; s < ARRAYSIZE(Samples); ++s)
+	{
+		for (UINT c = 0; c < 3; ++c)
+		{
+			if (fabs(Samples[s][c] - Expected[c]) > 1.0 || (Gray && c && Samples[s][c] != 128))
+			{
+				fprintf(stderr, "%s path %d RGB %u,%u,%u sample %u: %c is %u, expected %.2f\n", Matrix->Name, GetConvertPath(),
+					R, G, B, s, "YUV"[c], Samples[s][c], Expected[c]);
+				++TestFailures;
+			}
+		}
+	}
+}
+
+//
+// Grays, primaries and secondaries at full swing (0 and 255) and at studio swing (16 and 235)
+// input levels, on every path
+//
+static void TestColorsAgainstReference()
+{
+	const BYTE Grays[] = { 0, 1, 16, 64, 127, 128, 200, 235, 254, 255 };
+	const BYTE Levels[][2] = { { 0, 255 }, { 16, 235 } };
+	CONVERT_PATH SavedPath = GetConvertPath();
+
+	for (UINT p = CONVERT_PATH_SCALAR; p <= static_cast<UINT>(GetSupportedConvertPath()); ++p)
+	{
+		SetConvertPath(static_cast<CONVERT_PATH>(p));
+		for (UINT m = 0; m < ARRAYSIZE(TestMatrices); ++m)
+		{
+			for (UINT g = 0; g < ARRAYSIZE(Grays); ++g)
+			{
+				CheckSolidColor(&TestMatrices[m], Grays[g], Grays[g], Grays[g]);
+			}
+			for (UINT l = 0; l < ARRAYSIZE(Levels); ++l)
+			{
+				BYTE Low = Levels[l][0];
+				BYTE High = Levels[l][1];
+				for (UINT Color = 1; Color < 7; ++Color)
+				{
+					CheckSolidColor(&TestMatrices[m], (Color & 4) ? High : Low, (Color & 2) ? High : Low, (Color & 1) ? High : Low);
+				}
+			}
+		}
+	}
+
+	SetConvertPath(SavedPath);
+}
+
+//
+// Random images of odd sizes, every path has to match the scalar one byte for byte
+//
+static void TestPathsBitIdentical()
+{
+	const UINT Sizes[][2] = { { 1, 1 }, { 7, 3 }, { 8, 2 }, { 33, 5 }, { 300, 9 }, { 517, 4 } };
+	CONVERT_PATH SavedPath = GetConvertPath();
+	UINT Random = 777;
+
+	for (UINT s = 0; s < ARRAYSIZE(Sizes); ++s)
+	{
+		UINT Width = Sizes[s][0];
+		UINT Height = Sizes[s][1];
+		UINT Pitch = Width * 4 + 12;
+		UINT ChromaWidth = (Width + 1) / 2;
+		UINT ChromaHeight = (Height + 1) / 2;
+		UINT PlanarSize = Width * Height + 2 * ChromaWidth * ChromaHeight;
+		UINT Yuy2Size = ChromaWidth * 4 * Height;
+		BYTE* Image = new BYTE[Pitch * Height];
+		BYTE* Reference = new BYTE[2 * PlanarSize + Yuy2Size];
+		BYTE* Output = new BYTE[2 * PlanarSize + Yuy2Size];
+		for (UINT i = 0; i < Pitch * Height; ++i)
+		{
+			Image[i] = static_cast<BYTE>(TestRandom(&Random));
+		}
+
+		for (UINT m = 0; m < ARRAYSIZE(TestMatrices); ++m)
+		{
+			for (UINT p = CONVERT_PATH_SCALAR; p <= static_cast<UINT>(GetSupportedConvertPath()); ++p)
+			{
+				SetConvertPath(static_cast<CONVERT_PATH>(p));
+				BYTE* Out = (p == CONVERT_PATH_SCALAR) ? Reference : Output;
+				BYTE* U = Out + Width * Height;
+				BYTE* V = U + ChromaWidth * ChromaHeight;
+				BYTE* Nv12 = Out + PlanarSize;
+				ConvertBGRAToI420(Image, Pitch, Width, Height, Out, Width, U, ChromaWidth, V, ChromaWidth, TestMatrices[m].Matrix);
+				ConvertBGRAToNV12(Image, Pitch, Width, Height, Nv12, Width, Nv12 + Width * Height, ChromaWidth * 2, TestMatrices[m].Matrix);
+				ConvertBGRAToYUY2(Image, Pitch, Width, Height, Out + 2 * PlanarSize, ChromaWidth * 4, TestMatrices[m].Matrix);
+
+				if (p != CONVERT_PATH_SCALAR)
+				{
+					CHECK(memcmp(Reference, Output, 2 * PlanarSize + Yuy2Size) == 0);
+				}
+			}
+		}
+
+		delete [] Image;
+		delete [] Reference;
+		delete [] Output;
+	}
+
+	SetConvertPath(SavedPath);
+}
+
+int main()
+{
+	RUN_TEST(TestColorsAgainstReference);
+	RUN_TEST(TestPathsBitIdentical);
+	return TEST_RESULT();
+}
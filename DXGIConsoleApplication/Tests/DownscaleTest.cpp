@@ -0,0 +1,440 @@
+// DownscaleTest.cpp : Every downscale kernel path against a scalar reference, and the frame pyramid
+// built whole, updated under rects and reused when nothing changed.
+//
+
+#include "TestCommon.h"
+#include "Downscale.h"
+#include "ColorConvert.h"
+
+#define TEST_MAX_WIDTH  203
+#define TEST_MAX_HEIGHT 117
+#define TEST_MAX_PITCH  (TEST_MAX_WIDTH * 4 + 64)
+#define TEST_MAX_RECTS  6
+#define TEST_GUARD      0xCD
+
+static BYTE Frame[TEST_MAX_PITCH * TEST_MAX_HEIGHT];
+static BYTE Output[TEST_MAX_PITCH * TEST_MAX_HEIGHT];
+static BYTE Reference[PYRAMID_MAX_LEVELS + 1][TEST_MAX_PITCH * TEST_MAX_HEIGHT];
+
+static const DOWNSCALE_FILTER Filters[] = { DOWNSCALE_FILTER_BOX, DOWNSCALE_FILTER_BILINEAR };
+
+//
+// The pixel rounded from the 2x2 block at x0, x1 of rows y0, y1, one channel at a time
+//
+static void AveragePixel(_In_ const BYTE* Src, UINT SrcPitch, UINT x0, UINT x1, UINT y0, UINT y1, _Out_writes_(4) BYTE* Dst)
+{
+	for (UINT c = 0; c < 4; ++c)
+	{
+		UINT Sum = Src[y0 * SrcPitch + x0 * 4 + c] + Src[y0 * SrcPitch + x1 * 4 + c] + Src[y1 * SrcPitch + x0 * 4 + c] + Src[y1 * SrcPitch + x1 * 4 + c];
+		Dst[c] = static_cast<BYTE>((Sum + 2) / 4);
+	}
+}
+
+//
+// Shrink by Factor one pixel at a time. A box 2x averages each 2x2 block, anything larger
+// averages the two pixels at the center of each block on its two center rows. Blocks cut
+// off by the right or bottom edge use its last pixels.
+//
+static void DownscaleReference(_In_ const BYTE* Src, UINT SrcPitch, UINT Width, UINT Height, _Out_ BYTE* Dst, UINT DstPitch, UINT Factor)
+{
+	UINT Offset = Factor / 2 - 1;
+	for (UINT j = 0; j < (Height + Factor - 1) / Factor; ++j)
+	{
+		UINT y0 = min(j * Factor + Offset, Height - 1);
+		UINT y1 = min(y0 + 1, Height - 1);
+		for (UINT i = 0; i < (Width + Factor - 1) / Factor; ++i)
+		{
+			UINT x0 = min(i * Factor + Offset, Width - 1);
+			UINT x1 = min(x0 + 1, Width - 1);
+			AveragePixel(Src, SrcPitch, x0, x1, y0, y1, Dst + j * DstPitch + i * 4);
+		}
+	}
+}
+
+//
+// Random bytes, so rounding of every channel is hit, with the padding at the end of each row
+// different from the pixels
+//
+static void FillRandomFrame(UINT Pitch, UINT Height, _Inout_ UINT* Random)
+{
+	for (UINT i = 0; i < Pitch * Height; ++i)
+	{
+		Frame[i] = static_cast<BYTE>(TestRandom(Random));
+	}
+}
+
+static bool SameImage(_In_ const BYTE* Actual, UINT ActualPitch, _In_ const BYTE* Expected, UINT ExpectedPitch, UINT Width, UINT Height)
+{
+	for (UINT y = 0; y < Height; ++y)
+	{
+		if (memcmp(Actual + y * ActualPitch, Expected + y * ExpectedPitch, Width * 4) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// Bytes of Output outside its Width x Height pixels that aren't guard bytes any more
+//
+static UINT CountOverwrittenGuard(UINT Pitch, UINT Width, UINT Height)
+{
+	UINT Overwritten = 0;
+	for (UINT i = 0; i < sizeof(Output); ++i)
+	{
+		bool Inside = (i / Pitch < Height && i % Pitch < Width * 4);
+		Overwritten += (!Inside && Output[i] != TEST_GUARD) ? 1 : 0;
+	}
+	return Overwritten;
+}
+
+//
+// Every kernel path gives the reference's pixels exactly for odd and even sizes, sizes smaller
+// than a vector and padded pitches, and writes nothing past the output image
+//
+static void TestKernelsMatchReference()
+{
+	static const UINT Factors[] = { 2, 4, 8 };
+	CONVERT_PATH SavedPath = GetConvertPath();
+	UINT Random = 5;
+	for (UINT Round = 0; Round < 300; ++Round)
+	{
+		UINT Width = 1 + TestRandom(&Random) % ((Round < 100) ? 20 : TEST_MAX_WIDTH);
+		UINT Height = 1 + TestRandom(&Random) % ((Round < 100) ? 20 : TEST_MAX_HEIGHT);
+		UINT Pitch = Width * 4 + (TestRandom(&Random) % 17) * 4;
+		FillRandomFrame(Pitch, Height, &Random);
+
+		for (UINT f = 0; f < ARRAYSIZE(Factors); ++f)
+		{
+			UINT Factor = Factors[f];
+			UINT OutWidth = (Width + Factor - 1) / Factor;
+			UINT OutHeight = (Height + Factor - 1) / Factor;
+			UINT OutPitch = OutWidth * 4 + (TestRandom(&Random) % 5) * 4;
+			DownscaleReference(Frame, Pitch, Width, Height, Reference[0], OutPitch, Factor);
+
+			for (UINT p = CONVERT_PATH_SCALAR; p <= static_cast<UINT>(GetSupportedConvertPath()); ++p)
+			{
+				SetConvertPath(static_cast<CONVERT_PATH>(p));
+				memset(Output, TEST_GUARD, sizeof(Output));
+				if (Factor == 2 && (Round & 1))
+				{
+					DownscaleBGRA2x(Frame, Pitch, Width, Height, Output, OutPitch);
+				}
+				else
+				{
+					DownscaleBGRABilinear(Frame, Pitch, Width, Height, Output, OutPitch, Factor);
+				}
+
+				if (!SameImage(Output, OutPitch, Reference[0], OutPitch, OutWidth, OutHeight))
+				{
+					fprintf(stderr, "Round %u: path %u %ux shrink of %ux%u differs from the reference\n", Round, p, Factor, Width, Height);
+					++TestFailures;
+				}
+				CHECK_EQUAL(0, CountOverwrittenGuard(OutPitch, OutWidth, OutHeight));
+			}
+		}
+	}
+	SetConvertPath(SavedPath);
+}
+
+//
+// What every level of a pyramid of Filter over the whole of Frame has to be. Box levels are
+// the 2x shrink of the level above, bilinear levels are shrunk from the frame.
+//
+static void BuildReferencePyramid(DOWNSCALE_FILTER Filter, UINT Levels, UINT Pitch, UINT Width, UINT Height)
+{
+	const BYTE* Src = Frame;
+	UINT SrcPitch = Pitch;
+	UINT SrcWidth = Width;
+	UINT SrcHeight = Height;
+	for (UINT Level = 1; Level <= Levels; ++Level)
+	{
+		if (Filter == DOWNSCALE_FILTER_BILINEAR)
+		{
+			DownscaleReference(Frame, Pitch, Width, Height, Reference[Level], TEST_MAX_PITCH, 1 << Level);
+		}
+		else
+		{
+			DownscaleReference(Src, SrcPitch, SrcWidth, SrcHeight, Reference[Level], TEST_MAX_PITCH, 2);
+			Src = Reference[Level];
+			SrcPitch = TEST_MAX_PITCH;
+			SrcWidth = (SrcWidth + 1) / 2;
+			SrcHeight = (SrcHeight + 1) / 2;
+		}
+	}
+}
+
+//
+// Levels the pyramid holds against the reference, false and a message for the first that differs
+//
+static bool PyramidMatches(_In_ FRAMEPYRAMID* Pyramid, UINT Levels, UINT Width, UINT Height, UINT Round)
+{
+	for (UINT Level = 1; Level <= Levels; ++Level)
+	{
+		IMAGE_VIEW View;
+		if (!Pyramid->GetLevel(Level, &View) || View.Width != GetDownscaledSize(Width, Level) || View.Height != GetDownscaledSize(Height, Level) ||
+			!SameImage(View.Data, View.Pitch, Reference[Level], TEST_MAX_PITCH, View.Width, View.Height))
+		{
+			fprintf(stderr, "Round %u: level %u of %u of a %ux%u pyramid differs from the reference\n", Round, Level, Levels, Width, Height);
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// Random rect of up to a quarter of the frame, sometimes partly off it
+//
+static void RandomRect(_Out_ RECT* Rect, UINT Width, UINT Height, _Inout_ UINT* Random)
+{
+	Rect->left = static_cast<LONG>(TestRandom(Random) % (Width + 8)) - 4;
+	Rect->top = static_cast<LONG>(TestRandom(Random) % (Height + 8)) - 4;
+	LONG RectWidth = 1 + TestRandom(Random) % (Width / 4 + 1);
+	LONG RectHeight = 1 + TestRandom(Random) % (Height / 4 + 1);
+	Rect->right = Rect->left + RectWidth;
+	Rect->bottom = Rect->top + RectHeight;
+}
+
+//
+// New random pixels under the part of Rect inside the frame
+//
+static void ScribbleRect(_In_ const RECT* Rect, UINT Pitch, UINT Width, UINT Height, _Inout_ UINT* Random)
+{
+	for (LONG y = max(Rect->top, 0L); y < min(Rect->bottom, static_cast<LONG>(Height)); ++y)
+	{
+		for (LONG x = max(Rect->left, 0L); x < min(Rect->right, static_cast<LONG>(Width)); ++x)
+		{
+			*reinterpret_cast<UINT*>(Frame + y * Pitch + x * 4) = TestRandom(Random) ^ (TestRandom(Random) << 16);
+		}
+	}
+}
+
+//
+// For both filters, every level count and every kernel path: the first Update builds every
+// level as the reference does, and after changing only the pixels under random move destinations
+// and dirty rects, the update under those rects gives the same levels as building them anew
+//
+static void TestPyramidUpdates()
+{
+	static BYTE MetaData[TEST_MAX_RECTS * sizeof(DXGI_OUTDUPL_MOVE_RECT) + TEST_MAX_RECTS * sizeof(RECT)];
+	CONVERT_PATH SavedPath = GetConvertPath();
+	UINT Random = 17;
+	for (UINT Round = 0; Round < 60; ++Round)
+	{
+		DOWNSCALE_FILTER Filter = Filters[Round % ARRAYSIZE(Filters)];
+		UINT Levels = 1 + (Round / 2) % PYRAMID_MAX_LEVELS;
+		UINT Width = 1 + TestRandom(&Random) % TEST_MAX_WIDTH;
+		UINT Height = 1 + TestRandom(&Random) % TEST_MAX_HEIGHT;
+		UINT Pitch = Width * 4 + (TestRandom(&Random) % 9) * 4;
+		UINT Path = (Round / 6) % (GetSupportedConvertPath() + 1);
+		SetConvertPath(static_cast<CONVERT_PATH>(Path));
+		FillRandomFrame(Pitch, Height, &Random);
+		IMAGE_VIEW Image = { Frame, Width, Height, Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+
+		FRAMEPYRAMID Pyramid;
+		Pyramid.Init(stderr, Levels, Filter);
+		bool Changed = false;
+		REQUIRE(Pyramid.Update(&Image, nullptr, &Changed) == DUPL_RETURN_SUCCESS);
+		CHECK(Changed);
+		BuildReferencePyramid(Filter, Levels, Pitch, Width, Height);
+		if (!PyramidMatches(&Pyramid, Levels, Width, Height, Round))
+		{
+			++TestFailures;
+			continue;
+		}
+
+		for (UINT Frames = 0; Frames < 8; ++Frames)
+		{
+			FRAME_METADATA Meta;
+			RtlZeroMemory(&Meta, sizeof(Meta));
+			Meta.MetaData = MetaData;
+			Meta.MetaDataSize = sizeof(MetaData);
+			Meta.MoveCount = TestRandom(&Random) % TEST_MAX_RECTS;
+			Meta.DirtyCount = 1 + TestRandom(&Random) % (TEST_MAX_RECTS - 1);
+			Meta.Presented = true;
+
+			DXGI_OUTDUPL_MOVE_RECT* MoveRects = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(MetaData);
+			for (UINT i = 0; i < Meta.MoveCount; ++i)
+			{
+				RandomRect(&MoveRects[i].DestinationRect, Width, Height, &Random);
+				MoveRects[i].SourcePoint.x = 0;
+				MoveRects[i].SourcePoint.y = 0;
+				ScribbleRect(&MoveRects[i].DestinationRect, Pitch, Width, Height, &Random);
+			}
+			RECT* DirtyRects = reinterpret_cast<RECT*>(MetaData + Meta.MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT));
+			for (UINT i = 0; i < Meta.DirtyCount; ++i)
+			{
+				RandomRect(&DirtyRects[i], Width, Height, &Random);
+				ScribbleRect(&DirtyRects[i], Pitch, Width, Height, &Random);
+			}
+
+			REQUIRE(Pyramid.Update(&Image, &Meta, &Changed) == DUPL_RETURN_SUCCESS);
+			CHECK(Changed);
+			BuildReferencePyramid(Filter, Levels, Pitch, Width, Height);
+			if (!PyramidMatches(&Pyramid, Levels, Width, Height, Round))
+			{
+				++TestFailures;
+				break;
+			}
+		}
+	}
+	SetConvertPath(SavedPath);
+}
+
+//
+// Levels of two pyramids of the same frame, false and a message for the first that differs
+//
+static bool SamePyramid(_In_ FRAMEPYRAMID* Pyramid, _In_ FRAMEPYRAMID* Expected, UINT Levels, UINT Path, UINT Round)
+{
+	for (UINT Level = 1; Level <= Levels; ++Level)
+	{
+		IMAGE_VIEW View;
+		IMAGE_VIEW ExpectedView;
+		if (!Pyramid->GetLevel(Level, &View) || !Expected->GetLevel(Level, &ExpectedView) || View.Width != ExpectedView.Width ||
+			View.Height != ExpectedView.Height || !SameImage(View.Data, View.Pitch, ExpectedView.Data, ExpectedView.Pitch, View.Width, View.Height))
+		{
+			fprintf(stderr, "Round %u: level %u of the path %u pyramid differs from the scalar kernels\n", Round, Level, Path);
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// Every SIMD path builds and updates the same pyramid as the scalar kernels, for both filters
+// and every level count
+//
+static void TestPyramidPathsMatchScalar()
+{
+	static BYTE MetaData[TEST_MAX_RECTS * sizeof(RECT)];
+	CONVERT_PATH SavedPath = GetConvertPath();
+	UINT Random = 23;
+	for (UINT Round = 0; Round < 24; ++Round)
+	{
+		DOWNSCALE_FILTER Filter = Filters[Round % ARRAYSIZE(Filters)];
+		UINT Levels = 1 + (Round / 2) % PYRAMID_MAX_LEVELS;
+		UINT Width = 1 + TestRandom(&Random) % TEST_MAX_WIDTH;
+		UINT Height = 1 + TestRandom(&Random) % TEST_MAX_HEIGHT;
+		UINT Pitch = Width * 4 + (TestRandom(&Random) % 9) * 4;
+		FillRandomFrame(Pitch, Height, &Random);
+		IMAGE_VIEW Image = { Frame, Width, Height, Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+
+		FRAME_METADATA Meta;
+		RtlZeroMemory(&Meta, sizeof(Meta));
+		Meta.MetaData = MetaData;
+		Meta.MetaDataSize = sizeof(MetaData);
+		Meta.DirtyCount = 1 + TestRandom(&Random) % TEST_MAX_RECTS;
+		Meta.Presented = true;
+		RECT* DirtyRects = reinterpret_cast<RECT*>(MetaData);
+		for (UINT i = 0; i < Meta.DirtyCount; ++i)
+		{
+			RandomRect(&DirtyRects[i], Width, Height, &Random);
+		}
+
+		// Built by every path, then updated by every path under the rects after they changed
+		FRAMEPYRAMID Pyramids[CONVERT_PATH_AVX2 + 1];
+		UINT Paths = GetSupportedConvertPath() + 1;
+		for (UINT Step = 0; Step < 2; ++Step)
+		{
+			for (UINT p = CONVERT_PATH_SCALAR; p < Paths; ++p)
+			{
+				SetConvertPath(static_cast<CONVERT_PATH>(p));
+				if (Step == 0)
+				{
+					Pyramids[p].Init(stderr, Levels, Filter);
+				}
+				REQUIRE(Pyramids[p].Update(&Image, (Step == 0) ? nullptr : &Meta, nullptr) == DUPL_RETURN_SUCCESS);
+				if (p != CONVERT_PATH_SCALAR && !SamePyramid(&Pyramids[p], &Pyramids[CONVERT_PATH_SCALAR], Levels, p, Round))
+				{
+					++TestFailures;
+				}
+			}
+
+			for (UINT i = 0; i < Meta.DirtyCount; ++i)
+			{
+				ScribbleRect(&DirtyRects[i], Pitch, Width, Height, &Random);
+			}
+		}
+	}
+	SetConvertPath(SavedPath);
+}
+
+//
+// A frame without rects keeps the levels as they were even though the pixels were written,
+// while a full copy, a new size or Invalidate rebuild them all. Nothing is there before the
+// first Update, and only 32bpp frames are taken.
+//
+static void TestPyramidReuse()
+{
+	const UINT Width = 150;
+	const UINT Height = 90;
+	const UINT Pitch = Width * 4;
+	UINT Random = 29;
+	FillRandomFrame(Pitch, Height, &Random);
+	IMAGE_VIEW Image = { Frame, Width, Height, Pitch, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_ROTATE90 };
+
+	FRAMEPYRAMID Pyramid;
+	Pyramid.Init(stderr, PYRAMID_MAX_LEVELS, DOWNSCALE_FILTER_BOX);
+	IMAGE_VIEW View;
+	CHECK(!Pyramid.GetLevel(1, &View));
+	CHECK(View.Data == nullptr);
+
+	bool Changed = false;
+	REQUIRE(Pyramid.Update(&Image, nullptr, &Changed) == DUPL_RETURN_SUCCESS);
+	CHECK(Changed);
+	CHECK(!Pyramid.GetLevel(0, &View));
+	CHECK(!Pyramid.GetLevel(PYRAMID_MAX_LEVELS + 1, &View));
+	REQUIRE(Pyramid.GetLevel(PYRAMID_MAX_LEVELS, &View));
+	CHECK_EQUAL(DXGI_MODE_ROTATION_ROTATE90, View.Rotation);
+	BuildReferencePyramid(DOWNSCALE_FILTER_BOX, PYRAMID_MAX_LEVELS, Pitch, Width, Height);
+
+	// Only the pointer moved, whatever is in the frame now is not looked at
+	FRAME_METADATA Meta;
+	RtlZeroMemory(&Meta, sizeof(Meta));
+	FillRandomFrame(Pitch, Height, &Random);
+	CHECK(Pyramid.Update(&Image, &Meta, &Changed) == DUPL_RETURN_SUCCESS);
+	CHECK(!Changed);
+	CHECK(PyramidMatches(&Pyramid, PYRAMID_MAX_LEVELS, Width, Height, 0));
+
+	// Rects that can't be used
+	Meta.FullCopy = true;
+	CHECK(Pyramid.Update(&Image, &Meta, &Changed) == DUPL_RETURN_SUCCESS);
+	CHECK(Changed);
+	BuildReferencePyramid(DOWNSCALE_FILTER_BOX, PYRAMID_MAX_LEVELS, Pitch, Width, Height);
+	CHECK(PyramidMatches(&Pyramid, PYRAMID_MAX_LEVELS, Width, Height, 1));
+
+	// Forgotten, so rebuilt even without rects
+	Meta.FullCopy = false;
+	FillRandomFrame(Pitch, Height, &Random);
+	Pyramid.Invalidate();
+	CHECK(!Pyramid.GetLevel(1, &View));
+	CHECK(Pyramid.Update(&Image, &Meta, &Changed) == DUPL_RETURN_SUCCESS);
+	CHECK(Changed);
+	BuildReferencePyramid(DOWNSCALE_FILTER_BOX, PYRAMID_MAX_LEVELS, Pitch, Width, Height);
+	CHECK(PyramidMatches(&Pyramid, PYRAMID_MAX_LEVELS, Width, Height, 2));
+
+	// A smaller output reuses the buffer, and is rebuilt even without rects
+	Image.Width = 37;
+	Image.Height = 21;
+	FillRandomFrame(Pitch, Image.Height, &Random);
+	CHECK(Pyramid.Update(&Image, &Meta, &Changed) == DUPL_RETURN_SUCCESS);
+	CHECK(Changed);
+	BuildReferencePyramid(DOWNSCALE_FILTER_BOX, PYRAMID_MAX_LEVELS, Pitch, Image.Width, Image.Height);
+	CHECK(PyramidMatches(&Pyramid, PYRAMID_MAX_LEVELS, Image.Width, Image.Height, 3));
+
+	// 64bpp frames are refused and leave the pyramid as it was
+	Image.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	CHECK(Pyramid.Update(&Image, nullptr, &Changed) == DUPL_RETURN_ERROR_UNEXPECTED);
+	CHECK(!Changed);
+	CHECK(PyramidMatches(&Pyramid, PYRAMID_MAX_LEVELS, 37, 21, 4));
+}
+
+int main()
+{
+	RUN_TEST(TestKernelsMatchReference);
+	RUN_TEST(TestPyramidUpdates);
+	RUN_TEST(TestPyramidPathsMatchScalar);
+	RUN_TEST(TestPyramidReuse);
+	return TEST_RESULT();
+}
@@ -0,0 +1,583 @@
+// DuplicationManagerTest.cpp : DUPLICATIONMANAGER driven by CPUDUPLICATIONDEVICE. Checks the
+// staging ring delivers exactly what was presented, in order, and never copies or maps in an
+// order the real device would reject.
+//
+
+#include "TestCommon.h"
+#include "DuplicationManager.h"
+
+#define TEST_WIDTH      200
+#define TEST_HEIGHT     120
+#define TEST_QUEUE      16
+
+//
+// Manager on a fresh CPU device, with a buffer for the image it delivers
+//
+typedef struct _TEST_CAPTURE
+{
+	CPUDUPLICATIONDEVICE Device;
+	DUPLICATIONMANAGER* Manager;
+	BYTE* Image;
+} TEST_CAPTURE;
+
+static bool OpenCapture(_Out_ TEST_CAPTURE* Capture, DXGI_MODE_ROTATION Rotation, _In_reads_opt_(RegionCount) const RECT* Regions, UINT RegionCount, bool DirtyReadback)
+{
+	Capture->Image = nullptr;
+	Capture->Manager = new (std::nothrow) DUPLICATIONMANAGER(&Capture->Device);
+	if (!Capture->Manager || !Capture->Device.Init(TEST_WIDTH, TEST_HEIGHT, Rotation, TEST_QUEUE))
+	{
+		return false;
+	}
+	Capture->Manager->SetDirtyRectReadback(DirtyReadback);
+	if (RegionCount)
+	{
+		Capture->Manager->SetCaptureRegions(Regions, RegionCount);
+	}
+	if (Capture->Manager->InitDupl(stderr, 0) != DUPL_RETURN_SUCCESS)
+	{
+		return false;
+	}
+	Capture->Image = new (std::nothrow) BYTE[Capture->Manager->GetImageBufferSize()];
+	return Capture->Image != nullptr;
+}
+
+static void CloseCapture(_Inout_ TEST_CAPTURE* Capture)
+{
+	if (Capture->Manager)
+	{
+		delete Capture->Manager;
+		Capture->Manager = nullptr;
+	}
+	if (Capture->Image)
+	{
+		delete [] Capture->Image;
+		Capture->Image = nullptr;
+	}
+}
+
+//
+// Number of pixels of the delivered image that differ from Expected, which has the desktop's pitch.
+// The image is compared with the part of Expected from Left, Top on.
+//
+static UINT CountMismatches(_In_ TEST_CAPTURE* Capture, _In_ const BYTE* Expected, LONG Left = 0, LONG Top = 0)
+{
+	IMAGE_VIEW View;
+	Capture->Manager->GetImageView(Capture->Image, &View);
+	UINT Pitch = Capture->Device.GetDesktopPitch();
+	UINT Mismatches = 0;
+	for (UINT y = 0; y < View.Height; ++y)
+	{
+		const UINT* Row = reinterpret_cast<const UINT*>(Capture->Image + y * View.Pitch);
+		const UINT* ExpectedRow = reinterpret_cast<const UINT*>(Expected + (Top + y) * Pitch) + Left;
+		for (UINT x = 0; x < View.Width; ++x)
+		{
+			Mismatches += (Row[x] != ExpectedRow[x]) ? 1 : 0;
+		}
+	}
+	return Mismatches;
+}
+
+static void PresentWholeDesktop(_Inout_ TEST_CAPTURE* Capture, UINT Seed)
+{
+	FillTestImage(Capture->Device.GetDesktop(), TEST_WIDTH, TEST_HEIGHT, Capture->Device.GetDesktopPitch(), Seed);
+	RECT Dirty = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	Capture->Device.PresentFrame(nullptr, 0, &Dirty, 1);
+}
+
+static void CheckNoViolations(_In_ TEST_CAPTURE* Capture)
+{
+	CPU_DUPLICATION_STATS Stats;
+	Capture->Device.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Violations);
+	CHECK_EQUAL(Stats.Maps, Stats.Unmaps);
+}
+
+//
+// The first frame is read back right away, after that every frame comes out one GetFrame
+// later, and a timeout delivers what is still in the ring
+//
+static void TestRingDeliversInOrder()
+{
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, DXGI_MODE_ROTATION_IDENTITY, nullptr, 0, false);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+
+	UINT Pitch = Capture.Device.GetDesktopPitch();
+	BYTE* Expected = new BYTE[Pitch * TEST_HEIGHT];
+	bool Timeout;
+
+	const UINT Frames = 10;
+	for (UINT i = 0; i < Frames; ++i)
+	{
+		PresentWholeDesktop(&Capture, i + 1);
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+
+		if (i == 0 || i >= STAGING_RING_SIZE)
+		{
+			UINT Delivered = (i == 0) ? 1 : i + 2 - STAGING_RING_SIZE;
+			CHECK(!Timeout);
+			FillTestImage(Expected, TEST_WIDTH, TEST_HEIGHT, Pitch, Delivered);
+			CHECK_EQUAL(0, CountMismatches(&Capture, Expected));
+			CHECK(Capture.Manager->GetFrameMetaData() != nullptr);
+		}
+		else
+		{
+			// A frame was queued, the next call delivers it
+			CHECK(Timeout);
+			CHECK(Capture.Manager->IsFramePending());
+			CHECK(Capture.Manager->GetFrameMetaData() == nullptr);
+		}
+	}
+
+	// Nothing new, the frames still in the ring come out
+	for (UINT i = 1; i < STAGING_RING_SIZE; ++i)
+	{
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+		CHECK(!Timeout);
+	}
+	FillTestImage(Expected, TEST_WIDTH, TEST_HEIGHT, Pitch, Frames);
+	CHECK_EQUAL(0, CountMismatches(&Capture, Expected));
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(Timeout);
+	CHECK(!Capture.Manager->IsFramePending());
+
+	CPU_DUPLICATION_STATS Stats;
+	Capture.Device.GetStats(&Stats);
+	CHECK_EQUAL(Frames, Stats.FramesAcquired);
+	CHECK_EQUAL(Frames, Stats.Copies);
+	CheckNoViolations(&Capture);
+
+	delete [] Expected;
+	CloseCapture(&Capture);
+}
+
+//
+// Random dirty rects and moves, patched into the previous frame, give the desktop exactly. Both
+// are in the coordinates of the acquired image, which is not rotated with the output. With a
+// Region in desktop coordinates the moves come out as dirty rects of the region image.
+//
+static void CheckDirtyReadback(DXGI_MODE_ROTATION Rotation, _In_opt_ const RECT* Region)
+{
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, Rotation, Region, Region ? 1 : 0, true);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+
+	BYTE* Desktop = Capture.Device.GetDesktop();
+	UINT Pitch = Capture.Device.GetDesktopPitch();
+	BYTE* Scratch = new BYTE[Pitch * TEST_HEIGHT];
+	bool Timeout;
+
+	// Where the delivered image is in the acquired one
+	RECT Source = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	if (Region)
+	{
+		DesktopRectToImage(&Source, Region, Rotation, TEST_WIDTH, TEST_HEIGHT);
+	}
+
+	PresentWholeDesktop(&Capture, 1);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+
+	UINT Random = 12345;
+	for (UINT Frame = 0; Frame < 200; ++Frame)
+	{
+		DXGI_OUTDUPL_MOVE_RECT Move;
+		UINT MoveCount = 0;
+		if (TestRandom(&Random) % 3 == 0)
+		{
+			// Move a block within the desktop, the source is read before anything is written
+			INT Width = 1 + TestRandom(&Random) % (TEST_WIDTH / 2);
+			INT Height = 1 + TestRandom(&Random) % (TEST_HEIGHT / 2);
+			Move.SourcePoint.x = TestRandom(&Random) % (TEST_WIDTH - Width + 1);
+			Move.SourcePoint.y = TestRandom(&Random) % (TEST_HEIGHT - Height + 1);
+			Move.DestinationRect.left = TestRandom(&Random) % (TEST_WIDTH - Width + 1);
+			Move.DestinationRect.top = TestRandom(&Random) % (TEST_HEIGHT - Height + 1);
+			Move.DestinationRect.right = Move.DestinationRect.left + Width;
+			Move.DestinationRect.bottom = Move.DestinationRect.top + Height;
+			memcpy_s(Scratch, Pitch * TEST_HEIGHT, Desktop, Pitch * TEST_HEIGHT);
+			for (INT y = 0; y < Height; ++y)
+			{
+				memcpy_s(Desktop + (Move.DestinationRect.top + y) * Pitch + Move.DestinationRect.left * 4, Width * 4,
+					Scratch + (Move.SourcePoint.y + y) * Pitch + Move.SourcePoint.x * 4, Width * 4);
+			}
+			MoveCount = 1;
+		}
+
+		RECT Dirty[4];
+		UINT DirtyCount = 1 + TestRandom(&Random) % 3;
+		for (UINT i = 0; i < DirtyCount; ++i)
+		{
+			Dirty[i].left = TestRandom(&Random) % TEST_WIDTH;
+			Dirty[i].top = TestRandom(&Random) % TEST_HEIGHT;
+			Dirty[i].right = Dirty[i].left + 1 + TestRandom(&Random) % (TEST_WIDTH - Dirty[i].left);
+			Dirty[i].bottom = Dirty[i].top + 1 + TestRandom(&Random) % (TEST_HEIGHT - Dirty[i].top);
+			UINT Color = TestRandom(&Random);
+			for (LONG y = Dirty[i].top; y < Dirty[i].bottom; ++y)
+			{
+				UINT* Row = reinterpret_cast<UINT*>(Desktop + y * Pitch);
+				for (LONG x = Dirty[i].left; x < Dirty[i].right; ++x)
+				{
+					Row[x] = Color ^ (x * 0x101);
+				}
+			}
+		}
+
+		REQUIRE(Capture.Device.PresentFrame(&Move, MoveCount, Dirty, DirtyCount));
+
+		// The frame goes into the ring, the timeout after it reads it back. Frames that don't
+		// touch the region are skipped and time out both times.
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+		CHECK(Timeout);
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+		CHECK(Region || !Timeout);
+
+		const FRAME_METADATA* Meta = Capture.Manager->GetFrameMetaData();
+		if (!Timeout)
+		{
+			REQUIRE(Meta != nullptr);
+			CHECK(!Meta->FullCopy);
+		}
+		CHECK_EQUAL(0, CountMismatches(&Capture, Desktop, Source.left, Source.top));
+	}
+	CheckNoViolations(&Capture);
+
+	delete [] Scratch;
+	CloseCapture(&Capture);
+}
+
+static void TestDirtyReadbackMatchesDesktop()
+{
+	const DXGI_MODE_ROTATION Rotations[] = { DXGI_MODE_ROTATION_IDENTITY, DXGI_MODE_ROTATION_ROTATE90, DXGI_MODE_ROTATION_ROTATE180, DXGI_MODE_ROTATION_ROTATE270 };
+	RECT Region = { 15, 25, 95, 85 };
+	for (UINT r = 0; r < ARRAYSIZE(Rotations); ++r)
+	{
+		CheckDirtyReadback(Rotations[r], nullptr);
+		CheckDirtyReadback(Rotations[r], &Region);
+	}
+}
+
+//
+// Only the regions are copied and read back, stacked in the region image
+//
+static void TestRegionCapture()
+{
+	RECT Regions[2] = { { 10, 20, 60, 50 }, { 100, 0, 180, 40 } };
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, DXGI_MODE_ROTATION_IDENTITY, Regions, 2, true);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+
+	IMAGE_VIEW View;
+	Capture.Manager->GetImageView(Capture.Image, &View);
+	CHECK_EQUAL(80, View.Width);
+	CHECK_EQUAL(70, View.Height);
+
+	BYTE* Desktop = Capture.Device.GetDesktop();
+	UINT Pitch = Capture.Device.GetDesktopPitch();
+	bool Timeout;
+	for (UINT Frame = 1; Frame <= 4; ++Frame)
+	{
+		PresentWholeDesktop(&Capture, Frame);
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+		if (Timeout)
+		{
+			CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+		}
+		CHECK(!Timeout);
+
+		Capture.Manager->GetImageView(Capture.Image, &View);
+		UINT Mismatches = 0;
+		UINT DestY = 0;
+		for (UINT r = 0; r < 2; ++r)
+		{
+			for (LONG y = Regions[r].top; y < Regions[r].bottom; ++y, ++DestY)
+			{
+				Mismatches += (memcmp(Capture.Image + DestY * View.Pitch, Desktop + y * Pitch + Regions[r].left * 4, (Regions[r].right - Regions[r].left) * 4) != 0) ? 1 : 0;
+			}
+		}
+		CHECK_EQUAL(0, Mismatches);
+	}
+
+	// A change outside every region is skipped without a readback
+	CPU_DUPLICATION_STATS Before;
+	Capture.Device.GetStats(&Before);
+	RECT Outside = { 70, 60, 90, 100 };
+	REQUIRE(Capture.Device.PresentFrame(nullptr, 0, &Outside, 1));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(Timeout);
+	CPU_DUPLICATION_STATS After;
+	Capture.Device.GetStats(&After);
+	CHECK_EQUAL(Before.Copies, After.Copies);
+	CHECK_EQUAL(Before.FramesAcquired + 1, After.FramesAcquired);
+	CheckNoViolations(&Capture);
+
+	CloseCapture(&Capture);
+}
+
+//
+// A frame with only a pointer update is delivered without touching the staging ring
+//
+static void TestPointerOnlyFrame()
+{
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, DXGI_MODE_ROTATION_IDENTITY, nullptr, 0, true);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+	Capture.Manager->SetPointerCompositing(true);
+
+	bool Timeout;
+	PresentWholeDesktop(&Capture, 7);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+
+	CPU_DUPLICATION_STATS Before;
+	Capture.Device.GetStats(&Before);
+	REQUIRE(Capture.Device.PresentPointer(40, 30, true));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+
+	const FRAME_METADATA* Meta = Capture.Manager->GetFrameMetaData();
+	REQUIRE(Meta != nullptr);
+	CHECK(!Meta->Presented);
+	CHECK(Meta->PointerMoved);
+	CHECK_EQUAL(1, Meta->DirtyCount);
+
+	// Inside of the shape is opaque white
+	UINT Pitch = Capture.Manager->GetImagePitch();
+	CHECK_EQUAL(0xFFFFFFFF, reinterpret_cast<UINT*>(Capture.Image + 38 * Pitch)[48]);
+
+	CPU_DUPLICATION_STATS After;
+	Capture.Device.GetStats(&After);
+	CHECK_EQUAL(Before.Copies, After.Copies);
+	CHECK_EQUAL(Before.Maps, After.Maps);
+	CHECK_EQUAL(1, After.Calls[CPU_DUPLICATION_CALL_POINTER_SHAPE]);
+
+	// Moving it away restores the desktop underneath
+	REQUIRE(Capture.Device.PresentPointer(150, 90, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+	CHECK_EQUAL(0, CountMismatches(&Capture, Capture.Device.GetDesktop()));
+	CheckNoViolations(&Capture);
+
+	CloseCapture(&Capture);
+}
+
+//
+// Transition errors come out as expected errors, Reset recovers and the next frame is complete
+//
+static void TestFailuresAndReset()
+{
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, DXGI_MODE_ROTATION_IDENTITY, nullptr, 0, true);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+
+	bool Timeout;
+	PresentWholeDesktop(&Capture, 3);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+
+	// Desktop switch
+	Capture.Device.FailNextCall(CPU_DUPLICATION_CALL_ACQUIRE, DXGI_ERROR_ACCESS_LOST);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+
+	// Still going on the first time Reset tries
+	Capture.Device.FailNextCall(CPU_DUPLICATION_CALL_DUPLICATE, E_ACCESSDENIED);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Capture.Manager->Reset());
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->Reset());
+
+	// First frame after the Reset is a full copy
+	PresentWholeDesktop(&Capture, 4);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+	const FRAME_METADATA* Meta = Capture.Manager->GetFrameMetaData();
+	REQUIRE(Meta != nullptr);
+	CHECK(Meta->FullCopy);
+	CHECK_EQUAL(0, CountMismatches(&Capture, Capture.Device.GetDesktop()));
+
+	// Device removed, Reset creates a new device and staging textures
+	CPU_DUPLICATION_STATS Stats;
+	Capture.Device.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Calls[CPU_DUPLICATION_CALL_CREATE_DEVICE]);
+	Capture.Device.SetDeviceRemovedReason(DXGI_ERROR_DEVICE_RESET);
+	Capture.Device.FailNextCall(CPU_DUPLICATION_CALL_ACQUIRE, E_FAIL);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->Reset());
+	Capture.Device.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.Calls[CPU_DUPLICATION_CALL_CREATE_DEVICE]);
+
+	PresentWholeDesktop(&Capture, 5);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+	CHECK_EQUAL(0, CountMismatches(&Capture, Capture.Device.GetDesktop()));
+
+	// Not a transition
+	PresentWholeDesktop(&Capture, 6);
+	Capture.Device.FailNextCall(CPU_DUPLICATION_CALL_MAP, E_INVALIDARG);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CheckNoViolations(&Capture);
+
+	CloseCapture(&Capture);
+}
+
+//
+// A frame whose rects can't be read fails and queues no copy, the next frame is read back whole
+//
+static void TestMetaDataFailure()
+{
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, DXGI_MODE_ROTATION_IDENTITY, nullptr, 0, true);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+
+	bool Timeout;
+	PresentWholeDesktop(&Capture, 7);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+
+	CPU_DUPLICATION_STATS Before;
+	Capture.Device.GetStats(&Before);
+	PresentWholeDesktop(&Capture, 8);
+	Capture.Device.FailNextCall(CPU_DUPLICATION_CALL_DIRTY_RECTS, E_INVALIDARG);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Capture.Manager->IsFramePending());
+
+	CPU_DUPLICATION_STATS Stats;
+	Capture.Device.GetStats(&Stats);
+	CHECK_EQUAL(Before.FramesAcquired + 1, Stats.FramesAcquired);
+	CHECK_EQUAL(Before.Copies, Stats.Copies);
+
+	// Only a corner changes, but what the failed frame changed has to be read back too
+	FillTestImage(Capture.Device.GetDesktop(), 16, 16, Capture.Device.GetDesktopPitch(), 9);
+	RECT Dirty = { 0, 0, 16, 16 };
+	Capture.Device.PresentFrame(nullptr, 0, &Dirty, 1);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	if (Timeout)
+	{
+		CHECK(Capture.Manager->IsFramePending());
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	}
+	CHECK(!Timeout);
+	const FRAME_METADATA* Meta = Capture.Manager->GetFrameMetaData();
+	REQUIRE(Meta != nullptr);
+	CHECK(Meta->FullCopy);
+	CHECK_EQUAL(0, CountMismatches(&Capture, Capture.Device.GetDesktop()));
+	CheckNoViolations(&Capture);
+
+	CloseCapture(&Capture);
+}
+
+//
+// Outputs the adapter doesn't have are an expected error, they come and go with transitions
+//
+static void TestMissingOutput()
+{
+	CPUDUPLICATIONDEVICE Device;
+	REQUIRE(Device.Init(TEST_WIDTH, TEST_HEIGHT, DXGI_MODE_ROTATION_IDENTITY, TEST_QUEUE));
+	DUPLICATIONMANAGER Manager(&Device);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Manager.InitDupl(stderr, 1));
+
+	bool Timeout;
+	BYTE Image[4];
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Manager.GetFrame(Image, &Timeout, 0));
+}
+
+//
+// Only 32bpp desktops are captured, the region copies and the sinks all assume 4 byte pixels
+//
+static void TestDesktopFormats()
+{
+	CPUDUPLICATIONDEVICE Device;
+	REQUIRE(Device.Init(TEST_WIDTH, TEST_HEIGHT, DXGI_MODE_ROTATION_IDENTITY, TEST_QUEUE));
+	Device.SetDesktopFormat(DXGI_FORMAT_R16G16B16A16_FLOAT);
+	{
+		DUPLICATIONMANAGER Manager(&Device);
+		CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Manager.InitDupl(stderr, 0));
+	}
+
+	Device.SetDesktopFormat(DXGI_FORMAT_R10G10B10A2_UNORM);
+	DUPLICATIONMANAGER Manager(&Device);
+	REQUIRE(Manager.InitDupl(stderr, 0) == DUPL_RETURN_SUCCESS);
+	IMAGE_VIEW View;
+	BYTE Image[4];
+	Manager.GetImageView(Image, &View);
+	CHECK_EQUAL(DXGI_FORMAT_R10G10B10A2_UNORM, View.Format);
+
+	// An output switched to FP16 while capturing is refused when the duplication is recreated
+	Device.SetDesktopFormat(DXGI_FORMAT_R16G16B16A16_FLOAT);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Manager.Reset());
+
+	CPU_DUPLICATION_STATS Stats;
+	Device.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Violations);
+}
+
+//
+// Rotated outputs report desktop coordinates in desktop orientation, the image is not rotated
+//
+static void TestRotatedOutput()
+{
+	TEST_CAPTURE Capture;
+	bool Opened = OpenCapture(&Capture, DXGI_MODE_ROTATION_ROTATE90, nullptr, 0, false);
+	if (!Opened)
+	{
+		CloseCapture(&Capture);
+	}
+	REQUIRE(Opened);
+
+	DXGI_OUTPUT_DESC Desc;
+	Capture.Manager->GetOutputDesc(&Desc);
+	CHECK_EQUAL(TEST_HEIGHT, Desc.DesktopCoordinates.right - Desc.DesktopCoordinates.left);
+	CHECK_EQUAL(TEST_WIDTH, Desc.DesktopCoordinates.bottom - Desc.DesktopCoordinates.top);
+
+	bool Timeout;
+	PresentWholeDesktop(&Capture, 9);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Capture.Manager->GetFrame(Capture.Image, &Timeout, 0));
+	CHECK(!Timeout);
+
+	IMAGE_VIEW View;
+	Capture.Manager->GetImageView(Capture.Image, &View);
+	CHECK_EQUAL(TEST_WIDTH, View.Width);
+	CHECK_EQUAL(TEST_HEIGHT, View.Height);
+	CHECK_EQUAL(DXGI_MODE_ROTATION_ROTATE90, View.Rotation);
+	CHECK_EQUAL(0, CountMismatches(&Capture, Capture.Device.GetDesktop()));
+	CheckNoViolations(&Capture);
+
+	CloseCapture(&Capture);
+}
+
+int main()
+{
+	RUN_TEST(TestRingDeliversInOrder);
+	RUN_TEST(TestDirtyReadbackMatchesDesktop);
+	RUN_TEST(TestRegionCapture);
+	RUN_TEST(TestPointerOnlyFrame);
+	RUN_TEST(TestFailuresAndReset);
+	RUN_TEST(TestMetaDataFailure);
+	RUN_TEST(TestMissingOutput);
+	RUN_TEST(TestDesktopFormats);
+	RUN_TEST(TestRotatedOutput);
+	return TEST_RESULT();
+}
@@ -0,0 +1,304 @@
+// EventLogTest.cpp : Formatting of logged events, the rate limit and the repeats it reports, loss
+// of a full ring, and timestamp order across threads.
+//
+
+#include "TestCommon.h"
+#include "EventLog.h"
+
+#define TEST_LINE_SIZE      1024
+#define TEST_THREADS        4
+#define TEST_THREAD_EVENTS  200
+
+//
+// Read the lines the log wrote to File, at most MaxLines of them
+//
+static UINT ReadLines(_In_ FILE* File, _Out_writes_(MaxLines) char (*Lines)[TEST_LINE_SIZE], UINT MaxLines)
+{
+	fflush(File);
+	rewind(File);
+
+	UINT Count = 0;
+	while (Count < MaxLines && fgets(Lines[Count], TEST_LINE_SIZE, File))
+	{
+		Lines[Count][strcspn(Lines[Count], "\n")] = '\0';
+		++Count;
+	}
+	fseek(File, 0, SEEK_END);
+	return Count;
+}
+
+//
+// Message of an event line, after "<ms> [<thread>] "
+//
+static const char* MessageOf(_In_z_ const char* Line)
+{
+	const char* Message = strstr(Line, "] ");
+	return Message ? Message + 2 : Line;
+}
+
+static UINT CountLines(_In_reads_(Count) char (*Lines)[TEST_LINE_SIZE], UINT Count, _In_z_ const char* Text)
+{
+	UINT Matches = 0;
+	for (UINT Line = 0; Line < Count; ++Line)
+	{
+		if (strstr(Lines[Line], Text))
+		{
+			++Matches;
+		}
+	}
+	return Matches;
+}
+
+static char Lines[TEST_THREADS * TEST_THREAD_EVENTS + 16][TEST_LINE_SIZE];
+
+static void TestFormatting()
+{
+	FILE* File = tmpfile();
+	REQUIRE(File);
+
+	EVENTLOG Log;
+	REQUIRE(Log.Init(File) == DUPL_RETURN_SUCCESS);
+	Log.Write("Ints %d %u 0x%X %lld", S_OK, static_cast<UINT64>(-5), 7, 0xAB, static_cast<UINT64>(-1234567890123LL));
+	Log.Write("Double %.2f and %s", S_OK, LogArg(2.5), LogArg("narrow"));
+	Log.Write("%ls", E_FAIL, LogArg(L"Wide message"));
+	Log.Write("100%% of %s", S_OK, LogArg(static_cast<const void*>(nullptr)));
+	Log.Stop();
+
+	UINT Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	REQUIRE(Count == 4);
+	CHECK(strcmp(MessageOf(Lines[0]), "Ints -5 7 0xAB -1234567890123") == 0);
+	CHECK(strcmp(MessageOf(Lines[1]), "Double 2.50 and narrow") == 0);
+	CHECK(strcmp(MessageOf(Lines[2]), "Wide message with 0x80004005.") == 0);
+	CHECK(strcmp(MessageOf(Lines[3]), "100% of (null)") == 0);
+
+	char Prefix[32];
+	sprintf_s(Prefix, "[%u] ", GetCurrentThreadId());
+	CHECK(strstr(Lines[0], Prefix) != nullptr);
+
+	EVENTLOG_STATS Stats;
+	Log.GetStats(&Stats);
+	CHECK_EQUAL(4, Stats.Written);
+	CHECK_EQUAL(0, Stats.Dropped);
+	CHECK_EQUAL(0, Stats.Suppressed);
+	CHECK_EQUAL(1, Stats.Threads);
+
+	fclose(File);
+}
+
+//
+// Repeats past the burst are counted, and the count is reported once: by the next repeat logged
+// after the window, by the log once the window is over without one, or when the log stops
+//
+static void TestRateLimit()
+{
+	FILE* File = tmpfile();
+	REQUIRE(File);
+
+	// Without a writer thread yet nothing takes the count before the next repeat
+	EVENTLOG Log;
+	for (UINT Repeat = 0; Repeat < EVENTLOG_RATE_BURST + 6; ++Repeat)
+	{
+		Log.Write("Repeated %u", E_FAIL, 1);
+	}
+	Sleep(EVENTLOG_RATE_WINDOW_MS + 50);
+	Log.Write("Repeated %u", E_FAIL, 1);
+
+	REQUIRE(Log.Init(File) == DUPL_RETURN_SUCCESS);
+	Log.Flush();
+	UINT Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	REQUIRE(Count == EVENTLOG_RATE_BURST + 1);
+	CHECK(strcmp(MessageOf(Lines[EVENTLOG_RATE_BURST]), "Repeated 1 with 0x80004005. (6 repeats not logged)") == 0);
+
+	// A burst that ends without another repeat, only reported once its window is over
+	for (UINT Repeat = 0; Repeat < EVENTLOG_RATE_BURST + 3; ++Repeat)
+	{
+		Log.Write("Other %u", S_OK, 2);
+	}
+	Log.Flush();
+	Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	CHECK_EQUAL(EVENTLOG_RATE_BURST * 2 + 1, Count);
+	CHECK_EQUAL(0, CountLines(Lines, Count, "were not logged"));
+
+	Sleep(EVENTLOG_RATE_WINDOW_MS + 50);
+	Log.Flush();
+	Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	REQUIRE(Count == EVENTLOG_RATE_BURST * 2 + 2);
+	char Expected[128];
+	sprintf_s(Expected, "3 repeats of \"Other %%u\" of thread %u were not logged.", GetCurrentThreadId());
+	CHECK(strcmp(Lines[Count - 1], Expected) == 0);
+
+	// The last round reports what is left of windows still running
+	for (UINT Repeat = 0; Repeat < EVENTLOG_RATE_BURST + 2; ++Repeat)
+	{
+		Log.Write("Last %u", S_OK, 3);
+	}
+	Log.Stop();
+	Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	REQUIRE(Count == EVENTLOG_RATE_BURST * 3 + 3);
+	sprintf_s(Expected, "2 repeats of \"Last %%u\" of thread %u were not logged.", GetCurrentThreadId());
+	CHECK(strcmp(Lines[Count - 1], Expected) == 0);
+	CHECK_EQUAL(2, CountLines(Lines, Count, "were not logged"));
+
+	EVENTLOG_STATS Stats;
+	Log.GetStats(&Stats);
+	CHECK_EQUAL(EVENTLOG_RATE_BURST * 3 + 1, Stats.Written);
+	CHECK_EQUAL(6 + 3 + 2, Stats.Suppressed);
+
+	fclose(File);
+}
+
+//
+// An event that takes over the rate entry of another one still holding dropped repeats must not
+// lose their count
+//
+static void TestRateEntryTakenOver()
+{
+	FILE* File = tmpfile();
+	REQUIRE(File);
+
+	EVENTLOG Log;
+	REQUIRE(Log.Init(File) == DUPL_RETURN_SUCCESS);
+
+	// Same format and HRESULT, first arguments EVENTLOG_RATE_ENTRIES apart share an entry
+	for (UINT Repeat = 0; Repeat < EVENTLOG_RATE_BURST + 5; ++Repeat)
+	{
+		Log.Write("Colliding %u", S_OK, 1);
+	}
+	Log.Write("Colliding %u", S_OK, 1 + EVENTLOG_RATE_ENTRIES);
+
+	// Reported right away, the window of the event does not matter anymore
+	Log.Flush();
+	UINT Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	REQUIRE(Count == EVENTLOG_RATE_BURST + 2);
+	char Expected[128];
+	sprintf_s(Expected, "5 repeats of earlier events of thread %u were not logged.", GetCurrentThreadId());
+	CHECK(strcmp(Lines[Count - 1], Expected) == 0);
+
+	Log.Stop();
+	Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	CHECK_EQUAL(EVENTLOG_RATE_BURST + 2, Count);
+
+	EVENTLOG_STATS Stats;
+	Log.GetStats(&Stats);
+	CHECK_EQUAL(5, Stats.Suppressed);
+
+	fclose(File);
+}
+
+//
+// Without a writer thread the ring fills, the newest events are dropped and counted
+//
+static void TestRingFull()
+{
+	FILE* File = tmpfile();
+	REQUIRE(File);
+
+	EVENTLOG Log;
+	for (UINT Event = 0; Event < EVENTLOG_RING_EVENTS + 44; ++Event)
+	{
+		Log.Write("Event %u", S_OK, Event);
+	}
+	REQUIRE(Log.Init(File) == DUPL_RETURN_SUCCESS);
+	Log.Stop();
+
+	UINT Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	REQUIRE(Count == EVENTLOG_RING_EVENTS + 1);
+	for (UINT Event = 0; Event < EVENTLOG_RING_EVENTS; ++Event)
+	{
+		UINT Logged = EVENTLOG_RING_EVENTS;
+		sscanf_s(MessageOf(Lines[Event]), "Event %u", &Logged);
+		CHECK_EQUAL(Event, Logged);
+	}
+	char Expected[128];
+	sprintf_s(Expected, "44 events of thread %u were lost, its log ring was full.", GetCurrentThreadId());
+	CHECK(strcmp(Lines[Count - 1], Expected) == 0);
+
+	EVENTLOG_STATS Stats;
+	Log.GetStats(&Stats);
+	CHECK_EQUAL(EVENTLOG_RING_EVENTS, Stats.Written);
+	CHECK_EQUAL(44, Stats.Dropped);
+
+	fclose(File);
+}
+
+static DWORD WINAPI LoggingProc(_In_ void* Param)
+{
+	EVENTLOG* Log = reinterpret_cast<EVENTLOG*>(Param);
+	for (UINT Sequence = 0; Sequence < TEST_THREAD_EVENTS; ++Sequence)
+	{
+		Log->Write("Sequence %u", S_OK, Sequence);
+		if (Sequence % 16 == 0)
+		{
+			SwitchToThread();
+		}
+	}
+	return 0;
+}
+
+//
+// Events of several threads come out oldest first, every thread's in the order it logged them
+//
+static void TestThreadOrder()
+{
+	FILE* File = tmpfile();
+	REQUIRE(File);
+
+	EVENTLOG Log;
+	REQUIRE(Log.Init(File) == DUPL_RETURN_SUCCESS);
+
+	HANDLE Threads[TEST_THREADS];
+	DWORD ThreadIds[TEST_THREADS];
+	for (UINT Thread = 0; Thread < TEST_THREADS; ++Thread)
+	{
+		Threads[Thread] = CreateThread(nullptr, 0, LoggingProc, &Log, 0, &ThreadIds[Thread]);
+		REQUIRE(Threads[Thread]);
+	}
+	for (UINT Thread = 0; Thread < TEST_THREADS; ++Thread)
+	{
+		WaitForSingleObject(Threads[Thread], INFINITE);
+		CloseHandle(Threads[Thread]);
+	}
+	Log.Stop();
+
+	UINT Count = ReadLines(File, Lines, ARRAYSIZE(Lines));
+	CHECK_EQUAL(TEST_THREADS * TEST_THREAD_EVENTS, Count);
+
+	double Previous = -1.0;
+	UINT Next[TEST_THREADS] = {};
+	for (UINT Line = 0; Line < Count; ++Line)
+	{
+		double Time;
+		UINT ThreadId;
+		UINT Sequence;
+		REQUIRE(sscanf_s(Lines[Line], "%lf [%u] Sequence %u", &Time, &ThreadId, &Sequence) == 3);
+		CHECK(Time >= Previous);
+		Previous = Time;
+
+		UINT Thread = 0;
+		while (Thread < TEST_THREADS && ThreadIds[Thread] != ThreadId)
+		{
+			++Thread;
+		}
+		REQUIRE(Thread < TEST_THREADS);
+		CHECK_EQUAL(Next[Thread], Sequence);
+		Next[Thread] = Sequence + 1;
+	}
+
+	EVENTLOG_STATS Stats;
+	Log.GetStats(&Stats);
+	CHECK_EQUAL(TEST_THREADS, Stats.Threads);
+	CHECK_EQUAL(0, Stats.Dropped);
+	CHECK_EQUAL(0, Stats.Suppressed);
+
+	fclose(File);
+}
+
+int main()
+{
+	RUN_TEST(TestFormatting);
+	RUN_TEST(TestRateLimit);
+	RUN_TEST(TestRateEntryTakenOver);
+	RUN_TEST(TestRingFull);
+	RUN_TEST(TestThreadOrder);
+	return TEST_RESULT();
+}
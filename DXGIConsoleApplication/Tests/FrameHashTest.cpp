@@ -0,0 +1,160 @@
+// FrameHashTest.cpp : Change detection of FRAMEHASH with and without the frame's rects.
+//
+
+#include "TestCommon.h"
+#include "FrameHash.h"
+
+#define TEST_WIDTH      40
+#define TEST_HEIGHT     30
+#define TEST_PITCH      (TEST_WIDTH * BPP + 64)
+
+static BYTE Pixels[TEST_PITCH * TEST_HEIGHT];
+
+//
+// Metadata with one move and one dirty rect, as GetFrameMetaData hands them out
+//
+typedef struct _TEST_METADATA
+{
+	DXGI_OUTDUPL_MOVE_RECT Move;
+	RECT Dirty;
+} TEST_METADATA;
+
+static void MakeMeta(_Out_ FRAME_METADATA* Meta, _Out_ TEST_METADATA* Rects, LONG MoveTop, LONG MoveBottom, LONG DirtyTop, LONG DirtyBottom)
+{
+	RtlZeroMemory(Meta, sizeof(FRAME_METADATA));
+	RtlZeroMemory(Rects, sizeof(TEST_METADATA));
+	Rects->Move.DestinationRect.left = 2;
+	Rects->Move.DestinationRect.top = MoveTop;
+	Rects->Move.DestinationRect.right = 10;
+	Rects->Move.DestinationRect.bottom = MoveBottom;
+	Rects->Dirty.left = 20;
+	Rects->Dirty.top = DirtyTop;
+	Rects->Dirty.right = 30;
+	Rects->Dirty.bottom = DirtyBottom;
+	Meta->MetaData = reinterpret_cast<BYTE*>(Rects);
+	Meta->MetaDataSize = sizeof(TEST_METADATA);
+	Meta->MoveCount = 1;
+	Meta->DirtyCount = 1;
+	Meta->Presented = true;
+}
+
+static void SetPixel(UINT x, UINT y, UINT Value)
+{
+	reinterpret_cast<UINT*>(Pixels + y * TEST_PITCH)[x] = Value;
+}
+
+//
+// Without rects every row is compared, the padding past Width is not
+//
+static void TestWholeFrame()
+{
+	FRAMEHASH Hash;
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 1);
+
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+
+	Pixels[TEST_WIDTH * BPP + 3] ^= 0xFF;
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+
+	for (UINT y = 0; y < TEST_HEIGHT; y += 7)
+	{
+		SetPixel(TEST_WIDTH - 1, y, 0x12345678 + y);
+		CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+		CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+	}
+
+	// A different size or a reset starts over
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH - 1, TEST_HEIGHT));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH - 1, TEST_HEIGHT));
+	Hash.Reset();
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH - 1, TEST_HEIGHT));
+}
+
+//
+// With rects only their rows are hashed again, anywhere across the row
+//
+static void TestRectRows()
+{
+	FRAMEHASH Hash;
+	FRAME_METADATA Meta;
+	TEST_METADATA Rects;
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 2);
+	MakeMeta(&Meta, &Rects, 3, 6, 12, 15);
+
+	// Nothing to compare against yet, so the first frame is hashed whole
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+
+	// Under the move destination, outside of its columns
+	SetPixel(TEST_WIDTH - 1, 5, 0xCAFE);
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+
+	// Under the dirty rect
+	SetPixel(0, 12, 0xBEEF);
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+
+	// Rows the rects don't cover are trusted to be unchanged
+	SetPixel(0, 20, 0xF00D);
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+
+	// Until a frame without usable rects compares everything again
+	Meta.FullCopy = true;
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+
+	// A frame with no rects at all changed nothing
+	Meta.FullCopy = false;
+	Meta.MoveCount = 0;
+	Meta.DirtyCount = 0;
+	SetPixel(1, 1, 0xD00D);
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+}
+
+//
+// Rects reaching past the image are clipped, empty and inverted ones are skipped
+//
+static void TestRectsOutsideImage()
+{
+	FRAMEHASH Hash;
+	FRAME_METADATA Meta;
+	TEST_METADATA Rects;
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 3);
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+
+	MakeMeta(&Meta, &Rects, -50, 1, TEST_HEIGHT - 1, TEST_HEIGHT + 50);
+	SetPixel(3, 0, 0x1111);
+	SetPixel(3, TEST_HEIGHT - 1, 0x2222);
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT));
+
+	MakeMeta(&Meta, &Rects, TEST_HEIGHT + 5, TEST_HEIGHT + 9, 10, 4);
+	SetPixel(3, 7, 0x3333);
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Meta));
+}
+
+//
+// An empty image has no rows to hash and never changes
+//
+static void TestEmptyImage()
+{
+	FRAMEHASH Hash;
+	FRAME_METADATA Meta;
+	TEST_METADATA Rects;
+	MakeMeta(&Meta, &Rects, 0, 5, 0, 5);
+
+	CHECK(Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, 0));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, 0));
+	CHECK(!Hash.Update(Pixels, TEST_PITCH, TEST_WIDTH, 0, &Meta));
+}
+
+int main()
+{
+	RUN_TEST(TestWholeFrame);
+	RUN_TEST(TestRectRows);
+	RUN_TEST(TestRectsOutsideImage);
+	RUN_TEST(TestEmptyImage);
+	return TEST_RESULT();
+}
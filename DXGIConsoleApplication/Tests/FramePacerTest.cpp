@@ -0,0 +1,319 @@
+// FramePacerTest.cpp : FRAMEPACER on a simulated clock, fed by a simulated frame source.
+//
+
+#include "TestCommon.h"
+#include "FramePacer.h"
+
+// A tick per microsecond and 100 frames per second keep the arithmetic exact
+#define TEST_FREQUENCY      1000000
+#define TEST_FPS            100
+#define TEST_PERIOD         (TEST_FREQUENCY / TEST_FPS)
+#define TEST_WIDTH          8
+#define TEST_HEIGHT         4
+
+//
+// Time only moves when the test or a wait moves it
+//
+class FAKECLOCK : public FRAMECLOCK
+{
+	public:
+		FAKECLOCK() : m_Waits(0), m_Ticks(1000) {}
+		UINT64 GetTicks() { return m_Ticks; }
+		UINT64 GetFrequency() { return TEST_FREQUENCY; }
+		void WaitUntil(UINT64 Ticks)
+		{
+			++m_Waits;
+			m_Ticks = max(m_Ticks, Ticks);
+		}
+		void Advance(UINT64 Ticks) { m_Ticks += Ticks; }
+		UINT m_Waits;
+
+	private:
+		UINT64 m_Ticks;
+};
+
+//
+// Source whose frames show up at the ticks the test schedules. GetFrame spends the clock's time
+// waiting like AcquireNextFrame does: up to the frame if it arrives within the timeout, the whole
+// timeout otherwise.
+//
+class SIMSOURCE : public FRAMESOURCE
+{
+	public:
+		SIMSOURCE(_In_ FAKECLOCK* Clock) : m_Delivered(0), m_LastTimeoutMs(0), m_Clock(Clock), m_Next(0), m_Count(0)
+		{
+			RtlZeroMemory(&m_Meta, sizeof(m_Meta));
+		}
+
+		void Schedule(UINT64 Ticks)
+		{
+			m_Arrivals[m_Count++] = Ticks;
+		}
+
+		_Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
+		DUPL_RETURN GetFrame(_Inout_ BYTE* ImageData, _Out_ bool* Timeout, UINT TimeoutMs)
+		{
+			m_LastTimeoutMs = TimeoutMs;
+			UINT64 Now = m_Clock->GetTicks();
+			UINT64 Limit = Now + static_cast<UINT64>(TimeoutMs) * TEST_FREQUENCY / 1000;
+
+			// Frames that arrived while nobody was waiting are folded into one, like DXGI does
+			bool Arrived = false;
+			while (m_Next < m_Count && m_Arrivals[m_Next] <= Limit)
+			{
+				m_Clock->WaitUntil(m_Arrivals[m_Next++]);
+				Arrived = true;
+			}
+			*Timeout = !Arrived;
+			if (!Arrived)
+			{
+				m_Clock->WaitUntil(Limit);
+				return DUPL_RETURN_SUCCESS;
+			}
+
+			FillTestImage(ImageData, TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH * BPP, ++m_Delivered);
+			m_Meta.Presented = true;
+			m_Meta.FullCopy = true;
+			return DUPL_RETURN_SUCCESS;
+		}
+
+		void GetImageView(_In_ BYTE* ImageData, _Out_ IMAGE_VIEW* View)
+		{
+			View->Data = ImageData;
+			View->Width = TEST_WIDTH;
+			View->Height = TEST_HEIGHT;
+			View->Pitch = TEST_WIDTH * BPP;
+			View->Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+			View->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+		}
+
+		UINT GetImageBufferSize() { return TEST_WIDTH * BPP * TEST_HEIGHT; }
+		const FRAME_METADATA* GetFrameMetaData() { return &m_Meta; }
+		void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr)
+		{
+			RtlZeroMemory(DescPtr, sizeof(DXGI_OUTPUT_DESC));
+			SetRect(&DescPtr->DesktopCoordinates, 0, 0, TEST_WIDTH, TEST_HEIGHT);
+		}
+
+		UINT m_Delivered;
+		UINT m_LastTimeoutMs;
+
+	private:
+		FAKECLOCK* m_Clock;
+		UINT64 m_Arrivals[1024];
+		UINT m_Next;
+		UINT m_Count;
+		FRAME_METADATA m_Meta;
+};
+
+static BYTE Image[TEST_WIDTH * BPP * TEST_HEIGHT];
+
+//
+// One iteration of the capture loop. Returns what EndFrame returned.
+//
+static UINT RunFrame(_Inout_ FRAMEPACER* Pacer, _Inout_ SIMSOURCE* Source, _Out_ bool* NewFrame)
+{
+	bool Timeout;
+	Source->GetFrame(Image, &Timeout, Pacer->BeginFrame());
+	*NewFrame = !Timeout;
+	return Pacer->EndFrame(*NewFrame);
+}
+
+//
+// Without a rate the default timeout is used and nothing waits
+//
+static void TestUnpaced()
+{
+	FAKECLOCK Clock;
+	FRAMEPACER Pacer;
+	Pacer.Init(0, &Clock);
+
+	CHECK_EQUAL(FRAME_TIMEOUT_DEFAULT, Pacer.BeginFrame());
+	CHECK_EQUAL(0, Pacer.EndFrame(true));
+	CHECK_EQUAL(0, Pacer.EndFrame(false));
+	CHECK_EQUAL(0, Clock.m_Waits);
+
+	FRAMEPACER_STATS Stats;
+	Pacer.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.Frames);
+	CHECK_EQUAL(1, Stats.NewFrames);
+	CHECK_EQUAL(1, Stats.Repeats);
+	CHECK_EQUAL(0, Stats.MissedDeadlines);
+}
+
+//
+// An idle screen waits out each period in GetFrame and repeats the last frame on every deadline
+//
+static void TestIdleRepeatsOnSchedule()
+{
+	FAKECLOCK Clock;
+	SIMSOURCE Source(&Clock);
+	FRAMEPACER Pacer;
+	Pacer.Init(TEST_FPS, &Clock);
+	UINT64 Start = Clock.GetTicks();
+
+	for (UINT i = 1; i <= 50; ++i)
+	{
+		bool NewFrame;
+		CHECK_EQUAL(0, RunFrame(&Pacer, &Source, &NewFrame));
+		CHECK(!NewFrame);
+		CHECK_EQUAL(1000 / TEST_FPS, Source.m_LastTimeoutMs);
+		CHECK_EQUAL(Start + i * TEST_PERIOD, Clock.GetTicks());
+	}
+
+	FRAMEPACER_STATS Stats;
+	Pacer.GetStats(&Stats);
+	CHECK_EQUAL(50, Stats.Frames);
+	CHECK_EQUAL(50, Stats.Repeats);
+	CHECK_EQUAL(0, Stats.TotalJitterTicks);
+	CHECK_EQUAL(TEST_FREQUENCY, Stats.Frequency);
+}
+
+//
+// A frame early in the period goes out at the deadline, not when it arrived, and the timeout
+// shrinks to what is left of the period
+//
+static void TestFrameHeldToDeadline()
+{
+	FAKECLOCK Clock;
+	SIMSOURCE Source(&Clock);
+	FRAMEPACER Pacer;
+	Pacer.Init(TEST_FPS, &Clock);
+	UINT64 Start = Clock.GetTicks();
+
+	Source.Schedule(Start + TEST_PERIOD / 4);
+	bool NewFrame;
+	CHECK_EQUAL(0, RunFrame(&Pacer, &Source, &NewFrame));
+	CHECK(NewFrame);
+	CHECK_EQUAL(Start + TEST_PERIOD, Clock.GetTicks());
+
+	// Part way into the next period the timeout is what remains of it, rounded down
+	Clock.Advance(TEST_PERIOD / 2 + 1);
+	CHECK_EQUAL((TEST_PERIOD / 2 - 1) * 1000 / TEST_FREQUENCY, Pacer.BeginFrame());
+	CHECK_EQUAL(0, Pacer.EndFrame(false));
+	CHECK_EQUAL(Start + 2 * TEST_PERIOD, Clock.GetTicks());
+
+	// At or past the deadline GetFrame must not wait at all
+	Clock.Advance(TEST_PERIOD);
+	CHECK_EQUAL(0, Pacer.BeginFrame());
+}
+
+//
+// A frame that takes two and a half periods skips the two deadlines it missed, the schedule
+// stays anchored to the first deadline and jitter is measured from the deadline it hit
+//
+static void TestMissedDeadlines()
+{
+	FAKECLOCK Clock;
+	SIMSOURCE Source(&Clock);
+	FRAMEPACER Pacer;
+	Pacer.Init(TEST_FPS, &Clock);
+	UINT64 Start = Clock.GetTicks();
+
+	CHECK(Pacer.BeginFrame() > 0);
+	Clock.Advance(TEST_PERIOD * 5 / 2);
+	CHECK_EQUAL(1, Pacer.EndFrame(true));
+
+	bool NewFrame;
+	CHECK_EQUAL(0, RunFrame(&Pacer, &Source, &NewFrame));
+	CHECK_EQUAL(Start + 3 * TEST_PERIOD, Clock.GetTicks());
+
+	FRAMEPACER_STATS Stats;
+	Pacer.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.MissedDeadlines);
+	CHECK_EQUAL(TEST_PERIOD * 3 / 2, Stats.TotalJitterTicks);
+	CHECK_EQUAL(TEST_PERIOD * 3 / 2, Stats.MaxJitterTicks);
+}
+
+//
+// After a restart the first deadline is a period from the next BeginFrame, however long the
+// capture stalled, and the stall is not counted as missed deadlines
+//
+static void TestRestart()
+{
+	FAKECLOCK Clock;
+	SIMSOURCE Source(&Clock);
+	FRAMEPACER Pacer;
+	Pacer.Init(TEST_FPS, &Clock);
+
+	bool NewFrame;
+	CHECK_EQUAL(0, RunFrame(&Pacer, &Source, &NewFrame));
+	Clock.Advance(TEST_PERIOD * 10 + TEST_PERIOD / 2);
+	Pacer.Restart();
+
+	UINT64 Start = Clock.GetTicks();
+	CHECK_EQUAL(TEST_PERIOD * 1000 / TEST_FREQUENCY, Pacer.BeginFrame());
+	CHECK_EQUAL(0, Pacer.EndFrame(true));
+	CHECK_EQUAL(Start + TEST_PERIOD, Clock.GetTicks());
+
+	FRAMEPACER_STATS Stats;
+	Pacer.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.Frames);
+	CHECK_EQUAL(0, Stats.MissedDeadlines);
+	CHECK_EQUAL(0, Stats.TotalJitterTicks);
+}
+
+//
+// Random arrivals and random work after GetFrame. Every frame leaves on a deadline of the
+// schedule, no earlier than it, and every deadline is either emitted or counted as missed.
+//
+static void TestScheduleInvariants()
+{
+	FAKECLOCK Clock;
+	SIMSOURCE Source(&Clock);
+	FRAMEPACER Pacer;
+	Pacer.Init(TEST_FPS, &Clock);
+	UINT64 Start = Clock.GetTicks();
+	UINT Random = 31;
+
+	UINT64 Arrival = Start;
+	for (UINT i = 0; i < 1000; ++i)
+	{
+		Arrival += TestRandom(&Random) % (2 * TEST_PERIOD);
+		Source.Schedule(Arrival);
+	}
+
+	UINT Missed = 0;
+	UINT NewFrames = 0;
+	UINT64 Previous = Start;
+	for (UINT i = 0; i < 800; ++i)
+	{
+		bool Timeout;
+		Source.GetFrame(Image, &Timeout, Pacer.BeginFrame());
+
+		// Hashing, queueing and the odd slow write
+		UINT Work = TestRandom(&Random) % 100;
+		Clock.Advance((Work < 95) ? Work * 10 : Work * TEST_PERIOD / 30);
+
+		Missed += Pacer.EndFrame(!Timeout);
+		NewFrames += Timeout ? 0 : 1;
+
+		UINT64 Now = Clock.GetTicks();
+		CHECK(Now > Previous);
+		Previous = Now;
+	}
+
+	FRAMEPACER_STATS Stats;
+	Pacer.GetStats(&Stats);
+	CHECK_EQUAL(800, Stats.Frames);
+	CHECK_EQUAL(NewFrames, Stats.NewFrames);
+	CHECK_EQUAL(800 - NewFrames, Stats.Repeats);
+	CHECK_EQUAL(Missed, Stats.MissedDeadlines);
+	CHECK(Stats.MaxJitterTicks < TEST_PERIOD * 4);
+	CHECK(NewFrames > 0 && Missed > 0);
+
+	// The last frame left within a period after the deadline that ended it
+	UINT64 Deadlines = (Clock.GetTicks() - Start) / TEST_PERIOD;
+	CHECK_EQUAL(Stats.Frames + Stats.MissedDeadlines, Deadlines);
+}
+
+int main()
+{
+	RUN_TEST(TestUnpaced);
+	RUN_TEST(TestIdleRepeatsOnSchedule);
+	RUN_TEST(TestFrameHeldToDeadline);
+	RUN_TEST(TestMissedDeadlines);
+	RUN_TEST(TestRestart);
+	RUN_TEST(TestScheduleInvariants);
+	return TEST_RESULT();
+}
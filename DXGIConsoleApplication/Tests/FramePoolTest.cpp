@@ -0,0 +1,157 @@
+// FramePoolTest.cpp : Preallocation, the buffer limit, reuse and resizing of FRAMEPOOL buffers.
+//
+
+#include "TestCommon.h"
+#include "FramePool.h"
+
+#define TEST_BUFFER_SIZE    1000
+#define TEST_PREALLOCATE    3
+#define TEST_MAX            5
+
+//
+// Preallocated buffers are served without allocating, the pool grows up to its limit and
+// refuses past it, and a released buffer is handed out again
+//
+static void TestLimit()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_BUFFER_SIZE, TEST_PREALLOCATE, TEST_MAX, 0) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(TEST_BUFFER_SIZE, Pool.GetBufferSize());
+
+	FRAMEPOOL_STATS Stats;
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(TEST_PREALLOCATE, Stats.BufferCount);
+	CHECK_EQUAL(0, Stats.Outstanding);
+	CHECK(!Stats.LargePages);
+
+	FRAME_BUFFER* Buffers[TEST_MAX];
+	for (UINT i = 0; i < TEST_MAX; ++i)
+	{
+		REQUIRE(Pool.Acquire(&Buffers[i]) == DUPL_RETURN_SUCCESS);
+		CHECK_EQUAL(TEST_BUFFER_SIZE, Buffers[i]->Size);
+		CHECK_EQUAL(0, reinterpret_cast<UINT_PTR>(Buffers[i]->Data) % FRAMEPOOL_ALIGNMENT);
+		memset(Buffers[i]->Data, static_cast<int>(i), TEST_BUFFER_SIZE);
+	}
+
+	FRAME_BUFFER* Refused;
+	CHECK(Pool.Acquire(&Refused) == DUPL_RETURN_ERROR_EXPECTED);
+	CHECK(Refused == nullptr);
+
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(TEST_PREALLOCATE, Stats.Hits);
+	CHECK_EQUAL(TEST_MAX - TEST_PREALLOCATE, Stats.Misses);
+	CHECK_EQUAL(1, Stats.Failed);
+	CHECK_EQUAL(TEST_MAX, Stats.BufferCount);
+	CHECK_EQUAL(TEST_MAX, Stats.PeakOutstanding);
+
+	// A second reference keeps the buffer out of the pool
+	Pool.AddRef(Buffers[2]);
+	Pool.Release(Buffers[2]);
+	CHECK(Pool.Acquire(&Refused) == DUPL_RETURN_ERROR_EXPECTED);
+	Pool.Release(Buffers[2]);
+
+	FRAME_BUFFER* Again;
+	REQUIRE(Pool.Acquire(&Again) == DUPL_RETURN_SUCCESS);
+	CHECK(Again == Buffers[2]);
+	CHECK_EQUAL(1, Again->RefCount);
+	Buffers[2] = Again;
+
+	for (UINT i = 0; i < TEST_MAX; ++i)
+	{
+		Pool.Release(Buffers[i]);
+	}
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Outstanding);
+	CHECK_EQUAL(TEST_MAX, Stats.BufferCount);
+}
+
+//
+// Preallocation never goes past the limit
+//
+static void TestPreallocateCapped()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_BUFFER_SIZE, TEST_MAX + 4, TEST_MAX, 0) == DUPL_RETURN_SUCCESS);
+	FRAMEPOOL_STATS Stats;
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(TEST_MAX, Stats.BufferCount);
+	CHECK_EQUAL(static_cast<UINT64>(TEST_MAX) * ((TEST_BUFFER_SIZE + FRAMEPOOL_ALIGNMENT - 1) & ~(FRAMEPOOL_ALIGNMENT - 1)), Stats.Bytes);
+}
+
+//
+// Large pages are only used when asked for, and without them the pool still hands out buffers
+//
+static void TestLargePagesFallBack()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_BUFFER_SIZE, 1, TEST_MAX, FRAMEPOOL_FLAG_LARGE_PAGES) == DUPL_RETURN_SUCCESS);
+
+	FRAME_BUFFER* Buffers[2];
+	for (UINT i = 0; i < ARRAYSIZE(Buffers); ++i)
+	{
+		REQUIRE(Pool.Acquire(&Buffers[i]) == DUPL_RETURN_SUCCESS);
+		REQUIRE(Buffers[i]->Data);
+		memset(Buffers[i]->Data, 0xA5, TEST_BUFFER_SIZE);
+	}
+
+	FRAMEPOOL_STATS Stats;
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.BufferCount);
+	CHECK_EQUAL(Stats.LargePages, Buffers[0]->LargePage || Buffers[1]->LargePage);
+
+	for (UINT i = 0; i < ARRAYSIZE(Buffers); ++i)
+	{
+		Pool.Release(Buffers[i]);
+	}
+}
+
+//
+// After a resize the free buffers are gone and new ones have the new size, while a buffer held
+// across the resize stays usable and is freed, not pooled, when it comes back
+//
+static void TestResize()
+{
+	const UINT Larger = TEST_BUFFER_SIZE * 3 + 7;
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_BUFFER_SIZE, TEST_PREALLOCATE, TEST_MAX, 0) == DUPL_RETURN_SUCCESS);
+
+	FRAME_BUFFER* Held;
+	REQUIRE(Pool.Acquire(&Held) == DUPL_RETURN_SUCCESS);
+	Pool.Resize(Larger);
+	CHECK_EQUAL(Larger, Pool.GetBufferSize());
+
+	FRAMEPOOL_STATS Stats;
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.BufferCount);
+	CHECK_EQUAL(1, Stats.Outstanding);
+	memset(Held->Data, 0x5A, TEST_BUFFER_SIZE);
+
+	FRAME_BUFFER* Resized;
+	REQUIRE(Pool.Acquire(&Resized) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(Larger, Resized->Size);
+	CHECK_EQUAL(0, reinterpret_cast<UINT_PTR>(Resized->Data) % FRAMEPOOL_ALIGNMENT);
+	memset(Resized->Data, 0xA5, Larger);
+
+	Pool.Release(Held);
+	Pool.Release(Resized);
+	Pool.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Outstanding);
+	CHECK_EQUAL(1, Stats.BufferCount);
+	CHECK_EQUAL(static_cast<UINT64>((Larger + FRAMEPOOL_ALIGNMENT - 1) & ~(FRAMEPOOL_ALIGNMENT - 1)), Stats.Bytes);
+
+	// The same size again keeps the pool as it is
+	Pool.Resize(Larger);
+	FRAME_BUFFER* Again;
+	REQUIRE(Pool.Acquire(&Again) == DUPL_RETURN_SUCCESS);
+	CHECK(Again == Resized);
+	Pool.Release(Again);
+}
+
+int main()
+{
+	RUN_TEST(TestLimit);
+	RUN_TEST(TestPreallocateCapped);
+	RUN_TEST(TestLargePagesFallBack);
+	RUN_TEST(TestResize);
+	return TEST_RESULT();
+}
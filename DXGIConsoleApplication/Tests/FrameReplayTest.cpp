@@ -0,0 +1,364 @@
+// FrameReplayTest.cpp : Frames recorded from a CPU duplication come back pixel for pixel with
+// their rects, and a replay keeps the recorded spacing on a simulated clock.
+//
+
+#include "TestCommon.h"
+#include "FrameReplay.h"
+
+#define TEST_WIDTH      64
+#define TEST_HEIGHT     48
+#define TEST_PITCH      (TEST_WIDTH * BPP)
+#define TEST_QUEUE      16
+#define TEST_FRAMES     40
+#define TEST_FREQUENCY  1000000
+#define TEST_RECORDING  "FrameReplayTest.rec"
+
+//
+// Time only moves when a wait moves it
+//
+class FAKECLOCK : public FRAMECLOCK
+{
+	public:
+		FAKECLOCK() : m_Ticks(1000) {}
+		UINT64 GetTicks() { return m_Ticks; }
+		UINT64 GetFrequency() { return TEST_FREQUENCY; }
+		void WaitUntil(UINT64 Ticks) { m_Ticks = max(m_Ticks, Ticks); }
+
+	private:
+		UINT64 m_Ticks;
+};
+
+static BYTE Expected[TEST_FRAMES][TEST_PITCH * TEST_HEIGHT];
+static UINT ExpectedMoves[TEST_FRAMES];
+static UINT ExpectedDirty[TEST_FRAMES];
+
+//
+// Pixels of a replayed image that differ from a packed expected image
+//
+static UINT CountMismatches(_In_ const BYTE* Image, UINT Pitch, _In_ const BYTE* Packed)
+{
+	UINT Mismatches = 0;
+	for (UINT y = 0; y < TEST_HEIGHT; ++y)
+	{
+		const UINT* Row = reinterpret_cast<const UINT*>(Image + y * Pitch);
+		const UINT* ExpectedRow = reinterpret_cast<const UINT*>(Packed + y * TEST_PITCH);
+		for (UINT x = 0; x < TEST_WIDTH; ++x)
+		{
+			Mismatches += (Row[x] != ExpectedRow[x]) ? 1 : 0;
+		}
+	}
+	return Mismatches;
+}
+
+//
+// Change the desktop with a random move and random dirty rects and present it
+//
+static bool PresentRandomFrame(_Inout_ CPUDUPLICATIONDEVICE* Device, _Inout_ UINT* Random)
+{
+	BYTE* Desktop = Device->GetDesktop();
+	UINT Pitch = Device->GetDesktopPitch();
+
+	DXGI_OUTDUPL_MOVE_RECT Move;
+	UINT MoveCount = 0;
+	if (TestRandom(Random) % 3 == 0)
+	{
+		static BYTE Scratch[TEST_PITCH * 2 * TEST_HEIGHT];
+		INT Width = 1 + TestRandom(Random) % (TEST_WIDTH / 2);
+		INT Height = 1 + TestRandom(Random) % (TEST_HEIGHT / 2);
+		Move.SourcePoint.x = TestRandom(Random) % (TEST_WIDTH - Width + 1);
+		Move.SourcePoint.y = TestRandom(Random) % (TEST_HEIGHT - Height + 1);
+		SetRect(&Move.DestinationRect, TestRandom(Random) % (TEST_WIDTH - Width + 1), TestRandom(Random) % (TEST_HEIGHT - Height + 1), 0, 0);
+		Move.DestinationRect.right = Move.DestinationRect.left + Width;
+		Move.DestinationRect.bottom = Move.DestinationRect.top + Height;
+		if (Pitch * TEST_HEIGHT > sizeof(Scratch))
+		{
+			return false;
+		}
+		memcpy_s(Scratch, sizeof(Scratch), Desktop, Pitch * TEST_HEIGHT);
+		for (INT y = 0; y < Height; ++y)
+		{
+			memcpy_s(Desktop + (Move.DestinationRect.top + y) * Pitch + Move.DestinationRect.left * BPP, Width * BPP,
+				Scratch + (Move.SourcePoint.y + y) * Pitch + Move.SourcePoint.x * BPP, Width * BPP);
+		}
+		MoveCount = 1;
+	}
+
+	RECT Dirty[3];
+	UINT DirtyCount = 1 + TestRandom(Random) % ARRAYSIZE(Dirty);
+	for (UINT i = 0; i < DirtyCount; ++i)
+	{
+		Dirty[i].left = TestRandom(Random) % TEST_WIDTH;
+		Dirty[i].top = TestRandom(Random) % TEST_HEIGHT;
+		Dirty[i].right = Dirty[i].left + 1 + TestRandom(Random) % (TEST_WIDTH - Dirty[i].left);
+		Dirty[i].bottom = Dirty[i].top + 1 + TestRandom(Random) % (TEST_HEIGHT - Dirty[i].top);
+		UINT Color = TestRandom(Random);
+		for (LONG y = Dirty[i].top; y < Dirty[i].bottom; ++y)
+		{
+			UINT* Row = reinterpret_cast<UINT*>(Desktop + y * Pitch);
+			for (LONG x = Dirty[i].left; x < Dirty[i].right; ++x)
+			{
+				Row[x] = Color ^ (x * 0x101);
+			}
+		}
+	}
+
+	return Device->PresentFrame(&Move, MoveCount, Dirty, DirtyCount);
+}
+
+//
+// Record a CPU duplication with dirty rect readback, keeping what each frame should look like
+//
+static void RecordDuplication(bool Compress)
+{
+	CPUDUPLICATIONDEVICE Device;
+	DUPLICATIONMANAGER Manager(&Device);
+	REQUIRE(Device.Init(TEST_WIDTH, TEST_HEIGHT, DXGI_MODE_ROTATION_IDENTITY, TEST_QUEUE));
+	Manager.SetDirtyRectReadback(true);
+	REQUIRE(Manager.InitDupl(stderr, 0) == DUPL_RETURN_SUCCESS);
+
+	BYTE* Image = new BYTE[Manager.GetImageBufferSize()];
+	FRAMERECORDER Recorder;
+	Recorder.SetCompression(Compress);
+	if (Recorder.Open(stderr, &Manager, TEST_RECORDING) != DUPL_RETURN_SUCCESS)
+	{
+		delete [] Image;
+		REQUIRE(false);
+	}
+
+	UINT Random = Compress ? 3 : 4;
+	FillTestImage(Device.GetDesktop(), TEST_WIDTH, TEST_HEIGHT, Device.GetDesktopPitch(), 1);
+	RECT Whole = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	Device.PresentFrame(nullptr, 0, &Whole, 1);
+
+	for (UINT Frame = 0; Frame < TEST_FRAMES; ++Frame)
+	{
+		if (Frame)
+		{
+			CHECK(PresentRandomFrame(&Device, &Random));
+		}
+
+		// The frame goes into the ring, a timeout later it is read back
+		bool Timeout = true;
+		for (UINT Try = 0; Try < 2 && Timeout; ++Try)
+		{
+			CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recorder.GetFrame(Image, &Timeout, 0));
+		}
+		CHECK(!Timeout);
+
+		const FRAME_METADATA* Meta = Recorder.GetFrameMetaData();
+		ExpectedMoves[Frame] = (Meta && !Meta->FullCopy) ? Meta->MoveCount : 0;
+		ExpectedDirty[Frame] = (Meta && !Meta->FullCopy) ? Meta->DirtyCount : 0;
+		for (UINT y = 0; y < TEST_HEIGHT; ++y)
+		{
+			memcpy_s(Expected[Frame] + y * TEST_PITCH, TEST_PITCH, Device.GetDesktop() + y * Device.GetDesktopPitch(), TEST_PITCH);
+		}
+	}
+
+	CHECK_EQUAL(TEST_FRAMES, Recorder.GetFrameCount());
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Recorder.Close());
+	delete [] Image;
+}
+
+//
+// As fast as asked for, every recorded frame comes back as it was captured, rects and all,
+// and the end of the recording is reported as an expected error
+//
+static void CheckReplayMatches()
+{
+	FAKECLOCK Clock;
+	FRAMEREPLAYER Replayer;
+	REQUIRE(Replayer.Open(stderr, TEST_RECORDING, 0, &Clock) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Replayer.GetImageBufferSize() == TEST_PITCH * TEST_HEIGHT);
+
+	BYTE* Image = new BYTE[Replayer.GetImageBufferSize()];
+	memset(Image, 0, Replayer.GetImageBufferSize());
+	UINT64 Start = Clock.GetTicks();
+	for (UINT Frame = 0; Frame < TEST_FRAMES; ++Frame)
+	{
+		bool Timeout;
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 0));
+		CHECK(!Timeout);
+		CHECK_EQUAL(0, CountMismatches(Image, TEST_PITCH, Expected[Frame]));
+
+		const FRAME_METADATA* Meta = Replayer.GetFrameMetaData();
+		if (Meta)
+		{
+			CHECK_EQUAL(Frame == 0 || (!ExpectedMoves[Frame] && !ExpectedDirty[Frame]), Meta->FullCopy);
+			CHECK_EQUAL(ExpectedMoves[Frame], Meta->MoveCount);
+			CHECK_EQUAL(ExpectedDirty[Frame], Meta->DirtyCount);
+		}
+		else
+		{
+			++TestFailures;
+		}
+	}
+	CHECK_EQUAL(Start, Clock.GetTicks());
+
+	bool Timeout;
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Replayer.GetFrame(Image, &Timeout, 0));
+	CHECK(Timeout);
+	delete [] Image;
+}
+
+static void TestRoundTripRaw()
+{
+	RecordDuplication(false);
+	CheckReplayMatches();
+	DeleteFileA(TEST_RECORDING);
+}
+
+static void TestRoundTripCompressed()
+{
+	RecordDuplication(true);
+	CheckReplayMatches();
+	DeleteFileA(TEST_RECORDING);
+}
+
+//
+// Append a frame captured Microseconds into the recording, whole or with one dirty rect
+//
+static DUPL_RETURN AppendFrame(_Inout_ RECORDINGWRITER* Writer, UINT Index, LONGLONG Microseconds, UINT Seed, _In_opt_ const RECT* Dirty, bool Repeat)
+{
+	static BYTE Pixels[TEST_PITCH * TEST_HEIGHT];
+	RECORDING_FRAME_INFO Info;
+	RtlZeroMemory(&Info, sizeof(Info));
+	Info.Index = Index;
+	Info.CaptureTime.QuadPart = 5000000 + Microseconds;
+	Info.Frequency.QuadPart = 1000000;
+	if (Repeat)
+	{
+		Info.Flags = RECORDING_FLAG_REPEAT;
+		return Writer->Append(&Info, nullptr, 0, nullptr, 0, Index - 1);
+	}
+
+	Info.Width = TEST_WIDTH;
+	Info.Height = TEST_HEIGHT;
+	Info.Pitch = TEST_PITCH;
+	Info.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	Info.DirtyCount = Dirty ? 1 : 0;
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, Seed);
+	return Writer->Append(&Info, reinterpret_cast<const BYTE*>(Dirty), Dirty ? sizeof(RECT) : 0, Pixels, sizeof(Pixels));
+}
+
+//
+// At twice the recorded speed each frame is due at half its recorded offset from the first.
+// A frame that is not due within the timeout times out after exactly the timeout, and a
+// repeat is consumed without touching the image.
+//
+static void TestReplayTiming()
+{
+	RECORDINGWRITER Writer;
+	REQUIRE(Writer.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 0, 0, 1, nullptr, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 1, 10000, 2, nullptr, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 2, 10000, 3, nullptr, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 3, 40000, 4, nullptr, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 4, 50000, 0, nullptr, true));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 5, 60000, 5, nullptr, false));
+	REQUIRE(Writer.Close() == DUPL_RETURN_SUCCESS);
+
+	FAKECLOCK Clock;
+	FRAMEREPLAYER Replayer;
+	REQUIRE(Replayer.Open(stderr, TEST_RECORDING, 2.0, &Clock) == DUPL_RETURN_SUCCESS);
+	BYTE* Image = new BYTE[Replayer.GetImageBufferSize()];
+	BYTE* Reference = new BYTE[TEST_PITCH * TEST_HEIGHT];
+	UINT64 Start = Clock.GetTicks();
+	bool Timeout;
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 100));
+	CHECK(!Timeout);
+	CHECK_EQUAL(Start, Clock.GetTicks());
+
+	// Due 5 ms in, a 2 ms timeout runs out first
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 2));
+	CHECK(Timeout);
+	CHECK(Replayer.GetFrameMetaData() == nullptr);
+	CHECK_EQUAL(Start + 2000, Clock.GetTicks());
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 100));
+	CHECK(!Timeout);
+	CHECK_EQUAL(Start + 5000, Clock.GetTicks());
+	FillTestImage(Reference, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 2);
+	CHECK_EQUAL(0, CountMismatches(Image, TEST_PITCH, Reference));
+
+	// Captured at the same time, so no wait
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 100));
+	CHECK(!Timeout);
+	CHECK_EQUAL(Start + 5000, Clock.GetTicks());
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 100));
+	CHECK(!Timeout);
+	CHECK_EQUAL(Start + 20000, Clock.GetTicks());
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 100));
+	CHECK(Timeout);
+	CHECK_EQUAL(Start + 25000, Clock.GetTicks());
+	FillTestImage(Reference, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 4);
+	CHECK_EQUAL(0, CountMismatches(Image, TEST_PITCH, Reference));
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 100));
+	CHECK(!Timeout);
+	CHECK_EQUAL(Start + 30000, Clock.GetTicks());
+
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Replayer.GetFrame(Image, &Timeout, 100));
+
+	delete [] Reference;
+	delete [] Image;
+	Replayer.Close();
+	DeleteFileA(TEST_RECORDING);
+}
+
+//
+// Only the recorded dirty rect is written, unless a frame is missing from the recording, when
+// the rects no longer describe the change and the whole frame is copied
+//
+static void TestIndexGapCopiesWholeFrame()
+{
+	RECT Dirty = { 8, 4, 24, 20 };
+	RECORDINGWRITER Writer;
+	REQUIRE(Writer.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 0, 0, 1, nullptr, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 1, 1000, 2, &Dirty, false));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, AppendFrame(&Writer, 3, 3000, 3, &Dirty, false));
+	REQUIRE(Writer.Close() == DUPL_RETURN_SUCCESS);
+
+	FAKECLOCK Clock;
+	FRAMEREPLAYER Replayer;
+	REQUIRE(Replayer.Open(stderr, TEST_RECORDING, 0, &Clock) == DUPL_RETURN_SUCCESS);
+	BYTE* Image = new BYTE[Replayer.GetImageBufferSize()];
+	BYTE* Reference = new BYTE[TEST_PITCH * TEST_HEIGHT];
+	BYTE* Patched = new BYTE[TEST_PITCH * TEST_HEIGHT];
+	bool Timeout;
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 0));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 0));
+	CHECK(!Timeout);
+	const FRAME_METADATA* Meta = Replayer.GetFrameMetaData();
+	CHECK(Meta && !Meta->FullCopy && Meta->DirtyCount == 1);
+	FillTestImage(Patched, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 1);
+	FillTestImage(Reference, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 2);
+	CopyRegions(Patched, TEST_PITCH, Reference, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Dirty, 1);
+	CHECK_EQUAL(0, CountMismatches(Image, TEST_PITCH, Patched));
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Replayer.GetFrame(Image, &Timeout, 0));
+	CHECK(!Timeout);
+	Meta = Replayer.GetFrameMetaData();
+	CHECK(Meta && Meta->FullCopy);
+	FillTestImage(Reference, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 3);
+	CHECK_EQUAL(0, CountMismatches(Image, TEST_PITCH, Reference));
+
+	delete [] Patched;
+	delete [] Reference;
+	delete [] Image;
+	Replayer.Close();
+	DeleteFileA(TEST_RECORDING);
+}
+
+int main()
+{
+	RUN_TEST(TestRoundTripRaw);
+	RUN_TEST(TestRoundTripCompressed);
+	RUN_TEST(TestReplayTiming);
+	RUN_TEST(TestIndexGapCopiesWholeFrame);
+	return TEST_RESULT();
+}
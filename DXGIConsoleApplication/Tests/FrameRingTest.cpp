@@ -0,0 +1,378 @@
+// FrameRingTest.cpp : Order, skipping and buffer accounting of the frame ring, and a stress run of
+// one producer against consumers that read every frame and the newest one.
+//
+
+#include "TestCommon.h"
+#include "FrameRing.h"
+
+#define TEST_WIDTH          16
+#define TEST_HEIGHT         8
+#define TEST_PITCH          (TEST_WIDTH * BPP + 16)
+#define TEST_SIZE           4
+#define TEST_STRESS_FRAMES  20000
+#define TEST_WAIT_MS        5000
+
+static BYTE Pixels[TEST_PITCH * TEST_HEIGHT];
+static IMAGE_VIEW View = { Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+
+//
+// The ring holds frames packed, every pixel of frame Index is derived from Index
+//
+static UINT PixelOf(UINT Index, UINT x, UINT y)
+{
+	return (Index * 0x9E3779B1) ^ (y * TEST_WIDTH + x);
+}
+
+static void DrawFrame(UINT Index)
+{
+	for (UINT y = 0; y < TEST_HEIGHT; ++y)
+	{
+		for (UINT x = 0; x < TEST_WIDTH; ++x)
+		{
+			reinterpret_cast<UINT*>(Pixels + y * TEST_PITCH)[x] = PixelOf(Index, x, y);
+		}
+	}
+}
+
+static bool FrameIntact(_In_ const RING_FRAME* Frame)
+{
+	if (Frame->Image.Width != TEST_WIDTH || Frame->Image.Height != TEST_HEIGHT || Frame->Image.Pitch != TEST_WIDTH * BPP)
+	{
+		return false;
+	}
+	for (UINT y = 0; y < TEST_HEIGHT; ++y)
+	{
+		for (UINT x = 0; x < TEST_WIDTH; ++x)
+		{
+			if (reinterpret_cast<const UINT*>(Frame->Image.Data + y * Frame->Image.Pitch)[x] != PixelOf(Frame->Index, x, y))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static DUPL_RETURN PublishFrame(_In_ FRAMERING* Ring, UINT Index, _In_opt_ const FRAME_METADATA* Meta)
+{
+	DrawFrame(Index);
+	return Ring->Publish(&View, Index, Meta);
+}
+
+//
+// Frames come out in order with their index and pixels, the changed bounds of their rects, and
+// metadata for incremental sinks that asks for a whole copy after a gap
+//
+static void TestReadsInOrder()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * BPP * TEST_HEIGHT, 0, TEST_SIZE + 2, 0) == DUPL_RETURN_SUCCESS);
+	FRAMERING Ring;
+	REQUIRE(Ring.Init(stderr, &Pool, TEST_SIZE) == DUPL_RETURN_SUCCESS);
+	UINT Consumer;
+	REQUIRE(Ring.AddConsumer(&Consumer) == DUPL_RETURN_SUCCESS);
+
+	RING_FRAME* Frame;
+	bool Timeout = false;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Ring.Read(Consumer, &Frame, &Timeout, 0));
+	CHECK(Timeout && !Frame);
+	CHECK(!Ring.ReadLatest(&Frame));
+
+	// A move and two dirty rects
+	BYTE MetaData[sizeof(DXGI_OUTDUPL_MOVE_RECT) + 2 * sizeof(RECT)];
+	DXGI_OUTDUPL_MOVE_RECT Move;
+	RtlZeroMemory(&Move, sizeof(Move));
+	SetRect(&Move.DestinationRect, 4, 2, 6, 3);
+	RECT Dirty[2] = { { 1, 5, 2, 6 }, { 10, 1, 12, 2 } };
+	memcpy(MetaData, &Move, sizeof(Move));
+	memcpy(MetaData + sizeof(Move), Dirty, sizeof(Dirty));
+	FRAME_METADATA Meta;
+	RtlZeroMemory(&Meta, sizeof(Meta));
+	Meta.MetaData = MetaData;
+	Meta.MetaDataSize = sizeof(MetaData);
+	Meta.MoveCount = 1;
+	Meta.DirtyCount = 2;
+	Meta.AcquireTime.QuadPart = 1234;
+
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, 10, &Meta));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, 11, &Meta));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, 12, nullptr));
+
+	RECT Whole = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	RECT Bounds = { 1, 1, 12, 6 };
+	const RECT* Expected[] = { &Whole, &Bounds, &Whole };
+	for (UINT i = 0; i < 3; ++i)
+	{
+		REQUIRE(Ring.Read(Consumer, &Frame, &Timeout, 0) == DUPL_RETURN_SUCCESS && !Timeout);
+		CHECK_EQUAL(i + 1, Frame->Sequence);
+		CHECK_EQUAL(10 + i, Frame->Index);
+		CHECK(FrameIntact(Frame));
+		CHECK(EqualRect(&Frame->Changed, Expected[i]));
+		CHECK_EQUAL((i < 2) ? 1234 : Frame->PublishTime.QuadPart, Frame->CaptureTime.QuadPart);
+
+		FRAME_METADATA RingMeta;
+		GetRingFrameMetaData(Frame, i, &RingMeta);
+		CHECK(!RingMeta.FullCopy);
+		CHECK_EQUAL(1, RingMeta.DirtyCount);
+		CHECK(EqualRect(reinterpret_cast<const RECT*>(RingMeta.MetaData), Expected[i]));
+		GetRingFrameMetaData(Frame, 0, &RingMeta);
+		CHECK_EQUAL(i != 0, RingMeta.FullCopy);
+		Ring.Release(Frame);
+	}
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Ring.Read(Consumer, &Frame, &Timeout, 0));
+	CHECK(Timeout);
+
+	FRAMERING_STATS Stats;
+	Ring.GetStats(&Stats);
+	CHECK_EQUAL(3, Stats.Published);
+	CHECK_EQUAL(3, Stats.Entries);
+	CHECK_EQUAL(3, Stats.Read[0]);
+	CHECK_EQUAL(0, Stats.Dropped[0]);
+}
+
+//
+// A consumer that fell behind gets the last TEST_SIZE frames and counts the rest as dropped,
+// ReadLatest gets the newest one
+//
+static void TestSlowConsumerSkips()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * BPP * TEST_HEIGHT, 0, TEST_SIZE + 2, 0) == DUPL_RETURN_SUCCESS);
+	FRAMERING Ring;
+	REQUIRE(Ring.Init(stderr, &Pool, TEST_SIZE) == DUPL_RETURN_SUCCESS);
+	UINT Consumer;
+	REQUIRE(Ring.AddConsumer(&Consumer) == DUPL_RETURN_SUCCESS);
+
+	for (UINT i = 1; i <= 10; ++i)
+	{
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, i, nullptr));
+	}
+
+	RING_FRAME* Latest;
+	REQUIRE(Ring.ReadLatest(&Latest));
+	CHECK_EQUAL(10, Latest->Index);
+	CHECK(FrameIntact(Latest));
+
+	RING_FRAME* Frame;
+	bool Timeout;
+	for (UINT i = 11 - TEST_SIZE; i <= 10; ++i)
+	{
+		REQUIRE(Ring.Read(Consumer, &Frame, &Timeout, 0) == DUPL_RETURN_SUCCESS && !Timeout);
+		CHECK_EQUAL(i, Frame->Index);
+		CHECK(FrameIntact(Frame));
+		Ring.Release(Frame);
+	}
+	Ring.Release(Latest);
+
+	FRAMERING_STATS Stats;
+	Ring.GetStats(&Stats);
+	CHECK_EQUAL(TEST_SIZE, Stats.Read[0]);
+	CHECK_EQUAL(10 - TEST_SIZE, Stats.Dropped[0]);
+	CHECK_EQUAL(TEST_SIZE + 1, Stats.Entries);
+	CHECK_EQUAL(0, Stats.Failed);
+
+	// A consumer added now starts with the next frame
+	UINT Late;
+	REQUIRE(Ring.AddConsumer(&Late) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Ring.Read(Late, &Frame, &Timeout, 0));
+	CHECK(Timeout);
+}
+
+//
+// A frame a consumer holds keeps its pixels while the ring goes on. With every pool buffer in
+// use the frame is not published, and the next one counts as changed everywhere.
+//
+static void TestHeldFramesAndPoolExhaustion()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * BPP * TEST_HEIGHT, 0, TEST_SIZE + 1, 0) == DUPL_RETURN_SUCCESS);
+	FRAMERING Ring;
+	REQUIRE(Ring.Init(stderr, &Pool, TEST_SIZE) == DUPL_RETURN_SUCCESS);
+	UINT Consumer;
+	REQUIRE(Ring.AddConsumer(&Consumer) == DUPL_RETURN_SUCCESS);
+
+	RING_FRAME* Held;
+	bool Timeout;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, 1, nullptr));
+	REQUIRE(Ring.Read(Consumer, &Held, &Timeout, 0) == DUPL_RETURN_SUCCESS && !Timeout);
+
+	// Slots and the held frame take every buffer after TEST_SIZE more frames
+	for (UINT i = 2; i <= TEST_SIZE + 1; ++i)
+	{
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, i, nullptr));
+	}
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, PublishFrame(&Ring, 100, nullptr));
+	CHECK_EQUAL(1, Held->Index);
+	CHECK(FrameIntact(Held));
+
+	// Only a small rect changed, but the frame before it was lost
+	Ring.Release(Held);
+	RECT Dirty = { 0, 0, 1, 1 };
+	FRAME_METADATA Meta;
+	RtlZeroMemory(&Meta, sizeof(Meta));
+	Meta.MetaData = reinterpret_cast<BYTE*>(&Dirty);
+	Meta.MetaDataSize = sizeof(Dirty);
+	Meta.DirtyCount = 1;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, PublishFrame(&Ring, 101, &Meta));
+	RING_FRAME* Frame;
+	REQUIRE(Ring.ReadLatest(&Frame));
+	CHECK_EQUAL(101, Frame->Index);
+	RECT Whole = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	CHECK(EqualRect(&Frame->Changed, &Whole));
+	Ring.Release(Frame);
+
+	FRAMERING_STATS Stats;
+	Ring.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Failed);
+	CHECK_EQUAL(TEST_SIZE + 2, Stats.Published);
+	CHECK_EQUAL(TEST_SIZE + 1, Stats.Entries);
+
+	// Frames larger than the pool's buffers are refused
+	IMAGE_VIEW Large = View;
+	Large.Height = TEST_HEIGHT + 1;
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Ring.Publish(&Large, 102, nullptr));
+
+	UINT Consumers[FRAMERING_MAX_CONSUMERS];
+	for (UINT i = 1; i < FRAMERING_MAX_CONSUMERS; ++i)
+	{
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Ring.AddConsumer(&Consumers[i]));
+	}
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Ring.AddConsumer(&Consumers[0]));
+}
+
+typedef struct _TEST_CONSUMER
+{
+	FRAMERING* Ring;
+	UINT Consumer;
+	bool Latest;                // ReadLatest until the ring stops instead of Read
+	volatile LONG* Stopped;
+	UINT Frames;
+	UINT Errors;                // Torn frames and frames out of order
+	DUPL_RETURN Result;
+} TEST_CONSUMER;
+
+static DWORD WINAPI ConsumerProc(_In_ void* Param)
+{
+	TEST_CONSUMER* Test = reinterpret_cast<TEST_CONSUMER*>(Param);
+	LONGLONG Last = 0;
+	UINT Random = Test->Consumer + 1;
+	for (;;)
+	{
+		RING_FRAME* Frame = nullptr;
+		if (Test->Latest)
+		{
+			if (ReadAcquire(Test->Stopped))
+			{
+				break;
+			}
+			if (!Test->Ring->ReadLatest(&Frame))
+			{
+				SwitchToThread();
+				continue;
+			}
+		}
+		else
+		{
+			bool Timeout;
+			Test->Result = Test->Ring->Read(Test->Consumer, &Frame, &Timeout, INFINITE);
+			if (Test->Result != DUPL_RETURN_SUCCESS)
+			{
+				break;
+			}
+			if (Timeout)
+			{
+				continue;
+			}
+		}
+
+		// Newest frames may be read again, frames in order may not
+		bool InOrder = Test->Latest ? (Frame->Sequence >= Last) : (Frame->Sequence > Last);
+		Test->Errors += (InOrder && Frame->Index + 1 == static_cast<UINT>(Frame->Sequence)) ? 0 : 1;
+		Last = Frame->Sequence;
+
+		// Hold some frames while the producer laps the ring
+		if (TestRandom(&Random) % 16 == 0)
+		{
+			SwitchToThread();
+		}
+		Test->Errors += FrameIntact(Frame) ? 0 : 1;
+		Test->Ring->Release(Frame);
+		++Test->Frames;
+	}
+	return 0;
+}
+
+//
+// One producer, two consumers reading every frame and one reading the newest. No frame a
+// consumer holds is ever torn or recycled, every consumer sees the frames in order, reads or
+// drops each of them, and a pool sized as FRAMERING asks for never runs out.
+//
+static void TestStress()
+{
+	const UINT Consumers = 3;
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * BPP * TEST_HEIGHT, 0, TEST_SIZE + Consumers + 1, 0) == DUPL_RETURN_SUCCESS);
+	FRAMERING Ring;
+	REQUIRE(Ring.Init(stderr, &Pool, TEST_SIZE) == DUPL_RETURN_SUCCESS);
+
+	volatile LONG Stopped = 0;
+	TEST_CONSUMER Tests[Consumers];
+	HANDLE Threads[Consumers];
+	for (UINT i = 0; i < Consumers; ++i)
+	{
+		RtlZeroMemory(&Tests[i], sizeof(TEST_CONSUMER));
+		Tests[i].Ring = &Ring;
+		Tests[i].Latest = (i == Consumers - 1);
+		Tests[i].Stopped = &Stopped;
+		if (!Tests[i].Latest)
+		{
+			REQUIRE(Ring.AddConsumer(&Tests[i].Consumer) == DUPL_RETURN_SUCCESS);
+		}
+		Threads[i] = CreateThread(nullptr, 0, ConsumerProc, &Tests[i], 0, nullptr);
+		REQUIRE(Threads[i] != nullptr);
+	}
+
+	UINT Failed = 0;
+	for (UINT i = 0; i < TEST_STRESS_FRAMES; ++i)
+	{
+		Failed += (PublishFrame(&Ring, i, nullptr) == DUPL_RETURN_SUCCESS) ? 0 : 1;
+		if (i % 64 == 0)
+		{
+			SwitchToThread();
+		}
+	}
+	Ring.Stop();
+	InterlockedExchange(&Stopped, 1);
+	for (UINT i = 0; i < Consumers; ++i)
+	{
+		CHECK_EQUAL(WAIT_OBJECT_0, WaitForSingleObject(Threads[i], TEST_WAIT_MS));
+		CloseHandle(Threads[i]);
+	}
+	CHECK_EQUAL(0, Failed);
+
+	FRAMERING_STATS Stats;
+	Ring.GetStats(&Stats);
+	CHECK_EQUAL(TEST_STRESS_FRAMES, Stats.Published);
+	CHECK(Stats.Entries <= TEST_SIZE + Consumers + 1);
+	for (UINT i = 0; i < Consumers; ++i)
+	{
+		CHECK_EQUAL(0, Tests[i].Errors);
+		if (!Tests[i].Latest)
+		{
+			CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Tests[i].Result);
+			CHECK_EQUAL(Tests[i].Frames, Stats.Read[Tests[i].Consumer]);
+			CHECK_EQUAL(TEST_STRESS_FRAMES, Stats.Read[Tests[i].Consumer] + Stats.Dropped[Tests[i].Consumer]);
+		}
+	}
+	fprintf(stderr, "Consumers read %u and %u frames of %u, the newest frame was read %u times.\n",
+		Tests[0].Frames, Tests[1].Frames, TEST_STRESS_FRAMES, Tests[2].Frames);
+}
+
+int main()
+{
+	RUN_TEST(TestReadsInOrder);
+	RUN_TEST(TestSlowConsumerSkips);
+	RUN_TEST(TestHeldFramesAndPoolExhaustion);
+	RUN_TEST(TestStress);
+	return TEST_RESULT();
+}
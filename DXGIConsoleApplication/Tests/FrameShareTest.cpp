@@ -0,0 +1,549 @@
+// FrameShareTest.cpp : Shared frames read back against the published images, the reader wakeup
+// and entry protocol, a reader in another process, and the named objects underneath.
+//
+// Run with -read <name> <frames> the test is the reader process of TestOtherProcess.
+//
+
+#include "TestCommon.h"
+#include "FrameShare.h"
+
+#define TEST_WIDTH          48
+#define TEST_HEIGHT         24
+#define TEST_PITCH          (TEST_WIDTH * BPP + 32)
+#define TEST_SLOT_SIZE      (TEST_WIDTH * BPP * TEST_HEIGHT)
+#define TEST_SLOTS          4
+#define TEST_FRAMES         200
+#define TEST_PROCESS_FRAMES 500
+#define TEST_WAIT_MS        10000
+
+// No process has this id, pid_max is at most 2^22
+#define TEST_DEAD_PROCESS   0x7FFFFFF0
+
+static UINT NameCount = 0;
+
+static void GetTestName(_Out_ char (&Name)[MAX_PATH])
+{
+	sprintf_s(Name, "FrameShareTest.%u.%u", GetCurrentProcessId(), ++NameCount);
+}
+
+//
+// Frame Index of TestOtherProcess, its reader checks every pixel against this
+//
+static void DrawProcessFrame(_Out_writes_bytes_(TEST_PITCH * TEST_HEIGHT) BYTE* Data, UINT Index)
+{
+	FillTestImage(Data, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, Index);
+}
+
+static void FillRect(_Inout_ BYTE* Data, UINT Pitch, _In_ const RECT* Rect, UINT Seed)
+{
+	for (LONG y = Rect->top; y < Rect->bottom; ++y)
+	{
+		for (LONG x = Rect->left; x < Rect->right; ++x)
+		{
+			reinterpret_cast<UINT*>(Data + y * Pitch)[x] = (Seed * 0x01000193) ^ (y << 12) ^ x;
+		}
+	}
+}
+
+static void RandomRect(_Inout_ UINT* Random, UINT Width, UINT Height, _Out_ RECT* Rect)
+{
+	Rect->left = TestRandom(Random) % Width;
+	Rect->top = TestRandom(Random) % Height;
+	Rect->right = Rect->left + 1 + TestRandom(Random) % (Width - Rect->left);
+	Rect->bottom = Rect->top + 1 + TestRandom(Random) % (Height - Rect->top);
+}
+
+//
+// Named events and sections are shared by name until the last handle is closed, opening one as
+// another kind of object fails, and processes can be waited for
+//
+static void TestNamedObjects()
+{
+	char Name[MAX_PATH];
+	GetTestName(Name);
+
+	HANDLE Event = CreateEventA(nullptr, FALSE, FALSE, Name);
+	REQUIRE(Event != nullptr);
+	CHECK_EQUAL(ERROR_SUCCESS, GetLastError());
+	HANDLE Same = CreateEventA(nullptr, TRUE, TRUE, Name);
+	REQUIRE(Same != nullptr);
+	CHECK_EQUAL(ERROR_ALREADY_EXISTS, GetLastError());
+
+	// The event keeps the reset mode and state it was created with
+	CHECK_EQUAL(WAIT_TIMEOUT, WaitForSingleObject(Same, 0));
+	CHECK(SetEvent(Same));
+	CHECK_EQUAL(WAIT_OBJECT_0, WaitForSingleObject(Event, 0));
+	CHECK_EQUAL(WAIT_TIMEOUT, WaitForSingleObject(Same, 10));
+	HANDLE Opened = OpenEventA(EVENT_MODIFY_STATE, FALSE, Name);
+	REQUIRE(Opened != nullptr);
+	CHECK(SetEvent(Opened));
+	CHECK(ResetEvent(Event));
+	CHECK_EQUAL(WAIT_TIMEOUT, WaitForSingleObject(Same, 0));
+	CloseHandle(Opened);
+	CloseHandle(Same);
+	CloseHandle(Event);
+	CHECK(OpenEventA(EVENT_MODIFY_STATE, FALSE, Name) == nullptr);
+	CHECK_EQUAL(ERROR_FILE_NOT_FOUND, GetLastError());
+
+	HANDLE Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, 3 * 4096 + 100, Name);
+	REQUIRE(Mapping != nullptr);
+	CHECK_EQUAL(ERROR_SUCCESS, GetLastError());
+	HANDLE Other = OpenFileMappingA(FILE_MAP_READ, FALSE, Name);
+	REQUIRE(Other != nullptr);
+	CHECK(CreateEventA(nullptr, FALSE, FALSE, Name) == nullptr);
+	CHECK_EQUAL(ERROR_INVALID_HANDLE, GetLastError());
+	HANDLE Existing = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, 100, Name);
+	CHECK_EQUAL(ERROR_ALREADY_EXISTS, GetLastError());
+	CloseHandle(Existing);
+
+	// Read only handles give no writable views
+	CHECK(MapViewOfFile(Other, FILE_MAP_WRITE, 0, 0, 0) == nullptr);
+	BYTE* Written = reinterpret_cast<BYTE*>(MapViewOfFile(Mapping, FILE_MAP_WRITE, 0, 0, 0));
+	const BYTE* Read = reinterpret_cast<const BYTE*>(MapViewOfFile(Other, FILE_MAP_READ, 0, 4096, 0));
+	REQUIRE(Written && Read);
+	CHECK_EQUAL(0, Read[0]);
+	Written[4096] = 0x5A;
+	Written[3 * 4096 + 99] = 0xA5;
+	CHECK_EQUAL(0x5A, Read[0]);
+	CHECK_EQUAL(0xA5, Read[2 * 4096 + 99]);
+	UnmapViewOfFile(Read);
+	UnmapViewOfFile(Written);
+	CloseHandle(Mapping);
+	CloseHandle(Other);
+	CHECK(OpenFileMappingA(FILE_MAP_READ, FALSE, Name) == nullptr);
+	CHECK_EQUAL(ERROR_FILE_NOT_FOUND, GetLastError());
+
+	HANDLE Self = OpenProcess(SYNCHRONIZE, FALSE, GetCurrentProcessId());
+	REQUIRE(Self != nullptr);
+	CHECK_EQUAL(WAIT_TIMEOUT, WaitForSingleObject(Self, 0));
+	CloseHandle(Self);
+	CHECK(OpenProcess(SYNCHRONIZE, FALSE, TEST_DEAD_PROCESS) == nullptr);
+	CHECK_EQUAL(ERROR_INVALID_PARAMETER, GetLastError());
+}
+
+//
+// Publish frames that change under random move and dirty rects, wholesale and at two sizes,
+// and read every frame still in the ring back after each one. Each slot is only brought up to
+// date with what changed since it was written, so a missed rect shows up in a later frame.
+//
+static void TestFramesReadBack()
+{
+	char Name[MAX_PATH];
+	GetTestName(Name);
+	FRAMESHARE Share;
+	REQUIRE(Share.Init(stderr, Name, TEST_SLOT_SIZE, TEST_SLOTS) == DUPL_RETURN_SUCCESS);
+	FRAMESHAREREADER Reader;
+	REQUIRE(Reader.Attach(stderr, Name) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(1, Share.GetReaderCount());
+	CHECK_EQUAL(0, Reader.GetHead());
+
+	BYTE* Source = new BYTE[TEST_PITCH * TEST_HEIGHT];
+	BYTE* History = new BYTE[TEST_SLOTS * TEST_SLOT_SIZE];
+	BYTE* Buffer = new BYTE[TEST_SLOT_SIZE];
+	UINT HistoryWidth[TEST_SLOTS];
+	UINT HistoryHeight[TEST_SLOTS];
+	BYTE MetaData[sizeof(DXGI_OUTDUPL_MOVE_RECT) + 2 * FRAMESHARE_MAX_DIRTY_RECTS * sizeof(RECT)];
+	RECT Rects[2 * FRAMESHARE_MAX_DIRTY_RECTS];
+	UINT Random = 24;
+	UINT64 FullBytes = 0;
+
+	// Slots that missed a whole frame are copied whole the next time they are written
+	bool StaleAll[TEST_SLOTS];
+	for (UINT i = 0; i < TEST_SLOTS; ++i)
+	{
+		StaleAll[i] = true;
+	}
+
+	for (UINT i = 0; i < TEST_FRAMES; ++i)
+	{
+		// Half the size for a while, a mode change makes every slot stale
+		UINT Width = (i >= 80 && i < 120) ? TEST_WIDTH / 2 : TEST_WIDTH;
+		UINT Height = (i >= 80 && i < 120) ? TEST_HEIGHT / 2 : TEST_HEIGHT;
+		bool SizeChanged = (i == 0 || i == 80 || i == 120);
+		UINT Kind = TestRandom(&Random) % 32;
+
+		FRAME_METADATA Meta;
+		RtlZeroMemory(&Meta, sizeof(Meta));
+		Meta.AcquireTime.QuadPart = 1000 + i;
+		UINT RectCount = 0;
+		bool HasMeta = (Kind != 0);
+		if (SizeChanged || Kind <= 1)
+		{
+			// No metadata, or metadata that asks for a whole copy
+			FillTestImage(Source, Width, Height, TEST_PITCH, i);
+			Meta.FullCopy = true;
+		}
+		else
+		{
+			RectCount = (Kind == 2) ? FRAMESHARE_MAX_DIRTY_RECTS + 6 : 1 + TestRandom(&Random) % 4;
+			for (UINT r = 0; r < RectCount; ++r)
+			{
+				RandomRect(&Random, Width, Height, &Rects[r]);
+				FillRect(Source, TEST_PITCH, &Rects[r], i * 8 + r);
+			}
+
+			// The first rect is the destination of a move, the image has it applied already
+			Meta.MoveCount = 1;
+			Meta.DirtyCount = RectCount - 1;
+			DXGI_OUTDUPL_MOVE_RECT Move;
+			RtlZeroMemory(&Move, sizeof(Move));
+			Move.DestinationRect = Rects[0];
+			memcpy(MetaData, &Move, sizeof(Move));
+			memcpy(MetaData + sizeof(Move), &Rects[1], Meta.DirtyCount * sizeof(RECT));
+			Meta.MetaData = MetaData;
+			Meta.MetaDataSize = sizeof(Move) + Meta.DirtyCount * sizeof(RECT);
+		}
+
+		IMAGE_VIEW View = { Source, Width, Height, TEST_PITCH, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+		FRAMESHARE_STATS Before;
+		Share.GetStats(&Before);
+		REQUIRE(Share.Publish(&View, 100 + i, HasMeta ? &Meta : nullptr) == DUPL_RETURN_SUCCESS);
+		FRAMESHARE_STATS After;
+		Share.GetStats(&After);
+		UINT Slot = i % TEST_SLOTS;
+		bool Whole = !HasMeta || Meta.FullCopy || SizeChanged;
+		bool CopiedWhole = Whole || StaleAll[Slot];
+		CHECK_EQUAL(CopiedWhole ? 1 : 0, After.FullFrames - Before.FullFrames);
+		if (CopiedWhole)
+		{
+			FullBytes += Width * BPP * Height;
+		}
+		for (UINT s = 0; s < TEST_SLOTS; ++s)
+		{
+			StaleAll[s] = (s != Slot) && (StaleAll[s] || Whole);
+		}
+		for (UINT y = 0; y < Height; ++y)
+		{
+			memcpy(History + Slot * TEST_SLOT_SIZE + y * Width * BPP, Source + y * TEST_PITCH, Width * BPP);
+		}
+		HistoryWidth[Slot] = Width;
+		HistoryHeight[Slot] = Height;
+
+		// The newest frame and its description
+		LONGLONG Head = Reader.GetHead();
+		CHECK_EQUAL(i + 1, Head);
+		FRAMESHARE_VIEW Frame;
+		REQUIRE(Reader.ReadFrame(0, Buffer, TEST_SLOT_SIZE, &Frame) == DUPL_RETURN_SUCCESS);
+		CHECK_EQUAL(Head, Frame.Sequence);
+		CHECK_EQUAL(100 + i, Frame.Frame.Index);
+		CHECK_EQUAL(Width * BPP, Frame.Frame.Pitch);
+		CHECK_EQUAL(HasMeta ? 1000 + i : Frame.Frame.PublishTime.QuadPart, Frame.Frame.CaptureTime.QuadPart);
+		CHECK_EQUAL(Whole, Frame.Frame.FullFrame != FALSE);
+		if (!Whole && RectCount <= FRAMESHARE_MAX_DIRTY_RECTS)
+		{
+			CHECK_EQUAL(RectCount, Frame.Frame.DirtyCount);
+			CHECK(memcmp(Frame.Frame.Dirty, Rects, RectCount * sizeof(RECT)) == 0);
+		}
+		else if (!Whole)
+		{
+			RECT Bounds = Rects[0];
+			for (UINT r = 1; r < RectCount; ++r)
+			{
+				UnionRect(&Bounds, &Bounds, &Rects[r]);
+			}
+			CHECK_EQUAL(1, Frame.Frame.DirtyCount);
+			CHECK(EqualRect(&Frame.Frame.Dirty[0], &Bounds));
+		}
+
+		// Every frame still in the ring is intact
+		for (LONGLONG Sequence = max(1LL, Head - TEST_SLOTS + 1); Sequence <= Head; ++Sequence)
+		{
+			UINT Older = static_cast<UINT>((Sequence - 1) % TEST_SLOTS);
+			REQUIRE(Reader.ReadFrame(Sequence, Buffer, TEST_SLOT_SIZE, &Frame) == DUPL_RETURN_SUCCESS);
+			CHECK_EQUAL(HistoryWidth[Older], Frame.Image.Width);
+			CHECK_EQUAL(HistoryHeight[Older], Frame.Image.Height);
+			if (memcmp(Buffer, History + Older * TEST_SLOT_SIZE, HistoryWidth[Older] * BPP * HistoryHeight[Older]) != 0)
+			{
+				fprintf(stderr, "Frame %lld differs after publishing frame %u.\n", Sequence, i);
+				CHECK(false);
+			}
+		}
+		if (Head > TEST_SLOTS)
+		{
+			CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Reader.ReadFrame(Head - TEST_SLOTS, Buffer, TEST_SLOT_SIZE, &Frame));
+		}
+		CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Reader.ReadFrame(Head + 1, Buffer, TEST_SLOT_SIZE, &Frame));
+	}
+
+	FRAMESHARE_STATS Stats;
+	Share.GetStats(&Stats);
+	CHECK_EQUAL(TEST_FRAMES, Stats.Published);
+	CHECK_EQUAL(0, Stats.Failed);
+	CHECK(Stats.BytesCopied < static_cast<UINT64>(TEST_FRAMES) * TEST_SLOT_SIZE);
+	CHECK(Stats.BytesCopied >= FullBytes);
+	CHECK_EQUAL(Reader.GetHead(), Share.GetSlowestReader());
+
+	// Frames larger than a slot are refused, the next one is copied whole
+	IMAGE_VIEW Large = { Source, TEST_WIDTH, TEST_HEIGHT + 1, TEST_PITCH, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Share.Publish(&Large, 0, nullptr));
+	Share.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Failed);
+
+	// Only one publisher per name
+	FRAMESHARE Second;
+	CHECK_EQUAL(DUPL_RETURN_ERROR_UNEXPECTED, Second.Init(stderr, Name, TEST_SLOT_SIZE, TEST_SLOTS));
+
+	delete [] Source;
+	delete [] History;
+	delete [] Buffer;
+}
+
+typedef struct _TEST_WAITER
+{
+	FRAMESHAREREADER* Reader;
+	LONGLONG After;
+	DUPL_RETURN Result;
+	bool Timeout;
+} TEST_WAITER;
+
+static DWORD WINAPI WaitProc(_In_ void* Param)
+{
+	TEST_WAITER* Waiter = reinterpret_cast<TEST_WAITER*>(Param);
+	Waiter->Result = Waiter->Reader->Wait(Waiter->After, TEST_WAIT_MS, &Waiter->Timeout);
+	return 0;
+}
+
+static DUPL_RETURN WaitInThread(_Inout_ TEST_WAITER* Waiter, _In_opt_ FRAMESHARE* Share, UINT Index)
+{
+	HANDLE Thread = CreateThread(nullptr, 0, WaitProc, Waiter, 0, nullptr);
+	if (!Thread)
+	{
+		return DUPL_RETURN_ERROR_UNEXPECTED;
+	}
+
+	// Give the reader time to go to sleep
+	Sleep(50);
+	if (Share)
+	{
+		BYTE Pixels[TEST_WIDTH * BPP];
+		RtlZeroMemory(Pixels, sizeof(Pixels));
+		IMAGE_VIEW View = { Pixels, TEST_WIDTH, 1, sizeof(Pixels), DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+		Share->Publish(&View, Index, nullptr);
+	}
+	DWORD Result = WaitForSingleObject(Thread, TEST_WAIT_MS);
+	CloseHandle(Thread);
+
+	return (Result == WAIT_OBJECT_0) ? DUPL_RETURN_SUCCESS : DUPL_RETURN_ERROR_UNEXPECTED;
+}
+
+//
+// A reader sleeping in Wait is woken by the next frame and by Close, and times out without them
+//
+static void TestWaitAndClose()
+{
+	char Name[MAX_PATH];
+	GetTestName(Name);
+	FRAMESHARE Share;
+	REQUIRE(Share.Init(stderr, Name, TEST_SLOT_SIZE, TEST_SLOTS) == DUPL_RETURN_SUCCESS);
+	FRAMESHAREREADER Reader;
+	REQUIRE(Reader.Attach(stderr, Name) == DUPL_RETURN_SUCCESS);
+
+	TEST_WAITER Waiter;
+	RtlZeroMemory(&Waiter, sizeof(Waiter));
+	Waiter.Reader = &Reader;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, WaitInThread(&Waiter, &Share, 1));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Waiter.Result);
+	CHECK(!Waiter.Timeout);
+	CHECK_EQUAL(1, Reader.GetHead());
+	FRAMESHARE_STATS Stats;
+	Share.GetStats(&Stats);
+	CHECK_EQUAL(1, Stats.Wakeups);
+
+	// A reader that keeps up costs the publisher no wakeup
+	bool Timeout;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Reader.Wait(0, 0, &Timeout));
+	CHECK(!Timeout);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Reader.Wait(1, 20, &Timeout));
+	CHECK(Timeout);
+
+	Waiter.After = 1;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, WaitInThread(&Waiter, &Share, 2));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Waiter.Result);
+	CHECK(!Waiter.Timeout);
+
+	// Closing wakes the reader, frames published before can still be read
+	Waiter.After = 2;
+	HANDLE Thread = CreateThread(nullptr, 0, WaitProc, &Waiter, 0, nullptr);
+	REQUIRE(Thread != nullptr);
+	Sleep(50);
+	Share.Close();
+	CHECK_EQUAL(WAIT_OBJECT_0, WaitForSingleObject(Thread, TEST_WAIT_MS));
+	CloseHandle(Thread);
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Waiter.Result);
+	BYTE Buffer[TEST_WIDTH * BPP];
+	FRAMESHARE_VIEW Frame;
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Reader.ReadFrame(0, Buffer, sizeof(Buffer), &Frame));
+	CHECK_EQUAL(2, Frame.Frame.Index);
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Reader.Wait(1, 0, &Timeout));
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Reader.Wait(2, 0, &Timeout));
+	Reader.Detach();
+
+	// The name is free once the readers are gone too
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Share.Init(stderr, Name, TEST_SLOT_SIZE, TEST_SLOTS));
+}
+
+//
+// Every reader gets an entry of its own until they run out. Entries of processes that are gone
+// are taken over.
+//
+static void TestReaderEntries()
+{
+	char Name[MAX_PATH];
+	GetTestName(Name);
+	FRAMESHARE Share;
+	REQUIRE(Share.Init(stderr, Name, TEST_SLOT_SIZE, TEST_SLOTS) == DUPL_RETURN_SUCCESS);
+
+	FRAMESHAREREADER Readers[FRAMESHARE_MAX_READERS + 1];
+	for (UINT i = 0; i < FRAMESHARE_MAX_READERS; ++i)
+	{
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Readers[i].Attach(stderr, Name));
+	}
+	CHECK_EQUAL(FRAMESHARE_MAX_READERS, Share.GetReaderCount());
+	CHECK_EQUAL(DUPL_RETURN_ERROR_EXPECTED, Readers[FRAMESHARE_MAX_READERS].Attach(stderr, Name));
+	Readers[3].Detach();
+	CHECK_EQUAL(FRAMESHARE_MAX_READERS - 1, Share.GetReaderCount());
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Readers[FRAMESHARE_MAX_READERS].Attach(stderr, Name));
+
+	// Hand an entry to a process that doesn't exist, as if it exited without detaching
+	HANDLE Mapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, Name);
+	REQUIRE(Mapping != nullptr);
+	FRAMESHARE_HEADER* Header = reinterpret_cast<FRAMESHARE_HEADER*>(MapViewOfFile(Mapping, FILE_MAP_WRITE, 0, 0, sizeof(FRAMESHARE_HEADER)));
+	REQUIRE(Header != nullptr);
+	Readers[5].Detach();
+	CHECK_EQUAL(0, InterlockedCompareExchange(&Header->Readers[5].ProcessId, TEST_DEAD_PROCESS, 0));
+	CHECK_EQUAL(DUPL_RETURN_SUCCESS, Readers[5].Attach(stderr, Name));
+	CHECK_EQUAL(static_cast<LONG>(GetCurrentProcessId()), Header->Readers[5].ProcessId);
+	CHECK_EQUAL(FRAMESHARE_MAX_READERS, Share.GetReaderCount());
+	UnmapViewOfFile(Header);
+	CloseHandle(Mapping);
+}
+
+//
+// Reader process of TestOtherProcess. Reads the frames in order as they come, checking every
+// pixel, and fails if one is wrong or none could be read.
+//
+static int RunReader(_In_z_ const char* Name, UINT Frames)
+{
+	FRAMESHAREREADER Reader;
+	if (Reader.Attach(stderr, Name) != DUPL_RETURN_SUCCESS)
+	{
+		return 2;
+	}
+
+	BYTE* Expected = new BYTE[TEST_PITCH * TEST_HEIGHT];
+	BYTE* Buffer = new BYTE[TEST_SLOT_SIZE];
+	LONGLONG Last = Reader.GetHead();
+	UINT Count = 0;
+	UINT Wrong = 0;
+	bool Timeout;
+	while (Count < Frames && Reader.Wait(Last, TEST_WAIT_MS, &Timeout) == DUPL_RETURN_SUCCESS && !Timeout)
+	{
+		FRAMESHARE_VIEW View;
+		if (Reader.ReadFrame(Last + 1, Buffer, TEST_SLOT_SIZE, &View) != DUPL_RETURN_SUCCESS)
+		{
+			// Overwritten before it was read, go on with the newest
+			Last = Reader.GetHead() - 1;
+			continue;
+		}
+
+		DrawProcessFrame(Expected, View.Frame.Index);
+		for (UINT y = 0; y < TEST_HEIGHT; ++y)
+		{
+			if (memcmp(Buffer + y * TEST_WIDTH * BPP, Expected + y * TEST_PITCH, TEST_WIDTH * BPP) != 0)
+			{
+				++Wrong;
+				break;
+			}
+		}
+		Last = View.Sequence;
+		++Count;
+	}
+	Reader.Detach();
+	delete [] Expected;
+	delete [] Buffer;
+
+	fprintf(stderr, "Reader process read %u frames, %u wrong.\n", Count, Wrong);
+	return (Count && !Wrong) ? 0 : 1;
+}
+
+//
+// This executable started with -read maps the frames, waits for them on the named events and
+// checks them while they are published. Frames are published as fast as possible, so the reader
+// process also reads slots that are being replaced.
+//
+static void TestOtherProcess()
+{
+	char Path[MAX_PATH];
+	REQUIRE(GetModuleFileNameA(nullptr, Path, MAX_PATH) != 0);
+	char Name[MAX_PATH];
+	GetTestName(Name);
+	FRAMESHARE Share;
+	REQUIRE(Share.Init(stderr, Name, TEST_SLOT_SIZE, TEST_SLOTS) == DUPL_RETURN_SUCCESS);
+
+	char CommandLine[3 * MAX_PATH];
+	sprintf_s(CommandLine, "\"%s\" -read %s %u", Path, Name, TEST_PROCESS_FRAMES);
+	STARTUPINFOA Startup;
+	RtlZeroMemory(&Startup, sizeof(Startup));
+	Startup.cb = sizeof(Startup);
+	PROCESS_INFORMATION Process;
+	fflush(stdout);
+	REQUIRE(CreateProcessA(nullptr, CommandLine, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &Startup, &Process));
+	CHECK(Process.dwProcessId != 0);
+
+	ULONGLONG Deadline = GetTickCount64() + TEST_WAIT_MS;
+	while (!Share.GetReaderCount() && GetTickCount64() < Deadline && WaitForSingleObject(Process.hProcess, 1) == WAIT_TIMEOUT)
+	{
+	}
+	CHECK_EQUAL(1, Share.GetReaderCount());
+
+	BYTE* Pixels = new BYTE[TEST_PITCH * TEST_HEIGHT];
+	IMAGE_VIEW View = { Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_MODE_ROTATION_IDENTITY };
+	for (UINT i = 0; i < TEST_PROCESS_FRAMES && WaitForSingleObject(Process.hProcess, 0) == WAIT_TIMEOUT; ++i)
+	{
+		DrawProcessFrame(Pixels, i);
+		CHECK_EQUAL(DUPL_RETURN_SUCCESS, Share.Publish(&View, i, nullptr));
+
+		// Now and then wait until the reader caught up, so it also sleeps on its event
+		if (i % 50 == 49)
+		{
+			while (Share.GetSlowestReader() < static_cast<LONGLONG>(i + 1) && WaitForSingleObject(Process.hProcess, 1) == WAIT_TIMEOUT)
+			{
+			}
+			Sleep(5);
+		}
+	}
+	Share.Close();
+
+	DWORD ExitCode = STILL_ACTIVE;
+	CHECK_EQUAL(WAIT_OBJECT_0, WaitForSingleObject(Process.hProcess, TEST_WAIT_MS));
+	CHECK(GetExitCodeProcess(Process.hProcess, &ExitCode));
+	CHECK_EQUAL(0, ExitCode);
+	CHECK_EQUAL(WAIT_OBJECT_0, WaitForSingleObject(Process.hThread, 0));
+	CloseHandle(Process.hThread);
+	CloseHandle(Process.hProcess);
+	delete [] Pixels;
+
+	// Exit codes of processes that failed come back too
+	sprintf_s(CommandLine, "\"%s\" -read %s.missing 1", Path, Name);
+	REQUIRE(CreateProcessA(nullptr, CommandLine, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &Startup, &Process));
+	CHECK_EQUAL(WAIT_OBJECT_0, WaitForSingleObject(Process.hProcess, TEST_WAIT_MS));
+	CHECK(GetExitCodeProcess(Process.hProcess, &ExitCode));
+	CHECK_EQUAL(2, ExitCode);
+	CloseHandle(Process.hThread);
+	CloseHandle(Process.hProcess);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc >= 4 && strcmp(argv[1], "-read") == 0)
+	{
+		return RunReader(argv[2], static_cast<UINT>(strtoul(argv[3], nullptr, 10)));
+	}
+
+	RUN_TEST(TestNamedObjects);
+	RUN_TEST(TestFramesReadBack);
+	RUN_TEST(TestWaitAndClose);
+	RUN_TEST(TestReaderEntries);
+	RUN_TEST(TestOtherProcess);
+	return TEST_RESULT();
+}
@@ -0,0 +1,400 @@
+// FrameWriterTest.cpp : Queue policies, accounting, per frame completions and the single producer
+// rule of FRAMEWRITER. Every file goes into a directory of its own under the temp path.
+//
+
+#include "TestCommon.h"
+#include "FrameWriter.h"
+
+#define TEST_WIDTH      24
+#define TEST_HEIGHT     10
+#define TEST_PITCH      (TEST_WIDTH * 4 + 32)   // Padded like a mapped staging texture
+#define TEST_RECORDING  "FrameWriterTest.rec"
+
+static BYTE Pixels[TEST_PITCH * TEST_HEIGHT];
+static char TestDirectory[MAX_PATH];
+static char RecordingPath[MAX_PATH];
+
+//
+// Path of Name in the test directory
+//
+static void GetTestPath(_In_z_ const char* Name, _Out_ char (&Path)[MAX_PATH])
+{
+	sprintf_s(Path, "%s/%s", TestDirectory, Name);
+}
+
+static void MakeFrame(_Out_ IMAGE_VIEW* Image, UINT Seed)
+{
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, Seed);
+	Image->Data = Pixels;
+	Image->Width = TEST_WIDTH;
+	Image->Height = TEST_HEIGHT;
+	Image->Pitch = TEST_PITCH;
+	Image->Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	Image->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+}
+
+//
+// Every frame queued under the blocking policy reaches the recording, in any writer order, with its pixels intact
+//
+static void TestBlockingRecordsEveryFrame()
+{
+	const UINT Frames = 200;
+
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * TEST_HEIGHT, 0, 6, 0) == DUPL_RETURN_SUCCESS);
+	RECORDINGWRITER Recording;
+	Recording.SetCompression(false);
+	REQUIRE(Recording.Open(stderr, RecordingPath) == DUPL_RETURN_SUCCESS);
+
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.Init(stderr, 2, 4, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_SUCCESS);
+	Writer.SetRecording(&Recording);
+	IMAGE_VIEW Image;
+	for (UINT i = 0; i < Frames; ++i)
+	{
+		if (i % 5 == 4)
+		{
+			CHECK(Writer.EnqueueRepeat(i) == DUPL_RETURN_SUCCESS);
+			continue;
+		}
+		MakeFrame(&Image, i);
+		CHECK(Writer.Enqueue(&Image, i) == DUPL_RETURN_SUCCESS);
+	}
+	Writer.Shutdown();
+	CHECK(Recording.Close() == DUPL_RETURN_SUCCESS);
+
+	// Every frame completed once, written
+	FRAMEWRITER_COMPLETION Completions[Frames + 1];
+	CHECK_EQUAL(Frames, Writer.GetCompletions(Completions, Frames + 1));
+	bool Completed[Frames] = {};
+	for (UINT i = 0; i < Frames; ++i)
+	{
+		FRAMEWRITER_COMPLETION* Completion = &Completions[i];
+		REQUIRE(Completion->Index < Frames);
+		CHECK(!Completed[Completion->Index]);
+		Completed[Completion->Index] = true;
+		CHECK_EQUAL(FRAMEWRITER_RESULT_WRITTEN, Completion->Result);
+		CHECK_EQUAL(Completion->Index % 5 == 4, Completion->Repeat);
+		CHECK(Completion->WriteTicks >= 0 && Completion->LatencyTicks >= Completion->WriteTicks);
+	}
+	CHECK_EQUAL(0, Writer.GetCompletions(Completions, Frames + 1));
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	CHECK_EQUAL(Frames, Stats.Enqueued);
+	CHECK_EQUAL(Frames / 5, Stats.Repeats);
+	CHECK_EQUAL(Frames, Stats.Written);
+	CHECK_EQUAL(0, Stats.Dropped);
+	CHECK_EQUAL(0, Stats.Failed);
+	CHECK(Stats.MaxQueueDepth <= 2);
+
+	FRAMEPOOL_STATS PoolStats;
+	Pool.GetStats(&PoolStats);
+	CHECK_EQUAL(0, PoolStats.Outstanding);
+
+	RECORDINGREADER Reader;
+	REQUIRE(Reader.Open(stderr, RecordingPath) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(Frames, Reader.GetFrameCount());
+	BYTE Expected[TEST_PITCH * TEST_HEIGHT];
+	for (UINT i = 0; i < Frames; ++i)
+	{
+		UINT Entry;
+		RECORDING_FRAME Frame;
+		REQUIRE(Reader.FindFrame(i, &Entry));
+		REQUIRE(Reader.GetFrame(Entry, &Frame) == DUPL_RETURN_SUCCESS);
+		CHECK_EQUAL((i % 5 == 4) ? RECORDING_FLAG_REPEAT : 0, Frame.Header->Info.Flags & RECORDING_FLAG_REPEAT);
+		if (i % 5 == 4)
+		{
+			// Shows the frame queued with pixels right before it
+			REQUIRE(Frame.DataHeader);
+			CHECK_EQUAL(i - 1, Frame.DataHeader->Info.Index);
+			continue;
+		}
+		FillTestImage(Expected, TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH * 4, i);
+		CHECK_EQUAL(TEST_WIDTH * 4, Frame.DataHeader->Info.Pitch);
+		CHECK(Frame.DataSize == TEST_WIDTH * 4 * TEST_HEIGHT && memcmp(Frame.Data, Expected, Frame.DataSize) == 0);
+	}
+	Reader.Close();
+	DeleteFileA(RecordingPath);
+}
+
+//
+// Under DROP_OLDEST the producer never waits, and every frame is either written or counted as dropped
+//
+static void TestDropOldestAccounting()
+{
+	const UINT Frames = 2000;
+
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * TEST_HEIGHT, 0, 3, 0) == DUPL_RETURN_SUCCESS);
+	RECORDINGWRITER Recording;
+	Recording.SetCompression(false);
+	REQUIRE(Recording.Open(stderr, RecordingPath) == DUPL_RETURN_SUCCESS);
+
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.Init(stderr, 1, 2, &Pool, FRAMEWRITER_POLICY_DROP_OLDEST) == DUPL_RETURN_SUCCESS);
+	Writer.SetRecording(&Recording);
+	IMAGE_VIEW Image;
+	for (UINT i = 0; i < Frames; ++i)
+	{
+		MakeFrame(&Image, i);
+		CHECK(Writer.Enqueue(&Image, i) == DUPL_RETURN_SUCCESS);
+	}
+	Writer.Shutdown();
+	CHECK(Recording.Close() == DUPL_RETURN_SUCCESS);
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Failed);
+	CHECK(Stats.Enqueued <= Frames);
+	CHECK_EQUAL(Frames, Stats.Written + Stats.Dropped);
+
+	// The ring keeps the completions of the last frames, the ones before are counted as lost
+	CHECK_EQUAL(Frames - FRAMEWRITER_COMPLETIONS, Stats.CompletionsLost);
+	FRAMEWRITER_COMPLETION Completions[FRAMEWRITER_COMPLETIONS];
+	CHECK_EQUAL(FRAMEWRITER_COMPLETIONS, Writer.GetCompletions(Completions, FRAMEWRITER_COMPLETIONS));
+	bool LastWritten = false;
+	for (UINT i = 0; i < FRAMEWRITER_COMPLETIONS; ++i)
+	{
+		CHECK(Completions[i].Result == FRAMEWRITER_RESULT_WRITTEN || Completions[i].Result == FRAMEWRITER_RESULT_DROPPED);
+		if (Completions[i].Result == FRAMEWRITER_RESULT_DROPPED)
+		{
+			CHECK_EQUAL(0, Completions[i].LatencyTicks);
+		}
+
+		// Nothing newer pushes the last frame out of the queue
+		if (Completions[i].Index == Frames - 1)
+		{
+			LastWritten = (Completions[i].Result == FRAMEWRITER_RESULT_WRITTEN);
+		}
+	}
+	CHECK(LastWritten);
+
+	FRAMEPOOL_STATS PoolStats;
+	Pool.GetStats(&PoolStats);
+	CHECK_EQUAL(0, PoolStats.Outstanding);
+	CHECK(PoolStats.PeakOutstanding <= 3);
+
+	// Whatever survived is each frame once, with its own pixels
+	RECORDINGREADER Reader;
+	REQUIRE(Reader.Open(stderr, RecordingPath) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(Stats.Written, Reader.GetFrameCount());
+	BYTE Expected[TEST_WIDTH * 4 * TEST_HEIGHT];
+	UINT Previous = 0;
+	for (UINT Entry = 0; Entry < Reader.GetFrameCount(); ++Entry)
+	{
+		RECORDING_FRAME Frame;
+		REQUIRE(Reader.GetFrame(Entry, &Frame) == DUPL_RETURN_SUCCESS);
+		UINT Index = Frame.Header->Info.Index;
+		CHECK(!Entry || Index > Previous);
+		Previous = Index;
+		FillTestImage(Expected, TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH * 4, Index);
+		CHECK(Frame.DataSize == sizeof(Expected) && memcmp(Frame.Data, Expected, sizeof(Expected)) == 0);
+	}
+	Reader.Close();
+	DeleteFileA(RecordingPath);
+}
+
+//
+// Frames too large for the pool buffers are refused without touching the queue
+//
+static void TestOversizedFrameRefused()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * (TEST_HEIGHT - 1), 0, 2, 0) == DUPL_RETURN_SUCCESS);
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.Init(stderr, 2, 1, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_SUCCESS);
+
+	IMAGE_VIEW Image;
+	MakeFrame(&Image, 1);
+	CHECK(Writer.Enqueue(&Image, 1) == DUPL_RETURN_ERROR_UNEXPECTED);
+	Writer.Shutdown();
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	CHECK_EQUAL(0, Stats.Enqueued);
+}
+
+typedef struct _PRODUCER_CONTEXT
+{
+	FRAMEWRITER* Writer;
+	DUPL_RETURN Result;
+} PRODUCER_CONTEXT;
+
+static DWORD WINAPI SecondProducer(_In_ void* Param)
+{
+	PRODUCER_CONTEXT* Context = reinterpret_cast<PRODUCER_CONTEXT*>(Param);
+	Context->Result = Context->Writer->EnqueueRepeat(2);
+	return 0;
+}
+
+//
+// The copy outside of the lock is only safe with one producer, a second thread is turned away
+//
+static void TestSecondProducerRefused()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * TEST_HEIGHT, 0, 2, 0) == DUPL_RETURN_SUCCESS);
+	RECORDINGWRITER Recording;
+	REQUIRE(Recording.Open(stderr, RecordingPath) == DUPL_RETURN_SUCCESS);
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.Init(stderr, 2, 1, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_SUCCESS);
+	Writer.SetRecording(&Recording);
+
+	CHECK(Writer.EnqueueRepeat(1) == DUPL_RETURN_SUCCESS);
+	PRODUCER_CONTEXT Context = { &Writer, DUPL_RETURN_SUCCESS };
+	HANDLE Thread = CreateThread(nullptr, 0, SecondProducer, &Context, 0, nullptr);
+	REQUIRE(Thread);
+	WaitForSingleObject(Thread, INFINITE);
+	CloseHandle(Thread);
+	CHECK(Context.Result == DUPL_RETURN_ERROR_UNEXPECTED);
+	CHECK(Writer.EnqueueRepeat(3) == DUPL_RETURN_SUCCESS);
+	Writer.Shutdown();
+	Recording.Close();
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	CHECK_EQUAL(2, Stats.Enqueued);
+	DeleteFileA(RecordingPath);
+}
+
+//
+// Without a recording each frame becomes a bitmap of the packed rows
+//
+static void TestBitmapWritten()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * TEST_HEIGHT, 0, 2, 0) == DUPL_RETURN_SUCCESS);
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.Init(stderr, 2, 1, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Writer.SetDirectory(TestDirectory) == DUPL_RETURN_SUCCESS);
+
+	IMAGE_VIEW Image;
+	MakeFrame(&Image, 7);
+	CHECK(Writer.Enqueue(&Image, 900001) == DUPL_RETURN_SUCCESS);
+	Writer.Shutdown();
+
+	char Path[MAX_PATH];
+	GetTestPath("900001.bmp", Path);
+	FILE* File;
+	REQUIRE(fopen_s(&File, Path, "rb") == 0);
+	BITMAPFILEHEADER FileHeader;
+	BITMAPINFOHEADER InfoHeader;
+	BYTE Row[TEST_WIDTH * 4];
+	CHECK_EQUAL(1, fread(&FileHeader, sizeof(FileHeader), 1, File));
+	CHECK_EQUAL(1, fread(&InfoHeader, sizeof(InfoHeader), 1, File));
+	CHECK_EQUAL(0x4D42, FileHeader.bfType);
+	CHECK_EQUAL(sizeof(FileHeader) + sizeof(InfoHeader) + sizeof(Row) * TEST_HEIGHT, FileHeader.bfSize);
+	CHECK_EQUAL(TEST_WIDTH, InfoHeader.biWidth);
+	CHECK_EQUAL(-TEST_HEIGHT, InfoHeader.biHeight);
+	for (UINT y = 0; y < TEST_HEIGHT; ++y)
+	{
+		CHECK_EQUAL(1, fread(Row, sizeof(Row), 1, File));
+		CHECK(memcmp(Row, Pixels + y * TEST_PITCH, sizeof(Row)) == 0);
+	}
+	fclose(File);
+	DeleteFileA(Path);
+}
+
+//
+// Repeats written by several threads all end up in the one repeat file, not in a file each
+//
+static void TestRepeatsListedInOneFile()
+{
+	const UINT Repeats = 50;
+
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * TEST_HEIGHT, 0, 2, 0) == DUPL_RETURN_SUCCESS);
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.Init(stderr, 4, 3, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_SUCCESS);
+	REQUIRE(Writer.SetDirectory(TestDirectory) == DUPL_RETURN_SUCCESS);
+	for (UINT i = 0; i < Repeats; ++i)
+	{
+		CHECK(Writer.EnqueueRepeat(900100 + i) == DUPL_RETURN_SUCCESS);
+	}
+	Writer.Shutdown();
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	CHECK_EQUAL(Repeats, Stats.Written);
+	CHECK_EQUAL(0, Stats.Failed);
+
+	char Path[MAX_PATH];
+	GetTestPath(FRAMEWRITER_REPEAT_FILE, Path);
+	FILE* File;
+	REQUIRE(fopen_s(&File, Path, "r") == 0);
+	bool Seen[Repeats] = {};
+	UINT Index;
+	UINT Lines = 0;
+	while (fscanf(File, "%u", &Index) == 1)
+	{
+		++Lines;
+		REQUIRE(Index >= 900100 && Index < 900100 + Repeats);
+		CHECK(!Seen[Index - 900100]);
+		Seen[Index - 900100] = true;
+	}
+	fclose(File);
+	CHECK_EQUAL(Repeats, Lines);
+	DeleteFileA(Path);
+}
+
+//
+// Init after Shutdown starts the writer again on the same lock, a second Init while running is refused
+//
+static void TestRestart()
+{
+	FRAMEPOOL Pool;
+	REQUIRE(Pool.Init(stderr, TEST_WIDTH * 4 * TEST_HEIGHT, 0, 2, 0) == DUPL_RETURN_SUCCESS);
+	FRAMEWRITER Writer;
+	REQUIRE(Writer.SetDirectory(TestDirectory) == DUPL_RETURN_SUCCESS);
+	for (UINT Run = 0; Run < 3; ++Run)
+	{
+		REQUIRE(Writer.Init(stderr, 2, 2, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_SUCCESS);
+		CHECK(Writer.Init(stderr, 2, 2, &Pool, FRAMEWRITER_POLICY_BLOCK) == DUPL_RETURN_ERROR_UNEXPECTED);
+		CHECK(Writer.EnqueueRepeat(Run) == DUPL_RETURN_SUCCESS);
+		Writer.Shutdown();
+	}
+
+	FRAMEWRITER_STATS Stats;
+	Writer.GetStats(&Stats);
+	CHECK_EQUAL(3, Stats.Written);
+	FRAMEWRITER_COMPLETION Completions[4];
+	CHECK_EQUAL(3, Writer.GetCompletions(Completions, 4));
+
+	char Path[MAX_PATH];
+	GetTestPath(FRAMEWRITER_REPEAT_FILE, Path);
+	DeleteFileA(Path);
+}
+
+int main()
+{
+	char TempPath[MAX_PATH];
+	if (!GetTempPathA(MAX_PATH, TempPath))
+	{
+		fprintf(stderr, "No temp path.\n");
+		return 1;
+	}
+	sprintf_s(TestDirectory, "%sFrameWriterTest%u", TempPath, GetCurrentProcessId());
+	if (!CreateDirectoryA(TestDirectory, nullptr))
+	{
+		fprintf(stderr, "Test directory %s couldn't be created.\n", TestDirectory);
+		return 1;
+	}
+	GetTestPath(TEST_RECORDING, RecordingPath);
+
+	RUN_TEST(TestBlockingRecordsEveryFrame);
+	RUN_TEST(TestDropOldestAccounting);
+	RUN_TEST(TestOversizedFrameRefused);
+	RUN_TEST(TestSecondProducerRefused);
+	RUN_TEST(TestBitmapWritten);
+	RUN_TEST(TestRepeatsListedInOneFile);
+	RUN_TEST(TestRestart);
+
+	// Fails if a test left a file behind, a repeat file per thread for example
+	if (!RemoveDirectoryA(TestDirectory))
+	{
+		fprintf(stderr, "Test directory %s is not empty.\n", TestDirectory);
+		++TestFailures;
+	}
+	return TEST_RESULT();
+}
@@ -0,0 +1,225 @@
+// LatencyHistogramTest.cpp : Bucket layout, percentiles against sorted values, and the per stage report.
+//
+
+#include "TestCommon.h"
+#include "LatencyHistogram.h"
+
+#define TEST_VALUES     20000
+#define TEST_LATENCY    "LatencyHistogramTest.json"
+
+//
+// Buckets cover every value once, in order, and a bucket's bound is at most 1/16th above
+// any value in it
+//
+static void TestBucketLayout()
+{
+	unsigned Previous = 0;
+	for (uint64_t Value = 0; Value < (1 << 16); ++Value)
+	{
+		unsigned Bucket = LATENCYHISTOGRAM::GetBucket(Value);
+		CHECK(Bucket == Previous || Bucket == Previous + 1);
+		Previous = Bucket;
+	}
+
+	for (unsigned Bucket = 0; Bucket + 1 < LATENCY_BUCKET_COUNT; ++Bucket)
+	{
+		uint64_t Bound = LATENCYHISTOGRAM::GetBucketUpperBound(Bucket);
+		if (LATENCYHISTOGRAM::GetBucket(Bound) != Bucket || LATENCYHISTOGRAM::GetBucket(Bound + 1) != Bucket + 1)
+		{
+			fprintf(stderr, "Bucket %u ends at %llu, which is not where the next one starts\n", Bucket, static_cast<unsigned long long>(Bound));
+			++TestFailures;
+		}
+	}
+
+	UINT Random = 7;
+	for (UINT i = 0; i < 100000; ++i)
+	{
+		uint64_t Value = (static_cast<uint64_t>(TestRandom(&Random)) << 16 | TestRandom(&Random)) >> (TestRandom(&Random) % 40);
+		uint64_t Bound = LATENCYHISTOGRAM::GetBucketUpperBound(LATENCYHISTOGRAM::GetBucket(Value));
+		CHECK(Bound >= Value);
+		CHECK(Bound - Value <= Value / LATENCY_SUB_BUCKETS);
+	}
+
+	// Values too large for the histogram share the last bucket
+	CHECK_EQUAL(LATENCY_BUCKET_COUNT - 1, LATENCYHISTOGRAM::GetBucket(static_cast<uint64_t>(1) << LATENCY_MAX_EXPONENT));
+	CHECK_EQUAL(LATENCY_BUCKET_COUNT - 1, LATENCYHISTOGRAM::GetBucket(UINT64_MAX));
+}
+
+static int CompareValues(const void* First, const void* Second)
+{
+	uint64_t a = *static_cast<const uint64_t*>(First);
+	uint64_t b = *static_cast<const uint64_t*>(Second);
+	return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+//
+// Percentiles of random latencies with a long tail are within the bucket error of the value
+// of the same rank in the sorted input
+//
+static void TestPercentilesMatchSorted()
+{
+	static uint64_t Values[TEST_VALUES];
+	LATENCYHISTOGRAM Histogram;
+	UINT Random = 13;
+	double Sum = 0;
+	for (UINT i = 0; i < TEST_VALUES; ++i)
+	{
+		UINT Pick = TestRandom(&Random) % 1000;
+		Values[i] = (Pick < 990) ? 500 + TestRandom(&Random) % 16000 : 100000 + TestRandom(&Random) % 5000000;
+		Histogram.Record(Values[i]);
+		Sum += static_cast<double>(Values[i]);
+	}
+	qsort(Values, TEST_VALUES, sizeof(uint64_t), CompareValues);
+
+	CHECK_EQUAL(TEST_VALUES, Histogram.GetCount());
+	CHECK_EQUAL(Values[0], Histogram.GetMin());
+	CHECK_EQUAL(Values[TEST_VALUES - 1], Histogram.GetMax());
+	CHECK(Histogram.GetMean() > Sum / TEST_VALUES - 0.01 && Histogram.GetMean() < Sum / TEST_VALUES + 0.01);
+
+	const double Percentiles[] = { 0.0, 1.0, 50.0, 90.0, 99.0, 99.9, 100.0 };
+	for (UINT i = 0; i < ARRAYSIZE(Percentiles); ++i)
+	{
+		uint64_t Rank = static_cast<uint64_t>(Percentiles[i] / 100.0 * TEST_VALUES + 0.5);
+		uint64_t Expected = Values[(Rank ? Rank : 1) - 1];
+		uint64_t Reported = Histogram.GetPercentile(Percentiles[i]);
+		if (Reported < Expected || Reported - Expected > Expected / LATENCY_SUB_BUCKETS || Reported > Histogram.GetMax())
+		{
+			fprintf(stderr, "p%.1f is %llu, sorted value is %llu\n", Percentiles[i], static_cast<unsigned long long>(Reported), static_cast<unsigned long long>(Expected));
+			++TestFailures;
+		}
+	}
+
+	// Nothing recorded reports zeros
+	Histogram.Reset();
+	CHECK_EQUAL(0, Histogram.GetCount());
+	CHECK_EQUAL(0, Histogram.GetMin());
+	CHECK_EQUAL(0, Histogram.GetMax());
+	CHECK_EQUAL(0, Histogram.GetPercentile(99.0));
+}
+
+//
+// Merging histograms is the same as recording everything into one
+//
+static void TestMerge()
+{
+	LATENCYHISTOGRAM All;
+	LATENCYHISTOGRAM Parts[3];
+	UINT Random = 21;
+	for (UINT i = 0; i < 3000; ++i)
+	{
+		uint64_t Value = TestRandom(&Random) % (100000 * (i % 3 + 1));
+		All.Record(Value);
+		Parts[i % 3].Record(Value);
+	}
+
+	LATENCYHISTOGRAM Merged;
+	for (UINT i = 0; i < ARRAYSIZE(Parts); ++i)
+	{
+		Merged.Merge(&Parts[i]);
+	}
+	CHECK_EQUAL(All.GetCount(), Merged.GetCount());
+	CHECK_EQUAL(All.GetMin(), Merged.GetMin());
+	CHECK_EQUAL(All.GetMax(), Merged.GetMax());
+	for (double p = 0; p <= 100.0; p += 2.5)
+	{
+		CHECK_EQUAL(All.GetPercentile(p), Merged.GetPercentile(p));
+	}
+}
+
+//
+// Each stage is the time between consecutive stamps, stages with a missing or out of order
+// stamp are left out, and the total starts at the earliest stamp
+//
+static void TestReportStages()
+{
+	LATENCYREPORT Report;
+
+	// Without a frequency there is nothing to convert with
+	LATENCY_STAMPS Stamps;
+	for (UINT i = 0; i < LATENCY_STAMP_COUNT; ++i)
+	{
+		Stamps.Ticks[i] = 1000 + i * 100;
+	}
+	Report.Record(&Stamps);
+	CHECK_EQUAL(0, Report.GetStage(LATENCY_STAGE_TOTAL)->GetCount());
+
+	// Ticks of 10 ns
+	Report.SetFrequency(100000000);
+	Report.Record(&Stamps);
+	for (UINT i = 0; i < LATENCY_STAGE_TOTAL; ++i)
+	{
+		CHECK_EQUAL(1, Report.GetStage(static_cast<LATENCY_STAGE>(i))->GetCount());
+		CHECK_EQUAL(1, Report.GetStage(static_cast<LATENCY_STAGE>(i))->GetMax());
+	}
+	CHECK_EQUAL(6, Report.GetStage(LATENCY_STAGE_TOTAL)->GetMax());
+
+	// A pointer only update without a present time, and a map stamp behind the copy
+	Report.Reset();
+	Stamps.Ticks[LATENCY_STAMP_PRESENT] = 0;
+	Stamps.Ticks[LATENCY_STAMP_MAP] = Stamps.Ticks[LATENCY_STAMP_COPY] - 1;
+	Report.Record(&Stamps);
+	CHECK_EQUAL(0, Report.GetStage(LATENCY_STAGE_PRESENT_TO_ACQUIRE)->GetCount());
+	CHECK_EQUAL(1, Report.GetStage(LATENCY_STAGE_ACQUIRE_TO_COPY)->GetCount());
+	CHECK_EQUAL(0, Report.GetStage(LATENCY_STAGE_COPY_TO_MAP)->GetCount());
+	CHECK_EQUAL(1, Report.GetStage(LATENCY_STAGE_MAP_TO_READBACK)->GetCount());
+	CHECK_EQUAL(5, Report.GetStage(LATENCY_STAGE_TOTAL)->GetMax());
+
+	// Not written yet, so no total
+	Stamps.Ticks[LATENCY_STAMP_WRITTEN] = 0;
+	Report.Record(&Stamps);
+	CHECK_EQUAL(1, Report.GetStage(LATENCY_STAGE_TOTAL)->GetCount());
+}
+
+//
+// Every stage is written as one JSON line with the fields a dashboard reads
+//
+static void TestReportWrite()
+{
+	LATENCYREPORT Report;
+	Report.SetFrequency(1000000);
+	LATENCY_STAMPS Stamps;
+	for (UINT Frame = 0; Frame < 100; ++Frame)
+	{
+		for (UINT i = 0; i < LATENCY_STAMP_COUNT; ++i)
+		{
+			Stamps.Ticks[i] = 1000000 + i * (100 + Frame);
+		}
+		Report.Record(&Stamps);
+	}
+
+	FILE* File;
+	REQUIRE(fopen_s(&File, TEST_LATENCY, "w+") == 0);
+	Report.Write(File, 42);
+	rewind(File);
+
+	char Line[512];
+	UINT Lines = 0;
+	while (fgets(Line, sizeof(Line), File))
+	{
+		unsigned Frame;
+		char Stage[64];
+		unsigned long long Count, Min, P50, P99, P999, Max;
+		double Mean;
+		int Fields = sscanf(Line, "{\"frame\":%u,\"stage\":\"%63[a-z_]\",\"count\":%llu,\"min_us\":%llu,\"mean_us\":%lf,\"p50_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}",
+			&Frame, Stage, &Count, &Min, &Mean, &P50, &P99, &P999, &Max);
+		REQUIRE(Fields == 9 && Lines < LATENCY_STAGE_COUNT);
+		CHECK_EQUAL(42, Frame);
+		CHECK(strcmp(Stage, LATENCYREPORT::GetStageName(static_cast<LATENCY_STAGE>(Lines))) == 0);
+		CHECK_EQUAL(100, Count);
+		CHECK(Min <= P50 && P50 <= P99 && P99 <= P999 && P999 <= Max);
+		++Lines;
+	}
+	fclose(File);
+	DeleteFileA(TEST_LATENCY);
+	CHECK_EQUAL(LATENCY_STAGE_COUNT, Lines);
+}
+
+int main()
+{
+	RUN_TEST(TestBucketLayout);
+	RUN_TEST(TestPercentilesMatchSorted);
+	RUN_TEST(TestMerge);
+	RUN_TEST(TestReportStages);
+	RUN_TEST(TestReportWrite);
+	return TEST_RESULT();
+}
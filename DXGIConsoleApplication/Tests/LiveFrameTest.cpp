@@ -0,0 +1,239 @@
+// LiveFrameTest.cpp : The live frame writer against ReadLiveFrame, across size changes and restarts.
+//
+
+#include "TestCommon.h"
+#include "LiveFrame.h"
+
+#define TEST_LIVE       "LiveFrameTest.bmp"
+#define TEST_LIVE_SEQ   "LiveFrameTest.bmp.seq"
+#define TEST_MAX_WIDTH  48
+#define TEST_MAX_HEIGHT 24
+#define TEST_PITCH      (TEST_MAX_WIDTH * BPP + 16)
+#define TEST_FRAMES     300
+#define TEST_READS      200
+
+static BYTE Source[TEST_PITCH * TEST_MAX_HEIGHT];
+
+static void MakeImage(_Out_ IMAGE_VIEW* Image, _Out_writes_bytes_(TEST_PITCH * TEST_MAX_HEIGHT) BYTE* Data, UINT Width, UINT Height, UINT Seed)
+{
+	FillTestImage(Data, Width, Height, TEST_PITCH, Seed);
+	Image->Data = Data;
+	Image->Width = Width;
+	Image->Height = Height;
+	Image->Pitch = TEST_PITCH;
+	Image->Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	Image->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+}
+
+//
+// True if Read holds the packed rows of the test image Seed
+//
+static bool MatchesImage(_In_ const BYTE* Read, UINT Width, UINT Height, UINT Seed)
+{
+	static BYTE Expected[TEST_MAX_WIDTH * BPP * TEST_MAX_HEIGHT];
+	FillTestImage(Expected, Width, Height, Width * BPP, Seed);
+	return memcmp(Read, Expected, Width * BPP * Height) == 0;
+}
+
+static void DeleteLiveFrame()
+{
+	DeleteFileA(TEST_LIVE);
+	DeleteFileA(TEST_LIVE_SEQ);
+}
+
+//
+// Whole frames, then a dirty rect update that only rewrites the rect
+//
+static void TestReadBack()
+{
+	DeleteLiveFrame();
+	LIVEFRAME Live;
+	REQUIRE(Live.Init(stderr, TEST_LIVE) == DUPL_RETURN_SUCCESS);
+
+	IMAGE_VIEW Image;
+	MakeImage(&Image, Source, 40, 20, 1);
+	REQUIRE(Live.Update(&Image, 7, nullptr) == DUPL_RETURN_SUCCESS);
+
+	BYTE Read[TEST_MAX_WIDTH * BPP * TEST_MAX_HEIGHT];
+	LIVEFRAME_HEADER Header;
+	REQUIRE(ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(7, Header.FrameIndex);
+	CHECK_EQUAL(40, Header.Width);
+	CHECK_EQUAL(20, Header.Height);
+	CHECK_EQUAL(40 * BPP, Header.Pitch);
+	CHECK_EQUAL(1, Header.Generation);
+	CHECK_EQUAL(0, Header.Sequence & 1);
+	CHECK(MatchesImage(Read, 40, 20, 1));
+
+	// Only the dirty rect comes from the new image
+	RECT Dirty = { 5, 3, 17, 9 };
+	FRAME_METADATA Meta;
+	RtlZeroMemory(&Meta, sizeof(Meta));
+	Meta.MetaData = reinterpret_cast<BYTE*>(&Dirty);
+	Meta.MetaDataSize = sizeof(Dirty);
+	Meta.DirtyCount = 1;
+	MakeImage(&Image, Source, 40, 20, 2);
+	REQUIRE(Live.Update(&Image, 8, &Meta) == DUPL_RETURN_SUCCESS);
+	REQUIRE(ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(8, Header.FrameIndex);
+	static BYTE Expected[40 * BPP * 20];
+	static BYTE Second[40 * BPP * 20];
+	FillTestImage(Expected, 40, 20, 40 * BPP, 1);
+	FillTestImage(Second, 40, 20, 40 * BPP, 2);
+	for (LONG y = Dirty.top; y < Dirty.bottom; ++y)
+	{
+		memcpy(Expected + y * 40 * BPP + Dirty.left * BPP, Second + y * 40 * BPP + Dirty.left * BPP, (Dirty.right - Dirty.left) * BPP);
+	}
+	CHECK(memcmp(Read, Expected, sizeof(Expected)) == 0);
+
+	// Too small a buffer is an error, not a partial copy
+	CHECK(ReadLiveFrame(stderr, TEST_LIVE, Read, 40 * BPP * 19, &Header) == DUPL_RETURN_ERROR_UNEXPECTED);
+
+	Live.Close();
+	DeleteLiveFrame();
+}
+
+//
+// A new size recreates the bitmap under a new generation, the sequence carries on, also into the next writer
+//
+static void TestSequenceSurvivesRecreate()
+{
+	DeleteLiveFrame();
+	BYTE Read[TEST_MAX_WIDTH * BPP * TEST_MAX_HEIGHT];
+	LIVEFRAME_HEADER Header;
+	IMAGE_VIEW Image;
+	LONG Previous;
+	{
+		LIVEFRAME Live;
+		REQUIRE(Live.Init(stderr, TEST_LIVE) == DUPL_RETURN_SUCCESS);
+		MakeImage(&Image, Source, TEST_MAX_WIDTH, TEST_MAX_HEIGHT, 3);
+		REQUIRE(Live.Update(&Image, 1, nullptr) == DUPL_RETURN_SUCCESS);
+		REQUIRE(ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) == DUPL_RETURN_SUCCESS);
+		Previous = Header.Sequence;
+
+		MakeImage(&Image, Source, 20, 10, 4);
+		REQUIRE(Live.Update(&Image, 2, nullptr) == DUPL_RETURN_SUCCESS);
+		REQUIRE(ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) == DUPL_RETURN_SUCCESS);
+		CHECK(Header.Sequence > Previous);
+		CHECK_EQUAL(2, Header.Generation);
+		CHECK_EQUAL(20, Header.Width);
+		CHECK(MatchesImage(Read, 20, 10, 4));
+		Previous = Header.Sequence;
+	}
+
+	LIVEFRAME Live;
+	REQUIRE(Live.Init(stderr, TEST_LIVE) == DUPL_RETURN_SUCCESS);
+	MakeImage(&Image, Source, 20, 10, 5);
+	REQUIRE(Live.Update(&Image, 0, nullptr) == DUPL_RETURN_SUCCESS);
+	REQUIRE(ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) == DUPL_RETURN_SUCCESS);
+	CHECK(Header.Sequence > Previous);
+	CHECK_EQUAL(3, Header.Generation);
+	CHECK(MatchesImage(Read, 20, 10, 5));
+
+	Live.Close();
+	DeleteLiveFrame();
+}
+
+//
+// A header claiming more than the bitmap holds, or a pitch that isn't packed, is never read through
+//
+static void TestHeaderCheckedAgainstMapping()
+{
+	DeleteLiveFrame();
+	LIVEFRAME Live;
+	REQUIRE(Live.Init(stderr, TEST_LIVE) == DUPL_RETURN_SUCCESS);
+	IMAGE_VIEW Image;
+	MakeImage(&Image, Source, 16, 8, 6);
+	REQUIRE(Live.Update(&Image, 1, nullptr) == DUPL_RETURN_SUCCESS);
+	Live.Close();
+
+	static BYTE Read[1024 * 1024 * BPP];
+	LIVEFRAME_HEADER Header;
+	const UINT Sizes[][3] = { { 16, 4096, 16 * BPP }, { 1024, 1024, 1024 * BPP }, { 16, 8, 16 * BPP + 4 }, { 0, 8, 0 } };
+	for (UINT i = 0; i < ARRAYSIZE(Sizes); ++i)
+	{
+		FILE* File;
+		REQUIRE(fopen_s(&File, TEST_LIVE_SEQ, "r+b") == 0);
+		LIVEFRAME_HEADER Shared;
+		REQUIRE(fread(&Shared, sizeof(Shared), 1, File) == 1);
+		Shared.Width = Sizes[i][0];
+		Shared.Height = Sizes[i][1];
+		Shared.Pitch = Sizes[i][2];
+		fseek(File, 0, SEEK_SET);
+		fwrite(&Shared, sizeof(Shared), 1, File);
+		fclose(File);
+
+		CHECK(ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) == DUPL_RETURN_ERROR_EXPECTED);
+	}
+
+	DeleteLiveFrame();
+}
+
+typedef struct _READER_CONTEXT
+{
+	volatile LONG Done;
+	volatile LONG Reads;
+	UINT Mismatches;
+} READER_CONTEXT;
+
+static DWORD WINAPI ReaderProc(_In_ void* Param)
+{
+	READER_CONTEXT* Context = reinterpret_cast<READER_CONTEXT*>(Param);
+	static BYTE Read[TEST_MAX_WIDTH * BPP * TEST_MAX_HEIGHT];
+	while (!ReadAcquire(&Context->Done))
+	{
+		LIVEFRAME_HEADER Header;
+		if (ReadLiveFrame(stderr, TEST_LIVE, Read, sizeof(Read), &Header) != DUPL_RETURN_SUCCESS)
+		{
+			continue;
+		}
+		InterlockedIncrement(&Context->Reads);
+		if (!MatchesImage(Read, Header.Width, Header.Height, Header.FrameIndex))
+		{
+			++Context->Mismatches;
+		}
+	}
+	return 0;
+}
+
+//
+// While the writer keeps changing the size, every read that succeeds is one whole frame.
+// The writer goes on until the reader got enough frames through.
+//
+static void TestReadsWhileResizing()
+{
+	DeleteLiveFrame();
+	LIVEFRAME Live;
+	REQUIRE(Live.Init(stderr, TEST_LIVE) == DUPL_RETURN_SUCCESS);
+	IMAGE_VIEW Image;
+	MakeImage(&Image, Source, 8, 4, 0);
+	REQUIRE(Live.Update(&Image, 0, nullptr) == DUPL_RETURN_SUCCESS);
+
+	READER_CONTEXT Context = { 0, 0, 0 };
+	HANDLE Thread = CreateThread(nullptr, 0, ReaderProc, &Context, 0, nullptr);
+	REQUIRE(Thread);
+	for (UINT i = 1; i < TEST_FRAMES || (ReadAcquire(&Context.Reads) < TEST_READS && i < TEST_FRAMES * 1000); ++i)
+	{
+		UINT Width = 8 + (i * 7) % (TEST_MAX_WIDTH - 8);
+		UINT Height = 4 + (i * 5) % (TEST_MAX_HEIGHT - 4);
+		MakeImage(&Image, Source, Width, Height, i);
+		CHECK(Live.Update(&Image, i, nullptr) == DUPL_RETURN_SUCCESS);
+	}
+	WriteRelease(&Context.Done, 1);
+	WaitForSingleObject(Thread, INFINITE);
+	CloseHandle(Thread);
+
+	CHECK(Context.Reads > 0);
+	CHECK_EQUAL(0, Context.Mismatches);
+	Live.Close();
+	DeleteLiveFrame();
+}
+
+int main()
+{
+	RUN_TEST(TestReadBack);
+	RUN_TEST(TestSequenceSurvivesRecreate);
+	RUN_TEST(TestHeaderCheckedAgainstMapping);
+	RUN_TEST(TestReadsWhileResizing);
+	return TEST_RESULT();
+}
@@ -0,0 +1,256 @@
+// PointerCompositeTest.cpp : The vector pointer blends against a scalar reference on synthetic shapes,
+// and the compositor puts back exactly what it drew over.
+//
+
+#include "TestCommon.h"
+#include "PointerComposite.h"
+
+#define TEST_WIDTH      96
+#define TEST_HEIGHT     64
+#define TEST_PITCH      (TEST_WIDTH * 4 + 24)
+#define TEST_MAX_SHAPE  48
+
+static BYTE Image[TEST_PITCH * TEST_HEIGHT];
+static BYTE Reference[TEST_PITCH * TEST_HEIGHT];
+static BYTE Original[TEST_PITCH * TEST_HEIGHT];
+static BYTE Shape[TEST_MAX_SHAPE * 4 * TEST_MAX_SHAPE * 2];
+
+static const DXGI_OUTDUPL_POINTER_SHAPE_TYPE Types[] =
+{
+	DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR,
+	DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR,
+	DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME
+};
+
+//
+// Random shape of a random type and size with a pitch that is not the width, placed so it is
+// sometimes partly or wholly off the image
+//
+static void RandomPointer(_Out_ POINTER_STATE* Pointer, DXGI_OUTDUPL_POINTER_SHAPE_TYPE Type, _Inout_ UINT* Random)
+{
+	RtlZeroMemory(Pointer, sizeof(POINTER_STATE));
+	Pointer->ShapeBuffer = Shape;
+	Pointer->BufferSize = sizeof(Shape);
+	Pointer->Visible = true;
+	Pointer->HasShape = true;
+
+	DXGI_OUTDUPL_POINTER_SHAPE_INFO* Info = &Pointer->ShapeInfo;
+	Info->Type = Type;
+	Info->Width = 1 + TestRandom(Random) % TEST_MAX_SHAPE;
+	UINT Height = 1 + TestRandom(Random) % TEST_MAX_SHAPE;
+	if (Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME)
+	{
+		Info->Pitch = (Info->Width + 7) / 8 + TestRandom(Random) % 3;
+		Info->Height = Height * 2;
+	}
+	else
+	{
+		Info->Pitch = Info->Width * 4 + (TestRandom(Random) % 3) * 4;
+		Info->Height = Height;
+	}
+
+	for (UINT i = 0; i < Info->Pitch * Info->Height; ++i)
+	{
+		Shape[i] = static_cast<BYTE>(TestRandom(Random));
+	}
+
+	// Masked color alpha is only ever 0 or 0xFF, color alpha is often one of the two as well
+	if (Type != DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME)
+	{
+		for (UINT y = 0; y < Info->Height; ++y)
+		{
+			for (UINT x = 0; x < Info->Width; ++x)
+			{
+				BYTE* Alpha = Shape + y * Info->Pitch + x * 4 + 3;
+				UINT Pick = TestRandom(Random) % 4;
+				if (Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR || Pick < 2)
+				{
+					*Alpha = (Pick & 1) ? 0xFF : 0;
+				}
+			}
+		}
+	}
+
+	Pointer->Position.x = static_cast<LONG>(TestRandom(Random) % (TEST_WIDTH + TEST_MAX_SHAPE)) - TEST_MAX_SHAPE / 2;
+	Pointer->Position.y = static_cast<LONG>(TestRandom(Random) % (TEST_HEIGHT + TEST_MAX_SHAPE)) - TEST_MAX_SHAPE / 2;
+}
+
+static UINT RoundDiv255(UINT X)
+{
+	return (2 * X + 255) / 510;
+}
+
+//
+// One pixel at a time with the rules the duplication sample draws the pointer with
+//
+static void BlendReference(_Inout_ BYTE* Dst, _In_ const POINTER_STATE* Pointer)
+{
+	const DXGI_OUTDUPL_POINTER_SHAPE_INFO* Info = &Pointer->ShapeInfo;
+	UINT Height = (Info->Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME) ? Info->Height / 2 : Info->Height;
+	for (UINT y = 0; y < Height; ++y)
+	{
+		for (UINT x = 0; x < Info->Width; ++x)
+		{
+			LONG ImageX = Pointer->Position.x + x;
+			LONG ImageY = Pointer->Position.y + y;
+			if (ImageX < 0 || ImageY < 0 || ImageX >= TEST_WIDTH || ImageY >= TEST_HEIGHT)
+			{
+				continue;
+			}
+
+			UINT* Pixel = reinterpret_cast<UINT*>(Dst + ImageY * TEST_PITCH + ImageX * 4);
+			if (Info->Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME)
+			{
+				BYTE Bit = static_cast<BYTE>(0x80 >> (x % 8));
+				bool And = (Shape[y * Info->Pitch + x / 8] & Bit) != 0;
+				bool Xor = (Shape[(y + Height) * Info->Pitch + x / 8] & Bit) != 0;
+				*Pixel = (*Pixel & (And ? 0xFFFFFFFF : 0xFF000000)) ^ (Xor ? 0x00FFFFFF : 0);
+				continue;
+			}
+
+			UINT S = *reinterpret_cast<const UINT*>(Shape + y * Info->Pitch + x * 4);
+			UINT A = S >> 24;
+			if (Info->Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR)
+			{
+				*Pixel = ((A == 0xFF) ? (*Pixel ^ S) : S) | 0xFF000000;
+				continue;
+			}
+
+			UINT Out = 0xFF000000;
+			for (UINT Shift = 0; Shift < 24; Shift += 8)
+			{
+				Out |= RoundDiv255(((S >> Shift) & 0xFF) * A + ((*Pixel >> Shift) & 0xFF) * (255 - A)) << Shift;
+			}
+			*Pixel = Out;
+		}
+	}
+}
+
+//
+// Every shape type, size, pitch and placement gives the reference's pixels exactly, inside the
+// pointer rect and nowhere else, padding included
+//
+static void TestBlendMatchesReference()
+{
+	UINT Random = 41;
+	for (UINT Round = 0; Round < 3000; ++Round)
+	{
+		POINTER_STATE Pointer;
+		RandomPointer(&Pointer, Types[Round % ARRAYSIZE(Types)], &Random);
+		for (UINT i = 0; i < sizeof(Image); ++i)
+		{
+			Image[i] = static_cast<BYTE>(TestRandom(&Random));
+		}
+		memcpy(Reference, Image, sizeof(Image));
+		BlendReference(Reference, &Pointer);
+
+		RECT Rect;
+		if (GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Rect))
+		{
+			BlendPointerShape(Image, TEST_PITCH, &Rect, &Pointer);
+		}
+
+		if (memcmp(Image, Reference, sizeof(Image)) != 0)
+		{
+			fprintf(stderr, "Round %u: type %d %ux%u at %d,%d differs from the reference\n", Round, Pointer.ShapeInfo.Type,
+				Pointer.ShapeInfo.Width, Pointer.ShapeInfo.Height, static_cast<int>(Pointer.Position.x), static_cast<int>(Pointer.Position.y));
+			++TestFailures;
+		}
+	}
+}
+
+//
+// The rect is the shape clipped to the image, half the shape height for monochrome, and there
+// is none for a hidden pointer, one without a shape or one off the image
+//
+static void TestPointerRect()
+{
+	POINTER_STATE Pointer;
+	UINT Random = 3;
+	RandomPointer(&Pointer, DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME, &Random);
+	Pointer.ShapeInfo.Width = 32;
+	Pointer.ShapeInfo.Height = 64;
+	Pointer.Position.x = -8;
+	Pointer.Position.y = TEST_HEIGHT - 20;
+
+	RECT Rect;
+	CHECK(GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Rect));
+	RECT Expected = { 0, TEST_HEIGHT - 20, 24, TEST_HEIGHT };
+	CHECK(memcmp(&Rect, &Expected, sizeof(RECT)) == 0);
+
+	Pointer.ShapeInfo.Type = DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR;
+	Pointer.Position.y = 4;
+	CHECK(GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Rect));
+	CHECK_EQUAL(TEST_HEIGHT, Rect.bottom);
+
+	Pointer.Position.x = TEST_WIDTH;
+	CHECK(!GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Rect));
+
+	Pointer.Position.x = 0;
+	Pointer.Visible = false;
+	CHECK(!GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Rect));
+
+	Pointer.Visible = true;
+	Pointer.HasShape = false;
+	CHECK(!GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Rect));
+}
+
+//
+// Erasing after drawing gives back the image bit for bit, for pointers that move and change
+// shape between frames, and the compositor refuses to draw twice or erase what isn't drawn
+//
+static void TestDrawEraseRestores()
+{
+	UINT Random = 77;
+	FillTestImage(Image, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 5);
+	memcpy(Original, Image, sizeof(Image));
+
+	POINTERCOMPOSITOR Compositor;
+	RECT Rect;
+	CHECK(!Compositor.Erase(Image, TEST_PITCH, &Rect));
+
+	for (UINT Round = 0; Round < 500; ++Round)
+	{
+		POINTER_STATE Pointer;
+		RandomPointer(&Pointer, Types[Round % ARRAYSIZE(Types)], &Random);
+
+		RECT Drawn;
+		bool Visible = GetPointerRect(&Pointer, TEST_WIDTH, TEST_HEIGHT, &Drawn);
+		CHECK_EQUAL(Visible, Compositor.Draw(Image, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Pointer, &Rect));
+		if (!Visible)
+		{
+			continue;
+		}
+		CHECK(memcmp(&Rect, &Drawn, sizeof(RECT)) == 0);
+		CHECK(!Compositor.Draw(Image, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Pointer, &Rect));
+
+		memcpy(Reference, Original, sizeof(Original));
+		BlendReference(Reference, &Pointer);
+		CHECK(memcmp(Image, Reference, sizeof(Image)) == 0);
+
+		CHECK(Compositor.Erase(Image, TEST_PITCH, &Rect));
+		CHECK(memcmp(&Rect, &Drawn, sizeof(RECT)) == 0);
+		CHECK(memcmp(Image, Original, sizeof(Image)) == 0);
+		CHECK(!Compositor.Erase(Image, TEST_PITCH, &Rect));
+	}
+
+	// After the image was replaced as a whole there is nothing to put back
+	POINTER_STATE Pointer;
+	RandomPointer(&Pointer, DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR, &Random);
+	Pointer.Position.x = 10;
+	Pointer.Position.y = 10;
+	CHECK(Compositor.Draw(Image, TEST_PITCH, TEST_WIDTH, TEST_HEIGHT, &Pointer, &Rect));
+	FillTestImage(Image, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, 6);
+	memcpy(Original, Image, sizeof(Image));
+	Compositor.Forget();
+	CHECK(!Compositor.Erase(Image, TEST_PITCH, &Rect));
+	CHECK(memcmp(Image, Original, sizeof(Image)) == 0);
+}
+
+int main()
+{
+	RUN_TEST(TestBlendMatchesReference);
+	RUN_TEST(TestPointerRect);
+	RUN_TEST(TestDrawEraseRestores);
+	return TEST_RESULT();
+}
@@ -0,0 +1,247 @@
+// RecordingFileTest.cpp : Repeats in recordings resolve to the frame they show, frames are found by
+// index and recordings the reader can't trust are refused.
+//
+
+#include "TestCommon.h"
+#include "RecordingFile.h"
+
+#define TEST_WIDTH      16
+#define TEST_HEIGHT     8
+#define TEST_PITCH      (TEST_WIDTH * 4)
+#define TEST_RECORDING  "RecordingFileTest.rec"
+#define TEST_BITMAP     "RecordingFileTest.bmp"
+
+static BYTE Pixels[TEST_PITCH * TEST_HEIGHT];
+
+static void MakeInfo(_Out_ RECORDING_FRAME_INFO* Info, UINT Index, bool Repeat)
+{
+	RtlZeroMemory(Info, sizeof(RECORDING_FRAME_INFO));
+	Info->Index = Index;
+	Info->CaptureTime.QuadPart = Index * 1000;
+	Info->Frequency.QuadPart = 1000000;
+	if (Repeat)
+	{
+		// Repeats are queued without an image, so they have no geometry
+		Info->Flags = RECORDING_FLAG_REPEAT;
+		return;
+	}
+	Info->Width = TEST_WIDTH;
+	Info->Height = TEST_HEIGHT;
+	Info->Pitch = TEST_PITCH;
+	Info->Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+}
+
+static DUPL_RETURN AppendFrame(_Inout_ RECORDINGWRITER* Writer, UINT Index)
+{
+	RECORDING_FRAME_INFO Info;
+	MakeInfo(&Info, Index, false);
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, Index);
+	return Writer->Append(&Info, nullptr, 0, Pixels, sizeof(Pixels));
+}
+
+static DUPL_RETURN AppendRepeat(_Inout_ RECORDINGWRITER* Writer, UINT Index, UINT RepeatOf)
+{
+	RECORDING_FRAME_INFO Info;
+	MakeInfo(&Info, Index, true);
+	return Writer->Append(&Info, nullptr, 0, nullptr, 0, RepeatOf);
+}
+
+//
+// Export Entry and compare the bitmap's pixels with the test image of frame Seed
+//
+static bool ExportMatches(_Inout_ RECORDINGREADER* Reader, UINT Entry, UINT Seed)
+{
+	if (Reader->ExportBitmap(Entry, TEST_BITMAP) != DUPL_RETURN_SUCCESS)
+	{
+		return false;
+	}
+
+	FILE* File;
+	if (fopen_s(&File, TEST_BITMAP, "rb") != 0)
+	{
+		return false;
+	}
+	BITMAPFILEHEADER FileHeader;
+	BITMAPINFOHEADER InfoHeader;
+	BYTE Read[sizeof(Pixels)];
+	bool Matches = fread(&FileHeader, sizeof(FileHeader), 1, File) == 1 &&
+		fread(&InfoHeader, sizeof(InfoHeader), 1, File) == 1 &&
+		InfoHeader.biWidth == TEST_WIDTH && InfoHeader.biHeight == -TEST_HEIGHT &&
+		fread(Read, sizeof(Read), 1, File) == 1;
+	fclose(File);
+	DeleteFileA(TEST_BITMAP);
+
+	FillTestImage(Pixels, TEST_WIDTH, TEST_HEIGHT, TEST_PITCH, Seed);
+	return Matches && memcmp(Read, Pixels, sizeof(Pixels)) == 0;
+}
+
+//
+// A repeat exports the pixels and size of the frame it repeats, even through another repeat and
+// with encoded pixels. Repeats of frames the recording doesn't have are reported, not guessed.
+//
+static void TestExportRepeat()
+{
+	RECORDINGWRITER Writer;
+	REQUIRE(Writer.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+
+	// Writer threads append in any order
+	CHECK(AppendRepeat(&Writer, 12, 11) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendFrame(&Writer, 13) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendRepeat(&Writer, 11, 10) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendFrame(&Writer, 10) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendRepeat(&Writer, 15, 14) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendRepeat(&Writer, 16, 13) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendRepeat(&Writer, 9, RECORDING_NO_FRAME) == DUPL_RETURN_SUCCESS);
+	CHECK(Writer.Close() == DUPL_RETURN_SUCCESS);
+
+	RECORDINGREADER Reader;
+	REQUIRE(Reader.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(7, Reader.GetFrameCount());
+
+	UINT Entry;
+	RECORDING_FRAME Frame;
+	REQUIRE(Reader.FindFrame(11, &Entry));
+	REQUIRE(Reader.GetFrame(Entry, &Frame) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(0, Frame.Header->Info.Width);
+	REQUIRE(Frame.DataHeader);
+	CHECK_EQUAL(10, Frame.DataHeader->Info.Index);
+	CHECK(ExportMatches(&Reader, Entry, 10));
+
+	REQUIRE(Reader.FindFrame(12, &Entry));
+	CHECK(ExportMatches(&Reader, Entry, 10));
+	REQUIRE(Reader.FindFrame(16, &Entry));
+	CHECK(ExportMatches(&Reader, Entry, 13));
+	REQUIRE(Reader.FindFrame(13, &Entry));
+	CHECK(ExportMatches(&Reader, Entry, 13));
+
+	const UINT Missing[] = { 9, 15 };
+	for (UINT i = 0; i < ARRAYSIZE(Missing); ++i)
+	{
+		REQUIRE(Reader.FindFrame(Missing[i], &Entry));
+		REQUIRE(Reader.GetFrame(Entry, &Frame) == DUPL_RETURN_SUCCESS);
+		CHECK(Frame.DataHeader == nullptr);
+		CHECK(Frame.Data == nullptr);
+		CHECK(Reader.ExportBitmap(Entry, TEST_BITMAP) == DUPL_RETURN_ERROR_UNEXPECTED);
+	}
+
+	Reader.Close();
+	DeleteFileA(TEST_RECORDING);
+}
+
+//
+// Frames are found by index in a recording with gaps, indexes outside it or in a gap are not
+//
+static void TestFindFrame()
+{
+	RECORDINGWRITER Writer;
+	REQUIRE(Writer.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+
+	const UINT Frames[] = { 20, 5, 7, 8, 30 };
+	for (UINT i = 0; i < ARRAYSIZE(Frames); ++i)
+	{
+		CHECK(AppendFrame(&Writer, Frames[i]) == DUPL_RETURN_SUCCESS);
+	}
+	CHECK(Writer.Close() == DUPL_RETURN_SUCCESS);
+
+	RECORDINGREADER Reader;
+	REQUIRE(Reader.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(ARRAYSIZE(Frames), Reader.GetFrameCount());
+
+	UINT Found = 0;
+	for (UINT Index = 0; Index < 40; ++Index)
+	{
+		UINT Entry;
+		if (!Reader.FindFrame(Index, &Entry))
+		{
+			CHECK_EQUAL(Reader.GetFrameCount(), Entry);
+			continue;
+		}
+
+		RECORDING_FRAME Frame;
+		REQUIRE(Reader.GetFrame(Entry, &Frame) == DUPL_RETURN_SUCCESS);
+		CHECK_EQUAL(Index, Frame.Header->Info.Index);
+		CHECK(ExportMatches(&Reader, Entry, Index));
+		++Found;
+	}
+	CHECK_EQUAL(ARRAYSIZE(Frames), Found);
+
+	Reader.Close();
+	DeleteFileA(TEST_RECORDING);
+}
+
+//
+// Encoded and stored pixels are both part of the one format, only the chunk flag tells them apart
+//
+static void TestEncodedAndStored()
+{
+	for (UINT Compress = 0; Compress < 2; ++Compress)
+	{
+		RECORDINGWRITER Writer;
+		Writer.SetCompression(Compress != 0);
+		REQUIRE(Writer.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+		CHECK(AppendFrame(&Writer, 3) == DUPL_RETURN_SUCCESS);
+		CHECK(Writer.Close() == DUPL_RETURN_SUCCESS);
+
+		RECORDINGREADER Reader;
+		REQUIRE(Reader.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+		RECORDING_FRAME Frame;
+		REQUIRE(Reader.GetFrame(0, &Frame) == DUPL_RETURN_SUCCESS);
+		CHECK_EQUAL(Compress != 0, (Frame.Header->Info.Flags & RECORDING_FLAG_ENCODED) != 0);
+		CHECK(ExportMatches(&Reader, 0, 3));
+
+		Reader.Close();
+		DeleteFileA(TEST_RECORDING);
+	}
+}
+
+//
+// Recordings that were never closed, or of another format version, are not opened
+//
+static void TestRejected()
+{
+	RECORDINGWRITER Writer;
+	REQUIRE(Writer.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+	CHECK(AppendFrame(&Writer, 0) == DUPL_RETURN_SUCCESS);
+	CHECK(Writer.Close() == DUPL_RETURN_SUCCESS);
+
+	FILE* File;
+	REQUIRE(fopen_s(&File, TEST_RECORDING, "r+b") == 0);
+	RECORDING_FILE_HEADER Header;
+	REQUIRE(fread(&Header, sizeof(Header), 1, File) == 1);
+
+	RECORDINGREADER Reader;
+	RECORDING_FILE_HEADER Changed = Header;
+	Changed.Version = RECORDING_VERSION + 1;
+	rewind(File);
+	fwrite(&Changed, sizeof(Changed), 1, File);
+	fflush(File);
+	CHECK(Reader.Open(stderr, TEST_RECORDING) == DUPL_RETURN_ERROR_UNEXPECTED);
+
+	// What a recording looks like until Close wrote its index
+	Changed = Header;
+	Changed.IndexOffset = 0;
+	Changed.FrameCount = 0;
+	rewind(File);
+	fwrite(&Changed, sizeof(Changed), 1, File);
+	fflush(File);
+	CHECK(Reader.Open(stderr, TEST_RECORDING) == DUPL_RETURN_ERROR_UNEXPECTED);
+	CHECK_EQUAL(0, Reader.GetFrameCount());
+
+	rewind(File);
+	fwrite(&Header, sizeof(Header), 1, File);
+	fclose(File);
+	CHECK(Reader.Open(stderr, TEST_RECORDING) == DUPL_RETURN_SUCCESS);
+	CHECK_EQUAL(1, Reader.GetFrameCount());
+
+	Reader.Close();
+	DeleteFileA(TEST_RECORDING);
+}
+
+int main()
+{
+	RUN_TEST(TestExportRepeat);
+	RUN_TEST(TestFindFrame);
+	RUN_TEST(TestEncodedAndStored);
+	RUN_TEST(TestRejected);
+	return TEST_RESULT();
+}
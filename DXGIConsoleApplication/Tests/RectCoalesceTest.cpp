@@ -0,0 +1,191 @@
+// RectCoalesceTest.cpp : Properties of merged dirty rects checked pixel by pixel against the rects DXGI reported.
+//
+
+#include "TestCommon.h"
+#include "RectCoalesce.h"
+
+#define TEST_WIDTH      128
+#define TEST_HEIGHT     96
+#define TEST_MAX_RECTS  200
+
+static BYTE InputMask[TEST_HEIGHT][TEST_WIDTH];
+static BYTE OutputMask[TEST_HEIGHT][TEST_WIDTH];
+
+static void FillMask(_Out_ BYTE Mask[TEST_HEIGHT][TEST_WIDTH], _In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	memset(Mask, 0, TEST_HEIGHT * TEST_WIDTH);
+	for (UINT i = 0; i < Count; ++i)
+	{
+		for (LONG y = max(Rects[i].top, 0L); y < min(Rects[i].bottom, static_cast<LONG>(TEST_HEIGHT)); ++y)
+		{
+			for (LONG x = max(Rects[i].left, 0L); x < min(Rects[i].right, static_cast<LONG>(TEST_WIDTH)); ++x)
+			{
+				Mask[y][x] = 1;
+			}
+		}
+	}
+}
+
+//
+// Small rects scattered over the grid, some overlapping, some touching and a few empty
+//
+static UINT RandomRects(_Out_writes_(TEST_MAX_RECTS) RECT* Rects, _Inout_ UINT* Random)
+{
+	UINT Count = 1 + TestRandom(Random) % TEST_MAX_RECTS;
+	for (UINT i = 0; i < Count; ++i)
+	{
+		Rects[i].left = TestRandom(Random) % TEST_WIDTH;
+		Rects[i].top = TestRandom(Random) % TEST_HEIGHT;
+		LONG Width = TestRandom(Random) % 24;
+		LONG Height = TestRandom(Random) % 16;
+		Rects[i].right = min(Rects[i].left + Width, static_cast<LONG>(TEST_WIDTH));
+		Rects[i].bottom = min(Rects[i].top + Height, static_cast<LONG>(TEST_HEIGHT));
+	}
+	return Count;
+}
+
+static UINT CountValid(_In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	UINT Valid = 0;
+	for (UINT i = 0; i < Count; ++i)
+	{
+		Valid += (Rects[i].left < Rects[i].right && Rects[i].top < Rects[i].bottom) ? 1 : 0;
+	}
+	return Valid;
+}
+
+//
+// For random rects and cost models: every reported pixel stays covered, no rect is empty or
+// off the grid, there are never more rects than went in, and no merged rect holds a larger share
+// of unreported pixels than the cost model allows
+//
+static void TestCoverageAndWaste()
+{
+	static const COALESCE_PARAMS Models[] = { { 0, 0 }, { 64, 25 }, { COALESCE_DEFAULT_RECT_COST, COALESCE_DEFAULT_WASTE_PERCENT }, { 1 << 20, 90 } };
+	RECT Rects[TEST_MAX_RECTS];
+	UINT Random = 11;
+	for (UINT Round = 0; Round < 400; ++Round)
+	{
+		const COALESCE_PARAMS* Params = &Models[Round % ARRAYSIZE(Models)];
+		UINT Count = RandomRects(Rects, &Random);
+		UINT Valid = CountValid(Rects, Count);
+		FillMask(InputMask, Rects, Count);
+
+		UINT Merged = CoalesceRects(Rects, Count, Params);
+		REQUIRE(Merged <= Valid);
+		FillMask(OutputMask, Rects, Merged);
+
+		UINT Lost = 0;
+		for (UINT y = 0; y < TEST_HEIGHT; ++y)
+		{
+			for (UINT x = 0; x < TEST_WIDTH; ++x)
+			{
+				Lost += (InputMask[y][x] && !OutputMask[y][x]) ? 1 : 0;
+			}
+		}
+		CHECK_EQUAL(0, Lost);
+
+		for (UINT i = 0; i < Merged; ++i)
+		{
+			const RECT* Rect = &Rects[i];
+			CHECK(Rect->left < Rect->right && Rect->top < Rect->bottom);
+			CHECK(Rect->left >= 0 && Rect->top >= 0 && Rect->right <= TEST_WIDTH && Rect->bottom <= TEST_HEIGHT);
+
+			LONGLONG Area = static_cast<LONGLONG>(Rect->right - Rect->left) * (Rect->bottom - Rect->top);
+			LONGLONG Unreported = 0;
+			for (LONG y = Rect->top; y < Rect->bottom; ++y)
+			{
+				for (LONG x = Rect->left; x < Rect->right; ++x)
+				{
+					Unreported += InputMask[y][x] ? 0 : 1;
+				}
+			}
+			if (Unreported * 100 > static_cast<LONGLONG>(Params->MaxWastePercent) * Area)
+			{
+				fprintf(stderr, "Round %u: merged rect %u has %lld of %lld pixels unreported\n", Round, i, Unreported, Area);
+				++TestFailures;
+			}
+		}
+	}
+}
+
+//
+// Overlapping, contained and edge sharing rects merge even when nothing may be wasted
+//
+static void TestFreeMerges()
+{
+	COALESCE_PARAMS NoWaste = { 0, 0 };
+
+	// A line of glyph cells typed one after the other
+	RECT Glyphs[16];
+	for (UINT i = 0; i < ARRAYSIZE(Glyphs); ++i)
+	{
+		SetRect(&Glyphs[ARRAYSIZE(Glyphs) - 1 - i], 10 + i * 8, 20, 18 + i * 8, 36);
+	}
+	CHECK_EQUAL(1, CoalesceRects(Glyphs, ARRAYSIZE(Glyphs), &NoWaste));
+	RECT Line = { 10, 20, 10 + 16 * 8, 36 };
+	CHECK(memcmp(&Glyphs[0], &Line, sizeof(RECT)) == 0);
+
+	// Rects inside each other and the same rect reported twice
+	RECT Nested[] = { { 0, 0, 50, 50 }, { 10, 10, 20, 20 }, { 0, 0, 50, 50 }, { 49, 0, 50, 50 } };
+	CHECK_EQUAL(1, CoalesceRects(Nested, ARRAYSIZE(Nested), &NoWaste));
+
+	// Touching only at a corner, or apart, would waste pixels
+	RECT Corner[] = { { 0, 0, 10, 10 }, { 10, 10, 20, 20 }, { 30, 0, 40, 10 } };
+	CHECK_EQUAL(3, CoalesceRects(Corner, ARRAYSIZE(Corner), &NoWaste));
+
+	// Close enough for the default cost
+	RECT Near[] = { { 0, 0, 10, 10 }, { 12, 0, 22, 10 } };
+	CHECK_EQUAL(1, CoalesceRects(Near, ARRAYSIZE(Near), nullptr));
+	RECT Both = { 0, 0, 22, 10 };
+	CHECK(memcmp(&Near[0], &Both, sizeof(RECT)) == 0);
+}
+
+//
+// Empty rects are dropped and a single rect comes back as it was
+//
+static void TestEmptyAndSingle()
+{
+	RECT Empty[] = { { 5, 5, 5, 10 }, { 5, 5, 10, 5 }, { 10, 10, 5, 20 } };
+	CHECK_EQUAL(0, CoalesceRects(Empty, ARRAYSIZE(Empty), nullptr));
+	CHECK_EQUAL(0, CoalesceRects(Empty, 0, nullptr));
+
+	RECT One[] = { { 5, 5, 5, 10 }, { 1, 2, 3, 4 } };
+	CHECK_EQUAL(1, CoalesceRects(One, ARRAYSIZE(One), nullptr));
+	RECT Expected = { 1, 2, 3, 4 };
+	CHECK(memcmp(&One[0], &Expected, sizeof(RECT)) == 0);
+
+	RECT Area[] = { { 0, 0, 10, 10 }, { 5, 5, 15, 15 }, { 3, 3, 3, 9 } };
+	CHECK_EQUAL(200, GetRectsArea(Area, ARRAYSIZE(Area)));
+}
+
+//
+// Far more rects than the window holds, in reverse order, take the qsort path and merge into
+// one rect per row of cells
+//
+static void TestManyRects()
+{
+	static RECT Cells[TEST_MAX_RECTS];
+	UINT Count = 0;
+	for (UINT Row = 0; Row < 8; ++Row)
+	{
+		for (UINT Column = 0; Column < 25; ++Column)
+		{
+			SetRect(&Cells[TEST_MAX_RECTS - 1 - Count++], Column * 4, Row * 12, Column * 4 + 4, Row * 12 + 8);
+		}
+	}
+
+	COALESCE_PARAMS NoWaste = { 0, 0 };
+	UINT Merged = CoalesceRects(Cells, Count, &NoWaste);
+	CHECK_EQUAL(8, Merged);
+	CHECK_EQUAL(8 * 100 * 8, GetRectsArea(Cells, Merged));
+}
+
+int main()
+{
+	RUN_TEST(TestCoverageAndWaste);
+	RUN_TEST(TestFreeMerges);
+	RUN_TEST(TestEmptyAndSingle);
+	RUN_TEST(TestManyRects);
+	return TEST_RESULT();
+}
@@ -0,0 +1,389 @@
+// RegionCopyTest.cpp : CopyRegions, CopyRegionsRotated and ApplyMoveRects against pixel by pixel references,
+// RotateRects against SetMoveRectForRotation.
+//
+
+#include "TestCommon.h"
+#include "RegionCopy.h"
+
+#define TEST_WIDTH      97
+#define TEST_HEIGHT     61
+
+//
+// Copy the pixels of Rects one at a time, clipped to the image, and count them
+//
+static UINT ReferenceCopy(_Inout_ BYTE* Dst, UINT DstPitch, _In_ const BYTE* Src, UINT SrcPitch, _In_reads_(Count) const RECT* Rects, UINT Count)
+{
+	UINT Bytes = 0;
+	for (UINT i = 0; i < Count; ++i)
+	{
+		for (LONG y = max(Rects[i].top, 0L); y < min(Rects[i].bottom, static_cast<LONG>(TEST_HEIGHT)); ++y)
+		{
+			for (LONG x = max(Rects[i].left, 0L); x < min(Rects[i].right, static_cast<LONG>(TEST_WIDTH)); ++x)
+			{
+				reinterpret_cast<UINT*>(Dst + y * DstPitch)[x] = reinterpret_cast<const UINT*>(Src + y * SrcPitch)[x];
+				Bytes += BPP;
+			}
+		}
+	}
+	return Bytes;
+}
+
+static void RandomRect(_Out_ RECT* Rect, _Inout_ UINT* Random)
+{
+	// Partly outside the image now and then, and empty or inverted now and then
+	Rect->left = static_cast<LONG>(TestRandom(Random) % (TEST_WIDTH + 20)) - 10;
+	Rect->top = static_cast<LONG>(TestRandom(Random) % (TEST_HEIGHT + 20)) - 10;
+	Rect->right = Rect->left + static_cast<LONG>(TestRandom(Random) % (TEST_WIDTH / 2)) - 2;
+	Rect->bottom = Rect->top + static_cast<LONG>(TestRandom(Random) % (TEST_HEIGHT / 2)) - 2;
+}
+
+//
+// Random rects between images of different and equal pitches, the pitch padding and the
+// pixels outside the rects stay as they were
+//
+static void TestCopyRegionsMatchesReference()
+{
+	const UINT Pitches[][2] = { { TEST_WIDTH * BPP, TEST_WIDTH * BPP }, { 512, 512 }, { 512, TEST_WIDTH * BPP }, { TEST_WIDTH * BPP, 448 } };
+	UINT Random = 99;
+
+	for (UINT p = 0; p < ARRAYSIZE(Pitches); ++p)
+	{
+		UINT DstPitch = Pitches[p][0];
+		UINT SrcPitch = Pitches[p][1];
+		BYTE* Src = new BYTE[SrcPitch * TEST_HEIGHT];
+		BYTE* Dst = new BYTE[DstPitch * TEST_HEIGHT];
+		BYTE* Expected = new BYTE[DstPitch * TEST_HEIGHT];
+
+		for (UINT Round = 0; Round < 200; ++Round)
+		{
+			memset(Src, 0x5A, SrcPitch * TEST_HEIGHT);
+			memset(Dst, 0xA5, DstPitch * TEST_HEIGHT);
+			FillTestImage(Src, TEST_WIDTH, TEST_HEIGHT, SrcPitch, Round);
+			FillTestImage(Dst, TEST_WIDTH, TEST_HEIGHT, DstPitch, Round + 1000);
+			memcpy(Expected, Dst, DstPitch * TEST_HEIGHT);
+
+			RECT Rects[6];
+			UINT Count = TestRandom(&Random) % ARRAYSIZE(Rects);
+			for (UINT i = 0; i < Count; ++i)
+			{
+				RandomRect(&Rects[i], &Random);
+			}
+
+			// Overlapping rects are copied twice, which the count reflects
+			UINT ExpectedBytes = ReferenceCopy(Expected, DstPitch, Src, SrcPitch, Rects, Count);
+			UINT Bytes = CopyRegions(Dst, DstPitch, Src, SrcPitch, TEST_WIDTH, TEST_HEIGHT, Rects, Count);
+			CHECK_EQUAL(ExpectedBytes, Bytes);
+			CHECK(memcmp(Expected, Dst, DstPitch * TEST_HEIGHT) == 0);
+		}
+
+		delete [] Src;
+		delete [] Dst;
+		delete [] Expected;
+	}
+}
+
+//
+// Full width rects of equally pitched images take the single block path, it must not
+// run past the last row
+//
+static void TestFullWidthBlock()
+{
+	const UINT Pitch = 512;
+	BYTE* Src = new BYTE[Pitch * TEST_HEIGHT];
+	BYTE* Dst = new BYTE[Pitch * TEST_HEIGHT];
+	BYTE* Expected = new BYTE[Pitch * TEST_HEIGHT];
+	FillTestImage(Src, Pitch / BPP, TEST_HEIGHT, Pitch, 1);
+	FillTestImage(Dst, Pitch / BPP, TEST_HEIGHT, Pitch, 2);
+	memcpy(Expected, Dst, Pitch * TEST_HEIGHT);
+
+	RECT Rect = { 0, 10, TEST_WIDTH, TEST_HEIGHT };
+	ReferenceCopy(Expected, Pitch, Src, Pitch, &Rect, 1);
+	CHECK_EQUAL((TEST_HEIGHT - 10) * TEST_WIDTH * BPP, CopyRegions(Dst, Pitch, Src, Pitch, TEST_WIDTH, TEST_HEIGHT, &Rect, 1));
+
+	// The padding between rows is part of the block, only the padding after the last row is not
+	for (UINT y = 10; y < TEST_HEIGHT - 1; ++y)
+	{
+		memcpy(Expected + y * Pitch + TEST_WIDTH * BPP, Src + y * Pitch + TEST_WIDTH * BPP, Pitch - TEST_WIDTH * BPP);
+	}
+	CHECK(memcmp(Expected, Dst, Pitch * TEST_HEIGHT) == 0);
+
+	delete [] Src;
+	delete [] Dst;
+	delete [] Expected;
+}
+
+//
+// Rects entirely off the image copy nothing
+//
+static void TestRectsOutsideImage()
+{
+	BYTE Src[TEST_WIDTH * BPP * TEST_HEIGHT];
+	BYTE Dst[TEST_WIDTH * BPP * TEST_HEIGHT];
+	memset(Src, 1, sizeof(Src));
+	memset(Dst, 2, sizeof(Dst));
+
+	RECT Rects[] = { { -20, 0, 0, 10 }, { TEST_WIDTH, 0, TEST_WIDTH + 5, 10 }, { 0, TEST_HEIGHT, 10, TEST_HEIGHT + 1 }, { 5, 5, 5, 9 } };
+	CHECK_EQUAL(0, CopyRegions(Dst, TEST_WIDTH * BPP, Src, TEST_WIDTH * BPP, TEST_WIDTH, TEST_HEIGHT, Rects, ARRAYSIZE(Rects)));
+	for (UINT i = 0; i < sizeof(Dst); ++i)
+	{
+		REQUIRE(Dst[i] == 2);
+	}
+}
+
+//
+// Where pixel X, Y of a TexWidth x TexHeight move rect coordinate space lands in a surface laid
+// out for Rotation, the mapping of DISPLAYMANAGER::SetMoveRect
+//
+static POINT RotatePixel(DXGI_MODE_ROTATION Rotation, LONG X, LONG Y, LONG TexWidth, LONG TexHeight)
+{
+	POINT Pixel;
+	switch (Rotation)
+	{
+		case DXGI_MODE_ROTATION_ROTATE90:
+			Pixel.x = TexHeight - 1 - Y;
+			Pixel.y = X;
+			break;
+		case DXGI_MODE_ROTATION_ROTATE180:
+			Pixel.x = TexWidth - 1 - X;
+			Pixel.y = TexHeight - 1 - Y;
+			break;
+		case DXGI_MODE_ROTATION_ROTATE270:
+			Pixel.x = Y;
+			Pixel.y = TexWidth - 1 - X;
+			break;
+		default:
+			Pixel.x = X;
+			Pixel.y = Y;
+			break;
+	}
+	return Pixel;
+}
+
+//
+// Bounding rect of the pixels of Rect once rotated
+//
+static RECT RotateRect(DXGI_MODE_ROTATION Rotation, _In_ const RECT* Rect, LONG TexWidth, LONG TexHeight)
+{
+	POINT First = RotatePixel(Rotation, Rect->left, Rect->top, TexWidth, TexHeight);
+	POINT Last = RotatePixel(Rotation, Rect->right - 1, Rect->bottom - 1, TexWidth, TexHeight);
+	RECT Rotated;
+	Rotated.left = min(First.x, Last.x);
+	Rotated.top = min(First.y, Last.y);
+	Rotated.right = max(First.x, Last.x) + 1;
+	Rotated.bottom = max(First.y, Last.y) + 1;
+	return Rotated;
+}
+
+//
+// Move random blocks in an unrotated image, rotate the result, and compare with the rotated
+// image moved by ApplyMoveRects for each of the four rotations
+//
+static void TestMoveRectsForAllRotations()
+{
+	const DXGI_MODE_ROTATION Rotations[] = { DXGI_MODE_ROTATION_IDENTITY, DXGI_MODE_ROTATION_ROTATE90, DXGI_MODE_ROTATION_ROTATE180, DXGI_MODE_ROTATION_ROTATE270 };
+	const LONG TexWidth = TEST_WIDTH;
+	const LONG TexHeight = TEST_HEIGHT;
+	UINT* Image = new UINT[TexWidth * TexHeight];
+	UINT* Moved = new UINT[TexWidth * TexHeight];
+	UINT* Surface = new UINT[TexWidth * TexHeight];
+	UINT* Expected = new UINT[TexWidth * TexHeight];
+	UINT Random = 4242;
+
+	for (UINT r = 0; r < ARRAYSIZE(Rotations); ++r)
+	{
+		DXGI_MODE_ROTATION Rotation = Rotations[r];
+		bool Portrait = (Rotation == DXGI_MODE_ROTATION_ROTATE90 || Rotation == DXGI_MODE_ROTATION_ROTATE270);
+		LONG SurfaceWidth = Portrait ? TexHeight : TexWidth;
+
+		for (UINT Round = 0; Round < 100; ++Round)
+		{
+			FillTestImage(reinterpret_cast<BYTE*>(Image), TexWidth, TexHeight, TexWidth * BPP, Round);
+
+			DXGI_OUTDUPL_MOVE_RECT Move;
+			LONG Width = 1 + TestRandom(&Random) % (TexWidth / 2);
+			LONG Height = 1 + TestRandom(&Random) % (TexHeight / 2);
+			Move.SourcePoint.x = TestRandom(&Random) % (TexWidth - Width + 1);
+			Move.SourcePoint.y = TestRandom(&Random) % (TexHeight - Height + 1);
+			Move.DestinationRect.left = TestRandom(&Random) % (TexWidth - Width + 1);
+			Move.DestinationRect.top = TestRandom(&Random) % (TexHeight - Height + 1);
+			Move.DestinationRect.right = Move.DestinationRect.left + Width;
+			Move.DestinationRect.bottom = Move.DestinationRect.top + Height;
+
+			// Reference move, reading from an untouched copy so overlap doesn't matter
+			memcpy(Moved, Image, TexWidth * TexHeight * sizeof(UINT));
+			for (LONG y = 0; y < Height; ++y)
+			{
+				for (LONG x = 0; x < Width; ++x)
+				{
+					Moved[(Move.DestinationRect.top + y) * TexWidth + Move.DestinationRect.left + x] = Image[(Move.SourcePoint.y + y) * TexWidth + Move.SourcePoint.x + x];
+				}
+			}
+
+			for (LONG y = 0; y < TexHeight; ++y)
+			{
+				for (LONG x = 0; x < TexWidth; ++x)
+				{
+					POINT Pixel = RotatePixel(Rotation, x, y, TexWidth, TexHeight);
+					Surface[Pixel.y * SurfaceWidth + Pixel.x] = Image[y * TexWidth + x];
+					Expected[Pixel.y * SurfaceWidth + Pixel.x] = Moved[y * TexWidth + x];
+				}
+			}
+
+			// The rects themselves are the rotated source and destination
+			RECT SrcRect;
+			RECT DestRect;
+			RECT Source = { Move.SourcePoint.x, Move.SourcePoint.y, Move.SourcePoint.x + Width, Move.SourcePoint.y + Height };
+			SetMoveRectForRotation(&SrcRect, &DestRect, Rotation, &Move, TexWidth, TexHeight);
+			RECT ExpectedSrc = RotateRect(Rotation, &Source, TexWidth, TexHeight);
+			RECT ExpectedDest = RotateRect(Rotation, &Move.DestinationRect, TexWidth, TexHeight);
+			CHECK(memcmp(&ExpectedSrc, &SrcRect, sizeof(RECT)) == 0);
+			CHECK(memcmp(&ExpectedDest, &DestRect, sizeof(RECT)) == 0);
+
+			UINT Bytes = ApplyMoveRects(reinterpret_cast<BYTE*>(Surface), SurfaceWidth * BPP, SurfaceWidth, (TexWidth * TexHeight) / SurfaceWidth, &Move, 1, Rotation, TexWidth, TexHeight);
+			CHECK_EQUAL(Width * Height * BPP, Bytes);
+			if (memcmp(Expected, Surface, TexWidth * TexHeight * sizeof(UINT)) != 0)
+			{
+				fprintf(stderr, "Rotation %d round %u: moved surface differs\n", Rotation, Round);
+				++TestFailures;
+			}
+		}
+	}
+
+	delete [] Image;
+	delete [] Moved;
+	delete [] Surface;
+	delete [] Expected;
+}
+
+//
+// Random rects of an acquired image copied upright for each rotation, into a surface that is
+// sometimes smaller than the rotated image. The pixels outside the rects and the pitch padding
+// stay as they were.
+//
+static void TestCopyRegionsRotated()
+{
+	const DXGI_MODE_ROTATION Rotations[] = { DXGI_MODE_ROTATION_IDENTITY, DXGI_MODE_ROTATION_ROTATE90, DXGI_MODE_ROTATION_ROTATE180, DXGI_MODE_ROTATION_ROTATE270 };
+	const LONG TexWidth = TEST_WIDTH;
+	const LONG TexHeight = TEST_HEIGHT;
+	const UINT SrcPitch = TexWidth * BPP + 12;
+	const UINT DstPitch = max(TexWidth, TexHeight) * BPP + 20;
+	BYTE* Src = new BYTE[SrcPitch * TexHeight];
+	BYTE* Dst = new BYTE[DstPitch * max(TexWidth, TexHeight)];
+	BYTE* Expected = new BYTE[DstPitch * max(TexWidth, TexHeight)];
+	UINT Random = 808;
+
+	for (UINT r = 0; r < ARRAYSIZE(Rotations); ++r)
+	{
+		DXGI_MODE_ROTATION Rotation = Rotations[r];
+		bool Portrait = (Rotation == DXGI_MODE_ROTATION_ROTATE90 || Rotation == DXGI_MODE_ROTATION_ROTATE270);
+
+		for (UINT Round = 0; Round < 100; ++Round)
+		{
+			LONG DstWidth = (Portrait ? TexHeight : TexWidth) - ((Round & 1) ? 7 : 0);
+			LONG DstHeight = (Portrait ? TexWidth : TexHeight) - ((Round & 2) ? 5 : 0);
+			memset(Dst, 0xA5, DstPitch * max(TexWidth, TexHeight));
+			memset(Expected, 0xA5, DstPitch * max(TexWidth, TexHeight));
+			FillTestImage(Src, TexWidth, TexHeight, SrcPitch, Round);
+
+			RECT Rects[3];
+			UINT Count = 1 + TestRandom(&Random) % ARRAYSIZE(Rects);
+			UINT ExpectedBytes = 0;
+			for (UINT i = 0; i < Count; ++i)
+			{
+				RandomRect(&Rects[i], &Random);
+			}
+			for (LONG y = 0; y < TexHeight; ++y)
+			{
+				for (LONG x = 0; x < TexWidth; ++x)
+				{
+					bool Inside = false;
+					for (UINT i = 0; i < Count; ++i)
+					{
+						Inside = Inside || (x >= Rects[i].left && x < Rects[i].right && y >= Rects[i].top && y < Rects[i].bottom);
+					}
+					POINT Pixel = RotatePixel(Rotation, x, y, TexWidth, TexHeight);
+					if (Inside && Pixel.x < DstWidth && Pixel.y < DstHeight)
+					{
+						reinterpret_cast<UINT*>(Expected + Pixel.y * DstPitch)[Pixel.x] = reinterpret_cast<const UINT*>(Src + y * SrcPitch)[x];
+					}
+				}
+			}
+
+			// Overlapping rects count once per rect, like CopyRegions
+			for (UINT i = 0; i < Count; ++i)
+			{
+				RECT Image = { 0, 0, TexWidth, TexHeight };
+				RECT Clipped;
+				if (IntersectRect(&Clipped, &Rects[i], &Image))
+				{
+					RECT Rotated = RotateRect(Rotation, &Clipped, TexWidth, TexHeight);
+					LONG Width = min(Rotated.right, DstWidth) - Rotated.left;
+					LONG Height = min(Rotated.bottom, DstHeight) - Rotated.top;
+					ExpectedBytes += (Width > 0 && Height > 0) ? Width * Height * BPP : 0;
+				}
+			}
+
+			UINT Bytes = CopyRegionsRotated(Dst, DstPitch, DstWidth, DstHeight, Src, SrcPitch, TexWidth, TexHeight, Rotation, Rects, Count);
+			CHECK_EQUAL(ExpectedBytes, Bytes);
+			if (memcmp(Expected, Dst, DstPitch * max(TexWidth, TexHeight)) != 0)
+			{
+				fprintf(stderr, "Rotation %d round %u: rotated copy differs\n", Rotation, Round);
+				++TestFailures;
+			}
+		}
+	}
+
+	delete [] Src;
+	delete [] Dst;
+	delete [] Expected;
+}
+
+//
+// A batch of random rects, some reaching past the image, mapped at once for each rotation and in
+// place, against the destination SetMoveRectForRotation gives each of them
+//
+static void TestRotateRects()
+{
+	const DXGI_MODE_ROTATION Rotations[] = { DXGI_MODE_ROTATION_UNSPECIFIED, DXGI_MODE_ROTATION_IDENTITY, DXGI_MODE_ROTATION_ROTATE90, DXGI_MODE_ROTATION_ROTATE180, DXGI_MODE_ROTATION_ROTATE270 };
+	RECT Rects[37];
+	RECT Rotated[ARRAYSIZE(Rects)];
+	UINT Random = 515;
+
+	for (UINT r = 0; r < ARRAYSIZE(Rotations); ++r)
+	{
+		DXGI_MODE_ROTATION Rotation = Rotations[r];
+		for (UINT Round = 0; Round < 20; ++Round)
+		{
+			for (UINT i = 0; i < ARRAYSIZE(Rects); ++i)
+			{
+				RandomRect(&Rects[i], &Random);
+			}
+
+			RotateRects(Rotated, Rects, ARRAYSIZE(Rects), Rotation, TEST_WIDTH, TEST_HEIGHT);
+			for (UINT i = 0; i < ARRAYSIZE(Rects); ++i)
+			{
+				DXGI_OUTDUPL_MOVE_RECT Move;
+				RtlZeroMemory(&Move, sizeof(Move));
+				Move.DestinationRect = Rects[i];
+				RECT Unused;
+				RECT Expected;
+				SetMoveRectForRotation(&Unused, &Expected, Rotation, &Move, TEST_WIDTH, TEST_HEIGHT);
+				CHECK(memcmp(&Expected, &Rotated[i], sizeof(RECT)) == 0);
+			}
+
+			RotateRects(Rects, Rects, ARRAYSIZE(Rects), Rotation, TEST_WIDTH, TEST_HEIGHT);
+			CHECK(memcmp(Rotated, Rects, sizeof(Rects)) == 0);
+		}
+	}
+}
+
+int main()
+{
+	RUN_TEST(TestCopyRegionsMatchesReference);
+	RUN_TEST(TestFullWidthBlock);
+	RUN_TEST(TestRectsOutsideImage);
+	RUN_TEST(TestMoveRectsForAllRotations);
+	RUN_TEST(TestCopyRegionsRotated);
+	RUN_TEST(TestRotateRects);
+	return TEST_RESULT();
+}
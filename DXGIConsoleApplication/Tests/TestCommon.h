@@ -0,0 +1,84 @@
+// TestCommon.h : Checks shared by the tests in this directory. Every XxxTest.cpp is its own
+// executable that runs its test functions with RUN_TEST and returns TEST_RESULT().
+//
+
+#ifndef _TESTCOMMON_H_
+#define _TESTCOMMON_H_
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static UINT TestFailures = 0;
+
+// Report a failed check and keep going, so one run shows every broken expectation
+#define CHECK(Condition) \
+	do \
+	{ \
+		if (!(Condition)) \
+		{ \
+			fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #Condition); \
+			++TestFailures; \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(Expected, Actual) \
+	do \
+	{ \
+		long long ExpectedValue = static_cast<long long>(Expected); \
+		long long ActualValue = static_cast<long long>(Actual); \
+		if (ExpectedValue != ActualValue) \
+		{ \
+			fprintf(stderr, "%s(%d): CHECK_EQUAL(%s, %s) failed, expected %lld but got %lld\n", __FILE__, __LINE__, #Expected, #Actual, ExpectedValue, ActualValue); \
+			++TestFailures; \
+		} \
+	} while (0)
+
+// Stop the test function, for checks the rest of it depends on
+#define REQUIRE(Condition) \
+	do \
+	{ \
+		if (!(Condition)) \
+		{ \
+			fprintf(stderr, "%s(%d): REQUIRE(%s) failed\n", __FILE__, __LINE__, #Condition); \
+			++TestFailures; \
+			return; \
+		} \
+	} while (0)
+
+#define RUN_TEST(Test) \
+	do \
+	{ \
+		UINT FailuresBefore = TestFailures; \
+		Test(); \
+		printf("%-48s %s\n", #Test, (TestFailures == FailuresBefore) ? "passed" : "FAILED"); \
+	} while (0)
+
+#define TEST_RESULT() (TestFailures ? 1 : 0)
+
+//
+// Deterministic pseudo random numbers, tests must fail the same way every run
+//
+static inline UINT TestRandom(_Inout_ UINT* State)
+{
+	*State = *State * 1664525 + 1013904223;
+	return *State >> 8;
+}
+
+//
+// Fill a 32bpp image with a pattern that differs for every Seed
+//
+static inline void FillTestImage(_Out_writes_bytes_(Pitch * Height) BYTE* Data, UINT Width, UINT Height, UINT Pitch, UINT Seed)
+{
+	for (UINT y = 0; y < Height; ++y)
+	{
+		UINT* Row = reinterpret_cast<UINT*>(Data + y * Pitch);
+		for (UINT x = 0; x < Width; ++x)
+		{
+			Row[x] = (Seed * 0x9E3779B1) ^ (y * 0x10001) ^ (x * 0x3F1);
+		}
+	}
+}
+
+#endif